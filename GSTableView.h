@@ -17,5 +17,6 @@
 - (void) setVisibleColumns:(NSArray*) identifiers;
 - (void) toggleColumnWithIdentifier:(NSString *)identifier;
 - (NSArray *) visibleColumnIdentifiers;
+- (NSArray *) allTableColumns;
 
 @end
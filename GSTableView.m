@@ -118,6 +118,12 @@
     return outIdentifiers;
 }
 
+//! All columns, including hidden ones.
+- (NSArray *) allTableColumns
+{
+    return [tableColumnCache allValues];
+}
+
 
 //! Standard 1st responder implementation.
 - (void) keyDown: (NSEvent *) event
@@ -0,0 +1,83 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusScheduler.h"
+#import "GeniusReviewLog.h"
+
+@class GeniusPair;
+@class GeniusTimingWheel;
+
+//! Number of entries filled in by GeniusAnalytics#getScoreCounts:useAB:useBA:, one for never quizzed plus one per score.
+#define kGeniusAnalyticsScoreBucketCount (kGeniusSchedulerMaximumScore+2)
+
+//! Right and total answer counts of one group, type or pair.
+typedef struct _GeniusRetentionCounts {
+    unsigned int rightCount;
+    unsigned int reviewCount;
+} GeniusRetentionCounts;
+
+//! Deck statistics kept up to date from individual changes instead of rescanning the deck.
+/*!
+    The owner reports associations entering and leaving the deck, score and importance changes, and
+    every answer given in a quiz.  Queries then cost time proportional to the number of score buckets,
+    forecast days or groups, never to the size of the deck.
+
+    Score counts only cover enabled pairs and are kept per direction, matching what
+    GeniusPair#associationsForPairs:useAB:useBA: returns.  Retention is the share of right answers,
+    attributed to the group and type each pair has now.  The log doesn't keep them, so the counts of
+    every pair are kept as well and moved to the new group or type when the owner reports a change.
+    The owner marks retention stale when the log moved, and it is rebuilt from the GeniusReviewLog on
+    the next query.
+ */
+@interface GeniusAnalytics : NSObject {
+    unsigned int _scoreCounts[2][kGeniusAnalyticsScoreBucketCount];   //!< Enabled associations by direction (AB, BA) and score+1.
+    GeniusTimingWheel * _dueIndex;              //!< Source of the due forecast.
+    NSMutableDictionary * _groupRetention;      //!< Group string -> NSMutableData holding GeniusRetentionCounts.
+    NSMutableDictionary * _typeRetention;       //!< Type string -> NSMutableData holding GeniusRetentionCounts.
+    NSMutableDictionary * _pairRetention;       //!< GeniusPair#pairID NSNumber -> NSMutableData holding GeniusRetentionCounts.
+    BOOL _retentionIsStale;                     //!< YES until #rebuildRetentionFromLog:pairs: has run.
+}
+
+- (id) initWithDueIndex:(GeniusTimingWheel *)dueIndex;
+
+// Model changes
+- (void) addAssociation:(GeniusAssociation *)association;
+- (void) removeAssociation:(GeniusAssociation *)association;
+- (void) removeAllAssociations;
+- (void) association:(GeniusAssociation *)association didChangeScoreFrom:(int)oldScore;
+- (void) pair:(GeniusPair *)pair didChangeImportanceFrom:(int)oldImportance;
+- (void) pair:(GeniusPair *)pair didChangeGroupFrom:(NSString *)oldGroup;
+- (void) pair:(GeniusPair *)pair didChangeTypeFrom:(NSString *)oldType;
+
+// Review events
+- (void) recordReview:(const GeniusReviewRecord *)record ofAssociation:(GeniusAssociation *)association;
+- (BOOL) retentionIsStale;
+- (void) invalidateRetention;
+- (void) rebuildRetentionFromLog:(GeniusReviewLog *)reviewLog pairs:(NSArray *)pairs;
+
+// Queries
+- (void) getScoreCounts:(unsigned int *)counts useAB:(BOOL)useAB useBA:(BOOL)useBA;
+- (unsigned int) associationCountUseAB:(BOOL)useAB useBA:(BOOL)useBA;
+- (unsigned int) learnedCountUseAB:(BOOL)useAB useBA:(BOOL)useBA;
+- (void) getDueForecast:(unsigned int *)counts forDays:(unsigned int)dayCount;
+- (NSDictionary *) retentionByGroup;
+- (NSDictionary *) retentionByType;
+
+@end
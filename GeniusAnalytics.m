@@ -0,0 +1,357 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusAnalytics.h"
+#import "GeniusAssociation.h"
+#import "GeniusPair.h"
+#import "GeniusTimingWheel.h"
+
+//! Index into a score count row for @a score.  Never quizzed is 0, scores above the maximum share the last bucket.
+static unsigned int ScoreBucket(int score)
+{
+    if (score < -1)
+        score = -1;
+    return MIN(score, kGeniusSchedulerMaximumScore) + 1;
+}
+
+//! 0 for GeniusPair#associationAB, 1 for GeniusPair#associationBA.
+static unsigned int Direction(GeniusAssociation * association)
+{
+    return ([[association parentPair] associationAB] == association) ? 0 : 1;
+}
+
+//! Association identifier and object, sorted by identifier for lookups while scanning the review log.
+typedef struct _GeniusAnalyticsLookupEntry {
+    GeniusAssociationID associationID;
+    GeniusAssociation * association;
+} GeniusAnalyticsLookupEntry;
+
+//! State passed through GeniusReviewLog#scanRecordsWithFunction:context: by #rebuildRetentionFromLog:pairs:.
+typedef struct _GeniusAnalyticsRebuildContext {
+    GeniusAnalytics * analytics;
+    GeniusAnalyticsLookupEntry * entries;
+    unsigned int count;
+} GeniusAnalyticsRebuildContext;
+
+//! qsort() comparison for GeniusAnalyticsLookupEntry.
+static int CompareLookupEntries(const void * entry1, const void * entry2)
+{
+    GeniusAssociationID id1 = ((const GeniusAnalyticsLookupEntry *)entry1)->associationID;
+    GeniusAssociationID id2 = ((const GeniusAnalyticsLookupEntry *)entry2)->associationID;
+    return (id1 < id2) ? -1 : (id1 > id2);
+}
+
+//! Binary search of @a entries for @a associationID.  Returns nil if there is none.
+static GeniusAssociation * LookupAssociation(const GeniusAnalyticsLookupEntry * entries, unsigned int count, GeniusAssociationID associationID)
+{
+    unsigned int low = 0, high = count;
+    while (low < high)
+    {
+        unsigned int middle = (low + high) / 2;
+        if (entries[middle].associationID < associationID)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < count && entries[low].associationID == associationID)
+        return entries[low].association;
+    return nil;
+}
+
+
+@interface GeniusAnalytics (Private)
+- (void) _addRightCount:(int)rightCount reviewCount:(int)reviewCount forKey:(id)key inDictionary:(NSMutableDictionary *)dictionary;
+- (void) _moveRetentionOfPair:(GeniusPair *)pair fromKey:(NSString *)oldKey toKey:(NSString *)newKey inDictionary:(NSMutableDictionary *)dictionary;
+- (void) _countReview:(const GeniusReviewRecord *)record ofAssociation:(GeniusAssociation *)association;
+- (NSDictionary *) _retentionFromDictionary:(NSDictionary *)dictionary;
+@end
+
+//! Scan function used by #rebuildRetentionFromLog:pairs:.
+static void RebuildRetention(const GeniusReviewRecord * records, unsigned int count, void * context)
+{
+    GeniusAnalyticsRebuildContext * rebuild = (GeniusAnalyticsRebuildContext *)context;
+    unsigned int i;
+    for (i=0; i<count; i++)
+    {
+        GeniusAssociation * association = LookupAssociation(rebuild->entries, rebuild->count, records[i].associationID);
+        if (association)
+            [rebuild->analytics _countReview:&records[i] ofAssociation:association];
+    }
+}
+
+
+@implementation GeniusAnalytics
+
+//! Designated initializer.  @a dueIndex answers forecast queries and is retained.
+- (id) initWithDueIndex:(GeniusTimingWheel *)dueIndex
+{
+    self = [super init];
+    if (self != nil) {
+        _dueIndex = [dueIndex retain];
+        _groupRetention = [[NSMutableDictionary alloc] init];
+        _typeRetention = [[NSMutableDictionary alloc] init];
+        _pairRetention = [[NSMutableDictionary alloc] init];
+        _retentionIsStale = YES;
+        [self removeAllAssociations];
+    }
+    return self;
+}
+
+//! Releases the due index and retention tables, deallocates memory.
+- (void) dealloc
+{
+    [_dueIndex release];
+    [_groupRetention release];
+    [_typeRetention release];
+    [_pairRetention release];
+    [super dealloc];
+}
+
+//! Counts @a association, which just became part of the deck.
+- (void) addAssociation:(GeniusAssociation *)association
+{
+    if ([[association parentPair] disabled])
+        return;
+    _scoreCounts[Direction(association)][ScoreBucket([association score])]++;
+}
+
+//! Stops counting @a association, which is about to leave the deck.
+- (void) removeAssociation:(GeniusAssociation *)association
+{
+    if ([[association parentPair] disabled])
+        return;
+    _scoreCounts[Direction(association)][ScoreBucket([association score])]--;
+}
+
+//! Forgets all associations.  Retention is kept since it describes past answers.
+- (void) removeAllAssociations
+{
+    memset(_scoreCounts, 0, sizeof(_scoreCounts));
+}
+
+//! Moves @a association from the bucket of @a oldScore to the bucket of its current score.
+- (void) association:(GeniusAssociation *)association didChangeScoreFrom:(int)oldScore
+{
+    if ([[association parentPair] disabled])
+        return;
+    unsigned int direction = Direction(association);
+    _scoreCounts[direction][ScoreBucket(oldScore)]--;
+    _scoreCounts[direction][ScoreBucket([association score])]++;
+}
+
+//! Adds or removes the associations of @a pair when it is enabled or disabled.
+- (void) pair:(GeniusPair *)pair didChangeImportanceFrom:(int)oldImportance
+{
+    BOOL wasDisabled = (oldImportance == kGeniusPairDisabledImportance);
+    BOOL isDisabled = [pair disabled];
+    if (wasDisabled == isDisabled)
+        return;
+
+    int step = (isDisabled ? -1 : 1);
+    _scoreCounts[0][ScoreBucket([[pair associationAB] score])] += step;
+    _scoreCounts[1][ScoreBucket([[pair associationBA] score])] += step;
+}
+
+//! Moves the past answers of @a pair from @a oldGroup to its current group.
+/*! Nothing to do while retention is stale, the rebuild uses the current group. */
+- (void) pair:(GeniusPair *)pair didChangeGroupFrom:(NSString *)oldGroup
+{
+    if (_retentionIsStale)
+        return;
+    [self _moveRetentionOfPair:pair fromKey:oldGroup toKey:[pair customGroupString] inDictionary:_groupRetention];
+}
+
+//! Moves the past answers of @a pair from @a oldType to its current type.
+/*! Nothing to do while retention is stale, the rebuild uses the current type. */
+- (void) pair:(GeniusPair *)pair didChangeTypeFrom:(NSString *)oldType
+{
+    if (_retentionIsStale)
+        return;
+    [self _moveRetentionOfPair:pair fromKey:oldType toKey:[pair customTypeString] inDictionary:_typeRetention];
+}
+
+//! Counts an answer just given for @a association.
+/*! Ignored while retention is stale, since the rebuild will find the record in the log. */
+- (void) recordReview:(const GeniusReviewRecord *)record ofAssociation:(GeniusAssociation *)association
+{
+    if (_retentionIsStale)
+        return;
+    [self _countReview:record ofAssociation:association];
+}
+
+//! _retentionIsStale getter.
+- (BOOL) retentionIsStale
+{
+    return _retentionIsStale;
+}
+
+//! Marks retention as needing #rebuildRetentionFromLog:pairs:.
+- (void) invalidateRetention
+{
+    _retentionIsStale = YES;
+}
+
+//! Recounts retention from every record in @a reviewLog.
+/*!
+    Records are matched to the associations of @a pairs through a sorted identifier table, so the
+    whole log is read in one sequential pass.  Records of associations no longer in the deck are ignored.
+*/
+- (void) rebuildRetentionFromLog:(GeniusReviewLog *)reviewLog pairs:(NSArray *)pairs
+{
+    [_groupRetention removeAllObjects];
+    [_typeRetention removeAllObjects];
+    [_pairRetention removeAllObjects];
+
+    GeniusAnalyticsRebuildContext context;
+    context.analytics = self;
+    context.count = [pairs count] * 2;
+    context.entries = (GeniusAnalyticsLookupEntry *)malloc(MAX(context.count, 1U) * sizeof(GeniusAnalyticsLookupEntry));
+
+    unsigned int i = 0;
+    NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+    {
+        context.entries[i].association = [pair associationAB];
+        context.entries[i++].associationID = [[pair associationAB] associationID];
+        context.entries[i].association = [pair associationBA];
+        context.entries[i++].associationID = [[pair associationBA] associationID];
+    }
+    qsort(context.entries, context.count, sizeof(GeniusAnalyticsLookupEntry), CompareLookupEntries);
+
+    [reviewLog scanRecordsWithFunction:RebuildRetention context:&context];
+    free(context.entries);
+
+    _retentionIsStale = NO;
+}
+
+//! Fills @a counts with the number of enabled associations per score bucket.
+/*!
+    @a counts must hold kGeniusAnalyticsScoreBucketCount entries: never quizzed first, then scores 0 and up.
+    @a useAB and @a useBA select the directions to include.
+*/
+- (void) getScoreCounts:(unsigned int *)counts useAB:(BOOL)useAB useBA:(BOOL)useBA
+{
+    unsigned int b;
+    for (b=0; b<kGeniusAnalyticsScoreBucketCount; b++)
+        counts[b] = (useAB ? _scoreCounts[0][b] : 0) + (useBA ? _scoreCounts[1][b] : 0);
+}
+
+//! Number of enabled associations in the selected directions.
+- (unsigned int) associationCountUseAB:(BOOL)useAB useBA:(BOOL)useBA
+{
+    unsigned int counts[kGeniusAnalyticsScoreBucketCount];
+    [self getScoreCounts:counts useAB:useAB useBA:useBA];
+
+    unsigned int total = 0, b;
+    for (b=0; b<kGeniusAnalyticsScoreBucketCount; b++)
+        total += counts[b];
+    return total;
+}
+
+//! Number of enabled associations in the selected directions that have been quizzed at least once.
+- (unsigned int) learnedCountUseAB:(BOOL)useAB useBA:(BOOL)useBA
+{
+    unsigned int counts[kGeniusAnalyticsScoreBucketCount];
+    [self getScoreCounts:counts useAB:useAB useBA:useBA];
+    return [self associationCountUseAB:useAB useBA:useBA] - counts[0];
+}
+
+//! Number of associations falling due on each of the next @a dayCount days, today first including overdue ones.
+- (void) getDueForecast:(unsigned int *)counts forDays:(unsigned int)dayCount
+{
+    [_dueIndex advanceToTime:GeniusTimeNow()];
+    [_dueIndex getDueCounts:counts forDays:dayCount];
+}
+
+//! Group string -> NSNumber with the share of right answers.  Pairs without group are under the empty string.
+- (NSDictionary *) retentionByGroup
+{
+    return [self _retentionFromDictionary:_groupRetention];
+}
+
+//! Type string -> NSNumber with the share of right answers.  Pairs without type are under the empty string.
+- (NSDictionary *) retentionByType
+{
+    return [self _retentionFromDictionary:_typeRetention];
+}
+
+@end
+
+
+@implementation GeniusAnalytics (Private)
+
+//! Adds @a rightCount and @a reviewCount, either of which may be negative, to the counts under @a key.
+/*! Keys left without answers are removed, so they don't show up with a ratio of 0. */
+- (void) _addRightCount:(int)rightCount reviewCount:(int)reviewCount forKey:(id)key inDictionary:(NSMutableDictionary *)dictionary
+{
+    if (key == nil)
+        key = @"";
+    NSMutableData * data = [dictionary objectForKey:key];
+    if (data == nil)
+    {
+        data = [NSMutableData dataWithLength:sizeof(GeniusRetentionCounts)];
+        [dictionary setObject:data forKey:key];
+    }
+    GeniusRetentionCounts * counts = [data mutableBytes];
+    counts->rightCount += rightCount;
+    counts->reviewCount += reviewCount;
+    if (counts->reviewCount == 0)
+        [dictionary removeObjectForKey:key];
+}
+
+//! Moves the answers counted for @a pair from @a oldKey to @a newKey of @a dictionary.
+- (void) _moveRetentionOfPair:(GeniusPair *)pair fromKey:(NSString *)oldKey toKey:(NSString *)newKey inDictionary:(NSMutableDictionary *)dictionary
+{
+    NSData * data = [_pairRetention objectForKey:[NSNumber numberWithUnsignedLongLong:[pair pairID]]];
+    if (data == nil)
+        return;
+    const GeniusRetentionCounts * counts = [data bytes];
+    int rightCount = counts->rightCount, reviewCount = counts->reviewCount;
+    [self _addRightCount:-rightCount reviewCount:-reviewCount forKey:oldKey inDictionary:dictionary];
+    [self _addRightCount:rightCount reviewCount:reviewCount forKey:newKey inDictionary:dictionary];
+}
+
+//! Counts @a record for the pair of @a association and its current group and type.  Skips are not answers.
+- (void) _countReview:(const GeniusReviewRecord *)record ofAssociation:(GeniusAssociation *)association
+{
+    if (record->outcome == GeniusReviewOutcomeSkip)
+        return;
+    GeniusPair * pair = [association parentPair];
+    int rightCount = (record->outcome == GeniusReviewOutcomeRight);
+    [self _addRightCount:rightCount reviewCount:1 forKey:[pair customGroupString] inDictionary:_groupRetention];
+    [self _addRightCount:rightCount reviewCount:1 forKey:[pair customTypeString] inDictionary:_typeRetention];
+    [self _addRightCount:rightCount reviewCount:1 forKey:[NSNumber numberWithUnsignedLongLong:[pair pairID]] inDictionary:_pairRetention];
+}
+
+//! Converts a table of GeniusRetentionCounts into right answer ratios.
+- (NSDictionary *) _retentionFromDictionary:(NSDictionary *)dictionary
+{
+    NSMutableDictionary * retention = [NSMutableDictionary dictionaryWithCapacity:[dictionary count]];
+    NSEnumerator * keyEnumerator = [dictionary keyEnumerator];
+    NSString * key;
+    while ((key = [keyEnumerator nextObject]))
+    {
+        const GeniusRetentionCounts * counts = [[dictionary objectForKey:key] bytes];
+        float ratio = (counts->reviewCount ? (float)counts->rightCount / (float)counts->reviewCount : 0.0);
+        [retention setObject:[NSNumber numberWithFloat:ratio] forKey:key];
+    }
+    return retention;
+}
+
+@end
@@ -0,0 +1,148 @@
+//
+//  GeniusAnalyticsTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusAnalytics.h"
+#import "GeniusTimingWheel.h"
+#import "GeniusPair.h"
+
+@interface GeniusAnalyticsTest : SenTestCase {
+    GeniusTimingWheel *wheel;       //!< Due index backing the forecast.
+    GeniusAnalytics *analytics;     //!< The object under test.
+    NSMutableArray *pairs;          //!< Pairs counted by #analytics.
+}
+
+@end
+
+//! Tests for the incrementally maintained GeniusAnalytics counts.
+@implementation GeniusAnalyticsTest
+
+//! Creates analytics over three fresh pairs.
+- (void) setUp
+{
+    wheel = [[GeniusTimingWheel alloc] initWithTime:GeniusTimeNow()];
+    analytics = [[GeniusAnalytics alloc] initWithDueIndex:wheel];
+    pairs = [[NSMutableArray alloc] init];
+
+    int i;
+    for (i=0; i<3; i++)
+    {
+        GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+        [pairs addObject:pair];
+        [analytics addAssociation:[pair associationAB]];
+        [analytics addAssociation:[pair associationBA]];
+    }
+}
+
+//! Releases analytics, wheel and pairs.
+- (void) tearDown
+{
+    [analytics release];
+    analytics = nil;
+    [wheel release];
+    wheel = nil;
+    [pairs release];
+    pairs = nil;
+}
+
+//! Score changes and disabling pairs move counts between buckets.
+- (void) testScoreCounts
+{
+    STAssertEquals([analytics associationCountUseAB:YES useBA:NO], 3U, nil);
+    STAssertEquals([analytics associationCountUseAB:YES useBA:YES], 6U, nil);
+    STAssertEquals([analytics learnedCountUseAB:YES useBA:YES], 0U, nil);
+
+    GeniusAssociation * association = [[pairs objectAtIndex:0] associationAB];
+    [association setScore:2];
+    [analytics association:association didChangeScoreFrom:-1];
+
+    unsigned int counts[kGeniusAnalyticsScoreBucketCount];
+    [analytics getScoreCounts:counts useAB:YES useBA:NO];
+    STAssertEquals(counts[0], 2U, nil);
+    STAssertEquals(counts[3], 1U, nil);
+    STAssertEquals([analytics learnedCountUseAB:YES useBA:NO], 1U, nil);
+    STAssertEquals([analytics learnedCountUseAB:NO useBA:YES], 0U, nil);
+
+    GeniusPair * pair = [pairs objectAtIndex:0];
+    int importance = [pair importance];
+    [pair setImportance:kGeniusPairDisabledImportance];
+    [analytics pair:pair didChangeImportanceFrom:importance];
+    STAssertEquals([analytics associationCountUseAB:YES useBA:YES], 4U, nil);
+    STAssertEquals([analytics learnedCountUseAB:YES useBA:YES], 0U, nil);
+
+    [pair setImportance:importance];
+    [analytics pair:pair didChangeImportanceFrom:kGeniusPairDisabledImportance];
+    STAssertEquals([analytics learnedCountUseAB:YES useBA:YES], 1U, nil);
+
+    [analytics removeAssociation:association];
+    STAssertEquals([analytics learnedCountUseAB:YES useBA:YES], 0U, nil);
+}
+
+//! Answers are counted per group once retention has been built.
+- (void) testRetention
+{
+    GeniusPair * pair = [pairs objectAtIndex:1];
+    [pair setCustomGroupString:@"verbs"];
+
+    GeniusReviewRecord record;
+    record.associationID = [[pair associationAB] associationID];
+    record.time = GeniusTimeNow();
+    record.responseMilliseconds = 1500;
+    record.matchScore = 1.0;
+    record.outcome = GeniusReviewOutcomeRight;
+    record.flags = 0;
+
+    [analytics recordReview:&record ofAssociation:[pair associationAB]];
+    STAssertEquals([[analytics retentionByGroup] count], 0U, @"ignored while stale");
+
+    [analytics rebuildRetentionFromLog:nil pairs:pairs];
+    [analytics recordReview:&record ofAssociation:[pair associationAB]];
+    record.outcome = GeniusReviewOutcomeWrong;
+    [analytics recordReview:&record ofAssociation:[pair associationAB]];
+    record.outcome = GeniusReviewOutcomeSkip;
+    [analytics recordReview:&record ofAssociation:[pair associationAB]];
+
+    STAssertEquals([[[analytics retentionByGroup] objectForKey:@"verbs"] floatValue], 0.5f, nil);
+    STAssertEquals([[[analytics retentionByType] objectForKey:@""] floatValue], 0.5f, nil);
+}
+
+//! Past answers follow a pair to its new group without rescanning the log.
+- (void) testRetentionFollowsGroupChange
+{
+    GeniusPair * pair = [pairs objectAtIndex:0];
+    [pair setCustomGroupString:@"verbs"];
+    [[pairs objectAtIndex:1] setCustomGroupString:@"verbs"];
+    [analytics rebuildRetentionFromLog:nil pairs:pairs];
+
+    GeniusReviewRecord record;
+    record.associationID = [[pair associationAB] associationID];
+    record.time = GeniusTimeNow();
+    record.responseMilliseconds = 1500;
+    record.matchScore = 1.0;
+    record.outcome = GeniusReviewOutcomeRight;
+    record.flags = 0;
+    [analytics recordReview:&record ofAssociation:[pair associationAB]];
+
+    record.associationID = [[[pairs objectAtIndex:1] associationAB] associationID];
+    record.outcome = GeniusReviewOutcomeWrong;
+    [analytics recordReview:&record ofAssociation:[[pairs objectAtIndex:1] associationAB]];
+    STAssertEquals([[[analytics retentionByGroup] objectForKey:@"verbs"] floatValue], 0.5f, nil);
+
+    [pair setCustomGroupString:@"nouns"];
+    [analytics pair:pair didChangeGroupFrom:@"verbs"];
+    STAssertFalse([analytics retentionIsStale], nil);
+    STAssertEquals([[[analytics retentionByGroup] objectForKey:@"verbs"] floatValue], 0.0f, nil);
+    STAssertEquals([[[analytics retentionByGroup] objectForKey:@"nouns"] floatValue], 1.0f, nil);
+
+    [pair setCustomTypeString:@"easy"];
+    [analytics pair:pair didChangeTypeFrom:nil];
+    STAssertEquals([[[analytics retentionByType] objectForKey:@"easy"] floatValue], 1.0f, nil);
+    STAssertEquals([[[analytics retentionByType] objectForKey:@""] floatValue], 0.0f, nil);
+}
+
+@end
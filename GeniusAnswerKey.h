@@ -0,0 +1,51 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+//! Normalized form of an answer, computed once and compared many times while grading.
+/*!
+    The folded string is the answer in Unicode NFKC with case folded, so ligatures, full width letters,
+    decomposed accents and case no longer matter.  The key further drops punctuation and collapses white
+    space into single spaces; its words are what the similar matching mode and GeniusStringDiff compare.
+    Everything is computed in one pass over the characters when the key is created.
+    GeniusItem caches the key of its string value and drops it on edit.
+ */
+@interface GeniusAnswerKey : NSObject {
+    NSString * _foldedString;           //!< NFKC normalized and case folded.
+    NSString * _key;                    //!< _foldedString without punctuation, words separated by single spaces.
+    NSArray * _words;                   //!< Words of _key.
+    NSString * _string;                 //!< The original string, for #keyForWord:.
+    NSMutableDictionary * _wordKeys;    //!< Space separated word of _string -> its key.  Built on first use.
+}
+
++ (GeniusAnswerKey *) answerKeyWithString:(NSString *)string;
+- (id) initWithString:(NSString *)string;
+
+- (NSString *) foldedString;
+- (NSString *) key;
+- (NSArray *) words;
+- (NSString *) keyForWord:(NSString *)word;
+
+- (BOOL) isEqualToAnswerKey:(GeniusAnswerKey *)answerKey;
+- (float) similarityToAnswerKey:(GeniusAnswerKey *)answerKey;
+
+@end
+
+
+NSString * GeniusAnswerKeyString(NSString * string);
@@ -0,0 +1,177 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusAnswerKey.h"
+
+//! NFKC normalized, case folded copy of @a string.
+static NSString * FoldString(NSString * string)
+{
+    NSMutableString * folded = [NSMutableString stringWithString:(string ? string : @"")];
+    CFStringNormalize((CFMutableStringRef)folded, kCFStringNormalizationFormKC);
+    CFStringFold((CFMutableStringRef)folded, kCFCompareCaseInsensitive, NULL);
+    CFStringNormalize((CFMutableStringRef)folded, kCFStringNormalizationFormKC);    // folding may decompose
+    return folded;
+}
+
+//! @a folded without punctuation and with runs of white space turned into single spaces, trimmed.
+/*! One pass, compacting the characters in place:  a space is only written after skipping white space. */
+static NSString * StripPunctuation(NSString * folded)
+{
+    unsigned int i, length = [folded length], keyLength = 0;
+    if (length == 0)
+        return @"";
+
+    unichar * characters = (unichar *)malloc(length * sizeof(unichar));
+    [folded getCharacters:characters];
+    CFCharacterSetRef punctuation = CFCharacterSetGetPredefined(kCFCharacterSetPunctuation);
+    CFCharacterSetRef whitespace = CFCharacterSetGetPredefined(kCFCharacterSetWhitespaceAndNewline);
+    BOOL pendingSpace = NO;
+    for (i=0; i<length; i++)
+    {
+        unichar c = characters[i];
+        if (CFCharacterSetIsCharacterMember(punctuation, c))
+            continue;
+        if (CFCharacterSetIsCharacterMember(whitespace, c))
+        {
+            pendingSpace = (keyLength > 0);
+            continue;
+        }
+        if (pendingSpace)
+        {
+            characters[keyLength++] = ' ';
+            pendingSpace = NO;
+        }
+        characters[keyLength++] = c;
+    }
+    NSString * key = [NSString stringWithCharacters:characters length:keyLength];
+    free(characters);
+    return key;
+}
+
+//! The GeniusAnswerKey#key of @a string, without keeping the rest of a GeniusAnswerKey.
+NSString * GeniusAnswerKeyString(NSString * string)
+{
+    return StripPunctuation(FoldString(string));
+}
+
+
+@implementation GeniusAnswerKey
+
+//! Returns a new autoreleased key of @a string.
++ (GeniusAnswerKey *) answerKeyWithString:(NSString *)string
+{
+    return [[[self alloc] initWithString:string] autorelease];
+}
+
+//! Designated initializer.  A nil @a string is treated as empty.
+- (id) initWithString:(NSString *)string
+{
+    self = [super init];
+    if (self != nil) {
+        _string = [(string ? string : @"") copy];
+        _foldedString = [FoldString(_string) retain];
+        _key = [StripPunctuation(_foldedString) retain];
+        _words = ([_key length] ? [[_key componentsSeparatedByString:@" "] retain] : [[NSArray alloc] init]);
+    }
+    return self;
+}
+
+//! Releases the strings and deallocates memory.
+- (void) dealloc
+{
+    [_string release];
+    [_foldedString release];
+    [_key release];
+    [_words release];
+    [_wordKeys release];
+    [super dealloc];
+}
+
+//! _foldedString getter.
+- (NSString *) foldedString
+{
+    return _foldedString;
+}
+
+//! _key getter.
+- (NSString *) key
+{
+    return _key;
+}
+
+//! _words getter.
+- (NSArray *) words
+{
+    return _words;
+}
+
+//! Key of @a word, looked up among the space separated words of the original string before computing it.
+- (NSString *) keyForWord:(NSString *)word
+{
+    if (_wordKeys == nil)
+    {
+        _wordKeys = [[NSMutableDictionary alloc] init];
+        NSEnumerator * wordEnumerator = [[_string componentsSeparatedByString:@" "] objectEnumerator];
+        NSString * stringWord;
+        while ((stringWord = [wordEnumerator nextObject]))
+            if ([_wordKeys objectForKey:stringWord] == nil)
+                [_wordKeys setObject:GeniusAnswerKeyString(stringWord) forKey:stringWord];
+    }
+
+    NSString * key = [_wordKeys objectForKey:word];
+    return (key ? key : GeniusAnswerKeyString(word));
+}
+
+//! Whether both answers are the same apart from case, punctuation, white space and Unicode representation.
+- (BOOL) isEqualToAnswerKey:(GeniusAnswerKey *)answerKey
+{
+    return [_key isEqualToString:[answerKey key]];
+}
+
+//! 1.0 for equal keys, otherwise the share of words the answers have in common (Dice coefficient), 0.0 to 1.0.
+/*! Word order is ignored, repeated words count as often as they occur in both. */
+- (float) similarityToAnswerKey:(GeniusAnswerKey *)answerKey
+{
+    if ([self isEqualToAnswerKey:answerKey])
+        return 1.0;
+
+    NSArray * otherWords = [answerKey words];
+    unsigned int total = [_words count] + [otherWords count];
+    if (total == 0)
+        return 0.0;
+
+    CFMutableBagRef bag = CFBagCreateMutable(kCFAllocatorDefault, [_words count], &kCFTypeBagCallBacks);
+    NSEnumerator * wordEnumerator = [_words objectEnumerator];
+    NSString * word;
+    while ((word = [wordEnumerator nextObject]))
+        CFBagAddValue(bag, word);
+
+    unsigned int common = 0;
+    wordEnumerator = [otherWords objectEnumerator];
+    while ((word = [wordEnumerator nextObject]))
+    {
+        if (CFBagContainsValue(bag, word) == false)
+            continue;
+        CFBagRemoveValue(bag, word);
+        common++;
+    }
+    CFRelease(bag);
+    return (2.0 * common) / total;
+}
+
+@end
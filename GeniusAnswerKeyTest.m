@@ -0,0 +1,78 @@
+//
+//  GeniusAnswerKeyTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusAnswerKey.h"
+#import "GeniusItem.h"
+
+@interface GeniusAnswerKeyTest : SenTestCase {
+}
+
+@end
+
+//! Tests for the GeniusAnswerKey grading normalization.
+@implementation GeniusAnswerKeyTest
+
+//! Decomposed accents, ligatures, full width letters and case all fold to the same string.
+- (void) testUnicodeFolding
+{
+    GeniusAnswerKey * decomposed = [GeniusAnswerKey answerKeyWithString:[NSString stringWithFormat:@"E%Ccole", (unichar)0x0301]];
+    GeniusAnswerKey * precomposed = [GeniusAnswerKey answerKeyWithString:[NSString stringWithFormat:@"%Ccole", (unichar)0x00E9]];
+    STAssertEqualObjects([decomposed foldedString], [precomposed foldedString], nil);
+
+    NSString * ligature = [NSString stringWithFormat:@"%Csh", (unichar)0xFB01];
+    STAssertEqualObjects([[GeniusAnswerKey answerKeyWithString:ligature] foldedString], @"fish", nil);
+    NSString * fullWidth = [NSString stringWithFormat:@"%C%C%C", (unichar)0xFF21, (unichar)0xFF22, (unichar)0xFF23];
+    STAssertEqualObjects([[GeniusAnswerKey answerKeyWithString:fullWidth] foldedString], @"abc", nil);
+}
+
+//! Punctuation is dropped and white space collapsed in the key, but not in the folded string.
+- (void) testKey
+{
+    GeniusAnswerKey * answerKey = [GeniusAnswerKey answerKeyWithString:@"  Don't   stop,\tnow! "];
+    STAssertEqualObjects([answerKey key], @"dont stop now", nil);
+    STAssertEqualObjects([answerKey words], ([NSArray arrayWithObjects:@"dont", @"stop", @"now", nil]), nil);
+    STAssertEqualObjects([answerKey foldedString], @"  don't   stop,\tnow! ", nil);
+
+    STAssertTrue([answerKey isEqualToAnswerKey:[GeniusAnswerKey answerKeyWithString:@"dont STOP now"]], nil);
+    STAssertEqualObjects(GeniusAnswerKeyString(@"...?"), @"", nil);
+    STAssertEqualObjects([[GeniusAnswerKey answerKeyWithString:nil] key], @"", nil);
+}
+
+//! Similarity is 1 for equal keys and the word overlap otherwise.
+- (void) testSimilarity
+{
+    GeniusAnswerKey * target = [GeniusAnswerKey answerKeyWithString:@"the quick brown fox"];
+    STAssertEquals([target similarityToAnswerKey:[GeniusAnswerKey answerKeyWithString:@"The quick, brown fox."]], 1.0f, nil);
+    STAssertEqualsWithAccuracy([target similarityToAnswerKey:[GeniusAnswerKey answerKeyWithString:@"quick brown"]], 2.0f*2/6, 0.0001f, nil);
+    STAssertEquals([target similarityToAnswerKey:[GeniusAnswerKey answerKeyWithString:@"slow dog"]], 0.0f, nil);
+}
+
+//! Words of the original string map to their keys.
+- (void) testKeyForWord
+{
+    GeniusAnswerKey * answerKey = [GeniusAnswerKey answerKeyWithString:@"Hello, World!"];
+    STAssertEqualObjects([answerKey keyForWord:@"Hello,"], @"hello", nil);
+    STAssertEqualObjects([answerKey keyForWord:@"World!"], @"world", nil);
+    STAssertEqualObjects([answerKey keyForWord:@"Other"], @"other", nil);
+}
+
+//! Items cache their key until their string value changes.
+- (void) testItemInvalidation
+{
+    GeniusItem * item = [[[GeniusItem alloc] init] autorelease];
+    [item setStringValue:@"Chat"];
+    GeniusAnswerKey * answerKey = [item answerKey];
+    STAssertEqualObjects([answerKey key], @"chat", nil);
+    STAssertTrue([item answerKey] == answerKey, nil);
+
+    [item setValue:@"Chien" forKey:@"stringValue"];
+    STAssertEqualObjects([[item answerKey] key], @"chien", nil);
+}
+
+@end
@@ -20,17 +20,31 @@
 
 @class GeniusPreferencesController;
 @class GeniusHelpWindowController;
+@class GeniusDeckSearchIndex;
+@class GeniusDeckSearchController;
+@class GeniusMemoryController;
 
 @interface GeniusAppDelegate : NSObject {
     GeniusPreferencesController *preferencesController;  //!< Standard NSWindowController subclass for preferences window.
     GeniusHelpWindowController *helpController;              //!< Standard NSWindowController subclass for help window.
+    GeniusDeckSearchIndex *deckSearchIndex;                  //!< Search index over all decks, created on first use.
+    GeniusDeckSearchController *deckSearchController;        //!< Search All Decks window.
+    GeniusMemoryController *memoryController;                //!< Memory Usage debug panel.
 }
 
 - (IBAction) showPreferences:(id)sender;
 - (IBAction) showWebSite:(id)sender;
 - (IBAction) showSupportSite:(id)sender;
 - (IBAction) toggleSoundEffects:(id)sender;
+- (IBAction) toggleMultipleChoice:(id)sender;
 - (IBAction) showHelpWindow:(id)sender;
 - (IBAction) importFile:(id)sender;
+- (IBAction) newDeckFromLibrary:(id)sender;
+- (IBAction) exportTrace:(id)sender;
+- (IBAction) showMemoryUsage:(id)sender;
+- (IBAction) searchAllDecks:(id)sender;
+- (IBAction) reviewAllDecks:(id)sender;
+
+- (GeniusDeckSearchIndex *) deckSearchIndex;
 
 @end
@@ -22,6 +22,12 @@
 #import "GeniusItem.h"
 #import "GeniusDocument.h"
 #import "GeniusDocumentFile.h"
+#import "GeniusDeckSearchIndex.h"
+#import "GeniusDeckSearchController.h"
+#import "GeniusMemoryController.h"
+#import "GeniusDueQueue.h"
+#import "MyQuizController.h"
+#import "GeniusTrace.h"
 
 #import "GeniusPreferencesController.h"
 
@@ -38,6 +44,8 @@
 		[NSNumber numberWithBool:YES], GeniusPreferencesQuizUseFullScreenKey,
 		[NSNumber numberWithBool:YES], GeniusPreferencesQuizUseVisualErrorsKey,
 		[NSNumber numberWithInt:GeniusPreferencesQuizSimilarMatchingMode], GeniusPreferencesQuizMatchingModeKey,
+		[NSNumber numberWithBool:NO], GeniusPreferencesQuizMultipleChoiceKey,
+		[NSNumber numberWithInt:4], GeniusPreferencesQuizChoiceCountKey,
         
 		[NSNumber numberWithInt:10], GeniusPreferencesQuizNumItemsKey,
 		[NSNumber numberWithInt:20], GeniusPreferencesQuizFixedTimeMinKey,
@@ -52,6 +60,9 @@
 - (void) dealloc {
     [preferencesController release];
     [helpController release];
+    [deckSearchController release];
+    [memoryController release];
+    [deckSearchIndex release];
     [super dealloc];
 }
 
@@ -89,6 +100,12 @@
 
 }
 
+//! Empty method keeping the multiple choice toggle enabled.  Its state is bound to the user preference like the sound toggle.
+- (IBAction) toggleMultipleChoice:(id)sender
+{
+
+}
+
 //! Presents basic help window @see GeniusHelpWindowController#showWindow
 - (IBAction) showHelpWindow:(id)sender
 {
@@ -106,6 +123,136 @@
     [GeniusDocument importFile:sender];
 }
 
+//! Wraps call to GeniusDocument(FileFormat)::newDeckFromLibrary:
+- (IBAction)newDeckFromLibrary:(id)sender
+{
+    [GeniusDocument newDeckFromLibrary:sender];
+}
+
+//! Writes the spans and counters recorded so far as a Chrome trace event file.
+- (IBAction)exportTrace:(id)sender
+{
+    NSSavePanel * savePanel = [NSSavePanel savePanel];
+    [savePanel setRequiredFileType:@"json"];
+    if ([savePanel runModalForDirectory:nil file:@"Genius Trace.json"] != NSOKButton)
+        return;
+
+    if (GeniusTraceWriteToFile([savePanel filename]) == NO)
+        NSBeep();
+}
+
+//! Shows the Memory Usage panel for the frontmost deck.
+- (IBAction) showMemoryUsage:(id)sender
+{
+    if (memoryController == nil)
+        memoryController = [[GeniusMemoryController alloc] init];
+    [memoryController showWindow:self];
+}
+
+//! Returns the index searched by Search All Decks, creating it in the default directory on first use.
+- (GeniusDeckSearchIndex *) deckSearchIndex
+{
+    if (deckSearchIndex == nil)
+        deckSearchIndex = [[GeniusDeckSearchIndex alloc] init];
+    return deckSearchIndex;
+}
+
+//! Shows the Search All Decks window.
+- (IBAction) searchAllDecks:(id)sender
+{
+    if (deckSearchController == nil)
+        deckSearchController = [[GeniusDeckSearchController alloc] initWithSearchIndex:[self deckSearchIndex]];
+    [deckSearchController showWindow:self];
+}
+
+//! Runs one quiz over the items due in all open and indexed decks, most overdue first.  See GeniusDueQueue.
+- (IBAction) reviewAllDecks:(id)sender
+{
+    GeniusDeckSearchIndex * searchIndex = [self deckSearchIndex];
+    GeniusDueQueue * queue = [[GeniusDueQueue alloc] initWithSearchIndex:searchIndex];
+    [queue loadDecksAtPaths:[searchIndex deckPaths] documents:[[NSDocumentController sharedDocumentController] documents] time:GeniusTimeNow()];
+
+    if ([queue remainingCount] == 0)
+    {
+        NSString * title = NSLocalizedString(@"Nothing is due.", nil);
+        NSString * message = NSLocalizedString(@"None of your decks has items due for review.", nil);
+        NSString * okTitle = NSLocalizedString(@"OK", nil);
+        [[NSAlert alertWithMessageText:title defaultButton:okTitle alternateButton:nil otherButton:nil informativeTextWithFormat:message] runModal];
+    }
+    else
+    {
+        MyQuizController * quizController = [[MyQuizController alloc] init];
+        [quizController runQuiz:queue];
+        [quizController release];
+        if ([queue flush] == NO)
+            NSBeep();
+    }
+    [queue release];
+}
+
+//! Returns the main menu item sending @a action, or nil.
+- (NSMenuItem *) _menuItemWithAction:(SEL)action
+{
+    NSEnumerator * menuEnumerator = [[[NSApp mainMenu] itemArray] objectEnumerator];
+    NSMenuItem * menuItem;
+    while ((menuItem = [menuEnumerator nextObject]))
+    {
+        NSEnumerator * itemEnumerator = [[[menuItem submenu] itemArray] objectEnumerator];
+        NSMenuItem * item;
+        while ((item = [itemEnumerator nextObject]))
+            if ([item action] == action)
+                return item;
+    }
+    return nil;
+}
+
+//! Adds the library, search, trace and memory commands below Import in the File menu, Attach below Duplicate, Multiple Choice below Sound Effects and Review All Decks below the quiz commands.  MainMenu.nib predates them.
+- (void) _installMenuItems
+{
+    NSMenuItem * importItem = [self _menuItemWithAction:@selector(importFile:)];
+    if (importItem)
+    {
+        NSMenu * menu = [importItem menu];
+        int index = [menu indexOfItem:importItem];
+        [menu insertItemWithTitle:NSLocalizedString(@"New Deck from Library...", nil) action:@selector(newDeckFromLibrary:) keyEquivalent:@"" atIndex:index+1];
+        [menu insertItemWithTitle:NSLocalizedString(@"Export Library...", nil) action:@selector(exportLibrary:) keyEquivalent:@"" atIndex:index+2];
+        [menu insertItemWithTitle:NSLocalizedString(@"Search All Decks...", nil) action:@selector(searchAllDecks:) keyEquivalent:@"F" atIndex:index+3];
+        [menu insertItemWithTitle:NSLocalizedString(@"Sync with Shared Copy...", nil) action:@selector(syncDeck:) keyEquivalent:@"" atIndex:index+4];
+        if (GeniusTraceEnabled)
+        {
+            [menu insertItemWithTitle:NSLocalizedString(@"Export Trace...", nil) action:@selector(exportTrace:) keyEquivalent:@"" atIndex:index+5];
+            [menu insertItemWithTitle:NSLocalizedString(@"Memory Usage...", nil) action:@selector(showMemoryUsage:) keyEquivalent:@"" atIndex:index+6];
+        }
+    }
+
+    NSMenuItem * duplicateItem = [self _menuItemWithAction:@selector(duplicate:)];
+    if (duplicateItem)
+    {
+        NSMenu * menu = [duplicateItem menu];
+        int index = [menu indexOfItem:duplicateItem];
+        [menu insertItemWithTitle:NSLocalizedString(@"Attach Image or Sound...", nil) action:@selector(attachMedia:) keyEquivalent:@"" atIndex:index+1];
+    }
+
+    NSMenuItem * soundItem = [self _menuItemWithAction:@selector(toggleSoundEffects:)];
+    if (soundItem)
+    {
+        NSMenu * menu = [soundItem menu];
+        int index = [menu indexOfItem:soundItem];
+        NSMenuItem * choiceItem = [menu insertItemWithTitle:NSLocalizedString(@"Multiple Choice", nil) action:@selector(toggleMultipleChoice:) keyEquivalent:@"" atIndex:index+1];
+        [choiceItem setTarget:self];
+        NSString * keyPath = [@"values." stringByAppendingString:GeniusPreferencesQuizMultipleChoiceKey];
+        [choiceItem bind:@"value" toObject:[NSUserDefaultsController sharedUserDefaultsController] withKeyPath:keyPath options:nil];
+    }
+
+    NSMenuItem * quizItem = [self _menuItemWithAction:@selector(quizSelection:)];
+    if (quizItem)
+    {
+        NSMenu * menu = [quizItem menu];
+        int index = [menu indexOfItem:quizItem];
+        [menu insertItemWithTitle:NSLocalizedString(@"Review All Decks", nil) action:@selector(reviewAllDecks:) keyEquivalent:@"" atIndex:index+1];
+    }
+}
+
 @end
 
 
@@ -114,10 +261,19 @@
 - (void)applicationWillFinishLaunching:(NSNotification *)aNotification
 {
     srandom(time(NULL));
+
+    // Tracing is off unless asked for, see GeniusTrace.h.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"GeniusTraceEnabled"] || getenv("GENIUS_TRACE"))
+        GeniusTraceSetEnabled(YES);
+
+    // Autosaves are written on a background thread, see GeniusDocument(FileFormat).
+    [[NSDocumentController sharedDocumentController] setAutosavingDelay:30.0];
 }
 
 - (void)applicationDidFinishLaunching:(NSNotification *)aNotification
 {
+    [self _installMenuItems];
+
 	// OpenFiles
     NSArray * openFiles = [[NSUserDefaults standardUserDefaults] objectForKey:@"OpenFiles"];
 	if (openFiles)
@@ -127,6 +283,17 @@
 		while ((path = [pathEnumerator nextObject]))
 			[self application:NSApp openFile:path];
 	}
+
+    // Bring the search index up to date with recent decks saved while it was not running.
+    GeniusDeckSearchIndex * searchIndex = [self deckSearchIndex];
+    [searchIndex removeMissingDecks];
+    NSMutableArray * recentPaths = [NSMutableArray array];
+    NSEnumerator * urlEnumerator = [[[NSDocumentController sharedDocumentController] recentDocumentURLs] objectEnumerator];
+    NSURL * url;
+    while ((url = [urlEnumerator nextObject]))
+        if ([url isFileURL])
+            [recentPaths addObject:[url path]];
+    [searchIndex indexDecksAtPaths:recentPaths];
 }
 
 /*
@@ -10,6 +10,17 @@
 
 @class GeniusItem;
 @class GeniusPair;
+@class GeniusMemoryReport;
+
+//! Time base used by the scheduler: whole seconds since 1970-01-01 00:00:00 UTC.
+typedef long long GeniusTime;
+
+extern const GeniusTime kGeniusTimeNone;
+
+//! 64 bit identifier of a GeniusAssociation used outside the document archive, e.g. by GeniusReviewLog.
+typedef unsigned long long GeniusAssociationID;
+
+GeniusTime GeniusTimeNow(void);
 
 //! A directed association between two GeniusItem instances, with score-keeping data.
 /*!
@@ -28,6 +39,8 @@ A GeniusAssociation is the basic unit of memorization in Genius.  A GeniusAssoci
     //! performance info dictionary
     /*! contains scoreNumber and dueDate for this GeniusAssociation. */
     NSMutableDictionary * _perfDict;
+
+    GeniusTime _dueTime;    //!< Cached copy of #dueDate as GeniusTime, kGeniusTimeNone when not scheduled.
 }
 
 - (id) _initWithCueItem:(GeniusItem *)cueItem answerItem:(GeniusItem *)answerItem parentPair:(GeniusPair *)parentPair performanceDict:(NSDictionary *)performanceDict;
@@ -54,4 +67,12 @@ A GeniusAssociation is the basic unit of memorization in Genius.  A GeniusAssoci
 - (NSDate *) dueDate;
 - (void) setDueDate:(NSDate *)dueDate;
 
+- (GeniusTime) dueTime;
+- (void) setDueTime:(GeniusTime)dueTime;
+- (void) setPrimitiveDueTime:(GeniusTime)dueTime;
+
+- (GeniusAssociationID) associationID;
+
+- (void) addToMemoryReport:(GeniusMemoryReport *)report;
+
 @end
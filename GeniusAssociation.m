@@ -8,10 +8,33 @@
 
 #import "GeniusAssociation.h"
 #import "GeniusPair.h"
+#import "GeniusItem.h"
+#import "GeniusMemoryReport.h"
+#include <limits.h>    // LLONG_MIN
+#include <math.h>      // floor
+#include <time.h>      // time
 
 NSString * GeniusAssociationScoreNumberKey = @"scoreNumber"; //!< accessor key for score in _perfDict
 NSString * GeniusAssociationDueDateKey = @"dueDate"; //!< accessor key for due date in _perfDict
 
+//! GeniusTime value of an association that has no due date.
+const GeniusTime kGeniusTimeNone = LLONG_MIN;
+
+//! Returns the current time in the scheduler's time base.
+/*! Cheap enough to call once per scheduling pass instead of allocating an NSDate per association. */
+GeniusTime GeniusTimeNow(void)
+{
+    return (GeniusTime)time(NULL);
+}
+
+//! Converts @a date to GeniusTime, returning kGeniusTimeNone for @c nil.
+static GeniusTime GeniusTimeFromDate(NSDate * date)
+{
+    if (date == nil)
+        return kGeniusTimeNone;
+    return (GeniusTime)floor([date timeIntervalSince1970]);
+}
+
 @implementation GeniusAssociation
 /*! 
 Creates copy of the provided @a performanceDict.
@@ -27,6 +50,8 @@ Creates copy of the provided @a performanceDict.
         _perfDict = [performanceDict mutableCopy];
     else
         _perfDict = [[NSMutableDictionary alloc] init];
+
+    _dueTime = GeniusTimeFromDate([_perfDict objectForKey:GeniusAssociationDueDateKey]);
     return self;
 }
 
@@ -96,6 +121,7 @@ and deletes all entries from GeniusAssociation#_perfDict.
     [self willChangeValueForKey:GeniusAssociationScoreNumberKey];
     [self willChangeValueForKey:GeniusAssociationDueDateKey];
     [_perfDict removeAllObjects];
+    _dueTime = kGeniusTimeNone;
     [self didChangeValueForKey:GeniusAssociationDueDateKey];
     [self didChangeValueForKey:GeniusAssociationScoreNumberKey];
 }
@@ -158,22 +184,61 @@ and deletes all entries from GeniusAssociation#_perfDict.
 }
 
 //! dueDate setter. Stores @p dueDate in _perfDict under GeniusAssociationDueDateKey 
+/*! Also refreshes the cached #dueTime. */
 - (void) setDueDate:(NSDate *)dueDate
 {
     [_perfDict setValue:dueDate forKey:GeniusAssociationDueDateKey];
+    _dueTime = GeniusTimeFromDate(dueDate);
+}
+
+//! Returns #dueDate as GeniusTime without touching the NSDate.
+/*! kGeniusTimeNone means the association is not scheduled. */
+- (GeniusTime) dueTime
+{
+    return _dueTime;
+}
+
+//! Convenience method for setting #dueDate from a GeniusTime.
+/*! Goes through #setDueDate: so that observers of @c dueDate are notified. */
+- (void) setDueTime:(GeniusTime)dueTime
+{
+    if (dueTime == kGeniusTimeNone)
+        [self setDueDate:nil];
+    else
+        [self setDueDate:[NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)dueTime]];
+}
+
+//! Sets #dueTime without notifying observers of @c dueDate.
+/*! For batch updates whose caller refreshes whatever depends on due times, see GeniusAssociationColumns#writeDueTimesToAssociations. */
+- (void) setPrimitiveDueTime:(GeniusTime)dueTime
+{
+    NSDate * dueDate = (dueTime == kGeniusTimeNone ? nil : [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)dueTime]);
+    [_perfDict setValue:dueDate forKey:GeniusAssociationDueDateKey];
+    _dueTime = dueTime;
+}
+
+//! Identifier of this association outside the document archive.
+/*! The GeniusPair#pairID of the parent pair with the direction in the lowest bit. */
+- (GeniusAssociationID) associationID
+{
+    return ([_parentPair pairID] << 1) | (_cueItem == [_parentPair itemA] ? 0 : 1);
 }
 
 //! Compare to @a association based on #dueDate.
 /*! For comparison purposes a missing #dueDate is treated the same as +[NSDate distantPast]. */
 - (NSComparisonResult) compareByDate:(GeniusAssociation *)association
 {
-    NSDate * date1 = [self dueDate];
-    NSDate * date2 = [association dueDate];
-    if (date1 == nil)
+    GeniusTime time1 = _dueTime;
+    GeniusTime time2 = [association dueTime];
+    if (time1 == kGeniusTimeNone)
         return NSOrderedAscending;  // 0 <
-    if (date2 == nil)
+    if (time2 == kGeniusTimeNone)
         return NSOrderedDescending; // > 0
-    return [date1 compare:date2];
+    if (time1 < time2)
+        return NSOrderedAscending;
+    if (time1 > time2)
+        return NSOrderedDescending;
+    return NSOrderedSame;
 }
 
 //! Compare to @a association based on #scoreNumber.
@@ -189,4 +254,15 @@ and deletes all entries from GeniusAssociation#_perfDict.
     return [scoreNumber1 compare:scoreNumber2];
 }
 
+//! Adds the association, its performance dictionary and both items to @a report.
+- (void) addToMemoryReport:(GeniusMemoryReport *)report
+{
+    if ([report addObject:self toSubsystem:GeniusMemoryAssociationsSubsystem] == NO)
+        return;
+    [report addObservationInfoOfObject:self];
+    [report addDictionary:_perfDict toSubsystem:GeniusMemoryPerformanceSubsystem];
+    [_cueItem addToMemoryReport:report];
+    [_answerItem addToMemoryReport:report];
+}
+
 @end
@@ -0,0 +1,47 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusAssociation.h"
+
+//! Packed copy of the scores and due times of a set of GeniusAssociation items.
+/*!
+    Scores and due times live in the performance dictionary of each association as NSNumber and NSDate
+    objects, which is far too slow to walk for deck wide operations.  GeniusAssociationColumns copies them
+    into plain C arrays, one entry per association in the order given, so that tight loops can work on them.
+    Changes are written back with #writeDueTimesToAssociations.
+ */
+@interface GeniusAssociationColumns : NSObject {
+    NSArray * _associations;    //!< The associations the columns were read from, in column order.
+    unsigned int _count;        //!< Number of entries in each column.
+    int * _scores;              //!< GeniusAssociation#score values, -1 when never quizzed.
+    GeniusTime * _dueTimes;     //!< GeniusAssociation#dueTime values, kGeniusTimeNone when not scheduled.
+}
+
+- (id) initWithAssociations:(NSArray *)associations;
+
+- (NSArray *) associations;
+- (unsigned int) count;
+- (int *) scores;
+- (GeniusTime *) dueTimes;
+
+- (void) reloadFromAssociations;
+- (unsigned int) writeDueTimesToAssociations;
+
+@end
@@ -0,0 +1,104 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusAssociationColumns.h"
+
+
+@implementation GeniusAssociationColumns
+
+//! Copies the scores and due times of @a associations into packed columns.
+- (id) initWithAssociations:(NSArray *)associations
+{
+    self = [super init];
+    if (self != nil) {
+        _associations = [associations copy];
+        _count = [_associations count];
+        _scores = (int *)malloc(MAX(_count, 1U) * sizeof(int));
+        _dueTimes = (GeniusTime *)malloc(MAX(_count, 1U) * sizeof(GeniusTime));
+        [self reloadFromAssociations];
+    }
+    return self;
+}
+
+//! Releases associations, frees the columns and deallocates memory.
+- (void) dealloc
+{
+    [_associations release];
+    free(_scores);
+    free(_dueTimes);
+    [super dealloc];
+}
+
+//! _associations getter.
+- (NSArray *) associations
+{
+    return _associations;
+}
+
+//! Number of entries in each column.
+- (unsigned int) count
+{
+    return _count;
+}
+
+//! Score column.  May be modified in place.
+- (int *) scores
+{
+    return _scores;
+}
+
+//! Due time column.  May be modified in place.
+- (GeniusTime *) dueTimes
+{
+    return _dueTimes;
+}
+
+//! Refreshes the columns from the current values of the associations.
+- (void) reloadFromAssociations
+{
+    unsigned int i;
+    for (i=0; i<_count; i++)
+    {
+        GeniusAssociation * association = [_associations objectAtIndex:i];
+        _scores[i] = [association score];
+        _dueTimes[i] = [association dueTime];
+    }
+}
+
+//! Stores the due time column back into the associations.
+/*!
+    Only associations whose due time actually differs are touched.  Observers are not notified, so a
+    deck wide update costs no key value observing per association; the caller refreshes whatever depends
+    on due times once afterwards.  Returns the number of changed associations.
+ */
+- (unsigned int) writeDueTimesToAssociations
+{
+    unsigned int changed = 0;
+    unsigned int i;
+    for (i=0; i<_count; i++)
+    {
+        GeniusAssociation * association = [_associations objectAtIndex:i];
+        if ([association dueTime] == _dueTimes[i])
+            continue;
+        [association setPrimitiveDueTime:_dueTimes[i]];
+        changed++;
+    }
+    return changed;
+}
+
+@end
@@ -18,7 +18,12 @@
 
 #import <Foundation/Foundation.h>
 
+#import "GeniusScheduler.h"
+#import "GeniusRandom.h"
+
 @class GeniusAssociation;
+@class GeniusReviewLog;
+@class GeniusAnalytics;
 
 @interface GeniusAssociationEnumerator : NSObject {
     NSMutableArray * _inputAssociations;  //!< GeniusAssociation items to filter.
@@ -26,12 +31,20 @@
     unsigned int _count;                  //!< Minium number of items to return.
     int _minimumScore;                    //!< Score cutoff for returned items.
     float _m_value;                       //!< Center value for the probability based selection.
+    id <GeniusScheduler> _scheduler;      //!< Decides new scores and due times after each answer.
+    GeniusReviewLog * _reviewLog;         //!< Receives a record for every answer.  May be nil.
+    GeniusAnalytics * _analytics;         //!< Counts every answer for retention statistics.  May be nil.
+    GeniusTime _time;                     //!< Time set by #setTime:, kGeniusTimeNone to follow the clock.
+    GeniusRandomState _randomState;       //!< Generator set up by #setRandomSeed:.
+    BOOL _isSeeded;                       //!< Use _randomState rather than random().
 
     // Transient state
     int _maximumScore;                    //!< Temporary value used in probability based selection.
     
     NSMutableArray * _scheduledAssociations;  //!< The selection of items returned via nextAssociation.
     BOOL _hasPerformedChooseAssociations;     //!< Flag indicating if performChooseAssociations has been called.
+    NSTimeInterval _presentationTime;         //!< When #nextAssociation last returned an association.
+    float _matchScore;                        //!< Similarity of the typed answer for the current association.
 }
 
 - (id) initWithAssociations:(NSArray *)associations;
@@ -42,9 +55,24 @@
 - (void) setProbabilityCenter:(float)value;
 - (void) performChooseAssociations;
 
+- (id <GeniusScheduler>) scheduler;
+- (void) setScheduler:(id <GeniusScheduler>)scheduler;
+
+- (GeniusReviewLog *) reviewLog;
+- (void) setReviewLog:(GeniusReviewLog *)reviewLog;
+
+- (GeniusAnalytics *) analytics;
+- (void) setAnalytics:(GeniusAnalytics *)analytics;
+
+- (void) setMatchScore:(float)matchScore;
+
+- (void) setTime:(GeniusTime)now;
+- (void) setRandomSeed:(uint64_t)seed;
+
 - (int) remainingCount;
 
 - (GeniusAssociation *) nextAssociation;
+- (NSArray *) upcomingAssociations:(unsigned int)count;
 
 - (void) associationRight:(GeniusAssociation *)association;
 - (void) associationWrong:(GeniusAssociation *)association;
@@ -20,6 +20,9 @@
 #include <math.h>   // pow
 #import "GeniusPair.h"
 #import "GeniusAssociation.h"
+#import "GeniusReviewLog.h"
+#import "GeniusAnalytics.h"
+#import "GeniusTrace.h"
 
 static unsigned long Factorial(int n)
 {
@@ -34,9 +37,10 @@ static float PoissonValue(int x, float m)
 
 
 //! randomly returns NSOrderedAscending or NSOrderedDescending
+/*! @a context is a GeniusRandomState to draw from, or NULL for random(). */
 int RandomSortFunction(id object1, id object2, void * context)
 {
-    BOOL x = random() & 0x1;
+    BOOL x = (context ? GeniusRandomLong((GeniusRandomState *)context) : random()) & 0x1;
     return (x ? NSOrderedAscending : NSOrderedDescending);
 }
 
@@ -59,16 +63,26 @@ int RandomSortFunction(id object1, id object2, void * context)
     _count = [_inputAssociations count];
     _minimumScore = -1;
     _m_value = 1.0;
+    _scheduler = [[GeniusScoreScheduler defaultScheduler] retain];
+    _reviewLog = nil;
+    _analytics = nil;
+    _matchScore = -1.0;
+    _presentationTime = [NSDate timeIntervalSinceReferenceDate];
+    _time = kGeniusTimeNone;
+    _isSeeded = NO;
     
     _hasPerformedChooseAssociations = NO;
     _scheduledAssociations = [[NSMutableArray alloc] init];
     return self;
 }
 
-//! Releases #_inputAssociations and #_scheduledAssociations and frees up memory.
+//! Releases #_inputAssociations, #_scheduler, #_reviewLog, #_analytics and #_scheduledAssociations and frees up memory.
 - (void) dealloc
 {
     [_inputAssociations release];
+    [_scheduler release];
+    [_reviewLog release];
+    [_analytics release];
 
     [_scheduledAssociations release];
 
@@ -98,6 +112,82 @@ int RandomSortFunction(id object1, id object2, void * context)
     _m_value = value;
 }
 
+//! _scheduler getter.
+- (id <GeniusScheduler>) scheduler
+{
+    return _scheduler;
+}
+
+//! _scheduler setter.  Passing nil restores GeniusScoreScheduler#defaultScheduler.
+- (void) setScheduler:(id <GeniusScheduler>)scheduler
+{
+    if (scheduler == nil)
+        scheduler = [GeniusScoreScheduler defaultScheduler];
+    [_scheduler release];
+    _scheduler = [scheduler retain];
+}
+
+//! _reviewLog getter.
+- (GeniusReviewLog *) reviewLog
+{
+    return _reviewLog;
+}
+
+//! _reviewLog setter.
+- (void) setReviewLog:(GeniusReviewLog *)reviewLog
+{
+    [reviewLog retain];
+    [_reviewLog release];
+    _reviewLog = reviewLog;
+}
+
+//! _analytics getter.
+- (GeniusAnalytics *) analytics
+{
+    return _analytics;
+}
+
+//! _analytics setter.
+- (void) setAnalytics:(GeniusAnalytics *)analytics
+{
+    [analytics retain];
+    [_analytics release];
+    _analytics = analytics;
+}
+
+//! Records how closely the typed answer for the current association matched, 0.0 to 1.0.
+/*! Reset to -1.0 (nothing typed) each time #nextAssociation returns a new association. */
+- (void) setMatchScore:(float)matchScore
+{
+    _matchScore = matchScore;
+}
+
+//! Makes the enumerator act as if it were @a now, for simulations.  kGeniusTimeNone goes back to the clock.
+- (void) setTime:(GeniusTime)now
+{
+    _time = now;
+}
+
+//! Draws the session's random choices from a generator seeded with @a seed instead of random().
+/*! Two enumerators with the same seed, associations and times make the same choices, whatever thread they run on. */
+- (void) setRandomSeed:(uint64_t)seed
+{
+    GeniusRandomSeed(&_randomState, seed);
+    _isSeeded = YES;
+}
+
+//! The current time:  #_time if set, else GeniusTimeNow().
+- (GeniusTime) _now
+{
+    return (_time == kGeniusTimeNone ? GeniusTimeNow() : _time);
+}
+
+//! Next number from random() or, once seeded, from #_randomState.
+- (long) _random
+{
+    return (_isSeeded ? GeniusRandomLong(&_randomState) : random());
+}
+
 //! Loops over #_inputAssociations to find relevent items.
 /*!
     Filters out disabled GeniusAssociation items and those with a score lower than
@@ -106,14 +196,12 @@ int RandomSortFunction(id object1, id object2, void * context)
 */
 - (NSArray *) _getActiveAssociations
 {
-    #if DEBUG
-        NSLog(@"_minimumScore=%d, [_inputAssociations count]=%d", _minimumScore, [_inputAssociations count]);
-    #endif
     int requestedMinimumScore = _minimumScore;
 
     _minimumScore = -2;
     _maximumScore = _minimumScore;
     
+    GeniusTime now = [self _now];
     NSMutableArray * outAssociations = [NSMutableArray array];
     NSEnumerator * associationEnumerator = [_inputAssociations objectEnumerator];
     GeniusAssociation * association;
@@ -131,7 +219,8 @@ int RandomSortFunction(id object1, id object2, void * context)
         [(NSMutableArray *)outAssociations addObject:association];
             
         // If the fire date has already expired, clear it
-        if ([[association dueDate] compare:[NSDate date]] == NSOrderedAscending)
+        GeniusTime dueTime = [association dueTime];
+        if (dueTime != kGeniusTimeNone && dueTime < now)
             [association setDueDate:nil];
 
         // Calculate minimum and maximum scores        
@@ -170,11 +259,6 @@ static NSComparisonResult CompareAssociationByImportance(GeniusAssociation * ass
 */
 - (NSArray *) _chooseCountAssociationsByScore:(NSArray *)associations
 {
-    #if DEBUG
-        NSLog(@"_minimumScore=%d, _maximumScore=%d", _minimumScore, _maximumScore);
-        NSLog(@"[associations count]=%d, _count=%d", [associations count], _count);
-    #endif
-
     if ([associations count] <= _count)
         return associations;
 
@@ -194,10 +278,6 @@ static NSComparisonResult CompareAssociationByImportance(GeniusAssociation * ass
         NSMutableArray * bucket = [buckets objectAtIndex:b];
         [bucket addObject:association];
     }
-    #if DEBUG
-    for (b=0; b<bucketCount; b++)
-        NSLog(@"bucket %d has %d associations", b, [[buckets objectAtIndex:b] count]);
-    #endif
 
     // Calculate Poisson distribution curve using _m_value.
     float * p = calloc(sizeof(float), bucketCount);
@@ -206,20 +286,13 @@ static NSComparisonResult CompareAssociationByImportance(GeniusAssociation * ass
     {
         p[b] = PoissonValue(b, _m_value);
         max_p = MAX(max_p, p[b]);
-
-        #if DEBUG
-        NSLog(@"p[%d]=%f --> expect n=%.1f", b, p[b], _count * p[b]);
-        #endif
     }
 
     // Perform weighted random selection of _count objects
     NSMutableArray * outAssociations = [NSMutableArray array];
     while ([outAssociations count] < _count)
     {
-        float x = random() / (float)LONG_MAX;
-        #if DEBUG
-        float origValue = x;
-        #endif
+        float x = [self _random] / (float)LONG_MAX;
 
         // Here we translate the random point x to the index of the corresponding weighted bucket.
         // We assert that the sum of the probabilities (p[b] for all b) is 1.0.
@@ -232,10 +305,6 @@ static NSComparisonResult CompareAssociationByImportance(GeniusAssociation * ass
                 {
                     [outAssociations addObject:[bucket objectAtIndex:0]];
                     [bucket removeObjectAtIndex:0];
-                    
-                    #if DEBUG
-                    NSLog(@"%f\t--> pull from bucket %d, %d left", origValue, b, [bucket count]);
-                    #endif
                     break;  // done with this association
                 }
             }
@@ -258,11 +327,12 @@ static NSComparisonResult CompareAssociationByImportance(GeniusAssociation * ass
 */
 - (void) performChooseAssociations
 {
+    uint64_t spanStart = GeniusTraceSpanBegin();
     // 1. First, filter out disabled pairs, minimum scores, and long-term dates.
     NSArray * activeAssociations = [self _getActiveAssociations];
     
     // 2. Randomize the remaining "active" associations
-    NSArray * randomActiveAssociations = [activeAssociations sortedArrayUsingFunction:RandomSortFunction context:NULL];
+    NSArray * randomActiveAssociations = [activeAssociations sortedArrayUsingFunction:RandomSortFunction context:(_isSeeded ? &_randomState : NULL)];
     
     // 3. Weight the associations according to pair importance
     NSArray * orderedAssociations = [randomActiveAssociations sortedArrayUsingFunction:CompareAssociationByImportance context:NULL];
@@ -270,20 +340,10 @@ static NSComparisonResult CompareAssociationByImportance(GeniusAssociation * ass
     // 4. Choose _count associations by score according to a probability curve
     NSArray * chosenAssociations = [self _chooseCountAssociationsByScore:orderedAssociations];
 
-    // DEBUG
-    #if DEBUG
-    NSEnumerator * associationEnumerator = [chosenAssociations objectEnumerator];
-    GeniusAssociation * association;
-    while ((association = [associationEnumerator nextObject]))
-    {
-        GeniusPair * pair = [association parentPair];
-        NSLog(@"%@, date=%@, score=%d, importance=%d", [[pair itemA] stringValue], [[association dueDate] description], [association score], [pair importance]);
-    }
-    #endif
-
     [_inputAssociations setArray:chosenAssociations];   // HACK
 
     _hasPerformedChooseAssociations = YES;
+    GeniusTraceSpanEnd("choose-session", spanStart);
 }
 
 //! Convenience method for returning the number of items in _inputAssociations.
@@ -308,86 +368,116 @@ static NSComparisonResult CompareAssociationByImportance(GeniusAssociation * ass
         [self performChooseAssociations];
 
     // Try popping an association off the scheduled associations queue
-    #if DEBUG
-    //NSLog(@"_scheduledAssociations = %@", [_scheduledAssociations description]);
-    #endif
     if ([_scheduledAssociations count])
     {
-        association = [[_scheduledAssociations objectAtIndex:0] retain];
-        if ([[association dueDate] compare:[NSDate date]] == NSOrderedAscending)
+        association = [_scheduledAssociations objectAtIndex:0];
+        if ([association dueTime] < [self _now])
         {
+            [[association retain] autorelease];
             [_scheduledAssociations removeObjectAtIndex:0];
-            return [association autorelease];
+            _presentationTime = [NSDate timeIntervalSinceReferenceDate];
+            _matchScore = -1.0;
+            return association;
         }
     }
     
     // Otherwise try popping an unscheduled association
-    #if DEBUG
-    //NSLog(@"_inputAssociations = %@", [_inputAssociations description]);
-    #endif
     if ([_inputAssociations count] == 0)
         return nil;
     association = [[_inputAssociations objectAtIndex:0] retain];
     [_inputAssociations removeObjectAtIndex:0];
+    _presentationTime = [NSDate timeIntervalSinceReferenceDate];
+    _matchScore = -1.0;
     return [association autorelease];
 }
 
+//! Up to @a count associations likely to be returned by the next calls to #nextAssociation, soonest first.
+/*! A guess, since answers reschedule associations in between.  Used to prefetch media. */
+- (NSArray *) upcomingAssociations:(unsigned int)count
+{
+    NSMutableArray * associations = [NSMutableArray arrayWithCapacity:count];
+    unsigned int i;
+    for (i=0; i<[_scheduledAssociations count] && [associations count] < count; i++)
+    {
+        GeniusAssociation * association = [_scheduledAssociations objectAtIndex:i];
+        if ([association dueTime] >= [self _now])
+            break;
+        [associations addObject:association];
+    }
+    for (i=0; i<[_inputAssociations count] && [associations count] < count; i++)
+        [associations addObject:[_inputAssociations objectAtIndex:i]];
+    return associations;
+}
+
 
-//! Updates GeniusAssociation#dueDate based on current GeniusAssociation#score provided @a association and inserts in _scheduledAssociations.
-- (void) _scheduleAssociation:(GeniusAssociation *)association
+//! Lets #_scheduler process @a outcome for @a association and, unless skipped, inserts it in _scheduledAssociations.
+/*!
+    The answer is recorded in #_reviewLog and #_analytics along with the response time and #_matchScore.
+    #_scheduledAssociations is kept sorted by GeniusAssociation#dueTime, so the insertion point is found by
+    binary search.  Associations with equal due times keep their arrival order.
+*/
+- (void) _scheduleAssociation:(GeniusAssociation *)association outcome:(GeniusReviewOutcome)outcome
 {
-    unsigned int sec = pow(5, [association score]);
-    NSDate * dueDate = [[NSDate date] addTimeInterval:sec];
-    [association setDueDate:dueDate];
+    uint64_t spanStart = GeniusTraceSpanBegin();
+    GeniusTime now = [self _now];
+    if (_reviewLog || _analytics)
+    {
+        NSTimeInterval responseTime = [NSDate timeIntervalSinceReferenceDate] - _presentationTime;
+        GeniusReviewRecord record;
+        record.associationID = [association associationID];
+        record.time = now;
+        record.responseMilliseconds = (unsigned int)(MAX(responseTime, 0.0) * 1000.0);
+        record.matchScore = _matchScore;
+        record.outcome = outcome;
+        record.flags = 0;
+        [_reviewLog appendRecord:&record];
+        [_analytics recordReview:&record ofAssociation:association];
+    }
 
-    int i, n = [_scheduledAssociations count];
-    for (i=0; i<n; i++)
+    [_scheduler scheduleAssociation:association outcome:outcome time:now];
+    if (outcome == GeniusReviewOutcomeSkip)
     {
-        NSDate * dueDate = [association dueDate];
-        GeniusAssociation * currentAssoc = [_scheduledAssociations objectAtIndex:i];
-        NSDate * currentFireDate = [currentAssoc dueDate];
-        if ([dueDate compare:currentFireDate] == NSOrderedAscending)
-        {
-            [_scheduledAssociations insertObject:association atIndex:i];
-            return;
-        }
+        GeniusTraceSpanEnd("grade", spanStart);
+        return;
     }
-    [_scheduledAssociations addObject:association];
+
+    GeniusTime dueTime = [association dueTime];
+    unsigned int low = 0, high = [_scheduledAssociations count];
+    while (low < high)
+    {
+        unsigned int middle = (low + high) / 2;
+        if ([[_scheduledAssociations objectAtIndex:middle] dueTime] <= dueTime)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    [_scheduledAssociations insertObject:association atIndex:low];
+    GeniusTraceSpanEnd("grade", spanStart);
 }
 
 
-//! Bumps score of @a association up by one.
+//! Records a right answer for @a association.  The classic scheduler bumps the score up by one.
 - (void) associationRight:(GeniusAssociation *)association
 {
-    // score++
-    int score = [association score];
-    [association setScore:score+1];
-
-    [self _scheduleAssociation:association];
+    [self _scheduleAssociation:association outcome:GeniusReviewOutcomeRight];
 }
 
-//! Sets score for the @a association back to zero.
+//! Records a wrong answer for @a association.  The classic scheduler sets the score back to zero.
 /*!
     @todo This seems questionable.
  */
 - (void) associationWrong:(GeniusAssociation *)association
 {
-    // score = 0
-    [association setScore:0];
-
-    [self _scheduleAssociation:association];
+    [self _scheduleAssociation:association outcome:GeniusReviewOutcomeWrong];
 }
 
-//! Sets score for the @a association
+//! Records a skipped @a association.  The classic scheduler clears score and due date.
 /*!
     @todo This seems unexpected.  Why would skipping something mean nullify the score and due date?
 */
 - (void) associationSkip:(GeniusAssociation *)association
 {
-    // score = -1
-    [association setScoreNumber:nil];
-    
-    [association setDueDate:nil];
+    [self _scheduleAssociation:association outcome:GeniusReviewOutcomeSkip];
 }
 
 @end
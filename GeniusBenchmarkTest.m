@@ -0,0 +1,625 @@
+//
+//  GeniusBenchmarkTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusScheduler.h"
+#import "GeniusAssociationColumns.h"
+#import "GeniusPair.h"
+#import "GeniusAnalytics.h"
+#import "GeniusTimingWheel.h"
+#import "GeniusTableRowModel.h"
+#import "GeniusSortEngine.h"
+#import "GeniusTabularCodec.h"
+#import "GeniusPairMerger.h"
+#import "GeniusDeckSnapshot.h"
+#import "GeniusLearnerSimulator.h"
+#import "GeniusDistractorIndex.h"
+#import "GeniusItem.h"
+#import "GeniusSyncClient.h"
+#import "GeniusSyncServer.h"
+
+@interface GeniusBenchmarkTest : SenTestCase {
+}
+
+@end
+
+//! Throughput measurements for deck wide operations.  Results are logged, not asserted.
+@implementation GeniusBenchmarkTest
+
+//! Batch rescheduling of one million packed entries from the classic to the SM-2 scheduler.
+- (void) testRescheduleThroughput
+{
+    const unsigned int count = 1000000;
+    const int passes = 10;
+    int * scores = (int *)malloc(count * sizeof(int));
+    GeniusTime * dueTimes = (GeniusTime *)malloc(count * sizeof(GeniusTime));
+    GeniusTime deltas[kGeniusSchedulerMaximumScore+2];
+
+    srandom(27);
+    unsigned int i;
+    for (i=0; i<count; i++)
+    {
+        scores[i] = (int)(random() % 12) - 1;
+        dueTimes[i] = (scores[i] < 0) ? kGeniusTimeNone : 1200000000LL + (random() % 10000000);
+    }
+
+    id <GeniusScheduler> classic = [GeniusScoreScheduler schedulerWithIdentifier:@"classic" parameters:nil];
+    id <GeniusScheduler> sm2 = [GeniusScoreScheduler schedulerWithIdentifier:@"sm2" parameters:nil];
+    GeniusComputeRescheduleDeltas(classic, sm2, deltas);
+
+    NSDate * start = [NSDate date];
+    int pass;
+    for (pass=0; pass<passes; pass++)
+        GeniusRescheduleDueTimes(scores, dueTimes, count, deltas);
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+
+    NSLog(@"reschedule: %u entries x %d passes in %.3fs (%.1f M entries/s)", count, passes, elapsed, (count * passes) / MAX(elapsed, 1e-9) / 1e6);
+
+    for (i=0; i<count; i++)
+        if (scores[i] < 0)
+            STAssertEquals(dueTimes[i], kGeniusTimeNone, @"entry %u", i);
+
+    free(scores);
+    free(dueTimes);
+}
+
+//! Rescheduling through columns agrees with scheduling each association individually.
+- (void) testRescheduleColumns
+{
+    id <GeniusScheduler> classic = [GeniusScoreScheduler defaultScheduler];
+    id <GeniusScheduler> sm2 = [GeniusScoreScheduler schedulerWithIdentifier:@"sm2" parameters:nil];
+    GeniusTime now = 1200000000LL;
+
+    NSMutableArray * pairs = [NSMutableArray array];
+    NSMutableArray * associations = [NSMutableArray array];
+    int score;
+    for (score=0; score<8; score++)
+    {
+        GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+        [pairs addObject:pair];
+        GeniusAssociation * association = [pair associationAB];
+        [association setScore:score];
+        [association setDueTime:now + [classic intervalForScore:score]];
+        [associations addObject:association];
+        [associations addObject:[pair associationBA]];
+    }
+
+    GeniusAssociationColumns * columns = [[GeniusAssociationColumns alloc] initWithAssociations:associations];
+    unsigned int changed = GeniusRescheduleColumns(columns, classic, sm2);
+    [columns release];
+
+    STAssertEquals(changed, 8U, nil);
+    for (score=0; score<8; score++)
+    {
+        GeniusPair * pair = [pairs objectAtIndex:score];
+        STAssertEquals([[pair associationAB] dueTime], now + [sm2 intervalForScore:score], @"score %d", score);
+        STAssertEquals([[pair associationBA] dueTime], kGeniusTimeNone, nil);
+    }
+}
+
+//! Cost of updating and querying GeniusAnalytics after each answer in a 200,000 association deck.
+- (void) testAnalyticsAnswerLatency
+{
+    const unsigned int pairCount = 100000;
+    const unsigned int answerCount = 10000;
+    GeniusTime now = GeniusTimeNow();
+
+    GeniusTimingWheel * wheel = [[GeniusTimingWheel alloc] initWithTime:now];
+    GeniusAnalytics * analytics = [[GeniusAnalytics alloc] initWithDueIndex:wheel];
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:pairCount];
+    unsigned int i;
+    for (i=0; i<pairCount; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [pairs addObject:pair];
+        [pair release];
+        [wheel addAssociation:[pair associationAB]];
+        [wheel addAssociation:[pair associationBA]];
+        [analytics addAssociation:[pair associationAB]];
+        [analytics addAssociation:[pair associationBA]];
+    }
+    [analytics rebuildRetentionFromLog:nil pairs:pairs];
+
+    unsigned int forecast[30];
+    GeniusReviewRecord record;
+    record.time = now;
+    record.responseMilliseconds = 1000;
+    record.matchScore = 1.0;
+    record.outcome = GeniusReviewOutcomeRight;
+    record.flags = 0;
+
+    srandom(29);
+    NSDate * start = [NSDate date];
+    for (i=0; i<answerCount; i++)
+    {
+        GeniusAssociation * association = [[pairs objectAtIndex:random() % pairCount] associationAB];
+        int oldScore = [association score];
+        [association setScore:oldScore+1];
+        [association setDueTime:now + 60 * (i % 5000)];
+        [analytics association:association didChangeScoreFrom:oldScore];
+        [wheel updateAssociation:association];
+        record.associationID = [association associationID];
+        [analytics recordReview:&record ofAssociation:association];
+
+        [analytics learnedCountUseAB:YES useBA:YES];
+        [analytics getDueForecast:forecast forDays:30];
+        [analytics retentionByGroup];
+    }
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+    NSLog(@"analytics: %u answers with update and query in %.3fs (%.1f us per answer)", answerCount, elapsed, elapsed / answerCount * 1e6);
+
+    unsigned int total = 0;
+    for (i=0; i<30; i++)
+        total += forecast[i];
+    STAssertTrue(total <= 2 * pairCount, nil);
+    STAssertEquals([analytics associationCountUseAB:YES useBA:YES], 2 * pairCount, nil);
+
+    [analytics release];
+    [wheel release];
+}
+
+//! Simulated scrolling through 100,000 rows, 40 visible rows and 7 columns per frame.
+/*! Compares the row model against resolving every cell through key value coding as the bindings did. */
+- (void) testScrollFrameCost
+{
+    const unsigned int rowCount = 100000;
+    const unsigned int visibleRows = 40;
+    const unsigned int frameCount = 5000;
+    NSArray * identifiers = [NSArray arrayWithObjects:@"disabled", @"columnA", @"columnB", @"customGroup", @"customType", @"scoreAB", @"scoreBA", nil];
+    NSArray * keyPaths = [NSArray arrayWithObjects:@"disabled", @"itemA.stringValue", @"itemB.stringValue", @"customGroupString", @"customTypeString", @"associationAB.scoreNumber", @"associationBA.scoreNumber", nil];
+    unsigned int columnCount = [identifiers count];
+
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:rowCount];
+    unsigned int i;
+    for (i=0; i<rowCount; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair associationAB] setScore:(i % 8) - 1];
+        [pairs addObject:pair];
+        [pair release];
+    }
+
+    GeniusTableRowModel * rowModel = [[GeniusTableRowModel alloc] initWithArrangedObjects:pairs];
+    unsigned int c;
+    for (c=0; c<columnCount; c++)
+        [rowModel setKeyPath:[keyPaths objectAtIndex:c] transformerName:nil forBinding:@"value" column:[identifiers objectAtIndex:c]];
+
+    // Scroll down three rows per frame, redrawing every visible cell like a table does.
+    NSDate * start = [NSDate date];
+    unsigned int frame, tiers = 0;
+    for (frame=0; frame<frameCount; frame++)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        NSRange visible = NSMakeRange((frame * 3) % (rowCount - visibleRows), visibleRows);
+        [rowModel setVisibleRange:visible];
+        for (i=visible.location; i<NSMaxRange(visible); i++)
+        {
+            for (c=0; c<columnCount; c++)
+                [rowModel valueForBinding:@"value" column:[identifiers objectAtIndex:c] row:i];
+            tiers += [rowModel statusTierForColumn:@"scoreAB" row:i];
+        }
+        [pool release];
+    }
+    NSTimeInterval modelElapsed = -[start timeIntervalSinceNow];
+
+    start = [NSDate date];
+    for (frame=0; frame<frameCount; frame++)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        NSRange visible = NSMakeRange((frame * 3) % (rowCount - visibleRows), visibleRows);
+        for (i=visible.location; i<NSMaxRange(visible); i++)
+            for (c=0; c<columnCount; c++)
+                [[pairs objectAtIndex:i] valueForKeyPath:[keyPaths objectAtIndex:c]];
+        [pool release];
+    }
+    NSTimeInterval kvcElapsed = -[start timeIntervalSinceNow];
+
+    unsigned int rowsDrawn = frameCount * visibleRows;
+    NSLog(@"scroll: row model %.2f us/frame %.3f us/row (%u rows materialized), key value coding %.2f us/frame %.3f us/row",
+          modelElapsed / frameCount * 1e6, modelElapsed / rowsDrawn * 1e6, [rowModel materializedRowCount],
+          kvcElapsed / frameCount * 1e6, kvcElapsed / rowsDrawn * 1e6);
+
+    STAssertTrue([rowModel cachedRowCount] <= visibleRows + 32, nil);
+    STAssertTrue(tiers > 0, nil);
+    [rowModel release];
+}
+
+//! Sorting 500,000 rows by score and by text, comparing GeniusSortEngine with NSSortDescriptor.
+/*! The first engine sort includes extracting the keys; the re-sort reverses direction over cached keys. */
+- (void) testSortThroughput
+{
+    const unsigned int rowCount = 500000;
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:rowCount];
+    srandom(31);
+    unsigned int i;
+    for (i=0; i<rowCount; i++)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setValue:[NSString stringWithFormat:@"Cue %ld", random() % 100000] forKey:@"stringValue"];
+        [[pair associationAB] setScore:(int)(random() % 12) - 1];
+        [pairs addObject:pair];
+        [pair release];
+        [pool release];
+    }
+
+    NSArray * keyPaths = [NSArray arrayWithObjects:@"associationAB.scoreNumber", @"itemA.stringValue", nil];
+    GeniusSortEngine * engine = [[GeniusSortEngine alloc] init];
+    unsigned int k;
+    for (k=0; k<[keyPaths count]; k++)
+    {
+        NSString * keyPath = [keyPaths objectAtIndex:k];
+        NSArray * ascending = [NSArray arrayWithObject:[[[NSSortDescriptor alloc] initWithKey:keyPath ascending:YES] autorelease]];
+        NSArray * descending = [NSArray arrayWithObject:[[[NSSortDescriptor alloc] initWithKey:keyPath ascending:NO] autorelease]];
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+
+        NSDate * start = [NSDate date];
+        NSArray * sorted = [engine sortedArrayFromArray:pairs usingDescriptors:ascending];
+        NSTimeInterval firstElapsed = -[start timeIntervalSinceNow];
+
+        start = [NSDate date];
+        NSArray * resorted = [engine sortedArrayFromArray:pairs usingDescriptors:descending];
+        NSTimeInterval cachedElapsed = -[start timeIntervalSinceNow];
+
+        start = [NSDate date];
+        [pairs sortedArrayUsingDescriptors:ascending];
+        NSTimeInterval kvcElapsed = -[start timeIntervalSinceNow];
+
+        NSLog(@"sort %@: %u rows, engine first %.3fs, engine cached %.3fs, sort descriptors %.3fs",
+              keyPath, rowCount, firstElapsed, cachedElapsed, kvcElapsed);
+        STAssertEquals([sorted count], rowCount, nil);
+        STAssertEquals([resorted count], rowCount, nil);
+        [pool release];
+    }
+    [engine release];
+}
+
+//! Encoding and decoding 100,000 rows of tab delimited text, as a large drag or paste does.
+- (void) testTabularCodecThroughput
+{
+    const unsigned int rowCount = 100000;
+    NSArray * keyPaths = [NSArray arrayWithObjects:@"itemA.stringValue", @"itemB.stringValue", @"customGroupString", @"customTypeString", @"notesString", nil];
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:rowCount];
+    unsigned int i;
+    for (i=0; i<rowCount; i++)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setValue:[NSString stringWithFormat:@"Question number %u", i] forKey:@"stringValue"];
+        [[pair itemB] setValue:[NSString stringWithFormat:@"Answer\twith tab %u", i] forKey:@"stringValue"];
+        [pair setNotesString:@"Some notes\non two lines"];
+        [pairs addObject:pair];
+        [pair release];
+        [pool release];
+    }
+
+    NSDate * start = [NSDate date];
+    NSString * text = [GeniusTabularEncoder stringFromPairs:pairs keyPaths:keyPaths];
+    NSTimeInterval encodeElapsed = -[start timeIntervalSinceNow];
+
+    start = [NSDate date];
+    GeniusTabularDecoder * decoder = [[GeniusTabularDecoder alloc] initWithString:text keyPaths:keyPaths];
+    NSTimeInterval longestSlice = 0.0;
+    while ([decoder isAtEnd] == NO)
+    {
+        NSDate * sliceStart = [NSDate date];
+        [decoder decodePairsWithLimit:1000];
+        longestSlice = MAX(longestSlice, -[sliceStart timeIntervalSinceNow]);
+    }
+    NSTimeInterval decodeElapsed = -[start timeIntervalSinceNow];
+
+    NSLog(@"tabular: %u rows, %u characters, encode %.3fs, decode %.3fs, longest 1000 row slice %.1f ms",
+          rowCount, [text length], encodeElapsed, decodeElapsed, longestSlice * 1000.0);
+    STAssertEquals([[decoder pairs] count], rowCount, nil);
+    [decoder release];
+}
+
+//! Re-importing a 100,000 row word list with every tenth answer changed and 10,000 new rows.
+- (void) testMergeThroughput
+{
+    const unsigned int rowCount = 100000;
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:rowCount];
+    NSMutableArray * incoming = [NSMutableArray arrayWithCapacity:rowCount + rowCount / 10];
+    unsigned int i;
+    for (i=0; i<rowCount + rowCount / 10; i++)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        NSString * cue = [NSString stringWithFormat:@"Word %u", i];
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setValue:cue forKey:@"stringValue"];
+        [[pair itemB] setValue:[NSString stringWithFormat:@"Wort %u", i] forKey:@"stringValue"];
+        if (i < rowCount)
+            [pairs addObject:pair];
+        [pair release];
+
+        pair = [[GeniusPair alloc] init];
+        [[pair itemA] setValue:[cue lowercaseString] forKey:@"stringValue"];
+        [[pair itemB] setValue:[NSString stringWithFormat:(i % 10 ? @"Wort %u" : @"Neues Wort %u"), i] forKey:@"stringValue"];
+        [incoming addObject:pair];
+        [pair release];
+        [pool release];
+    }
+
+    NSDate * start = [NSDate date];
+    GeniusPairMerger * merger = [[GeniusPairMerger alloc] initWithPairs:pairs];
+    [merger planMergeOfPairs:incoming];
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+
+    NSLog(@"merge: %u existing, %u incoming rows planned in %.3fs (%u inserted, %u updated, %u unchanged)",
+          rowCount, [incoming count], elapsed, [merger insertedCount], [merger updatedCount], [merger unchangedCount]);
+    STAssertEquals([merger insertedCount], rowCount / 10, nil);
+    STAssertEquals([merger updatedCount], rowCount / 10, nil);
+    STAssertEquals([merger unchangedCount], rowCount - rowCount / 10, nil);
+    [merger release];
+}
+
+//! Cost of editing while snapshots are outstanding, against editing with no snapshot held.
+/*!
+    Each round scores 20 random pairs of a 100,000 pair deck and takes a snapshot.  When the previous
+    snapshot is still held, as by a background worker, each round also copies the table and the
+    chunks holding the edited pairs.
+ */
+- (void) testSnapshotEditOverhead
+{
+    const unsigned int count = 100000;
+    const int rounds = 2000, editsPerRound = 20;
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:count];
+    unsigned int i;
+    for (i=0; i<count; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [pairs addObject:pair];
+        [pair release];
+    }
+    GeniusDeckStore * store = [[GeniusDeckStore alloc] initWithPairs:pairs];
+
+    NSDate * start = [NSDate date];
+    [store snapshot];
+    NSTimeInterval buildTime = -[start timeIntervalSinceNow];
+
+    NSTimeInterval elapsed[2];
+    int held;
+    for (held=0; held<2; held++)
+    {
+        srandom(36);
+        GeniusDeckSnapshot * heldSnapshot = nil;
+        start = [NSDate date];
+        int round, edit;
+        for (round=0; round<rounds; round++)
+        {
+            NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+            for (edit=0; edit<editsPerRound; edit++)
+            {
+                GeniusAssociation * association = [[pairs objectAtIndex:random() % count] associationAB];
+                [association setScore:round % 8];
+                [store objectDidChange:association];
+            }
+            GeniusDeckSnapshot * snapshot = [store snapshot];
+            if (held)
+            {
+                [heldSnapshot release];
+                heldSnapshot = [snapshot retain];
+            }
+            [pool release];
+        }
+        elapsed[held] = -[start timeIntervalSinceNow];
+        [heldSnapshot release];
+    }
+
+    NSLog(@"snapshot: %u pairs built in %.3fs; %d edits in %.3fs without and %.3fs with a snapshot held (%.2f us overhead per edit)",
+          count, buildTime, rounds * editsPerRound, elapsed[0], elapsed[1], (elapsed[1] - elapsed[0]) * 1e6 / (rounds * editsPerRound));
+    STAssertEquals([[store snapshot] count], count, nil);
+    [store release];
+}
+
+//! Two months of daily study by 500 learners on a 300 pair deck, with the classic and SM-2 schedulers.
+- (void) testLearnerSimulation
+{
+    NSMutableArray * pairs = [NSMutableArray array];
+    unsigned int i;
+    for (i=0; i<300; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [pair setImportance:(i % 3 == 0 ? kGeniusPairMaximumImportance : kGeniusPairNormalImportance)];
+        [pairs addObject:pair];
+        [pair release];
+    }
+    NSDictionary * parameters = [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithInt:500], @"learnerCount",
+        [NSNumber numberWithInt:60], @"dayCount",
+        nil];
+
+    NSArray * identifiers = [NSArray arrayWithObjects:@"classic", @"sm2", nil];
+    NSEnumerator * identifierEnumerator = [identifiers objectEnumerator];
+    NSString * identifier;
+    while ((identifier = [identifierEnumerator nextObject]))
+    {
+        GeniusLearnerSimulator * simulator = [[GeniusLearnerSimulator alloc] initWithPairs:pairs parameters:parameters];
+        [simulator setScheduler:[GeniusScoreScheduler schedulerWithIdentifier:identifier parameters:nil]];
+        [simulator run];
+        NSLog(@"simulation on %u threads:\n%@", [GeniusLearnerSimulator processorCount], [simulator report]);
+        STAssertTrue([simulator answerCount] > 0, nil);
+        [simulator release];
+    }
+}
+
+//! Cost of indexing a 50,000 pair deck for multiple choice and of finding four distractors per card.
+- (void) testDistractorLatency
+{
+    const unsigned int pairCount = 50000;
+    const unsigned int queryCount = 10000;
+    NSArray * types = [NSArray arrayWithObjects:@"noun", @"verb", @"adjective", nil];
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:pairCount];
+    GeniusRandomState random;
+    GeniusRandomSeed(&random, 31);
+    unsigned int i, j;
+    for (i=0; i<pairCount; i++)
+    {
+        char answer[16];
+        unsigned int length = 4 + GeniusRandomLong(&random) % 8;
+        for (j=0; j<length; j++)
+            answer[j] = 'a' + GeniusRandomLong(&random) % 26;
+        answer[length] = 0;
+
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setStringValue:[NSString stringWithFormat:@"question %u", i]];
+        [[pair itemB] setStringValue:[NSString stringWithCString:answer encoding:NSASCIIStringEncoding]];
+        [pair setCustomTypeString:[types objectAtIndex:i % [types count]]];
+        [pairs addObject:pair];
+        [pair release];
+    }
+
+    GeniusDistractorIndex * index = [[GeniusDistractorIndex alloc] init];
+    NSDate * start = [NSDate date];
+    [index setPairs:pairs];
+    NSTimeInterval buildElapsed = -[start timeIntervalSinceNow];
+
+    unsigned int found = 0;
+    start = [NSDate date];
+    for (i=0; i<queryCount; i++)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        GeniusPair * pair = [pairs objectAtIndex:GeniusRandomLong(&random) % pairCount];
+        found += [[index distractorsForAssociation:[pair associationAB] count:4] count];
+        [pool release];
+    }
+    NSTimeInterval queryElapsed = -[start timeIntervalSinceNow];
+
+    NSLog(@"distractors: %u pairs indexed in %.3fs; %u cards in %.3fs (%.1f us per card)",
+          pairCount, buildElapsed, queryCount, queryElapsed, queryElapsed / queryCount * 1e6);
+    STAssertEquals(found, 4 * queryCount, nil);
+    [index release];
+}
+
+//! Cost of duplicating 50,000 pairs with long text, as the Duplicate command does with a large selection.
+- (void) testDuplicateCost
+{
+    const unsigned int pairCount = 50000;
+    NSString * longText = [@"" stringByPaddingToLength:4096 withString:@"lorem ipsum " startingAtIndex:0];
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:pairCount];
+    unsigned int i;
+    for (i=0; i<pairCount; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setStringValue:[NSString stringWithFormat:@"question %u", i]];
+        [[pair itemB] setStringValue:longText];
+        [pair setNotesString:longText];
+        [pairs addObject:pair];
+        [pair release];
+    }
+
+    NSDate * start = [NSDate date];
+    NSArray * copies = [[NSArray alloc] initWithArray:pairs copyItems:YES];
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+
+    NSLog(@"duplicate: %u pairs with %u characters of text each in %.3fs (%.2f us per pair)",
+          pairCount, 2 * [longText length], elapsed, elapsed / pairCount * 1e6);
+    STAssertTrue([[[copies lastObject] itemB] stringValue] == [[[pairs lastObject] itemB] stringValue], nil);
+    [copies release];
+}
+
+//! Bytes moved and time taken to sync a 100,000 card deck between two machines.
+/*!
+    The first machine pushes the whole deck and the second pulls it.  Then the first edits 100 cards and
+    studies 1,000, the second studies 1,000 of which 100 were also studied on the first, and both sync
+    twice so that the conflicting reviews are merged and seen on both sides.
+ */
+- (void) testSyncTransfer
+{
+    const unsigned int cardCount = 100000;
+    const unsigned int studyCount = 1000;
+    NSMutableArray * pairsA = [NSMutableArray arrayWithCapacity:cardCount];
+    unsigned int i;
+    for (i=0; i<cardCount; i++)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setStringValue:[NSString stringWithFormat:@"Word %u", i]];
+        [[pair itemB] setStringValue:[NSString stringWithFormat:@"Wort %u", i]];
+        [pairsA addObject:pair];
+        [pair release];
+        [pool release];
+    }
+
+    GeniusSyncServer * server = [[GeniusSyncServer alloc] initWithPath:nil];
+    GeniusSyncClient * clientA = [[GeniusSyncClient alloc] initWithReplicaID:@"A" statePath:nil];
+    GeniusSyncClient * clientB = [[GeniusSyncClient alloc] initWithReplicaID:@"B" statePath:nil];
+    GeniusDeckStore * storeA = [[GeniusDeckStore alloc] initWithPairs:pairsA];
+
+    NSDate * start = [NSDate date];
+    [clientA syncSnapshot:[storeA snapshot] transport:server];
+    NSTimeInterval pushElapsed = -[start timeIntervalSinceNow];
+    unsigned int pushBytes = [clientA bytesSent];
+
+    start = [NSDate date];
+    NSArray * cards = [clientB syncSnapshot:[[[[GeniusDeckStore alloc] initWithPairs:[NSArray array]] autorelease] snapshot] transport:server];
+    NSMutableArray * pairsB = [NSMutableArray arrayWithCapacity:cardCount];
+    NSMutableDictionary * pairsByIDB = [NSMutableDictionary dictionaryWithCapacity:cardCount];
+    NSEnumerator * cardEnumerator = [cards objectEnumerator];
+    NSDictionary * card;
+    while ((card = [cardEnumerator nextObject]))
+    {
+        GeniusPair * pair = [[GeniusPair alloc] initWithItemA:[[[GeniusItem alloc] init] autorelease] itemB:[[[GeniusItem alloc] init] autorelease]
+                                                     userDict:[NSMutableDictionary dictionary] pairID:[[card objectForKey:@"id"] unsignedLongLongValue]];
+        GeniusSyncApplyCardToPair(card, pair);
+        [pairsB addObject:pair];
+        [pairsByIDB setObject:pair forKey:[card objectForKey:@"id"]];
+        [pair release];
+    }
+    NSTimeInterval pullElapsed = -[start timeIntervalSinceNow];
+    unsigned int pullBytes = [clientB bytesReceived];
+    GeniusDeckStore * storeB = [[GeniusDeckStore alloc] initWithPairs:pairsB];
+
+    GeniusRandomState random;
+    GeniusRandomSeed(&random, 48);
+    for (i=0; i<studyCount; i++)
+    {
+        GeniusPair * pairA = [pairsA objectAtIndex:GeniusRandomLong(&random) % cardCount];
+        if (i < studyCount / 10)
+            [[pairA itemB] setStringValue:[NSString stringWithFormat:@"das Wort %u", i]];
+        [[pairA associationAB] setScore:2];
+        [[pairA associationAB] setDueTime:1200000000LL + i];
+        [storeA pairDidChange:pairA];
+
+        // The first 100 reviews on the second machine hit cards also reviewed on the first.
+        GeniusPair * pairB = (i < studyCount / 10 ? [pairsByIDB objectForKey:[NSNumber numberWithUnsignedLongLong:[pairA pairID]]]
+                                                 : [pairsB objectAtIndex:GeniusRandomLong(&random) % cardCount]);
+        [[pairB associationAB] setScore:0];
+        [[pairB associationAB] setDueTime:1100000000LL + i];
+        [storeB pairDidChange:pairB];
+    }
+
+    unsigned int deltaBytes = 0;
+    start = [NSDate date];
+    [clientA syncSnapshot:[storeA snapshot] transport:server];
+    deltaBytes += [clientA bytesSent] + [clientA bytesReceived];
+    unsigned int sentCountA = [clientA sentCount];
+    cards = [clientB syncSnapshot:[storeB snapshot] transport:server];
+    deltaBytes += [clientB bytesSent] + [clientB bytesReceived];
+    unsigned int sentCountB = [clientB sentCount];
+    cardEnumerator = [cards objectEnumerator];
+    while ((card = [cardEnumerator nextObject]))
+        GeniusSyncApplyCardToPair(card, [pairsByIDB objectForKey:[card objectForKey:@"id"]]);
+    [clientA syncSnapshot:[storeA snapshot] transport:server];
+    deltaBytes += [clientA bytesSent] + [clientA bytesReceived];
+    NSTimeInterval deltaElapsed = -[start timeIntervalSinceNow];
+
+    NSLog(@"sync: %u cards, push %u bytes in %.3fs, pull %u bytes in %.3fs; %u + %u changed cards merged moving %u bytes in %.3fs",
+          cardCount, pushBytes, pushElapsed, pullBytes, pullElapsed, sentCountA, sentCountB, deltaBytes, deltaElapsed);
+    STAssertEquals([pairsB count], cardCount, nil);
+    STAssertTrue(sentCountA <= studyCount && sentCountB <= studyCount, nil);
+    STAssertTrue(deltaBytes < pushBytes / 10, nil);
+
+    [storeA release];
+    [storeB release];
+    [clientA release];
+    [clientB release];
+    [server release];
+}
+
+@end
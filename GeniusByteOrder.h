@@ -0,0 +1,49 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+// Little endian integers for the binary files of a deck:  review log, text and media stores,
+// libraries and the deck search index.  The files read the same on PowerPC and Intel.
+
+//! Stores @a value at @a bytes in little endian byte order.
+static __inline__ void PutUInt32(unsigned char * bytes, unsigned int value)
+{
+    int i;
+    for (i=0; i<4; i++)
+        bytes[i] = (unsigned char)(value >> (8 * i));
+}
+
+//! Reads a little endian 32 bit value from @a bytes.
+static __inline__ unsigned int GetUInt32(const unsigned char * bytes)
+{
+    return (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) | ((unsigned int)bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
+
+//! Stores @a value at @a bytes in little endian byte order.
+static __inline__ void PutUInt64(unsigned char * bytes, unsigned long long value)
+{
+    PutUInt32(bytes, (unsigned int)value);
+    PutUInt32(bytes + 4, (unsigned int)(value >> 32));
+}
+
+//! Reads a little endian 64 bit value from @a bytes.
+static __inline__ unsigned long long GetUInt64(const unsigned char * bytes)
+{
+    return (unsigned long long)GetUInt32(bytes) | ((unsigned long long)GetUInt32(bytes + 4) << 32);
+}
@@ -0,0 +1,38 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class GeniusDeckSearchIndex;
+
+//! Window searching the GeniusDeckSearchIndex of all decks and opening the deck of a result at its pair.
+/*! The window is built in code; there is no nib for it. */
+@interface GeniusDeckSearchController : NSWindowController {
+    GeniusDeckSearchIndex * _searchIndex;   //!< The index searched.
+    NSSearchField * _searchField;           //!< Query entry.
+    NSTableView * _tableView;               //!< Lists #_results.
+    NSTextField * _statusField;             //!< Number of results.
+    NSArray * _results;                     //!< GeniusDeckSearchResult objects of the current query.
+}
+
+- (id) initWithSearchIndex:(GeniusDeckSearchIndex *)searchIndex;
+
+- (IBAction) search:(id)sender;
+- (IBAction) openResult:(id)sender;
+
+@end
@@ -0,0 +1,170 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusDeckSearchController.h"
+#import "GeniusDeckSearchIndex.h"
+#import "GeniusDocument.h"
+
+//! Most results listed for one query.
+#define kGeniusDeckSearchResultLimit 500
+
+//! Builds the window and lists the results of GeniusDeckSearchIndex queries.
+@implementation GeniusDeckSearchController
+
+//! Creates the window:  a search field above a table of deck, question and answer, and a status line.
+- (id) initWithSearchIndex:(GeniusDeckSearchIndex *)searchIndex
+{
+    NSPanel * panel = [[NSPanel alloc] initWithContentRect:NSMakeRect(0.0, 0.0, 600.0, 380.0)
+        styleMask:(NSTitledWindowMask | NSClosableWindowMask | NSResizableWindowMask) backing:NSBackingStoreBuffered defer:YES];
+    [panel setTitle:NSLocalizedString(@"Search All Decks", nil)];
+    [panel setMinSize:NSMakeSize(360.0, 200.0)];
+    [panel setHidesOnDeactivate:NO];
+    [panel setFrameAutosaveName:@"DeckSearch"];
+
+    self = [super initWithWindow:panel];
+    [panel release];
+    if (self == nil)
+        return nil;
+
+    _searchIndex = [searchIndex retain];
+    _results = [[NSArray alloc] init];
+    NSView * contentView = [panel contentView];
+    NSRect bounds = [contentView bounds];
+
+    _searchField = [[NSSearchField alloc] initWithFrame:NSMakeRect(12.0, NSHeight(bounds) - 34.0, NSWidth(bounds) - 24.0, 22.0)];
+    [_searchField setAutoresizingMask:(NSViewWidthSizable | NSViewMinYMargin)];
+    [_searchField setTarget:self];
+    [_searchField setAction:@selector(search:)];
+    [contentView addSubview:_searchField];
+
+    NSScrollView * scrollView = [[NSScrollView alloc] initWithFrame:NSMakeRect(12.0, 30.0, NSWidth(bounds) - 24.0, NSHeight(bounds) - 72.0)];
+    [scrollView setAutoresizingMask:(NSViewWidthSizable | NSViewHeightSizable)];
+    [scrollView setHasVerticalScroller:YES];
+    [scrollView setBorderType:NSBezelBorder];
+    _tableView = [[NSTableView alloc] initWithFrame:[[scrollView contentView] bounds]];
+    NSArray * identifiers = [NSArray arrayWithObjects:@"deckName", @"question", @"answer", nil];
+    NSArray * titles = [NSArray arrayWithObjects:NSLocalizedString(@"Deck", nil), NSLocalizedString(@"Question", nil), NSLocalizedString(@"Answer", nil), nil];
+    unsigned int i;
+    for (i=0; i<[identifiers count]; i++)
+    {
+        NSTableColumn * column = [[NSTableColumn alloc] initWithIdentifier:[identifiers objectAtIndex:i]];
+        [[column headerCell] setStringValue:[titles objectAtIndex:i]];
+        [column setEditable:NO];
+        [column setWidth:(i == 0 ? 120.0 : 220.0)];
+        [_tableView addTableColumn:column];
+        [column release];
+    }
+    [_tableView setColumnAutoresizingStyle:NSTableViewUniformColumnAutoresizingStyle];
+    [_tableView setUsesAlternatingRowBackgroundColors:YES];
+    [_tableView setDataSource:self];
+    [_tableView setTarget:self];
+    [_tableView setDoubleAction:@selector(openResult:)];
+    [scrollView setDocumentView:_tableView];
+    [contentView addSubview:scrollView];
+    [scrollView release];
+
+    _statusField = [[NSTextField alloc] initWithFrame:NSMakeRect(12.0, 6.0, NSWidth(bounds) - 24.0, 17.0)];
+    [_statusField setAutoresizingMask:(NSViewWidthSizable | NSViewMaxYMargin)];
+    [_statusField setEditable:NO];
+    [_statusField setBordered:NO];
+    [_statusField setDrawsBackground:NO];
+    [_statusField setFont:[NSFont systemFontOfSize:[NSFont smallSystemFontSize]]];
+    [contentView addSubview:_statusField];
+
+    [panel setInitialFirstResponder:_searchField];
+    [panel center];
+
+    // Segments finished in the background may add results.
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(search:) name:GeniusDeckSearchIndexDidChangeNotification object:_searchIndex];
+    return self;
+}
+
+//! Stops observing the index and releases the views and results.
+- (void) dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [_searchIndex release];
+    [_searchField release];
+    [_tableView release];
+    [_statusField release];
+    [_results release];
+    [super dealloc];
+}
+
+//! Runs the query in #_searchField and lists the results.
+- (IBAction) search:(id)sender
+{
+    NSArray * results = [_searchIndex resultsForQuery:[_searchField stringValue] limit:kGeniusDeckSearchResultLimit];
+    [results retain];
+    [_results release];
+    _results = results;
+    [_tableView reloadData];
+
+    if ([[_searchField stringValue] length] == 0)
+        [_statusField setStringValue:@""];
+    else
+    {
+        NSSet * decks = [NSSet setWithArray:[_results valueForKey:@"deckPath"]];
+        [_statusField setStringValue:[NSString stringWithFormat:NSLocalizedString(@"%u items in %u decks", nil), [_results count], [decks count]]];
+    }
+}
+
+//! Opens the deck of the clicked result, or brings it to the front, and selects the pair.
+- (IBAction) openResult:(id)sender
+{
+    int row = [_tableView clickedRow];
+    if (row < 0)
+        row = [_tableView selectedRow];
+    if (row < 0 || row >= (int)[_results count])
+        return;
+
+    GeniusDeckSearchResult * result = [_results objectAtIndex:row];
+    NSError * error = nil;
+    NSURL * url = [NSURL fileURLWithPath:[result deckPath]];
+    GeniusDocument * document = [[NSDocumentController sharedDocumentController] openDocumentWithContentsOfURL:url display:YES error:&error];
+    if (document == nil)
+    {
+        if (error)
+            [self presentError:error];
+        return;
+    }
+
+    // The deck may have changed since it was indexed.
+    if ([document isKindOfClass:[GeniusDocument class]] == NO || [document revealPairWithID:[result pairID]] == NO)
+        NSBeep();
+}
+
+@end
+
+
+//! Table data source.
+@implementation GeniusDeckSearchController(NSTableDataSource)
+
+//! Number of results.
+- (int)numberOfRowsInTableView:(NSTableView *)aTableView
+{
+    return [_results count];
+}
+
+//! Deck name, question or answer of the result in @a rowIndex.
+- (id)tableView:(NSTableView *)aTableView objectValueForTableColumn:(NSTableColumn *)aTableColumn row:(int)rowIndex
+{
+    return [[_results objectAtIndex:rowIndex] valueForKey:[aTableColumn identifier]];
+}
+
+@end
@@ -0,0 +1,124 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusPair.h"
+#import "GeniusScheduler.h"
+
+@class GeniusDeckSnapshot;
+
+//! Posted by GeniusDeckSearchIndex when a deck was indexed or removed.
+extern NSString * GeniusDeckSearchIndexDidChangeNotification;
+
+//! Most characters of the question and answer of a pair shown in results.
+#define kGeniusDeckSearchSnippetLength 120
+
+//! Read only view of the segment of one deck in a GeniusDeckSearchIndex.
+/*!
+    Holds the text, importance, scores and due times of every pair as last indexed, and the scheduler
+    of the deck, so a deck that is not open can be searched and reviewed without reading the deck file.
+    Values are read from the mapped segment on demand.  Direction 0 is GeniusPair#associationAB,
+    direction 1 GeniusPair#associationBA.
+ */
+@interface GeniusDeckSummary : NSObject {
+    NSData * _data;                     //!< Whole segment, usually mapped.
+    unsigned int _count;                //!< Number of pair records.
+    unsigned int _termCount;            //!< Number of term records.
+    const unsigned char * _pairs;       //!< First pair record.
+    const unsigned char * _terms;       //!< First term record.
+    const unsigned char * _strings;     //!< String area.
+    const unsigned char * _postings;    //!< Posting list area.
+    id <GeniusScheduler> _scheduler;    //!< Scheduler of the deck, decoded from the segment.
+}
+
+- (id) initWithData:(NSData *)data;
+
+- (unsigned int) count;
+- (GeniusPairID) pairIDAtIndex:(unsigned int)index;
+- (NSString *) questionAtIndex:(unsigned int)index;
+- (NSString *) answerAtIndex:(unsigned int)index;
+- (int) importanceAtIndex:(unsigned int)index;
+- (int) scoreAtIndex:(unsigned int)index direction:(unsigned int)direction;
+- (GeniusTime) dueTimeAtIndex:(unsigned int)index direction:(unsigned int)direction;
+- (id <GeniusScheduler>) scheduler;
+
+@end
+
+
+//! One pair found by GeniusDeckSearchIndex#resultsForQuery:limit:.
+@interface GeniusDeckSearchResult : NSObject {
+    NSString * _deckPath;       //!< File of the deck holding the pair.
+    GeniusPairID _pairID;       //!< GeniusPair#pairID of the pair.
+    NSString * _question;       //!< Start of the text of GeniusPair#itemA as last indexed.
+    NSString * _answer;         //!< Start of the text of GeniusPair#itemB as last indexed.
+}
+
+- (id) initWithDeckPath:(NSString *)deckPath pairID:(GeniusPairID)pairID question:(NSString *)question answer:(NSString *)answer;
+
+- (NSString *) deckPath;
+- (NSString *) deckName;
+- (GeniusPairID) pairID;
+- (NSString *) question;
+- (NSString *) answer;
+
+@end
+
+
+//! Application wide word index over the decks the user has opened, kept on disk.
+/*!
+    Every deck gets an immutable segment file holding its pairs (see GeniusDeckSummary) and a sorted table of the normalized
+    words (see GeniusAnswerKeyString) of their question, answer, group, type and notes, each with the
+    ascending list of pairs using it.  A catalog maps deck paths to segment files and the modification
+    date of the deck they were built from.  Saving or opening a deck only rebuilds its own segment,
+    from a GeniusDeckSnapshot on a background thread; the new segment is swapped in on the main thread.
+
+    Queries never open a deck:  each segment is mapped on first use, the words of the query are found
+    by binary search, the last one as a prefix so results follow typing, and the pair lists are
+    intersected.  Results carry the pair id, so a document can select the pair once it is opened.
+
+    Used on the main thread only, apart from the segment building it starts itself.
+ */
+@interface GeniusDeckSearchIndex : NSObject {
+    NSString * _directoryPath;              //!< Folder holding the catalog and segments.
+    NSMutableDictionary * _catalog;         //!< Deck path -> dictionary with "segment" file name and deck "modificationDate".
+    NSMutableDictionary * _segments;        //!< Deck path -> GeniusDeckSummary, mapped on first use.
+    unsigned int _pendingCount;             //!< Segments being built on background threads.
+}
+
++ (NSString *) defaultDirectoryPath;
+
+- (id) initWithDirectoryPath:(NSString *)directoryPath;
+- (NSString *) directoryPath;
+
+- (NSArray *) deckPaths;
+- (BOOL) isDeckCurrentAtPath:(NSString *)deckPath;
+- (NSDate *) modificationDateForDeckAtPath:(NSString *)deckPath;
+- (GeniusDeckSummary *) summaryForDeckAtPath:(NSString *)deckPath;
+- (unsigned int) pendingCount;
+
++ (NSData *) segmentDataWithSnapshot:(GeniusDeckSnapshot *)snapshot scheduler:(id <GeniusScheduler>)scheduler;
+- (BOOL) setSegmentData:(NSData *)segmentData forDeckAtPath:(NSString *)deckPath modificationDate:(NSDate *)modificationDate;
+- (void) indexSnapshot:(GeniusDeckSnapshot *)snapshot scheduler:(id <GeniusScheduler>)scheduler forDeckAtPath:(NSString *)deckPath;
+- (void) indexDecksAtPaths:(NSArray *)deckPaths;
+- (void) removeDeckAtPath:(NSString *)deckPath;
+- (void) removeMissingDecks;
+
+- (NSArray *) resultsForQuery:(NSString *)query limit:(unsigned int)limit;
+
+@end
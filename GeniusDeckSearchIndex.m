@@ -0,0 +1,827 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusDeckSearchIndex.h"
+#import "GeniusDeckSnapshot.h"
+#import "GeniusAnswerKey.h"
+#import "GeniusDocument.h"
+#import "GeniusDocumentFile.h"
+#import "GeniusByteOrder.h"
+#include <string.h>     // memcmp
+
+//! First bytes of every segment file.
+static const char kGeniusSegmentMagic[8] = { 'G', 'e', 'n', 'i', 'u', 's', 'S', '2' };
+
+//! Size of the segment header:  magic, pair count, term count, string area length, posting count,
+//! and offset and length of the scheduler property list in the string area.
+#define kGeniusSegmentHeaderSize 32
+
+//! Size of one pair record:  pair id, offset and length of question and answer in the string area,
+//! importance, the two scores, 4 unused bytes and the two due times.
+#define kGeniusSegmentPairSize 56
+
+//! Size of one term record:  offset and length of the word in the string area, first posting and posting count.
+#define kGeniusSegmentTermSize 16
+
+NSString * GeniusDeckSearchIndexDidChangeNotification = @"GeniusDeckSearchIndexDidChange";
+
+//! Name of the catalog file in the index folder.
+static NSString * const kGeniusCatalogFileName = @"Catalog.plist";
+
+//! Appends the UTF-8 bytes of @a text to @a strings and stores where they went in @a record, as offset and length.
+/*! The whole text is kept, since GeniusDueQueue quizzes from it. */
+static void AppendString(NSMutableData * strings, NSString * text, unsigned char * record)
+{
+    const char * utf8 = [text UTF8String];
+    unsigned int byteLength = (utf8 ? strlen(utf8) : 0);
+    PutUInt32(record, [strings length]);
+    PutUInt32(record + 4, byteLength);
+    [strings appendBytes:utf8 length:byteLength];
+}
+
+//! The first kGeniusDeckSearchSnippetLength characters of @a text.
+static NSString * Snippet(NSString * text)
+{
+    if ([text length] <= kGeniusDeckSearchSnippetLength)
+        return text;
+    return [text substringToIndex:[text rangeOfComposedCharacterSequenceAtIndex:kGeniusDeckSearchSnippetLength].location];
+}
+
+//! A word and the ascending numbers of the pairs using it, while a segment is built.
+typedef struct _GeniusSegmentTerm {
+    NSData * word;          //!< UTF-8 bytes of the word.
+    NSData * postings;      //!< Host order unsigned int pair numbers.
+} GeniusSegmentTerm;
+
+//! qsort comparator:  words in byte order, the order searched by GeniusDeckSummary.
+static int CompareTerms(const void * a, const void * b)
+{
+    NSData * word1 = ((const GeniusSegmentTerm *)a)->word;
+    NSData * word2 = ((const GeniusSegmentTerm *)b)->word;
+    unsigned int length1 = [word1 length], length2 = [word2 length];
+    int result = memcmp([word1 bytes], [word2 bytes], MIN(length1, length2));
+    if (result == 0 && length1 != length2)
+        result = (length1 < length2 ? -1 : 1);
+    return result;
+}
+
+//! Numbers found in both ascending lists @a postings1 and @a postings2.
+static NSData * IntersectPostings(NSData * postings1, NSData * postings2)
+{
+    const unsigned int * p1 = [postings1 bytes];
+    const unsigned int * p2 = [postings2 bytes];
+    unsigned int count1 = [postings1 length] / sizeof(unsigned int), count2 = [postings2 length] / sizeof(unsigned int);
+    NSMutableData * result = [NSMutableData dataWithCapacity:MIN(count1, count2) * sizeof(unsigned int)];
+    unsigned int i = 0, j = 0;
+    while (i < count1 && j < count2)
+    {
+        if (p1[i] < p2[j])
+            i++;
+        else if (p1[i] > p2[j])
+            j++;
+        else
+        {
+            [result appendBytes:&p1[i] length:sizeof(unsigned int)];
+            i++;
+            j++;
+        }
+    }
+    return result;
+}
+
+
+//! Word lookup used by GeniusDeckSearchIndex#resultsForQuery:limit:.
+@interface GeniusDeckSummary (Search)
+- (NSData *) postingsForWord:(NSString *)word isPrefix:(BOOL)isPrefix;
+@end
+
+//! Reads pair records and term tables of a mapped segment.
+@implementation GeniusDeckSummary
+
+//! Checks that the tables of @a data lie within it.  Returns nil for damaged or foreign data.
+- (id) initWithData:(NSData *)data
+{
+    self = [super init];
+    if (self == nil)
+        return nil;
+
+    const unsigned char * bytes = [data bytes];
+    unsigned long long length = [data length];
+    if (length < kGeniusSegmentHeaderSize || memcmp(bytes, kGeniusSegmentMagic, sizeof(kGeniusSegmentMagic)) != 0)
+    {
+        [self release];
+        return nil;
+    }
+
+    _count = GetUInt32(bytes + 8);
+    _termCount = GetUInt32(bytes + 12);
+    unsigned long long stringsLength = GetUInt32(bytes + 16);
+    unsigned long long postingCount = GetUInt32(bytes + 20);
+    unsigned long long stringsStart = kGeniusSegmentHeaderSize + (unsigned long long)_count * kGeniusSegmentPairSize + (unsigned long long)_termCount * kGeniusSegmentTermSize;
+    unsigned long long postingsStart = (stringsStart + stringsLength + 3) & ~3ULL;
+    if (postingsStart + 4 * postingCount != length || (unsigned long long)GetUInt32(bytes + 24) + GetUInt32(bytes + 28) > stringsLength)
+    {
+        [self release];
+        return nil;
+    }
+
+    _data = [data retain];
+    _pairs = bytes + kGeniusSegmentHeaderSize;
+    _terms = _pairs + _count * kGeniusSegmentPairSize;
+    _strings = bytes + stringsStart;
+    _postings = bytes + postingsStart;
+
+    // Offsets inside the string and posting areas are checked once here, not on every read.
+    unsigned int i;
+    for (i=0; i<_count; i++)
+    {
+        const unsigned char * record = _pairs + i * kGeniusSegmentPairSize;
+        if ((unsigned long long)GetUInt32(record + 8) + GetUInt32(record + 12) > stringsLength
+                || (unsigned long long)GetUInt32(record + 16) + GetUInt32(record + 20) > stringsLength)
+            break;
+    }
+    unsigned int j;
+    for (j=0; j<_termCount && i==_count; j++)
+    {
+        const unsigned char * record = _terms + j * kGeniusSegmentTermSize;
+        if ((unsigned long long)GetUInt32(record) + GetUInt32(record + 4) > stringsLength
+                || (unsigned long long)GetUInt32(record + 8) + GetUInt32(record + 12) > postingCount)
+            break;
+    }
+    if (i != _count || j != _termCount)
+    {
+        [self release];
+        return nil;
+    }
+
+    NSData * schedulerData = [NSData dataWithBytes:_strings + GetUInt32(bytes + 24) length:GetUInt32(bytes + 28)];
+    NSDictionary * schedulerPlist = [NSPropertyListSerialization propertyListFromData:schedulerData mutabilityOption:NSPropertyListImmutable format:NULL errorDescription:NULL];
+    if ([schedulerPlist isKindOfClass:[NSDictionary class]])
+        _scheduler = [[GeniusScoreScheduler schedulerWithIdentifier:[schedulerPlist objectForKey:@"identifier"] parameters:[schedulerPlist objectForKey:@"parameters"]] retain];
+    if (_scheduler == nil)
+        _scheduler = [[GeniusScoreScheduler defaultScheduler] retain];
+    return self;
+}
+
+//! Releases the data and scheduler.
+- (void) dealloc
+{
+    [_data release];
+    [_scheduler release];
+    [super dealloc];
+}
+
+//! Number of pairs in the deck when the segment was built.
+- (unsigned int) count
+{
+    return _count;
+}
+
+//! GeniusPair#pairID of pair number @a index.
+- (GeniusPairID) pairIDAtIndex:(unsigned int)index
+{
+    return GetUInt64(_pairs + index * kGeniusSegmentPairSize);
+}
+
+//! Text of GeniusPair#itemA of pair number @a index.
+- (NSString *) questionAtIndex:(unsigned int)index
+{
+    const unsigned char * record = _pairs + index * kGeniusSegmentPairSize;
+    return [[[NSString alloc] initWithBytes:_strings + GetUInt32(record + 8) length:GetUInt32(record + 12) encoding:NSUTF8StringEncoding] autorelease];
+}
+
+//! Text of GeniusPair#itemB of pair number @a index.
+- (NSString *) answerAtIndex:(unsigned int)index
+{
+    const unsigned char * record = _pairs + index * kGeniusSegmentPairSize;
+    return [[[NSString alloc] initWithBytes:_strings + GetUInt32(record + 16) length:GetUInt32(record + 20) encoding:NSUTF8StringEncoding] autorelease];
+}
+
+//! GeniusPair#importance of pair number @a index.
+- (int) importanceAtIndex:(unsigned int)index
+{
+    return (int)GetUInt32(_pairs + index * kGeniusSegmentPairSize + 24);
+}
+
+//! GeniusAssociation#score in @a direction of pair number @a index, -1 if never quizzed.
+- (int) scoreAtIndex:(unsigned int)index direction:(unsigned int)direction
+{
+    return (int)GetUInt32(_pairs + index * kGeniusSegmentPairSize + 28 + 4 * (direction & 1));
+}
+
+//! GeniusAssociation#dueTime in @a direction of pair number @a index.
+- (GeniusTime) dueTimeAtIndex:(unsigned int)index direction:(unsigned int)direction
+{
+    return (GeniusTime)GetUInt64(_pairs + index * kGeniusSegmentPairSize + 40 + 8 * (direction & 1));
+}
+
+//! _scheduler getter.  The classic scheduler for segments of decks using it.
+- (id <GeniusScheduler>) scheduler
+{
+    return _scheduler;
+}
+
+@end
+
+
+@implementation GeniusDeckSummary (Search)
+
+//! Ascending host order numbers of the pairs using @a word, or any word starting with it if @a isPrefix.
+/*! @a word must be normalized like the indexed words, see GeniusAnswerKeyString. */
+- (NSData *) postingsForWord:(NSString *)word isPrefix:(BOOL)isPrefix
+{
+    const char * key = [word UTF8String];
+    unsigned int keyLength = strlen(key);
+
+    // First term not ordered before key.
+    unsigned int low = 0, high = _termCount;
+    while (low < high)
+    {
+        unsigned int middle = (low + high) / 2;
+        const unsigned char * record = _terms + middle * kGeniusSegmentTermSize;
+        unsigned int termLength = GetUInt32(record + 4);
+        int result = memcmp(_strings + GetUInt32(record), key, MIN(termLength, keyLength));
+        if (result < 0 || (result == 0 && termLength < keyLength))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    NSMutableIndexSet * pairIndexes = [NSMutableIndexSet indexSet];
+    unsigned int t;
+    for (t=low; t<_termCount; t++)
+    {
+        const unsigned char * record = _terms + t * kGeniusSegmentTermSize;
+        unsigned int termLength = GetUInt32(record + 4);
+        if (termLength < keyLength || memcmp(_strings + GetUInt32(record), key, keyLength) != 0)
+            break;
+        if (isPrefix == NO && termLength != keyLength)
+            break;
+
+        const unsigned char * posting = _postings + 4 * GetUInt32(record + 8);
+        unsigned int p, postingCount = GetUInt32(record + 12);
+        for (p=0; p<postingCount; p++)
+            [pairIndexes addIndex:GetUInt32(posting + 4 * p)];
+        if (isPrefix == NO)
+            break;
+    }
+
+    unsigned int count = [pairIndexes count];
+    NSMutableData * postings = [NSMutableData dataWithLength:count * sizeof(unsigned int)];
+    [pairIndexes getIndexes:[postings mutableBytes] maxCount:count inIndexRange:NULL];
+    return postings;
+}
+
+@end
+
+
+//! Implements the result object.
+@implementation GeniusDeckSearchResult
+
+//! Designated initializer.
+- (id) initWithDeckPath:(NSString *)deckPath pairID:(GeniusPairID)pairID question:(NSString *)question answer:(NSString *)answer
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _deckPath = [deckPath copy];
+        _pairID = pairID;
+        _question = [question copy];
+        _answer = [answer copy];
+    }
+    return self;
+}
+
+//! Releases the strings.
+- (void) dealloc
+{
+    [_deckPath release];
+    [_question release];
+    [_answer release];
+    [super dealloc];
+}
+
+//! _deckPath getter.
+- (NSString *) deckPath
+{
+    return _deckPath;
+}
+
+//! File name of the deck without extension, for display.
+- (NSString *) deckName
+{
+    return [[_deckPath lastPathComponent] stringByDeletingPathExtension];
+}
+
+//! _pairID getter.
+- (GeniusPairID) pairID
+{
+    return _pairID;
+}
+
+//! _question getter.
+- (NSString *) question
+{
+    return _question;
+}
+
+//! _answer getter.
+- (NSString *) answer
+{
+    return _answer;
+}
+
+@end
+
+
+@interface GeniusDeckSearchIndex (Private)
+- (NSString *) _writeSegmentData:(NSData *)segmentData;
+- (BOOL) _installSegmentFile:(NSString *)segmentName forDeckAtPath:(NSString *)deckPath modificationDate:(NSDate *)modificationDate;
+- (void) _writeCatalog;
+- (void) _indexSnapshotInBackground:(NSDictionary *)job;
+- (void) _indexFilesInBackground:(NSArray *)jobs;
+- (void) _backgroundIndexDidEnd:(NSDictionary *)job;
+@end
+
+@implementation GeniusDeckSearchIndex
+
+//! Genius/Search Index in the Application Support folder of the user.
++ (NSString *) defaultDirectoryPath
+{
+    NSArray * paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES);
+    NSString * supportPath = ([paths count] ? [paths objectAtIndex:0] : [NSHomeDirectory() stringByAppendingPathComponent:@"Library/Application Support"]);
+    return [[supportPath stringByAppendingPathComponent:@"Genius"] stringByAppendingPathComponent:@"Search Index"];
+}
+
+//! Opens the index kept in @a directoryPath, creating the folder and its parents if needed.
+- (id) initWithDirectoryPath:(NSString *)directoryPath
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _directoryPath = [directoryPath copy];
+        _segments = [[NSMutableDictionary alloc] init];
+
+        NSFileManager * fileManager = [NSFileManager defaultManager];
+        NSArray * components = [_directoryPath pathComponents];
+        NSString * path = @"";
+        unsigned int i;
+        for (i=0; i<[components count]; i++)
+        {
+            path = [path stringByAppendingPathComponent:[components objectAtIndex:i]];
+            if ([fileManager fileExistsAtPath:path] == NO && [fileManager createDirectoryAtPath:path attributes:nil] == NO)
+            {
+                NSLog(@"Could not create search index %@", _directoryPath);
+                break;
+            }
+        }
+
+        NSString * catalogPath = [_directoryPath stringByAppendingPathComponent:kGeniusCatalogFileName];
+        NSDictionary * catalog = [NSDictionary dictionaryWithContentsOfFile:catalogPath];
+        _catalog = (catalog ? [catalog mutableCopy] : [[NSMutableDictionary alloc] init]);
+    }
+    return self;
+}
+
+//! Opens the index in #defaultDirectoryPath.
+- (id) init
+{
+    return [self initWithDirectoryPath:[[self class] defaultDirectoryPath]];
+}
+
+//! Releases the catalog and mapped segments.
+- (void) dealloc
+{
+    [_directoryPath release];
+    [_catalog release];
+    [_segments release];
+    [super dealloc];
+}
+
+//! _directoryPath getter.
+- (NSString *) directoryPath
+{
+    return _directoryPath;
+}
+
+//! Paths of the indexed decks.
+- (NSArray *) deckPaths
+{
+    return [_catalog allKeys];
+}
+
+//! Whether the segment of the deck at @a deckPath was built from the file as it is now.
+- (BOOL) isDeckCurrentAtPath:(NSString *)deckPath
+{
+    NSDictionary * entry = [_catalog objectForKey:deckPath];
+    if (entry == nil)
+        return NO;
+    NSDictionary * attributes = [[NSFileManager defaultManager] fileAttributesAtPath:deckPath traverseLink:YES];
+    return (attributes && [[attributes fileModificationDate] isEqualToDate:[entry objectForKey:@"modificationDate"]]);
+}
+
+//! Modification date of the deck file the segment of @a deckPath was built from, or nil if it is not indexed.
+- (NSDate *) modificationDateForDeckAtPath:(NSString *)deckPath
+{
+    return [[_catalog objectForKey:deckPath] objectForKey:@"modificationDate"];
+}
+
+//! The mapped segment of the deck at @a deckPath, or nil if it is missing or damaged.
+/*! Damaged segments, and those of older versions, are dropped from the catalog so the deck is indexed again. */
+- (GeniusDeckSummary *) summaryForDeckAtPath:(NSString *)deckPath
+{
+    GeniusDeckSummary * segment = [_segments objectForKey:deckPath];
+    if (segment)
+        return segment;
+
+    NSString * segmentName = [[_catalog objectForKey:deckPath] objectForKey:@"segment"];
+    if (segmentName == nil)
+        return nil;
+    NSData * data = [NSData dataWithContentsOfMappedFile:[_directoryPath stringByAppendingPathComponent:segmentName]];
+    segment = [[[GeniusDeckSummary alloc] initWithData:data] autorelease];
+    if (segment == nil)
+    {
+        NSLog(@"Damaged search index segment for %@", deckPath);
+        [[NSFileManager defaultManager] removeFileAtPath:[_directoryPath stringByAppendingPathComponent:segmentName] handler:nil];
+        [_catalog removeObjectForKey:deckPath];
+        [self _writeCatalog];
+        return nil;
+    }
+    [_segments setObject:segment forKey:deckPath];
+    return segment;
+}
+
+//! Number of segments being built on background threads.
+- (unsigned int) pendingCount
+{
+    return _pendingCount;
+}
+
+//! Builds the segment of the pairs of @a snapshot, studied with @a scheduler.  Safe on any thread.
+/*! @a scheduler may be nil for the classic scheduler. */
++ (NSData *) segmentDataWithSnapshot:(GeniusDeckSnapshot *)snapshot scheduler:(id <GeniusScheduler>)scheduler
+{
+    unsigned int i, count = [snapshot count];
+    NSMutableData * pairTable = [NSMutableData dataWithLength:count * kGeniusSegmentPairSize];
+    NSMutableData * strings = [NSMutableData data];
+    CFMutableDictionaryRef wordPostings = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+    NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+    for (i=0; i<count; i++)
+    {
+        const GeniusPairRecord * record = [snapshot recordAtIndex:i];
+        unsigned char * pairRecord = (unsigned char *)[pairTable mutableBytes] + i * kGeniusSegmentPairSize;
+        PutUInt32(pairRecord, (unsigned int)(record->pairID & 0xFFFFFFFFULL));
+        PutUInt32(pairRecord + 4, (unsigned int)(record->pairID >> 32));
+        AppendString(strings, record->itemA, pairRecord + 8);
+        AppendString(strings, record->itemB, pairRecord + 16);
+        PutUInt32(pairRecord + 24, (unsigned int)record->importance);
+        PutUInt32(pairRecord + 28, (unsigned int)record->scores[0]);
+        PutUInt32(pairRecord + 32, (unsigned int)record->scores[1]);
+        PutUInt64(pairRecord + 40, (unsigned long long)record->dueTimes[0]);
+        PutUInt64(pairRecord + 48, (unsigned long long)record->dueTimes[1]);
+
+        NSString * fields[5] = { record->itemA, record->itemB, record->customGroup, record->customType, record->notes };
+        unsigned int f;
+        for (f=0; f<5; f++)
+        {
+            if ([fields[f] length] == 0)
+                continue;
+            NSEnumerator * wordEnumerator = [[GeniusAnswerKeyString(fields[f]) componentsSeparatedByString:@" "] objectEnumerator];
+            NSString * word;
+            while ((word = [wordEnumerator nextObject]))
+            {
+                if ([word length] == 0)
+                    continue;
+                NSMutableData * postings = (NSMutableData *)CFDictionaryGetValue(wordPostings, word);
+                if (postings == nil)
+                {
+                    postings = [[NSMutableData alloc] init];
+                    CFDictionarySetValue(wordPostings, word, postings);
+                    [postings release];
+                }
+                unsigned int postingCount = [postings length] / sizeof(unsigned int);
+                if (postingCount == 0 || ((const unsigned int *)[postings bytes])[postingCount-1] != i)
+                    [postings appendBytes:&i length:sizeof(unsigned int)];
+            }
+        }
+
+        if ((i & 1023) == 1023)
+        {
+            [pool release];
+            pool = [[NSAutoreleasePool alloc] init];
+        }
+    }
+    [pool release];
+
+    // Sort the words so segments can be searched by bisection.
+    unsigned int t, termCount = CFDictionaryGetCount(wordPostings);
+    const void ** words = malloc(MAX(termCount, 1U) * sizeof(void *));
+    const void ** postingLists = malloc(MAX(termCount, 1U) * sizeof(void *));
+    CFDictionaryGetKeysAndValues(wordPostings, words, postingLists);
+    GeniusSegmentTerm * terms = malloc(MAX(termCount, 1U) * sizeof(GeniusSegmentTerm));
+    for (t=0; t<termCount; t++)
+    {
+        terms[t].word = [(NSString *)words[t] dataUsingEncoding:NSUTF8StringEncoding];
+        terms[t].postings = (NSData *)postingLists[t];
+    }
+    qsort(terms, termCount, sizeof(GeniusSegmentTerm), CompareTerms);
+
+    NSMutableData * termTable = [NSMutableData dataWithLength:termCount * kGeniusSegmentTermSize];
+    NSMutableData * postingArea = [NSMutableData data];
+    unsigned int postingTotal = 0;
+    for (t=0; t<termCount; t++)
+    {
+        unsigned char * termRecord = (unsigned char *)[termTable mutableBytes] + t * kGeniusSegmentTermSize;
+        unsigned int p, postingCount = [terms[t].postings length] / sizeof(unsigned int);
+        PutUInt32(termRecord, [strings length]);
+        PutUInt32(termRecord + 4, [terms[t].word length]);
+        PutUInt32(termRecord + 8, postingTotal);
+        PutUInt32(termRecord + 12, postingCount);
+        [strings appendData:terms[t].word];
+
+        const unsigned int * values = [terms[t].postings bytes];
+        unsigned char bytes[4];
+        for (p=0; p<postingCount; p++)
+        {
+            PutUInt32(bytes, values[p]);
+            [postingArea appendBytes:bytes length:4];
+        }
+        postingTotal += postingCount;
+    }
+    free(terms);
+    free(words);
+    free(postingLists);
+    CFRelease(wordPostings);
+
+    NSDictionary * schedulerPlist = [NSDictionary dictionaryWithObjectsAndKeys:
+        (scheduler ? [scheduler identifier] : @"classic"), @"identifier",
+        (scheduler ? [scheduler parameters] : [NSDictionary dictionary]), @"parameters",
+        nil];
+    NSData * schedulerData = [NSPropertyListSerialization dataFromPropertyList:schedulerPlist format:NSPropertyListBinaryFormat_v1_0 errorDescription:NULL];
+
+    unsigned char header[kGeniusSegmentHeaderSize];
+    memcpy(header, kGeniusSegmentMagic, sizeof(kGeniusSegmentMagic));
+    PutUInt32(header + 24, [strings length]);
+    PutUInt32(header + 28, [schedulerData length]);
+    [strings appendData:schedulerData];
+    PutUInt32(header + 8, count);
+    PutUInt32(header + 12, termCount);
+    PutUInt32(header + 16, [strings length]);
+    PutUInt32(header + 20, postingTotal);
+
+    NSMutableData * segment = [NSMutableData dataWithBytes:header length:kGeniusSegmentHeaderSize];
+    [segment appendData:pairTable];
+    [segment appendData:termTable];
+    [segment appendData:strings];
+    [segment increaseLengthBy:(4 - [segment length] % 4) % 4];
+    [segment appendData:postingArea];
+    return segment;
+}
+
+//! Replaces the segment of the deck at @a deckPath with @a segmentData, built from the deck as of @a modificationDate.
+/*! Returns NO if the segment could not be written, or if the index already holds a newer one. */
+- (BOOL) setSegmentData:(NSData *)segmentData forDeckAtPath:(NSString *)deckPath modificationDate:(NSDate *)modificationDate
+{
+    NSString * segmentName = [self _writeSegmentData:segmentData];
+    if (segmentName == nil)
+        return NO;
+    return [self _installSegmentFile:segmentName forDeckAtPath:deckPath modificationDate:modificationDate];
+}
+
+//! Rebuilds the segment of the deck at @a deckPath from @a snapshot and @a scheduler on a background thread.
+/*! The deck file is expected to hold the pairs of @a snapshot, so its modification date is recorded with them. */
+- (void) indexSnapshot:(GeniusDeckSnapshot *)snapshot scheduler:(id <GeniusScheduler>)scheduler forDeckAtPath:(NSString *)deckPath
+{
+    NSDictionary * attributes = [[NSFileManager defaultManager] fileAttributesAtPath:deckPath traverseLink:YES];
+    if (snapshot == nil || attributes == nil)
+        return;
+
+    NSDictionary * job = [NSDictionary dictionaryWithObjectsAndKeys:
+        snapshot, @"snapshot",
+        deckPath, @"deckPath",
+        [attributes fileModificationDate], @"modificationDate",
+        scheduler, @"scheduler",    // may be nil, ending the list
+        nil];
+    _pendingCount++;
+    [NSThread detachNewThreadSelector:@selector(_indexSnapshotInBackground:) toTarget:self withObject:job];
+}
+
+//! Indexes the decks of @a deckPaths whose segment is missing or older than the file, reading them on a background thread.
+/*!
+    Used at launch for the recent decks, which are not open.  File attributes are read here, since
+    NSFileManager may only be used on the main thread.
+ */
+- (void) indexDecksAtPaths:(NSArray *)deckPaths
+{
+    NSMutableArray * jobs = [NSMutableArray array];
+    NSEnumerator * pathEnumerator = [deckPaths objectEnumerator];
+    NSString * deckPath;
+    while ((deckPath = [pathEnumerator nextObject]))
+    {
+        if ([self isDeckCurrentAtPath:deckPath])
+            continue;
+        NSDictionary * attributes = [[NSFileManager defaultManager] fileAttributesAtPath:deckPath traverseLink:YES];
+        if (attributes)
+            [jobs addObject:[NSDictionary dictionaryWithObjectsAndKeys:deckPath, @"deckPath", [attributes fileModificationDate], @"modificationDate", nil]];
+    }
+
+    if ([jobs count] == 0)
+        return;
+    _pendingCount += [jobs count];
+    [NSThread detachNewThreadSelector:@selector(_indexFilesInBackground:) toTarget:self withObject:jobs];
+}
+
+//! Forgets the deck at @a deckPath and deletes its segment.
+- (void) removeDeckAtPath:(NSString *)deckPath
+{
+    NSString * segmentName = [[_catalog objectForKey:deckPath] objectForKey:@"segment"];
+    if (segmentName == nil)
+        return;
+
+    [[NSFileManager defaultManager] removeFileAtPath:[_directoryPath stringByAppendingPathComponent:segmentName] handler:nil];
+    [_segments removeObjectForKey:deckPath];
+    [_catalog removeObjectForKey:deckPath];
+    [self _writeCatalog];
+    [[NSNotificationCenter defaultCenter] postNotificationName:GeniusDeckSearchIndexDidChangeNotification object:self];
+}
+
+//! Forgets decks that were deleted or moved since they were indexed.
+- (void) removeMissingDecks
+{
+    NSEnumerator * pathEnumerator = [[_catalog allKeys] objectEnumerator];
+    NSString * deckPath;
+    while ((deckPath = [pathEnumerator nextObject]))
+        if ([[NSFileManager defaultManager] fileExistsAtPath:deckPath] == NO)
+            [self removeDeckAtPath:deckPath];
+}
+
+//! Up to @a limit pairs of all indexed decks using every word of @a query, most recently saved decks first.
+/*! The last word also matches longer words unless @a query ends with a space. */
+- (NSArray *) resultsForQuery:(NSString *)query limit:(unsigned int)limit
+{
+    NSMutableArray * results = [NSMutableArray array];
+    NSString * key = GeniusAnswerKeyString(query);
+    if ([key length] == 0 || limit == 0)
+        return results;
+
+    NSArray * words = [key componentsSeparatedByString:@" "];
+    unichar lastCharacter = [query characterAtIndex:[query length] - 1];
+    BOOL lastIsPrefix = ([[NSCharacterSet whitespaceAndNewlineCharacterSet] characterIsMember:lastCharacter] == NO);
+
+    NSMutableArray * deckPaths = [NSMutableArray arrayWithArray:[_catalog allKeys]];
+    NSMutableArray * dates = [NSMutableArray array];
+    NSEnumerator * pathEnumerator = [deckPaths objectEnumerator];
+    NSString * deckPath;
+    while ((deckPath = [pathEnumerator nextObject]))
+        [dates addObject:[[_catalog objectForKey:deckPath] objectForKey:@"modificationDate"]];
+    NSDictionary * datesByPath = [NSDictionary dictionaryWithObjects:dates forKeys:deckPaths];
+    NSArray * sortedPaths = [datesByPath keysSortedByValueUsingSelector:@selector(compare:)];
+
+    pathEnumerator = [sortedPaths reverseObjectEnumerator];
+    while ((deckPath = [pathEnumerator nextObject]) && [results count] < limit)
+    {
+        GeniusDeckSummary * segment = [self summaryForDeckAtPath:deckPath];
+        if (segment == nil)
+            continue;
+
+        NSData * postings = nil;
+        unsigned int w;
+        for (w=0; w<[words count] && (postings == nil || [postings length]); w++)
+        {
+            BOOL isPrefix = (lastIsPrefix && w == [words count] - 1);
+            NSData * wordPostings = [segment postingsForWord:[words objectAtIndex:w] isPrefix:isPrefix];
+            postings = (postings ? IntersectPostings(postings, wordPostings) : wordPostings);
+        }
+
+        const unsigned int * pairIndexes = [postings bytes];
+        unsigned int i, count = [postings length] / sizeof(unsigned int);
+        for (i=0; i<count && [results count] < limit; i++)
+        {
+            unsigned int index = pairIndexes[i];
+            GeniusDeckSearchResult * result = [[GeniusDeckSearchResult alloc] initWithDeckPath:deckPath pairID:[segment pairIDAtIndex:index]
+                question:Snippet([segment questionAtIndex:index]) answer:Snippet([segment answerAtIndex:index])];
+            [results addObject:result];
+            [result release];
+        }
+    }
+    return results;
+}
+
+@end
+
+
+@implementation GeniusDeckSearchIndex (Private)
+
+//! Writes @a segmentData to a new file in the index folder.  Returns its name, or nil on failure.
+- (NSString *) _writeSegmentData:(NSData *)segmentData
+{
+    NSString * segmentName = [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"segment"];
+    if ([segmentData writeToFile:[_directoryPath stringByAppendingPathComponent:segmentName] atomically:YES] == NO)
+    {
+        NSLog(@"Could not write search index segment %@", segmentName);
+        return nil;
+    }
+    return segmentName;
+}
+
+//! Makes the written segment @a segmentName the one of @a deckPath, deleting the one it replaces.
+/*! A segment older than the one in the catalog is deleted instead and NO returned. */
+- (BOOL) _installSegmentFile:(NSString *)segmentName forDeckAtPath:(NSString *)deckPath modificationDate:(NSDate *)modificationDate
+{
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    NSDictionary * entry = [_catalog objectForKey:deckPath];
+    if (entry && [[entry objectForKey:@"modificationDate"] compare:modificationDate] == NSOrderedDescending)
+    {
+        [fileManager removeFileAtPath:[_directoryPath stringByAppendingPathComponent:segmentName] handler:nil];
+        return NO;
+    }
+
+    NSString * oldName = [entry objectForKey:@"segment"];
+    if (oldName)
+        [fileManager removeFileAtPath:[_directoryPath stringByAppendingPathComponent:oldName] handler:nil];
+    [_segments removeObjectForKey:deckPath];
+    [_catalog setObject:[NSDictionary dictionaryWithObjectsAndKeys:segmentName, @"segment", modificationDate, @"modificationDate", nil] forKey:deckPath];
+    [self _writeCatalog];
+    [[NSNotificationCenter defaultCenter] postNotificationName:GeniusDeckSearchIndexDidChangeNotification object:self];
+    return YES;
+}
+
+//! Saves _catalog.
+- (void) _writeCatalog
+{
+    NSString * catalogPath = [_directoryPath stringByAppendingPathComponent:kGeniusCatalogFileName];
+    if ([_catalog writeToFile:catalogPath atomically:YES] == NO)
+        NSLog(@"Could not write search index catalog %@", catalogPath);
+}
+
+//! Background thread body of #indexSnapshot:scheduler:forDeckAtPath:.
+- (void) _indexSnapshotInBackground:(NSDictionary *)job
+{
+    NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+    NSMutableDictionary * result = [NSMutableDictionary dictionaryWithDictionary:job];
+    [result removeObjectForKey:@"snapshot"];
+    [result removeObjectForKey:@"scheduler"];
+
+    NSData * segmentData = [[self class] segmentDataWithSnapshot:[job objectForKey:@"snapshot"] scheduler:[job objectForKey:@"scheduler"]];
+    NSString * segmentName = [self _writeSegmentData:segmentData];
+    if (segmentName)
+        [result setObject:segmentName forKey:@"segment"];
+    [self performSelectorOnMainThread:@selector(_backgroundIndexDidEnd:) withObject:result waitUntilDone:NO];
+    [pool release];
+}
+
+//! Background thread body of #indexDecksAtPaths:.  Reads each deck of @a jobs without opening a document.
+/*! Each job holds the path of a deck and the modification date read on the main thread. */
+- (void) _indexFilesInBackground:(NSArray *)jobs
+{
+    NSEnumerator * jobEnumerator = [jobs objectEnumerator];
+    NSDictionary * job;
+    while ((job = [jobEnumerator nextObject]))
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        NSString * deckPath = [job objectForKey:@"deckPath"];
+        NSMutableDictionary * result = [NSMutableDictionary dictionaryWithObject:deckPath forKey:@"deckPath"];
+        id <GeniusScheduler> scheduler = nil;
+        NSArray * pairs = [GeniusDocument pairsWithContentsOfFile:deckPath scheduler:&scheduler];
+        if (pairs)
+        {
+            GeniusDeckStore * store = [[GeniusDeckStore alloc] initWithPairs:pairs];
+            NSData * segmentData = [[self class] segmentDataWithSnapshot:[store snapshot] scheduler:scheduler];
+            [store release];
+
+            NSString * segmentName = [self _writeSegmentData:segmentData];
+            if (segmentName)
+                [result setObject:segmentName forKey:@"segment"];
+            [result setObject:[job objectForKey:@"modificationDate"] forKey:@"modificationDate"];
+        }
+        [self performSelectorOnMainThread:@selector(_backgroundIndexDidEnd:) withObject:result waitUntilDone:NO];
+        [pool release];
+    }
+}
+
+//! Installs a segment built on a background thread, on the main thread.
+- (void) _backgroundIndexDidEnd:(NSDictionary *)job
+{
+    _pendingCount--;
+    NSString * segmentName = [job objectForKey:@"segment"];
+    if (segmentName)
+        [self _installSegmentFile:segmentName forDeckAtPath:[job objectForKey:@"deckPath"] modificationDate:[job objectForKey:@"modificationDate"]];
+}
+
+@end
@@ -0,0 +1,154 @@
+//
+//  GeniusDeckSearchIndexTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusDeckSearchIndex.h"
+#import "GeniusDeckSnapshot.h"
+#import "GeniusItem.h"
+
+@interface GeniusDeckSearchIndexTest : SenTestCase {
+    NSString *directoryPath;        //!< Temporary folder holding the index.
+    GeniusDeckSearchIndex *index;   //!< The object under test.
+}
+
+@end
+
+//! Tests for GeniusDeckSearchIndex segments, queries and persistence.
+@implementation GeniusDeckSearchIndexTest
+
+//! Opens an empty index in a temporary folder for each test.
+- (void) setUp
+{
+    NSString * name = [[NSProcessInfo processInfo] globallyUniqueString];
+    directoryPath = [[NSTemporaryDirectory() stringByAppendingPathComponent:name] retain];
+    index = [[GeniusDeckSearchIndex alloc] initWithDirectoryPath:directoryPath];
+}
+
+//! Deletes the index folder.
+- (void) tearDown
+{
+    [index release];
+    index = nil;
+    [[NSFileManager defaultManager] removeFileAtPath:directoryPath handler:nil];
+    [directoryPath release];
+    directoryPath = nil;
+}
+
+//! Returns a segment of pairs whose questions and answers are the alternating strings of @a texts.
+- (NSData *) _segmentWithTexts:(NSArray *)texts
+{
+    NSMutableArray * pairs = [NSMutableArray array];
+    unsigned int i;
+    for (i=0; i+1<[texts count]; i+=2)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setValue:[texts objectAtIndex:i] forKey:@"stringValue"];
+        [[pair itemB] setValue:[texts objectAtIndex:i+1] forKey:@"stringValue"];
+        [pairs addObject:pair];
+        [pair release];
+    }
+    GeniusDeckStore * store = [[[GeniusDeckStore alloc] initWithPairs:pairs] autorelease];
+    return [GeniusDeckSearchIndex segmentDataWithSnapshot:[store snapshot] scheduler:nil];
+}
+
+//! Returns the questions of the results for @a query.
+- (NSArray *) _questionsForQuery:(NSString *)query
+{
+    return [[index resultsForQuery:query limit:100] valueForKey:@"question"];
+}
+
+//! Every query word must match, and the last one also matches as a prefix.
+- (void) testQueryWords
+{
+    NSArray * texts = [NSArray arrayWithObjects:@"Red apple", @"rouge", @"Green apple", @"vert", @"Red car", @"voiture", nil];
+    STAssertTrue([index setSegmentData:[self _segmentWithTexts:texts] forDeckAtPath:@"/Decks/Colors.genius" modificationDate:[NSDate date]], nil);
+
+    STAssertEqualObjects([self _questionsForQuery:@"apple"], ([NSArray arrayWithObjects:@"Red apple", @"Green apple", nil]), nil);
+    STAssertEqualObjects([self _questionsForQuery:@"RED APP"], [NSArray arrayWithObject:@"Red apple"], nil);
+    STAssertEqualObjects([self _questionsForQuery:@"voit"], [NSArray arrayWithObject:@"Red car"], nil);
+    STAssertEquals([[self _questionsForQuery:@"voit "] count], 0U, nil);
+    STAssertEquals([[self _questionsForQuery:@"blue"] count], 0U, nil);
+
+    GeniusDeckSearchResult * result = [[index resultsForQuery:@"car" limit:10] lastObject];
+    STAssertEqualObjects([result deckName], @"Colors", nil);
+    STAssertEqualObjects([result answer], @"voiture", nil);
+}
+
+//! Results come from every deck, and a reopened index finds the same results.
+- (void) testPersistence
+{
+    NSDate * older = [NSDate dateWithTimeIntervalSinceReferenceDate:1000.0];
+    NSDate * newer = [NSDate dateWithTimeIntervalSinceReferenceDate:2000.0];
+    [index setSegmentData:[self _segmentWithTexts:[NSArray arrayWithObjects:@"one cat", @"un chat", nil]] forDeckAtPath:@"/Decks/A.genius" modificationDate:older];
+    [index setSegmentData:[self _segmentWithTexts:[NSArray arrayWithObjects:@"two cats", @"deux chats", nil]] forDeckAtPath:@"/Decks/B.genius" modificationDate:newer];
+
+    NSArray * expected = [NSArray arrayWithObjects:@"two cats", @"one cat", nil];
+    STAssertEqualObjects([self _questionsForQuery:@"cat"], expected, nil);
+
+    [index release];
+    index = [[GeniusDeckSearchIndex alloc] initWithDirectoryPath:directoryPath];
+    STAssertEquals([[index deckPaths] count], 2U, nil);
+    STAssertEqualObjects([self _questionsForQuery:@"cat"], expected, nil);
+}
+
+//! A newer segment replaces the old one, an older one is refused, and removed decks are no longer searched.
+- (void) testReplaceAndRemove
+{
+    NSDate * date = [NSDate dateWithTimeIntervalSinceReferenceDate:1000.0];
+    [index setSegmentData:[self _segmentWithTexts:[NSArray arrayWithObjects:@"old", @"alt", nil]] forDeckAtPath:@"/Decks/A.genius" modificationDate:date];
+    STAssertTrue([index setSegmentData:[self _segmentWithTexts:[NSArray arrayWithObjects:@"new", @"neu", nil]] forDeckAtPath:@"/Decks/A.genius" modificationDate:[date addTimeInterval:10.0]], nil);
+    STAssertFalse([index setSegmentData:[self _segmentWithTexts:[NSArray arrayWithObjects:@"stale", @"alt", nil]] forDeckAtPath:@"/Decks/A.genius" modificationDate:date], nil);
+
+    STAssertEquals([[self _questionsForQuery:@"old"] count], 0U, nil);
+    STAssertEquals([[self _questionsForQuery:@"stale"] count], 0U, nil);
+    STAssertEqualObjects([self _questionsForQuery:@"new"], [NSArray arrayWithObject:@"new"], nil);
+
+    NSArray * files = [[NSFileManager defaultManager] directoryContentsAtPath:directoryPath];
+    STAssertEquals([files count], 2U, @"catalog and one segment: %@", files);
+
+    [index removeDeckAtPath:@"/Decks/A.genius"];
+    STAssertEquals([[index deckPaths] count], 0U, nil);
+    STAssertEquals([[self _questionsForQuery:@"new"] count], 0U, nil);
+}
+
+//! The summary of a deck keeps the whole text, the performance of both directions and the scheduler.
+- (void) testSummary
+{
+    GeniusItem * itemA = [[[GeniusItem alloc] init] autorelease];
+    [itemA setStringValue:[@"" stringByPaddingToLength:200 withString:@"long " startingAtIndex:0]];
+    GeniusItem * itemB = [[[GeniusItem alloc] init] autorelease];
+    [itemB setStringValue:@"answer"];
+    GeniusPair * pair = [[[GeniusPair alloc] initWithItemA:itemA itemB:itemB userDict:[NSMutableDictionary dictionary]] autorelease];
+    [pair setImportance:kGeniusPairDisabledImportance];
+    [[pair associationAB] setScore:2];
+    [[pair associationAB] setDueTime:1200000000LL];
+
+    NSDictionary * parameters = [NSDictionary dictionaryWithObject:[NSNumber numberWithDouble:2.0] forKey:@"easeFactor"];
+    id <GeniusScheduler> scheduler = [GeniusScoreScheduler schedulerWithIdentifier:@"sm2" parameters:parameters];
+    GeniusDeckStore * store = [[[GeniusDeckStore alloc] initWithPairs:[NSArray arrayWithObject:pair]] autorelease];
+    NSData * segmentData = [GeniusDeckSearchIndex segmentDataWithSnapshot:[store snapshot] scheduler:scheduler];
+    [index setSegmentData:segmentData forDeckAtPath:@"/Decks/A.genius" modificationDate:[NSDate date]];
+
+    GeniusDeckSummary * summary = [index summaryForDeckAtPath:@"/Decks/A.genius"];
+    STAssertEquals([summary count], 1U, nil);
+    STAssertEquals([summary pairIDAtIndex:0], [pair pairID], nil);
+    STAssertEqualObjects([summary questionAtIndex:0], [itemA stringValue], nil);
+    STAssertEqualObjects([summary answerAtIndex:0], @"answer", nil);
+    STAssertEquals([summary importanceAtIndex:0], kGeniusPairDisabledImportance, nil);
+    STAssertEquals([summary scoreAtIndex:0 direction:0], 2, nil);
+    STAssertEquals([summary scoreAtIndex:0 direction:1], -1, nil);
+    STAssertEquals([summary dueTimeAtIndex:0 direction:0], 1200000000LL, nil);
+    STAssertEquals([summary dueTimeAtIndex:0 direction:1], kGeniusTimeNone, nil);
+    STAssertEqualObjects([[summary scheduler] identifier], @"sm2", nil);
+    STAssertEqualObjects([[summary scheduler] parameters], parameters, nil);
+
+    GeniusDeckSearchResult * result = [[index resultsForQuery:@"long" limit:1] lastObject];
+    STAssertEquals([[result question] length], (unsigned int)kGeniusDeckSearchSnippetLength, @"results show the start only");
+}
+
+@end
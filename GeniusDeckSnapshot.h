@@ -0,0 +1,91 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusPair.h"
+#import "GeniusAssociation.h"
+
+//! Number of record pointers per table chunk, as a power of two.
+#define kGeniusSnapshotChunkShift 6
+
+//! Immutable copy of the values of one GeniusPair.
+/*!
+    Records are reference counted and never change once created; an edit to the pair creates a new
+    record.  Index 0 of #items is GeniusPair#itemA, index 1 GeniusPair#itemB.  Index 0 of #scores and
+    #dueTimes is GeniusPair#associationAB, index 1 GeniusPair#associationBA.
+ */
+typedef struct _GeniusPairRecord {
+    int32_t refCount;               //!< Private.  Number of chunks and stores referring to the record.
+    GeniusPairID pairID;            //!< GeniusPair#pairID.
+    NSString * itemA;               //!< Text of GeniusPair#itemA, or nil.
+    NSString * itemB;               //!< Text of GeniusPair#itemB, or nil.
+    GeniusItem * items[2];          //!< Unobserved copies of the items, sharing their storage.  Carry the media URLs.
+    NSString * customGroup;         //!< GeniusPair#customGroupString.
+    NSString * customType;          //!< GeniusPair#customTypeString.
+    NSString * notes;               //!< GeniusPair#notesString.
+    int importance;                 //!< GeniusPair#importance.
+    int scores[2];                  //!< GeniusAssociation#score, -1 if never quizzed.
+    GeniusTime dueTimes[2];         //!< GeniusAssociation#dueTime.
+} GeniusPairRecord;
+
+typedef struct _GeniusSnapshotTable GeniusSnapshotTable;
+
+//! Immutable view of the pairs of a GeniusDocument at one moment.
+/*!
+    Safe to read from any thread while the document keeps changing.  Snapshots share their record
+    table with the GeniusDeckStore that made them; the store copies a 64 entry chunk of the table only
+    when it changes a chunk a snapshot still uses.
+ */
+@interface GeniusDeckSnapshot : NSObject {
+    GeniusSnapshotTable * _table;   //!< Shared, reference counted record table.
+}
+
+- (unsigned int) count;
+- (const GeniusPairRecord *) recordAtIndex:(unsigned int)index;
+- (GeniusPair *) newPairAtIndex:(unsigned int)index;
+
+@end
+
+
+//! Keeps a persistent record table in step with a live array of GeniusPair items and hands out snapshots.
+/*!
+    Used on the main thread only.  Edits are only noted as they happen, see #pairDidChange: and
+    #pairsDidChange; the table is brought up to date when the next #snapshot is taken, in time
+    proportional to the number of pairs edited since the last one.  Reordering, inserting or removing
+    pairs rebuilds the table from the pairs array, reusing the records of unchanged pairs.
+ */
+@interface GeniusDeckStore : NSObject {
+    NSArray * _pairs;                       //!< The live pairs, in document order.
+    GeniusSnapshotTable * _table;           //!< Records of _pairs as of the last snapshot.
+    CFMutableDictionaryRef _indexes;        //!< GeniusPair -> index + 1 in _table.  Not retained.
+    CFMutableDictionaryRef _owners;         //!< GeniusItem -> owning GeniusPair.  Not retained.
+    CFMutableSetRef _dirtyPairs;            //!< Pairs edited since the last snapshot.  Not retained.
+    BOOL _needsRebuild;                     //!< Set when pairs were inserted, removed or moved.
+}
+
+- (id) initWithPairs:(NSArray *)pairs;
+
+- (void) setPairs:(NSArray *)pairs;
+- (void) pairsDidChange;
+- (void) pairDidChange:(GeniusPair *)pair;
+- (void) objectDidChange:(id)object;
+
+- (GeniusDeckSnapshot *) snapshot;
+
+@end
@@ -0,0 +1,404 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusDeckSnapshot.h"
+#import "GeniusItem.h"
+#include <libkern/OSAtomic.h>
+
+//! Number of record pointers per chunk.
+#define kGeniusSnapshotChunkSize (1 << kGeniusSnapshotChunkShift)
+
+//! Mask giving the position of a record within its chunk.
+#define kGeniusSnapshotChunkMask (kGeniusSnapshotChunkSize - 1)
+
+//! Fixed size block of record pointers, shared between tables until one of them changes it.
+typedef struct _GeniusSnapshotChunk {
+    int32_t refCount;                                       //!< Number of tables using the chunk.
+    GeniusPairRecord * records[kGeniusSnapshotChunkSize];   //!< One reference each, NULL past the end of the table.
+} GeniusSnapshotChunk;
+
+//! Persistent array of GeniusPairRecord pointers split into chunks.
+struct _GeniusSnapshotTable {
+    int32_t refCount;                   //!< Number of snapshots and stores using the table.
+    unsigned int count;                 //!< Number of records.
+    unsigned int chunkCount;            //!< Number of entries in chunks.
+    GeniusSnapshotChunk ** chunks;      //!< One reference each.
+};
+
+
+//! Creates a record holding the current values of @a pair, with a reference count of one.
+static GeniusPairRecord * RecordCreate(GeniusPair * pair)
+{
+    GeniusPairRecord * record = (GeniusPairRecord *)calloc(1, sizeof(GeniusPairRecord));
+    record->refCount = 1;
+    record->pairID = [pair pairID];
+    record->itemA = [[[pair itemA] stringValue] copy];
+    record->itemB = [[[pair itemB] stringValue] copy];
+    record->items[0] = [[pair itemA] copy];
+    record->items[1] = [[pair itemB] copy];
+    record->customGroup = [[pair customGroupString] copy];
+    record->customType = [[pair customTypeString] copy];
+    record->notes = [[pair notesString] copy];
+    record->importance = [pair importance];
+    record->scores[0] = [[pair associationAB] score];
+    record->scores[1] = [[pair associationBA] score];
+    record->dueTimes[0] = [[pair associationAB] dueTime];
+    record->dueTimes[1] = [[pair associationBA] dueTime];
+    return record;
+}
+
+//! Adds a reference to @a record.
+static GeniusPairRecord * RecordRetain(GeniusPairRecord * record)
+{
+    OSAtomicIncrement32Barrier(&record->refCount);
+    return record;
+}
+
+//! Drops a reference to @a record, freeing it with the last one.  @a record may be NULL.
+static void RecordRelease(GeniusPairRecord * record)
+{
+    if (record == NULL || OSAtomicDecrement32Barrier(&record->refCount) > 0)
+        return;
+    [record->itemA release];
+    [record->itemB release];
+    [record->items[0] release];
+    [record->items[1] release];
+    [record->customGroup release];
+    [record->customType release];
+    [record->notes release];
+    free(record);
+}
+
+//! Drops a reference to @a chunk, releasing its records with the last one.
+static void ChunkRelease(GeniusSnapshotChunk * chunk)
+{
+    if (OSAtomicDecrement32Barrier(&chunk->refCount) > 0)
+        return;
+    int i;
+    for (i=0; i<kGeniusSnapshotChunkSize; i++)
+        RecordRelease(chunk->records[i]);
+    free(chunk);
+}
+
+//! Creates a table of @a count empty record slots with a reference count of one.
+static GeniusSnapshotTable * TableCreate(unsigned int count)
+{
+    GeniusSnapshotTable * table = (GeniusSnapshotTable *)calloc(1, sizeof(GeniusSnapshotTable));
+    table->refCount = 1;
+    table->count = count;
+    table->chunkCount = (count + kGeniusSnapshotChunkMask) >> kGeniusSnapshotChunkShift;
+    table->chunks = (GeniusSnapshotChunk **)calloc(MAX(table->chunkCount, 1U), sizeof(GeniusSnapshotChunk *));
+    unsigned int i;
+    for (i=0; i<table->chunkCount; i++)
+    {
+        table->chunks[i] = (GeniusSnapshotChunk *)calloc(1, sizeof(GeniusSnapshotChunk));
+        table->chunks[i]->refCount = 1;
+    }
+    return table;
+}
+
+//! Adds a reference to @a table.
+static GeniusSnapshotTable * TableRetain(GeniusSnapshotTable * table)
+{
+    OSAtomicIncrement32Barrier(&table->refCount);
+    return table;
+}
+
+//! Drops a reference to @a table, releasing its chunks with the last one.
+static void TableRelease(GeniusSnapshotTable * table)
+{
+    if (OSAtomicDecrement32Barrier(&table->refCount) > 0)
+        return;
+    unsigned int i;
+    for (i=0; i<table->chunkCount; i++)
+        ChunkRelease(table->chunks[i]);
+    free(table->chunks);
+    free(table);
+}
+
+//! Returns a table sharing every chunk of @a table.  Costs one pointer per 64 records.
+static GeniusSnapshotTable * TableCopy(GeniusSnapshotTable * table)
+{
+    GeniusSnapshotTable * copy = (GeniusSnapshotTable *)calloc(1, sizeof(GeniusSnapshotTable));
+    copy->refCount = 1;
+    copy->count = table->count;
+    copy->chunkCount = table->chunkCount;
+    copy->chunks = (GeniusSnapshotChunk **)malloc(MAX(copy->chunkCount, 1U) * sizeof(GeniusSnapshotChunk *));
+    unsigned int i;
+    for (i=0; i<copy->chunkCount; i++)
+    {
+        copy->chunks[i] = table->chunks[i];
+        OSAtomicIncrement32Barrier(&copy->chunks[i]->refCount);
+    }
+    return copy;
+}
+
+//! Returns the record at @a index of @a table.
+static GeniusPairRecord * TableRecord(GeniusSnapshotTable * table, unsigned int index)
+{
+    return table->chunks[index >> kGeniusSnapshotChunkShift]->records[index & kGeniusSnapshotChunkMask];
+}
+
+//! Replaces the record at @a index of @a table, which must not be shared, taking over the reference to @a record.
+/*! Copies the chunk first if another table still uses it. */
+static void TableSetRecord(GeniusSnapshotTable * table, unsigned int index, GeniusPairRecord * record)
+{
+    unsigned int chunkIndex = index >> kGeniusSnapshotChunkShift;
+    GeniusSnapshotChunk * chunk = table->chunks[chunkIndex];
+    if (chunk->refCount > 1)
+    {
+        GeniusSnapshotChunk * copy = (GeniusSnapshotChunk *)malloc(sizeof(GeniusSnapshotChunk));
+        copy->refCount = 1;
+        int i;
+        for (i=0; i<kGeniusSnapshotChunkSize; i++)
+            copy->records[i] = (chunk->records[i] ? RecordRetain(chunk->records[i]) : NULL);
+        ChunkRelease(chunk);
+        table->chunks[chunkIndex] = chunk = copy;
+    }
+    RecordRelease(chunk->records[index & kGeniusSnapshotChunkMask]);
+    chunk->records[index & kGeniusSnapshotChunkMask] = record;
+}
+
+
+@interface GeniusDeckSnapshot (Private)
+- (id) _initWithTable:(GeniusSnapshotTable *)table;
+@end
+
+@implementation GeniusDeckSnapshot
+
+//! Releases the shared table.  May happen on any thread.
+- (void) dealloc
+{
+    TableRelease(_table);
+    [super dealloc];
+}
+
+//! Number of pairs in the deck when the snapshot was taken.
+- (unsigned int) count
+{
+    return _table->count;
+}
+
+//! Values of the pair at @a index in document order.  Valid as long as the snapshot is.
+- (const GeniusPairRecord *) recordAtIndex:(unsigned int)index
+{
+    NSParameterAssert(index < _table->count);
+    return TableRecord(_table, index);
+}
+
+//! Creates an unobserved GeniusPair with the values of the record at @a index, for archiving off the main thread.
+/*!
+    The caller owns the returned pair.  Its items share storage with those of the record, so they keep
+    every atom of the original, media URLs included.  Due times are restored to whole seconds.
+ */
+- (GeniusPair *) newPairAtIndex:(unsigned int)index
+{
+    const GeniusPairRecord * record = [self recordAtIndex:index];
+    GeniusItem * itemA = [[record->items[0] copy] autorelease];
+    GeniusItem * itemB = [[record->items[1] copy] autorelease];
+
+    NSMutableDictionary * userDict = [NSMutableDictionary dictionary];
+    GeniusPair * pair = [[GeniusPair alloc] initWithItemA:itemA itemB:itemB userDict:userDict pairID:record->pairID];
+    [pair setCustomGroupString:record->customGroup];
+    [pair setCustomTypeString:record->customType];
+    [pair setNotesString:record->notes];
+    if (record->importance != kGeniusPairNormalImportance)
+        [pair setImportance:record->importance];
+
+    [[pair associationAB] setScore:record->scores[0]];
+    [[pair associationAB] setDueTime:record->dueTimes[0]];
+    [[pair associationBA] setScore:record->scores[1]];
+    [[pair associationBA] setDueTime:record->dueTimes[1]];
+    return pair;
+}
+
+@end
+
+
+@implementation GeniusDeckSnapshot (Private)
+
+//! Designated initializer.  Takes a reference to @a table.
+- (id) _initWithTable:(GeniusSnapshotTable *)table
+{
+    self = [super init];
+    if (self != nil) {
+        _table = TableRetain(table);
+    }
+    return self;
+}
+
+@end
+
+
+@interface GeniusDeckStore (Private)
+- (void) _rebuild;
+- (void) _updateDirtyPairs;
+@end
+
+@implementation GeniusDeckStore
+
+//! Designated initializer.  @a pairs is retained, not copied, and read again when pairs change.
+- (id) initWithPairs:(NSArray *)pairs
+{
+    self = [super init];
+    if (self != nil) {
+        _table = TableCreate(0);
+        _indexes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+        _owners = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+        _dirtyPairs = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+        [self setPairs:pairs];
+    }
+    return self;
+}
+
+//! Creates a store without pairs.
+- (id) init
+{
+    return [self initWithPairs:nil];
+}
+
+//! Releases the table and frees memory.  Outstanding snapshots keep their records.
+- (void) dealloc
+{
+    [_pairs release];
+    TableRelease(_table);
+    CFRelease(_indexes);
+    CFRelease(_owners);
+    CFRelease(_dirtyPairs);
+    [super dealloc];
+}
+
+//! Switches to a different pairs array.  No records are reused from the previous one.
+- (void) setPairs:(NSArray *)pairs
+{
+    [pairs retain];
+    [_pairs release];
+    _pairs = pairs;
+
+    TableRelease(_table);
+    _table = TableCreate(0);
+    CFDictionaryRemoveAllValues(_indexes);
+    CFDictionaryRemoveAllValues(_owners);
+    CFSetRemoveAllValues(_dirtyPairs);
+    _needsRebuild = YES;
+}
+
+//! Notes that pairs were inserted, removed or moved.
+/*! Inserted pairs must also be passed to #pairDidChange:, since they may reuse the address of a removed pair. */
+- (void) pairsDidChange
+{
+    _needsRebuild = YES;
+}
+
+//! Notes that the values of @a pair changed.
+- (void) pairDidChange:(GeniusPair *)pair
+{
+    CFSetAddValue(_dirtyPairs, pair);
+}
+
+//! Notes a change reported by key value observing of a pair, one of its associations or one of its items.
+- (void) objectDidChange:(id)object
+{
+    if ([object isKindOfClass:[GeniusPair class]])
+        [self pairDidChange:object];
+    else if ([object isKindOfClass:[GeniusAssociation class]])
+        [self pairDidChange:[object parentPair]];
+    else
+    {
+        GeniusPair * pair = (GeniusPair *)CFDictionaryGetValue(_owners, object);
+        if (pair)
+            [self pairDidChange:pair];
+    }
+}
+
+//! Returns a snapshot of the pairs as they are now.
+/*!
+    Only records of pairs edited since the last snapshot are recreated, and only the chunks holding
+    them are copied, so taking a snapshot costs time proportional to the edits in between.
+ */
+- (GeniusDeckSnapshot *) snapshot
+{
+    if (_needsRebuild)
+        [self _rebuild];
+    else if (CFSetGetCount(_dirtyPairs))
+        [self _updateDirtyPairs];
+
+    return [[[GeniusDeckSnapshot alloc] _initWithTable:_table] autorelease];
+}
+
+@end
+
+
+@implementation GeniusDeckStore (Private)
+
+//! Lays out a new table in the order of #_pairs, reusing the records of pairs that weren't edited.
+- (void) _rebuild
+{
+    unsigned int i, count = [_pairs count];
+    GeniusSnapshotTable * table = TableCreate(count);
+    CFMutableDictionaryRef indexes = CFDictionaryCreateMutable(kCFAllocatorDefault, count, NULL, NULL);
+    CFDictionaryRemoveAllValues(_owners);
+
+    for (i=0; i<count; i++)
+    {
+        GeniusPair * pair = [_pairs objectAtIndex:i];
+        unsigned int oldIndex = (unsigned int)(uintptr_t)CFDictionaryGetValue(_indexes, pair);
+        GeniusPairRecord * record;
+        if (oldIndex && CFSetContainsValue(_dirtyPairs, pair) == NO)
+            record = RecordRetain(TableRecord(_table, oldIndex - 1));
+        else
+            record = RecordCreate(pair);
+
+        table->chunks[i >> kGeniusSnapshotChunkShift]->records[i & kGeniusSnapshotChunkMask] = record;
+        CFDictionarySetValue(indexes, pair, (const void *)(uintptr_t)(i + 1));
+        CFDictionarySetValue(_owners, [pair itemA], pair);
+        CFDictionarySetValue(_owners, [pair itemB], pair);
+    }
+
+    TableRelease(_table);
+    _table = table;
+    CFRelease(_indexes);
+    _indexes = indexes;
+    CFSetRemoveAllValues(_dirtyPairs);
+    _needsRebuild = NO;
+}
+
+//! Replaces the records of the edited pairs, copying the table and chunks still used by snapshots.
+- (void) _updateDirtyPairs
+{
+    if (_table->refCount > 1)
+    {
+        GeniusSnapshotTable * table = TableCopy(_table);
+        TableRelease(_table);
+        _table = table;
+    }
+
+    CFIndex i, count = CFSetGetCount(_dirtyPairs);
+    const void ** pairs = (const void **)malloc(count * sizeof(void *));
+    CFSetGetValues(_dirtyPairs, pairs);
+    for (i=0; i<count; i++)
+    {
+        unsigned int index = (unsigned int)(uintptr_t)CFDictionaryGetValue(_indexes, pairs[i]);
+        if (index)
+            TableSetRecord(_table, index - 1, RecordCreate((GeniusPair *)pairs[i]));
+    }
+    free(pairs);
+    CFSetRemoveAllValues(_dirtyPairs);
+}
+
+@end
@@ -0,0 +1,128 @@
+//
+//  GeniusDeckSnapshotTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusDeckSnapshot.h"
+#import "GeniusItem.h"
+
+@interface GeniusDeckSnapshotTest : SenTestCase {
+    NSMutableArray *pairs;      //!< Live pairs behind the store.
+    GeniusDeckStore *store;     //!< The object under test.
+}
+
+@end
+
+//! Tests for GeniusDeckStore and GeniusDeckSnapshot.
+@implementation GeniusDeckSnapshotTest
+
+//! Creates a store over 200 numbered pairs for each test.
+- (void) setUp
+{
+    pairs = [[NSMutableArray alloc] init];
+    int i;
+    for (i=0; i<200; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setValue:[NSString stringWithFormat:@"%d", i] forKey:@"stringValue"];
+        [pairs addObject:pair];
+        [pair release];
+    }
+    store = [[GeniusDeckStore alloc] initWithPairs:pairs];
+}
+
+//! Releases the store and pairs.
+- (void) tearDown
+{
+    [store release];
+    store = nil;
+    [pairs release];
+    pairs = nil;
+}
+
+//! Records match the pairs in document order.
+- (void) testSnapshotContents
+{
+    [[[pairs objectAtIndex:5] associationBA] setScore:3];
+    [[pairs objectAtIndex:5] setCustomGroupString:@"five"];
+
+    GeniusDeckSnapshot * snapshot = [store snapshot];
+    STAssertEquals([snapshot count], 200U, nil);
+    unsigned int i;
+    for (i=0; i<200; i++)
+    {
+        const GeniusPairRecord * record = [snapshot recordAtIndex:i];
+        STAssertEquals(record->pairID, [[pairs objectAtIndex:i] pairID], nil);
+        STAssertEqualObjects(record->itemA, [NSString stringWithFormat:@"%u", i], nil);
+    }
+    const GeniusPairRecord * record = [snapshot recordAtIndex:5];
+    STAssertEquals(record->scores[0], -1, nil);
+    STAssertEquals(record->scores[1], 3, nil);
+    STAssertEqualObjects(record->customGroup, @"five", nil);
+}
+
+//! Edits after a snapshot show up in the next snapshot only, and untouched records are shared.
+- (void) testSnapshotIsolation
+{
+    GeniusDeckSnapshot * before = [store snapshot];
+
+    GeniusPair * pair = [pairs objectAtIndex:70];
+    [[pair itemB] setValue:@"changed" forKey:@"stringValue"];
+    [store objectDidChange:[pair itemB]];
+    [[pair associationAB] setScore:4];
+    [store objectDidChange:[pair associationAB]];
+
+    GeniusDeckSnapshot * after = [store snapshot];
+    STAssertNil([before recordAtIndex:70]->itemB, nil);
+    STAssertEquals([before recordAtIndex:70]->scores[0], -1, nil);
+    STAssertEqualObjects([after recordAtIndex:70]->itemB, @"changed", nil);
+    STAssertEquals([after recordAtIndex:70]->scores[0], 4, nil);
+
+    STAssertTrue([before recordAtIndex:69] == [after recordAtIndex:69], @"unchanged records are shared");
+    STAssertTrue([before recordAtIndex:199] == [after recordAtIndex:199], nil);
+    STAssertTrue([after recordAtIndex:70] == [[store snapshot] recordAtIndex:70], @"no edits, no new records");
+}
+
+//! Inserted, removed and moved pairs are reflected; older snapshots keep the old order.
+- (void) testStructuralChanges
+{
+    GeniusDeckSnapshot * before = [store snapshot];
+
+    GeniusPair * inserted = [[[GeniusPair alloc] init] autorelease];
+    [[inserted itemA] setValue:@"new" forKey:@"stringValue"];
+    [pairs insertObject:inserted atIndex:10];
+    [store pairsDidChange];
+    [store pairDidChange:inserted];
+
+    [pairs removeObjectAtIndex:0];
+    [pairs exchangeObjectAtIndex:50 withObjectAtIndex:150];
+    [store pairsDidChange];
+
+    GeniusDeckSnapshot * after = [store snapshot];
+    STAssertEquals([after count], 200U, nil);
+    unsigned int i;
+    for (i=0; i<200; i++)
+        STAssertEquals([after recordAtIndex:i]->pairID, [[pairs objectAtIndex:i] pairID], @"index %u", i);
+    STAssertEqualObjects([after recordAtIndex:9]->itemA, @"new", nil);
+    STAssertEqualObjects([before recordAtIndex:0]->itemA, @"0", nil);
+    STAssertTrue([before recordAtIndex:1] == [after recordAtIndex:0], @"records survive a rebuild");
+}
+
+//! A snapshot stays readable after the store and pairs are gone.
+- (void) testSnapshotOutlivesStore
+{
+    GeniusDeckSnapshot * snapshot = [[store snapshot] retain];
+    [store release];
+    store = nil;
+    [pairs removeAllObjects];
+
+    STAssertEquals([snapshot count], 200U, nil);
+    STAssertEqualObjects([snapshot recordAtIndex:123]->itemA, @"123", nil);
+    [snapshot release];
+}
+
+@end
@@ -0,0 +1,72 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusRandom.h"
+
+@class GeniusPair;
+@class GeniusAssociation;
+
+//! Number of MinHash values in the signature of an answer.
+#define kGeniusMinHashCount 32
+
+//! Number of LSH bands the signature is cut into.  Answers sharing all values of one band are candidates.
+/*!
+    With 8 bands of 4 values, answers whose trigram sets have Jaccard similarity 0.5 meet in some band about
+    40% of the time, at 0.7 about 90% of the time, and at 0.2 under 2% of the time.
+ */
+#define kGeniusLSHBandCount 8
+
+//! Finds plausible wrong answers for multiple choice quizzes:  answers of the same deck that look alike.
+/*!
+    Every GeniusAssociation with answer text is indexed by a MinHash signature of the character trigrams of
+    its GeniusAnswerKey.  Associations are partitioned by direction, GeniusPair#customTypeString and
+    GeniusPair#customGroupString; within a partition, each band of the signature hashes to a bucket of the
+    associations sharing it.  So the candidates for a card are the members of its own #kGeniusLSHBandCount
+    buckets, ranked by how many signature values they share, and finding them costs a few dictionary
+    lookups however large the deck is.
+
+    When a partition doesn't yield enough distractors, the buckets of other partitions of the same type and
+    direction are tried, then random answers of the same partition, type and finally direction.  Answers
+    equal to the right one, or to each other, after normalization are never offered.
+
+    Like GeniusFuzzyIndex, the index is kept up to date with #addPair:, #removePair: and #invalidateObject:.
+ */
+@interface GeniusDistractorIndex : NSObject {
+    CFMutableDictionaryRef _entries;        //!< GeniusAssociation -> its entry.  Retains the associations.
+    CFMutableDictionaryRef _owners;         //!< Answer GeniusItem -> its indexed GeniusAssociation.  Not retained.
+    NSMutableDictionary * _partitions;      //!< Partition key -> partition.
+    NSMutableDictionary * _typePartitions;  //!< Direction and type -> NSMutableArray of partitions.
+    NSMutableArray * _directionPartitions;  //!< Partitions of each direction:  index 0 for A to B, 1 for B to A.
+    uint32_t _seeds[kGeniusMinHashCount];   //!< Seed of each MinHash function.
+    GeniusRandomState _randomState;         //!< Picks fill-in answers.
+}
+
+- (void) setPairs:(NSArray *)pairs;
+- (void) addPair:(GeniusPair *)pair;
+- (void) removePair:(GeniusPair *)pair;
+- (void) invalidateObject:(id)object;
+
+- (unsigned int) count;
+- (unsigned long long) byteCount;
+- (void) setRandomSeed:(uint64_t)seed;
+
+- (NSArray *) distractorsForAssociation:(GeniusAssociation *)association count:(unsigned int)count;
+
+@end
@@ -0,0 +1,675 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusDistractorIndex.h"
+#import "GeniusPair.h"
+#import "GeniusAssociation.h"
+#import "GeniusItem.h"
+#import "GeniusAnswerKey.h"
+#import "GeniusMemoryReport.h"
+#include <time.h>       // time
+
+//! Signature values per band.
+#define kGeniusLSHRowsPerBand (kGeniusMinHashCount / kGeniusLSHBandCount)
+
+//! Longest answer key hashed with a buffer on the stack.
+#define kGeniusMinHashStackLength 256
+
+@class GeniusDistractorPartition;
+
+//! What the index knows about one association.
+typedef struct _GeniusDistractorEntry {
+    GeniusAssociation * association;            //!< The key of the entry in GeniusDistractorIndex#_entries.
+    GeniusDistractorPartition * partition;      //!< Partition holding the entry, or nil if the answer has no text.
+    NSString * key;                             //!< GeniusAnswerKey#key of the answer.  Retained.
+    unsigned int memberIndex;                   //!< Position in the members of #partition.
+    uint32_t signature[kGeniusMinHashCount];    //!< Minimum of each hash function over the trigrams of #key.
+    uint32_t bands[kGeniusLSHBandCount];        //!< Hash of each band of #signature.
+} GeniusDistractorEntry;
+
+//! A distractor candidate and the number of signature values it shares with the answer.
+typedef struct _GeniusDistractorCandidate {
+    GeniusDistractorEntry * entry;
+    unsigned int matches;
+} GeniusDistractorCandidate;
+
+
+//! Murmur3 finalizer, spreads the bits of @a h.
+static __inline__ uint32_t Mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35U;
+    h ^= h >> 16;
+    return h;
+}
+
+//! Fills @a signature with the MinHash of the character trigrams of @a key, padded with a space at both ends.
+static void ComputeSignature(NSString * key, const uint32_t * seeds, uint32_t * signature)
+{
+    unsigned int i, j, length = [key length];
+    unichar stackBuffer[kGeniusMinHashStackLength];
+    unichar * buffer = (length + 2 <= kGeniusMinHashStackLength ? stackBuffer : malloc((length + 2) * sizeof(unichar)));
+    buffer[0] = ' ';
+    [key getCharacters:buffer + 1];
+    buffer[length + 1] = ' ';
+
+    for (i=0; i<kGeniusMinHashCount; i++)
+        signature[i] = 0xFFFFFFFFU;
+    for (j=0; j+3<=length+2; j++)
+    {
+        uint32_t h = 2166136261U;   // FNV-1a
+        h = (h ^ buffer[j]) * 16777619U;
+        h = (h ^ buffer[j+1]) * 16777619U;
+        h = (h ^ buffer[j+2]) * 16777619U;
+        for (i=0; i<kGeniusMinHashCount; i++)
+        {
+            uint32_t value = Mix32(h ^ seeds[i]);
+            if (value < signature[i])
+                signature[i] = value;
+        }
+    }
+
+    if (buffer != stackBuffer)
+        free(buffer);
+}
+
+//! Fills @a bands with the hash of each band of @a signature.  Never 0.
+static void ComputeBands(const uint32_t * signature, uint32_t * bands)
+{
+    unsigned int band, row;
+    for (band=0; band<kGeniusLSHBandCount; band++)
+    {
+        uint32_t h = 2166136261U ^ band;
+        for (row=0; row<kGeniusLSHRowsPerBand; row++)
+            h = Mix32(h ^ signature[band * kGeniusLSHRowsPerBand + row]) * 16777619U;
+        bands[band] = (h ? h : 1);
+    }
+}
+
+//! Number of equal values in two signatures, an estimate of the Jaccard similarity times kGeniusMinHashCount.
+static __inline__ unsigned int SignatureMatches(const uint32_t * a, const uint32_t * b)
+{
+    unsigned int i, matches = 0;
+    for (i=0; i<kGeniusMinHashCount; i++)
+        matches += (a[i] == b[i]);
+    return matches;
+}
+
+//! CFDictionaryApplyFunction callback adding the size of a bucket array to the unsigned long long at @a context.
+static void AddBucketSize(const void * hash, const void * bucket, void * context)
+{
+    *(unsigned long long *)context += GeniusMemorySizeOfCollection((id)bucket);
+}
+
+//! CFDictionaryApplyFunction callback adding the size of a GeniusDistractorEntry and its key to the unsigned long long at @a context.
+static void AddEntrySize(const void * association, const void * entry, void * context)
+{
+    *(unsigned long long *)context += sizeof(GeniusDistractorEntry) + GeniusMemorySizeOfString(((const GeniusDistractorEntry *)entry)->key);
+}
+
+//! qsort comparator:  most matches first, then by position in the partition for a stable order.
+static int CompareCandidates(const void * a, const void * b)
+{
+    const GeniusDistractorCandidate * c1 = a;
+    const GeniusDistractorCandidate * c2 = b;
+    if (c1->matches != c2->matches)
+        return (c1->matches > c2->matches ? -1 : 1);
+    if (c1->entry->memberIndex != c2->entry->memberIndex)
+        return (c1->entry->memberIndex < c2->entry->memberIndex ? -1 : 1);
+    return 0;
+}
+
+
+//! The associations of one direction, type and group, with their LSH buckets.
+@interface GeniusDistractorPartition : NSObject {
+    NSString * _key;                                        //!< Key in GeniusDistractorIndex#_partitions.
+    NSString * _typeKey;                                    //!< Key in GeniusDistractorIndex#_typePartitions.
+    unsigned int _direction;                                //!< 0 for A to B, 1 for B to A.
+    GeniusDistractorEntry ** _members;                      //!< Entries of the partition, in no particular order.
+    unsigned int _count;                                    //!< Number of _members.
+    unsigned int _capacity;                                 //!< Allocated size of _members.
+    CFMutableDictionaryRef _buckets[kGeniusLSHBandCount];   //!< Band hash -> CFMutableArray of entries.
+}
+- (id) initWithKey:(NSString *)key typeKey:(NSString *)typeKey direction:(unsigned int)direction;
+- (NSString *) key;
+- (NSString *) typeKey;
+- (unsigned int) direction;
+- (unsigned int) count;
+- (GeniusDistractorEntry *) memberAtIndex:(unsigned int)index;
+- (CFArrayRef) bucketForBand:(unsigned int)band hash:(uint32_t)hash;
+- (void) addEntry:(GeniusDistractorEntry *)entry;
+- (void) removeEntry:(GeniusDistractorEntry *)entry;
+- (unsigned long long) byteCount;
+@end
+
+@implementation GeniusDistractorPartition
+
+//! Designated initializer.
+- (id) initWithKey:(NSString *)key typeKey:(NSString *)typeKey direction:(unsigned int)direction
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _key = [key copy];
+        _typeKey = [typeKey copy];
+        _direction = direction;
+        unsigned int band;
+        for (band=0; band<kGeniusLSHBandCount; band++)
+            _buckets[band] = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+    }
+    return self;
+}
+
+//! Releases the buckets and frees memory.  Entries belong to the index.
+- (void) dealloc
+{
+    unsigned int band;
+    for (band=0; band<kGeniusLSHBandCount; band++)
+        CFRelease(_buckets[band]);
+    free(_members);
+    [_key release];
+    [_typeKey release];
+    [super dealloc];
+}
+
+//! _key getter.
+- (NSString *) key
+{
+    return _key;
+}
+
+//! _typeKey getter.
+- (NSString *) typeKey
+{
+    return _typeKey;
+}
+
+//! _direction getter.
+- (unsigned int) direction
+{
+    return _direction;
+}
+
+//! Number of entries.
+- (unsigned int) count
+{
+    return _count;
+}
+
+//! Entry number @a index.
+- (GeniusDistractorEntry *) memberAtIndex:(unsigned int)index
+{
+    return _members[index];
+}
+
+//! Entries whose band number @a band hashes to @a hash, or NULL.
+- (CFArrayRef) bucketForBand:(unsigned int)band hash:(uint32_t)hash
+{
+    return CFDictionaryGetValue(_buckets[band], (const void *)(uintptr_t)hash);
+}
+
+//! Adds @a entry to the members and to one bucket per band.
+- (void) addEntry:(GeniusDistractorEntry *)entry
+{
+    if (_count == _capacity)
+    {
+        _capacity = MAX(2 * _capacity, 16U);
+        _members = realloc(_members, _capacity * sizeof(GeniusDistractorEntry *));
+    }
+    entry->memberIndex = _count;
+    entry->partition = self;
+    _members[_count++] = entry;
+
+    unsigned int band;
+    for (band=0; band<kGeniusLSHBandCount; band++)
+    {
+        CFMutableArrayRef bucket = (CFMutableArrayRef)CFDictionaryGetValue(_buckets[band], (const void *)(uintptr_t)entry->bands[band]);
+        if (bucket == NULL)
+        {
+            bucket = CFArrayCreateMutable(kCFAllocatorDefault, 0, NULL);
+            CFDictionarySetValue(_buckets[band], (const void *)(uintptr_t)entry->bands[band], bucket);
+            CFRelease(bucket);
+        }
+        CFArrayAppendValue(bucket, entry);
+    }
+}
+
+//! Removes @a entry from the members and its buckets.  Buckets are small, so they are searched.
+- (void) removeEntry:(GeniusDistractorEntry *)entry
+{
+    unsigned int band;
+    for (band=0; band<kGeniusLSHBandCount; band++)
+    {
+        CFMutableArrayRef bucket = (CFMutableArrayRef)CFDictionaryGetValue(_buckets[band], (const void *)(uintptr_t)entry->bands[band]);
+        if (bucket == NULL)
+            continue;
+        CFIndex index = CFArrayGetFirstIndexOfValue(bucket, CFRangeMake(0, CFArrayGetCount(bucket)), entry);
+        if (index != kCFNotFound)
+            CFArrayRemoveValueAtIndex(bucket, index);
+        if (CFArrayGetCount(bucket) == 0)
+            CFDictionaryRemoveValue(_buckets[band], (const void *)(uintptr_t)entry->bands[band]);
+    }
+
+    // Fill the hole with the last member.
+    GeniusDistractorEntry * last = _members[--_count];
+    _members[entry->memberIndex] = last;
+    last->memberIndex = entry->memberIndex;
+    entry->partition = nil;
+}
+
+//! Estimated bytes of the member list and band buckets.  The entries belong to the index.
+- (unsigned long long) byteCount
+{
+    unsigned long long total = GeniusMemorySizeOfObject(self) + _capacity * sizeof(GeniusDistractorEntry *);
+    unsigned int band;
+    for (band=0; band<kGeniusLSHBandCount; band++)
+    {
+        total += GeniusMemorySizeOfCollection((id)_buckets[band]);
+        CFDictionaryApplyFunction(_buckets[band], AddBucketSize, &total);
+    }
+    return total;
+}
+
+@end
+
+
+@interface GeniusDistractorIndex (Private)
+- (void) _addAssociation:(GeniusAssociation *)association direction:(unsigned int)direction;
+- (void) _removeAssociation:(GeniusAssociation *)association;
+- (void) _indexEntry:(GeniusDistractorEntry *)entry direction:(unsigned int)direction;
+- (void) _unindexEntry:(GeniusDistractorEntry *)entry;
+- (void) _reindexAssociation:(GeniusAssociation *)association;
+- (unsigned int) _collectCandidates:(GeniusDistractorCandidate **)candidates count:(unsigned int)count capacity:(unsigned int *)capacity inPartition:(GeniusDistractorPartition *)partition forEntry:(GeniusDistractorEntry *)entry visited:(CFMutableSetRef)visited;
+- (void) _takeCandidates:(GeniusDistractorCandidate *)candidates count:(unsigned int)candidateCount into:(NSMutableArray *)distractors limit:(unsigned int)limit seenKeys:(CFMutableSetRef)seenKeys;
+- (void) _fillDistractors:(NSMutableArray *)distractors limit:(unsigned int)limit fromPartitions:(NSArray *)partitions visited:(CFMutableSetRef)visited seenKeys:(CFMutableSetRef)seenKeys;
+@end
+
+@implementation GeniusDistractorIndex
+
+//! Creates an empty index.
+- (id) init
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _entries = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+        _owners = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+        _partitions = [[NSMutableDictionary alloc] init];
+        _typePartitions = [[NSMutableDictionary alloc] init];
+        _directionPartitions = [[NSMutableArray alloc] initWithObjects:[NSMutableArray array], [NSMutableArray array], nil];
+
+        // Fixed seeds, so signatures are the same in every run.
+        GeniusRandomState seedState;
+        GeniusRandomSeed(&seedState, 0x4D696E48617368ULL);
+        unsigned int i;
+        for (i=0; i<kGeniusMinHashCount; i++)
+            _seeds[i] = (uint32_t)GeniusRandomNext(&seedState);
+        GeniusRandomSeed(&_randomState, (uint64_t)time(NULL));
+    }
+    return self;
+}
+
+//! Frees the entries and releases the partitions.
+- (void) dealloc
+{
+    CFIndex i, count = CFDictionaryGetCount(_entries);
+    const void ** entries = malloc(MAX(count, 1) * sizeof(void *));
+    CFDictionaryGetKeysAndValues(_entries, NULL, entries);
+    for (i=0; i<count; i++)
+    {
+        [((GeniusDistractorEntry *)entries[i])->key release];
+        free((void *)entries[i]);
+    }
+    free(entries);
+    CFRelease(_entries);
+    CFRelease(_owners);
+    [_partitions release];
+    [_typePartitions release];
+    [_directionPartitions release];
+    [super dealloc];
+}
+
+//! Indexes the pairs of @a pairs not indexed yet and drops indexed pairs no longer in @a pairs.
+- (void) setPairs:(NSArray *)pairs
+{
+    NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+        [self addPair:pair];
+
+    CFIndex i, count = CFDictionaryGetCount(_entries);
+    if ((unsigned int)count == 2 * [pairs count])
+        return;
+
+    CFMutableSetRef currentPairs = CFSetCreateMutable(kCFAllocatorDefault, [pairs count], NULL);
+    pairEnumerator = [pairs objectEnumerator];
+    while ((pair = [pairEnumerator nextObject]))
+        CFSetAddValue(currentPairs, pair);
+
+    const void ** associations = malloc(MAX(count, 1) * sizeof(void *));
+    CFDictionaryGetKeysAndValues(_entries, associations, NULL);
+    for (i=0; i<count; i++)
+        if (CFSetContainsValue(currentPairs, [(GeniusAssociation *)associations[i] parentPair]) == NO)
+            [self _removeAssociation:(GeniusAssociation *)associations[i]];
+    free(associations);
+    CFRelease(currentPairs);
+}
+
+//! Indexes the answers of both associations of @a pair unless they are indexed already.
+- (void) addPair:(GeniusPair *)pair
+{
+    [self _addAssociation:[pair associationAB] direction:0];
+    [self _addAssociation:[pair associationBA] direction:1];
+}
+
+//! Drops both associations of @a pair.
+- (void) removePair:(GeniusPair *)pair
+{
+    [self _removeAssociation:[pair associationAB]];
+    [self _removeAssociation:[pair associationBA]];
+}
+
+//! Reindexes what changed after an edit of @a object:  a GeniusPair whose type or group may have changed, or an answer GeniusItem.
+- (void) invalidateObject:(id)object
+{
+    if ([object isKindOfClass:[GeniusPair class]])
+    {
+        [self _reindexAssociation:[object associationAB]];
+        [self _reindexAssociation:[object associationBA]];
+    }
+    else
+    {
+        GeniusAssociation * association = (GeniusAssociation *)CFDictionaryGetValue(_owners, object);
+        if (association)
+            [self _reindexAssociation:association];
+    }
+}
+
+//! Number of associations offered as distractors, those with answer text.
+- (unsigned int) count
+{
+    unsigned int count = 0;
+    NSEnumerator * partitionEnumerator = [_partitions objectEnumerator];
+    GeniusDistractorPartition * partition;
+    while ((partition = [partitionEnumerator nextObject]))
+        count += [partition count];
+    return count;
+}
+
+//! Estimated bytes held by the index:  entries, partitions and tables.
+- (unsigned long long) byteCount
+{
+    unsigned long long total = GeniusMemorySizeOfObject(self) + GeniusMemorySizeOfCollection((id)_entries) + GeniusMemorySizeOfCollection((id)_owners);
+    total += GeniusMemorySizeOfCollection(_partitions) + GeniusMemorySizeOfCollection(_typePartitions) + GeniusMemorySizeOfCollection(_directionPartitions);
+    CFDictionaryApplyFunction(_entries, AddEntrySize, &total);
+
+    NSEnumerator * partitionEnumerator = [_partitions objectEnumerator];
+    GeniusDistractorPartition * partition;
+    while ((partition = [partitionEnumerator nextObject]))
+        total += [partition byteCount];
+    return total;
+}
+
+//! Seeds the choice of fill-in answers, to repeat a run.
+- (void) setRandomSeed:(uint64_t)seed
+{
+    GeniusRandomSeed(&_randomState, seed);
+}
+
+//! Up to @a count answer GeniusItem objects that look like the answer of @a association but are different.
+/*! Fewer are returned only when the deck has fewer distinct answers in the direction of @a association. */
+- (NSArray *) distractorsForAssociation:(GeniusAssociation *)association count:(unsigned int)count
+{
+    NSMutableArray * distractors = [NSMutableArray arrayWithCapacity:count];
+    GeniusDistractorEntry * entry = (GeniusDistractorEntry *)CFDictionaryGetValue(_entries, association);
+    if (entry == NULL || entry->partition == nil || count == 0)
+        return distractors;
+
+    GeniusDistractorPartition * partition = entry->partition;
+    CFMutableSetRef visited = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+    CFMutableSetRef seenKeys = CFSetCreateMutable(kCFAllocatorDefault, 0, &kCFTypeSetCallBacks);
+    CFSetAddValue(visited, entry);
+    CFSetAddValue(seenKeys, entry->key);
+
+    unsigned int capacity = 64;
+    GeniusDistractorCandidate * candidates = malloc(capacity * sizeof(GeniusDistractorCandidate));
+
+    // Look alikes of the same type and group, then of the same type.
+    unsigned int candidateCount = [self _collectCandidates:&candidates count:0 capacity:&capacity inPartition:partition forEntry:entry visited:visited];
+    [self _takeCandidates:candidates count:candidateCount into:distractors limit:count seenKeys:seenKeys];
+
+    NSArray * typePartitions = [_typePartitions objectForKey:[partition typeKey]];
+    if ([distractors count] < count)
+    {
+        candidateCount = 0;
+        NSEnumerator * partitionEnumerator = [typePartitions objectEnumerator];
+        GeniusDistractorPartition * otherPartition;
+        while ((otherPartition = [partitionEnumerator nextObject]))
+            if (otherPartition != partition)
+                candidateCount = [self _collectCandidates:&candidates count:candidateCount capacity:&capacity inPartition:otherPartition forEntry:entry visited:visited];
+        [self _takeCandidates:candidates count:candidateCount into:distractors limit:count seenKeys:seenKeys];
+    }
+    free(candidates);
+
+    // Any answer will do, preferring the closest partitions.
+    if ([distractors count] < count)
+        [self _fillDistractors:distractors limit:count fromPartitions:[NSArray arrayWithObject:partition] visited:visited seenKeys:seenKeys];
+    if ([distractors count] < count)
+        [self _fillDistractors:distractors limit:count fromPartitions:typePartitions visited:visited seenKeys:seenKeys];
+    if ([distractors count] < count)
+        [self _fillDistractors:distractors limit:count fromPartitions:[_directionPartitions objectAtIndex:[partition direction]] visited:visited seenKeys:seenKeys];
+
+    CFRelease(visited);
+    CFRelease(seenKeys);
+    return distractors;
+}
+
+@end
+
+
+@implementation GeniusDistractorIndex (Private)
+
+//! Adds an entry for @a association unless it has one, and indexes its answer if it has text.
+- (void) _addAssociation:(GeniusAssociation *)association direction:(unsigned int)direction
+{
+    if (association == nil || CFDictionaryContainsKey(_entries, association))
+        return;
+
+    GeniusDistractorEntry * entry = calloc(1, sizeof(GeniusDistractorEntry));
+    entry->association = association;
+    CFDictionarySetValue(_entries, association, entry);
+    CFDictionarySetValue(_owners, [association answerItem], association);
+    [self _indexEntry:entry direction:direction];
+}
+
+//! Drops the entry of @a association.
+- (void) _removeAssociation:(GeniusAssociation *)association
+{
+    GeniusDistractorEntry * entry = (GeniusDistractorEntry *)CFDictionaryGetValue(_entries, association);
+    if (entry == NULL)
+        return;
+
+    [self _unindexEntry:entry];
+    [entry->key release];
+    free(entry);
+    CFDictionaryRemoveValue(_owners, [association answerItem]);
+    CFDictionaryRemoveValue(_entries, association);     // releases association, so last
+}
+
+//! Computes the signature of the answer of @a entry and puts it in its partition, unless the answer has no text.
+- (void) _indexEntry:(GeniusDistractorEntry *)entry direction:(unsigned int)direction
+{
+    NSString * key = [[[entry->association answerItem] answerKey] key];
+    [entry->key release];
+    entry->key = [key copy];
+    if ([key length] == 0)
+        return;
+
+    ComputeSignature(key, _seeds, entry->signature);
+    ComputeBands(entry->signature, entry->bands);
+
+    GeniusPair * pair = [entry->association parentPair];
+    NSString * type = [pair customTypeString];
+    NSString * group = [pair customGroupString];
+    NSString * typeKey = [NSString stringWithFormat:@"%u\t%@", direction, (type ? type : @"")];
+    NSString * partitionKey = [NSString stringWithFormat:@"%@\t%@", typeKey, (group ? group : @"")];
+
+    GeniusDistractorPartition * partition = [_partitions objectForKey:partitionKey];
+    if (partition == nil)
+    {
+        partition = [[GeniusDistractorPartition alloc] initWithKey:partitionKey typeKey:typeKey direction:direction];
+        [_partitions setObject:partition forKey:partitionKey];
+        NSMutableArray * typePartitions = [_typePartitions objectForKey:typeKey];
+        if (typePartitions == nil)
+        {
+            typePartitions = [NSMutableArray array];
+            [_typePartitions setObject:typePartitions forKey:typeKey];
+        }
+        [typePartitions addObject:partition];
+        [[_directionPartitions objectAtIndex:direction] addObject:partition];
+        [partition release];
+    }
+    [partition addEntry:entry];
+}
+
+//! Takes @a entry out of its partition, dropping the partition when it becomes empty.
+- (void) _unindexEntry:(GeniusDistractorEntry *)entry
+{
+    GeniusDistractorPartition * partition = entry->partition;
+    if (partition == nil)
+        return;
+
+    [partition removeEntry:entry];
+    if ([partition count])
+        return;
+
+    NSString * typeKey = [partition typeKey];
+    NSMutableArray * typePartitions = [_typePartitions objectForKey:typeKey];
+    [typePartitions removeObjectIdenticalTo:partition];
+    if ([typePartitions count] == 0)
+        [_typePartitions removeObjectForKey:typeKey];
+    [[_directionPartitions objectAtIndex:[partition direction]] removeObjectIdenticalTo:partition];
+    [_partitions removeObjectForKey:[partition key]];     // releases partition, so last
+}
+
+//! Indexes @a association again if its answer text, type or group changed.
+- (void) _reindexAssociation:(GeniusAssociation *)association
+{
+    GeniusDistractorEntry * entry = (GeniusDistractorEntry *)CFDictionaryGetValue(_entries, association);
+    if (entry == NULL)
+        return;
+
+    GeniusPair * pair = [association parentPair];
+    unsigned int direction = (association == [pair associationAB] ? 0 : 1);
+    NSString * key = [[[association answerItem] answerKey] key];
+    if (entry->partition && [key isEqualToString:entry->key])
+    {
+        NSString * type = [pair customTypeString];
+        NSString * group = [pair customGroupString];
+        NSString * partitionKey = [NSString stringWithFormat:@"%u\t%@\t%@", direction, (type ? type : @""), (group ? group : @"")];
+        if ([partitionKey isEqualToString:[entry->partition key]])
+            return;
+    }
+
+    [self _unindexEntry:entry];
+    [self _indexEntry:entry direction:direction];
+}
+
+//! Appends the members of the buckets of @a entry in @a partition not visited yet to the @a count @a candidates.
+/*! Grows @a candidates as needed, marks the appended entries visited and returns the new number of candidates. */
+- (unsigned int) _collectCandidates:(GeniusDistractorCandidate **)candidates count:(unsigned int)count capacity:(unsigned int *)capacity inPartition:(GeniusDistractorPartition *)partition forEntry:(GeniusDistractorEntry *)entry visited:(CFMutableSetRef)visited
+{
+    unsigned int band;
+    for (band=0; band<kGeniusLSHBandCount; band++)
+    {
+        CFArrayRef bucket = [partition bucketForBand:band hash:entry->bands[band]];
+        if (bucket == NULL)
+            continue;
+
+        CFIndex i, bucketCount = CFArrayGetCount(bucket);
+        for (i=0; i<bucketCount; i++)
+        {
+            GeniusDistractorEntry * member = (GeniusDistractorEntry *)CFArrayGetValueAtIndex(bucket, i);
+            if (CFSetContainsValue(visited, member))
+                continue;
+            CFSetAddValue(visited, member);
+
+            if (count == *capacity)
+            {
+                *capacity *= 2;
+                *candidates = realloc(*candidates, *capacity * sizeof(GeniusDistractorCandidate));
+            }
+            (*candidates)[count].entry = member;
+            (*candidates)[count].matches = SignatureMatches(entry->signature, member->signature);
+            count++;
+        }
+    }
+    return count;
+}
+
+//! Adds the answers of the best @a candidates to @a distractors until it holds @a limit, skipping answers in @a seenKeys.
+- (void) _takeCandidates:(GeniusDistractorCandidate *)candidates count:(unsigned int)candidateCount into:(NSMutableArray *)distractors limit:(unsigned int)limit seenKeys:(CFMutableSetRef)seenKeys
+{
+    qsort(candidates, candidateCount, sizeof(GeniusDistractorCandidate), CompareCandidates);
+
+    unsigned int i;
+    for (i=0; i<candidateCount && [distractors count]<limit; i++)
+    {
+        GeniusDistractorEntry * member = candidates[i].entry;
+        if (CFSetContainsValue(seenKeys, member->key))
+            continue;
+        CFSetAddValue(seenKeys, member->key);
+        [distractors addObject:[member->association answerItem]];
+    }
+}
+
+//! Adds random answers from @a partitions to @a distractors until it holds @a limit, skipping visited entries and answers in @a seenKeys.
+/*! Large partitions get a bounded number of random draws, so a deck of repeated answers cannot stall the quiz. */
+- (void) _fillDistractors:(NSMutableArray *)distractors limit:(unsigned int)limit fromPartitions:(NSArray *)partitions visited:(CFMutableSetRef)visited seenKeys:(CFMutableSetRef)seenKeys
+{
+    unsigned int partitionCount = [partitions count];
+    if (partitionCount == 0)
+        return;
+
+    unsigned int i, first = GeniusRandomLong(&_randomState) % partitionCount;
+    for (i=0; i<partitionCount && [distractors count]<limit; i++)
+    {
+        GeniusDistractorPartition * partition = [partitions objectAtIndex:(first + i) % partitionCount];
+        unsigned int memberCount = [partition count];
+        unsigned int draws = 4 * (limit - [distractors count]) + 8;
+        BOOL scan = (memberCount <= draws);     // small partitions are scanned from a random start
+        unsigned int start = GeniusRandomLong(&_randomState) % memberCount;
+        unsigned int j;
+        for (j=0; j<(scan ? memberCount : draws) && [distractors count]<limit; j++)
+        {
+            unsigned int index = (scan ? (start + j) % memberCount : GeniusRandomLong(&_randomState) % memberCount);
+            GeniusDistractorEntry * member = [partition memberAtIndex:index];
+            if (CFSetContainsValue(visited, member))
+                continue;
+            CFSetAddValue(visited, member);
+            if (CFSetContainsValue(seenKeys, member->key))
+                continue;
+            CFSetAddValue(seenKeys, member->key);
+            [distractors addObject:[member->association answerItem]];
+        }
+    }
+}
+
+@end
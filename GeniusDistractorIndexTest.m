@@ -0,0 +1,151 @@
+//
+//  GeniusDistractorIndexTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusDistractorIndex.h"
+#import "GeniusPair.h"
+#import "GeniusItem.h"
+
+@interface GeniusDistractorIndexTest : SenTestCase {
+    GeniusDistractorIndex *index;   //!< The object under test.
+    NSMutableArray *pairs;          //!< Indexed pairs.
+}
+
+@end
+
+//! Tests for the GeniusDistractorIndex multiple choice answers.
+@implementation GeniusDistractorIndexTest
+
+//! Creates an empty, seeded index for each test.
+- (void) setUp
+{
+    index = [[GeniusDistractorIndex alloc] init];
+    [index setRandomSeed:17];
+    pairs = [[NSMutableArray alloc] init];
+}
+
+//! Releases the index and pairs.
+- (void) tearDown
+{
+    [index release];
+    index = nil;
+    [pairs release];
+    pairs = nil;
+}
+
+//! Adds a pair with @a question, @a answer and @a type to #pairs and the index.
+- (GeniusPair *) _addPairWithQuestion:(NSString *)question answer:(NSString *)answer type:(NSString *)type
+{
+    GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+    [[pair itemA] setValue:question forKey:@"stringValue"];
+    [[pair itemB] setValue:answer forKey:@"stringValue"];
+    [pair setCustomTypeString:type];
+    [pairs addObject:pair];
+    [index addPair:pair];
+    return pair;
+}
+
+//! Answer strings of the distractors for the A to B association of @a pair.
+- (NSArray *) _distractorsForPair:(GeniusPair *)pair count:(unsigned int)count
+{
+    return [[index distractorsForAssociation:[pair associationAB] count:count] valueForKey:@"stringValue"];
+}
+
+//! Look alike answers come before unrelated ones, and the right answer or its variants are never offered.
+- (void) testSimilarAnswersFirst
+{
+    GeniusPair * pair = [self _addPairWithQuestion:@"house" answer:@"das Haus" type:@"noun"];
+    [self _addPairWithQuestion:@"houses" answer:@"die Haeuser" type:@"noun"];
+    [self _addPairWithQuestion:@"little house" answer:@"das Haeuschen" type:@"noun"];
+    [self _addPairWithQuestion:@"mouse" answer:@"die Maus" type:@"noun"];
+    [self _addPairWithQuestion:@"house!" answer:@"Das  Haus." type:@"noun"];
+    [self _addPairWithQuestion:@"the house" answer:@"das Hause" type:@"noun"];
+    [self _addPairWithQuestion:@"sky" answer:@"der Himmel" type:@"noun"];
+    [self _addPairWithQuestion:@"to run" answer:@"laufen" type:@"verb"];
+
+    STAssertEquals([index count], 16U, nil);
+
+    NSArray * distractors = [self _distractorsForPair:pair count:1];
+    STAssertEqualObjects(distractors, [NSArray arrayWithObject:@"das Hause"], nil);
+
+    distractors = [self _distractorsForPair:pair count:4];
+    STAssertEquals([distractors count], 4U, nil);
+    STAssertFalse([distractors containsObject:@"das Haus"], nil);
+    STAssertFalse([distractors containsObject:@"Das  Haus."], @"equal to the answer after normalization");
+    STAssertFalse([distractors containsObject:@"laufen"], @"other types only when the own one runs out");
+    STAssertEquals([[NSSet setWithArray:distractors] count], 4U, nil);
+}
+
+//! Other types fill in only when a type has too few answers, and there are never more than exist.
+- (void) testFillFromOtherTypes
+{
+    GeniusPair * pair = [self _addPairWithQuestion:@"to run" answer:@"laufen" type:@"verb"];
+    [self _addPairWithQuestion:@"to walk" answer:@"gehen" type:@"verb"];
+    [self _addPairWithQuestion:@"house" answer:@"das Haus" type:@"noun"];
+    [self _addPairWithQuestion:@"mouse" answer:@"die Maus" type:@"noun"];
+    [self _addPairWithQuestion:@"empty" answer:nil type:@"noun"];
+
+    NSArray * distractors = [self _distractorsForPair:pair count:4];
+    STAssertEquals([distractors count], 3U, nil);
+    STAssertEqualObjects([distractors objectAtIndex:0], @"gehen", nil);
+    STAssertTrue([distractors containsObject:@"das Haus"], nil);
+    STAssertTrue([distractors containsObject:@"die Maus"], nil);
+}
+
+//! Edits of answers and types move associations, and removed pairs are no longer offered.
+- (void) testUpdates
+{
+    GeniusPair * pair = [self _addPairWithQuestion:@"cat" answer:@"die Katze" type:@"noun"];
+    GeniusPair * other = [self _addPairWithQuestion:@"cats" answer:@"die Katzen" type:@"noun"];
+    GeniusPair * third = [self _addPairWithQuestion:@"to eat" answer:@"essen" type:@"verb"];
+
+    STAssertEqualObjects([self _distractorsForPair:pair count:1], [NSArray arrayWithObject:@"die Katzen"], nil);
+
+    [[other itemB] setValue:@"die Kater" forKey:@"stringValue"];
+    [index invalidateObject:[other itemB]];
+    STAssertEqualObjects([self _distractorsForPair:pair count:1], [NSArray arrayWithObject:@"die Kater"], nil);
+
+    [other setCustomTypeString:@"verb"];
+    [index invalidateObject:other];
+    [third setCustomTypeString:@"noun"];
+    [index invalidateObject:third];
+    STAssertEqualObjects([self _distractorsForPair:pair count:1], [NSArray arrayWithObject:@"essen"], nil);
+
+    [pairs removeObject:third];
+    [index setPairs:pairs];
+    STAssertEqualObjects([self _distractorsForPair:pair count:1], [NSArray arrayWithObject:@"die Kater"], nil);
+    STAssertEquals([index count], 4U, nil);
+
+    [index removePair:other];
+    STAssertEquals([[self _distractorsForPair:pair count:3] count], 0U, nil);
+}
+
+//! Inflections of a verb are found through the buckets ahead of the other verbs.
+- (void) testInflectionsFindTheirStem
+{
+    NSArray * stems = [NSArray arrayWithObjects:@"spiel", @"fahr", @"schreib", @"lauf", @"trink", @"geh", @"sprech", @"les", nil];
+    NSArray * endings = [NSArray arrayWithObjects:@"en", @"e", @"st", @"t", @"end", @"er", nil];
+    unsigned int i, j;
+    for (i=0; i<[stems count]; i++)
+        for (j=0; j<[endings count]; j++)
+        {
+            NSString * answer = [[stems objectAtIndex:i] stringByAppendingString:[endings objectAtIndex:j]];
+            [self _addPairWithQuestion:[NSString stringWithFormat:@"q%u", i * 10 + j] answer:answer type:nil];
+        }
+
+    for (i=0; i<[stems count]; i++)
+    {
+        GeniusPair * pair = [pairs objectAtIndex:i * [endings count]];
+        NSArray * distractors = [self _distractorsForPair:pair count:2];
+        STAssertEquals([distractors count], 2U, nil);
+        NSString * stem = [stems objectAtIndex:i];
+        STAssertTrue([[distractors objectAtIndex:0] hasPrefix:stem], @"%@ for %@", distractors, stem);
+    }
+}
+
+@end
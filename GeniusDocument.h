@@ -18,8 +18,24 @@
 
 #import <Cocoa/Cocoa.h>
 
+#import "GeniusScheduler.h"
+#import "GeniusPair.h"
+#import "GeniusReviewLog.h"
+
 @class GeniusArrayController;
-@class GeniusPair;
+@class GeniusTimingWheel;
+@class GeniusMediaStore;
+@class GeniusTextStore;
+@class GeniusAnalytics;
+@class GeniusTableRowModel;
+@class GeniusSortEngine;
+@class GeniusFuzzyIndex;
+@class GeniusDistractorIndex;
+@class GeniusPairColumns;
+@class GeniusLibrary;
+@class GeniusDeckStore;
+@class GeniusDeckSnapshot;
+@class GeniusMemoryReport;
 @class GSTableView;
 
 //! Standard NSDocument subclass for controlling interaction between UI and GeniusPair list.
@@ -42,16 +58,41 @@
     NSMutableArray *_visibleColumnIdentifiers;          //!< Identifiers of the columns that should be displayed on loading a file.
     NSMutableDictionary *_columnHeadersDict;            //!< Labels used for column header names.
     NSMutableArray *_pairs;                             //!< The GeniusPair items that make up a GeniusDocument.
+    NSMutableDictionary *_pairsByID;                    //!< GeniusPair#pairID as NSNumber -> GeniusPair, for every item in _pairs.
+    GeniusLibrary *_library;                            //!< Shared card content of a library deck, nil for ordinary decks.
+    NSString *_syncPath;                                //!< Shared copy this deck syncs with, see #syncDeck:.  nil until first synced.
     NSDate *_cumulativeStudyTime;                       //!< Not sure this is used anymore.
     NSNumber *probabilityCenter;                        //!< balance between learning and reviewing.
 
     // some flags
     BOOL _shouldShowImportWarningOnSave;                //!< Flag indicating the GeniusDocument was loaded from an older version.
     NSArray *_pairsDuringDrag;                          //!< Temporary array of items being dragged and dropped.
+    NSMutableDictionary *_promisedPairs;                //!< Pasteboard name -> GeniusDeckSnapshot of the pairs whose text is only generated when asked for.
     NSMutableSet *_customTypeStringCache;               //!< Cache of all types used in deck.
 
     // cached values
     NSArray *_sortedCustomTypeStrings;                  //!< Sorted array of custom types cached from Genius Pairs.
+    GeniusTimingWheel *_dueIndex;                       //!< Due time index over all GeniusAssociation items in _pairs.
+    id <GeniusScheduler> _scheduler;                    //!< Scheduling algorithm used by quizzes on this deck.
+    GeniusReviewLog *_reviewLog;                        //!< History of every answer, stored next to the deck.
+    unsigned long long _appliedLogPosition;             //!< Leading records of _reviewLog whose detached answers were applied but not yet saved, or 0.
+    GeniusMediaStore *_mediaStore;                      //!< Images and sounds of the deck, stored next to it.
+    GeniusTextStore *_textStore;                        //!< Notes and long item text of the deck as opened, read on demand.
+    GeniusDistractorIndex *_distractorIndex;            //!< Look alike answers for multiple choice quizzes, built on first use.
+    BOOL _distractorIndexNeedsSync;                     //!< Set when pairs were added or removed since _distractorIndex last saw them.
+    GeniusAnalytics *_analytics;                        //!< Incrementally maintained deck statistics.
+    GeniusTableRowModel *_rowModel;                     //!< Display values of the visible table rows.
+    GeniusDeckStore *_deckStore;                        //!< Record table behind #snapshot, kept in step with _pairs.
+    BOOL _isSyncingSelection;                           //!< Set while copying selection between table and arrayController.
+    unsigned int _undoRegistrationCount;                //!< Undo actions the undo manager is estimated to hold, see GeniusDocument(MemoryAccounting).
+    unsigned int _closedUndoRegistrationCount;          //!< Part of _undoRegistrationCount in closed undo groups.
+    NSMutableArray *_undoGroupSizes;                    //!< NSNumber with the registrations of each closed undo group, oldest first.
+
+    // background saving
+    unsigned int _editGeneration;                       //!< Counts changes, so a finished save can tell whether it has the latest one.
+    BOOL _isSaving;                                     //!< Set while a save runs on a background thread.
+    float _saveProgress;                                //!< Fraction of the running save that is done.
+    NSMutableArray *_pendingSaves;                      //!< NSInvocation of each save requested while another one was running.
     
     // TableView appearance
     float rowHeight;                                    //!< table view row height
@@ -62,9 +103,30 @@
 - (void) setPairs: (NSMutableArray*) values;
 - (void) removeObjectFromPairsAtIndex:(int) index;
 - (void) insertObject:(GeniusPair*) pair inPairsAtIndex:(int)index;
+- (void) movePairsAtIndexes:(NSIndexSet *)fromIndexes toIndexes:(NSIndexSet *)toIndexes;
+
+- (GeniusPair *) pairWithID:(GeniusPairID)pairID;
+- (BOOL) revealPairWithID:(GeniusPairID)pairID;
+- (BOOL) applyReviewRecord:(const GeniusReviewRecord *)record;
+- (GeniusDeckSnapshot *) snapshot;
+
+- (GeniusLibrary *) library;
+- (BOOL) isLibraryDeck;
+- (void) setLibrary:(GeniusLibrary *)library overlayData:(NSData *)overlayData;
 
 - (NSSearchField *) searchField;
 
+- (GeniusTimingWheel *) dueIndex;
+
+- (id <GeniusScheduler>) scheduler;
+- (void) setScheduler:(id <GeniusScheduler>)scheduler;
+
+- (GeniusReviewLog *) reviewLog;
+- (GeniusMediaStore *) mediaStore;
+- (GeniusTextStore *) textStore;
+- (GeniusDistractorIndex *) distractorIndex;
+- (GeniusAnalytics *) analytics;
+
 - (void) _reloadCustomTypeCacheSet;
 - (void) setListTextSizeMode: (int) mode;
 
@@ -88,6 +150,11 @@
 
 - (IBAction) add: (id) sender;
 - (IBAction) duplicate: (id) sender;
+- (IBAction) attachMedia: (id) sender;
+- (IBAction) syncDeck: (id) sender;
+
+- (IBAction) copy: (id) sender;
+- (IBAction) paste: (id) sender;
 
 - (IBAction) resetScore: (id) sender;
 - (IBAction) setItemImportance: (id) sender;
@@ -101,11 +168,27 @@
 @end
 
 @interface GeniusArrayController : NSArrayController {
-    NSString * _filterString; //!< The string for which we are filtering.
+    NSString * _filterString;       //!< The string for which we are filtering.
+    GeniusSortEngine * _sortEngine; //!< Sorts arranged objects by cached per column keys.
+    GeniusFuzzyIndex * _fuzzyIndex; //!< Word index for fuzzy searches, built on the first one.
+    BOOL _fuzzyIndexNeedsSync;      //!< Set when pairs were added or removed since _fuzzyIndex last saw them.
+    GeniusPairColumns * _pairColumns;   //!< Packed numeric fields for structured filters, built on the first one.
+    unsigned int _searchCacheLimit;     //!< Most bytes each of _sortEngine and _fuzzyIndex with _pairColumns may keep, 0 if unbounded.
 }
 
 - (NSString *) filterString;
 - (void) setFilterString:(NSString *)string;
+
+- (void) objectDidChange:(id)object;
+- (void) pairsDidChange;
+- (void) associationsDidChange;
+
+- (unsigned int) searchCacheLimit;
+- (void) setSearchCacheLimit:(unsigned int)limit;
+- (void) discardSearchCaches;
+- (void) addToMemoryReport:(GeniusMemoryReport *)report;
+
++ (NSArray *) fuzzyKeyPaths;
 @end
 
 @interface GeniusDocument(UndoRedoSupport)
@@ -17,9 +17,9 @@
 */
 
 #import "GeniusDocument.h"
-#import "GeniusDocument_DebugLogging.h"
 
 #import "GeniusDocumentFile.h"
+#import "GeniusDocumentMemory.h"
 #import "IconTextFieldCell.h"
 #import "GeniusToolbar.h"
 #import "GeniusItem.h"
@@ -28,20 +28,60 @@
 #import "GeniusPreferencesController.h"
 #import "GeniusPair.h"
 #import "GeniusAssociation.h"
+#import "GeniusTimingWheel.h"
+#import "GeniusAssociationColumns.h"
+#import "GeniusReviewLog.h"
+#import "GeniusMediaStore.h"
+#import "GeniusTextStore.h"
+#import "GeniusTrace.h"
+#import "GeniusFuzzyIndex.h"
+#import "GeniusDistractorIndex.h"
+#import "GeniusFilterQuery.h"
+#import "GeniusPairColumns.h"
+#import "GeniusAnalytics.h"
+#import "GeniusTableRowModel.h"
+#import "GeniusSortEngine.h"
+#import "GeniusMemoryReport.h"
+#import "GeniusTabularCodec.h"
+#import "GeniusPairMerger.h"
+#import "GeniusLibrary.h"
+#import "GeniusDeckSnapshot.h"
+#import "GeniusSyncClient.h"
+#import "GeniusSyncServer.h"
 #import "IsPairImportantTransformer.h"
 #import "ColorFromPairImportanceTransformer.h"
 #import "GSTableView.h"
 
+//! Most pairs shown for a fuzzy search (a filter string starting with ~).
+#define kGeniusFuzzySearchLimit 1000
+
+//! Seconds without a search after which a search index over GeniusArrayController#_searchCacheLimit is dropped.
+#define kGeniusSearchCacheIdleDelay 10.0
+
 @interface GeniusDocument (VeryPrivate)
 - (NSArray *) _enabledAssociationsForPairs:(NSArray *)pairs;
 - (void) _updateStatusText;
 - (void) _updateLevelIndicator;
+- (void) _installRowModel;
+- (void) _tableViewBoundsDidChange:(NSNotification *)notification;
+- (void) _registerPairID:(GeniusPair *)pair;
+- (void) _movePairs:(NSArray *)pairs beforePair:(GeniusPair *)targetPair;
+@end
+
+@interface GeniusDocument (Pasteboard)
+- (void) _promisePairs:(NSArray *)pairs onPasteboard:(NSPasteboard *)pboard;
+- (NSString *) _stringFromPromisedSnapshot:(GeniusDeckSnapshot *)snapshot;
+- (void) _importTabularText:(NSString *)string;
+- (void) _continueImportWithDecoder:(GeniusTabularDecoder *)decoder;
+- (void) _keepPromisedPairs;
+- (void) _addImportedPairs:(NSArray *)pairs;
 @end
 
 // Standard NSDocument subclass for controlling display and editing of a Genius file.
 @implementation GeniusDocument
 
 static NSArray *columnBindings;
+static NSImage *statusImages[GeniusStatusTierCount];    //!< Score column glyphs by GeniusStatusTier.
 
 //! returns list of keypaths used to get at values of a GeniusPair.
 + (NSArray *) columnBindings
@@ -58,12 +98,11 @@ static NSArray *columnBindings;
     [NSValueTransformer setValueTransformer:[[[IsPairImportantTransformer alloc] init] autorelease] forName:@"IsPairImportantTransformer"];
     [NSValueTransformer setValueTransformer:[[[ColorFromPairImportanceTransformer alloc] init] autorelease] forName:@"ColorFromPairImportanceTransformer"];
 
+    statusImages[GeniusStatusTierNew] = [[NSImage imageNamed:@"status-red"] retain];
+    statusImages[GeniusStatusTierLearning] = [[NSImage imageNamed:@"status-yellow"] retain];
+    statusImages[GeniusStatusTierLearned] = [[NSImage imageNamed:@"status-green"] retain];
+
     columnBindings = [[NSArray alloc] initWithObjects:@"itemA.stringValue", @"itemB.stringValue", @"customGroupString", @"customTypeString", @"associationAB.scoreNumber", @"associationBA.scoreNumber", @"notesString", nil];
-    
-    // install swizzle based logging
-#if DEBUG
-    [self installLogging];
-#endif
 }
 
 //! Basic NSDocument init method.
@@ -74,7 +113,21 @@ static NSArray *columnBindings;
 {
     self = [super init];
     if (self) {
+        // Index of association due times, kept in step with _pairs.
+        _dueIndex = [[GeniusTimingWheel alloc] init];
+        _analytics = [[GeniusAnalytics alloc] initWithDueIndex:_dueIndex];
+        _rowModel = [[GeniusTableRowModel alloc] init];
+        _deckStore = [[GeniusDeckStore alloc] init];
+        _scheduler = [[GeniusScoreScheduler defaultScheduler] retain];
+
+        // Review history goes to a temporary directory until the deck is saved, see setFileName:.
+        NSString * logName = [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"geniuslog"];
+        _reviewLog = [[GeniusReviewLog alloc] initWithDirectoryPath:[NSTemporaryDirectory() stringByAppendingPathComponent:logName]];
+        NSString * mediaName = [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"geniusmedia"];
+        _mediaStore = [[GeniusMediaStore alloc] initWithDirectoryPath:[NSTemporaryDirectory() stringByAppendingPathComponent:mediaName]];
+
         // Init array for genius pairs.
+        _pairsByID = [[NSMutableDictionary alloc] init];
         [self setPairs:[NSMutableArray array]];
 
         // Expect not to be loading a 1.0 format file
@@ -90,6 +143,10 @@ static NSArray *columnBindings;
         _visibleColumnIdentifiers = [[NSMutableArray alloc] initWithObjects:@"disabled", @"columnA", @"columnB", @"scoreAB", nil];
 
         _customTypeStringCache = [[NSMutableSet alloc] init];
+        _promisedPairs = [[NSMutableDictionary alloc] init];
+        _pendingSaves = [[NSMutableArray alloc] init];
+        _undoGroupSizes = [[NSMutableArray alloc] init];
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(undoManagerDidCloseUndoGroup:) name:NSUndoManagerDidCloseUndoGroupNotification object:[self undoManager]];
 
         // setup change tracking of ourself
         [self addObserver:self];
@@ -105,12 +162,36 @@ static NSArray *columnBindings;
 - (void) dealloc
 {
     [_pairs release];
+    [_pairsByID release];
+    [_library release];
+    [_syncPath release];
     [_visibleColumnIdentifiers release];
     [_columnHeadersDict release];
     [_searchField release];
     [_customTypeStringCache release];
     [probabilityCenter release];
     [_sortedCustomTypeStrings release];
+    [_dueIndex release];
+    [_analytics release];
+    [_rowModel release];
+    [_deckStore release];
+    [_scheduler release];
+    [_pairsDuringDrag release];
+    [_promisedPairs release];
+    [_pendingSaves release];
+    [_undoGroupSizes release];
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+
+    // Drop the history of decks that were never saved.
+    [_reviewLog flush];
+    if ([self fileName] == nil)
+        [[NSFileManager defaultManager] removeFileAtPath:[_reviewLog directoryPath] handler:nil];
+    [_reviewLog release];
+    if ([self fileName] == nil)
+        [[NSFileManager defaultManager] removeFileAtPath:[_mediaStore directoryPath] handler:nil];
+    [_mediaStore release];
+    [_textStore release];
+    [_distractorIndex release];
     
     [super dealloc];
 }
@@ -140,6 +221,9 @@ static NSArray *columnBindings;
     // set up tool bar and enable tabbing from search field to table view.
     [self setupToolbarForWindow:[aController window]];
     [_searchField setNextKeyView:tableView];
+
+    [self _installRowModel];
+    [self applyMemoryBudgets];
 	
     [self reloadInterfaceFromModel];
 }
@@ -150,9 +234,20 @@ static NSArray *columnBindings;
     NSUndoManager *undoManager = [self undoManager];
     
     [[undoManager prepareWithInvocationTarget:self] removeObjectFromPairsAtIndex:index];
+    GeniusTraceCount(GeniusTraceCounterUndoRegistrations, 1);
+    _undoRegistrationCount++;
 
     [pair addObserver:self];
     [_pairs insertObject:pair atIndex:index];
+    [_deckStore pairsDidChange];
+    [arrayController pairsDidChange];
+    _distractorIndexNeedsSync = YES;
+    [_deckStore pairDidChange:pair];
+    [self _registerPairID:pair];
+    [_dueIndex addAssociation:[pair associationAB]];
+    [_dueIndex addAssociation:[pair associationBA]];
+    [_analytics addAssociation:[pair associationAB]];
+    [_analytics addAssociation:[pair associationBA]];
 }
 
 //! removes the item at index from pairs array, taking care to stop observing it first.
@@ -162,8 +257,123 @@ static NSArray *columnBindings;
     
     GeniusPair *pair = [_pairs objectAtIndex:index];
     [[undoManager prepareWithInvocationTarget:self] insertObject:pair inPairsAtIndex:index];
+    GeniusTraceCount(GeniusTraceCounterUndoRegistrations, 1);
+    _undoRegistrationCount++;
     [pair removeObserver:self];
+    [_dueIndex removeAssociation:[pair associationAB]];
+    [_dueIndex removeAssociation:[pair associationBA]];
+    [_analytics removeAssociation:[pair associationAB]];
+    [_analytics removeAssociation:[pair associationBA]];
+    [_pairsByID removeObjectForKey:[NSNumber numberWithUnsignedLongLong:[pair pairID]]];
     [_pairs removeObjectAtIndex:index];
+    [_deckStore pairsDidChange];
+    [arrayController pairsDidChange];
+    _distractorIndexNeedsSync = YES;
+}
+
+//! Moves the pairs at @a fromIndexes so they end up at @a toIndexes, keeping their order.
+/*!
+    The pairs themselves are untouched: no copies, no observer, due index or analytics updates.  Undo is
+    one invocation holding the two index sets, which are usually single ranges.  Observers of @c pairs
+    see a removal followed by an insertion.
+ */
+- (void) movePairsAtIndexes:(NSIndexSet *)fromIndexes toIndexes:(NSIndexSet *)toIndexes
+{
+    NSAssert([fromIndexes count] == [toIndexes count], @"moved pair count");
+    if ([fromIndexes isEqualToIndexSet:toIndexes])
+        return;
+
+    [[[self undoManager] prepareWithInvocationTarget:self] movePairsAtIndexes:toIndexes toIndexes:fromIndexes];
+    GeniusTraceCount(GeniusTraceCounterUndoRegistrations, 1);
+    _undoRegistrationCount++;
+
+    NSArray * movedPairs = [_pairs objectsAtIndexes:fromIndexes];
+    [self willChange:NSKeyValueChangeRemoval valuesAtIndexes:fromIndexes forKey:@"pairs"];
+    [_pairs removeObjectsAtIndexes:fromIndexes];
+    [self didChange:NSKeyValueChangeRemoval valuesAtIndexes:fromIndexes forKey:@"pairs"];
+
+    [self willChange:NSKeyValueChangeInsertion valuesAtIndexes:toIndexes forKey:@"pairs"];
+    [_pairs insertObjects:movedPairs atIndexes:toIndexes];
+    [_deckStore pairsDidChange];
+    [self didChange:NSKeyValueChangeInsertion valuesAtIndexes:toIndexes forKey:@"pairs"];
+}
+
+//! Returns the pair with GeniusPair#pairID @a pairID, or nil.
+- (GeniusPair *) pairWithID:(GeniusPairID)pairID
+{
+    return [_pairsByID objectForKey:[NSNumber numberWithUnsignedLongLong:pairID]];
+}
+
+//! Selects the pair with GeniusPair#pairID @a pairID and scrolls it into view, clearing a search that hides it.
+/*! Returns NO if the deck has no such pair. */
+- (BOOL) revealPairWithID:(GeniusPairID)pairID
+{
+    GeniusPair * pair = [self pairWithID:pairID];
+    if (pair == nil)
+        return NO;
+
+    if ([[arrayController arrangedObjects] indexOfObjectIdenticalTo:pair] == NSNotFound)
+    {
+        [_searchField setStringValue:@""];
+        [arrayController setFilterString:@""];
+    }
+    [arrayController setSelectedObjects:[NSArray arrayWithObject:pair]];
+    unsigned int row = [[arrayController arrangedObjects] indexOfObjectIdenticalTo:pair];
+    if (row != NSNotFound)
+        [tableView scrollRowToVisible:row];
+    return YES;
+}
+
+//! Schedules the association answered in @a record as if it had been answered in a quiz on this deck.
+/*!
+    Used for answers given in a combined review of several decks, see GeniusDueQueue.  Detached records,
+    already in the review log of the deck, are only applied; others are logged and counted as well.
+    Returns NO if the deck has no such association.
+ */
+- (BOOL) applyReviewRecord:(const GeniusReviewRecord *)record
+{
+    GeniusPair * pair = [self pairWithID:(GeniusPairID)(record->associationID >> 1)];
+    if (pair == nil)
+        return NO;
+
+    GeniusAssociation * association = ((record->associationID & 1) ? [pair associationBA] : [pair associationAB]);
+    if ((record->flags & GeniusReviewRecordDetached) == 0)
+    {
+        [_reviewLog appendRecord:record];
+        [_analytics recordReview:record ofAssociation:association];
+    }
+    [_scheduler scheduleAssociation:association outcome:record->outcome time:record->time];
+    return YES;
+}
+
+//! Returns an immutable view of the pairs as they are now, for reading on any thread.
+/*! Cheap enough to take on every use; unchanged parts of the deck are shared between snapshots. */
+- (GeniusDeckSnapshot *) snapshot
+{
+    return [_deckStore snapshot];
+}
+
+//! _library getter.
+- (GeniusLibrary *) library
+{
+    return _library;
+}
+
+//! Library decks show shared, read only cards and only save the learner's performance.
+- (BOOL) isLibraryDeck
+{
+    return (_library != nil);
+}
+
+//! Makes the receiver a deck studying the cards of @a library, with the performance saved in @a overlayData.
+/*! @a overlayData may be nil for a new deck.  Pairs are in library order. */
+- (void) setLibrary:(GeniusLibrary *)library overlayData:(NSData *)overlayData
+{
+    [library retain];
+    [_library release];
+    _library = library;
+
+    [self setPairs:[library pairsWithOverlayData:overlayData]];
 }
 
 //! _pairs getter.
@@ -181,6 +391,25 @@ static NSArray *columnBindings;
     [values retain];
     [_pairs release];
     _pairs = values;
+    [_deckStore setPairs:_pairs];
+    [arrayController pairsDidChange];
+    _distractorIndexNeedsSync = YES;
+
+    [_dueIndex removeAllAssociations];
+    [_dueIndex advanceToTime:GeniusTimeNow()];
+    [_analytics removeAllAssociations];
+    [_analytics invalidateRetention];
+    [_pairsByID removeAllObjects];
+    NSEnumerator * pairEnumerator = [_pairs objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+    {
+        [self _registerPairID:pair];
+        [_dueIndex addAssociation:[pair associationAB]];
+        [_dueIndex addAssociation:[pair associationBA]];
+        [_analytics addAssociation:[pair associationAB]];
+        [_analytics addAssociation:[pair associationBA]];
+    }
 }
 
 //! _searchField getter.
@@ -189,6 +418,111 @@ static NSArray *columnBindings;
     return _searchField;
 }
 
+//! Returns the due time index over all associations, advanced to the current time.
+/*! Use GeniusTimingWheel#dueAssociations and GeniusTimingWheel#getDueCounts:forDays: for due and forecast counts. */
+- (GeniusTimingWheel *) dueIndex
+{
+    [_dueIndex advanceToTime:GeniusTimeNow()];
+    return _dueIndex;
+}
+
+//! _reviewLog getter.
+- (GeniusReviewLog *) reviewLog
+{
+    return _reviewLog;
+}
+
+//! _mediaStore getter.
+- (GeniusMediaStore *) mediaStore
+{
+    return _mediaStore;
+}
+
+//! _textStore getter.  nil unless the deck was opened from a file with a text section.
+- (GeniusTextStore *) textStore
+{
+    return _textStore;
+}
+
+//! Returns #_distractorIndex brought up to date with the pairs.  Builds it on first use and keeps it afterwards.
+- (GeniusDistractorIndex *) distractorIndex
+{
+    if (_distractorIndex == nil)
+    {
+        _distractorIndex = [[GeniusDistractorIndex alloc] init];
+        _distractorIndexNeedsSync = YES;
+    }
+    if (_distractorIndexNeedsSync)
+    {
+        [_distractorIndex setPairs:_pairs];
+        _distractorIndexNeedsSync = NO;
+    }
+    return _distractorIndex;
+}
+
+//! Returns the deck statistics, first recounting retention from the review log if needed.
+- (GeniusAnalytics *) analytics
+{
+    if ([_analytics retentionIsStale])
+        [_analytics rebuildRetentionFromLog:_reviewLog pairs:_pairs];
+    return _analytics;
+}
+
+//! _scheduler getter.
+- (id <GeniusScheduler>) scheduler
+{
+    return _scheduler;
+}
+
+//! _scheduler setter.  Reschedules every association in the deck for the new algorithm.
+/*!
+    Due times are moved in one batch over packed columns, see GeniusRescheduleColumns(), and written back
+    without change notifications; the due index, snapshots, sort keys and table are refreshed once for the
+    whole deck instead.  The change is not undoable but marks the document as edited.  Passing nil
+    restores the classic scheduler.
+*/
+- (void) setScheduler:(id <GeniusScheduler>)scheduler
+{
+    if (scheduler == nil)
+        scheduler = [GeniusScoreScheduler defaultScheduler];
+    if (scheduler == _scheduler)
+        return;
+
+    NSMutableArray * associations = [NSMutableArray arrayWithCapacity:[_pairs count] * 2];
+    NSEnumerator * pairEnumerator = [_pairs objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+    {
+        [associations addObject:[pair associationAB]];
+        [associations addObject:[pair associationBA]];
+    }
+
+    GeniusAssociationColumns * columns = [[GeniusAssociationColumns alloc] initWithAssociations:associations];
+    unsigned int changed = GeniusRescheduleColumns(columns, _scheduler, scheduler);
+    [columns release];
+
+    if (changed)
+    {
+        [_dueIndex removeAllAssociations];
+        [_dueIndex advanceToTime:GeniusTimeNow()];
+        NSEnumerator * associationEnumerator = [associations objectEnumerator];
+        GeniusAssociation * association;
+        while ((association = [associationEnumerator nextObject]))
+            [_dueIndex addAssociation:association];
+
+        [_deckStore setPairs:_pairs];
+        [arrayController associationsDidChange];
+        [_rowModel invalidateAllRows];
+        [tableView setNeedsDisplay:YES];
+        [self _updateStatusText];
+        [self _updateLevelIndicator];
+    }
+
+    [_scheduler release];
+    _scheduler = [scheduler retain];
+    [self updateChangeCount:NSChangeDone];
+}
+
 //! Dumps the GeniusDocument#_customTypeStringCache and rebuilds it from _pairs.
 - (void) _reloadCustomTypeCacheSet
 {
@@ -260,6 +594,47 @@ static NSArray *columnBindings;
 */
 @implementation GeniusDocument(VeryPrivate)
 
+//! Adds @a pair to _pairsByID, giving it a new GeniusPair#pairID if another pair already has its identifier.
+- (void) _registerPairID:(GeniusPair *)pair
+{
+    NSNumber * key = [NSNumber numberWithUnsignedLongLong:[pair pairID]];
+    GeniusPair * existingPair = [_pairsByID objectForKey:key];
+    while (existingPair && existingPair != pair)
+    {
+        [pair assignNewPairID];
+        key = [NSNumber numberWithUnsignedLongLong:[pair pairID]];
+        existingPair = [_pairsByID objectForKey:key];
+    }
+    [_pairsByID setObject:pair forKey:key];
+}
+
+//! Moves @a pairs in front of @a targetPair, or to the end of the deck if @a targetPair is nil.
+/*! One pass over _pairs finds the current indexes of @a pairs and the destination among the remaining pairs. */
+- (void) _movePairs:(NSArray *)pairs beforePair:(GeniusPair *)targetPair
+{
+    NSSet * movingPairs = [NSSet setWithArray:pairs];
+    NSMutableIndexSet * fromIndexes = [NSMutableIndexSet indexSet];
+    unsigned int i, count = [_pairs count];
+    unsigned int remainingCount = 0, destination = NSNotFound;
+    for (i=0; i<count; i++)
+    {
+        GeniusPair * pair = [_pairs objectAtIndex:i];
+        if ([movingPairs containsObject:pair])
+            [fromIndexes addIndex:i];
+        else
+        {
+            if (pair == targetPair)
+                destination = remainingCount;
+            remainingCount++;
+        }
+    }
+    if (destination == NSNotFound)
+        destination = remainingCount;
+
+    NSIndexSet * toIndexes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(destination, [fromIndexes count])];
+    [self movePairsAtIndexes:fromIndexes toIndexes:toIndexes];
+}
+
 //! Convenience method to check which GeniusPair GeniusAssociation scores are Displayed.
 /*!
     Hiding a score column excludes its related GeniusAssociation from the quiz.
@@ -308,14 +683,23 @@ static NSArray *columnBindings;
         }
     }
     
+    if (_isSaving)
+    {
+        NSString * format = NSLocalizedString(@"Saving %d%%", nil);
+        NSString * saving = [NSString stringWithFormat:format, (int)(_saveProgress * 100.0F)];
+        status = (status ? [NSString stringWithFormat:@"%@ - %@", status, saving] : saving);
+    }
+
     [statusField setObjectValue:status];
 }
 
 //! Updates the progress bar at lower right of Genius window to reflect current success with a Genius Document.
+/*! Reads the counts from #_analytics instead of walking every association. */
 - (void) _updateLevelIndicator
 {	
-	NSArray * associations = [self _enabledAssociationsForPairs:_pairs];
-	int associationCount = [associations count];
+    BOOL useAB = !([tableView columnWithIdentifier:@"scoreAB"] < 0);
+    BOOL useBA = !([tableView columnWithIdentifier:@"scoreBA"] < 0);
+	unsigned int associationCount = [_analytics associationCountUseAB:useAB useBA:useBA];
 
 	if (associationCount == 0)
 	{
@@ -324,18 +708,69 @@ static NSArray *columnBindings;
 		return;
 	}
 
-	int learnedAssociationCount = 0;
-	NSEnumerator * associationEnumerator = [associations objectEnumerator];
-	GeniusAssociation * association;
-	while ((association = [associationEnumerator nextObject]))
-		if ([association scoreNumber] != nil)
-			learnedAssociationCount++;
+	unsigned int learnedAssociationCount = [_analytics learnedCountUseAB:useAB useBA:useBA];
 	
 	float percentLearned = (float)learnedAssociationCount/(float)associationCount;
 	[levelIndicator setDoubleValue:(percentLearned * 100.0)];
 	[levelField setDoubleValue:(percentLearned * 100.0)];
 }
 
+//! Replaces the table's arrangedObjects bindings with #_rowModel.
+/*!
+    Every column binding observing @c arrangedObjects is moved into the row model and unbound, and the
+    table gets its values through the NSTableDataSource methods instead.  Selection and sort order are
+    copied between the table and #arrayController by hand from then on.
+*/
+- (void) _installRowModel
+{
+    NSArray * bindings = [NSArray arrayWithObjects:@"value", @"textColor", @"fontBold", nil];
+    NSEnumerator * columnEnumerator = [[tableView allTableColumns] objectEnumerator];
+    NSTableColumn * column;
+    while ((column = [columnEnumerator nextObject]))
+    {
+        NSEnumerator * bindingEnumerator = [bindings objectEnumerator];
+        NSString * binding;
+        while ((binding = [bindingEnumerator nextObject]))
+        {
+            NSDictionary * info = [column infoForBinding:binding];
+            NSString * keyPath = [info objectForKey:NSObservedKeyPathKey];
+            if ([keyPath hasPrefix:@"arrangedObjects."] == NO)
+                continue;
+
+            keyPath = [keyPath substringFromIndex:[@"arrangedObjects." length]];
+            NSString * transformerName = [[info objectForKey:NSOptionsKey] objectForKey:NSValueTransformerNameBindingOption];
+            if ([transformerName isKindOfClass:[NSString class]] == NO)
+                transformerName = nil;
+            [_rowModel setKeyPath:keyPath transformerName:transformerName forBinding:binding column:[column identifier]];
+
+            if ([binding isEqualToString:@"value"])
+                [column setSortDescriptorPrototype:[[[NSSortDescriptor alloc] initWithKey:keyPath ascending:YES] autorelease]];
+            [column unbind:binding];
+        }
+    }
+    [tableView unbind:NSContentBinding];
+    [tableView unbind:NSSelectionIndexesBinding];
+    [tableView unbind:NSSortDescriptorsBinding];
+
+    [_rowModel setArrangedObjects:[arrayController arrangedObjects]];
+    [tableView setDataSource:self];
+    [tableView reloadData];
+    [tableView selectRowIndexes:[arrayController selectionIndexes] byExtendingSelection:NO];
+
+    [arrayController addObserver:self forKeyPath:@"arrangedObjects" options:0 context:NULL];
+    [arrayController addObserver:self forKeyPath:@"selectionIndexes" options:0 context:NULL];
+
+    NSClipView * clipView = [[tableView enclosingScrollView] contentView];
+    [clipView setPostsBoundsChangedNotifications:YES];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_tableViewBoundsDidChange:) name:NSViewBoundsDidChangeNotification object:clipView];
+}
+
+//! Tells #_rowModel which rows are on screen after scrolling.
+- (void) _tableViewBoundsDidChange:(NSNotification *)notification
+{
+    [_rowModel setVisibleRange:[tableView rowsInRect:[tableView visibleRect]]];
+}
+
 @end
 
 //! Collection of methods loosely related to coordinating model and view changes.
@@ -368,10 +803,24 @@ static NSArray *columnBindings;
 //! Catches changes to many objects in the model graph and updates cached values as needed.
 - (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
 {
+    GeniusTraceCount(GeniusTraceCounterKVONotifications, 1);
     if ([keyPath isEqualToString:@"ListTextSizeMode"])
     {
         [self setListTextSizeMode:[[change objectForKey:NSKeyValueChangeNewKey] intValue]];
     }
+    else if (object == arrayController)
+    {
+        if ([keyPath isEqualToString:@"arrangedObjects"])
+        {
+            [_rowModel setArrangedObjects:[arrayController arrangedObjects]];
+            [tableView reloadData];
+        }
+
+        _isSyncingSelection = YES;
+        if ([[tableView selectedRowIndexes] isEqualToIndexSet:[arrayController selectionIndexes]] == NO)
+            [tableView selectRowIndexes:[arrayController selectionIndexes] byExtendingSelection:NO];
+        _isSyncingSelection = NO;
+    }
     else
     {
         NSUndoManager *undoManager = [self undoManager];
@@ -381,9 +830,28 @@ static NSArray *columnBindings;
         }
         
         [[undoManager prepareWithInvocationTarget:self] setValue:oldValue forKeyPath:keyPath inObject:object];
+        GeniusTraceCount(GeniusTraceCounterUndoRegistrations, 1);
+        _undoRegistrationCount++;
         
         if ([keyPath isEqualToString:@"customTypeString"])
+        {
             [self _reloadCustomTypeCacheSet];
+            [_analytics pair:object didChangeTypeFrom:oldValue];
+        }
+        else if ([keyPath isEqualToString:@"customGroupString"])
+            [_analytics pair:object didChangeGroupFrom:oldValue];
+        else if ([keyPath isEqualToString:@"dueDate"])
+            [_dueIndex updateAssociation:object];
+        else if ([keyPath isEqualToString:@"scoreNumber"])
+            [_analytics association:object didChangeScoreFrom:(oldValue ? [oldValue intValue] : -1)];
+        else if ([keyPath isEqualToString:@"importance"])
+            [_analytics pair:object didChangeImportanceFrom:[oldValue intValue]];
+
+        [arrayController objectDidChange:object];
+        [_deckStore objectDidChange:object];
+        [_distractorIndex invalidateObject:object];
+        [_rowModel invalidateAllRows];
+        [tableView setNeedsDisplay:YES];
         
         [self _updateStatusText];
         [self _updateLevelIndicator];
@@ -397,31 +865,55 @@ static NSArray *columnBindings;
 /*! GeniusDocument(NSTableDataSource) */
 @implementation GeniusDocument(NSTableDataSource)
 
-//! Copy paste support, writes out selected items to @a pboard as tab delimited text.
+//! Number of arranged pairs.
+- (int)numberOfRowsInTableView:(NSTableView *)aTableView
+{
+    return [_rowModel count];
+}
+
+//! Cached value of the column's former @c value binding.
+- (id)tableView:(NSTableView *)aTableView objectValueForTableColumn:(NSTableColumn *)aTableColumn row:(int)rowIndex
+{
+    return [_rowModel valueForBinding:@"value" column:[aTableColumn identifier] row:rowIndex];
+}
+
+//! Writes an edited cell back to the pair, undoing the column's transformer.  Undo is registered by the usual change observation.
+- (void)tableView:(NSTableView *)aTableView setObjectValue:(id)anObject forTableColumn:(NSTableColumn *)aTableColumn row:(int)rowIndex
+{
+    [_rowModel setValue:anObject forBinding:@"value" column:[aTableColumn identifier] row:rowIndex];
+}
+
+//! Sorting by column header goes through the array controller, which rearranges the rows.
+- (void)tableView:(NSTableView *)aTableView sortDescriptorsDidChange:(NSArray *)oldDescriptors
+{
+    [arrayController setSortDescriptors:[aTableView sortDescriptors]];
+}
+
+//! Copy paste support, promises the dragged rows to @a pboard as tab delimited text.
+/*! The text is only generated if a receiver asks for it, see pasteboard:provideDataForType:. */
 - (BOOL)tableView:(NSTableView *)tableView writeRows:(NSArray *)rows toPasteboard:(NSPasteboard*)pboard
 {
-    [pboard declareTypes:[NSArray arrayWithObjects:NSTabularTextPboardType, nil] owner:self];
-    
     // Convert row numbers to items
-    _pairsDuringDrag = [NSMutableArray array];
+    NSArray * arrangedObjects = [arrayController arrangedObjects];
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:[rows count]];
     NSEnumerator * rowNumberEnumerator = [rows objectEnumerator];
     NSNumber * rowNumber;
     while ((rowNumber = [rowNumberEnumerator nextObject]))
-    {
-        GeniusItem * item = [[arrayController arrangedObjects] objectAtIndex:[rowNumber intValue]];
-        [(NSMutableArray *)_pairsDuringDrag addObject:item];
-    }    
+        [pairs addObject:[arrangedObjects objectAtIndex:[rowNumber intValue]]];
 
-    NSString * outputString = [GeniusPair tabularTextFromPairs:_pairsDuringDrag order:[GeniusDocument columnBindings]];
-    [pboard setString:outputString forType:NSTabularTextPboardType];
-    [pboard setString:outputString forType:NSStringPboardType];
-    
+    [_pairsDuringDrag release];
+    _pairsDuringDrag = [pairs retain];
+
+    [self _promisePairs:pairs onPasteboard:pboard];
     return YES;
 }
 
 //! Validates drop target. 
 - (NSDragOperation)tableView:(NSTableView *)aTableView validateDrop:(id <NSDraggingInfo>)info proposedRow:(int)row proposedDropOperation:(NSTableViewDropOperation)operation
 {
+    if ([self isLibraryDeck])                   // cards come from the library, in library order
+        return NSDragOperationNone;
+
     if ([info draggingSource] == aTableView)    // intra-document
     {
         if (operation == NSTableViewDropOn)
@@ -439,17 +931,24 @@ static NSArray *columnBindings;
 /*! Unpacks GeniusItem instances from the paste board.  Expects tablular text.  */
 - (BOOL)tableView:(NSTableView *)aTableView acceptDrop:(id <NSDraggingInfo>)info row:(int)row dropOperation:(NSTableViewDropOperation)operation
 {
+    if ([self isLibraryDeck])
+        return NO;
+
     if ([info draggingSource] == aTableView)      // intra-document
     {
-        NSArray * copyOfItemsDuringDrag = [[NSArray alloc] initWithArray:_pairsDuringDrag copyItems:YES];
-    
-        NSIndexSet * indexes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(row, [copyOfItemsDuringDrag count])];
-        [arrayController insertObjects:copyOfItemsDuringDrag atArrangedObjectIndexes:indexes];
-        
-        if ([info draggingSource] == aTableView)
-            [arrayController removeObjects:_pairsDuringDrag];
-        
-        [copyOfItemsDuringDrag release];
+        // Drop in front of the first arranged pair at or after row that isn't being dragged.
+        NSArray * arrangedObjects = [arrayController arrangedObjects];
+        NSSet * draggedPairs = [NSSet setWithArray:_pairsDuringDrag];
+        GeniusPair * targetPair = nil;
+        unsigned int i;
+        for (i=row; i<[arrangedObjects count] && targetPair == nil; i++)
+            if ([draggedPairs containsObject:[arrangedObjects objectAtIndex:i]] == NO)
+                targetPair = [arrangedObjects objectAtIndex:i];
+
+        [self _movePairs:_pairsDuringDrag beforePair:targetPair];
+        [arrayController setSelectedObjects:_pairsDuringDrag];
+
+        [_pairsDuringDrag release];
         _pairsDuringDrag = nil;
     }
     else                                        // inter-document, inter-application
@@ -459,14 +958,152 @@ static NSArray *columnBindings;
         if (string == nil)
             return NO;
 
-        string = [string stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+        [self _importTabularText:string];
+    }
+        
+    return YES;
+}
+
+@end
+
+
+/*!
+    @category GeniusDocument(Pasteboard)
+    @abstract Lazily generated pasteboard text and incremental paste.
+*/
+@implementation GeniusDocument(Pasteboard)
+
+//! Declares tabular and plain text for @a pairs on @a pboard without generating it yet.
+/*!
+    Only a GeniusDeckSnapshot of the pairs is kept, so edits made after the copy don't change what is
+    pasted.  The text is produced by pasteboard:provideDataForType: once a receiver asks for it, so a
+    drag that is never dropped outside the table costs nothing.
+ */
+- (void) _promisePairs:(NSArray *)pairs onPasteboard:(NSPasteboard *)pboard
+{
+    GeniusDeckStore * store = [[GeniusDeckStore alloc] initWithPairs:pairs];
+    GeniusDeckSnapshot * snapshot = [store snapshot];
+    [store release];
+
+    [pboard declareTypes:[NSArray arrayWithObjects:NSTabularTextPboardType, NSStringPboardType, nil] owner:self];
+    [_promisedPairs setObject:snapshot forKey:[pboard name]];
+}
 
-        NSArray * pairs = [GeniusPair pairsFromTabularText:string order:[GeniusDocument columnBindings]];
+//! Tab delimited text of the pairs in @a snapshot, as they were when they were promised.
+- (NSString *) _stringFromPromisedSnapshot:(GeniusDeckSnapshot *)snapshot
+{
+    unsigned int count = [snapshot count];
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:count];
+    unsigned int i;
+    for (i = 0; i < count; i++)
+    {
+        GeniusPair * pair = [snapshot newPairAtIndex:i];
+        [pairs addObject:pair];
+        [pair release];
+    }
+    return [GeniusTabularEncoder stringFromPairs:pairs keyPaths:[GeniusDocument columnBindings]];
+}
+
+//! NSPasteboard callback, encodes the promised pairs once a receiver asks for @a type.
+- (void)pasteboard:(NSPasteboard *)pboard provideDataForType:(NSString *)type
+{
+    NSString * string = [self _stringFromPromisedSnapshot:[_promisedPairs objectForKey:[pboard name]]];
+    [pboard setString:string forType:type];
+}
+
+//! NSPasteboard callback, forgets the pairs promised to @a pboard.
+- (void)pasteboardChangedOwner:(NSPasteboard *)pboard
+{
+    [_promisedPairs removeObjectForKey:[pboard name]];
+}
+
+//! Writes out the text of all outstanding promises, since pasteboards don't retain their owner.
+- (void) _keepPromisedPairs
+{
+    NSEnumerator * nameEnumerator = [[_promisedPairs allKeys] objectEnumerator];
+    NSString * name;
+    while ((name = [nameEnumerator nextObject]))
+    {
+        NSPasteboard * pboard = [NSPasteboard pasteboardWithName:name];
+        NSString * string = [self _stringFromPromisedSnapshot:[_promisedPairs objectForKey:name]];
+        [pboard declareTypes:[NSArray arrayWithObjects:NSTabularTextPboardType, NSStringPboardType, nil] owner:nil];
+        [pboard setString:string forType:NSTabularTextPboardType];
+        [pboard setString:string forType:NSStringPboardType];
+    }
+    [_promisedPairs removeAllObjects];
+}
+
+//! Adds the pairs in tab delimited @a string to the deck, decoding a slice per run loop pass.
+/*! Keeps the window responsive for large pastes.  The pairs are added in one step once all are decoded. */
+- (void) _importTabularText:(NSString *)string
+{
+    GeniusTabularDecoder * decoder = [[[GeniusTabularDecoder alloc] initWithString:string keyPaths:[GeniusDocument columnBindings]] autorelease];
+    [self _continueImportWithDecoder:decoder];
+}
+
+//! Decodes for about 50 ms, then either finishes the import or schedules itself again.
+- (void) _continueImportWithDecoder:(GeniusTabularDecoder *)decoder
+{
+    NSDate * deadline = [NSDate dateWithTimeIntervalSinceNow:0.05];
+    while ([decoder isAtEnd] == NO && [deadline timeIntervalSinceNow] > 0.0)
+        [decoder decodePairsWithLimit:1000];
+
+    if ([decoder isAtEnd] == NO)
+    {
+        [self performSelector:@selector(_continueImportWithDecoder:) withObject:decoder afterDelay:0.0];
+        return;
+    }
+
+    NSArray * pairs = [decoder pairs];
+    if ([pairs count] > 0)
+        [self _addImportedPairs:pairs];
+}
+
+//! Adds imported @a pairs, offering to merge them into existing items when some are already in the deck.
+- (void) _addImportedPairs:(NSArray *)pairs
+{
+    GeniusPairMerger * merger = [[GeniusPairMerger alloc] initWithPairs:_pairs];
+    [merger planMergeOfPairs:pairs];
+    unsigned int matchedCount = [merger updatedCount] + [merger unchangedCount];
+    if (matchedCount == 0)
+    {
         [arrayController setFilterString:@""];
         [arrayController addObjects:pairs];
+        [merger release];
+        return;
     }
-        
-    return YES;
+
+    NSString * title = [NSString stringWithFormat:NSLocalizedString(@"%u of the %u items are already in this deck.", nil), matchedCount, [pairs count]];
+    NSString * message = NSLocalizedString(@"Merging updates %u items, leaves %u unchanged and adds %u new items. Scores of existing items are kept.", nil);
+    NSString * mergeTitle = NSLocalizedString(@"Merge", nil);
+    NSString * addAllTitle = NSLocalizedString(@"Add All", nil);
+    NSString * cancelTitle = NSLocalizedString(@"Cancel", nil);
+
+    NSAlert * alert = [NSAlert alertWithMessageText:title defaultButton:mergeTitle alternateButton:addAllTitle otherButton:cancelTitle
+        informativeTextWithFormat:message, [merger updatedCount], [merger unchangedCount], [merger insertedCount]];
+    NSArray * context = [[NSArray alloc] initWithObjects:merger, pairs, nil];
+    [merger release];
+    [alert beginSheetModalForWindow:[self windowForSheet] modalDelegate:self didEndSelector:@selector(_mergeAlertDidEnd:returnCode:contextInfo:) contextInfo:context];
+}
+
+//! Handles the choice made in the sheet shown by _addImportedPairs:.
+- (void)_mergeAlertDidEnd:(NSAlert *)alert returnCode:(int)returnCode contextInfo:(void *)contextInfo
+{
+    NSArray * context = (NSArray *)contextInfo;
+    GeniusPairMerger * merger = [context objectAtIndex:0];
+
+    NSArray * insertedPairs = nil;
+    if (returnCode == NSAlertDefaultReturn)
+        insertedPairs = [merger applyToDocumentPairs];
+    else if (returnCode == NSAlertAlternateReturn)
+        insertedPairs = [context objectAtIndex:1];
+
+    if (insertedPairs)
+    {
+        [arrayController setFilterString:@""];
+        [arrayController addObjects:insertedPairs];
+    }
+    [context release];
 }
 
 @end
@@ -532,6 +1169,9 @@ static NSArray *columnBindings;
 //! FirstResponder wrapper for arrayController insert:.
 - (IBAction) add:(id)sender
 {
+    if ([self isLibraryDeck])
+        return;
+
     // In case user is typing in table view.
     [[tableView window] endEditingFor:nil]; 
 
@@ -553,6 +1193,9 @@ static NSArray *columnBindings;
 //! FirstResponder wrapper for arrayController remove:.
 - (IBAction) delete:(id)sender
 {
+    if ([self isLibraryDeck])
+        return;
+
     // In case user is typing in table view.
     [[tableView window] endEditingFor:nil]; 
 
@@ -571,6 +1214,9 @@ static NSArray *columnBindings;
 //! Duplicates the selected items and inserts them in the document.
 - (IBAction) duplicate:(id)sender
 {
+    if ([self isLibraryDeck])
+        return;
+
     NSArray * selectedObjects = [arrayController selectedObjects];
     
     NSIndexSet * selectionIndexes = [arrayController selectionIndexes];
@@ -582,6 +1228,174 @@ static NSArray *columnBindings;
     [newObjects release];
 }
 
+//! Asks for an image or sound file and attaches it to the question of the selected items.
+/*!
+    The file is copied into #_mediaStore, so the deck keeps working when the original is moved or deleted
+    and attaching the same file to many items stores it once.
+*/
+- (IBAction) attachMedia:(id)sender
+{
+    if ([self isLibraryDeck] || [[arrayController selectedObjects] count] == 0)
+        return;
+
+    NSMutableArray * fileTypes = [NSMutableArray arrayWithArray:[NSImage imageFileTypes]];
+    [fileTypes addObjectsFromArray:[NSSound soundUnfilteredFileTypes]];
+
+    NSOpenPanel * openPanel = [NSOpenPanel openPanel];
+    [openPanel beginSheetForDirectory:nil file:nil types:fileTypes modalForWindow:[self windowForSheet] modalDelegate:self didEndSelector:@selector(_attachPanelDidEnd:returnCode:contextInfo:) contextInfo:[[arrayController selectedObjects] retain]];
+}
+
+//! Stores the file chosen in #attachMedia: and points the selected items at it.
+- (void)_attachPanelDidEnd:(NSOpenPanel *)openPanel returnCode:(int)returnCode contextInfo:(void *)contextInfo
+{
+    NSArray * selectedObjects = [(NSArray *)contextInfo autorelease];
+    if (returnCode != NSOKButton)
+        return;
+
+    NSString * path = [openPanel filename];
+    NSURL * url = [_mediaStore addContentsOfFile:path];
+    if (url == nil)
+    {
+        NSBeep();
+        return;
+    }
+
+    BOOL isImage = [[NSImage imageFileTypes] containsObject:[path pathExtension]] || [[NSImage imageFileTypes] containsObject:NSHFSTypeOfFile(path)];
+    NSString * key = (isImage ? @"imageURL" : @"soundURL");
+    NSEnumerator * pairEnumerator = [selectedObjects objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+        [[pair itemA] setValue:url forKey:key];
+    [[self undoManager] setActionName:@"Attach Media"];
+}
+
+//! Brings the pairs in line with @a cards from a GeniusSyncClient, adding, changing and removing pairs.
+- (void) _applySyncedCards:(NSArray *)cards
+{
+    NSMutableArray * insertedPairs = [NSMutableArray array];
+    NSMutableArray * removedPairs = [NSMutableArray array];
+    NSEnumerator * cardEnumerator = [cards objectEnumerator];
+    NSDictionary * card;
+    while ((card = [cardEnumerator nextObject]))
+    {
+        GeniusPairID pairID = [[card objectForKey:@"id"] unsignedLongLongValue];
+        GeniusPair * pair = [self pairWithID:pairID];
+        if (GeniusSyncCardIsDeleted(card))
+        {
+            if (pair)
+                [removedPairs addObject:pair];
+        }
+        else if (pair)
+            GeniusSyncApplyCardToPair(card, pair);
+        else if ([card objectForKey:@"c"])
+        {
+            GeniusItem * itemA = [[[GeniusItem alloc] init] autorelease];
+            GeniusItem * itemB = [[[GeniusItem alloc] init] autorelease];
+            pair = [[[GeniusPair alloc] initWithItemA:itemA itemB:itemB userDict:[NSMutableDictionary dictionary] pairID:pairID] autorelease];
+            GeniusSyncApplyCardToPair(card, pair);
+            [insertedPairs addObject:pair];
+        }
+    }
+
+    if ([removedPairs count])
+        [arrayController removeObjects:removedPairs];
+    if ([insertedPairs count])
+        [arrayController addObjects:insertedPairs];
+    if ([cards count])
+        [[self undoManager] setActionName:@"Sync"];
+}
+
+//! Exchanges changed cards with the shared copy at _syncPath, applies what came back and saves.
+- (void) _syncWithSharedCopy
+{
+    GeniusSyncClient * client = [[GeniusSyncClient alloc] initWithReplicaID:GeniusSyncReplicaID() statePath:[GeniusSyncClient statePathForDocumentPath:[self fileName]]];
+    GeniusSyncFileTransport * transport = [[GeniusSyncFileTransport alloc] initWithPath:_syncPath];
+    uint64_t spanStart = GeniusTraceSpanBegin();
+    NSArray * cards = [client syncSnapshot:[self snapshot] transport:transport];
+    GeniusTraceSpanEnd("sync", spanStart);
+    [transport release];
+    [client release];
+
+    if (cards == nil)
+    {
+        NSString * title = NSLocalizedString(@"The shared copy of this deck could not be reached.", nil);
+        NSString * message = NSLocalizedString(@"Make sure %@ is available and try again.", nil);
+        NSAlert * alert = [NSAlert alertWithMessageText:title defaultButton:NSLocalizedString(@"OK", nil) alternateButton:nil otherButton:nil informativeTextWithFormat:message, _syncPath];
+        [alert beginSheetModalForWindow:[self windowForSheet] modalDelegate:nil didEndSelector:NULL contextInfo:NULL];
+        return;
+    }
+
+    [self _applySyncedCards:cards];
+
+    // The sync state now matches the deck as synced, so the deck on disk must too.
+    [self saveDocument:self];
+}
+
+//! Syncs the deck with its shared copy, asking for a folder to keep the shared copy in the first time.
+/*!
+    The shared copy is a GeniusSyncServer state file; every machine that keeps this deck in the same
+    folder syncs with the others through it.  Only changed cards travel, and cards edited or studied on
+    several machines are merged rather than overwritten, see GeniusSyncServer.
+*/
+- (IBAction) syncDeck:(id)sender
+{
+    if ([self isLibraryDeck])
+        return;
+    [[tableView window] endEditingFor:nil];
+
+    if ([self fileName] == nil)
+    {
+        NSString * title = NSLocalizedString(@"Save this deck before syncing it.", nil);
+        NSString * message = NSLocalizedString(@"The sync state is kept next to the deck file.", nil);
+        NSAlert * alert = [NSAlert alertWithMessageText:title defaultButton:NSLocalizedString(@"OK", nil) alternateButton:nil otherButton:nil informativeTextWithFormat:message];
+        [alert beginSheetModalForWindow:[self windowForSheet] modalDelegate:nil didEndSelector:NULL contextInfo:NULL];
+        return;
+    }
+
+    if (_syncPath == nil)
+    {
+        NSOpenPanel * openPanel = [NSOpenPanel openPanel];
+        [openPanel setCanChooseFiles:NO];
+        [openPanel setCanChooseDirectories:YES];
+        [openPanel setCanCreateDirectories:YES];
+        [openPanel setPrompt:NSLocalizedString(@"Choose", nil)];
+        [openPanel setMessage:NSLocalizedString(@"Choose a folder all your computers can reach to keep the shared copy of this deck in.", nil)];
+        [openPanel beginSheetForDirectory:nil file:nil types:nil modalForWindow:[self windowForSheet] modalDelegate:self didEndSelector:@selector(_syncPanelDidEnd:returnCode:contextInfo:) contextInfo:NULL];
+        return;
+    }
+
+    [self _syncWithSharedCopy];
+}
+
+//! Remembers the folder chosen in #syncDeck: and syncs.
+- (void)_syncPanelDidEnd:(NSOpenPanel *)openPanel returnCode:(int)returnCode contextInfo:(void *)contextInfo
+{
+    if (returnCode != NSOKButton)
+        return;
+
+    NSString * name = [[[[self fileName] lastPathComponent] stringByDeletingPathExtension] stringByAppendingPathExtension:@"geniusshared"];
+    [_syncPath release];
+    _syncPath = [[[openPanel filename] stringByAppendingPathComponent:name] copy];
+    [self _syncWithSharedCopy];
+}
+
+//! Puts the selected items on the general pasteboard as tab delimited text.
+- (IBAction) copy:(id)sender
+{
+    [self _promisePairs:[arrayController selectedObjects] onPasteboard:[NSPasteboard generalPasteboard]];
+}
+
+//! Adds the items in the tab delimited text on the general pasteboard to the document.
+- (IBAction) paste:(id)sender
+{
+    if ([self isLibraryDeck])
+        return;
+
+    NSString * string = [[NSPasteboard generalPasteboard] stringForType:NSStringPboardType];
+    if (string)
+        [self _importTabularText:string];
+}
+
 //! Initiates modal sheet to check if the user really wants to reset selected items.
 - (IBAction)resetScore:(id)sender
 {
@@ -658,6 +1472,9 @@ static NSArray *columnBindings;
         [undoManager beginUndoGrouping];
     }
 
+    [enumerator setScheduler:_scheduler];
+    [enumerator setReviewLog:_reviewLog];
+    [enumerator setAnalytics:[self analytics]];
     [enumerator performChooseAssociations];    // Pre-perform for progress indication
 
     if ([enumerator remainingCount] == 0)
@@ -674,6 +1491,8 @@ static NSArray *columnBindings;
     }
     else {
         MyQuizController *quizController = [[MyQuizController alloc] init];
+        if ([[NSUserDefaults standardUserDefaults] boolForKey:GeniusPreferencesQuizMultipleChoiceKey])
+            [quizController setDistractorIndex:[self distractorIndex]];
         [quizController runQuiz:enumerator];
         [quizController release];
     }
@@ -804,6 +1623,9 @@ static NSArray *columnBindings;
     }
     
 
+    if (action == @selector(syncDeck:))
+        return ([self isLibraryDeck] == NO);
+
 	if (action == @selector(quizAutoPick:) || action == @selector(quizReview:))
 	{
 		if ([[arrayController arrangedObjects] count] == 0)
@@ -813,8 +1635,8 @@ static NSArray *columnBindings;
 	NSArray * selectedObjects = [arrayController selectedObjects];
 	int selectedCount = [selectedObjects count];
 
-	if (action == @selector(duplicate:) || action == @selector(resetScore:) || action == @selector(setItemImportance:)
-		|| action == @selector(quizSelection:))
+	if (action == @selector(duplicate:) || action == @selector(resetScore:) || action == @selector(attachMedia:) || action == @selector(setItemImportance:)
+		|| action == @selector(quizSelection:) || action == @selector(copy:))
 	{
 		if (selectedCount == 0)
 			return NO;
@@ -839,6 +1661,13 @@ static NSArray *columnBindings;
         return YES;
     }
     
+    if ([self isLibraryDeck] && (action == @selector(add:) || action == @selector(delete:)
+            || action == @selector(duplicate:) || action == @selector(paste:) || action == @selector(attachMedia:)))
+        return NO;
+
+    if (action == @selector(paste:))
+        return ([[NSPasteboard generalPasteboard] availableTypeFromArray:[NSArray arrayWithObject:NSStringPboardType]] != nil);
+    
     return [super validateMenuItem:(id)menuItem];
 }
 
@@ -847,32 +1676,42 @@ static NSArray *columnBindings;
 
 @implementation GeniusDocument(NSTableViewDelegate)
 
+//! Card text of a library deck is read only.  Importance and scores remain editable.
+- (BOOL)tableView:(NSTableView *)aTableView shouldEditTableColumn:(NSTableColumn *)aTableColumn row:(int)rowIndex
+{
+    if ([self isLibraryDeck] == NO)
+        return YES;
+    NSString * identifier = [aTableColumn identifier];
+    return ([identifier isEqualToString:@"disabled"] || [identifier isEqualToString:@"scoreAB"] || [identifier isEqualToString:@"scoreBA"]);
+}
+
+//! Applies the status glyph, text color and weight of the row from #_rowModel instead of asking the pair.
 - (void)tableView:(NSTableView *)aTableView willDisplayCell:(id)aCell forTableColumn:(NSTableColumn *)aTableColumn row:(int)rowIndex
 {
     NSString * identifier = [aTableColumn identifier];
     if ([identifier isEqualToString:@"scoreAB"] || [identifier isEqualToString:@"scoreBA"])
-    {
-        GeniusPair * pair = [[arrayController arrangedObjects] objectAtIndex:rowIndex];
-    
-        int score;
-        if ([identifier isEqualToString:@"scoreAB"])
-            score = [[pair associationAB] score];
-        else
-            score = [[pair associationBA] score];
+        [aCell setImage:statusImages[[_rowModel statusTierForColumn:identifier row:rowIndex]]];
 
-        NSImage * image = nil;
-        if (score == -1)
-            image = [NSImage imageNamed:@"status-red"];
-        else if (score < 5)
-            image = [NSImage imageNamed:@"status-yellow"];
-        else
-            image = [NSImage imageNamed:@"status-green"];
-        [aCell setImage:image];
+    NSColor * textColor = [_rowModel valueForBinding:@"textColor" column:identifier row:rowIndex];
+    if (textColor && [aCell respondsToSelector:@selector(setTextColor:)])
+        [aCell setTextColor:textColor];
+
+    NSNumber * fontBold = [_rowModel valueForBinding:@"fontBold" column:identifier row:rowIndex];
+    if (fontBold)
+    {
+        NSFontTraitMask trait = ([fontBold boolValue] ? NSBoldFontMask : NSUnboldFontMask);
+        [aCell setFont:[[NSFontManager sharedFontManager] convertFont:[aCell font] toHaveTrait:trait]];
     }
 }
 
 - (void)tableViewSelectionDidChange:(NSNotification *)aNotification
 {
+    if (_isSyncingSelection == NO)
+    {
+        _isSyncingSelection = YES;
+        [arrayController setSelectionIndexes:[tableView selectedRowIndexes]];
+        _isSyncingSelection = NO;
+    }
     [self _updateStatusText];
     [[infoDrawer contentView] setNeedsDisplay:YES];
 }
@@ -886,13 +1725,19 @@ static NSArray *columnBindings;
 - (id)initWithCoder:(NSCoder *)decoder
 {
     self = [super initWithCoder:decoder];
+    if (self != nil) {
+        _sortEngine = [[GeniusSortEngine alloc] init];
+    }
     return self;
 }
 
-//! Releases _filterString and frees memory.
+//! Releases _filterString, _sortEngine, _fuzzyIndex and _pairColumns and frees memory.
 - (void) dealloc
 {
     [_filterString release];
+    [_sortEngine release];
+    [_fuzzyIndex release];
+    [_pairColumns release];
     [super dealloc];
 }
 
@@ -912,28 +1757,192 @@ static NSArray *columnBindings;
     [self rearrangeObjects];
 }
 
+//! Drops the cached sort keys of @a object, a GeniusPair or one of its associations or items.
+/*! Called by GeniusDocument whenever it observes an edit, so the next sort sees the new value. */
+- (void) objectDidChange:(id)object
+{
+    [_sortEngine invalidateObject:object];
+    [_fuzzyIndex invalidateObject:object];
+    [_pairColumns invalidateObject:object];
+}
+
+//! Called by GeniusDocument after the scores or due times of many associations changed without notifications.
+/*! Drops every sort key and #_pairColumns.  The text in #_fuzzyIndex is unaffected. */
+- (void) associationsDidChange
+{
+    [_sortEngine invalidateAllObjects];
+    [_pairColumns release];
+    _pairColumns = nil;
+}
+
+//! Called by GeniusDocument when pairs are added or removed, so #_fuzzyIndex catches up before its next search.
+- (void) pairsDidChange
+{
+    _fuzzyIndexNeedsSync = YES;
+}
+
+//! _searchCacheLimit getter.
+- (unsigned int) searchCacheLimit
+{
+    return _searchCacheLimit;
+}
+
+//! _searchCacheLimit setter.  Also bounds the sort keys of _sortEngine.  Takes effect after the next sort, or once searching pauses.
+- (void) setSearchCacheLimit:(unsigned int)limit
+{
+    _searchCacheLimit = limit;
+    [_sortEngine setCacheLimit:limit];
+}
+
+//! Drops the sort keys, #_fuzzyIndex and #_pairColumns.  Each is rebuilt when next needed.
+- (void) discardSearchCaches
+{
+    [_sortEngine invalidateAllObjects];
+    [_fuzzyIndex release];
+    _fuzzyIndex = nil;
+    [_pairColumns release];
+    _pairColumns = nil;
+}
+
+//! Adds the sort keys, and #_fuzzyIndex with #_pairColumns, to @a report with #_searchCacheLimit as their budget.
+- (void) addToMemoryReport:(GeniusMemoryReport *)report
+{
+    [report addByteCount:[_sortEngine cachedByteCount] objectCount:[_sortEngine cachedKeyCount] toSubsystem:GeniusMemorySortKeysSubsystem];
+    [report setLimit:_searchCacheLimit forSubsystem:GeniusMemorySortKeysSubsystem];
+
+    unsigned long long byteCount = (_fuzzyIndex ? [_fuzzyIndex byteCount] : 0) + (_pairColumns ? [_pairColumns byteCount] : 0);
+    [report addByteCount:byteCount objectCount:[_fuzzyIndex wordCount] + [_pairColumns count] toSubsystem:GeniusMemorySearchIndexSubsystem];
+    [report setLimit:_searchCacheLimit forSubsystem:GeniusMemorySearchIndexSubsystem];
+}
+
+//! Drops #_fuzzyIndex and #_pairColumns if together they hold more than #_searchCacheLimit bytes.
+/*!
+    Runs once searching pauses for kGeniusSearchCacheIdleDelay seconds, see #_searchDidEnd, so a deck too
+    large for the budget keeps its index while the user types a query and gives the memory back afterwards.
+ */
+- (void) _enforceSearchCacheLimit
+{
+    unsigned long long byteCount = (_fuzzyIndex ? [_fuzzyIndex byteCount] : 0) + (_pairColumns ? [_pairColumns byteCount] : 0);
+    if (_searchCacheLimit == 0 || byteCount <= _searchCacheLimit)
+        return;
+
+    [_fuzzyIndex release];
+    _fuzzyIndex = nil;
+    [_pairColumns release];
+    _pairColumns = nil;
+}
+
+//! Puts off #_enforceSearchCacheLimit until no search ran for kGeniusSearchCacheIdleDelay seconds.
+- (void) _searchDidEnd
+{
+    if (_searchCacheLimit == 0)
+        return;
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(_enforceSearchCacheLimit) object:nil];
+    [self performSelector:@selector(_enforceSearchCacheLimit) withObject:nil afterDelay:kGeniusSearchCacheIdleDelay];
+}
+
+//! Text searched by fuzzy queries, in ranking order:  a hit in the question beats one in the notes.
++ (NSArray *) fuzzyKeyPaths
+{
+    static NSArray * fuzzyKeyPaths = nil;
+    if (fuzzyKeyPaths == nil)
+        fuzzyKeyPaths = [[NSArray alloc] initWithObjects:@"itemA.stringValue", @"itemB.stringValue", @"customGroupString", @"customTypeString", @"notesString", nil];
+    return fuzzyKeyPaths;
+}
+
+//! Returns #_fuzzyIndex brought up to date with @a objects.  Builds it on first use and keeps it afterwards.
+- (GeniusFuzzyIndex *) _fuzzyIndexForObjects:(NSArray *)objects
+{
+    if (_fuzzyIndex == nil)
+    {
+        _fuzzyIndex = [[GeniusFuzzyIndex alloc] initWithKeyPaths:[GeniusArrayController fuzzyKeyPaths]];
+        _fuzzyIndexNeedsSync = YES;
+    }
+    if (_fuzzyIndexNeedsSync)
+    {
+        [_fuzzyIndex setObjects:objects];
+        _fuzzyIndexNeedsSync = NO;
+    }
+    return _fuzzyIndex;
+}
+
+//! Pairs of @a objects matching @a query with typos allowed, best first.
+- (NSArray *) _fuzzyMatchesForQuery:(NSString *)query inArray:(NSArray *)objects
+{
+    NSArray * matches = [[self _fuzzyIndexForObjects:objects] objectsMatchingQuery:query inArray:objects limit:kGeniusFuzzySearchLimit];
+    [self _searchDidEnd];
+    return matches;
+}
+
+//! Pairs of @a objects matching the structured @a query, in the order of @a objects.
+/*! Numeric terms run over #_pairColumns, which is only rebuilt when the pairs themselves change. */
+- (NSArray *) _objectsMatchingQuery:(GeniusFilterQuery *)query inArray:(NSArray *)objects
+{
+    if (_pairColumns == nil)
+        _pairColumns = [[GeniusPairColumns alloc] init];
+    [_pairColumns setPairs:objects];
+    NSArray * matches = [query filteredPairsFromColumns:_pairColumns textIndex:[self _fuzzyIndexForObjects:objects]];
+    [self _searchDidEnd];
+    return matches;
+}
+
+//! Sorts @a objects by the current sort descriptors using _sortEngine.
+- (NSArray *) _sortObjects:(NSArray *)objects
+{
+    NSArray * sortDescriptors = [self sortDescriptors];
+    if ([sortDescriptors count] == 0)
+        return objects;
+    return [_sortEngine sortedArrayFromArray:objects usingDescriptors:sortDescriptors];
+}
+
 //! Returns a given array, appropriately sorted and filtered.
+/*!
+    Sorting goes through GeniusSortEngine rather than NSSortDescriptor, which reads every value through KVC on every comparison.
+    A filter string starting with @c ~ is a fuzzy search:  results tolerate typos and come ranked by closeness rather than sorted.
+    A filter string with field terms such as <tt>group:verbs scoreAB<3</tt> is a GeniusFilterQuery.
+*/
 - (NSArray *)arrangeObjects:(NSArray *)objects
 {
-    if ([_filterString length] > 0)
+    if ([_filterString hasPrefix:@"~"])
     {
-        NSArray * keyPaths = [GeniusDocument columnBindings];
-        NSMutableArray * filteredObjects = [NSMutableArray array];
-        NSEnumerator * pairEnumerator = [objects objectEnumerator];
-        GeniusPair * pair;
-        while ((pair = [pairEnumerator nextObject]))
+        NSString * query = [_filterString substringFromIndex:1];
+        if ([[query stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]] length] == 0)
+            return [self _sortObjects:objects];
+
+        uint64_t spanStart = GeniusTraceSpanBegin();
+        NSArray * matches = [self _fuzzyMatchesForQuery:query inArray:objects];
+        GeniusTraceSpanEnd("filter", spanStart);
+        return matches;
+    }
+    else if ([_filterString length] > 0)
+    {
+        uint64_t spanStart = GeniusTraceSpanBegin();
+        NSArray * filteredObjects;
+        GeniusFilterQuery * query = [GeniusFilterQuery queryWithString:_filterString time:GeniusTimeNow()];
+        if (query)
+            filteredObjects = [self _objectsMatchingQuery:query inArray:objects];
+        else
         {
-            //! @todo surely there is a better way to do this.  Perhaps use SearchKit?
-            NSString * tabularText = [pair tabularTextByOrder:keyPaths];
-            NSRange range = [tabularText rangeOfString:_filterString options:NSCaseInsensitiveSearch];
-            if (range.location != NSNotFound)
-                [filteredObjects addObject:pair];
+            NSArray * keyPaths = [GeniusDocument columnBindings];
+            NSMutableArray * matches = [NSMutableArray array];
+            NSEnumerator * pairEnumerator = [objects objectEnumerator];
+            GeniusPair * pair;
+            while ((pair = [pairEnumerator nextObject]))
+            {
+                //! @todo surely there is a better way to do this.  Perhaps use SearchKit?
+                NSString * tabularText = [pair tabularTextByOrder:keyPaths];
+                NSRange range = [tabularText rangeOfString:_filterString options:NSCaseInsensitiveSearch];
+                if (range.location != NSNotFound)
+                    [matches addObject:pair];
+            }
+            filteredObjects = matches;
         }
-        return [super arrangeObjects:filteredObjects];
+        GeniusTraceSpanEnd("filter", spanStart);
+        return [self _sortObjects:filteredObjects];
     }
     else
     {
-        return [super arrangeObjects:objects];
+        return [self _sortObjects:objects];
     }
 }
 
@@ -1006,6 +2015,11 @@ static NSArray *columnBindings;
 //! Removes self from notification center
 - (void)windowWillClose:(NSNotification *)aNotification
 {
+    [NSObject cancelPreviousPerformRequestsWithTarget:self];
+    [NSObject cancelPreviousPerformRequestsWithTarget:arrayController];
+    [self _keepPromisedPairs];
+    [arrayController removeObserver:self forKeyPath:@"arrangedObjects"];
+    [arrayController removeObserver:self forKeyPath:@"selectionIndexes"];
     [self removeObserver:self];
     [_pairs makeObjectsPerformSelector:@selector(removeObserver:) withObject:self];
 
@@ -24,8 +24,13 @@
 
 - (NSData *)dataRepresentationOfType:(NSString *)aType;
 - (BOOL)loadDataRepresentation:(NSData *)data ofType:(NSString *)aType;
+- (void)setFileName:(NSString *)fileName;
++ (NSArray *) pairsWithContentsOfFile:(NSString *)path scheduler:(id <GeniusScheduler> *)scheduler;
 
 - (IBAction)exportFile:(id)sender;
 + (IBAction)importFile:(id)sender;
 
+- (IBAction)exportLibrary:(id)sender;
++ (IBAction)newDeckFromLibrary:(id)sender;
+
 @end
@@ -20,7 +20,40 @@
 #import "GeniusPair.h"
 #import "GeniusAssociation.h"
 #import "GeniusDocument.h"
+#import "GeniusDocumentMemory.h"
 #import "GSTableView.h"
+#import "GeniusReviewLog.h"
+#import "GeniusMediaStore.h"
+#import "GeniusTextStore.h"
+#import "GeniusTrace.h"
+#import "GeniusAnalytics.h"
+#import "GeniusLibrary.h"
+#import "GeniusDeckSnapshot.h"
+#import "GeniusDeckSearchIndex.h"
+#import "GeniusAppDelegate.h"
+#include <fcntl.h>      // open
+#include <unistd.h>     // write, fsync, close, unlink
+#include <sys/stat.h>   // stat, fchmod
+#include <errno.h>
+#include <stdio.h>      // rename
+
+//! Methods of GeniusDocument.m used by background saving.
+@interface GeniusDocument (StatusText)
+- (void) _updateStatusText;
+@end
+
+@interface GeniusDocument (BackgroundSave)
+- (NSDictionary *) _archiveSettings;
++ (NSData *) _archivedDataWithPairs:(NSArray *)pairs settings:(NSDictionary *)settings;
+- (void) _saveInBackground:(NSMutableDictionary *)job;
+- (BOOL) _writeData:(NSData *)data atomicallyToFile:(NSString *)path;
+- (void) _reportSaveProgress:(float)progress;
+- (void) _setSaveProgress:(NSNumber *)progress;
+- (void) _backgroundSaveDidEnd:(NSDictionary *)job;
+- (GeniusDeckSearchIndex *) _deckSearchIndex;
+- (unsigned int) _applyDetachedReviews;
+- (void) _markDetachedReviewsApplied;
+@end
 
 //! Methods related to reading and writing genius files.
 /*!
@@ -34,39 +67,170 @@
 /*!
     Includes a formatVersion value of 1 to distinguish this file format from future and past
     versions.   Only saves files in version 1.5 format.  Making them incompatible with previous
-    versions of Genius.
+    versions of Genius.  Library decks save the path of their GeniusLibrary and a performance
+    overlay instead of the pairs.  Saves in place and autosaves don't come here, see
+    saveToURL:ofType:forSaveOperation:delegate:didSaveSelector:contextInfo:.
 */
 - (NSData *)dataRepresentationOfType:(NSString *)aType
 {
-    NSMutableData * data = [NSMutableData data];
-    NSKeyedArchiver * archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
+    uint64_t spanStart = GeniusTraceSpanBegin();
+    [_reviewLog flush];
+    NSData * data = [[self class] _archivedDataWithPairs:_pairs settings:[self _archiveSettings]];
+    GeniusTraceSpanEnd("save", spanStart);
+    return data;
+}
 
-    NSEvent * event = [NSApp currentEvent];
-    if (event && ([event modifierFlags] & NSAlternateKeyMask))
-        [archiver setOutputFormat:NSPropertyListXMLFormat_v1_0];
-    else
-		[archiver setOutputFormat:kCFPropertyListBinaryFormat_v1_0];
-    
-    [archiver encodeInt:1 forKey:@"formatVersion"];
-    [archiver encodeObject:[tableView visibleColumnIdentifiers] forKey:@"visibleColumnIdentifiers"];
-    [archiver encodeObject:_columnHeadersDict forKey:@"columnHeadersDict"];
-    [archiver encodeObject:_pairs forKey:@"pairs"];
-    [archiver encodeObject:_cumulativeStudyTime forKey:@"cumulativeStudyTime"];
-    [archiver encodeObject:probabilityCenter forKey:@"learnVsReviewNumber"];
-    [archiver finishEncoding];
-    [archiver release];
+//! Saves in place and autosaves from a GeniusDeckSnapshot on a background thread.
+/*!
+    The file is written next to its destination and renamed into place, so it is never seen half
+    written.  Changes made while the save runs leave the document edited.  Saves requested during
+    another save wait for it to finish.  Other save operations go through NSDocument as before.
+*/
+- (void)saveToURL:(NSURL *)absoluteURL ofType:(NSString *)typeName forSaveOperation:(NSSaveOperationType)saveOperation delegate:(id)delegate didSaveSelector:(SEL)didSaveSelector contextInfo:(void *)contextInfo
+{
+    NSString * path = [absoluteURL path];
+    BOOL isDirectory = NO;
+    if ((saveOperation != NSSaveOperation && saveOperation != NSAutosaveOperation) || [absoluteURL isFileURL] == NO
+            || [[NSFileManager defaultManager] fileExistsAtPath:[path stringByDeletingLastPathComponent] isDirectory:&isDirectory] == NO
+            || isDirectory == NO)
+    {
+        [super saveToURL:absoluteURL ofType:typeName forSaveOperation:saveOperation delegate:delegate didSaveSelector:didSaveSelector contextInfo:contextInfo];
+        return;
+    }
 
-    return data;
+    if (_isSaving)
+    {
+        NSMethodSignature * signature = [self methodSignatureForSelector:_cmd];
+        NSInvocation * invocation = [NSInvocation invocationWithMethodSignature:signature];
+        [invocation setTarget:self];
+        [invocation setSelector:_cmd];
+        [invocation setArgument:&absoluteURL atIndex:2];
+        [invocation setArgument:&typeName atIndex:3];
+        [invocation setArgument:&saveOperation atIndex:4];
+        [invocation setArgument:&delegate atIndex:5];
+        [invocation setArgument:&didSaveSelector atIndex:6];
+        [invocation setArgument:&contextInfo atIndex:7];
+        [invocation retainArguments];
+        [_pendingSaves addObject:invocation];
+        return;
+    }
+
+    [_reviewLog flush];
+
+    NSMutableDictionary * job = [NSMutableDictionary dictionary];
+    [job setObject:[self snapshot] forKey:@"snapshot"];
+    [job setObject:[self _archiveSettings] forKey:@"settings"];
+    [job setObject:path forKey:@"path"];
+    [job setObject:[NSNumber numberWithInt:saveOperation] forKey:@"saveOperation"];
+    [job setObject:[NSNumber numberWithUnsignedInt:_editGeneration] forKey:@"editGeneration"];
+    [job setValue:delegate forKey:@"delegate"];
+    if (didSaveSelector)
+        [job setObject:NSStringFromSelector(didSaveSelector) forKey:@"didSaveSelector"];
+    [job setObject:[NSValue valueWithPointer:contextInfo] forKey:@"contextInfo"];
+
+    _isSaving = YES;
+    [self _setSaveProgress:[NSNumber numberWithFloat:0.0F]];
+    [NSThread detachNewThreadSelector:@selector(_saveInBackground:) toTarget:self withObject:job];
+}
+
+//! Counts changes so that a background save knows whether it captured the latest one.
+- (void)updateChangeCount:(NSDocumentChangeType)change
+{
+    if (change == NSChangeDone || change == NSChangeUndone)
+        _editGeneration++;
+    [super updateChangeCount:change];
+}
+
+//! Keeps the review log and media store next to the deck when it is saved, saved under a new name, or opened.
+/*! Also lets the text store of a deck just opened read from the file instead of memory. */
+- (void)setFileName:(NSString *)fileName
+{
+    BOOL isOpening = ([self fileName] == nil);
+    [super setFileName:fileName];
+    if (fileName == nil)
+        return;
+
+    NSString * logPath = [GeniusReviewLog logPathForDocumentPath:fileName];
+    if ([logPath isEqualToString:[_reviewLog directoryPath]] == NO && [_reviewLog setDirectoryPath:logPath])
+        [_analytics invalidateRetention];     // may now hold the history of a deck opened from disk
+
+    NSString * mediaPath = [GeniusMediaStore storePathForDocumentPath:fileName];
+    if ([mediaPath isEqualToString:[_mediaStore directoryPath]] == NO)
+        [_mediaStore setDirectoryPath:mediaPath];
+
+    if (_textStore && [_textStore isMapped] == NO)
+        [_textStore mapSectionFromFile:fileName];
+
+    // Index the file as it is, before answers given while it was closed change the document.
+    GeniusDeckSearchIndex * searchIndex = [self _deckSearchIndex];
+    if (searchIndex && [searchIndex isDeckCurrentAtPath:fileName] == NO)
+        [searchIndex indexSnapshot:[self snapshot] scheduler:_scheduler forDeckAtPath:fileName];
+
+    if (isOpening == NO)
+        [self _markDetachedReviewsApplied];     // saved under a new name
+    else if ([self _applyDetachedReviews])
+        [self updateChangeCount:NSChangeDone];
+}
+
+//! Reads the pairs of the deck at @a path without creating a document or showing alerts.
+/*!
+    Safe on any thread; used to index decks that are not open.  Returns nil for unreadable files,
+    Genius 1.0 files and files of newer versions.  Library decks return the pairs of their library.
+    Unless @a scheduler is NULL it receives the scheduler saved with the deck, or nil for the classic one.
+*/
++ (NSArray *) pairsWithContentsOfFile:(NSString *)path scheduler:(id <GeniusScheduler> *)scheduler
+{
+    if (scheduler)
+        *scheduler = nil;
+
+    NSData * data = [NSData dataWithContentsOfMappedFile:path];
+    if (data == nil)
+        return nil;
+
+    NSArray * pairs = nil;
+    GeniusTextStore * textStore = nil;
+    NSKeyedUnarchiver * unarchiver = nil;
+    NS_DURING
+        unarchiver = [[NSKeyedUnarchiver alloc] initForReadingWithData:data];
+        if ([unarchiver decodeIntForKey:@"formatVersion"] <= 2)
+        {
+            NSData * textSection = [unarchiver decodeObjectForKey:@"textSection"];
+            if (textSection)
+            {
+                textStore = [[GeniusTextStore alloc] initWithSectionData:textSection];
+                [unarchiver setDelegate:textStore];
+            }
+
+            NSString * libraryPath = [unarchiver decodeObjectForKey:@"libraryPath"];
+            if (libraryPath)
+                pairs = [[GeniusLibrary libraryWithContentsOfFile:libraryPath] pairsWithOverlayData:[unarchiver decodeObjectForKey:@"libraryOverlay"]];
+            else
+                pairs = [unarchiver decodeObjectForKey:@"pairs"];
+
+            NSString * schedulerIdentifier = [unarchiver decodeObjectForKey:@"schedulerIdentifier"];
+            if (scheduler && schedulerIdentifier)
+                *scheduler = [GeniusScoreScheduler schedulerWithIdentifier:schedulerIdentifier parameters:[unarchiver decodeObjectForKey:@"schedulerParameters"]];
+            [unarchiver finishDecoding];
+        }
+    NS_HANDLER
+        NSLog(@"Could not read %@: %@", path, localException);
+        pairs = nil;
+    NS_ENDHANDLER
+    [unarchiver release];
+    [textStore release];
+    return pairs;
 }
 
 //! Reads in a GeniusDocument from the provided @a data.
 /*!
     This method supports reading the version 1.5 format as well as version 1.0.  The 1.5
     version is dependent on the NSKeyedUnarchiver while the 1.0 version was stored in
-    plist format.
+    plist format.  Decks with a text section (formatVersion 2) get lazy notes and long item
+    text from a GeniusTextStore.
 */
 - (BOOL)loadDataRepresentation:(NSData *)data ofType:(NSString *)aType
 {
+    uint64_t spanStart = GeniusTraceSpanBegin();
     BOOL result = NO;
     
     [[self undoManager]  disableUndoRegistration];
@@ -85,8 +249,8 @@
         NSLog(@"1.5");
         
         int formatVersion = [unarchiver decodeIntForKey:@"formatVersion"];
-        //  greater than one for genius 2.0
-        if (formatVersion > 1)
+        //  greater than two for genius 2.0
+        if (formatVersion > 2)
         {
 			NSString * title = NSLocalizedString(@"This document was saved by a newer version of Genius.", nil);
 			NSString * message = NSLocalizedString(@"Please upgrade Genius to a newer version.", nil);
@@ -99,6 +263,18 @@
         // handle 1.5 format
         else
         {
+            // Must come before the pairs, whose texts refer to it.
+            [_textStore release];
+            _textStore = nil;
+            NSData * textSection = [unarchiver decodeObjectForKey:@"textSection"];
+            if (textSection)
+            {
+                _textStore = [[GeniusTextStore alloc] initWithSectionData:textSection];
+                if (_textStore == nil)
+                    NSLog(@"Damaged text section, notes and long texts are missing");
+                [unarchiver setDelegate:_textStore];
+            }
+
             NSArray * visibleColumnIdentifiers = [unarchiver decodeObjectForKey:@"visibleColumnIdentifiers"];
             if (visibleColumnIdentifiers)
                 [_visibleColumnIdentifiers setArray:visibleColumnIdentifiers];
@@ -113,7 +289,28 @@
                     [_columnHeadersDict setObject:title forKey:@"columnB"];
             }
 
-            [self setPairs:[unarchiver decodeObjectForKey:@"pairs"]];
+            NSString * libraryPath = [unarchiver decodeObjectForKey:@"libraryPath"];
+            if (libraryPath)
+            {
+                GeniusLibrary * library = [GeniusLibrary libraryWithContentsOfFile:libraryPath];
+                if (library == nil)
+                {
+                    NSString * title = NSLocalizedString(@"The library used by this deck could not be opened.", nil);
+                    NSString * message = [NSString stringWithFormat:NSLocalizedString(@"Make sure %@ is available and try again.", nil), libraryPath];
+                    NSString * cancelTitle = NSLocalizedString(@"Cancel", nil);
+
+                    NSAlert * alert = [NSAlert alertWithMessageText:title defaultButton:cancelTitle alternateButton:nil otherButton:nil informativeTextWithFormat:@"%@", message];
+                    [alert runModal];
+                    [unarchiver finishDecoding];
+                    [unarchiver release];
+                    [[self undoManager] enableUndoRegistration];
+                    GeniusTraceSpanEnd("load", spanStart);
+                    return NO;
+                }
+                [self setLibrary:library overlayData:[unarchiver decodeObjectForKey:@"libraryOverlay"]];
+            }
+            else
+                [self setPairs:[unarchiver decodeObjectForKey:@"pairs"]];
 
             NSDate * cumulativeStudyTime = [unarchiver decodeObjectForKey:@"cumulativeStudyTime"];
             if (cumulativeStudyTime)
@@ -127,6 +324,28 @@
                 [self takeValue:learnVsReviewNumber forKey:@"probabilityCenter"];
             }
 
+            NSString * syncPath = [unarchiver decodeObjectForKey:@"syncPath"];
+            if (syncPath)
+            {
+                [_syncPath release];
+                _syncPath = [syncPath copy];
+            }
+
+            // Stored due dates already follow the saved scheduler, so don't reschedule.
+            NSString * schedulerIdentifier = [unarchiver decodeObjectForKey:@"schedulerIdentifier"];
+            if (schedulerIdentifier)
+            {
+                NSDictionary * schedulerParameters = [unarchiver decodeObjectForKey:@"schedulerParameters"];
+                id <GeniusScheduler> scheduler = [GeniusScoreScheduler schedulerWithIdentifier:schedulerIdentifier parameters:schedulerParameters];
+                if (scheduler)
+                {
+                    [_scheduler release];
+                    _scheduler = [scheduler retain];
+                }
+                else
+                    NSLog(@"Unknown scheduler %@, using default", schedulerIdentifier);
+            }
+
             [unarchiver finishDecoding];
             [unarchiver release];
 
@@ -184,6 +403,9 @@
         }
     }
     [[self undoManager]  enableUndoRegistration];
+    if (result)
+        [self applyMemoryBudgets];
+    GeniusTraceSpanEnd("load", spanStart);
     return result;
 }
 
@@ -270,4 +492,360 @@ Assuming this is okay, it simply passes the call to super.
     }
 }
 
+//! Initiates modal sheet for saving the cards of the document as a shared library.
+- (IBAction)exportLibrary:(id)sender
+{
+    NSSavePanel * savePanel = [NSSavePanel savePanel];
+    [savePanel setAllowedFileTypes:[NSArray arrayWithObject:@"geniuslibrary"]];
+    [savePanel setNameFieldLabel:NSLocalizedString(@"Export As:", nil)];
+    [savePanel setPrompt:NSLocalizedString(@"Export", nil)];
+
+    NSWindowController * windowController = [[self windowControllers] lastObject];
+    [savePanel beginSheetForDirectory:nil file:nil modalForWindow:[windowController window] modalDelegate:self didEndSelector:@selector(_exportLibraryDidEnd:returnCode:contextInfo:) contextInfo:nil];
+}
+
+//! Handles user response to modal sheet initiated in exportLibrary:.
+/*! Only card text and ids are written; scores stay with this document. */
+- (void)_exportLibraryDidEnd:(NSSavePanel *)sheet returnCode:(int)returnCode contextInfo:(void *)contextInfo
+{
+    NSString * path = [sheet filename];
+    if (returnCode != NSOKButton || path == nil)
+        return;
+
+    if ([GeniusLibrary writeLibraryWithPairs:_pairs toFile:path] == NO)
+        NSBeep();
+}
+
+//! Creates a new deck studying the cards of a library file chosen by the user.
+/*!
+    The cards are not copied into the deck.  Any number of decks may study the same library; each
+    keeps its own scores and due dates.
+*/
++ (IBAction)newDeckFromLibrary:(id)sender
+{
+    NSDocumentController * documentController = [NSDocumentController sharedDocumentController];
+    NSOpenPanel * openPanel = [NSOpenPanel openPanel];
+    [openPanel setTitle:NSLocalizedString(@"New Deck from Library", nil)];
+    [openPanel setPrompt:NSLocalizedString(@"Choose", nil)];
+
+    [documentController runModalOpenPanel:openPanel forTypes:[NSArray arrayWithObject:@"geniuslibrary"]];
+
+    NSString * path = [openPanel filename];
+    if (path == nil)
+        return;
+
+    GeniusLibrary * library = [GeniusLibrary libraryWithContentsOfFile:path];
+    if (library == nil)
+    {
+        NSBeep();
+        return;
+    }
+
+    [documentController newDocument:self];
+    GeniusDocument * document = (GeniusDocument *)[documentController currentDocument];
+    [document setLibrary:library overlayData:nil];
+    [document reloadInterfaceFromModel];
+}
+
+@end
+
+
+@implementation GeniusDocument (BackgroundSave)
+
+//! Everything but the pairs that goes into a saved deck, collected on the main thread.
+/*! Holding the option key while saving picks the XML format. */
+- (NSDictionary *) _archiveSettings
+{
+    NSMutableDictionary * settings = [NSMutableDictionary dictionary];
+
+    NSEvent * event = [NSApp currentEvent];
+    if (event && ([event modifierFlags] & NSAlternateKeyMask))
+        [settings setObject:[NSNumber numberWithInt:NSPropertyListXMLFormat_v1_0] forKey:@"outputFormat"];
+    else
+        [settings setObject:[NSNumber numberWithInt:kCFPropertyListBinaryFormat_v1_0] forKey:@"outputFormat"];
+
+    [settings setValue:[tableView visibleColumnIdentifiers] forKey:@"visibleColumnIdentifiers"];
+    [settings setValue:[[_columnHeadersDict copy] autorelease] forKey:@"columnHeadersDict"];
+    [settings setValue:_cumulativeStudyTime forKey:@"cumulativeStudyTime"];
+    [settings setValue:probabilityCenter forKey:@"learnVsReviewNumber"];
+    [settings setValue:[_library path] forKey:@"libraryPath"];
+    [settings setValue:_syncPath forKey:@"syncPath"];
+    // Decks using the classic scheduler stay byte compatible with earlier versions.
+    if ([[_scheduler identifier] isEqualToString:@"classic"] == NO || [[_scheduler parameters] count])
+    {
+        [settings setValue:[_scheduler identifier] forKey:@"schedulerIdentifier"];
+        [settings setValue:[_scheduler parameters] forKey:@"schedulerParameters"];
+    }
+    return settings;
+}
+
+//! Archives @a pairs and @a settings in the native file format.
+/*!
+    Touches nothing but its arguments, so it runs on any thread given pairs no other thread uses.
+    Notes and item text longer than kGeniusTextOutOfLineLength go into a text section, read lazily by
+    GeniusTextStore when the deck is opened; decks with a section are saved as formatVersion 2.
+*/
++ (NSData *) _archivedDataWithPairs:(NSArray *)pairs settings:(NSDictionary *)settings
+{
+    NSMutableData * data = [NSMutableData data];
+    NSKeyedArchiver * archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
+    [archiver setOutputFormat:[[settings objectForKey:@"outputFormat"] intValue]];
+
+    NSString * libraryPath = [settings objectForKey:@"libraryPath"];
+    GeniusTextSectionWriter * textWriter = [[[GeniusTextSectionWriter alloc] init] autorelease];
+    if (libraryPath == nil)
+    {
+        NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+        GeniusPair * pair;
+        while ((pair = [pairEnumerator nextObject]))
+        {
+            NSString * text = [pair notesString];
+            if ([text length])
+                [textWriter addString:text];
+            text = [[pair itemA] stringValue];
+            if ([text length] > kGeniusTextOutOfLineLength)
+                [textWriter addString:text];
+            text = [[pair itemB] stringValue];
+            if ([text length] > kGeniusTextOutOfLineLength)
+                [textWriter addString:text];
+        }
+    }
+
+    // Decks without notes or long texts stay readable by earlier versions.
+    if ([textWriter count])
+    {
+        [archiver encodeInt:2 forKey:@"formatVersion"];
+        [archiver encodeObject:[textWriter sectionData] forKey:@"textSection"];
+        [archiver setDelegate:textWriter];
+    }
+    else
+        [archiver encodeInt:1 forKey:@"formatVersion"];
+    [archiver encodeObject:[settings objectForKey:@"visibleColumnIdentifiers"] forKey:@"visibleColumnIdentifiers"];
+    [archiver encodeObject:[settings objectForKey:@"columnHeadersDict"] forKey:@"columnHeadersDict"];
+    if (libraryPath)
+    {
+        [archiver encodeObject:libraryPath forKey:@"libraryPath"];
+        [archiver encodeObject:[GeniusLibrary overlayDataForPairs:pairs] forKey:@"libraryOverlay"];
+    }
+    else
+        [archiver encodeObject:pairs forKey:@"pairs"];
+    [archiver encodeObject:[settings objectForKey:@"cumulativeStudyTime"] forKey:@"cumulativeStudyTime"];
+    [archiver encodeObject:[settings objectForKey:@"learnVsReviewNumber"] forKey:@"learnVsReviewNumber"];
+    if ([settings objectForKey:@"syncPath"])
+        [archiver encodeObject:[settings objectForKey:@"syncPath"] forKey:@"syncPath"];
+    NSString * schedulerIdentifier = [settings objectForKey:@"schedulerIdentifier"];
+    if (schedulerIdentifier)
+    {
+        [archiver encodeObject:schedulerIdentifier forKey:@"schedulerIdentifier"];
+        [archiver encodeObject:[settings objectForKey:@"schedulerParameters"] forKey:@"schedulerParameters"];
+    }
+    [archiver finishEncoding];
+    [archiver release];
+
+    return data;
+}
+
+//! Background thread body: recreates the pairs of the snapshot in @a job, archives and writes them.
+/*! Progress is 40% recreating pairs, 40% archiving and 20% writing. */
+- (void) _saveInBackground:(NSMutableDictionary *)job
+{
+    NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+    uint64_t spanStart = GeniusTraceSpanBegin();
+    GeniusDeckSnapshot * snapshot = [job objectForKey:@"snapshot"];
+    NSString * path = [job objectForKey:@"path"];
+
+    unsigned int i, count = [snapshot count];
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:count];
+    NSAutoreleasePool * innerPool = [[NSAutoreleasePool alloc] init];
+    for (i=0; i<count; i++)
+    {
+        GeniusPair * pair = [snapshot newPairAtIndex:i];
+        [pairs addObject:pair];
+        [pair release];
+        if ((i & 1023) == 1023)
+        {
+            [innerPool release];
+            innerPool = [[NSAutoreleasePool alloc] init];
+            [self _reportSaveProgress:0.4F * i / count];
+        }
+    }
+    [innerPool release];
+    [self _reportSaveProgress:0.4F];
+
+    NSData * data = nil;
+    NS_DURING
+        data = [[self class] _archivedDataWithPairs:pairs settings:[job objectForKey:@"settings"]];
+    NS_HANDLER
+        NSLog(@"Could not archive %@: %@", path, localException);
+    NS_ENDHANDLER
+    [self _reportSaveProgress:0.8F];
+
+    BOOL didSave = (data && [self _writeData:data atomicallyToFile:path]);
+    [job setObject:[NSNumber numberWithBool:didSave] forKey:@"didSave"];
+    GeniusTraceSpanEnd("save", spanStart);
+    [self performSelectorOnMainThread:@selector(_backgroundSaveDidEnd:) withObject:job waitUntilDone:NO];
+    [pool release];
+}
+
+//! Writes @a data to a temporary file beside @a path and renames it over @a path.
+/*! Keeps the permissions of an existing file.  Readers see either the old or the new file, never a partial one. */
+- (BOOL) _writeData:(NSData *)data atomicallyToFile:(NSString *)path
+{
+    NSString * tempName = [NSString stringWithFormat:@".%@.%@", [path lastPathComponent], [[NSProcessInfo processInfo] globallyUniqueString]];
+    NSString * tempPath = [[path stringByDeletingLastPathComponent] stringByAppendingPathComponent:tempName];
+    const char * tempFile = [tempPath fileSystemRepresentation];
+
+    int fd = open(tempFile, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        NSLog(@"Could not create %@: %s", tempPath, strerror(errno));
+        return NO;
+    }
+
+    struct stat existing;
+    if (stat([path fileSystemRepresentation], &existing) == 0)
+        fchmod(fd, existing.st_mode & 07777);
+
+    const char * bytes = [data bytes];
+    unsigned int length = [data length], offset = 0;
+    BOOL isWritten = YES;
+    while (isWritten && offset < length)
+    {
+        ssize_t written = write(fd, bytes + offset, MIN(length - offset, 1U << 20));
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            isWritten = NO;
+        else
+        {
+            offset += written;
+            [self _reportSaveProgress:0.8F + 0.2F * offset / length];
+        }
+    }
+    if (isWritten && fsync(fd) != 0)
+        isWritten = NO;
+    if (close(fd) != 0)
+        isWritten = NO;
+    if (isWritten && rename(tempFile, [path fileSystemRepresentation]) != 0)
+        isWritten = NO;
+
+    if (isWritten == NO)
+    {
+        NSLog(@"Could not write %@: %s", path, strerror(errno));
+        unlink(tempFile);
+    }
+    return isWritten;
+}
+
+//! The search index over all decks kept by GeniusAppDelegate, or nil when there is none, as in unit tests.
+- (GeniusDeckSearchIndex *) _deckSearchIndex
+{
+    id delegate = [NSApp delegate];
+    return ([delegate respondsToSelector:@selector(deckSearchIndex)] ? [delegate deckSearchIndex] : nil);
+}
+
+//! Applies the answers given in combined reviews that no saved deck file holds yet.
+/*!
+    Returns the number of records applied.  They are not undoable, but the document is left edited.
+    The records are only marked applied in the log once the deck is saved, see #_markDetachedReviewsApplied.
+ */
+- (unsigned int) _applyDetachedReviews
+{
+    NSData * data = [_reviewLog unappliedDetachedRecords];
+    const GeniusReviewRecord * records = [data bytes];
+    unsigned int i, count = [data length] / sizeof(GeniusReviewRecord), appliedCount = 0;
+    if (count == 0)
+        return 0;
+
+    [[self undoManager] disableUndoRegistration];
+    for (i=0; i<count; i++)
+        if ([self applyReviewRecord:&records[i]])
+            appliedCount++;
+    [[self undoManager] enableUndoRegistration];
+    _appliedLogPosition = [_reviewLog recordCount];
+    return appliedCount;
+}
+
+//! Marks the detached answers applied by #_applyDetachedReviews in the log, now that the deck file holds them.
+- (void) _markDetachedReviewsApplied
+{
+    if (_appliedLogPosition && [_reviewLog markDetachedRecordsAppliedBefore:_appliedLogPosition])
+        _appliedLogPosition = 0;
+}
+
+//! Passes @a progress to the main thread.
+- (void) _reportSaveProgress:(float)progress
+{
+    [self performSelectorOnMainThread:@selector(_setSaveProgress:) withObject:[NSNumber numberWithFloat:progress] waitUntilDone:NO];
+}
+
+//! Shows the progress of the running save in the status text.
+- (void) _setSaveProgress:(NSNumber *)progress
+{
+    _saveProgress = [progress floatValue];
+    [self _updateStatusText];
+}
+
+//! Finishes a background save on the main thread, as NSDocument would after writing the file.
+/*!
+    The document is only marked clean, or autosaved, if nothing changed since the snapshot was taken.
+    Then tells the delegate and starts the next pending save, if any.
+*/
+- (void) _backgroundSaveDidEnd:(NSDictionary *)job
+{
+    BOOL didSave = [[job objectForKey:@"didSave"] boolValue];
+    NSString * path = [job objectForKey:@"path"];
+    NSSaveOperationType saveOperation = [[job objectForKey:@"saveOperation"] intValue];
+    BOOL hasNewChanges = (_editGeneration != [[job objectForKey:@"editGeneration"] unsignedIntValue]);
+
+    if (didSave && saveOperation == NSAutosaveOperation)
+    {
+        [self setAutosavedContentsFileURL:[NSURL fileURLWithPath:path]];
+        if (hasNewChanges == NO)
+            [self updateChangeCount:NSChangeAutosaved];
+    }
+    else if (didSave)
+    {
+        NSDictionary * attributes = [[NSFileManager defaultManager] fileAttributesAtPath:path traverseLink:YES];
+        [self setFileModificationDate:[attributes fileModificationDate]];
+        if (hasNewChanges == NO)
+            [self updateChangeCount:NSChangeCleared];
+        [self _markDetachedReviewsApplied];
+        [[self _deckSearchIndex] indexSnapshot:[job objectForKey:@"snapshot"] scheduler:_scheduler forDeckAtPath:path];
+
+        // The autosaved copy is now older than the document itself.
+        NSURL * autosavedURL = [self autosavedContentsFileURL];
+        if (autosavedURL)
+        {
+            [[NSFileManager defaultManager] removeFileAtPath:[autosavedURL path] handler:nil];
+            [self setAutosavedContentsFileURL:nil];
+        }
+    }
+    else if (saveOperation != NSAutosaveOperation)
+    {
+        NSDictionary * userInfo = [NSDictionary dictionaryWithObject:path forKey:NSFilePathErrorKey];
+        [self presentError:[NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:userInfo]];
+    }
+
+    _isSaving = NO;
+    [self _updateStatusText];
+
+    id delegate = [job objectForKey:@"delegate"];
+    NSString * selectorName = [job objectForKey:@"didSaveSelector"];
+    if (delegate && selectorName)
+    {
+        typedef void (*GeniusDidSaveIMP)(id, SEL, NSDocument *, BOOL, void *);
+        SEL didSaveSelector = NSSelectorFromString(selectorName);
+        GeniusDidSaveIMP didSave_imp = (GeniusDidSaveIMP)[delegate methodForSelector:didSaveSelector];
+        didSave_imp(delegate, didSaveSelector, self, didSave, [[job objectForKey:@"contextInfo"] pointerValue]);
+    }
+
+    if ([_pendingSaves count])
+    {
+        NSInvocation * invocation = [[[_pendingSaves objectAtIndex:0] retain] autorelease];
+        [_pendingSaves removeObjectAtIndex:0];
+        [invocation invoke];
+    }
+}
+
 @end
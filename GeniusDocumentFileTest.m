@@ -8,6 +8,11 @@
 
 #import "GeniusDocument.h"
 #import "GeniusPair.h"
+#import "GeniusAssociation.h"
+#import "GeniusItem.h"
+#import "GeniusTextStore.h"
+#import "GeniusDocumentMemory.h"
+#import "GeniusMemoryReport.h"
 
 #import <SenTestingKit/SenTestingKit.h>
 
@@ -58,7 +63,8 @@
     STAssertEqualObjects([pair valueForKeyPath:@"notesString"], @"Test Notes", nil);
 }
 
-//! Loads up preconfigure test file and saves, compares output file and input file.
+//! Loads up preconfigure test file and saves, then checks that saving the result again is lossless.
+/*! The test file predates pair identifiers, so the first save adds them and differs from the input. */
 -(void) testLoadAndSave
 {
     NSData *data = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"TestFile1" ofType:@"genius"]];
@@ -68,10 +74,186 @@
     GeniusDocument *document  = (GeniusDocument*)[documentController openUntitledDocumentAndDisplay:YES error:&error];
     
     [document loadDataRepresentation:data ofType:@"Genius Documnent"];
+    GeniusPairID pairID = [[[document pairs] objectAtIndex:0] pairID];
+    STAssertTrue(pairID != 0, nil);
     
     NSData *newData = [document dataRepresentationOfType:@"Genius Document"];
+
+    GeniusDocument *secondDocument  = (GeniusDocument*)[documentController openUntitledDocumentAndDisplay:YES error:&error];
+    [secondDocument loadDataRepresentation:newData ofType:@"Genius Documnent"];
+    STAssertEquals([[[secondDocument pairs] objectAtIndex:0] pairID], pairID, nil);
+    STAssertEquals([secondDocument pairWithID:pairID], [[secondDocument pairs] objectAtIndex:0], nil);
     
-    STAssertTrue([newData isEqualToData:data], nil);
+    STAssertTrue([[secondDocument dataRepresentationOfType:@"Genius Document"] isEqualToData:newData], nil);
+}
+
+//! Notes and long item text are saved in the text section and come back as lazily loaded strings.
+- (void) testTextSection
+{
+    NSError *error;
+    NSDocumentController *documentController = [NSDocumentController sharedDocumentController];
+    GeniusDocument *document  = (GeniusDocument*)[documentController openUntitledDocumentAndDisplay:NO error:&error];
+
+    NSMutableString * longAnswer = [NSMutableString string];
+    while ([longAnswer length] <= kGeniusTextOutOfLineLength)
+        [longAnswer appendString:@"A long answer, spanning several paragraphs. "];
+    GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+    [[pair itemA] setStringValue:@"Question"];
+    [[pair itemB] setStringValue:longAnswer];
+    [pair setNotesString:@"Some notes"];
+    [document setPairs:[NSMutableArray arrayWithObjects:pair, [[[GeniusPair alloc] init] autorelease], nil]];
+    NSData * data = [document dataRepresentationOfType:@"Genius Document"];
+
+    GeniusDocument *secondDocument  = (GeniusDocument*)[documentController openUntitledDocumentAndDisplay:NO error:&error];
+    STAssertTrue([secondDocument loadDataRepresentation:data ofType:@"Genius Documnent"], nil);
+    STAssertEquals([[secondDocument textStore] count], 2U, nil);
+
+    GeniusPair * loadedPair = [[secondDocument pairs] objectAtIndex:0];
+    STAssertEqualObjects([[loadedPair itemA] stringValue], @"Question", nil);
+    STAssertEqualObjects([[loadedPair itemB] stringValue], longAnswer, nil);
+    STAssertEqualObjects([loadedPair notesString], @"Some notes", nil);
+    STAssertNil([[[secondDocument pairs] objectAtIndex:1] notesString], nil);
+
+    STAssertTrue([[secondDocument dataRepresentationOfType:@"Genius Document"] isEqualToData:data], nil);
+}
+
+//! Moving pairs keeps the same objects and their scores, and undoes in one step.
+- (void) testMovePairs
+{
+    NSError *error;
+    NSDocumentController *documentController = [NSDocumentController sharedDocumentController];
+    GeniusDocument *document  = (GeniusDocument*)[documentController openUntitledDocumentAndDisplay:YES error:&error];
+    [[document undoManager] setGroupsByEvent:NO];
+
+    NSMutableArray * pairs = [NSMutableArray array];
+    int i;
+    for (i=0; i<6; i++)
+    {
+        GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+        [[pair associationAB] setScore:i];
+        [pairs addObject:pair];
+    }
+    [document setPairs:pairs];
+    NSArray * originalOrder = [NSArray arrayWithArray:pairs];
+
+    NSMutableIndexSet * fromIndexes = [NSMutableIndexSet indexSetWithIndex:0];
+    [fromIndexes addIndex:4];
+    [[document undoManager] beginUndoGrouping];
+    [document movePairsAtIndexes:fromIndexes toIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(2, 2)]];
+    [[document undoManager] endUndoGrouping];
+
+    NSArray * expected = [NSArray arrayWithObjects:[originalOrder objectAtIndex:1], [originalOrder objectAtIndex:2],
+        [originalOrder objectAtIndex:0], [originalOrder objectAtIndex:4], [originalOrder objectAtIndex:3], [originalOrder objectAtIndex:5], nil];
+    STAssertEqualObjects([document pairs], expected, nil);
+    STAssertEquals([[[[document pairs] objectAtIndex:3] associationAB] score], 4, nil);
+    STAssertEquals([document pairWithID:[[originalOrder objectAtIndex:4] pairID]], [originalOrder objectAtIndex:4], nil);
+
+    [[document undoManager] undo];
+    STAssertEqualObjects([document pairs], originalOrder, nil);
+}
+
+//! Undo memory only counts the groups the undo manager keeps.
+- (void) testUndoMemoryIsBounded
+{
+    NSError *error;
+    NSDocumentController *documentController = [NSDocumentController sharedDocumentController];
+    GeniusDocument *document  = (GeniusDocument*)[documentController openUntitledDocumentAndDisplay:YES error:&error];
+    NSUndoManager * undoManager = [document undoManager];
+    [undoManager setGroupsByEvent:NO];
+    [undoManager setLevelsOfUndo:2];
+
+    int i;
+    for (i=0; i<3; i++)
+    {
+        [undoManager beginUndoGrouping];
+        [document insertObject:[[[GeniusPair alloc] init] autorelease] inPairsAtIndex:0];
+        [undoManager endUndoGrouping];
+    }
+    STAssertEquals([[document memoryReport] objectCountForSubsystem:GeniusMemoryUndoSubsystem], 2U, nil);
+
+    [undoManager removeAllActions];
+    STAssertEquals([[document memoryReport] objectCountForSubsystem:GeniusMemoryUndoSubsystem], 0U, nil);
+}
+
+//! Records the result of a save for testBackgroundSave.
+- (void) document:(NSDocument *)document didSave:(BOOL)didSave contextInfo:(void *)contextInfo
+{
+    *(int *)contextInfo = (didSave ? 1 : 0);
+}
+
+//! Runs the main run loop until the save reporting to @a result has finished.
+- (void) _waitForSave:(int *)result
+{
+    NSDate * timeout = [NSDate dateWithTimeIntervalSinceNow:30.0];
+    while (*result < 0 && [timeout timeIntervalSinceNow] > 0)
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+}
+
+//! Background saves write what the synchronous path writes, and changes made meanwhile keep the document edited.
+- (void) testBackgroundSave
+{
+    NSData *data = [NSData dataWithContentsOfFile:[[NSBundle bundleForClass:[self class]] pathForResource:@"TestFile1" ofType:@"genius"]];
+
+    NSError *error;
+    NSDocumentController *documentController = [NSDocumentController sharedDocumentController];
+    GeniusDocument *document  = (GeniusDocument*)[documentController openUntitledDocumentAndDisplay:NO error:&error];
+    [document loadDataRepresentation:data ofType:@"Genius Documnent"];
+    NSData * expected = [document dataRepresentationOfType:@"Genius Document"];
+
+    NSString * name = [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"genius"];
+    NSURL * url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+
+    [document updateChangeCount:NSChangeDone];
+    int result = -1;
+    [document saveToURL:url ofType:[document fileType] forSaveOperation:NSSaveOperation delegate:self didSaveSelector:@selector(document:didSave:contextInfo:) contextInfo:&result];
+    [self _waitForSave:&result];
+    STAssertEquals(result, 1, nil);
+    STAssertTrue([[NSData dataWithContentsOfURL:url] isEqualToData:expected], nil);
+    STAssertFalse([document isDocumentEdited], nil);
+
+    // A change made before the save finishes is not covered by it.
+    result = -1;
+    [document saveToURL:url ofType:[document fileType] forSaveOperation:NSSaveOperation delegate:self didSaveSelector:@selector(document:didSave:contextInfo:) contextInfo:&result];
+    [[[[document pairs] objectAtIndex:0] associationAB] setScore:3];
+    [document updateChangeCount:NSChangeDone];
+    [self _waitForSave:&result];
+    STAssertEquals(result, 1, nil);
+    STAssertTrue([document isDocumentEdited], nil);
+
+    [[NSFileManager defaultManager] removeFileAtPath:[url path] handler:nil];
+}
+
+//! Background saves keep every atom of the items, not just their text.
+- (void) testBackgroundSaveKeepsMedia
+{
+    NSError *error;
+    NSDocumentController *documentController = [NSDocumentController sharedDocumentController];
+    GeniusDocument *document  = (GeniusDocument*)[documentController openUntitledDocumentAndDisplay:NO error:&error];
+    NSURL * imageURL = [NSURL URLWithString:@"file:///Library/Desktop%20Pictures/Aqua%20Blue.jpg"];
+    NSURL * soundURL = [NSURL URLWithString:@"file:///System/Library/Sounds/Glass.aiff"];
+    GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+    [[pair itemA] setStringValue:@"Question"];
+    [[pair itemA] setImageURL:imageURL];
+    [[pair itemB] setSoundURL:soundURL];
+    [document setPairs:[NSMutableArray arrayWithObject:pair]];
+
+    NSString * name = [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"genius"];
+    NSURL * url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+
+    [document updateChangeCount:NSChangeDone];
+    int result = -1;
+    [document saveToURL:url ofType:[document fileType] forSaveOperation:NSSaveOperation delegate:self didSaveSelector:@selector(document:didSave:contextInfo:) contextInfo:&result];
+    [self _waitForSave:&result];
+    STAssertEquals(result, 1, nil);
+
+    GeniusDocument *secondDocument  = (GeniusDocument*)[documentController openUntitledDocumentAndDisplay:NO error:&error];
+    STAssertTrue([secondDocument loadDataRepresentation:[NSData dataWithContentsOfURL:url] ofType:@"Genius Documnent"], nil);
+    GeniusPair * loadedPair = [[secondDocument pairs] objectAtIndex:0];
+    STAssertEqualObjects([[loadedPair itemA] stringValue], @"Question", nil);
+    STAssertEqualObjects([[loadedPair itemA] imageURL], imageURL, nil);
+    STAssertEqualObjects([[loadedPair itemB] soundURL], soundURL, nil);
+
+    [[NSFileManager defaultManager] removeFileAtPath:[url path] handler:nil];
 }
 
 @end
@@ -0,0 +1,40 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import <Foundation/Foundation.h>
+
+#import "GeniusDocument.h"
+
+@class GeniusMemoryReport;
+
+// User defaults keys of the memory budgets of a deck.  Missing keys get the defaults named; 0 means unbounded.
+extern NSString * GeniusMemoryTextCacheLimitKey;    //!< Bytes of decoded text, GeniusTextStore#cacheLimit.  Default kGeniusTextDefaultCacheLimit.
+extern NSString * GeniusMemoryMediaMappedLimitKey;  //!< Bytes of mapped media, GeniusMediaStore#mappedByteLimit.  Default kGeniusMediaDefaultMappedLimit.
+extern NSString * GeniusMemorySearchCacheLimitKey;  //!< Bytes of sort keys and of search index, GeniusArrayController#searchCacheLimit.  Default kGeniusMemoryDefaultSearchCacheLimit.
+extern NSString * GeniusMemoryUndoLevelsKey;        //!< Undo groups kept, NSUndoManager#levelsOfUndo.  Default 0.
+
+//! Default bound on the sort keys, and on the fuzzy index with the pair columns, of a deck, in bytes.
+#define kGeniusMemoryDefaultSearchCacheLimit (64 * 1024 * 1024)
+
+@interface GeniusDocument (MemoryAccounting)
+
+- (GeniusMemoryReport *) memoryReport;
+- (void) applyMemoryBudgets;
+- (void) reduceMemoryUsage;
+- (void) undoManagerDidCloseUndoGroup:(NSNotification *)notification;
+
+@end
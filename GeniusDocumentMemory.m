@@ -0,0 +1,173 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import "GeniusDocumentMemory.h"
+#import "GeniusMemoryReport.h"
+#import "GeniusTimingWheel.h"
+#import "GeniusTableRowModel.h"
+#import "GeniusDistractorIndex.h"
+#import "GeniusTextStore.h"
+#import "GeniusMediaStore.h"
+#import "GeniusTrace.h"
+#include <limits.h>     // UINT_MAX
+
+NSString * GeniusMemoryTextCacheLimitKey = @"GeniusTextCacheLimit";
+NSString * GeniusMemoryMediaMappedLimitKey = @"GeniusMediaMappedLimit";
+NSString * GeniusMemorySearchCacheLimitKey = @"GeniusSearchCacheLimit";
+NSString * GeniusMemoryUndoLevelsKey = @"GeniusUndoLevels";
+
+//! Estimated bytes of one registered undo action:  an NSInvocation, its method signature and argument frame.
+/*!
+    NSUndoManager doesn't expose its stacks, so undo is reported as this times the number of registrations
+    in the undo groups it still keeps.
+ */
+#define kGeniusMemoryUndoRegistrationBytes 160
+
+//! Budget stored in the user defaults under @a key, or @a defaultValue if there is none.
+static unsigned long long GeniusMemoryBudget(NSString * key, unsigned long long defaultValue)
+{
+    id value = [[NSUserDefaults standardUserDefaults] objectForKey:key];
+    if (value == nil || [value respondsToSelector:@selector(longLongValue)] == NO)
+        return defaultValue;
+    return (unsigned long long)MAX([value longLongValue], 0LL);
+}
+
+@interface GeniusDocument (MemoryAccountingPrivate)
+- (void) _trimUndoAccounting;
+@end
+
+//! Measuring a deck and holding its caches to their budgets.
+/*!
+    @category GeniusDocument(MemoryAccounting)
+    #memoryReport lists what the pairs and every cache of the deck hold, for the Memory Usage panel and
+    for tests.  The caches evict on their own once over budget:  GeniusTextStore drops the least recently
+    read texts, GeniusMediaStore unmaps the least recently read segments, GeniusSortEngine drops the keys of
+    other columns and GeniusArrayController drops its search index once searching pauses.  #applyMemoryBudgets
+    hands them the budgets from the user defaults; #reduceMemoryUsage empties them all at once.
+ */
+@implementation GeniusDocument (MemoryAccounting)
+
+//! Bytes and objects held by the pairs and by each cache of the deck, with the budgets of the caches.
+- (GeniusMemoryReport *) memoryReport
+{
+    uint64_t spanStart = GeniusTraceSpanBegin();
+    GeniusMemoryReport * report = [[[GeniusMemoryReport alloc] init] autorelease];
+    [report addPairs:_pairs];
+    [report addCollection:_pairsByID toSubsystem:GeniusMemoryPairIndexSubsystem];
+
+    // Type strings are usually the very strings of the pairs, counted under text already.
+    [report addCollection:_customTypeStringCache toSubsystem:GeniusMemoryTypeCacheSubsystem];
+    [report addCollection:_sortedCustomTypeStrings toSubsystem:GeniusMemoryTypeCacheSubsystem];
+    NSEnumerator * typeEnumerator = [_customTypeStringCache objectEnumerator];
+    NSString * type;
+    while ((type = [typeEnumerator nextObject]))
+        [report addString:type toSubsystem:GeniusMemoryTypeCacheSubsystem];
+
+    [self _trimUndoAccounting];
+    [report addByteCount:(unsigned long long)_undoRegistrationCount * kGeniusMemoryUndoRegistrationBytes objectCount:_undoRegistrationCount toSubsystem:GeniusMemoryUndoSubsystem];
+    [report addByteCount:[_dueIndex byteCount] objectCount:[_dueIndex count] toSubsystem:GeniusMemoryDueIndexSubsystem];
+    [report addByteCount:[_rowModel cachedByteCount] objectCount:[_rowModel cachedRowCount] toSubsystem:GeniusMemoryRowModelSubsystem];
+    [arrayController addToMemoryReport:report];
+
+    unsigned long long distractorBytes = (_distractorIndex ? [_distractorIndex byteCount] : 0);
+    [report addByteCount:distractorBytes objectCount:[_distractorIndex count] toSubsystem:GeniusMemoryDistractorsSubsystem];
+
+    if (_textStore)
+    {
+        [report addByteCount:[_textStore cachedByteCount] objectCount:[_textStore cachedStringCount] toSubsystem:GeniusMemoryTextCacheSubsystem];
+        [report setLimit:[_textStore cacheLimit] forSubsystem:GeniusMemoryTextCacheSubsystem];
+    }
+    [report addByteCount:[_mediaStore mappedByteCount] objectCount:[_mediaStore mappedSegmentCount] toSubsystem:GeniusMemoryMediaSubsystem];
+    [report setLimit:[_mediaStore mappedByteLimit] forSubsystem:GeniusMemoryMediaSubsystem];
+
+    GeniusTraceSpanEnd("memoryReport", spanStart);
+    return report;
+}
+
+//! Hands the budgets in the user defaults to the caches, which evict right away if they hold more.
+/*! Called when the window is set up and after a deck is read, since reading replaces the text store. */
+- (void) applyMemoryBudgets
+{
+    unsigned long long textLimit = GeniusMemoryBudget(GeniusMemoryTextCacheLimitKey, kGeniusTextDefaultCacheLimit);
+    [_textStore setCacheLimit:(textLimit ? (unsigned int)MIN(textLimit, (unsigned long long)UINT_MAX) : UINT_MAX)];
+    [_mediaStore setMappedByteLimit:GeniusMemoryBudget(GeniusMemoryMediaMappedLimitKey, kGeniusMediaDefaultMappedLimit)];
+
+    unsigned long long searchLimit = GeniusMemoryBudget(GeniusMemorySearchCacheLimitKey, kGeniusMemoryDefaultSearchCacheLimit);
+    [arrayController setSearchCacheLimit:(unsigned int)MIN(searchLimit, (unsigned long long)UINT_MAX)];
+
+    unsigned long long undoLevels = GeniusMemoryBudget(GeniusMemoryUndoLevelsKey, 0);
+    [[self undoManager] setLevelsOfUndo:(unsigned int)MIN(undoLevels, (unsigned long long)UINT_MAX)];
+}
+
+//! Empties every cache that is rebuilt on demand:  search structures, distractors, table rows, decoded text and media mappings.
+- (void) reduceMemoryUsage
+{
+    [arrayController discardSearchCaches];
+    [_distractorIndex release];
+    _distractorIndex = nil;
+    [_rowModel invalidateAllRows];
+
+    unsigned int textLimit = [_textStore cacheLimit];
+    [_textStore setCacheLimit:0];
+    [_textStore setCacheLimit:textLimit];
+    [_mediaStore unmapSegments];
+}
+
+//! Notes how many undo actions were registered in the group just closed, dropping groups past NSUndoManager#levelsOfUndo.
+- (void) undoManagerDidCloseUndoGroup:(NSNotification *)notification
+{
+    unsigned int groupSize = _undoRegistrationCount - _closedUndoRegistrationCount;
+    if (groupSize == 0)
+        return;
+    [_undoGroupSizes addObject:[NSNumber numberWithUnsignedInt:groupSize]];
+    _closedUndoRegistrationCount = _undoRegistrationCount;
+    [self _trimUndoAccounting];
+}
+
+@end
+
+
+@implementation GeniusDocument (MemoryAccountingPrivate)
+
+//! Forgets the undo groups the undo manager no longer keeps.
+/*!
+    All of them once it has nothing left to undo or redo, for instance after NSUndoManager#removeAllActions
+    or when registrations were made with undo registration disabled.  Otherwise the oldest ones beyond
+    NSUndoManager#levelsOfUndo.
+ */
+- (void) _trimUndoAccounting
+{
+    NSUndoManager * undoManager = [self undoManager];
+    if ([undoManager canUndo] == NO && [undoManager canRedo] == NO)
+    {
+        [_undoGroupSizes removeAllObjects];
+        _undoRegistrationCount = 0;
+        _closedUndoRegistrationCount = 0;
+        return;
+    }
+
+    unsigned int levels = [undoManager levelsOfUndo];
+    while (levels > 0 && [_undoGroupSizes count] > levels)
+    {
+        unsigned int groupSize = [[_undoGroupSizes objectAtIndex:0] unsignedIntValue];
+        [_undoGroupSizes removeObjectAtIndex:0];
+        _undoRegistrationCount -= groupSize;
+        _closedUndoRegistrationCount -= groupSize;
+    }
+}
+
+@end
@@ -1,16 +0,0 @@
-//
-//  GeniusDocument_DebugLogging.h
-//  Genius
-//
-//  Created by Chris Miner on 09.01.08.
-//  Copyright 2008 Chris Miner. All rights reserved.
-//
-
-#import "GeniusDocument.h"
-
-@interface GeniusDocument(DebugLogging)
-
-+ (void) installLogging;
-
-@end
-
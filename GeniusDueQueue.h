@@ -0,0 +1,68 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusAssociationEnumerator.h"
+
+@class GeniusDeckSearchIndex;
+
+//! One association waiting in the heap of a deck in a GeniusDueQueue.
+typedef struct _GeniusDueEntry {
+    GeniusTime dueTime;             //!< Heap key.
+    unsigned int index;             //!< Number of the pair in the deck summary or snapshot.
+    unsigned short direction;       //!< 0 for GeniusPair#associationAB, 1 for GeniusPair#associationBA.
+    unsigned short isRepeat;        //!< Put back after a wrong answer in this session.
+} GeniusDueEntry;
+
+//! Combined review of everything due in all decks, open or not.
+/*!
+    Every deck gets a binary heap of its associations that are due, keyed by due time.  Open decks are
+    read from a GeniusDeckSnapshot of the document; other decks from their GeniusDeckSummary in the
+    application's GeniusDeckSearchIndex, so they are never loaded.  A second heap holds one slot per deck,
+    keyed by the due time at the top of its heap, and #nextAssociation pops from the deck at its top:  a
+    k-way merge handing out associations most overdue first, whatever deck they come from.
+
+    Answers for open decks go straight to the document, see GeniusDocument#applyReviewRecord:.  Answers
+    for closed decks are appended to the review log of the deck, flagged GeniusReviewRecordDetached; the
+    deck applies them when it is next opened.  Until then the queue replays them over the summary itself,
+    so an association answered in one session is not due again in the next.
+
+    A subclass of GeniusAssociationEnumerator so that MyQuizController can run the session.  Associations
+    of closed decks are stand-ins built from the summary and only live as long as the queue.
+ */
+@interface GeniusDueQueue : GeniusAssociationEnumerator {
+    GeniusDeckSearchIndex * _searchIndex;   //!< Source of the summaries of closed decks.
+    NSMutableArray * _decks;                //!< Private GeniusDueDeck per deck with due associations.
+    unsigned int * _mergeHeap;              //!< Indexes into _decks, a min-heap on the due time at the top of each deck heap.
+    unsigned int _mergeCount;               //!< Number of decks in #_mergeHeap.
+    unsigned int _loadedCount;              //!< Due associations loaded and not yet handed out.
+    NSMutableArray * _upcoming;             //!< Associations popped ahead of #nextAssociation by #upcomingAssociations:.
+    CFMutableDictionaryRef _handedOut;      //!< GeniusAssociation -> GeniusDueDeck, for associations handed out.  Not retained.
+}
+
+- (id) initWithSearchIndex:(GeniusDeckSearchIndex *)searchIndex;
+
+- (void) loadDecksAtPaths:(NSArray *)deckPaths documents:(NSArray *)documents time:(GeniusTime)now;
+
+- (unsigned int) deckCount;
+- (NSString *) deckPathForAssociation:(GeniusAssociation *)association;
+
+- (BOOL) flush;
+
+@end
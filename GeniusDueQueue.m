@@ -0,0 +1,626 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusDueQueue.h"
+#import "GeniusDeckSearchIndex.h"
+#import "GeniusDeckSnapshot.h"
+#import "GeniusDocument.h"
+#import "GeniusReviewLog.h"
+#import "GeniusItem.h"
+
+//! Whether @a a comes before @a b in a deck heap:  earlier due time first, then pair number and direction.
+static BOOL EntryPrecedes(const GeniusDueEntry * a, const GeniusDueEntry * b)
+{
+    if (a->dueTime != b->dueTime)
+        return (a->dueTime < b->dueTime);
+    if (a->index != b->index)
+        return (a->index < b->index);
+    return (a->direction < b->direction);
+}
+
+//! Restores the heap order of @a heap after the entry at @a index was made smaller.
+static void SiftEntryUp(GeniusDueEntry * heap, unsigned int index)
+{
+    GeniusDueEntry entry = heap[index];
+    while (index > 0)
+    {
+        unsigned int parent = (index - 1) / 2;
+        if (EntryPrecedes(&entry, &heap[parent]) == NO)
+            break;
+        heap[index] = heap[parent];
+        index = parent;
+    }
+    heap[index] = entry;
+}
+
+//! Restores the heap order of the @a count entries of @a heap after the entry at @a index was made larger.
+static void SiftEntryDown(GeniusDueEntry * heap, unsigned int count, unsigned int index)
+{
+    GeniusDueEntry entry = heap[index];
+    for (;;)
+    {
+        unsigned int child = 2 * index + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && EntryPrecedes(&heap[child + 1], &heap[child]))
+            child++;
+        if (EntryPrecedes(&heap[child], &entry) == NO)
+            break;
+        heap[index] = heap[child];
+        index = child;
+    }
+    heap[index] = entry;
+}
+
+//! The due associations of one deck, kept in a binary heap, and where its answers go.
+@interface GeniusDueDeck : NSObject {
+    NSString * _path;                   //!< Deck file, nil for an untitled document.
+    GeniusDocument * _document;         //!< Open deck, or nil.
+    GeniusDeckSnapshot * _snapshot;     //!< Pairs of _document when the queue was loaded.
+    GeniusDeckSummary * _summary;       //!< Closed deck as last indexed, or nil.
+    GeniusReviewLog * _reviewLog;       //!< Closed deck:  receives the detached records.
+    NSMutableDictionary * _standIns;    //!< Closed deck:  pair number -> GeniusPair built from _summary.
+    CFMutableDictionaryRef _handedOut;  //!< GeniusAssociation -> pair number * 2 + direction + 1.  Not retained.
+    GeniusDueEntry * _heap;             //!< Due associations, a min-heap on due time.
+    unsigned int _count;                //!< Entries in _heap.
+    unsigned int _capacity;             //!< Allocated size of _heap.
+}
+- (id) initWithDocument:(GeniusDocument *)document time:(GeniusTime)now;
+- (id) initWithSummary:(GeniusDeckSummary *)summary path:(NSString *)path time:(GeniusTime)now;
+- (NSString *) path;
+- (unsigned int) count;
+- (GeniusTime) topDueTime;
+- (GeniusDueEntry) popEntry;
+- (GeniusAssociation *) associationForEntry:(GeniusDueEntry)entry;
+- (void) recordAnswer:(GeniusReviewRecord *)record ofAssociation:(GeniusAssociation *)association;
+- (void) repeatAssociation:(GeniusAssociation *)association;
+- (BOOL) flush;
+@end
+
+@interface GeniusDueDeck (Private)
+- (void) _pushEntry:(GeniusDueEntry)entry;
+- (GeniusPair *) _standInAtIndex:(unsigned int)index;
+@end
+
+@implementation GeniusDueDeck
+
+//! Loads the due associations of the open deck @a document from a snapshot.  Answers go to the document.
+- (id) initWithDocument:(GeniusDocument *)document time:(GeniusTime)now
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _path = [[document fileName] copy];
+        _document = [document retain];
+        _snapshot = [[document snapshot] retain];
+        _handedOut = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+
+        unsigned int i, count = [_snapshot count];
+        for (i=0; i<count; i++)
+        {
+            const GeniusPairRecord * record = [_snapshot recordAtIndex:i];
+            if (record->importance == kGeniusPairDisabledImportance)
+                continue;
+
+            unsigned short direction;
+            for (direction=0; direction<2; direction++)
+            {
+                GeniusDueEntry entry = { record->dueTimes[direction], i, direction, 0 };
+                if (entry.dueTime != kGeniusTimeNone && entry.dueTime <= now)
+                    [self _pushEntry:entry];
+            }
+        }
+    }
+    return self;
+}
+
+//! Loads the due associations of the closed deck at @a path from its @a summary, indexed from the deck file.
+/*! Detached answers the file doesn't hold yet are replayed over the summary first. */
+- (id) initWithSummary:(GeniusDeckSummary *)summary path:(NSString *)path time:(GeniusTime)now
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _path = [path copy];
+        _summary = [summary retain];
+        _reviewLog = [[GeniusReviewLog alloc] initWithDirectoryPath:[GeniusReviewLog logPathForDocumentPath:path]];
+        _standIns = [[NSMutableDictionary alloc] init];
+        _handedOut = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+
+        unsigned int i, count = [_summary count];
+        NSData * detachedRecords = [_reviewLog unappliedDetachedRecords];
+        unsigned int r, recordCount = [detachedRecords length] / sizeof(GeniusReviewRecord);
+        if (recordCount)
+        {
+            NSMutableDictionary * indexes = [NSMutableDictionary dictionaryWithCapacity:count];
+            for (i=0; i<count; i++)
+                [indexes setObject:[NSNumber numberWithUnsignedInt:i] forKey:[NSNumber numberWithUnsignedLongLong:[_summary pairIDAtIndex:i]]];
+
+            const GeniusReviewRecord * records = [detachedRecords bytes];
+            for (r=0; r<recordCount; r++)
+            {
+                NSNumber * index = [indexes objectForKey:[NSNumber numberWithUnsignedLongLong:records[r].associationID >> 1]];
+                if (index == nil)
+                    continue;
+                GeniusPair * pair = [self _standInAtIndex:[index unsignedIntValue]];
+                GeniusAssociation * association = ((records[r].associationID & 1) ? [pair associationBA] : [pair associationAB]);
+                [[_summary scheduler] scheduleAssociation:association outcome:records[r].outcome time:records[r].time];
+            }
+        }
+
+        for (i=0; i<count; i++)
+        {
+            if ([_summary importanceAtIndex:i] == kGeniusPairDisabledImportance)
+                continue;
+
+            GeniusPair * standIn = [_standIns objectForKey:[NSNumber numberWithUnsignedInt:i]];
+            unsigned short direction;
+            for (direction=0; direction<2; direction++)
+            {
+                GeniusDueEntry entry = { 0, i, direction, 0 };
+                if (standIn)
+                    entry.dueTime = [(direction ? [standIn associationBA] : [standIn associationAB]) dueTime];
+                else
+                    entry.dueTime = [_summary dueTimeAtIndex:i direction:direction];
+                if (entry.dueTime != kGeniusTimeNone && entry.dueTime <= now)
+                    [self _pushEntry:entry];
+            }
+        }
+    }
+    return self;
+}
+
+//! Releases the deck sources and frees the heap.
+- (void) dealloc
+{
+    [_path release];
+    [_document release];
+    [_snapshot release];
+    [_summary release];
+    [_reviewLog release];
+    [_standIns release];
+    CFRelease(_handedOut);
+    free(_heap);
+    [super dealloc];
+}
+
+//! _path getter.
+- (NSString *) path
+{
+    return _path;
+}
+
+//! Number of associations left in the heap.
+- (unsigned int) count
+{
+    return _count;
+}
+
+//! Due time of the association at the top of the heap.  The heap must not be empty.
+- (GeniusTime) topDueTime
+{
+    return _heap[0].dueTime;
+}
+
+//! Removes and returns the entry at the top of the heap.  The heap must not be empty.
+- (GeniusDueEntry) popEntry
+{
+    GeniusDueEntry entry = _heap[0];
+    _count--;
+    if (_count)
+    {
+        _heap[0] = _heap[_count];
+        SiftEntryDown(_heap, _count, 0);
+    }
+    return entry;
+}
+
+//! The association of @a entry:  the live one of an open deck, or a stand-in for a closed deck.
+/*! Returns nil if the pair is gone from the document. */
+- (GeniusAssociation *) associationForEntry:(GeniusDueEntry)entry
+{
+    GeniusPair * pair;
+    if (_document)
+        pair = [_document pairWithID:[_snapshot recordAtIndex:entry.index]->pairID];
+    else
+        pair = [self _standInAtIndex:entry.index];
+
+    GeniusAssociation * association = (entry.direction ? [pair associationBA] : [pair associationAB]);
+    if (association)
+        CFDictionarySetValue(_handedOut, association, (const void *)(size_t)(2 * entry.index + entry.direction + 1));
+    return association;
+}
+
+//! Passes the answer in @a record to the document, or logs it as detached for a closed deck.
+- (void) recordAnswer:(GeniusReviewRecord *)record ofAssociation:(GeniusAssociation *)association
+{
+    if (_document)
+    {
+        record->flags = 0;
+        [_document applyReviewRecord:record];
+    }
+    else
+    {
+        record->flags = GeniusReviewRecordDetached;
+        [_reviewLog appendRecord:record];
+        [[_summary scheduler] scheduleAssociation:association outcome:record->outcome time:record->time];
+    }
+}
+
+//! Puts @a association back in the heap at its new due time.
+- (void) repeatAssociation:(GeniusAssociation *)association
+{
+    size_t value = (size_t)CFDictionaryGetValue(_handedOut, association);
+    if (value == 0 || [association dueTime] == kGeniusTimeNone)
+        return;
+
+    GeniusDueEntry entry = { [association dueTime], (value - 1) / 2, (value - 1) % 2, 1 };
+    [self _pushEntry:entry];
+}
+
+//! Writes buffered detached records to the review log of a closed deck.
+- (BOOL) flush
+{
+    return (_reviewLog ? [_reviewLog flush] : YES);
+}
+
+@end
+
+
+@implementation GeniusDueDeck (Private)
+
+//! Adds @a entry to the heap, growing it as needed.
+- (void) _pushEntry:(GeniusDueEntry)entry
+{
+    if (_count == _capacity)
+    {
+        _capacity = (_capacity ? 2 * _capacity : 16);
+        _heap = realloc(_heap, _capacity * sizeof(GeniusDueEntry));
+    }
+    _heap[_count] = entry;
+    SiftEntryUp(_heap, _count);
+    _count++;
+}
+
+//! The pair number @a index of a closed deck, built from the summary on first use and kept afterwards.
+- (GeniusPair *) _standInAtIndex:(unsigned int)index
+{
+    NSNumber * key = [NSNumber numberWithUnsignedInt:index];
+    GeniusPair * pair = [_standIns objectForKey:key];
+    if (pair)
+        return pair;
+
+    GeniusItem * itemA = [[[GeniusItem alloc] init] autorelease];
+    [itemA setStringValue:[_summary questionAtIndex:index]];
+    GeniusItem * itemB = [[[GeniusItem alloc] init] autorelease];
+    [itemB setStringValue:[_summary answerAtIndex:index]];
+    pair = [[GeniusPair alloc] initWithItemA:itemA itemB:itemB userDict:[NSMutableDictionary dictionary] pairID:[_summary pairIDAtIndex:index]];
+
+    unsigned int direction;
+    for (direction=0; direction<2; direction++)
+    {
+        GeniusAssociation * association = (direction ? [pair associationBA] : [pair associationAB]);
+        int score = [_summary scoreAtIndex:index direction:direction];
+        if (score >= 0)
+            [association setScore:score];
+        [association setDueTime:[_summary dueTimeAtIndex:index direction:direction]];
+    }
+    [_standIns setObject:pair forKey:key];
+    [pair release];
+    return pair;
+}
+
+@end
+
+
+@interface GeniusDueQueue (Private)
+- (GeniusTime) _currentTime;
+- (BOOL) _deck:(unsigned int)a precedesDeck:(unsigned int)b;
+- (void) _siftDeckUp:(unsigned int)position;
+- (void) _siftDeckDown:(unsigned int)position;
+- (GeniusAssociation *) _popAssociation;
+- (void) _answerAssociation:(GeniusAssociation *)association outcome:(GeniusReviewOutcome)outcome;
+@end
+
+//! k-way merge of the deck heaps.
+@implementation GeniusDueQueue
+
+//! Creates an empty queue reading closed decks from @a searchIndex.  See #loadDecksAtPaths:documents:time:.
+- (id) initWithSearchIndex:(GeniusDeckSearchIndex *)searchIndex
+{
+    self = [super initWithAssociations:[NSArray array]];
+    if (self != nil)
+    {
+        _searchIndex = [searchIndex retain];
+        _decks = [[NSMutableArray alloc] init];
+        _upcoming = [[NSMutableArray alloc] init];
+        _handedOut = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+        _hasPerformedChooseAssociations = YES;
+    }
+    return self;
+}
+
+//! Writes pending answers, releases the decks and frees the merge heap.
+- (void) dealloc
+{
+    [self flush];
+    [_searchIndex release];
+    [_decks release];
+    [_upcoming release];
+    CFRelease(_handedOut);
+    free(_mergeHeap);
+    [super dealloc];
+}
+
+//! Loads everything due at @a now in the open GeniusDocument objects of @a documents and the indexed decks of @a deckPaths.
+/*! Decks of @a deckPaths that are open, or not in the search index, are skipped. */
+- (void) loadDecksAtPaths:(NSArray *)deckPaths documents:(NSArray *)documents time:(GeniusTime)now
+{
+    [self flush];
+    [_decks removeAllObjects];
+    [_upcoming removeAllObjects];
+    CFDictionaryRemoveAllValues(_handedOut);
+    _loadedCount = 0;
+
+    NSMutableSet * openPaths = [NSMutableSet set];
+    NSEnumerator * documentEnumerator = [documents objectEnumerator];
+    id document;
+    while ((document = [documentEnumerator nextObject]))
+    {
+        if ([document isKindOfClass:[GeniusDocument class]] == NO)
+            continue;
+        if ([document fileName])
+            [openPaths addObject:[document fileName]];
+
+        GeniusDueDeck * deck = [[GeniusDueDeck alloc] initWithDocument:document time:now];
+        if ([deck count])
+            [_decks addObject:deck];
+        [deck release];
+    }
+
+    NSEnumerator * pathEnumerator = [deckPaths objectEnumerator];
+    NSString * deckPath;
+    while ((deckPath = [pathEnumerator nextObject]))
+    {
+        if ([openPaths containsObject:deckPath])
+            continue;
+        GeniusDeckSummary * summary = [_searchIndex summaryForDeckAtPath:deckPath];
+        if (summary == nil)
+            continue;
+
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        GeniusDueDeck * deck = [[GeniusDueDeck alloc] initWithSummary:summary path:deckPath time:now];
+        if ([deck count])
+            [_decks addObject:deck];
+        [deck release];
+        [pool release];
+    }
+
+    _mergeCount = [_decks count];
+    _mergeHeap = realloc(_mergeHeap, MAX(_mergeCount, 1U) * sizeof(unsigned int));
+    unsigned int i;
+    for (i=0; i<_mergeCount; i++)
+    {
+        _mergeHeap[i] = i;
+        _loadedCount += [[_decks objectAtIndex:i] count];
+    }
+    for (i=_mergeCount/2; i>0; i--)
+        [self _siftDeckDown:i-1];
+}
+
+//! Number of decks with something due when the queue was loaded.
+- (unsigned int) deckCount
+{
+    return [_decks count];
+}
+
+//! Path of the deck of @a association handed out by #nextAssociation, or nil.
+- (NSString *) deckPathForAssociation:(GeniusAssociation *)association
+{
+    return [(GeniusDueDeck *)CFDictionaryGetValue(_handedOut, association) path];
+}
+
+//! Writes the detached answers buffered for closed decks to their review logs.
+- (BOOL) flush
+{
+    BOOL result = YES;
+    NSEnumerator * deckEnumerator = [_decks objectEnumerator];
+    GeniusDueDeck * deck;
+    while ((deck = [deckEnumerator nextObject]))
+        result = [deck flush] && result;
+    return result;
+}
+
+//! The queue is filled by #loadDecksAtPaths:documents:time:, not by the selection of the superclass.
+- (void) performChooseAssociations
+{
+}
+
+//! Loaded associations not yet handed out.  Repeats of wrong answers are not counted.
+- (int) remainingCount
+{
+    return _loadedCount + [_upcoming count];
+}
+
+//! The most overdue association of all decks, or nil when nothing is due any more.
+- (GeniusAssociation *) nextAssociation
+{
+    GeniusAssociation * association;
+    if ([_upcoming count])
+    {
+        association = [[[_upcoming objectAtIndex:0] retain] autorelease];
+        [_upcoming removeObjectAtIndex:0];
+    }
+    else
+        association = [self _popAssociation];
+
+    _presentationTime = [NSDate timeIntervalSinceReferenceDate];
+    _matchScore = -1.0;
+    return association;
+}
+
+//! Pops up to @a count associations ahead of #nextAssociation, so their media can be prefetched.
+- (NSArray *) upcomingAssociations:(unsigned int)count
+{
+    GeniusAssociation * association;
+    while ([_upcoming count] < count && (association = [self _popAssociation]))
+        [_upcoming addObject:association];
+    return [_upcoming subarrayWithRange:NSMakeRange(0, MIN(count, [_upcoming count]))];
+}
+
+//! Records a right answer in the deck of @a association.
+- (void) associationRight:(GeniusAssociation *)association
+{
+    [self _answerAssociation:association outcome:GeniusReviewOutcomeRight];
+}
+
+//! Records a wrong answer in the deck of @a association and puts it back in the queue.
+- (void) associationWrong:(GeniusAssociation *)association
+{
+    [self _answerAssociation:association outcome:GeniusReviewOutcomeWrong];
+}
+
+//! Records a skipped @a association in its deck.
+- (void) associationSkip:(GeniusAssociation *)association
+{
+    [self _answerAssociation:association outcome:GeniusReviewOutcomeSkip];
+}
+
+@end
+
+
+@implementation GeniusDueQueue (Private)
+
+//! Time set by GeniusAssociationEnumerator#setTime:, or the clock.
+- (GeniusTime) _currentTime
+{
+    return (_time == kGeniusTimeNone ? GeniusTimeNow() : _time);
+}
+
+//! Whether deck number @a a belongs above deck number @a b in the merge heap.
+- (BOOL) _deck:(unsigned int)a precedesDeck:(unsigned int)b
+{
+    GeniusTime timeA = [[_decks objectAtIndex:a] topDueTime];
+    GeniusTime timeB = [[_decks objectAtIndex:b] topDueTime];
+    return (timeA < timeB || (timeA == timeB && a < b));
+}
+
+//! Moves the deck at @a position of the merge heap up after its top due time got earlier.
+- (void) _siftDeckUp:(unsigned int)position
+{
+    unsigned int deck = _mergeHeap[position];
+    while (position > 0)
+    {
+        unsigned int parent = (position - 1) / 2;
+        if ([self _deck:deck precedesDeck:_mergeHeap[parent]] == NO)
+            break;
+        _mergeHeap[position] = _mergeHeap[parent];
+        position = parent;
+    }
+    _mergeHeap[position] = deck;
+}
+
+//! Moves the deck at @a position of the merge heap down after its top due time got later.
+- (void) _siftDeckDown:(unsigned int)position
+{
+    unsigned int deck = _mergeHeap[position];
+    for (;;)
+    {
+        unsigned int child = 2 * position + 1;
+        if (child >= _mergeCount)
+            break;
+        if (child + 1 < _mergeCount && [self _deck:_mergeHeap[child + 1] precedesDeck:_mergeHeap[child]])
+            child++;
+        if ([self _deck:_mergeHeap[child] precedesDeck:deck] == NO)
+            break;
+        _mergeHeap[position] = _mergeHeap[child];
+        position = child;
+    }
+    _mergeHeap[position] = deck;
+}
+
+//! Takes the earliest entry off the deck at the top of the merge heap, if it is due.
+- (GeniusAssociation *) _popAssociation
+{
+    GeniusTime now = [self _currentTime];
+    while (_mergeCount && [[_decks objectAtIndex:_mergeHeap[0]] topDueTime] <= now)
+    {
+        GeniusDueDeck * deck = [_decks objectAtIndex:_mergeHeap[0]];
+        GeniusDueEntry entry = [deck popEntry];
+        if ([deck count])
+            [self _siftDeckDown:0];
+        else
+        {
+            _mergeHeap[0] = _mergeHeap[--_mergeCount];
+            if (_mergeCount)
+                [self _siftDeckDown:0];
+        }
+        if (entry.isRepeat == NO)
+            _loadedCount--;
+
+        GeniusAssociation * association = [deck associationForEntry:entry];
+        if (association)
+        {
+            CFDictionarySetValue(_handedOut, association, deck);
+            return association;
+        }
+    }
+    return nil;
+}
+
+//! Passes @a outcome for @a association to its deck, and puts wrong answers back in the queue.
+- (void) _answerAssociation:(GeniusAssociation *)association outcome:(GeniusReviewOutcome)outcome
+{
+    GeniusDueDeck * deck = (GeniusDueDeck *)CFDictionaryGetValue(_handedOut, association);
+    if (deck == nil)
+        return;
+
+    NSTimeInterval responseTime = [NSDate timeIntervalSinceReferenceDate] - _presentationTime;
+    GeniusReviewRecord record;
+    record.associationID = [association associationID];
+    record.time = [self _currentTime];
+    record.responseMilliseconds = (unsigned int)(MAX(responseTime, 0.0) * 1000.0);
+    record.matchScore = _matchScore;
+    record.outcome = outcome;
+    record.flags = 0;
+    [deck recordAnswer:&record ofAssociation:association];
+    if (outcome != GeniusReviewOutcomeWrong)
+        return;
+
+    // Back into the heap of its deck, and the deck back into the merge heap.
+    unsigned int deckIndex = [_decks indexOfObjectIdenticalTo:deck];
+    BOOL wasEmpty = ([deck count] == 0);
+    [deck repeatAssociation:association];
+    if ([deck count] == 0)
+        return;
+
+    unsigned int position;
+    if (wasEmpty)
+    {
+        position = _mergeCount++;
+        _mergeHeap[position] = deckIndex;
+    }
+    else
+    {
+        for (position=0; position<_mergeCount && _mergeHeap[position] != deckIndex; position++)
+            ;
+    }
+    [self _siftDeckUp:position];   // a new entry can only make the top of the deck earlier
+}
+
+@end
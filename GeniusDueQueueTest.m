@@ -0,0 +1,139 @@
+//
+//  GeniusDueQueueTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusDueQueue.h"
+#import "GeniusDeckSearchIndex.h"
+#import "GeniusDeckSnapshot.h"
+#import "GeniusReviewLog.h"
+#import "GeniusItem.h"
+
+@interface GeniusDueQueueTest : SenTestCase {
+    NSString *directoryPath;        //!< Temporary folder holding the index and the deck paths.
+    GeniusDeckSearchIndex *index;   //!< Summaries of the closed decks.
+    GeniusTime now;                 //!< Time of the review session.
+}
+
+@end
+
+//! Tests for the GeniusDueQueue merge of several closed decks.
+@implementation GeniusDueQueueTest
+
+//! Opens an empty index in a temporary folder for each test.
+- (void) setUp
+{
+    NSString * name = [[NSProcessInfo processInfo] globallyUniqueString];
+    directoryPath = [[NSTemporaryDirectory() stringByAppendingPathComponent:name] retain];
+    index = [[GeniusDeckSearchIndex alloc] initWithDirectoryPath:[directoryPath stringByAppendingPathComponent:@"Index"]];
+    now = 1200000000LL;
+}
+
+//! Deletes the folder.
+- (void) tearDown
+{
+    [index release];
+    index = nil;
+    [[NSFileManager defaultManager] removeFileAtPath:directoryPath handler:nil];
+    [directoryPath release];
+    directoryPath = nil;
+}
+
+//! Indexes a deck named @a name whose pair @c i is "name i" and due @a ages[i] seconds ago, or not scheduled for a negative age.
+/*! Returns the deck path.  The deck file itself is never written. */
+- (NSString *) _indexDeck:(NSString *)name ages:(const int *)ages count:(unsigned int)count
+{
+    NSMutableArray * pairs = [NSMutableArray array];
+    unsigned int i;
+    for (i=0; i<count; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setValue:[NSString stringWithFormat:@"%@ %u", name, i] forKey:@"stringValue"];
+        [[pair itemB] setValue:@"answer" forKey:@"stringValue"];
+        if (ages[i] >= 0)
+        {
+            [[pair associationAB] setScore:1];
+            [[pair associationAB] setDueTime:now - ages[i]];
+        }
+        [pairs addObject:pair];
+        [pair release];
+    }
+
+    NSString * deckPath = [directoryPath stringByAppendingPathComponent:[name stringByAppendingPathExtension:@"genius"]];
+    GeniusDeckStore * store = [[[GeniusDeckStore alloc] initWithPairs:pairs] autorelease];
+    NSData * segmentData = [GeniusDeckSearchIndex segmentDataWithSnapshot:[store snapshot] scheduler:nil];
+    NSDate * modificationDate = [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)(now - 1000)];
+    STAssertTrue([index setSegmentData:segmentData forDeckAtPath:deckPath modificationDate:modificationDate], nil);
+    return deckPath;
+}
+
+//! Returns a queue loaded at #now from every indexed deck.
+- (GeniusDueQueue *) _loadedQueue
+{
+    GeniusDueQueue * queue = [[[GeniusDueQueue alloc] initWithSearchIndex:index] autorelease];
+    [queue setTime:now];
+    [queue loadDecksAtPaths:[index deckPaths] documents:nil time:now];
+    return queue;
+}
+
+//! Associations of all decks come out most overdue first; future and unscheduled ones stay out.
+- (void) testMergeOrder
+{
+    const int agesA[4] = { 50, 10, -1, 30 };
+    const int agesB[3] = { 40, 20, 60 };
+    const int agesC[2] = { -1, -100 };
+    [self _indexDeck:@"A" ages:agesA count:4];
+    [self _indexDeck:@"B" ages:agesB count:3];
+    [self _indexDeck:@"C" ages:agesC count:2];
+
+    GeniusDueQueue * queue = [self _loadedQueue];
+    STAssertEquals([queue deckCount], 2U, nil);
+    STAssertEquals([queue remainingCount], 6, nil);
+
+    NSArray * expected = [NSArray arrayWithObjects:@"B 2", @"A 0", @"B 0", @"A 3", @"B 1", @"A 1", nil];
+    NSMutableArray * cues = [NSMutableArray array];
+    GeniusAssociation * association;
+    while ((association = [queue nextAssociation]))
+    {
+        [cues addObject:[[association cueItem] stringValue]];
+        [queue associationRight:association];
+    }
+    STAssertEqualObjects(cues, expected, nil);
+    STAssertEquals([queue remainingCount], 0, nil);
+}
+
+//! Answers for closed decks go to their review logs as detached records, and are not due again in the next session.
+- (void) testWriteBack
+{
+    const int ages[3] = { 30, 20, 10 };
+    NSString * deckPath = [self _indexDeck:@"A" ages:ages count:3];
+
+    GeniusDueQueue * queue = [self _loadedQueue];
+    GeniusAssociation * first = [queue nextAssociation];
+    STAssertEqualObjects([queue deckPathForAssociation:first], deckPath, nil);
+    [queue associationRight:first];
+    GeniusAssociation * second = [queue nextAssociation];
+    [queue associationWrong:second];
+    STAssertTrue([queue flush], nil);
+
+    GeniusReviewLog * log = [[[GeniusReviewLog alloc] initWithDirectoryPath:[GeniusReviewLog logPathForDocumentPath:deckPath]] autorelease];
+    NSData * data = [log unappliedDetachedRecords];
+    STAssertEquals([data length], 2 * sizeof(GeniusReviewRecord), nil);
+    const GeniusReviewRecord * records = [data bytes];
+    STAssertEquals(records[0].associationID, [first associationID], nil);
+    STAssertEquals(records[0].outcome, (int)GeniusReviewOutcomeRight, nil);
+    STAssertEquals(records[1].outcome, (int)GeniusReviewOutcomeWrong, nil);
+
+    // The right answer moved the first association into the future; the wrong one is due again.
+    now += 10;
+    queue = [self _loadedQueue];
+    STAssertEquals([queue remainingCount], 2, nil);
+    STAssertEqualObjects([[[queue nextAssociation] cueItem] stringValue], @"A 2", nil);
+    STAssertEqualObjects([[[queue nextAssociation] cueItem] stringValue], [[second cueItem] stringValue], nil);
+}
+
+@end
@@ -0,0 +1,61 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusAssociation.h"
+
+@class GeniusPairColumns;
+@class GeniusFuzzyIndex;
+
+typedef struct _GeniusFilterPredicate GeniusFilterPredicate;
+
+//! Structured search field query such as <tt>group:verbs type:irregular scoreAB<3 due<today importance>=7</tt>.
+/*!
+    A query is a list of whitespace separated terms, all of which must hold.  Double quotes group words
+    into one term, and a leading @c - negates a term.
+
+    - <tt>question:</tt>, <tt>answer:</tt>, <tt>group:</tt>, <tt>type:</tt>, <tt>notes:</tt> and <tt>text:</tt>
+      (all of them) match pairs where each word of the value is part of a word of that field.
+    - @c importance, @c scoreAB, @c scoreBA and @c score (either direction) compare with
+      <tt>< <= > >= = != :</tt> against a number; scores also accept @c new for never quizzed.
+    - @c dueAB, @c dueBA and @c due (either direction) take @c now, @c today, @c tomorrow, @c yesterday,
+      a date such as @c 2008-06-30, or an offset from now such as @c 3d, @c -12h or @c 2w.  Day values
+      cover the whole day:  <tt>due<today</tt> is overdue from before today, <tt>due<=today</tt> includes today.
+      Unscheduled associations never match a due comparison.
+    - Anything else is a bare word, searched in all text fields.
+
+    Queries compile to a list of GeniusFilterPredicate.  Text predicates are answered by the deck's
+    GeniusFuzzyIndex as a row bitmap; numeric predicates are range checks over the packed columns of a
+    GeniusPairColumns.  Each evaluation first estimates the fraction of rows each predicate keeps, exactly for
+    text and from a sample of rows for numbers, and runs the most selective one first over the whole deck.
+    Every following predicate only looks at the survivors of the previous ones.
+ */
+@interface GeniusFilterQuery : NSObject {
+    GeniusFilterPredicate * _predicates;    //!< Terms in the order typed.
+    unsigned int _count;                    //!< Number of _predicates.
+}
+
++ (GeniusFilterQuery *) queryWithString:(NSString *)string time:(GeniusTime)now;
+
+- (unsigned int) predicateCount;
+
+- (NSArray *) planForColumns:(GeniusPairColumns *)columns textIndex:(GeniusFuzzyIndex *)textIndex;
+- (NSArray *) filteredPairsFromColumns:(GeniusPairColumns *)columns textIndex:(GeniusFuzzyIndex *)textIndex;
+
+@end
@@ -0,0 +1,603 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusFilterQuery.h"
+#import "GeniusPairColumns.h"
+#import "GeniusFuzzyIndex.h"
+#import "GeniusTimingWheel.h"   // kGeniusTimeDay
+#include <ctype.h>              // isalpha
+#include <limits.h>             // LLONG_MIN, LLONG_MAX
+#include <math.h>               // floor
+#include <strings.h>            // ffs
+
+//! Rows sampled to estimate how selective a numeric predicate is.
+#define kGeniusFilterSampleSize 256
+
+//! Every text field, in the order of GeniusArrayController#fuzzyKeyPaths.
+#define kGeniusFilterAllTextFields 0x1F
+
+//! Packed columns a numeric GeniusFilterPredicate can test, as bits of GeniusFilterPredicate#columns.
+enum {
+    GeniusFilterColumnImportance = 1 << 0,
+    GeniusFilterColumnScoreAB = 1 << 1,
+    GeniusFilterColumnScoreBA = 1 << 2,
+    GeniusFilterColumnDueAB = 1 << 3,
+    GeniusFilterColumnDueBA = 1 << 4
+};
+
+//! Kind of a GeniusFilterPredicate.
+typedef enum {
+    GeniusFilterPredicateText = 0,      //!< Words of text fields, looked up in a GeniusFuzzyIndex.
+    GeniusFilterPredicateInteger,       //!< Range of int columns.
+    GeniusFilterPredicateTime           //!< Range of GeniusTime columns.
+} GeniusFilterPredicateKind;
+
+//! Comparison of a field term.
+typedef enum {
+    GeniusFilterOperatorNone = 0,
+    GeniusFilterOperatorLess,
+    GeniusFilterOperatorLessOrEqual,
+    GeniusFilterOperatorGreater,
+    GeniusFilterOperatorGreaterOrEqual,
+    GeniusFilterOperatorEqual,          //!< @c = or @c :
+    GeniusFilterOperatorNotEqual
+} GeniusFilterOperator;
+
+//! One term of a GeniusFilterQuery.
+struct _GeniusFilterPredicate {
+    GeniusFilterPredicateKind kind;
+    NSString * term;            //!< The term as typed, for GeniusFilterQuery#planForColumns:textIndex:.
+    BOOL negated;               //!< Term started with @c - or used @c !=.
+    NSString * text;            //!< Words looked up by text predicates.
+    unsigned int fieldMask;     //!< Text fields searched, bits in the order of GeniusArrayController#fuzzyKeyPaths.
+    unsigned int columns;       //!< Columns tested by numeric predicates.  A row passes if any of them is in range.
+    long long minimum;          //!< Inclusive lower bound of numeric predicates.
+    long long maximum;          //!< Inclusive upper bound of numeric predicates.
+};
+
+//! A predicate of a GeniusFilterQuery prepared for one evaluation.
+typedef struct _GeniusFilterPlanStep {
+    GeniusFilterPredicate * predicate;
+    uint32_t * bitmap;          //!< Rows a text predicate matches, before negation.  NULL for numeric predicates.
+    BOOL matchesAll;            //!< Text predicate without any words.
+    double selectivity;         //!< Estimated fraction of rows kept.
+} GeniusFilterPlanStep;
+
+//! Text field names and the fields they search.
+static const struct { const char * name; unsigned int fieldMask; } kTextFields[] = {
+    { "question", 1 << 0 }, { "a", 1 << 0 },
+    { "answer", 1 << 1 }, { "b", 1 << 1 },
+    { "group", 1 << 2 },
+    { "type", 1 << 3 },
+    { "notes", 1 << 4 },
+    { "text", kGeniusFilterAllTextFields }
+};
+
+//! Numeric field names and the columns they test.
+static const struct { const char * name; GeniusFilterPredicateKind kind; unsigned int columns; } kNumericFields[] = {
+    { "importance", GeniusFilterPredicateInteger, GeniusFilterColumnImportance },
+    { "scoreab", GeniusFilterPredicateInteger, GeniusFilterColumnScoreAB },
+    { "scoreba", GeniusFilterPredicateInteger, GeniusFilterColumnScoreBA },
+    { "score", GeniusFilterPredicateInteger, GeniusFilterColumnScoreAB | GeniusFilterColumnScoreBA },
+    { "dueab", GeniusFilterPredicateTime, GeniusFilterColumnDueAB },
+    { "dueba", GeniusFilterPredicateTime, GeniusFilterColumnDueBA },
+    { "due", GeniusFilterPredicateTime, GeniusFilterColumnDueAB | GeniusFilterColumnDueBA }
+};
+
+//! Splits @a string at whitespace outside double quotes.  The quotes themselves are dropped.
+static NSArray * TermsInString(NSString * string)
+{
+    NSMutableArray * terms = [NSMutableArray array];
+    NSMutableString * term = [NSMutableString string];
+    NSCharacterSet * whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+    BOOL quoted = NO;
+    unsigned int i, length = [string length];
+    for (i=0; i<=length; i++)
+    {
+        unichar c = (i < length ? [string characterAtIndex:i] : ' ');
+        if (c == '"' && i < length)
+        {
+            quoted = !quoted;
+            continue;
+        }
+        if (i == length || (quoted == NO && [whitespace characterIsMember:c]))
+        {
+            if ([term length] > 0)
+                [terms addObject:[NSString stringWithString:term]];
+            [term setString:@""];
+            continue;
+        }
+        CFStringAppendCharacters((CFMutableStringRef)term, &c, 1);
+    }
+    return terms;
+}
+
+//! Reads the comparison starting at @a index of @a string and stores its length in @a length.
+static GeniusFilterOperator ParseOperator(NSString * string, unsigned int index, unsigned int * length)
+{
+    unsigned int remaining = [string length] - index;
+    unichar first = (remaining > 0 ? [string characterAtIndex:index] : 0);
+    unichar second = (remaining > 1 ? [string characterAtIndex:index+1] : 0);
+
+    *length = 2;
+    if (first == '<' && second == '=')
+        return GeniusFilterOperatorLessOrEqual;
+    if (first == '>' && second == '=')
+        return GeniusFilterOperatorGreaterOrEqual;
+    if (first == '!' && second == '=')
+        return GeniusFilterOperatorNotEqual;
+
+    *length = 1;
+    if (first == '<')
+        return GeniusFilterOperatorLess;
+    if (first == '>')
+        return GeniusFilterOperatorGreater;
+    if (first == '=' || first == ':')
+        return GeniusFilterOperatorEqual;
+
+    *length = 0;
+    return GeniusFilterOperatorNone;
+}
+
+//! Parses @a string as a whole decimal number.
+static BOOL ParseInteger(NSString * string, long long * value)
+{
+    if ([string hasPrefix:@"+"])
+        string = [string substringFromIndex:1];
+    NSScanner * scanner = [NSScanner scannerWithString:string];
+    return ([scanner scanLongLong:value] && [scanner isAtEnd]);
+}
+
+//! Start of the day @a dayOffset days after the day of @a time, in the local time zone.
+static GeniusTime StartOfDay(GeniusTime time, int dayOffset)
+{
+    NSCalendarDate * date = [NSCalendarDate dateWithTimeIntervalSince1970:(NSTimeInterval)time];
+    NSCalendarDate * midnight = [NSCalendarDate dateWithYear:[date yearOfCommonEra] month:[date monthOfYear] day:[date dayOfMonth]
+        hour:0 minute:0 second:0 timeZone:[date timeZone]];
+    midnight = [midnight dateByAddingYears:0 months:0 days:dayOffset hours:0 minutes:0 seconds:0];
+    return (GeniusTime)floor([midnight timeIntervalSince1970]);
+}
+
+//! Parses the due time @a string into the inclusive range of times it stands for, relative to @a now.
+static BOOL ParseTime(NSString * string, GeniusTime now, GeniusTime * start, GeniusTime * end)
+{
+    NSString * value = [string lowercaseString];
+    if ([value isEqualToString:@"now"])
+    {
+        *start = *end = now;
+        return YES;
+    }
+
+    int dayOffset = 0;
+    BOOL isDay = YES;
+    if ([value isEqualToString:@"today"])
+        dayOffset = 0;
+    else if ([value isEqualToString:@"tomorrow"])
+        dayOffset = 1;
+    else if ([value isEqualToString:@"yesterday"])
+        dayOffset = -1;
+    else
+        isDay = NO;
+    if (isDay)
+    {
+        *start = StartOfDay(now, dayOffset);
+        *end = StartOfDay(now, dayOffset + 1) - 1;
+        return YES;
+    }
+
+    // Offsets from now such as 3d, -12h or 2w.
+    unsigned int length = [value length];
+    GeniusTime unit = 0;
+    switch (length > 1 ? [value characterAtIndex:length-1] : 0)
+    {
+        case 'm': unit = 60; break;
+        case 'h': unit = 3600; break;
+        case 'd': unit = kGeniusTimeDay; break;
+        case 'w': unit = 7 * kGeniusTimeDay; break;
+    }
+    if (unit)
+    {
+        long long count;
+        if (ParseInteger([value substringToIndex:length-1], &count) == NO || llabs(count) > 1000000)
+            return NO;
+        *start = *end = now + count * unit;
+        return YES;
+    }
+
+    NSCalendarDate * date = [NSCalendarDate dateWithString:value calendarFormat:@"%Y-%m-%d"];
+    if (date == nil)
+        return NO;
+    *start = (GeniusTime)floor([date timeIntervalSince1970]);
+    *end = StartOfDay(*start, 1) - 1;
+    return YES;
+}
+
+//! Fills @a predicate for the field term <tt>name op value</tt>.  Returns NO if @a name is no field or @a value does not fit it.
+static BOOL CompileFieldTerm(GeniusFilterPredicate * predicate, NSString * name, GeniusFilterOperator op, NSString * value, GeniusTime now)
+{
+    const char * fieldName = [[name lowercaseString] UTF8String];
+    unsigned int i;
+    for (i=0; i<sizeof(kTextFields)/sizeof(kTextFields[0]); i++)
+    {
+        if (strcmp(fieldName, kTextFields[i].name) != 0)
+            continue;
+        if ((op != GeniusFilterOperatorEqual && op != GeniusFilterOperatorNotEqual) || [value length] == 0)
+            return NO;
+        predicate->kind = GeniusFilterPredicateText;
+        predicate->text = value;
+        predicate->fieldMask = kTextFields[i].fieldMask;
+        if (op == GeniusFilterOperatorNotEqual)
+            predicate->negated = !predicate->negated;
+        return YES;
+    }
+
+    for (i=0; i<sizeof(kNumericFields)/sizeof(kNumericFields[0]); i++)
+    {
+        if (strcmp(fieldName, kNumericFields[i].name) != 0)
+            continue;
+
+        long long start, end;
+        long long lowest = LLONG_MIN + 1, highest = LLONG_MAX - 1;
+        if (kNumericFields[i].kind == GeniusFilterPredicateTime)
+        {
+            GeniusTime startTime, endTime;
+            if (ParseTime(value, now, &startTime, &endTime) == NO)
+                return NO;
+            start = startTime;
+            end = endTime;
+            lowest = kGeniusTimeNone + 1;   // unscheduled never matches
+        }
+        else if ((kNumericFields[i].columns & GeniusFilterColumnImportance) == 0 && [[value lowercaseString] isEqualToString:@"new"])
+            start = end = -1;
+        else if (ParseInteger(value, &start))
+            end = start;
+        else
+            return NO;
+        if (start < lowest || end > highest)
+            return NO;
+
+        predicate->kind = kNumericFields[i].kind;
+        predicate->columns = kNumericFields[i].columns;
+        predicate->minimum = start;
+        predicate->maximum = end;
+        switch (op)
+        {
+            case GeniusFilterOperatorLess:
+                predicate->minimum = lowest;
+                predicate->maximum = start - 1;
+                break;
+            case GeniusFilterOperatorLessOrEqual:
+                predicate->minimum = lowest;
+                break;
+            case GeniusFilterOperatorGreater:
+                predicate->minimum = end + 1;
+                predicate->maximum = highest;
+                break;
+            case GeniusFilterOperatorGreaterOrEqual:
+                predicate->maximum = highest;
+                break;
+            case GeniusFilterOperatorNotEqual:
+                predicate->negated = !predicate->negated;
+                break;
+            default:
+                break;
+        }
+        return YES;
+    }
+    return NO;
+}
+
+//! Whether @a value lies in <tt>[minimum, minimum + width]</tt>, with a single unsigned comparison.
+static __inline__ unsigned int InRange(long long value, long long minimum, unsigned long long width)
+{
+    return ((unsigned long long)value - (unsigned long long)minimum) <= width;
+}
+
+//! Compacts @a rows to those whose value in @a first or @a second is in range of @a predicate.  Returns the number kept.
+static unsigned int FilterIntegerRows(const GeniusFilterPredicate * predicate, const int * first, const int * second, unsigned int * rows, unsigned int count)
+{
+    long long minimum = predicate->minimum;
+    unsigned long long width = (unsigned long long)predicate->maximum - (unsigned long long)minimum;
+    unsigned int negated = (predicate->negated ? 1 : 0);
+    unsigned int i, kept = 0;
+    for (i=0; i<count; i++)
+    {
+        unsigned int row = rows[i];
+        rows[kept] = row;
+        kept += (InRange(first[row], minimum, width) | InRange(second[row], minimum, width)) ^ negated;
+    }
+    return kept;
+}
+
+//! GeniusTime counterpart of FilterIntegerRows().
+static unsigned int FilterTimeRows(const GeniusFilterPredicate * predicate, const GeniusTime * first, const GeniusTime * second, unsigned int * rows, unsigned int count)
+{
+    long long minimum = predicate->minimum;
+    unsigned long long width = (unsigned long long)predicate->maximum - (unsigned long long)minimum;
+    unsigned int negated = (predicate->negated ? 1 : 0);
+    unsigned int i, kept = 0;
+    for (i=0; i<count; i++)
+    {
+        unsigned int row = rows[i];
+        rows[kept] = row;
+        kept += (InRange(first[row], minimum, width) | InRange(second[row], minimum, width)) ^ negated;
+    }
+    return kept;
+}
+
+//! Compacts @a rows to those set in @a bitmap, or clear if @a negated.  Returns the number kept.
+static unsigned int FilterBitmapRows(const uint32_t * bitmap, BOOL negated, unsigned int * rows, unsigned int count)
+{
+    unsigned int flip = (negated ? 1 : 0);
+    unsigned int i, kept = 0;
+    for (i=0; i<count; i++)
+    {
+        unsigned int row = rows[i];
+        rows[kept] = row;
+        kept += ((bitmap[row >> 5] >> (row & 31)) & 1) ^ flip;
+    }
+    return kept;
+}
+
+
+@interface GeniusFilterQuery (Private)
+- (BOOL) _addTerm:(NSString *)term time:(GeniusTime)now;
+- (GeniusFilterPlanStep *) _planForColumns:(GeniusPairColumns *)columns textIndex:(GeniusFuzzyIndex *)textIndex;
+- (unsigned int) _filterRows:(unsigned int *)rows count:(unsigned int)count step:(const GeniusFilterPlanStep *)step columns:(GeniusPairColumns *)columns;
+@end
+
+@implementation GeniusFilterQuery
+
+//! Compiles @a string, resolving relative due times against @a now.
+/*! Returns @c nil unless @a string has at least one field term, so that plain searches keep their old meaning. */
++ (GeniusFilterQuery *) queryWithString:(NSString *)string time:(GeniusTime)now
+{
+    GeniusFilterQuery * query = [[[GeniusFilterQuery alloc] init] autorelease];
+    BOOL hasFieldTerm = NO;
+    NSEnumerator * termEnumerator = [TermsInString(string) objectEnumerator];
+    NSString * term;
+    while ((term = [termEnumerator nextObject]))
+        hasFieldTerm |= [query _addTerm:term time:now];
+    return (hasFieldTerm ? query : nil);
+}
+
+//! Releases the predicates and deallocates memory.
+- (void) dealloc
+{
+    unsigned int i;
+    for (i=0; i<_count; i++)
+    {
+        [_predicates[i].term release];
+        [_predicates[i].text release];
+    }
+    free(_predicates);
+    [super dealloc];
+}
+
+//! Number of terms.
+- (unsigned int) predicateCount
+{
+    return _count;
+}
+
+//! Terms in the order #filteredPairsFromColumns:textIndex: would evaluate them for @a columns.
+- (NSArray *) planForColumns:(GeniusPairColumns *)columns textIndex:(GeniusFuzzyIndex *)textIndex
+{
+    NSMutableArray * terms = [NSMutableArray arrayWithCapacity:_count];
+    GeniusFilterPlanStep * steps = [self _planForColumns:columns textIndex:textIndex];
+    unsigned int i;
+    for (i=0; i<_count; i++)
+    {
+        [terms addObject:steps[i].predicate->term];
+        free(steps[i].bitmap);
+    }
+    free(steps);
+    return terms;
+}
+
+//! The pairs of @a columns matching every term, in the order of GeniusPairColumns#pairs.
+/*! @a textIndex must index the same pairs, with GeniusArrayController#fuzzyKeyPaths. */
+- (NSArray *) filteredPairsFromColumns:(GeniusPairColumns *)columns textIndex:(GeniusFuzzyIndex *)textIndex
+{
+    unsigned int rowCount = [columns count];
+    if (rowCount == 0)
+        return [NSArray array];
+
+    GeniusFilterPlanStep * steps = [self _planForColumns:columns textIndex:textIndex];
+    unsigned int * rows = (unsigned int *)malloc(rowCount * sizeof(unsigned int));
+    unsigned int i, kept = 0, first = 0;
+
+    if (_count > 0 && steps[0].bitmap && steps[0].predicate->negated == NO)
+    {
+        // The most selective term is a text term:  start from its rows rather than from the whole deck.
+        unsigned int word, wordCount = (rowCount + 31) / 32;
+        for (word=0; word<wordCount; word++)
+        {
+            uint32_t bits = steps[0].bitmap[word];
+            while (bits)
+            {
+                rows[kept++] = word * 32 + (ffs(bits) - 1);
+                bits &= bits - 1;
+            }
+        }
+        first = 1;
+    }
+    else
+    {
+        for (i=0; i<rowCount; i++)
+            rows[i] = i;
+        kept = rowCount;
+    }
+
+    for (i=first; i<_count && kept > 0; i++)
+        kept = [self _filterRows:rows count:kept step:&steps[i] columns:columns];
+
+    NSArray * pairs = [columns pairs];
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:kept];
+    for (i=0; i<kept; i++)
+        [result addObject:[pairs objectAtIndex:rows[i]]];
+
+    for (i=0; i<_count; i++)
+        free(steps[i].bitmap);
+    free(steps);
+    free(rows);
+    return result;
+}
+
+@end
+
+
+@implementation GeniusFilterQuery (Private)
+
+//! Compiles @a term and appends it.  Returns YES for a field term, NO if it became a bare word.
+- (BOOL) _addTerm:(NSString *)term time:(GeniusTime)now
+{
+    GeniusFilterPredicate predicate;
+    memset(&predicate, 0, sizeof(predicate));
+    NSString * body = term;
+    if ([body length] > 1 && [body characterAtIndex:0] == '-')
+    {
+        predicate.negated = YES;
+        body = [body substringFromIndex:1];
+    }
+
+    unsigned int nameLength = 0, length = [body length];
+    while (nameLength < length && [body characterAtIndex:nameLength] < 128 && isalpha([body characterAtIndex:nameLength]))
+        nameLength++;
+    unsigned int operatorLength;
+    GeniusFilterOperator op = ParseOperator(body, nameLength, &operatorLength);
+
+    BOOL isFieldTerm = NO;
+    if (nameLength > 0 && op != GeniusFilterOperatorNone)
+    {
+        NSString * name = [body substringToIndex:nameLength];
+        NSString * value = [body substringFromIndex:nameLength + operatorLength];
+        isFieldTerm = CompileFieldTerm(&predicate, name, op, value, now);
+    }
+    if (isFieldTerm == NO)
+    {
+        predicate.kind = GeniusFilterPredicateText;
+        predicate.text = body;
+        predicate.fieldMask = kGeniusFilterAllTextFields;
+    }
+
+    predicate.term = [term retain];
+    [predicate.text retain];
+    _predicates = (GeniusFilterPredicate *)realloc(_predicates, (_count + 1) * sizeof(GeniusFilterPredicate));
+    _predicates[_count++] = predicate;
+    return isFieldTerm;
+}
+
+//! Looks up the text terms, estimates what fraction of rows each term keeps, and orders the terms most selective first.
+/*! The caller frees the returned steps and their bitmaps. */
+- (GeniusFilterPlanStep *) _planForColumns:(GeniusPairColumns *)columns textIndex:(GeniusFuzzyIndex *)textIndex
+{
+    unsigned int rowCount = [columns count];
+    GeniusFilterPlanStep * steps = (GeniusFilterPlanStep *)calloc(MAX(_count, 1U), sizeof(GeniusFilterPlanStep));
+
+    unsigned int sample[kGeniusFilterSampleSize];
+    unsigned int i, j, sampleCount = MIN(rowCount, (unsigned int)kGeniusFilterSampleSize);
+    for (i=0; i<sampleCount; i++)
+        sample[i] = (unsigned int)((unsigned long long)i * rowCount / sampleCount);
+
+    for (i=0; i<_count; i++)
+    {
+        GeniusFilterPlanStep * step = &steps[i];
+        step->predicate = &_predicates[i];
+        if (rowCount == 0)
+            continue;
+
+        if (step->predicate->kind == GeniusFilterPredicateText)
+        {
+            NSSet * pairs = [textIndex objectsWithWordsContaining:step->predicate->text inFields:step->predicate->fieldMask];
+            if (pairs == nil)
+            {
+                step->matchesAll = YES;
+                step->selectivity = (step->predicate->negated ? 0.0 : 1.0);
+                continue;
+            }
+
+            unsigned int matched = 0;
+            step->bitmap = (uint32_t *)calloc((rowCount + 31) / 32, sizeof(uint32_t));
+            NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+            id pair;
+            while ((pair = [pairEnumerator nextObject]))
+            {
+                unsigned int row = [columns rowOfPair:pair];
+                if (row == NSNotFound)
+                    continue;
+                step->bitmap[row >> 5] |= (1U << (row & 31));
+                matched++;
+            }
+            step->selectivity = (double)matched / rowCount;
+            if (step->predicate->negated)
+                step->selectivity = 1.0 - step->selectivity;
+        }
+        else
+        {
+            unsigned int rows[kGeniusFilterSampleSize];
+            memcpy(rows, sample, sampleCount * sizeof(unsigned int));
+            step->selectivity = (double)[self _filterRows:rows count:sampleCount step:step columns:columns] / sampleCount;
+        }
+    }
+
+    // Stable insertion sort:  terms as selective as each other keep the order typed.
+    for (i=1; i<_count; i++)
+    {
+        GeniusFilterPlanStep step = steps[i];
+        for (j=i; j>0 && steps[j-1].selectivity > step.selectivity; j--)
+            steps[j] = steps[j-1];
+        steps[j] = step;
+    }
+    return steps;
+}
+
+//! Compacts @a rows to those passing @a step.  Returns the number kept.
+- (unsigned int) _filterRows:(unsigned int *)rows count:(unsigned int)count step:(const GeniusFilterPlanStep *)step columns:(GeniusPairColumns *)columns
+{
+    const GeniusFilterPredicate * predicate = step->predicate;
+    if (predicate->kind == GeniusFilterPredicateText)
+    {
+        if (step->matchesAll)
+            return (predicate->negated ? 0 : count);
+        return FilterBitmapRows(step->bitmap, predicate->negated, rows, count);
+    }
+
+    if (predicate->minimum > predicate->maximum)
+        return (predicate->negated ? count : 0);
+
+    unsigned int columnMask = predicate->columns;
+    if (predicate->kind == GeniusFilterPredicateTime)
+    {
+        const GeniusTime * first = ((columnMask & GeniusFilterColumnDueAB) ? [columns dueTimesAB] : [columns dueTimesBA]);
+        const GeniusTime * second = ((columnMask & GeniusFilterColumnDueBA) ? [columns dueTimesBA] : first);
+        return FilterTimeRows(predicate, first, second, rows, count);
+    }
+
+    const int * first, * second;
+    if (columnMask & GeniusFilterColumnImportance)
+        first = second = [columns importances];
+    else
+    {
+        first = ((columnMask & GeniusFilterColumnScoreAB) ? [columns scoresAB] : [columns scoresBA]);
+        second = ((columnMask & GeniusFilterColumnScoreBA) ? [columns scoresBA] : first);
+    }
+    return FilterIntegerRows(predicate, first, second, rows, count);
+}
+
+@end
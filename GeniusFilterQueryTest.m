@@ -0,0 +1,156 @@
+//
+//  GeniusFilterQueryTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusFilterQuery.h"
+#import "GeniusPairColumns.h"
+#import "GeniusFuzzyIndex.h"
+#import "GeniusTimingWheel.h"
+#import "GeniusPair.h"
+#import "GeniusItem.h"
+
+@interface GeniusFilterQueryTest : SenTestCase {
+    NSMutableArray *pairs;          //!< The deck searched.
+    GeniusPairColumns *columns;     //!< Packed columns of #pairs.
+    GeniusFuzzyIndex *index;        //!< Text index of #pairs, with the search field's key paths.
+    GeniusTime now;                 //!< Query time, noon of some day.
+}
+
+@end
+
+//! Tests for parsing, planning and evaluating GeniusFilterQuery.
+@implementation GeniusFilterQueryTest
+
+//! Creates an empty deck for each test.
+- (void) setUp
+{
+    pairs = [[NSMutableArray alloc] init];
+    columns = [[GeniusPairColumns alloc] init];
+    index = [[GeniusFuzzyIndex alloc] initWithKeyPaths:[NSArray arrayWithObjects:@"itemA.stringValue", @"itemB.stringValue",
+        @"customGroupString", @"customTypeString", @"notesString", nil]];
+    now = (GeniusTime)floor([[NSCalendarDate dateWithYear:2008 month:6 day:15 hour:12 minute:0 second:0 timeZone:nil] timeIntervalSince1970]);
+}
+
+//! Releases the deck.
+- (void) tearDown
+{
+    [pairs release];
+    pairs = nil;
+    [columns release];
+    columns = nil;
+    [index release];
+    index = nil;
+}
+
+//! Adds a pair to #pairs.  A negative @a score leaves the A to B association unquizzed.
+- (GeniusPair *) _addPair:(NSString *)question group:(NSString *)group type:(NSString *)type importance:(int)importance score:(int)score
+{
+    GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+    [[pair itemA] setValue:question forKey:@"stringValue"];
+    [pair setCustomGroupString:group];
+    [pair setCustomTypeString:type];
+    [pair setImportance:importance];
+    if (score >= 0)
+        [[pair associationAB] setScore:score];
+    [pairs addObject:pair];
+    return pair;
+}
+
+//! Evaluates @a string over #pairs.
+- (NSArray *) _filter:(NSString *)string
+{
+    [columns setPairs:pairs];
+    [index setObjects:pairs];
+    GeniusFilterQuery * query = [GeniusFilterQuery queryWithString:string time:now];
+    STAssertNotNil(query, string);
+    return [query filteredPairsFromColumns:columns textIndex:index];
+}
+
+//! Only strings with a field term are structured queries; unknown fields and bad values become bare words.
+- (void) testParsing
+{
+    STAssertNil([GeniusFilterQuery queryWithString:@"plain words" time:now], nil);
+    STAssertNil([GeniusFilterQuery queryWithString:@"http://example.com" time:now], @"not a field");
+    STAssertNil([GeniusFilterQuery queryWithString:@"score<lots" time:now], @"not a number");
+
+    GeniusFilterQuery * query = [GeniusFilterQuery queryWithString:@"group:\"irregular verbs\" scoreAB<3 due<today importance>=7 werden" time:now];
+    STAssertNotNil(query, nil);
+    STAssertEquals([query predicateCount], 5U, nil);
+}
+
+//! Text terms match words of their field, numeric terms compare the packed columns.
+- (void) testFieldTerms
+{
+    GeniusPair * sein = [self _addPair:@"sein" group:@"verbs" type:@"irregular" importance:8 score:1];
+    GeniusPair * gehen = [self _addPair:@"gehen" group:@"verbs" type:@"irregular" importance:5 score:4];
+    GeniusPair * machen = [self _addPair:@"machen" group:@"verbs" type:@"regular" importance:9 score:-1];
+    GeniusPair * haus = [self _addPair:@"das Haus" group:@"nouns" type:nil importance:7 score:2];
+
+    STAssertEqualObjects([self _filter:@"group:verbs type:irregular"], ([NSArray arrayWithObjects:sein, gehen, nil]), nil);
+    STAssertEqualObjects([self _filter:@"type:regular"], ([NSArray arrayWithObjects:sein, gehen, machen, nil]), @"words contain the value");
+    STAssertEqualObjects([self _filter:@"group:verbs -type:irregular"], [NSArray arrayWithObject:machen], nil);
+    STAssertEqualObjects([self _filter:@"importance>=7 scoreAB<3"], ([NSArray arrayWithObjects:sein, machen, haus, nil]), @"new counts as below 3");
+    STAssertEqualObjects([self _filter:@"scoreAB=new"], [NSArray arrayWithObject:machen], nil);
+    STAssertEqualObjects([self _filter:@"importance!=5 haus"], [NSArray arrayWithObject:haus], nil);
+    STAssertEqualObjects([self _filter:@"score>3"], [NSArray arrayWithObject:gehen], nil);
+}
+
+//! Day values cover the whole local day and unscheduled associations never match.
+- (void) testDueTerms
+{
+    GeniusPair * overdue = [self _addPair:@"a" group:nil type:nil importance:5 score:0];
+    GeniusPair * today = [self _addPair:@"b" group:nil type:nil importance:5 score:0];
+    GeniusPair * later = [self _addPair:@"c" group:nil type:nil importance:5 score:0];
+    [self _addPair:@"d" group:nil type:nil importance:5 score:-1];
+    [[overdue associationAB] setDueTime:now - 2 * kGeniusTimeDay];
+    [[today associationAB] setDueTime:now + 3600];
+    [[later associationBA] setDueTime:now + 5 * kGeniusTimeDay];
+
+    STAssertEqualObjects([self _filter:@"due<today"], [NSArray arrayWithObject:overdue], nil);
+    STAssertEqualObjects([self _filter:@"due<=today"], ([NSArray arrayWithObjects:overdue, today, nil]), nil);
+    STAssertEqualObjects([self _filter:@"due:today"], [NSArray arrayWithObject:today], nil);
+    STAssertEqualObjects([self _filter:@"due>3d"], [NSArray arrayWithObject:later], nil);
+    STAssertEqualObjects([self _filter:@"dueAB>3d"], [NSArray array], nil);
+    STAssertEqualObjects([self _filter:@"due>=2008-06-20"], [NSArray arrayWithObject:later], nil);
+}
+
+//! The rarest term runs first, whatever order it was typed in.
+- (void) testPlanOrder
+{
+    int i;
+    for (i=0; i<500; i++)
+        [self _addPair:[NSString stringWithFormat:@"word%d", i] group:(i == 17 ? @"rare" : @"common") type:nil importance:(i % 10) score:(i % 5)];
+    [columns setPairs:pairs];
+    [index setObjects:pairs];
+
+    GeniusFilterQuery * query = [GeniusFilterQuery queryWithString:@"importance>=1 scoreAB<4 group:rare" time:now];
+    NSArray * plan = [query planForColumns:columns textIndex:index];
+    STAssertEqualObjects([plan objectAtIndex:0], @"group:rare", nil);
+    STAssertEqualObjects([plan objectAtIndex:1], @"scoreAB<4", nil);
+    STAssertEqualObjects([plan objectAtIndex:2], @"importance>=1", nil);
+
+    NSArray * matches = [query filteredPairsFromColumns:columns textIndex:index];
+    STAssertEqualObjects(matches, [NSArray arrayWithObject:[pairs objectAtIndex:17]], nil);
+}
+
+//! Edits reach the columns through GeniusPairColumns#invalidateObject:.
+- (void) testInvalidation
+{
+    GeniusPair * pair = [self _addPair:@"sein" group:nil type:nil importance:5 score:0];
+    STAssertEqualObjects([self _filter:@"importance>8"], [NSArray array], nil);
+
+    [pair setImportance:9];
+    [columns invalidateObject:pair];
+    STAssertEqualObjects([self _filter:@"importance>8"], [NSArray arrayWithObject:pair], nil);
+
+    [[pair associationAB] setScore:6];
+    [columns invalidateObject:[pair associationAB]];
+    STAssertEqualObjects([self _filter:@"scoreAB=6"], [NSArray arrayWithObject:pair], nil);
+}
+
+@end
@@ -0,0 +1,77 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+//! Longest query word compared by the bit-parallel verifier.  Longer query words are truncated.
+#define kGeniusFuzzyMaximumWordLength 64
+
+//! Most words of a query that are matched.  The rest are ignored.
+#define kGeniusFuzzyMaximumQueryWords 8
+
+//! Typo tolerant word search over the text of a set of objects, such as the GeniusPair items of a deck.
+/*!
+    The text found at each of #_keyPaths is split into lowercase words.  Every distinct word gets an id
+    and is listed under each of its trigrams, and under each word the index records which objects use it
+    in which fields.
+
+    A query word of length @c m matches a document word that contains it with at most @c k edits, where
+    @c k grows with @c m (see #maximumDistanceForWordLength:).  Such a word shares at least
+    <tt>m - 2 - 3k</tt> trigrams with the query word, so candidates come from the trigram lists alone; only
+    short query words, where that bound is zero, fall back to scanning the vocabulary, which is much smaller
+    than the deck.  Candidates are verified with Myers' bit-parallel edit distance, one machine word
+    operation per character.
+
+    An object matches when every query word matches one of its words.  Results are ranked by the total
+    number of edits, then by the first field holding a closest match (the order of #_keyPaths), then by
+    their order in the array searched.
+ */
+@interface GeniusFuzzyIndex : NSObject {
+    NSArray * _keyPaths;                        //!< Indexed text key paths, in ranking order.  At most 8.
+
+    NSMutableArray * _words;                    //!< Word id -> lowercase word.
+    CFMutableDictionaryRef _wordIDs;            //!< Lowercase word -> word id + 1.
+    CFMutableDictionaryRef * _occurrences;      //!< Word id -> (object -> bit mask of fields using the word).
+    unsigned int _occurrencesCapacity;          //!< Allocated size of _occurrences.
+    CFMutableDictionaryRef _trigramWords;       //!< Trigram code -> NSMutableData of word ids, ascending.
+
+    CFMutableDictionaryRef _objectWords;        //!< Indexed object -> NSData of its word ids.  Retains objects.
+    CFMutableDictionaryRef _owners;             //!< Object holding indexed text (e.g. a GeniusItem) -> indexed object.
+    unsigned long long _byteCount;              //!< Estimated bytes held, kept up to date as words and objects come and go.
+}
+
+- (id) initWithKeyPaths:(NSArray *)keyPaths;
+
++ (unsigned int) maximumDistanceForWordLength:(unsigned int)length;
+
+- (void) setObjects:(NSArray *)objects;
+- (void) addObject:(id)object;
+- (void) removeObject:(id)object;
+- (void) invalidateObject:(id)object;
+
+- (unsigned int) count;
+- (unsigned int) wordCount;
+- (unsigned long long) byteCount;
+
+- (NSSet *) objectsWithWordsContaining:(NSString *)text inFields:(unsigned int)fieldMask;
+- (NSArray *) objectsMatchingQuery:(NSString *)query inArray:(NSArray *)objects limit:(unsigned int)limit;
+
+@end
+
+
+unsigned int GeniusFuzzySubstringDistance(NSString * pattern, NSString * text);
@@ -0,0 +1,656 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusFuzzyIndex.h"
+#import "GeniusMemoryReport.h"
+#include <strings.h>    // ffs
+
+//! Longest document word compared.  Longer words are compared by their beginning.
+#define kGeniusFuzzyMaximumTextLength 256
+
+//! Estimated bytes of one dictionary entry, as counted by GeniusMemorySizeOfCollection.
+#define kGeniusFuzzyEntryBytes (4 * sizeof(void *))
+
+//! A query word compiled for Myers' algorithm:  for each character, the bit mask of its positions.
+typedef struct _GeniusFuzzyPattern {
+    unsigned int length;                                    //!< Number of characters, at most 64.
+    uint64_t asciiMasks[128];                               //!< Masks of characters below 128.
+    unsigned int otherCount;                                //!< Number of other distinct characters.
+    unichar others[kGeniusFuzzyMaximumWordLength];         //!< Other distinct characters.
+    uint64_t otherMasks[kGeniusFuzzyMaximumWordLength];     //!< Masks of #others.
+} GeniusFuzzyPattern;
+
+//! Best match of one object found so far by GeniusFuzzyIndex#objectsMatchingQuery:inArray:limit:.
+typedef struct _GeniusFuzzyScore {
+    unsigned char distances[kGeniusFuzzyMaximumQueryWords];    //!< Fewest edits for each query word.
+    unsigned char fields[kGeniusFuzzyMaximumQueryWords];       //!< First field with the fewest edits, for each query word.
+    unsigned char matchedWords;                                 //!< Bit mask of the query words matched.
+} GeniusFuzzyScore;
+
+//! Scores of the objects touched by one query.
+typedef struct _GeniusFuzzyScores {
+    CFMutableDictionaryRef indexes;     //!< Object -> index + 1 in #scores.
+    GeniusFuzzyScore * scores;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int queryWord;             //!< Query word being matched.
+    unsigned int distance;              //!< Edits of the document word being applied.
+} GeniusFuzzyScores;
+
+//! Fills @a pattern from the first 64 @a characters.
+static void CompilePattern(GeniusFuzzyPattern * pattern, const unichar * characters, unsigned int length)
+{
+    memset(pattern, 0, sizeof(GeniusFuzzyPattern));
+    pattern->length = MIN(length, kGeniusFuzzyMaximumWordLength);
+
+    unsigned int i, j;
+    for (i=0; i<pattern->length; i++)
+    {
+        unichar c = characters[i];
+        uint64_t bit = 1ULL << i;
+        if (c < 128)
+        {
+            pattern->asciiMasks[c] |= bit;
+            continue;
+        }
+        for (j=0; j<pattern->otherCount && pattern->others[j] != c; j++)
+            ;
+        if (j == pattern->otherCount)
+            pattern->others[pattern->otherCount++] = c;
+        pattern->otherMasks[j] |= bit;
+    }
+}
+
+//! Positions of @a c in @a pattern.
+static __inline__ uint64_t PatternMask(const GeniusFuzzyPattern * pattern, unichar c)
+{
+    if (c < 128)
+        return pattern->asciiMasks[c];
+    unsigned int j;
+    for (j=0; j<pattern->otherCount; j++)
+        if (pattern->others[j] == c)
+            return pattern->otherMasks[j];
+    return 0;
+}
+
+//! Fewest edits turning @a pattern into some substring of @a text.
+/*!
+    Myers' bit-vector algorithm, search variant:  the vertical deltas of a whole dynamic programming column
+    live in two machine words, and the top row stays zero so a match may start anywhere in @a text.
+ */
+static unsigned int SubstringDistance(const GeniusFuzzyPattern * pattern, const unichar * text, unsigned int length)
+{
+    unsigned int m = pattern->length;
+    if (m == 0)
+        return 0;
+
+    uint64_t last = 1ULL << (m - 1);
+    uint64_t pv = ~0ULL, mv = 0;
+    unsigned int score = m, best = m;
+    unsigned int i;
+    for (i=0; i<length && best > 0; i++)
+    {
+        uint64_t eq = PatternMask(pattern, text[i]);
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & last)
+            score++;
+        else if (mh & last)
+            score--;
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        best = MIN(best, score);
+    }
+    return best;
+}
+
+//! Fewest edits turning @a pattern into some substring of @a text.  Both are compared as given, case sensitively.
+unsigned int GeniusFuzzySubstringDistance(NSString * pattern, NSString * text)
+{
+    unichar patternCharacters[kGeniusFuzzyMaximumWordLength];
+    unichar textCharacters[kGeniusFuzzyMaximumTextLength];
+    unsigned int patternLength = MIN([pattern length], (unsigned int)kGeniusFuzzyMaximumWordLength);
+    unsigned int textLength = MIN([text length], (unsigned int)kGeniusFuzzyMaximumTextLength);
+    [pattern getCharacters:patternCharacters range:NSMakeRange(0, patternLength)];
+    [text getCharacters:textCharacters range:NSMakeRange(0, textLength)];
+
+    GeniusFuzzyPattern compiled;
+    CompilePattern(&compiled, patternCharacters, patternLength);
+    return SubstringDistance(&compiled, textCharacters, textLength);
+}
+
+//! Splits @a string into lowercase runs of letters and digits.
+static NSArray * WordsInString(NSString * string)
+{
+    NSMutableArray * words = [NSMutableArray array];
+    NSString * lowercase = [string lowercaseString];
+    unsigned int i, start = 0, length = [lowercase length];
+    if (length == 0)
+        return words;
+
+    unichar * characters = (unichar *)malloc(length * sizeof(unichar));
+    [lowercase getCharacters:characters];
+    CFCharacterSetRef alphanumerics = CFCharacterSetGetPredefined(kCFCharacterSetAlphaNumeric);
+    for (i=0; i<=length; i++)
+    {
+        if (i < length && CFCharacterSetIsCharacterMember(alphanumerics, characters[i]))
+            continue;
+        if (i > start)
+            [words addObject:[NSString stringWithCharacters:characters+start length:i-start]];
+        start = i + 1;
+    }
+    free(characters);
+    return words;
+}
+
+//! Dictionary key of the trigram starting at @a characters.  Never 0; collisions only cost extra candidates.
+static __inline__ const void * TrigramKey(const unichar * characters)
+{
+    uint32_t code = ((uint32_t)characters[0] * 0x9E3779B1U) ^ ((uint32_t)characters[1] * 0x85EBCA77U) ^ ((uint32_t)characters[2] * 0xC2B2AE3DU);
+    return (const void *)(uintptr_t)((code >> 1) | 1);
+}
+
+//! CFDictionaryApplyFunction callback recording that the current document word occurs in @a object in the fields of @a fieldMask.
+static void ScoreOccurrence(const void * object, const void * fieldMask, void * context)
+{
+    GeniusFuzzyScores * scores = (GeniusFuzzyScores *)context;
+    unsigned int index = (unsigned int)(uintptr_t)CFDictionaryGetValue(scores->indexes, object);
+    if (index == 0)
+    {
+        if (scores->count == scores->capacity)
+        {
+            scores->capacity = MAX(2 * scores->capacity, 256U);
+            scores->scores = (GeniusFuzzyScore *)realloc(scores->scores, scores->capacity * sizeof(GeniusFuzzyScore));
+        }
+        GeniusFuzzyScore * newScore = &scores->scores[scores->count++];
+        memset(newScore->distances, 0xFF, sizeof(newScore->distances));
+        memset(newScore->fields, 0xFF, sizeof(newScore->fields));
+        newScore->matchedWords = 0;
+        index = scores->count;
+        CFDictionarySetValue(scores->indexes, object, (const void *)(uintptr_t)index);
+    }
+
+    GeniusFuzzyScore * score = &scores->scores[index - 1];
+    unsigned int queryWord = scores->queryWord;
+    unsigned char field = ffs((int)(uintptr_t)fieldMask) - 1;
+    if (scores->distance < score->distances[queryWord])
+    {
+        score->distances[queryWord] = scores->distance;
+        score->fields[queryWord] = field;
+    }
+    else if (scores->distance == score->distances[queryWord])
+        score->fields[queryWord] = MIN(score->fields[queryWord], field);
+    score->matchedWords |= (1 << queryWord);
+}
+
+//! Objects collected by GeniusFuzzyIndex#objectsWithWordsContaining:inFields:.
+typedef struct _GeniusFuzzyCollector {
+    CFMutableSetRef objects;
+    uintptr_t fieldMask;        //!< Fields in which a word counts.
+} GeniusFuzzyCollector;
+
+//! CFDictionaryApplyFunction callback adding @a object when the current word occurs in one of the wanted fields.
+static void CollectOccurrence(const void * object, const void * fieldMask, void * context)
+{
+    GeniusFuzzyCollector * collector = (GeniusFuzzyCollector *)context;
+    if ((uintptr_t)fieldMask & collector->fieldMask)
+        CFSetAddValue(collector->objects, object);
+}
+
+
+@interface GeniusFuzzyIndex (Private)
+- (unsigned int) _wordIDForWord:(NSString *)word;
+- (unsigned int) _getCandidates:(unsigned int *)candidates forCharacters:(const unichar *)characters length:(unsigned int)m maximumDistance:(unsigned int)maximumDistance counts:(unsigned short *)counts;
+- (void) _scoreQueryWord:(NSString *)queryWord scores:(GeniusFuzzyScores *)scores counts:(unsigned short *)counts;
+@end
+
+@implementation GeniusFuzzyIndex
+
+//! Designated initializer.  Text found at @a keyPaths is indexed; earlier key paths rank higher.
+- (id) initWithKeyPaths:(NSArray *)keyPaths
+{
+    self = [super init];
+    if (self != nil) {
+        _keyPaths = [[keyPaths subarrayWithRange:NSMakeRange(0, MIN([keyPaths count], 8U))] retain];
+        _words = [[NSMutableArray alloc] init];
+        _wordIDs = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+        _trigramWords = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+        _objectWords = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        _owners = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+
+        _byteCount = GeniusMemorySizeOfObject(self) + GeniusMemorySizeOfCollection(_words) + GeniusMemorySizeOfCollection((id)_wordIDs);
+        _byteCount += GeniusMemorySizeOfCollection((id)_trigramWords) + GeniusMemorySizeOfCollection((id)_objectWords) + GeniusMemorySizeOfCollection((id)_owners);
+    }
+    return self;
+}
+
+//! Releases the index and frees memory.
+- (void) dealloc
+{
+    unsigned int i, count = [_words count];
+    for (i=0; i<count; i++)
+        CFRelease(_occurrences[i]);
+    free(_occurrences);
+    CFRelease(_wordIDs);
+    CFRelease(_trigramWords);
+    CFRelease(_owners);
+    CFRelease(_objectWords);
+    [_words release];
+    [_keyPaths release];
+    [super dealloc];
+}
+
+//! Edits allowed when matching a query word of @a length characters.
++ (unsigned int) maximumDistanceForWordLength:(unsigned int)length
+{
+    if (length <= 3)
+        return 0;
+    if (length <= 7)
+        return 1;
+    return 2;
+}
+
+//! Indexes the objects of @a objects not indexed yet and drops indexed objects no longer in @a objects.
+- (void) setObjects:(NSArray *)objects
+{
+    NSEnumerator * objectEnumerator = [objects objectEnumerator];
+    id object;
+    while ((object = [objectEnumerator nextObject]))
+        [self addObject:object];
+
+    unsigned int i, count = CFDictionaryGetCount(_objectWords);
+    if (count == [objects count])
+        return;
+
+    CFMutableSetRef currentObjects = CFSetCreateMutable(kCFAllocatorDefault, [objects count], NULL);
+    objectEnumerator = [objects objectEnumerator];
+    while ((object = [objectEnumerator nextObject]))
+        CFSetAddValue(currentObjects, object);
+
+    const void ** indexedObjects = (const void **)malloc(count * sizeof(void *));
+    CFDictionaryGetKeysAndValues(_objectWords, indexedObjects, NULL);
+    for (i=0; i<count; i++)
+        if (CFSetContainsValue(currentObjects, indexedObjects[i]) == NO)
+            [self removeObject:(id)indexedObjects[i]];
+    free(indexedObjects);
+    CFRelease(currentObjects);
+}
+
+//! Indexes the text of @a object unless it is indexed already.
+- (void) addObject:(id)object
+{
+    if (CFDictionaryContainsKey(_objectWords, object))
+        return;
+
+    NSMutableData * wordIDs = [NSMutableData data];
+    unsigned int field, fieldCount = [_keyPaths count];
+    for (field=0; field<fieldCount; field++)
+    {
+        NSString * keyPath = [_keyPaths objectAtIndex:field];
+        NSRange dot = [keyPath rangeOfString:@"." options:NSBackwardsSearch];
+        if (dot.location != NSNotFound)
+        {
+            id owner = [object valueForKeyPath:[keyPath substringToIndex:dot.location]];
+            if (owner && CFDictionaryContainsKey(_owners, owner) == NO)
+                _byteCount += kGeniusFuzzyEntryBytes;
+            if (owner)
+                CFDictionarySetValue(_owners, owner, object);
+        }
+
+        id value = [object valueForKeyPath:keyPath];
+        if ([value isKindOfClass:[NSString class]] == NO)
+            continue;
+
+        NSEnumerator * wordEnumerator = [WordsInString(value) objectEnumerator];
+        NSString * word;
+        while ((word = [wordEnumerator nextObject]))
+        {
+            unsigned int wordID = [self _wordIDForWord:word];
+            uintptr_t fieldMask = (uintptr_t)CFDictionaryGetValue(_occurrences[wordID], object);
+            if (fieldMask == 0)
+            {
+                [wordIDs appendBytes:&wordID length:sizeof(wordID)];
+                _byteCount += kGeniusFuzzyEntryBytes + sizeof(wordID);
+            }
+            CFDictionarySetValue(_occurrences[wordID], object, (const void *)(fieldMask | (1 << field)));
+        }
+    }
+    CFDictionarySetValue(_objectWords, object, wordIDs);
+    _byteCount += GeniusMemorySizeOfObject(wordIDs) + kGeniusFuzzyEntryBytes;
+}
+
+//! Drops @a object from the index.  Its words stay in the vocabulary.
+- (void) removeObject:(id)object
+{
+    NSData * wordIDs = (NSData *)CFDictionaryGetValue(_objectWords, object);
+    if (wordIDs == nil)
+        return;
+
+    const unsigned int * ids = [wordIDs bytes];
+    unsigned int i, count = [wordIDs length] / sizeof(unsigned int);
+    for (i=0; i<count; i++)
+        CFDictionaryRemoveValue(_occurrences[ids[i]], object);
+    _byteCount -= count * (kGeniusFuzzyEntryBytes + sizeof(unsigned int)) + GeniusMemorySizeOfObject(wordIDs) + kGeniusFuzzyEntryBytes;
+
+    NSEnumerator * keyPathEnumerator = [_keyPaths objectEnumerator];
+    NSString * keyPath;
+    while ((keyPath = [keyPathEnumerator nextObject]))
+    {
+        NSRange dot = [keyPath rangeOfString:@"." options:NSBackwardsSearch];
+        if (dot.location == NSNotFound)
+            continue;
+        id owner = [object valueForKeyPath:[keyPath substringToIndex:dot.location]];
+        if (owner && CFDictionaryGetValue(_owners, owner) == object)
+        {
+            CFDictionaryRemoveValue(_owners, owner);
+            _byteCount -= kGeniusFuzzyEntryBytes;
+        }
+    }
+
+    CFDictionaryRemoveValue(_objectWords, object);     // releases object, so last
+}
+
+//! Reindexes @a object, or the indexed object owning it (e.g. the GeniusPair of a GeniusItem), after an edit.
+- (void) invalidateObject:(id)object
+{
+    id indexedObject = (CFDictionaryContainsKey(_objectWords, object) ? object : (id)CFDictionaryGetValue(_owners, object));
+    if (indexedObject == nil)
+        return;
+
+    [indexedObject retain];
+    [self removeObject:indexedObject];
+    [self addObject:indexedObject];
+    [indexedObject release];
+}
+
+//! Number of indexed objects.
+- (unsigned int) count
+{
+    return CFDictionaryGetCount(_objectWords);
+}
+
+//! Number of distinct words seen, including words of objects since removed.
+- (unsigned int) wordCount
+{
+    return [_words count];
+}
+
+//! Estimated bytes held by the index.  Kept up to date by every change, so it costs nothing to ask.
+- (unsigned long long) byteCount
+{
+    return _byteCount;
+}
+
+//! Indexed objects in which every word of @a text is part of a word, unchanged, in one of the fields of @a fieldMask.
+/*!
+    Bit @c i of @a fieldMask stands for the @c i th key path.  The exact counterpart of
+    #objectsMatchingQuery:inArray:limit:, used for structured filters.  Returns @c nil when @a text has no words.
+ */
+- (NSSet *) objectsWithWordsContaining:(NSString *)text inFields:(unsigned int)fieldMask
+{
+    NSArray * textWords = WordsInString(text);
+    if ([textWords count] == 0)
+        return nil;
+
+    NSMutableSet * result = nil;
+    unsigned short * counts = (unsigned short *)calloc(MAX([_words count], 1U), sizeof(unsigned short));
+    unsigned int * candidates = (unsigned int *)malloc(MAX([_words count], 1U) * sizeof(unsigned int));
+    NSEnumerator * wordEnumerator = [textWords objectEnumerator];
+    NSString * textWord;
+    while ((textWord = [wordEnumerator nextObject]))
+    {
+        unichar characters[kGeniusFuzzyMaximumWordLength];
+        unsigned int m = MIN([textWord length], (unsigned int)kGeniusFuzzyMaximumWordLength);
+        [textWord getCharacters:characters range:NSMakeRange(0, m)];
+        unsigned int i, candidateCount = [self _getCandidates:candidates forCharacters:characters length:m maximumDistance:0 counts:counts];
+
+        GeniusFuzzyCollector collector;
+        collector.objects = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+        collector.fieldMask = fieldMask;
+        for (i=0; i<candidateCount; i++)
+        {
+            NSString * word = [_words objectAtIndex:candidates[i]];
+            if ([word rangeOfString:textWord].location != NSNotFound)
+                CFDictionaryApplyFunction(_occurrences[candidates[i]], CollectOccurrence, &collector);
+        }
+
+        NSSet * objects = (NSSet *)collector.objects;
+        if (result == nil)
+            result = [NSMutableSet setWithSet:objects];
+        else
+            [result intersectSet:objects];
+        CFRelease(collector.objects);
+        if ([result count] == 0)
+            break;
+    }
+    free(candidates);
+    free(counts);
+    return result;
+}
+
+//! Objects of @a objects matching every word of @a query, best first.  At most @a limit are returned.
+- (NSArray *) objectsMatchingQuery:(NSString *)query inArray:(NSArray *)objects limit:(unsigned int)limit
+{
+    NSArray * queryWords = WordsInString(query);
+    unsigned int queryWord, queryWordCount = MIN([queryWords count], (unsigned int)kGeniusFuzzyMaximumQueryWords);
+    if (queryWordCount == 0)
+        return [NSArray array];
+
+    GeniusFuzzyScores scores;
+    memset(&scores, 0, sizeof(scores));
+    scores.indexes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+    unsigned short * counts = (unsigned short *)calloc(MAX([_words count], 1U), sizeof(unsigned short));
+    for (queryWord=0; queryWord<queryWordCount; queryWord++)
+    {
+        scores.queryWord = queryWord;
+        [self _scoreQueryWord:[queryWords objectAtIndex:queryWord] scores:&scores counts:counts];
+    }
+    free(counts);
+
+    // Bucket by total edits and field, in the order of objects.
+    const unsigned int fieldCount = 8;
+    const unsigned int bucketCount = (2 * kGeniusFuzzyMaximumQueryWords + 1) * fieldCount;
+    NSMutableArray * buckets[bucketCount];
+    memset(buckets, 0, sizeof(buckets));
+    unsigned int allWords = (1 << queryWordCount) - 1;
+
+    NSEnumerator * objectEnumerator = [objects objectEnumerator];
+    id object;
+    while ((object = [objectEnumerator nextObject]))
+    {
+        unsigned int index = (unsigned int)(uintptr_t)CFDictionaryGetValue(scores.indexes, object);
+        if (index == 0)
+            continue;
+        GeniusFuzzyScore * score = &scores.scores[index - 1];
+        if (score->matchedWords != allWords)
+            continue;
+
+        unsigned int total = 0, field = fieldCount - 1;
+        for (queryWord=0; queryWord<queryWordCount; queryWord++)
+        {
+            total += score->distances[queryWord];
+            field = MIN(field, score->fields[queryWord]);
+        }
+        unsigned int bucket = MIN(total, 2U * kGeniusFuzzyMaximumQueryWords) * fieldCount + field;
+        if (buckets[bucket] == nil)
+            buckets[bucket] = [NSMutableArray array];
+        [buckets[bucket] addObject:object];
+    }
+    free(scores.scores);
+    CFRelease(scores.indexes);
+
+    NSMutableArray * results = [NSMutableArray array];
+    unsigned int bucket;
+    for (bucket=0; bucket<bucketCount && [results count] < limit; bucket++)
+    {
+        if (buckets[bucket] == nil)
+            continue;
+        unsigned int take = MIN([buckets[bucket] count], limit - [results count]);
+        [results addObjectsFromArray:[buckets[bucket] subarrayWithRange:NSMakeRange(0, take)]];
+    }
+    return results;
+}
+
+@end
+
+
+@implementation GeniusFuzzyIndex (Private)
+
+//! Returns the id of @a word, adding it to the vocabulary and trigram lists if it is new.
+- (unsigned int) _wordIDForWord:(NSString *)word
+{
+    uintptr_t index = (uintptr_t)CFDictionaryGetValue(_wordIDs, word);
+    if (index)
+        return index - 1;
+
+    unsigned int wordID = [_words count];
+    [_words addObject:word];
+    CFDictionarySetValue(_wordIDs, word, (const void *)(uintptr_t)(wordID + 1));
+    _byteCount += GeniusMemorySizeOfString(word) + sizeof(id) + kGeniusFuzzyEntryBytes;
+
+    if (wordID == _occurrencesCapacity)
+    {
+        _byteCount -= _occurrencesCapacity * sizeof(CFMutableDictionaryRef);
+        _occurrencesCapacity = MAX(2 * _occurrencesCapacity, 1024U);
+        _occurrences = (CFMutableDictionaryRef *)realloc(_occurrences, _occurrencesCapacity * sizeof(CFMutableDictionaryRef));
+        _byteCount += _occurrencesCapacity * sizeof(CFMutableDictionaryRef);
+    }
+    _occurrences[wordID] = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+    _byteCount += GeniusMemorySizeOfCollection((id)_occurrences[wordID]);
+
+    unichar characters[kGeniusFuzzyMaximumTextLength];
+    unsigned int i, length = MIN([word length], (unsigned int)kGeniusFuzzyMaximumTextLength);
+    [word getCharacters:characters range:NSMakeRange(0, length)];
+    for (i=0; i+3<=length; i++)
+    {
+        const void * key = TrigramKey(characters + i);
+        NSMutableData * wordIDs = (NSMutableData *)CFDictionaryGetValue(_trigramWords, key);
+        if (wordIDs == nil)
+        {
+            wordIDs = [[NSMutableData alloc] init];
+            CFDictionarySetValue(_trigramWords, key, wordIDs);
+            [wordIDs release];
+            _byteCount += GeniusMemorySizeOfObject(wordIDs) + kGeniusFuzzyEntryBytes;
+        }
+        // A trigram repeated within the word is listed once:  it would be the last entry.
+        unsigned int count = [wordIDs length] / sizeof(unsigned int);
+        if (count > 0 && ((const unsigned int *)[wordIDs bytes])[count - 1] == wordID)
+            continue;
+        [wordIDs appendBytes:&wordID length:sizeof(wordID)];
+        _byteCount += sizeof(wordID);
+    }
+    return wordID;
+}
+
+//! Fills @a candidates with the ids of the words that may contain @a characters within @a maximumDistance edits.
+/*!
+    Returns the number of candidates.  @a candidates holds an entry per word.  @a counts holds a zeroed
+    counter per word id on entry and on return.
+ */
+- (unsigned int) _getCandidates:(unsigned int *)candidates forCharacters:(const unichar *)characters length:(unsigned int)m maximumDistance:(unsigned int)maximumDistance counts:(unsigned short *)counts
+{
+    unsigned int wordCount = [_words count];
+    unsigned int candidateCount = 0;
+    unsigned int i, j;
+
+    // q-gram lemma:  a match within maximumDistance edits keeps m - 2 - 3 * maximumDistance of the query's
+    // trigrams.  Words are listed once per trigram, so each repeated query trigram lowers the bound by one.
+    const void * keys[kGeniusFuzzyMaximumWordLength];
+    unsigned int keyCount = 0;
+    for (i=0; i+3<=m; i++)
+    {
+        const void * key = TrigramKey(characters + i);
+        for (j=0; j<keyCount && keys[j] != key; j++)
+            ;
+        if (j == keyCount)
+            keys[keyCount++] = key;
+    }
+    int threshold = (int)keyCount - 3 * (int)maximumDistance;
+
+    if (threshold > 0)
+    {
+        unsigned int * touched = (unsigned int *)malloc(MAX(wordCount, 1U) * sizeof(unsigned int));
+        unsigned int touchedCount = 0;
+        for (i=0; i<keyCount; i++)
+        {
+            NSData * wordIDs = (NSData *)CFDictionaryGetValue(_trigramWords, keys[i]);
+            const unsigned int * ids = [wordIDs bytes];
+            unsigned int k, idCount = [wordIDs length] / sizeof(unsigned int);
+            for (k=0; k<idCount; k++)
+            {
+                unsigned int wordID = ids[k];
+                if (counts[wordID] == 0)
+                    touched[touchedCount++] = wordID;
+                if (++counts[wordID] == threshold)
+                    candidates[candidateCount++] = wordID;
+            }
+        }
+        for (i=0; i<touchedCount; i++)
+            counts[touched[i]] = 0;
+        free(touched);
+    }
+    else
+    {
+        // Too short for the trigram bound:  scan the vocabulary.
+        for (i=0; i<wordCount; i++)
+            if ([[_words objectAtIndex:i] length] + maximumDistance >= m)
+                candidates[candidateCount++] = i;
+    }
+    return candidateCount;
+}
+
+//! Finds the vocabulary words matching @a queryWord and records their objects in @a scores.
+/*! @a counts holds a zeroed counter per word id on entry and on return. */
+- (void) _scoreQueryWord:(NSString *)queryWord scores:(GeniusFuzzyScores *)scores counts:(unsigned short *)counts
+{
+    unichar characters[kGeniusFuzzyMaximumWordLength];
+    unsigned int m = MIN([queryWord length], (unsigned int)kGeniusFuzzyMaximumWordLength);
+    [queryWord getCharacters:characters range:NSMakeRange(0, m)];
+    GeniusFuzzyPattern pattern;
+    CompilePattern(&pattern, characters, m);
+
+    unsigned int maximumDistance = [[self class] maximumDistanceForWordLength:m];
+    unsigned int * candidates = (unsigned int *)malloc(MAX([_words count], 1U) * sizeof(unsigned int));
+    unsigned int i, candidateCount = [self _getCandidates:candidates forCharacters:characters length:m maximumDistance:maximumDistance counts:counts];
+
+    scores->distance = 0;
+    for (i=0; i<candidateCount; i++)
+    {
+        CFMutableDictionaryRef occurrences = _occurrences[candidates[i]];
+        if (CFDictionaryGetCount(occurrences) == 0)
+            continue;
+
+        NSString * word = [_words objectAtIndex:candidates[i]];
+        unichar text[kGeniusFuzzyMaximumTextLength];
+        unsigned int length = MIN([word length], (unsigned int)kGeniusFuzzyMaximumTextLength);
+        [word getCharacters:text range:NSMakeRange(0, length)];
+        unsigned int distance = SubstringDistance(&pattern, text, length);
+        if (distance > maximumDistance)
+            continue;
+
+        scores->distance = distance;
+        CFDictionaryApplyFunction(occurrences, ScoreOccurrence, scores);
+    }
+    free(candidates);
+}
+
+@end
@@ -0,0 +1,170 @@
+//
+//  GeniusFuzzyIndexTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusFuzzyIndex.h"
+#import "GeniusPair.h"
+#import "GeniusItem.h"
+
+@interface GeniusFuzzyIndexTest : SenTestCase {
+    GeniusFuzzyIndex *index;    //!< The object under test, indexing question and answer.
+    NSMutableArray *pairs;      //!< Indexed pairs.
+}
+
+@end
+
+//! Tests for the GeniusFuzzyIndex typo tolerant search.
+@implementation GeniusFuzzyIndexTest
+
+//! Creates an empty index for each test.
+- (void) setUp
+{
+    index = [[GeniusFuzzyIndex alloc] initWithKeyPaths:[NSArray arrayWithObjects:@"itemA.stringValue", @"itemB.stringValue", nil]];
+    pairs = [[NSMutableArray alloc] init];
+}
+
+//! Releases the index and pairs.
+- (void) tearDown
+{
+    [index release];
+    index = nil;
+    [pairs release];
+    pairs = nil;
+}
+
+//! Adds a pair with @a question and @a answer to #pairs.
+- (GeniusPair *) _addPairWithQuestion:(NSString *)question answer:(NSString *)answer
+{
+    GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+    [[pair itemA] setValue:question forKey:@"stringValue"];
+    [[pair itemB] setValue:answer forKey:@"stringValue"];
+    [pairs addObject:pair];
+    return pair;
+}
+
+//! The bit-parallel distance agrees with hand computed values.
+- (void) testSubstringDistance
+{
+    STAssertEquals(GeniusFuzzySubstringDistance(@"haus", @"krankenhaus"), 0U, nil);
+    STAssertEquals(GeniusFuzzySubstringDistance(@"hause", @"krankenhaus"), 1U, nil);
+    STAssertEquals(GeniusFuzzySubstringDistance(@"schmetterling", @"schmeterlink"), 2U, nil);
+    STAssertEquals(GeniusFuzzySubstringDistance(@"abc", @"xyz"), 3U, nil);
+    STAssertEquals(GeniusFuzzySubstringDistance(@"äpfel", @"äpfel"), 0U, nil);
+}
+
+//! Misspelled queries find their pairs, closest first, questions before answers.
+- (void) testRankedMatches
+{
+    GeniusPair * butterfly = [self _addPairWithQuestion:@"der Schmetterling" answer:@"butterfly"];
+    GeniusPair * hospital = [self _addPairWithQuestion:@"das Krankenhaus" answer:@"hospital"];
+    GeniusPair * house = [self _addPairWithQuestion:@"das Haus" answer:@"house"];
+    GeniusPair * reverse = [self _addPairWithQuestion:@"the house" answer:@"das Haus"];
+    [index setObjects:pairs];
+
+    NSArray * matches = [index objectsMatchingQuery:@"Schmeterling" inArray:pairs limit:10];
+    STAssertEqualObjects(matches, [NSArray arrayWithObject:butterfly], nil);
+
+    matches = [index objectsMatchingQuery:@"haus" inArray:pairs limit:10];
+    NSArray * expected = [NSArray arrayWithObjects:hospital, house, reverse, nil];
+    STAssertEqualObjects(matches, expected, @"exact question hits in deck order, then the answer hit");
+
+    matches = [index objectsMatchingQuery:@"hose" inArray:pairs limit:10];
+    expected = [NSArray arrayWithObjects:reverse, hospital, house, nil];
+    STAssertEqualObjects(matches, expected, @"one edit each, the question hit first");
+
+    matches = [index objectsMatchingQuery:@"das hause" inArray:pairs limit:2];
+    STAssertEquals([matches count], 2U, @"limit");
+    STAssertEqualObjects([matches objectAtIndex:0], hospital, nil);
+}
+
+//! Edits and removals are picked up.
+- (void) testUpdates
+{
+    GeniusPair * pair = [self _addPairWithQuestion:@"apple" answer:@"Apfel"];
+    [index setObjects:pairs];
+    STAssertEquals([[index objectsMatchingQuery:@"apfle" inArray:pairs limit:10] count], 1U, nil);
+
+    [[pair itemB] setValue:@"Birne" forKey:@"stringValue"];
+    [index invalidateObject:[pair itemB]];
+    STAssertEquals([[index objectsMatchingQuery:@"apfle" inArray:pairs limit:10] count], 0U, nil);
+    STAssertEquals([[index objectsMatchingQuery:@"birn" inArray:pairs limit:10] count], 1U, nil);
+
+    [pairs removeAllObjects];
+    [index setObjects:pairs];
+    STAssertEquals([index count], 0U, nil);
+}
+
+//! The running byte count grows with the index and gives back what removed objects held.
+- (void) testByteCount
+{
+    unsigned long long emptyByteCount = [index byteCount];
+    GeniusPair * pair = [self _addPairWithQuestion:@"apple" answer:@"Apfel"];
+    [index setObjects:pairs];
+    unsigned long long byteCount = [index byteCount];
+    STAssertTrue(byteCount > emptyByteCount, nil);
+
+    [index invalidateObject:[pair itemB]];
+    STAssertEquals([index byteCount], byteCount, @"reindexing the same text");
+
+    [pairs removeAllObjects];
+    [index setObjects:pairs];
+    STAssertTrue([index byteCount] < byteCount, @"the words stay, their occurrences go");
+
+    [pairs addObject:pair];
+    [index setObjects:pairs];
+    STAssertEquals([index byteCount], byteCount, nil);
+}
+
+//! Trigram candidates and vocabulary scans find exactly what a brute force scan finds.
+- (void) testAgainstBruteForce
+{
+    srandom(7);
+    NSMutableArray * vocabulary = [NSMutableArray array];
+    int i, j;
+    for (i=0; i<300; i++)
+    {
+        char word[16];
+        int length = 3 + random() % 10;
+        for (j=0; j<length; j++)
+            word[j] = 'a' + random() % 6;
+        word[length] = 0;
+        [vocabulary addObject:[NSString stringWithUTF8String:word]];
+    }
+    for (i=0; i<500; i++)
+    {
+        NSString * question = [NSString stringWithFormat:@"%@ %@", [vocabulary objectAtIndex:random() % 300], [vocabulary objectAtIndex:random() % 300]];
+        [self _addPairWithQuestion:question answer:[vocabulary objectAtIndex:random() % 300]];
+    }
+    [index setObjects:pairs];
+
+    for (i=0; i<50; i++)
+    {
+        NSMutableString * query = [NSMutableString stringWithString:[vocabulary objectAtIndex:random() % 300]];
+        if ([query length] > 4)
+            [query replaceCharactersInRange:NSMakeRange(2, 1) withString:@"f"];
+        unsigned int maximumDistance = [GeniusFuzzyIndex maximumDistanceForWordLength:[query length]];
+
+        NSMutableSet * expected = [NSMutableSet set];
+        NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+        GeniusPair * pair;
+        while ((pair = [pairEnumerator nextObject]))
+        {
+            NSString * text = [NSString stringWithFormat:@"%@ %@", [[pair itemA] stringValue], [[pair itemB] stringValue]];
+            NSEnumerator * wordEnumerator = [[text componentsSeparatedByString:@" "] objectEnumerator];
+            NSString * word;
+            while ((word = [wordEnumerator nextObject]))
+                if (GeniusFuzzySubstringDistance(query, word) <= maximumDistance)
+                    [expected addObject:pair];
+        }
+
+        NSArray * matches = [index objectsMatchingQuery:query inArray:pairs limit:1000];
+        STAssertEqualObjects([NSSet setWithArray:matches], expected, query);
+    }
+}
+
+@end
@@ -18,21 +18,21 @@
 
 #import <Foundation/Foundation.h>
 
+@class GeniusAnswerKey;
+@class GeniusMemoryReport;
+
+typedef struct _GeniusItemStorage GeniusItemStorage;
 
 //! A GeniusItem models one or more representations of a memorizable atom of information.
 /*! Example atoms of information include strings, images, web links, or sounds. A GeniusItem represents one of these atomic types of information. */
+/*!
+    The atoms live in a reference counted GeniusItemStorage that copies share until one of them is changed,
+    so copying an item costs one small allocation however much it holds.
+ */
 //! @todo Delete dead code. 
 @interface GeniusItem : NSObject <NSCoding, NSCopying> {
-    //! string atom
-    NSString * _stringValue;
-    //! image atom @todo not used
-    NSURL * _imageURL;
-    //! link atom @todo not used
-    NSURL * _webResourceURL;
-    //! synthesized speech atom @todo not used
-    NSString * _speakableStringValue;
-    //! record audio atom @todo not used
-    NSURL * _soundURL;
+    //! The atoms, possibly shared with copies.  NULL while all of them are nil.
+    GeniusItemStorage * _storage;
 }
 
 - (void) addObserver: (id) observer;
@@ -40,8 +40,12 @@
 
 // Visual
 - (NSString *) stringValue;
+- (void) setStringValue:(NSString *)string;
+- (GeniusAnswerKey *) answerKey;
 
 - (NSURL *) imageURL;
+- (void) setImageURL:(NSURL *)url;
+- (NSData *) imageData;
 
 - (NSURL *) webResourceURL;
 
@@ -49,5 +53,9 @@
 - (NSString *) speakableStringValue;
 
 - (NSURL *) soundURL;
+- (void) setSoundURL:(NSURL *)url;
+- (NSData *) soundData;
+
+- (void) addToMemoryReport:(GeniusMemoryReport *)report;
 
 @end
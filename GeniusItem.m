@@ -17,10 +17,71 @@
 */
 
 #import "GeniusItem.h"
+#import "GeniusMediaStore.h"
+#import "GeniusAnswerKey.h"
+#import "GeniusTrace.h"
+#import "GeniusMemoryReport.h"
+#include <libkern/OSAtomic.h>
+#include <malloc/malloc.h>  // malloc_size
+
+
+//! Values of a GeniusItem, shared by copies until one of them changes.
+struct _GeniusItemStorage {
+    int32_t refCount;                   //!< Number of items using the storage.
+    NSString * stringValue;             //!< string atom
+    NSURL * imageURL;                   //!< image atom, usually a GeniusMediaStore URL
+    NSURL * webResourceURL;             //!< link atom @todo not used
+    NSString * speakableStringValue;    //!< synthesized speech atom @todo not used
+    NSURL * soundURL;                   //!< record audio atom, usually a GeniusMediaStore URL
+    GeniusAnswerKey * answerKey;        //!< normalized stringValue for grading, computed on first use and dropped on edit
+};
+
+//! Returns a new storage holding retained copies of the values in @a source, or nil values when @a source is NULL.
+static GeniusItemStorage * GeniusItemStorageCreate(const GeniusItemStorage * source)
+{
+    GeniusItemStorage * storage = (GeniusItemStorage *)calloc(1, sizeof(GeniusItemStorage));
+    storage->refCount = 1;
+    if (source)
+    {
+        storage->stringValue = [source->stringValue retain];
+        storage->imageURL = [source->imageURL retain];
+        storage->webResourceURL = [source->webResourceURL retain];
+        storage->speakableStringValue = [source->speakableStringValue retain];
+        storage->soundURL = [source->soundURL retain];
+        storage->answerKey = [source->answerKey retain];
+    }
+    return storage;
+}
+
+//! Drops one use of @a storage, freeing it with the last.  @a storage may be NULL.
+static void GeniusItemStorageRelease(GeniusItemStorage * storage)
+{
+    if (storage == NULL || OSAtomicDecrement32Barrier(&storage->refCount) > 0)
+        return;
+    [storage->stringValue release];
+    [storage->imageURL release];
+    [storage->webResourceURL release];
+    [storage->speakableStringValue release];
+    [storage->soundURL release];
+    [storage->answerKey release];
+    free(storage);
+}
+
+
+@interface GeniusItem (Private)
+- (GeniusItemStorage *) _writableStorage;
+@end
 
 
 @implementation GeniusItem
 
+//! Counts item allocations while tracing.
++ (id) allocWithZone:(NSZone *)zone
+{
+    GeniusTraceCount(GeniusTraceCounterItemAllocations, 1);
+    return [super allocWithZone:zone];
+}
+
 //! Initializes new instance with all properties set to nil.
 - (id) init
 {
@@ -31,11 +92,9 @@
 //! Releases instance vars and deallocates instance.
 - (void) dealloc
 {
-    [_stringValue release];
-    [_imageURL release];
-    [_webResourceURL release];
-    [_speakableStringValue release];
-    [_soundURL release];
+    GeniusItemStorage * storage = _storage;
+    _storage = NULL;
+    GeniusItemStorageRelease(storage);
     [super dealloc];
 }
 
@@ -60,15 +119,15 @@
 }
 
 //! Creates and returns a copy of this instance in the new zone.
-/*! @todo Replace calls to @c copy with @c copyWithZone: for the instance variables. */
+/*! The copy shares _storage with the receiver; whichever of the two is changed first gets its own. */
 - (id)copyWithZone:(NSZone *)zone
 {
     GeniusItem * newItem = [[[self class] allocWithZone:zone] init];
-    newItem->_stringValue = [_stringValue copy];
-    newItem->_imageURL = [_imageURL copy];
-    newItem->_webResourceURL = [_webResourceURL copy];
-    newItem->_speakableStringValue = [_speakableStringValue copy];
-    newItem->_soundURL = [_soundURL copy];
+    if (_storage)
+    {
+        OSAtomicIncrement32Barrier(&_storage->refCount);
+        newItem->_storage = _storage;
+    }
     return newItem;
 }
 
@@ -79,11 +138,12 @@
     NSAssert([coder allowsKeyedCoding], @"allowsKeyedCoding");
 
     self = [super init];
-    _stringValue = [[coder decodeObjectForKey:@"stringValue"] retain];
-    _imageURL = [[coder decodeObjectForKey:@"imageURL"] retain];
-    _webResourceURL = [[coder decodeObjectForKey:@"webResourceURL"] retain];
-    _speakableStringValue = [[coder decodeObjectForKey:@"speakableStringValue"] retain];
-    _soundURL = [[coder decodeObjectForKey:@"soundURL"] retain];
+    _storage = GeniusItemStorageCreate(NULL);
+    _storage->stringValue = [[coder decodeObjectForKey:@"stringValue"] retain];
+    _storage->imageURL = [[coder decodeObjectForKey:@"imageURL"] retain];
+    _storage->webResourceURL = [[coder decodeObjectForKey:@"webResourceURL"] retain];
+    _storage->speakableStringValue = [[coder decodeObjectForKey:@"speakableStringValue"] retain];
+    _storage->soundURL = [[coder decodeObjectForKey:@"soundURL"] retain];
     return self;
 }
 
@@ -93,11 +153,13 @@
 {
     NSAssert([coder allowsKeyedCoding], @"allowsKeyedCoding");
 
-    if (_stringValue) [coder encodeObject:_stringValue forKey:@"stringValue"];
-    if (_imageURL) [coder encodeObject:_imageURL forKey:@"imageURL"];
-    if (_webResourceURL) [coder encodeObject:_webResourceURL forKey:@"webResourceURL"];
-    if (_speakableStringValue) [coder encodeObject:_speakableStringValue forKey:@"speakableStringValue"];
-    if (_soundURL) [coder encodeObject:_soundURL forKey:@"soundURL"];
+    if (_storage == NULL)
+        return;
+    if (_storage->stringValue) [coder encodeObject:_storage->stringValue forKey:@"stringValue"];
+    if (_storage->imageURL) [coder encodeObject:_storage->imageURL forKey:@"imageURL"];
+    if (_storage->webResourceURL) [coder encodeObject:_storage->webResourceURL forKey:@"webResourceURL"];
+    if (_storage->speakableStringValue) [coder encodeObject:_storage->speakableStringValue forKey:@"speakableStringValue"];
+    if (_storage->soundURL) [coder encodeObject:_storage->soundURL forKey:@"soundURL"];
 }
 
 //! Same as calling @c stringValue
@@ -106,34 +168,120 @@
     return [self stringValue];
 }
 
-//! _stringValue getter
+//! stringValue getter
 - (NSString *) stringValue
 {
-    return _stringValue;
+    return (_storage ? _storage->stringValue : nil);
+}
+
+//! stringValue setter.  Drops the cached #answerKey.
+- (void) setStringValue:(NSString *)string
+{
+    GeniusItemStorage * storage = [self _writableStorage];
+    [storage->stringValue release];
+    storage->stringValue = [string copy];
+    [storage->answerKey release];
+    storage->answerKey = nil;
 }
 
-//! _imageURL getter
+//! Normalized #stringValue used to grade answers, computed on first use.
+/*! The key is kept in _storage, so copies made before or after share it. */
+- (GeniusAnswerKey *) answerKey
+{
+    if (_storage == NULL)
+        _storage = GeniusItemStorageCreate(NULL);
+    if (_storage->answerKey == nil)
+        _storage->answerKey = [[GeniusAnswerKey alloc] initWithString:[self stringValue]];
+    return _storage->answerKey;
+}
+
+//! imageURL getter
 - (NSURL *) imageURL
 {
-    return _imageURL;
+    return (_storage ? _storage->imageURL : nil);
 }
 
-//! _webResourceURL getter
+//! imageURL setter
+- (void) setImageURL:(NSURL *)url
+{
+    GeniusItemStorage * storage = [self _writableStorage];
+    [storage->imageURL release];
+    storage->imageURL = [url copy];
+}
+
+//! Contents of #imageURL if it names a blob in an open GeniusMediaStore, otherwise nil.
+- (NSData *) imageData
+{
+    return [GeniusMediaStore dataForURL:[self imageURL]];
+}
+
+//! webResourceURL getter
 - (NSURL *) webResourceURL
 {
-    return _webResourceURL;
+    return (_storage ? _storage->webResourceURL : nil);
 }
 
-//! _speakableStringValue getter
+//! speakableStringValue getter
 - (NSString *) speakableStringValue
 {
-    return _speakableStringValue;
+    return (_storage ? _storage->speakableStringValue : nil);
 }
 
-//! _soundURL getter
+//! soundURL getter
 - (NSURL *) soundURL
 {
-    return _soundURL;
+    return (_storage ? _storage->soundURL : nil);
+}
+
+//! soundURL setter
+- (void) setSoundURL:(NSURL *)url
+{
+    GeniusItemStorage * storage = [self _writableStorage];
+    [storage->soundURL release];
+    storage->soundURL = [url copy];
+}
+
+//! Contents of #soundURL if it names a blob in an open GeniusMediaStore, otherwise nil.
+- (NSData *) soundData
+{
+    return [GeniusMediaStore dataForURL:[self soundURL]];
+}
+
+//! Adds the item and its storage to @a report.  Storage shared with copies counts once, with whichever item comes first.
+- (void) addToMemoryReport:(GeniusMemoryReport *)report
+{
+    if ([report addObject:self toSubsystem:GeniusMemoryItemsSubsystem] == NO)
+        return;
+    [report addObservationInfoOfObject:self];
+    if ([report shouldCountPointer:_storage] == NO)
+        return;
+
+    [report addByteCount:malloc_size(_storage) objectCount:0 toSubsystem:GeniusMemoryItemsSubsystem];
+    [report addString:_storage->stringValue toSubsystem:GeniusMemoryTextSubsystem];
+    [report addString:_storage->speakableStringValue toSubsystem:GeniusMemoryTextSubsystem];
+    [report addObject:_storage->imageURL toSubsystem:GeniusMemoryItemsSubsystem];
+    [report addObject:_storage->webResourceURL toSubsystem:GeniusMemoryItemsSubsystem];
+    [report addObject:_storage->soundURL toSubsystem:GeniusMemoryItemsSubsystem];
+    [report addObject:_storage->answerKey toSubsystem:GeniusMemoryItemsSubsystem];
+}
+
+@end
+
+
+@implementation GeniusItem (Private)
+
+//! Returns _storage for changing, first giving the receiver a storage of its own if it shares one with copies.
+- (GeniusItemStorage *) _writableStorage
+{
+    if (_storage == NULL)
+        _storage = GeniusItemStorageCreate(NULL);
+    else if (_storage->refCount > 1)
+    {
+        GeniusItemStorage * shared = _storage;
+        _storage = GeniusItemStorageCreate(shared);
+        GeniusItemStorageRelease(shared);
+    }
+    return _storage;
 }
 
 @end
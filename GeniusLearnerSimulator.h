@@ -0,0 +1,91 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusScheduler.h"
+#import "GeniusPair.h"
+
+//! Replays synthetic learners against GeniusAssociationEnumerator and a GeniusScheduler, without any user interface.
+/*!
+    Every learner gets a private copy of the deck and studies it for #dayCount days, in sessions set up
+    like GeniusDocument#quizAutoPick: (13 associations chosen by the Poisson bucket selection around the
+    probability center).  Each answer is drawn from a forgetting model, handed to the real enumerator and
+    scheduler, and simulated time moves on by a fixed time per answer.
+
+    The forgetting model keeps a memory stability @c S, in days, per association:  the chance to recall it
+    @c t days after the last review is <tt>exp(-t / S)</tt>, and never seen associations are always missed.
+    A miss resets @c S to <tt>initialStability * ability / difficulty</tt>.  A hit multiplies it by
+    <tt>1 + stabilityGrowth * ability / difficulty * (1 - p)</tt>, where @c p was the chance of recalling it,
+    so reviews of well remembered associations add little.  Difficulties are fixed per association and
+    ability per learner, both drawn from the seed.
+
+    Learners run in parallel on #threadCount threads, each with its own GeniusRandomState derived from the
+    seed and its number, so results do not depend on the number of threads.  Parameters, all optional:
+
+    - @c learnerCount (1000) and @c dayCount (90)
+    - @c sessionsPerDay (1), @c cardsPerSession (13), @c probabilityCenter (1.0), @c minimumScore (-1),
+      @c reviewBA (0, quiz B to A as well when 1), @c secondsPerAnswer (8) and @c maximumAnswersPerSession (300)
+    - @c initialStability (1.0), @c stabilityGrowth (3.0), @c difficultySpread (0.5) and @c abilitySpread (0.2)
+    - @c seed (1) and @c startTime (1200000000)
+ */
+@interface GeniusLearnerSimulator : NSObject {
+    NSDictionary * _parameters;         //!< Simulation parameters, see above.
+    id <GeniusScheduler> _scheduler;    //!< Scheduler under test.
+    unsigned int _threadCount;          //!< Worker threads, 0 for one per processor.
+
+    unsigned int _pairCount;            //!< Pairs in the deck.
+    int * _importances;                 //!< GeniusPair#importance of each pair of the deck.
+    GeniusPairID * _pairIDs;            //!< GeniusPair#pairID of each pair of the deck.
+    unsigned int _associationCount;     //!< Associations quizzed per learner.
+    double * _difficulties;             //!< Difficulty of each quizzed association, around 1.
+
+    unsigned int _learnerCount;         //!< Learners simulated by #run.
+    unsigned int _dayCount;             //!< Days simulated per learner.
+    float * _learnerRetention;          //!< Mean recall probability at the end of each day, by learner then day.
+    unsigned int * _learnerAnswers;     //!< Answers given each day, by learner then day.
+    unsigned int * _learnerCorrect;     //!< Correct answers given each day, by learner then day.
+
+    int32_t _nextLearner;               //!< Next learner to simulate, shared by the worker threads.
+    NSConditionLock * _runningLock;     //!< Condition is the number of worker threads still running.
+    NSTimeInterval _elapsed;            //!< Wall clock duration of the last #run.
+}
+
++ (unsigned int) processorCount;
+
+- (id) initWithPairs:(NSArray *)pairs parameters:(NSDictionary *)parameters;
+
+- (id <GeniusScheduler>) scheduler;
+- (void) setScheduler:(id <GeniusScheduler>)scheduler;
+
+- (unsigned int) threadCount;
+- (void) setThreadCount:(unsigned int)threadCount;
+
+- (void) run;
+
+- (unsigned int) learnerCount;
+- (unsigned int) dayCount;
+- (double) retentionOnDay:(unsigned int)day;
+- (double) answersOnDay:(unsigned int)day;
+- (double) accuracyOnDay:(unsigned int)day;
+- (unsigned long long) answerCount;
+- (double) answersPerSecond;
+
+- (NSString *) report;
+
+@end
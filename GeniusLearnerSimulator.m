@@ -0,0 +1,386 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusLearnerSimulator.h"
+#import "GeniusAssociationEnumerator.h"
+#import "GeniusRandom.h"
+#import "GeniusTimingWheel.h"   // kGeniusTimeDay
+#include <libkern/OSAtomic.h>   // OSAtomicIncrement32Barrier
+#include <sys/sysctl.h>         // sysctlbyname
+#include <math.h>               // exp
+
+//! Spreads the seeds of consecutive learners over the whole range.
+static const uint64_t kGeniusLearnerSeedStride = 0xD1B54A32D192ED03ULL;
+
+//! Memory of one association in the forgetting model.
+typedef struct _GeniusLearnerMemory {
+    double stability;           //!< Days until recall drops to 1/e.
+    GeniusTime lastReview;      //!< kGeniusTimeNone until first seen.
+} GeniusLearnerMemory;
+
+//! Chance of recalling @a memory at @a now.
+static double RecallProbability(const GeniusLearnerMemory * memory, GeniusTime now)
+{
+    if (memory->lastReview == kGeniusTimeNone)
+        return 0.0;
+    double days = (double)(now - memory->lastReview) / kGeniusTimeDay;
+    return exp(-MAX(days, 0.0) / memory->stability);
+}
+
+
+@interface GeniusLearnerSimulator (Private)
+- (double) _doubleParameterForKey:(NSString *)key defaultValue:(double)defaultValue;
+- (void) _runLearners;
+- (void) _workerThread:(id)unused;
+- (void) _simulateLearner:(unsigned int)learner;
+@end
+
+@implementation GeniusLearnerSimulator
+
+//! Number of processors available to run learners.
++ (unsigned int) processorCount
+{
+    int count = 1;
+    size_t size = sizeof(count);
+    if (sysctlbyname("hw.activecpu", &count, &size, NULL, 0) != 0 || count < 1)
+        count = 1;
+    return (unsigned int)count;
+}
+
+//! Designated initializer.  Learners study copies of @a pairs, starting from scratch.  @a parameters may be nil.
+- (id) initWithPairs:(NSArray *)pairs parameters:(NSDictionary *)parameters
+{
+    self = [super init];
+    if (self != nil) {
+        _parameters = [parameters copy];
+        _scheduler = [[GeniusScoreScheduler defaultScheduler] retain];
+
+        _pairCount = [pairs count];
+        _importances = (int *)malloc(MAX(_pairCount, 1U) * sizeof(int));
+        _pairIDs = (GeniusPairID *)malloc(MAX(_pairCount, 1U) * sizeof(GeniusPairID));
+        unsigned int i;
+        for (i=0; i<_pairCount; i++)
+        {
+            GeniusPair * pair = [pairs objectAtIndex:i];
+            _importances[i] = [pair importance];
+            _pairIDs[i] = [pair pairID];
+        }
+
+        BOOL reviewBA = ([self _doubleParameterForKey:@"reviewBA" defaultValue:0.0] != 0.0);
+        _associationCount = [[GeniusPair associationsForPairs:pairs useAB:YES useBA:reviewBA] count];
+        _difficulties = (double *)malloc(MAX(_associationCount, 1U) * sizeof(double));
+        GeniusRandomState random;
+        GeniusRandomSeed(&random, (uint64_t)[self _doubleParameterForKey:@"seed" defaultValue:1.0]);
+        double spread = [self _doubleParameterForKey:@"difficultySpread" defaultValue:0.5];
+        for (i=0; i<_associationCount; i++)
+            _difficulties[i] = exp(spread * GeniusRandomNormal(&random));
+    }
+    return self;
+}
+
+//! Releases the scheduler, frees the results and deallocates memory.
+- (void) dealloc
+{
+    [_parameters release];
+    [_scheduler release];
+    free(_importances);
+    free(_pairIDs);
+    free(_difficulties);
+    free(_learnerRetention);
+    free(_learnerAnswers);
+    free(_learnerCorrect);
+    [super dealloc];
+}
+
+//! _scheduler getter.
+- (id <GeniusScheduler>) scheduler
+{
+    return _scheduler;
+}
+
+//! _scheduler setter.  Passing nil restores GeniusScoreScheduler#defaultScheduler.
+/*! The scheduler is shared by all worker threads, so it must not keep state between calls. */
+- (void) setScheduler:(id <GeniusScheduler>)scheduler
+{
+    if (scheduler == nil)
+        scheduler = [GeniusScoreScheduler defaultScheduler];
+    [_scheduler release];
+    _scheduler = [scheduler retain];
+}
+
+//! _threadCount getter.
+- (unsigned int) threadCount
+{
+    return _threadCount;
+}
+
+//! _threadCount setter.  0 runs one worker thread per processor.
+- (void) setThreadCount:(unsigned int)threadCount
+{
+    _threadCount = threadCount;
+}
+
+//! Simulates every learner and blocks until all are done.
+- (void) run
+{
+    _learnerCount = (unsigned int)[self _doubleParameterForKey:@"learnerCount" defaultValue:1000.0];
+    _dayCount = (unsigned int)[self _doubleParameterForKey:@"dayCount" defaultValue:90.0];
+    unsigned int cells = MAX(_learnerCount * _dayCount, 1U);
+    free(_learnerRetention);
+    free(_learnerAnswers);
+    free(_learnerCorrect);
+    _learnerRetention = (float *)calloc(cells, sizeof(float));
+    _learnerAnswers = (unsigned int *)calloc(cells, sizeof(unsigned int));
+    _learnerCorrect = (unsigned int *)calloc(cells, sizeof(unsigned int));
+    _nextLearner = 0;
+
+    unsigned int threadCount = (_threadCount ? _threadCount : [GeniusLearnerSimulator processorCount]);
+    threadCount = MIN(threadCount, _learnerCount);
+
+    NSDate * start = [NSDate date];
+    if (threadCount <= 1)
+        [self _runLearners];
+    else
+    {
+        _runningLock = [[NSConditionLock alloc] initWithCondition:threadCount];
+        unsigned int i;
+        for (i=0; i<threadCount; i++)
+            [NSThread detachNewThreadSelector:@selector(_workerThread:) toTarget:self withObject:nil];
+        [_runningLock lockWhenCondition:0];
+        [_runningLock unlock];
+        [_runningLock release];
+        _runningLock = nil;
+    }
+    _elapsed = -[start timeIntervalSinceNow];
+}
+
+//! Number of learners of the last #run.
+- (unsigned int) learnerCount
+{
+    return _learnerCount;
+}
+
+//! Number of days of the last #run.
+- (unsigned int) dayCount
+{
+    return _dayCount;
+}
+
+//! Mean chance, over learners and quizzed associations, to recall an association at the end of @a day.
+- (double) retentionOnDay:(unsigned int)day
+{
+    double sum = 0.0;
+    unsigned int learner;
+    for (learner=0; learner<_learnerCount; learner++)
+        sum += _learnerRetention[learner * _dayCount + day];
+    return (_learnerCount ? sum / _learnerCount : 0.0);
+}
+
+//! Mean number of answers a learner gives on @a day.
+- (double) answersOnDay:(unsigned int)day
+{
+    unsigned long long sum = 0;
+    unsigned int learner;
+    for (learner=0; learner<_learnerCount; learner++)
+        sum += _learnerAnswers[learner * _dayCount + day];
+    return (_learnerCount ? (double)sum / _learnerCount : 0.0);
+}
+
+//! Fraction of the answers given on @a day that were right.
+- (double) accuracyOnDay:(unsigned int)day
+{
+    unsigned long long answers = 0, correct = 0;
+    unsigned int learner;
+    for (learner=0; learner<_learnerCount; learner++)
+    {
+        answers += _learnerAnswers[learner * _dayCount + day];
+        correct += _learnerCorrect[learner * _dayCount + day];
+    }
+    return (answers ? (double)correct / answers : 0.0);
+}
+
+//! Answers simulated by the last #run.
+- (unsigned long long) answerCount
+{
+    unsigned long long sum = 0;
+    unsigned int i, cells = _learnerCount * _dayCount;
+    for (i=0; i<cells; i++)
+        sum += _learnerAnswers[i];
+    return sum;
+}
+
+//! Simulated answers per wall clock second of the last #run.
+- (double) answersPerSecond
+{
+    return [self answerCount] / MAX(_elapsed, 1e-9);
+}
+
+//! Tab separated retention and workload curves of the last #run, one line per day after a summary line.
+- (NSString *) report
+{
+    NSMutableString * report = [NSMutableString stringWithFormat:@"# %@ scheduler, %u learners, %u pairs, %u days, %llu answers, %.0f answers/s\n",
+        [_scheduler identifier], _learnerCount, _pairCount, _dayCount, [self answerCount], [self answersPerSecond]];
+    [report appendString:@"day\tretention\tanswers\taccuracy\n"];
+    unsigned int day;
+    for (day=0; day<_dayCount; day++)
+        [report appendFormat:@"%u\t%.4f\t%.2f\t%.4f\n", day + 1, [self retentionOnDay:day], [self answersOnDay:day], [self accuracyOnDay:day]];
+    return report;
+}
+
+@end
+
+
+@implementation GeniusLearnerSimulator (Private)
+
+//! Convenience method for reading a numeric parameter.
+- (double) _doubleParameterForKey:(NSString *)key defaultValue:(double)defaultValue
+{
+    id value = [_parameters objectForKey:key];
+    if (value && [value respondsToSelector:@selector(doubleValue)])
+        return [value doubleValue];
+    return defaultValue;
+}
+
+//! Simulates learners until none is left.  Runs on every worker thread at once.
+- (void) _runLearners
+{
+    int32_t learner;
+    while ((learner = OSAtomicIncrement32Barrier(&_nextLearner) - 1) < (int32_t)_learnerCount)
+        [self _simulateLearner:(unsigned int)learner];
+}
+
+//! Body of a worker thread started by #run.
+- (void) _workerThread:(id)unused
+{
+    NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+    [self _runLearners];
+    [_runningLock lock];
+    [_runningLock unlockWithCondition:[_runningLock condition] - 1];
+    [pool release];
+}
+
+//! Runs every session of @a learner and stores its daily results.
+/*!
+    Only touches objects created here, the results row of @a learner and the stateless #_scheduler, so
+    learners can run on any thread.  Pairs are created with the deck's identifiers rather than new ones.
+ */
+- (void) _simulateLearner:(unsigned int)learner
+{
+    NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+
+    GeniusRandomState random;
+    uint64_t seed = (uint64_t)[self _doubleParameterForKey:@"seed" defaultValue:1.0];
+    GeniusRandomSeed(&random, seed + (learner + 1) * kGeniusLearnerSeedStride);
+
+    double ability = 1.0 + [self _doubleParameterForKey:@"abilitySpread" defaultValue:0.2] * GeniusRandomNormal(&random);
+    ability = MIN(MAX(ability, 0.2), 3.0);
+    double initialStability = [self _doubleParameterForKey:@"initialStability" defaultValue:1.0];
+    double stabilityGrowth = [self _doubleParameterForKey:@"stabilityGrowth" defaultValue:3.0];
+    unsigned int sessionsPerDay = MAX((unsigned int)[self _doubleParameterForKey:@"sessionsPerDay" defaultValue:1.0], 1U);
+    unsigned int cardsPerSession = (unsigned int)[self _doubleParameterForKey:@"cardsPerSession" defaultValue:13.0];
+    float probabilityCenter = [self _doubleParameterForKey:@"probabilityCenter" defaultValue:1.0];
+    int minimumScore = (int)[self _doubleParameterForKey:@"minimumScore" defaultValue:-1.0];
+    BOOL reviewBA = ([self _doubleParameterForKey:@"reviewBA" defaultValue:0.0] != 0.0);
+    GeniusTime secondsPerAnswer = (GeniusTime)[self _doubleParameterForKey:@"secondsPerAnswer" defaultValue:8.0];
+    unsigned int maximumAnswers = (unsigned int)[self _doubleParameterForKey:@"maximumAnswersPerSession" defaultValue:300.0];
+    GeniusTime startTime = (GeniusTime)[self _doubleParameterForKey:@"startTime" defaultValue:1200000000.0];
+
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:_pairCount];
+    unsigned int i;
+    for (i=0; i<_pairCount; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] initWithItemA:nil itemB:nil userDict:[NSMutableDictionary dictionary] pairID:_pairIDs[i]];
+        [pair setImportance:_importances[i]];
+        [pairs addObject:pair];
+        [pair release];
+    }
+    NSArray * associations = [GeniusPair associationsForPairs:pairs useAB:YES useBA:reviewBA];
+    unsigned int associationCount = MIN([associations count], _associationCount);
+
+    GeniusLearnerMemory * memories = (GeniusLearnerMemory *)malloc(MAX(associationCount, 1U) * sizeof(GeniusLearnerMemory));
+    CFMutableDictionaryRef indexes = CFDictionaryCreateMutable(kCFAllocatorDefault, associationCount, NULL, NULL);
+    for (i=0; i<associationCount; i++)
+    {
+        memories[i].stability = initialStability;
+        memories[i].lastReview = kGeniusTimeNone;
+        CFDictionarySetValue(indexes, [associations objectAtIndex:i], (const void *)(uintptr_t)(i + 1));
+    }
+
+    unsigned int day, session;
+    for (day=0; day<_dayCount; day++)
+    {
+        NSAutoreleasePool * dayPool = [[NSAutoreleasePool alloc] init];
+        unsigned int answers = 0, correct = 0;
+        for (session=0; session<sessionsPerDay; session++)
+        {
+            GeniusTime now = startTime + day * kGeniusTimeDay + session * (kGeniusTimeDay / sessionsPerDay);
+            GeniusAssociationEnumerator * enumerator = [[GeniusAssociationEnumerator alloc] initWithAssociations:associations];
+            [enumerator setCount:cardsPerSession];
+            [enumerator setMinimumScore:minimumScore];
+            [enumerator setProbabilityCenter:probabilityCenter];
+            [enumerator setScheduler:_scheduler];
+            [enumerator setTime:now];
+            [enumerator setRandomSeed:GeniusRandomNext(&random)];
+
+            unsigned int sessionAnswers = 0;
+            GeniusAssociation * association;
+            while (sessionAnswers < maximumAnswers && (association = [enumerator nextAssociation]))
+            {
+                unsigned int index = (unsigned int)(uintptr_t)CFDictionaryGetValue(indexes, association) - 1;
+                GeniusLearnerMemory * memory = &memories[index];
+                double factor = ability / _difficulties[index];
+                double p = RecallProbability(memory, now);
+                if (GeniusRandomUniform(&random) < p)
+                {
+                    memory->stability *= 1.0 + stabilityGrowth * factor * (1.0 - p);
+                    [enumerator associationRight:association];
+                    correct++;
+                }
+                else
+                {
+                    memory->stability = initialStability * factor;
+                    [enumerator associationWrong:association];
+                }
+                memory->lastReview = now;
+                sessionAnswers++;
+
+                now += secondsPerAnswer;
+                [enumerator setTime:now];
+            }
+            answers += sessionAnswers;
+            [enumerator release];
+        }
+
+        GeniusTime endOfDay = startTime + (day + 1) * kGeniusTimeDay;
+        double retention = 0.0;
+        for (i=0; i<associationCount; i++)
+            retention += RecallProbability(&memories[i], endOfDay);
+
+        unsigned int cell = learner * _dayCount + day;
+        _learnerRetention[cell] = (associationCount ? retention / associationCount : 0.0);
+        _learnerAnswers[cell] = answers;
+        _learnerCorrect[cell] = correct;
+        [dayPool release];
+    }
+
+    CFRelease(indexes);
+    free(memories);
+    [pool release];
+}
+
+@end
@@ -0,0 +1,111 @@
+//
+//  GeniusLearnerSimulatorTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusLearnerSimulator.h"
+#import "GeniusAssociationEnumerator.h"
+#import "GeniusPair.h"
+
+@interface GeniusLearnerSimulatorTest : SenTestCase {
+    NSMutableArray *pairs;      //!< The deck studied.
+}
+
+@end
+
+//! Tests for GeniusLearnerSimulator and the seeded enumerator it relies on.
+@implementation GeniusLearnerSimulatorTest
+
+//! Creates a deck of 60 pairs, every tenth one disabled.
+- (void) setUp
+{
+    pairs = [[NSMutableArray alloc] init];
+    int i;
+    for (i=0; i<60; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [pair setImportance:(i % 10 == 9 ? kGeniusPairDisabledImportance : kGeniusPairNormalImportance)];
+        [pairs addObject:pair];
+        [pair release];
+    }
+}
+
+//! Releases the deck.
+- (void) tearDown
+{
+    [pairs release];
+    pairs = nil;
+}
+
+//! Simulation parameters small enough for a unit test.
+- (NSDictionary *) _parameters
+{
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithInt:12], @"learnerCount",
+        [NSNumber numberWithInt:20], @"dayCount",
+        [NSNumber numberWithInt:7], @"seed",
+        nil];
+}
+
+//! Seeded enumerators at a fixed time choose the same session.
+- (void) testSeededEnumerator
+{
+    NSArray * associations = [GeniusPair associationsForPairs:pairs useAB:YES useBA:NO];
+    NSMutableArray * sessions = [NSMutableArray array];
+    int run;
+    for (run=0; run<2; run++)
+    {
+        GeniusAssociationEnumerator * enumerator = [[GeniusAssociationEnumerator alloc] initWithAssociations:associations];
+        [enumerator setCount:13];
+        [enumerator setTime:1200000000LL];
+        [enumerator setRandomSeed:42];
+        [enumerator performChooseAssociations];
+        [sessions addObject:[enumerator upcomingAssociations:13]];
+        [enumerator release];
+    }
+    STAssertEquals([[sessions objectAtIndex:0] count], 13U, nil);
+    STAssertEqualObjects([sessions objectAtIndex:0], [sessions objectAtIndex:1], nil);
+}
+
+//! Results depend on the seed only, not on the number of threads.
+- (void) testThreadCountDoesNotChangeResults
+{
+    GeniusLearnerSimulator * serial = [[[GeniusLearnerSimulator alloc] initWithPairs:pairs parameters:[self _parameters]] autorelease];
+    [serial setThreadCount:1];
+    [serial run];
+
+    GeniusLearnerSimulator * parallel = [[[GeniusLearnerSimulator alloc] initWithPairs:pairs parameters:[self _parameters]] autorelease];
+    [parallel setThreadCount:4];
+    [parallel run];
+
+    STAssertEquals([parallel answerCount], [serial answerCount], nil);
+    unsigned int day;
+    for (day=0; day<[serial dayCount]; day++)
+    {
+        STAssertEquals([parallel retentionOnDay:day], [serial retentionOnDay:day], @"day %u", day);
+        STAssertEquals([parallel answersOnDay:day], [serial answersOnDay:day], @"day %u", day);
+        STAssertEquals([parallel accuracyOnDay:day], [serial accuracyOnDay:day], @"day %u", day);
+    }
+}
+
+//! Studying every day builds up retention, and only enabled pairs are quizzed.
+- (void) testCurves
+{
+    GeniusLearnerSimulator * simulator = [[[GeniusLearnerSimulator alloc] initWithPairs:pairs parameters:[self _parameters]] autorelease];
+    [simulator run];
+
+    STAssertEquals([simulator learnerCount], 12U, nil);
+    STAssertEquals([simulator dayCount], 20U, nil);
+    STAssertTrue([simulator answersOnDay:0] >= 13.0, @"a session covers at least 13 cards");
+    STAssertTrue([simulator retentionOnDay:19] > [simulator retentionOnDay:0], nil);
+    STAssertTrue([simulator retentionOnDay:19] <= 1.0, nil);
+    STAssertTrue([simulator accuracyOnDay:19] > 0.0 && [simulator accuracyOnDay:19] < 1.0, nil);
+    STAssertTrue([simulator answersPerSecond] > 0.0, nil);
+    STAssertTrue([[simulator report] hasPrefix:@"# classic scheduler, 12 learners, 60 pairs, 20 days"], [simulator report]);
+}
+
+@end
@@ -0,0 +1,92 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusPair.h"
+#import "GeniusItem.h"
+
+//! Text fields of a card stored in a GeniusLibrary.
+typedef enum {
+    GeniusLibraryFieldItemA = 0,
+    GeniusLibraryFieldItemB,
+    GeniusLibraryFieldGroup,
+    GeniusLibraryFieldType,
+    GeniusLibraryFieldNotes,
+    GeniusLibraryFieldCount
+} GeniusLibraryField;
+
+//! Read-only, memory mapped card content shared by every deck studying it.
+/*!
+    A library file (@c .geniuslibrary) holds the text of each card and its GeniusPair#pairID, and nothing
+    about any learner.  It is mapped read only, so documents in the same process share one instance and
+    other processes share the same pages.  Decks studying a library only save a performance overlay, see
+    #overlayDataForPairs:, so their size grows with what was studied rather than with the library.
+
+    Layout, all integers little endian: a 32 byte header ("GLIB", version, card count, reserved,
+    64 bit offset of the string pool, reserved), then one 48 byte record per card in deck order
+    (64 bit id, then offset and length of each field's UTF-8 text in the string pool), then the 32 bit
+    card indexes ordered by card id, then the pool.  Version 1 files have no index; their cards are
+    sorted by id.  Every text is checked to lie within the pool when the file is opened.
+ */
+@interface GeniusLibrary : NSObject {
+    NSString * _path;               //!< Standardized path of the library file.
+    NSData * _data;                 //!< Mapped contents of the file.
+    const unsigned char * _records; //!< First card record within _data.
+    const unsigned char * _idOrder; //!< Card indexes ordered by id within _data, or NULL if the cards are.
+    const unsigned char * _strings; //!< String pool within _data.
+    unsigned int _count;            //!< Number of cards.
+}
+
++ (GeniusLibrary *) libraryWithContentsOfFile:(NSString *)path;
++ (BOOL) writeLibraryWithPairs:(NSArray *)pairs toFile:(NSString *)path;
+
+- (NSString *) path;
+- (unsigned int) count;
+
+- (GeniusPairID) pairIDAtIndex:(unsigned int)index;
+- (unsigned int) indexOfPairID:(GeniusPairID)pairID;
+- (NSString *) stringForField:(GeniusLibraryField)field atIndex:(unsigned int)index;
+
+- (NSMutableArray *) pairsWithOverlayData:(NSData *)overlayData;
++ (NSData *) overlayDataForPairs:(NSArray *)pairs;
+
+@end
+
+
+//! GeniusItem whose text is read from a GeniusLibrary on demand instead of being held in memory.
+@interface GeniusLibraryItem : GeniusItem {
+    GeniusLibrary * _library;       //!< Library holding the text.
+    unsigned int _libraryIndex;     //!< Card index in _library.
+    GeniusLibraryField _field;      //!< Which text of the card this item shows.
+}
+
+- (id) initWithLibrary:(GeniusLibrary *)library index:(unsigned int)index field:(GeniusLibraryField)field;
+
+@end
+
+
+//! GeniusPair of a library deck.  Group, type and notes come from the library and can't be changed.
+@interface GeniusLibraryPair : GeniusPair {
+    GeniusLibrary * _library;       //!< Library holding the card.
+    unsigned int _libraryIndex;     //!< Card index in _library.
+}
+
+- (id) initWithLibrary:(GeniusLibrary *)library index:(unsigned int)index;
+
+@end
@@ -0,0 +1,473 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusLibrary.h"
+#import "GeniusAssociation.h"
+#import "GeniusByteOrder.h"
+#include <pthread.h>
+
+//! Size of the library header in bytes.
+#define kGeniusLibraryHeaderSize 32
+
+//! Size of one card record: the id plus offset and length of each field.
+#define kGeniusLibraryRecordSize (8 + 8 * GeniusLibraryFieldCount)
+
+//! Library file format version.  Version 1 files, sorted by card id and without an id index, are still read.
+#define kGeniusLibraryVersion 2
+
+//! Size of the overlay header: magic, version, record size and record count.
+#define kGeniusOverlayHeaderSize 16
+
+//! Size of one overlay record: id, two due times, two scores, importance and a reserved word.
+#define kGeniusOverlayRecordSize 40
+
+//! Overlay format version.
+#define kGeniusOverlayVersion 1
+
+extern NSString * GeniusPairCustomTypeStringKey;
+extern NSString * GeniusPairCustomGroupStringKey;
+extern NSString * GeniusPairNotesStringKey;
+
+static const unsigned char kGeniusLibraryMagic[4] = { 'G', 'L', 'I', 'B' };
+static const unsigned char kGeniusOverlayMagic[4] = { 'G', 'O', 'V', 'L' };
+
+//! Open libraries by standardized path.  Values are not retained; each library removes itself in dealloc.
+static CFMutableDictionaryRef sharedLibraries = NULL;
+
+//! Guards sharedLibraries.  Decks are read on background threads by GeniusDeckSearchIndex.
+/*! Held across the last release of a library, so that no thread finds it while it is deallocated. */
+static pthread_mutex_t sharedLibrariesLock = PTHREAD_MUTEX_INITIALIZER;
+
+//! A card of a library being written, for sorting the id index.
+typedef struct _GeniusLibraryIDEntry {
+    GeniusPairID pairID;
+    unsigned int index;         //!< Position of the card in the deck.
+} GeniusLibraryIDEntry;
+
+//! qsort() comparator ordering GeniusLibraryIDEntry items by pair id.
+static int CompareIDEntries(const void * entry1, const void * entry2)
+{
+    GeniusPairID id1 = ((const GeniusLibraryIDEntry *)entry1)->pairID;
+    GeniusPairID id2 = ((const GeniusLibraryIDEntry *)entry2)->pairID;
+    return (id1 < id2) ? -1 : (id1 > id2);
+}
+
+//! Text of @a field of @a pair as written to a library.
+static NSString * FieldString(GeniusPair * pair, GeniusLibraryField field)
+{
+    switch (field)
+    {
+        case GeniusLibraryFieldItemA:   return [[pair itemA] stringValue];
+        case GeniusLibraryFieldItemB:   return [[pair itemB] stringValue];
+        case GeniusLibraryFieldGroup:   return [pair customGroupString];
+        case GeniusLibraryFieldType:    return [pair customTypeString];
+        case GeniusLibraryFieldNotes:   return [pair notesString];
+        default:                        return nil;
+    }
+}
+
+
+@interface GeniusLibrary (Private)
+- (id) _initWithPath:(NSString *)path;
+- (unsigned int) _indexAtIDRank:(unsigned int)rank;
+@end
+
+@implementation GeniusLibrary
+
+//! Returns the library at @a path, shared with every other user of that file in this process.
+/*! Returns nil if the file can't be read or isn't a library.  Safe on any thread. */
++ (GeniusLibrary *) libraryWithContentsOfFile:(NSString *)path
+{
+    path = [path stringByStandardizingPath];
+    pthread_mutex_lock(&sharedLibrariesLock);
+    if (sharedLibraries == NULL)
+        sharedLibraries = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+    GeniusLibrary * library = [(GeniusLibrary *)CFDictionaryGetValue(sharedLibraries, path) retain];
+    pthread_mutex_unlock(&sharedLibrariesLock);
+    if (library)
+        return [library autorelease];
+
+    // Mapped outside the lock; another thread may open the same file meanwhile, and the first one wins.
+    GeniusLibrary * newLibrary = [[self alloc] _initWithPath:path];
+    if (newLibrary == nil)
+        return nil;
+    pthread_mutex_lock(&sharedLibrariesLock);
+    library = [(GeniusLibrary *)CFDictionaryGetValue(sharedLibraries, path) retain];
+    if (library == nil)
+    {
+        CFDictionarySetValue(sharedLibraries, path, newLibrary);
+        library = [newLibrary retain];
+    }
+    pthread_mutex_unlock(&sharedLibrariesLock);
+    [newLibrary release];
+    return [library autorelease];
+}
+
+//! Writes the text and ids of @a pairs to a new library file at @a path.  The cards keep the order of @a pairs.
++ (BOOL) writeLibraryWithPairs:(NSArray *)pairs toFile:(NSString *)path
+{
+    unsigned int count = [pairs count];
+    unsigned long long indexOffset = kGeniusLibraryHeaderSize + (unsigned long long)count * kGeniusLibraryRecordSize;
+    unsigned long long stringsOffset = indexOffset + (unsigned long long)count * 4;
+    NSMutableData * data = [NSMutableData dataWithLength:(unsigned int)stringsOffset];
+    unsigned char * header = [data mutableBytes];
+    memcpy(header, kGeniusLibraryMagic, 4);
+    PutUInt32(header + 4, kGeniusLibraryVersion);
+    PutUInt32(header + 8, count);
+    PutUInt64(header + 16, stringsOffset);
+
+    GeniusLibraryIDEntry * entries = (GeniusLibraryIDEntry *)malloc(MAX(count, 1U) * sizeof(GeniusLibraryIDEntry));
+    unsigned int i, poolLength = 0;
+    for (i=0; i<count; i++)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        GeniusPair * pair = [pairs objectAtIndex:i];
+        unsigned char record[kGeniusLibraryRecordSize];
+        PutUInt64(record, [pair pairID]);
+        entries[i].pairID = [pair pairID];
+        entries[i].index = i;
+
+        int field;
+        for (field=0; field<GeniusLibraryFieldCount; field++)
+        {
+            const char * utf8 = [(FieldString(pair, field) ? FieldString(pair, field) : @"") UTF8String];
+            unsigned int length = strlen(utf8);
+            PutUInt32(record + 8 + 8 * field, poolLength);
+            PutUInt32(record + 12 + 8 * field, length);
+            [data appendBytes:utf8 length:length];
+            poolLength += length;
+        }
+        [data replaceBytesInRange:NSMakeRange(kGeniusLibraryHeaderSize + i * kGeniusLibraryRecordSize, kGeniusLibraryRecordSize) withBytes:record];
+        [pool release];
+    }
+
+    qsort(entries, count, sizeof(GeniusLibraryIDEntry), CompareIDEntries);
+    unsigned char * index = (unsigned char *)[data mutableBytes] + indexOffset;
+    for (i=0; i<count; i++)
+        PutUInt32(index + 4 * i, entries[i].index);
+    free(entries);
+
+    return [data writeToFile:path atomically:YES];
+}
+
+//! Releases the receiver while holding sharedLibrariesLock, so the last release and the removal in dealloc are atomic.
+- (oneway void) release
+{
+    pthread_mutex_lock(&sharedLibrariesLock);
+    [super release];
+    pthread_mutex_unlock(&sharedLibrariesLock);
+}
+
+//! Removes the receiver from the shared libraries and unmaps the file.  Runs with sharedLibrariesLock held.
+- (void) dealloc
+{
+    if (sharedLibraries && CFDictionaryGetValue(sharedLibraries, _path) == self)
+        CFDictionaryRemoveValue(sharedLibraries, _path);
+    [_path release];
+    [_data release];
+    [super dealloc];
+}
+
+//! _path getter.
+- (NSString *) path
+{
+    return _path;
+}
+
+//! Number of cards in the library.
+- (unsigned int) count
+{
+    return _count;
+}
+
+//! Identifier of the card at @a index.  Cards are in the order of the deck the library was written from.
+- (GeniusPairID) pairIDAtIndex:(unsigned int)index
+{
+    return GetUInt64(_records + index * kGeniusLibraryRecordSize);
+}
+
+//! Index of the card with @a pairID, found by binary search of the id index.  NSNotFound if there is none.
+- (unsigned int) indexOfPairID:(GeniusPairID)pairID
+{
+    unsigned int low = 0, high = _count;
+    while (low < high)
+    {
+        unsigned int middle = low + (high - low) / 2;
+        if ([self pairIDAtIndex:[self _indexAtIDRank:middle]] < pairID)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < _count && [self pairIDAtIndex:[self _indexAtIDRank:low]] == pairID)
+        return [self _indexAtIDRank:low];
+    return NSNotFound;
+}
+
+//! Text of @a field of the card at @a index, decoded from the mapped file.  nil for empty text.
+/*! The offsets and lengths were checked against the string pool by #_initWithPath:. */
+- (NSString *) stringForField:(GeniusLibraryField)field atIndex:(unsigned int)index
+{
+    const unsigned char * record = _records + index * kGeniusLibraryRecordSize;
+    unsigned int offset = GetUInt32(record + 8 + 8 * field);
+    unsigned int length = GetUInt32(record + 12 + 8 * field);
+    if (length == 0)
+        return nil;
+    return [[[NSString alloc] initWithBytes:_strings + offset length:length encoding:NSUTF8StringEncoding] autorelease];
+}
+
+//! Creates a GeniusLibraryPair for every card, restoring the performance saved in @a overlayData.
+/*! The pairs are in the order of the deck the library was written from.  @a overlayData may be nil; entries for cards no longer in the library are dropped. */
+- (NSMutableArray *) pairsWithOverlayData:(NSData *)overlayData
+{
+    NSMutableArray * pairs = [NSMutableArray arrayWithCapacity:_count];
+    unsigned int i;
+    for (i=0; i<_count; i++)
+    {
+        GeniusLibraryPair * pair = [[GeniusLibraryPair alloc] initWithLibrary:self index:i];
+        [pairs addObject:pair];
+        [pair release];
+    }
+
+    const unsigned char * bytes = [overlayData bytes];
+    if ([overlayData length] < kGeniusOverlayHeaderSize || memcmp(bytes, kGeniusOverlayMagic, 4) != 0
+            || GetUInt32(bytes + 4) != kGeniusOverlayVersion || GetUInt32(bytes + 8) != kGeniusOverlayRecordSize)
+        return pairs;
+
+    unsigned int recordCount = MIN(GetUInt32(bytes + 12), ([overlayData length] - kGeniusOverlayHeaderSize) / kGeniusOverlayRecordSize);
+    for (i=0; i<recordCount; i++)
+    {
+        const unsigned char * record = bytes + kGeniusOverlayHeaderSize + i * kGeniusOverlayRecordSize;
+        unsigned int index = [self indexOfPairID:GetUInt64(record)];
+        if (index == NSNotFound)
+            continue;
+
+        GeniusPair * pair = [pairs objectAtIndex:index];
+        [[pair associationAB] setDueTime:(GeniusTime)GetUInt64(record + 8)];
+        [[pair associationBA] setDueTime:(GeniusTime)GetUInt64(record + 16)];
+        [[pair associationAB] setScore:(int)GetUInt32(record + 24)];
+        [[pair associationBA] setScore:(int)GetUInt32(record + 28)];
+        [pair setImportance:(int)GetUInt32(record + 32)];
+    }
+    return pairs;
+}
+
+//! Packs the performance of every pair in @a pairs that was studied or had its importance changed.
++ (NSData *) overlayDataForPairs:(NSArray *)pairs
+{
+    NSMutableData * data = [NSMutableData dataWithLength:kGeniusOverlayHeaderSize];
+    unsigned int recordCount = 0;
+    NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+    {
+        GeniusAssociation * associationAB = [pair associationAB];
+        GeniusAssociation * associationBA = [pair associationBA];
+        if ([associationAB scoreNumber] == nil && [associationBA scoreNumber] == nil
+                && [associationAB dueTime] == kGeniusTimeNone && [associationBA dueTime] == kGeniusTimeNone
+                && [pair importance] == kGeniusPairNormalImportance)
+            continue;
+
+        unsigned char record[kGeniusOverlayRecordSize];
+        memset(record, 0, sizeof(record));
+        PutUInt64(record, [pair pairID]);
+        PutUInt64(record + 8, (unsigned long long)[associationAB dueTime]);
+        PutUInt64(record + 16, (unsigned long long)[associationBA dueTime]);
+        PutUInt32(record + 24, (unsigned int)[associationAB score]);
+        PutUInt32(record + 28, (unsigned int)[associationBA score]);
+        PutUInt32(record + 32, (unsigned int)[pair importance]);
+        [data appendBytes:record length:sizeof(record)];
+        recordCount++;
+    }
+
+    unsigned char * header = [data mutableBytes];
+    memcpy(header, kGeniusOverlayMagic, 4);
+    PutUInt32(header + 4, kGeniusOverlayVersion);
+    PutUInt32(header + 8, kGeniusOverlayRecordSize);
+    PutUInt32(header + 12, recordCount);
+    return data;
+}
+
+@end
+
+
+@implementation GeniusLibrary (Private)
+
+//! Maps the file at @a path and checks its header, id index and text offsets.  Returns nil if it isn't a valid library.
+/*! Every later read stays within the mapped file, so a truncated or damaged library is rejected here rather than read past its end. */
+- (id) _initWithPath:(NSString *)path
+{
+    self = [super init];
+    if (self != nil) {
+        _path = [path copy];
+        _data = [[NSData alloc] initWithContentsOfMappedFile:path];
+
+        const unsigned char * bytes = [_data bytes];
+        unsigned long long length = [_data length];
+        unsigned int version = (length >= kGeniusLibraryHeaderSize ? GetUInt32(bytes + 4) : 0);
+        BOOL isValid = (length >= kGeniusLibraryHeaderSize && memcmp(bytes, kGeniusLibraryMagic, 4) == 0
+                            && (version == 1 || version == kGeniusLibraryVersion));
+        if (isValid)
+        {
+            _count = GetUInt32(bytes + 8);
+            unsigned long long indexOffset = kGeniusLibraryHeaderSize + (unsigned long long)_count * kGeniusLibraryRecordSize;
+            unsigned long long stringsOffset = GetUInt64(bytes + 16);
+            isValid = (stringsOffset == indexOffset + (version == 1 ? 0 : (unsigned long long)_count * 4) && stringsOffset <= length);
+            _records = bytes + kGeniusLibraryHeaderSize;
+            _idOrder = (version == 1 ? NULL : bytes + indexOffset);
+            _strings = bytes + stringsOffset;
+
+            // 32 bit offsets and lengths summed in 64 bits can't overflow.
+            unsigned long long poolLength = length - stringsOffset;
+            unsigned int i;
+            for (i=0; isValid && i<_count; i++)
+            {
+                const unsigned char * record = _records + i * kGeniusLibraryRecordSize;
+                int field;
+                for (field=0; field<GeniusLibraryFieldCount; field++)
+                    if ((unsigned long long)GetUInt32(record + 8 + 8 * field) + GetUInt32(record + 12 + 8 * field) > poolLength)
+                        isValid = NO;
+                if (_idOrder && GetUInt32(_idOrder + 4 * i) >= _count)
+                    isValid = NO;
+            }
+        }
+        if (isValid == NO)
+        {
+            NSLog(@"%@ is not a Genius library", path);
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+//! Index of the card with the @a rank th smallest id.
+- (unsigned int) _indexAtIDRank:(unsigned int)rank
+{
+    return (_idOrder ? GetUInt32(_idOrder + 4 * rank) : rank);
+}
+
+@end
+
+
+@implementation GeniusLibraryItem
+
+//! Designated initializer.
+- (id) initWithLibrary:(GeniusLibrary *)library index:(unsigned int)index field:(GeniusLibraryField)field
+{
+    self = [super init];
+    if (self != nil) {
+        _library = [library retain];
+        _libraryIndex = index;
+        _field = field;
+    }
+    return self;
+}
+
+//! Releases the library and frees memory.
+- (void) dealloc
+{
+    [_library release];
+    [super dealloc];
+}
+
+//! Text from the library.  Not cached, so it only occupies memory while in use.
+- (NSString *) stringValue
+{
+    return [_library stringForField:_field atIndex:_libraryIndex];
+}
+
+//! Returns a plain, editable GeniusItem with the same text.
+- (id)copyWithZone:(NSZone *)zone
+{
+    GeniusItem * newItem = [[GeniusItem allocWithZone:zone] init];
+    [newItem setValue:[self stringValue] forKey:@"stringValue"];
+    return newItem;
+}
+
+@end
+
+
+@implementation GeniusLibraryPair
+
+//! Designated initializer.  Takes the id of the card so that overlays and review logs find it.
+- (id) initWithLibrary:(GeniusLibrary *)library index:(unsigned int)index
+{
+    GeniusLibraryItem * itemA = [[[GeniusLibraryItem alloc] initWithLibrary:library index:index field:GeniusLibraryFieldItemA] autorelease];
+    GeniusLibraryItem * itemB = [[[GeniusLibraryItem alloc] initWithLibrary:library index:index field:GeniusLibraryFieldItemB] autorelease];
+    self = [super initWithItemA:itemA itemB:itemB userDict:[NSMutableDictionary dictionary]];
+    if (self != nil) {
+        _library = [library retain];
+        _libraryIndex = index;
+        _pairID = [library pairIDAtIndex:index];
+    }
+    return self;
+}
+
+//! Releases the library and frees memory.
+- (void) dealloc
+{
+    [_library release];
+    [super dealloc];
+}
+
+//! Returns a plain, editable GeniusPair with the same text, as GeniusPair#copyWithZone: does.
+- (id)copyWithZone:(NSZone *)zone
+{
+    GeniusItem * newItemA = [[[self itemA] copy] autorelease];
+    GeniusItem * newItemB = [[[self itemB] copy] autorelease];
+    NSMutableDictionary * newUserDict = [NSMutableDictionary dictionary];
+    [newUserDict setValue:[self customGroupString] forKey:GeniusPairCustomGroupStringKey];
+    [newUserDict setValue:[self customTypeString] forKey:GeniusPairCustomTypeStringKey];
+    [newUserDict setValue:[self notesString] forKey:GeniusPairNotesStringKey];
+    return [[GeniusPair allocWithZone:zone] initWithItemA:newItemA itemB:newItemB userDict:newUserDict];
+}
+
+//! Group from the library.
+- (NSString *) customGroupString
+{
+    return [_library stringForField:GeniusLibraryFieldGroup atIndex:_libraryIndex];
+}
+
+//! Library content is read only.
+- (void) setCustomGroupString:(NSString *)customGroup
+{
+}
+
+//! Type from the library.
+- (NSString *) customTypeString
+{
+    return [_library stringForField:GeniusLibraryFieldType atIndex:_libraryIndex];
+}
+
+//! Library content is read only.
+- (void) setCustomTypeString:(NSString *)customType
+{
+}
+
+//! Notes from the library.
+- (NSString *) notesString
+{
+    return [_library stringForField:GeniusLibraryFieldNotes atIndex:_libraryIndex];
+}
+
+//! Library content is read only.
+- (void) setNotesString:(NSString *)notesString
+{
+}
+
+@end
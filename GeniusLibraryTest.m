@@ -0,0 +1,155 @@
+//
+//  GeniusLibraryTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusLibrary.h"
+#import "GeniusAssociation.h"
+
+@interface GeniusLibraryTest : SenTestCase {
+    NSString *path;             //!< Temporary library file.
+    NSMutableArray *pairs;      //!< Pairs written to the library.
+}
+
+@end
+
+//! Tests for GeniusLibrary files and performance overlays.
+@implementation GeniusLibraryTest
+
+//! Writes a library of 100 cards to a temporary file for each test.
+- (void) setUp
+{
+    NSString * name = [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"geniuslibrary"];
+    path = [[NSTemporaryDirectory() stringByAppendingPathComponent:name] retain];
+
+    pairs = [[NSMutableArray alloc] init];
+    int i;
+    for (i=0; i<100; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        [[pair itemA] setValue:[NSString stringWithFormat:@"question %d", i] forKey:@"stringValue"];
+        [[pair itemB] setValue:[NSString stringWithFormat:@"réponse %d", i] forKey:@"stringValue"];
+        if (i % 10 == 0)
+            [pair setCustomGroupString:@"tens"];
+        [pairs addObject:pair];
+        [pair release];
+    }
+    STAssertTrue([GeniusLibrary writeLibraryWithPairs:pairs toFile:path], nil);
+}
+
+//! Deletes the library file.
+- (void) tearDown
+{
+    [[NSFileManager defaultManager] removeFileAtPath:path handler:nil];
+    [path release];
+    path = nil;
+    [pairs release];
+    pairs = nil;
+}
+
+//! Every card can be found by id and reads back its text.
+- (void) testReadBack
+{
+    GeniusLibrary * library = [GeniusLibrary libraryWithContentsOfFile:path];
+    STAssertNotNil(library, nil);
+    STAssertEquals([library count], 100U, nil);
+    STAssertTrue([GeniusLibrary libraryWithContentsOfFile:path] == library, @"one shared instance per file");
+
+    NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+    {
+        unsigned int index = [library indexOfPairID:[pair pairID]];
+        STAssertTrue(index != NSNotFound, nil);
+        STAssertEqualObjects([library stringForField:GeniusLibraryFieldItemA atIndex:index], [[pair itemA] stringValue], nil);
+        STAssertEqualObjects([library stringForField:GeniusLibraryFieldItemB atIndex:index], [[pair itemB] stringValue], nil);
+        STAssertEqualObjects([library stringForField:GeniusLibraryFieldGroup atIndex:index], [pair customGroupString], nil);
+        STAssertNil([library stringForField:GeniusLibraryFieldNotes atIndex:index], nil);
+    }
+    STAssertEquals([library indexOfPairID:[library pairIDAtIndex:99] + 1], (unsigned int)NSNotFound, nil);
+}
+
+//! Cards keep the order of the deck they were written from.
+- (void) testDeckOrder
+{
+    GeniusLibrary * library = [GeniusLibrary libraryWithContentsOfFile:path];
+    NSArray * libraryPairs = [library pairsWithOverlayData:nil];
+    unsigned int i;
+    for (i=0; i<100; i++)
+    {
+        STAssertEquals([library pairIDAtIndex:i], [[pairs objectAtIndex:i] pairID], nil);
+        STAssertEqualObjects([[[libraryPairs objectAtIndex:i] itemA] stringValue], ([NSString stringWithFormat:@"question %d", i]), nil);
+    }
+}
+
+//! A library whose texts point past the end of the file is not opened.
+- (void) testTruncatedLibraryIsRejected
+{
+    NSData * data = [NSData dataWithContentsOfFile:path];
+    NSString * truncatedPath = [[path stringByDeletingPathExtension] stringByAppendingString:@"-truncated.geniuslibrary"];
+    STAssertTrue([[data subdataWithRange:NSMakeRange(0, [data length] - 1)] writeToFile:truncatedPath atomically:YES], nil);
+    STAssertNil([GeniusLibrary libraryWithContentsOfFile:truncatedPath], nil);
+
+    NSMutableData * damaged = [NSMutableData dataWithData:data];
+    unsigned char * lengthBytes = (unsigned char *)[damaged mutableBytes] + 32 + 12;    // text length of the first card's question
+    lengthBytes[3] = 0x7F;
+    STAssertTrue([damaged writeToFile:truncatedPath atomically:YES], nil);
+    STAssertNil([GeniusLibrary libraryWithContentsOfFile:truncatedPath], nil);
+    [[NSFileManager defaultManager] removeFileAtPath:truncatedPath handler:nil];
+}
+
+//! Library pairs show library text, ignore edits and copy into ordinary pairs.
+- (void) testLibraryPairs
+{
+    GeniusLibrary * library = [GeniusLibrary libraryWithContentsOfFile:path];
+    NSArray * libraryPairs = [library pairsWithOverlayData:nil];
+    STAssertEquals([libraryPairs count], 100U, nil);
+
+    GeniusPair * libraryPair = [libraryPairs objectAtIndex:0];
+    STAssertEquals([libraryPair pairID], [library pairIDAtIndex:0], nil);
+    STAssertEqualObjects([[libraryPair itemA] stringValue], [library stringForField:GeniusLibraryFieldItemA atIndex:0], nil);
+    STAssertNil([[libraryPair associationAB] scoreNumber], nil);
+
+    NSString * group = [libraryPair customGroupString];
+    [libraryPair setCustomGroupString:@"changed"];
+    STAssertEqualObjects([libraryPair customGroupString], group, nil);
+
+    GeniusPair * copy = [[libraryPair copy] autorelease];
+    STAssertEquals([copy class], [GeniusPair class], nil);
+    STAssertEqualObjects([[copy itemB] stringValue], [[libraryPair itemB] stringValue], nil);
+    [[copy itemB] setValue:@"edited" forKey:@"stringValue"];
+    STAssertEqualObjects([[copy itemB] stringValue], @"edited", nil);
+}
+
+//! Scores, due times and importance survive an overlay round trip; untouched cards aren't stored.
+- (void) testOverlayRoundTrip
+{
+    GeniusLibrary * library = [GeniusLibrary libraryWithContentsOfFile:path];
+    NSArray * libraryPairs = [library pairsWithOverlayData:nil];
+    GeniusPair * studied = [libraryPairs objectAtIndex:3];
+    [[studied associationAB] setScore:2];
+    [[studied associationAB] setDueTime:1200000000LL];
+    [[studied associationBA] setScore:0];
+    [[[libraryPairs objectAtIndex:7] associationBA] setScore:5];
+    [[libraryPairs objectAtIndex:9] setImportance:-1];
+
+    NSData * overlay = [GeniusLibrary overlayDataForPairs:libraryPairs];
+    STAssertEquals([overlay length], 16U + 3 * 40U, @"only changed cards are stored");
+
+    NSArray * restored = [library pairsWithOverlayData:overlay];
+    GeniusPair * restoredPair = [restored objectAtIndex:3];
+    STAssertEquals([[restoredPair associationAB] score], 2, nil);
+    STAssertEquals([[restoredPair associationAB] dueTime], 1200000000LL, nil);
+    STAssertEquals([[restoredPair associationBA] score], 0, nil);
+    STAssertEquals([[restoredPair associationBA] dueTime], kGeniusTimeNone, nil);
+    STAssertEquals([[[restored objectAtIndex:7] associationBA] score], 5, nil);
+    STAssertEquals([[[restored objectAtIndex:7] associationAB] score], -1, nil);
+    STAssertEquals([[restored objectAtIndex:9] importance], -1, nil);
+    STAssertEquals([[restored objectAtIndex:0] importance], kGeniusPairNormalImportance, nil);
+}
+
+@end
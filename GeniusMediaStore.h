@@ -0,0 +1,96 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+//! Size of a content digest in bytes (SHA-1).
+#define kGeniusMediaDigestLength 20
+
+//! Default bound on the segment bytes a GeniusMediaStore keeps mapped.
+#define kGeniusMediaDefaultMappedLimit (256ULL * 1024 * 1024)
+
+//! Size of one index record on disk in bytes.
+#define kGeniusMediaIndexRecordSize 40
+
+//! Where one blob is stored.
+typedef struct _GeniusMediaEntry {
+    unsigned char digest[kGeniusMediaDigestLength];     //!< SHA-1 of the contents.
+    unsigned int segment;                               //!< Number of the segment file.
+    unsigned int length;                                //!< Size of the blob in bytes.
+    unsigned long long offset;                          //!< Position of the blob in the segment file.
+} GeniusMediaEntry;
+
+//! Content addressed store for the images and sounds of a deck.
+/*!
+    Blobs are named by the SHA-1 of their contents, so adding the same picture twice stores it once and
+    media URLs mean the same thing in every deck.  They are appended to segment files of up to
+    #_segmentSize bytes in a directory next to the deck (@c .geniusmedia), and located through an
+    append-only index of fixed size little endian records:  digest, segment number, offset and length.
+
+    Segments are mapped, not read, so opening a store with thousands of pictures only reads the index, and
+    a blob costs nothing until its pages are touched.  #prefetchURLs: asks the kernel to read the pages of
+    upcoming blobs ahead of time.  Least recently used segments are unmapped once more than #mappedByteLimit
+    bytes are mapped; data already handed out keeps its own mapping.  GeniusItem#imageURL and friends hold media URLs of the form
+    @c geniusmedia:<hex digest>, which #dataForURL: resolves against every open store.
+
+    Like GeniusReviewLog, the directory can be moved with #setDirectoryPath: when the deck is saved.
+ */
+@interface GeniusMediaStore : NSObject {
+    NSString * _directoryPath;              //!< Directory holding the index and segment files.
+    unsigned long long _segmentSize;        //!< Segment size at which a new segment is started.
+
+    GeniusMediaEntry * _entries;            //!< Every stored blob, in index order.
+    unsigned int _entryCount;               //!< Number of entries in _entries.
+    unsigned int _entryCapacity;            //!< Allocated size of _entries.
+    CFMutableDictionaryRef _entryIndexes;   //!< Digest as NSData -> index + 1 in _entries.
+
+    unsigned int _segmentCount;             //!< Number of segment files.
+    unsigned long long _lastSegmentLength;  //!< Bytes in the newest segment file.
+    NSMutableDictionary * _mappedSegments;  //!< Segment number -> mapped NSData, filled on first use.
+    NSMutableArray * _mappedOrder;          //!< Keys of _mappedSegments, least recently used first.
+    unsigned long long _mappedByteLimit;    //!< Most bytes kept mapped, 0 if unbounded.
+}
+
++ (NSString *) storePathForDocumentPath:(NSString *)documentPath;
+
++ (BOOL) isMediaURL:(NSURL *)url;
++ (NSData *) dataForURL:(NSURL *)url;
++ (void) prefetchURLs:(NSArray *)urls;
+
+- (id) initWithDirectoryPath:(NSString *)path;
+- (id) initWithDirectoryPath:(NSString *)path segmentSize:(unsigned long long)segmentSize;
+
+- (NSString *) directoryPath;
+- (BOOL) setDirectoryPath:(NSString *)path;
+
+- (NSURL *) addData:(NSData *)data;
+- (NSURL *) addContentsOfFile:(NSString *)path;
+
+- (unsigned int) count;
+- (unsigned int) segmentCount;
+- (BOOL) containsURL:(NSURL *)url;
+- (NSData *) dataForURL:(NSURL *)url;
+- (void) prefetchURL:(NSURL *)url;
+
+- (unsigned int) mappedSegmentCount;
+- (unsigned long long) mappedByteCount;
+- (unsigned long long) mappedByteLimit;
+- (void) setMappedByteLimit:(unsigned long long)limit;
+- (void) unmapSegments;
+
+@end
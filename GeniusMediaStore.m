@@ -0,0 +1,561 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusMediaStore.h"
+#import "GeniusByteOrder.h"
+#include <CommonCrypto/CommonDigest.h>  // CC_SHA1
+#include <sys/mman.h>                   // madvise
+#include <fcntl.h>                      // open
+#include <unistd.h>                     // pwrite, write, close, getpagesize
+#include <errno.h>
+
+//! Default size at which a new segment file is started.
+#define kGeniusMediaDefaultSegmentSize (64ULL << 20)
+
+//! Blobs start at multiples of this many bytes within a segment.
+#define kGeniusMediaBlobAlignment 8ULL
+
+//! URL scheme of blobs in a GeniusMediaStore.
+static NSString * const kGeniusMediaURLScheme = @"geniusmedia";
+
+//! Every open store, searched by GeniusMediaStore#dataForURL:.  Not retained.
+static CFMutableArrayRef openStores = NULL;
+
+//! Returns the digest named by a @c geniusmedia:<hex> URL, or nil for any other URL.
+static NSData * DigestFromURL(NSURL * url)
+{
+    if (url == nil || [[url scheme] isEqualToString:kGeniusMediaURLScheme] == NO)
+        return nil;
+    NSString * hex = [url resourceSpecifier];
+    if ([hex length] != 2 * kGeniusMediaDigestLength)
+        return nil;
+
+    unsigned char digest[kGeniusMediaDigestLength];
+    int i;
+    for (i=0; i<2*kGeniusMediaDigestLength; i++)
+    {
+        unichar c = [hex characterAtIndex:i];
+        int nibble;
+        if (c >= '0' && c <= '9')       nibble = c - '0';
+        else if (c >= 'a' && c <= 'f')  nibble = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')  nibble = c - 'A' + 10;
+        else                            return nil;
+        if (i % 2 == 0)
+            digest[i/2] = nibble << 4;
+        else
+            digest[i/2] |= nibble;
+    }
+    return [NSData dataWithBytes:digest length:kGeniusMediaDigestLength];
+}
+
+//! Returns the @c geniusmedia:<hex> URL of @a digest.
+static NSURL * URLFromDigest(const unsigned char * digest)
+{
+    char hex[2 * kGeniusMediaDigestLength + 1];
+    int i;
+    for (i=0; i<kGeniusMediaDigestLength; i++)
+        sprintf(hex + 2 * i, "%02x", digest[i]);
+    return [NSURL URLWithString:[NSString stringWithFormat:@"%@:%s", kGeniusMediaURLScheme, hex]];
+}
+
+//! CFAllocator callbacks that keep a mapped segment alive for as long as data pointing into it.
+static const void * MappingRetain(const void * info)
+{
+    return [(id)info retain];
+}
+
+static void MappingRelease(const void * info)
+{
+    [(id)info release];
+}
+
+static void MappingDeallocate(void * ptr, void * info)
+{
+    // The bytes belong to the mapping, released along with the allocator.
+}
+
+//! Returns @a range of @a mapping without copying it.  The result retains @a mapping.
+static NSData * MappedSubdata(NSData * mapping, NSRange range)
+{
+    if (range.length == 0)
+        return [NSData data];
+
+    CFAllocatorContext context = { 0, mapping, MappingRetain, MappingRelease, NULL, NULL, NULL, MappingDeallocate, NULL };
+    CFAllocatorRef deallocator = CFAllocatorCreate(kCFAllocatorDefault, &context);
+    CFDataRef data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, (const UInt8 *)[mapping bytes] + range.location, range.length, deallocator);
+    CFRelease(deallocator);
+    return [(NSData *)data autorelease];
+}
+
+
+@interface GeniusMediaStore (Private)
+- (void) _loadIndex;
+- (void) _addEntry:(const GeniusMediaEntry *)entry;
+- (const GeniusMediaEntry *) _entryForURL:(NSURL *)url;
+- (NSString *) _segmentPath:(unsigned int)segment;
+- (NSData *) _mappedSegment:(unsigned int)segment;
+- (void) _unmapSegment:(NSNumber *)key;
+- (void) _evictMappedSegments;
+- (BOOL) _addBlobsToStoreAtPath:(NSString *)path;
+@end
+
+@implementation GeniusMediaStore
+
+//! Returns the path of the media store belonging to the deck at @a documentPath.
++ (NSString *) storePathForDocumentPath:(NSString *)documentPath
+{
+    return [[documentPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"geniusmedia"];
+}
+
+//! YES if @a url names a blob, whether or not an open store holds it.
++ (BOOL) isMediaURL:(NSURL *)url
+{
+    return (DigestFromURL(url) != nil);
+}
+
+//! Contents of the blob named by @a url from whichever open store holds it.  nil for other URLs.
+/*! Never reads a file:  the data is mapped and only paged in when used, see #prefetchURLs:. */
++ (NSData *) dataForURL:(NSURL *)url
+{
+    if (openStores == NULL || DigestFromURL(url) == nil)
+        return nil;
+
+    CFIndex i, count = CFArrayGetCount(openStores);
+    for (i=0; i<count; i++)
+    {
+        GeniusMediaStore * store = (GeniusMediaStore *)CFArrayGetValueAtIndex(openStores, i);
+        if ([store containsURL:url])
+            return [store dataForURL:url];
+    }
+    return nil;
+}
+
+//! Asks the kernel to start reading the blobs named by @a urls, so that showing them later doesn't wait for the disk.
++ (void) prefetchURLs:(NSArray *)urls
+{
+    if (openStores == NULL)
+        return;
+
+    NSEnumerator * urlEnumerator = [urls objectEnumerator];
+    NSURL * url;
+    while ((url = [urlEnumerator nextObject]))
+    {
+        CFIndex i, count = CFArrayGetCount(openStores);
+        for (i=0; i<count; i++)
+        {
+            GeniusMediaStore * store = (GeniusMediaStore *)CFArrayGetValueAtIndex(openStores, i);
+            if ([store containsURL:url])
+            {
+                [store prefetchURL:url];
+                break;
+            }
+        }
+    }
+}
+
+//! Opens the store in @a path with the default segment size.
+- (id) initWithDirectoryPath:(NSString *)path
+{
+    return [self initWithDirectoryPath:path segmentSize:kGeniusMediaDefaultSegmentSize];
+}
+
+//! Designated initializer.  The directory is created when the first blob is added.
+- (id) initWithDirectoryPath:(NSString *)path segmentSize:(unsigned long long)segmentSize
+{
+    self = [super init];
+    if (self != nil) {
+        _directoryPath = [path copy];
+        _segmentSize = MAX(segmentSize, 1ULL);
+        _entryIndexes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+        _mappedSegments = [[NSMutableDictionary alloc] init];
+        _mappedOrder = [[NSMutableArray alloc] init];
+        _mappedByteLimit = kGeniusMediaDefaultMappedLimit;
+        [self _loadIndex];
+
+        if (openStores == NULL)
+            openStores = CFArrayCreateMutable(kCFAllocatorDefault, 0, NULL);
+        CFArrayAppendValue(openStores, self);
+    }
+    return self;
+}
+
+//! Unregisters the store and frees memory.  Data returned by #dataForURL: stays valid.
+- (void) dealloc
+{
+    CFIndex index = CFArrayGetFirstIndexOfValue(openStores, CFRangeMake(0, CFArrayGetCount(openStores)), self);
+    if (index != kCFNotFound)
+        CFArrayRemoveValueAtIndex(openStores, index);
+
+    [_directoryPath release];
+    free(_entries);
+    CFRelease(_entryIndexes);
+    [_mappedSegments release];
+    [_mappedOrder release];
+    [super dealloc];
+}
+
+//! _directoryPath getter.
+- (NSString *) directoryPath
+{
+    return _directoryPath;
+}
+
+//! Changes the directory of the store.
+/*!
+    If the current directory holds blobs they go along to @a path:  the directory is moved there, or copied
+    if it isn't a temporary directory.  A store already at @a path is kept, and the blobs it lacks are added
+    to it; since blobs are named by their contents, nothing it holds is lost.  Without blobs the store
+    continues with those found at @a path.  Returns NO if the blobs could not be moved.
+*/
+- (BOOL) setDirectoryPath:(NSString *)path
+{
+    if ([path isEqualToString:_directoryPath])
+        return YES;
+
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    if (_entryCount > 0 && path != nil)
+    {
+        // A deck saved under a new name keeps sharing its pictures with the old file.
+        BOOL isTemporary = [_directoryPath hasPrefix:NSTemporaryDirectory()];
+        BOOL isMoved;
+        if ([fileManager fileExistsAtPath:path])
+        {
+            isMoved = [self _addBlobsToStoreAtPath:path];
+            if (isMoved && isTemporary)
+                [fileManager removeFileAtPath:_directoryPath handler:nil];
+        }
+        else if (isTemporary)
+            isMoved = [fileManager movePath:_directoryPath toPath:path handler:nil];
+        else
+            isMoved = [fileManager copyPath:_directoryPath toPath:path handler:nil];
+        if (isMoved == NO)
+        {
+            NSLog(@"Could not move media store %@ to %@", _directoryPath, path);
+            return NO;
+        }
+    }
+
+    [_directoryPath release];
+    _directoryPath = [path copy];
+    [self _loadIndex];
+    return YES;
+}
+
+//! Stores @a data unless a blob with the same contents is already there.  Returns its media URL.
+/*! Returns nil if the blob could not be written. */
+- (NSURL *) addData:(NSData *)data
+{
+    GeniusMediaEntry entry;
+    CC_SHA1([data bytes], [data length], entry.digest);
+    NSData * digest = [NSData dataWithBytes:entry.digest length:kGeniusMediaDigestLength];
+    if (CFDictionaryContainsKey(_entryIndexes, digest))
+        return URLFromDigest(entry.digest);
+
+    if ([data length] > 0xFFFFFFFFULL)
+        return nil;
+
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    if ([fileManager fileExistsAtPath:_directoryPath] == NO && [fileManager createDirectoryAtPath:_directoryPath attributes:nil] == NO)
+    {
+        NSLog(@"Could not create media store %@", _directoryPath);
+        return nil;
+    }
+
+    // Pack into the newest segment unless the blob would overflow it.
+    unsigned long long offset = (_lastSegmentLength + kGeniusMediaBlobAlignment - 1) & ~(kGeniusMediaBlobAlignment - 1);
+    if (_segmentCount == 0 || (_lastSegmentLength > 0 && offset + [data length] > _segmentSize))
+    {
+        _segmentCount++;
+        offset = 0;
+    }
+    entry.segment = _segmentCount - 1;
+    entry.offset = offset;
+    entry.length = [data length];
+
+    int fd = open([[self _segmentPath:entry.segment] fileSystemRepresentation], O_WRONLY | O_CREAT, 0644);
+    BOOL isWritten = (fd >= 0);
+    const char * bytes = [data bytes];
+    unsigned int written = 0;
+    while (isWritten && written < entry.length)
+    {
+        ssize_t result = pwrite(fd, bytes + written, entry.length - written, offset + written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            isWritten = NO;
+        else
+            written += result;
+    }
+    if (fd >= 0 && close(fd) != 0)
+        isWritten = NO;
+
+    // The index record goes last, so it never points at a blob that wasn't written.
+    if (isWritten)
+    {
+        unsigned char record[kGeniusMediaIndexRecordSize];
+        memset(record, 0, sizeof(record));
+        memcpy(record, entry.digest, kGeniusMediaDigestLength);
+        PutUInt32(record + 20, entry.segment);
+        PutUInt32(record + 24, entry.length);
+        PutUInt64(record + 28, entry.offset);
+
+        NSString * indexPath = [_directoryPath stringByAppendingPathComponent:@"index"];
+        fd = open([indexPath fileSystemRepresentation], O_WRONLY | O_CREAT | O_APPEND, 0644);
+        isWritten = (fd >= 0 && write(fd, record, sizeof(record)) == sizeof(record));
+        if (fd >= 0 && close(fd) != 0)
+            isWritten = NO;
+    }
+
+    if (isWritten == NO)
+    {
+        NSLog(@"Could not add media to %@: %s", _directoryPath, strerror(errno));
+        return nil;
+    }
+
+    _lastSegmentLength = offset + entry.length;
+    [self _unmapSegment:[NSNumber numberWithUnsignedInt:entry.segment]];
+    [self _addEntry:&entry];
+    return URLFromDigest(entry.digest);
+}
+
+//! Stores the contents of the file at @a path.  Returns its media URL, or nil.
+- (NSURL *) addContentsOfFile:(NSString *)path
+{
+    NSData * data = [NSData dataWithContentsOfMappedFile:path];
+    if (data == nil)
+        return nil;
+    return [self addData:data];
+}
+
+//! Number of distinct blobs.
+- (unsigned int) count
+{
+    return _entryCount;
+}
+
+//! Number of segment files.
+- (unsigned int) segmentCount
+{
+    return _segmentCount;
+}
+
+//! YES if the receiver holds the blob named by @a url.
+- (BOOL) containsURL:(NSURL *)url
+{
+    return ([self _entryForURL:url] != NULL);
+}
+
+//! Contents of the blob named by @a url, or nil if the receiver doesn't hold it.
+/*! The data points into the mapped segment; pages are read when first touched. */
+- (NSData *) dataForURL:(NSURL *)url
+{
+    const GeniusMediaEntry * entry = [self _entryForURL:url];
+    if (entry == NULL)
+        return nil;
+
+    NSData * mapping = [self _mappedSegment:entry->segment];
+    if (mapping == nil || entry->offset + entry->length > [mapping length])
+        return nil;
+    return MappedSubdata(mapping, NSMakeRange((unsigned int)entry->offset, entry->length));
+}
+
+//! Tells the kernel the pages of the blob named by @a url will be needed soon.  Doesn't wait for them.
+- (void) prefetchURL:(NSURL *)url
+{
+    const GeniusMediaEntry * entry = [self _entryForURL:url];
+    if (entry == NULL || entry->length == 0)
+        return;
+
+    NSData * mapping = [self _mappedSegment:entry->segment];
+    if (mapping == nil || entry->offset + entry->length > [mapping length])
+        return;
+
+    uintptr_t pageSize = getpagesize();
+    uintptr_t start = (uintptr_t)[mapping bytes] + (uintptr_t)entry->offset;
+    uintptr_t pageStart = start & ~(pageSize - 1);
+    madvise((void *)pageStart, (size_t)(start + entry->length - pageStart), MADV_WILLNEED);
+}
+
+//! Number of segments currently mapped by the receiver.
+- (unsigned int) mappedSegmentCount
+{
+    return [_mappedSegments count];
+}
+
+//! Bytes of the segments currently mapped by the receiver.  Address space, not necessarily resident.
+- (unsigned long long) mappedByteCount
+{
+    unsigned long long total = 0;
+    NSEnumerator * mappingEnumerator = [_mappedSegments objectEnumerator];
+    NSData * mapping;
+    while ((mapping = [mappingEnumerator nextObject]))
+        total += [mapping length];
+    return total;
+}
+
+//! _mappedByteLimit getter.
+- (unsigned long long) mappedByteLimit
+{
+    return _mappedByteLimit;
+}
+
+//! _mappedByteLimit setter.  0 keeps every segment mapped.  Unmaps segments right away if more are mapped.
+- (void) setMappedByteLimit:(unsigned long long)limit
+{
+    _mappedByteLimit = limit;
+    [self _evictMappedSegments];
+}
+
+//! Unmaps all segments.  They are mapped again when next read.
+- (void) unmapSegments
+{
+    [_mappedSegments removeAllObjects];
+    [_mappedOrder removeAllObjects];
+}
+
+@end
+
+
+@implementation GeniusMediaStore (Private)
+
+//! Reads the index in #_directoryPath.  Records past the end of their segment, left by a crash, are ignored.
+- (void) _loadIndex
+{
+    _entryCount = 0;
+    CFDictionaryRemoveAllValues(_entryIndexes);
+    [self unmapSegments];
+
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    _segmentCount = 0;
+    while ([fileManager fileExistsAtPath:[self _segmentPath:_segmentCount]])
+        _segmentCount++;
+    _lastSegmentLength = 0;
+    if (_segmentCount > 0)
+        _lastSegmentLength = [[fileManager fileAttributesAtPath:[self _segmentPath:_segmentCount-1] traverseLink:YES] fileSize];
+
+    NSData * index = [NSData dataWithContentsOfMappedFile:[_directoryPath stringByAppendingPathComponent:@"index"]];
+    const unsigned char * bytes = [index bytes];
+    unsigned int i, recordCount = [index length] / kGeniusMediaIndexRecordSize;
+    for (i=0; i<recordCount; i++)
+    {
+        const unsigned char * record = bytes + i * kGeniusMediaIndexRecordSize;
+        GeniusMediaEntry entry;
+        memcpy(entry.digest, record, kGeniusMediaDigestLength);
+        entry.segment = GetUInt32(record + 20);
+        entry.length = GetUInt32(record + 24);
+        entry.offset = GetUInt64(record + 28);
+        if (entry.segment >= _segmentCount || (entry.segment == _segmentCount - 1 && entry.offset + entry.length > _lastSegmentLength))
+            continue;
+        [self _addEntry:&entry];
+    }
+}
+
+//! Adds @a entry to #_entries and #_entryIndexes unless its digest is already known.
+- (void) _addEntry:(const GeniusMediaEntry *)entry
+{
+    NSData * digest = [NSData dataWithBytes:entry->digest length:kGeniusMediaDigestLength];
+    if (CFDictionaryContainsKey(_entryIndexes, digest))
+        return;
+
+    if (_entryCount == _entryCapacity)
+    {
+        _entryCapacity = MAX(2 * _entryCapacity, 64U);
+        _entries = (GeniusMediaEntry *)realloc(_entries, _entryCapacity * sizeof(GeniusMediaEntry));
+    }
+    _entries[_entryCount++] = *entry;
+    CFDictionarySetValue(_entryIndexes, digest, (const void *)(uintptr_t)_entryCount);
+}
+
+//! Entry of the blob named by @a url, or NULL.
+- (const GeniusMediaEntry *) _entryForURL:(NSURL *)url
+{
+    NSData * digest = DigestFromURL(url);
+    if (digest == nil)
+        return NULL;
+    unsigned int index = (unsigned int)(uintptr_t)CFDictionaryGetValue(_entryIndexes, digest);
+    return (index ? &_entries[index - 1] : NULL);
+}
+
+//! Path of segment file number @a segment.
+- (NSString *) _segmentPath:(unsigned int)segment
+{
+    return [_directoryPath stringByAppendingPathComponent:[NSString stringWithFormat:@"segment-%05u", segment]];
+}
+
+//! Maps segment file number @a segment on first use and marks it most recently used.
+- (NSData *) _mappedSegment:(unsigned int)segment
+{
+    NSNumber * key = [NSNumber numberWithUnsignedInt:segment];
+    NSData * mapping = [_mappedSegments objectForKey:key];
+    if (mapping)
+    {
+        if ([[_mappedOrder lastObject] isEqual:key] == NO)
+        {
+            [_mappedOrder removeObject:key];
+            [_mappedOrder addObject:key];
+        }
+    }
+    else
+    {
+        mapping = [NSData dataWithContentsOfMappedFile:[self _segmentPath:segment]];
+        if (mapping)
+        {
+            [_mappedSegments setObject:mapping forKey:key];
+            [_mappedOrder addObject:key];
+            [self _evictMappedSegments];
+        }
+    }
+    return mapping;
+}
+
+//! Forgets the mapping of the segment numbered @a key, if any.
+- (void) _unmapSegment:(NSNumber *)key
+{
+    [_mappedSegments removeObjectForKey:key];
+    [_mappedOrder removeObject:key];
+}
+
+//! Unmaps least recently used segments until at most #_mappedByteLimit bytes are mapped.  Keeps the newest one regardless.
+- (void) _evictMappedSegments
+{
+    while (_mappedByteLimit && [_mappedOrder count] > 1 && [self mappedByteCount] > _mappedByteLimit)
+        [self _unmapSegment:[[[_mappedOrder objectAtIndex:0] retain] autorelease]];
+}
+
+//! Adds every blob of the receiver to the store at @a path that it doesn't hold yet.  NO if one could not be written.
+- (BOOL) _addBlobsToStoreAtPath:(NSString *)path
+{
+    GeniusMediaStore * store = [[GeniusMediaStore alloc] initWithDirectoryPath:path segmentSize:_segmentSize];
+    BOOL isAdded = YES;
+    unsigned int i;
+    for (i=0; i<_entryCount && isAdded; i++)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        NSURL * url = URLFromDigest(_entries[i].digest);
+        if ([store containsURL:url] == NO)
+        {
+            NSData * data = [self dataForURL:url];
+            isAdded = (data && [store addData:data]);
+        }
+        [pool release];
+    }
+    [store release];
+    return isAdded;
+}
+
+@end
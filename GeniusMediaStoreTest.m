@@ -0,0 +1,172 @@
+//
+//  GeniusMediaStoreTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusMediaStore.h"
+#import "GeniusItem.h"
+
+@interface GeniusMediaStoreTest : SenTestCase {
+    NSString *path;     //!< Temporary store directory.
+}
+
+@end
+
+//! Returns @a length bytes of a repeating pattern starting at @a seed.
+static NSData * PatternData(unsigned int length, unsigned char seed)
+{
+    NSMutableData * data = [NSMutableData dataWithLength:length];
+    unsigned char * bytes = [data mutableBytes];
+    unsigned int i;
+    for (i=0; i<length; i++)
+        bytes[i] = (unsigned char)(seed + i);
+    return data;
+}
+
+//! Tests for the GeniusMediaStore blob store.
+@implementation GeniusMediaStoreTest
+
+//! Picks a fresh temporary directory for each test.
+- (void) setUp
+{
+    NSString * name = [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"geniusmedia"];
+    path = [[NSTemporaryDirectory() stringByAppendingPathComponent:name] retain];
+}
+
+//! Deletes the store directory.
+- (void) tearDown
+{
+    [[NSFileManager defaultManager] removeFileAtPath:path handler:nil];
+    [path release];
+    path = nil;
+}
+
+//! Equal contents share one blob and one URL.
+- (void) testDeduplication
+{
+    GeniusMediaStore * store = [[GeniusMediaStore alloc] initWithDirectoryPath:path];
+    NSURL * first = [store addData:PatternData(1000, 1)];
+    NSURL * second = [store addData:PatternData(1000, 1)];
+    NSURL * other = [store addData:PatternData(1000, 2)];
+
+    STAssertNotNil(first, nil);
+    STAssertEqualObjects(first, second, nil);
+    STAssertFalse([first isEqual:other], nil);
+    STAssertEquals([store count], 2U, nil);
+    STAssertEqualObjects([store dataForURL:first], PatternData(1000, 1), nil);
+    [store release];
+}
+
+//! Blobs survive reopening and spread over several segments.
+- (void) testReopenAndSegments
+{
+    GeniusMediaStore * store = [[GeniusMediaStore alloc] initWithDirectoryPath:path segmentSize:4096];
+    NSMutableArray * urls = [NSMutableArray array];
+    int i;
+    for (i=0; i<10; i++)
+        [urls addObject:[store addData:PatternData(1000 + i, i)]];
+    STAssertEquals([store segmentCount], 3U, nil);
+    NSData * held = [store dataForURL:[urls objectAtIndex:9]];
+    [store release];
+
+    STAssertEqualObjects(held, PatternData(1009, 9), @"data outlives the store");
+
+    store = [[GeniusMediaStore alloc] initWithDirectoryPath:path segmentSize:4096];
+    STAssertEquals([store count], 10U, nil);
+    for (i=0; i<10; i++)
+        STAssertEqualObjects([store dataForURL:[urls objectAtIndex:i]], PatternData(1000 + i, i), @"blob %d", i);
+
+    NSURL * url = [store addData:PatternData(5000, 42)];
+    STAssertEquals([store segmentCount], 4U, @"a blob larger than a segment gets its own");
+    STAssertEqualObjects([store dataForURL:url], PatternData(5000, 42), nil);
+    [store release];
+}
+
+//! Only well formed media URLs are recognized.
+- (void) testURLs
+{
+    STAssertTrue([GeniusMediaStore isMediaURL:[NSURL URLWithString:@"geniusmedia:0123456789abcdef0123456789ABCDEF01234567"]], nil);
+    STAssertFalse([GeniusMediaStore isMediaURL:[NSURL URLWithString:@"geniusmedia:0123"]], nil);
+    STAssertFalse([GeniusMediaStore isMediaURL:[NSURL URLWithString:@"file:///tmp/picture.png"]], nil);
+    STAssertFalse([GeniusMediaStore isMediaURL:nil], nil);
+}
+
+//! Items resolve media URLs against every open store.
+- (void) testItemResolution
+{
+    GeniusMediaStore * store = [[GeniusMediaStore alloc] initWithDirectoryPath:path];
+    NSURL * url = [store addData:PatternData(300, 7)];
+
+    GeniusItem * item = [[GeniusItem alloc] init];
+    [item setImageURL:url];
+    STAssertEqualObjects([item imageData], PatternData(300, 7), nil);
+    STAssertNil([item soundData], nil);
+
+    [item setSoundURL:[NSURL URLWithString:@"file:///tmp/sound.aiff"]];
+    STAssertNil([item soundData], @"only store URLs are resolved");
+
+    [store release];
+    STAssertNil([item imageData], @"closed stores are not searched");
+    [item release];
+}
+
+//! Past its mapped byte limit the store unmaps the least recently read segments; data handed out stays valid.
+- (void) testMappedByteLimit
+{
+    GeniusMediaStore * store = [[GeniusMediaStore alloc] initWithDirectoryPath:path segmentSize:1024];
+    NSMutableArray * urls = [NSMutableArray array];
+    int i;
+    for (i=0; i<4; i++)
+        [urls addObject:[store addData:PatternData(800, i)]];
+    STAssertEquals([store segmentCount], 4U, nil);
+
+    NSData * first = [store dataForURL:[urls objectAtIndex:0]];
+    for (i=1; i<4; i++)
+        [store dataForURL:[urls objectAtIndex:i]];
+    STAssertEquals([store mappedSegmentCount], 4U, nil);
+    STAssertEquals([store mappedByteCount], 3200ULL, nil);
+
+    [store setMappedByteLimit:1600];
+    STAssertEquals([store mappedSegmentCount], 2U, nil);
+    STAssertEquals([store mappedByteCount], 1600ULL, nil);
+    STAssertEqualObjects(first, PatternData(800, 0), @"unmapped segments outlive the data read from them");
+
+    // Reading the oldest blob maps it again and evicts the least recently read one, blob 2.
+    STAssertEqualObjects([store dataForURL:[urls objectAtIndex:0]], PatternData(800, 0), nil);
+    STAssertEquals([store mappedSegmentCount], 2U, nil);
+    [store dataForURL:[urls objectAtIndex:3]];
+    STAssertEquals([store mappedSegmentCount], 2U, @"blob 3 is still mapped");
+
+    [store unmapSegments];
+    STAssertEquals([store mappedByteCount], 0ULL, nil);
+    [store release];
+}
+
+//! Moving a store onto an existing one adds the missing blobs instead of replacing it.
+- (void) testSetDirectoryPathKeepsExistingStore
+{
+    NSString * otherPath = [[path stringByDeletingPathExtension] stringByAppendingString:@"-other.geniusmedia"];
+    GeniusMediaStore * other = [[GeniusMediaStore alloc] initWithDirectoryPath:otherPath];
+    NSURL * kept = [other addData:PatternData(500, 1)];
+    NSURL * shared = [other addData:PatternData(500, 2)];
+    [other release];
+
+    GeniusMediaStore * store = [[GeniusMediaStore alloc] initWithDirectoryPath:path];
+    STAssertEqualObjects([store addData:PatternData(500, 2)], shared, nil);
+    NSURL * added = [store addData:PatternData(500, 3)];
+    STAssertTrue([store setDirectoryPath:otherPath], nil);
+
+    STAssertEquals([store count], 3U, nil);
+    STAssertEqualObjects([store dataForURL:kept], PatternData(500, 1), @"the existing blobs survive");
+    STAssertEqualObjects([store dataForURL:shared], PatternData(500, 2), nil);
+    STAssertEqualObjects([store dataForURL:added], PatternData(500, 3), nil);
+    [store release];
+
+    [[NSFileManager defaultManager] removeFileAtPath:otherPath handler:nil];
+}
+
+@end
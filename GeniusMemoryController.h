@@ -0,0 +1,34 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import <Cocoa/Cocoa.h>
+
+@class GeniusMemoryReport;
+
+//! Debug panel listing the GeniusMemoryReport of the frontmost deck.
+/*! The window is built in code; there is no nib for it.  Shown from the File menu when tracing is enabled. */
+@interface GeniusMemoryController : NSWindowController {
+    NSTableView * _tableView;           //!< One row per subsystem of #_report.
+    NSTextField * _statusField;         //!< Deck name and totals.
+    GeniusMemoryReport * _report;       //!< Report shown, nil when no deck is open.
+    NSArray * _subsystems;              //!< Subsystems of _report, in table order.
+}
+
+- (IBAction) refresh:(id)sender;
+- (IBAction) reduceMemoryUsage:(id)sender;
+
+@end
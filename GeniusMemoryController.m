@@ -0,0 +1,188 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import "GeniusMemoryController.h"
+#import "GeniusMemoryReport.h"
+#import "GeniusDocument.h"
+#import "GeniusDocumentMemory.h"
+
+//! Returns the deck whose window is main, or nil.
+static GeniusDocument * CurrentDeck(void)
+{
+    id document = [[NSDocumentController sharedDocumentController] currentDocument];
+    return ([document isKindOfClass:[GeniusDocument class]] ? document : nil);
+}
+
+//! Builds the window and shows the memory report of the current deck.
+@implementation GeniusMemoryController
+
+//! Creates the window:  a table of subsystem, objects, bytes and budget above a status line and buttons.
+- (id) init
+{
+    NSPanel * panel = [[NSPanel alloc] initWithContentRect:NSMakeRect(0.0, 0.0, 480.0, 360.0)
+        styleMask:(NSTitledWindowMask | NSClosableWindowMask | NSResizableWindowMask | NSUtilityWindowMask) backing:NSBackingStoreBuffered defer:YES];
+    [panel setTitle:NSLocalizedString(@"Memory Usage", nil)];
+    [panel setMinSize:NSMakeSize(360.0, 200.0)];
+    [panel setHidesOnDeactivate:NO];
+    [panel setFrameAutosaveName:@"MemoryUsage"];
+
+    self = [super initWithWindow:panel];
+    [panel release];
+    if (self == nil)
+        return nil;
+
+    _subsystems = [[NSArray alloc] init];
+    NSView * contentView = [panel contentView];
+    NSRect bounds = [contentView bounds];
+
+    NSScrollView * scrollView = [[NSScrollView alloc] initWithFrame:NSMakeRect(12.0, 72.0, NSWidth(bounds) - 24.0, NSHeight(bounds) - 84.0)];
+    [scrollView setAutoresizingMask:(NSViewWidthSizable | NSViewHeightSizable)];
+    [scrollView setHasVerticalScroller:YES];
+    [scrollView setBorderType:NSBezelBorder];
+    _tableView = [[NSTableView alloc] initWithFrame:[[scrollView contentView] bounds]];
+    NSArray * identifiers = [NSArray arrayWithObjects:@"subsystem", @"objects", @"bytes", @"limit", nil];
+    NSArray * titles = [NSArray arrayWithObjects:NSLocalizedString(@"Subsystem", nil), NSLocalizedString(@"Objects", nil), NSLocalizedString(@"Bytes", nil), NSLocalizedString(@"Budget", nil), nil];
+    unsigned int i;
+    for (i=0; i<[identifiers count]; i++)
+    {
+        NSTableColumn * column = [[NSTableColumn alloc] initWithIdentifier:[identifiers objectAtIndex:i]];
+        [[column headerCell] setStringValue:[titles objectAtIndex:i]];
+        if (i > 0)
+            [[column dataCell] setAlignment:NSRightTextAlignment];
+        [column setEditable:NO];
+        [column setWidth:(i == 0 ? 140.0 : 90.0)];
+        [_tableView addTableColumn:column];
+        [column release];
+    }
+    [_tableView setColumnAutoresizingStyle:NSTableViewUniformColumnAutoresizingStyle];
+    [_tableView setUsesAlternatingRowBackgroundColors:YES];
+    [_tableView setDataSource:self];
+    [scrollView setDocumentView:_tableView];
+    [contentView addSubview:scrollView];
+    [scrollView release];
+
+    _statusField = [[NSTextField alloc] initWithFrame:NSMakeRect(12.0, 48.0, NSWidth(bounds) - 24.0, 17.0)];
+    [_statusField setAutoresizingMask:(NSViewWidthSizable | NSViewMaxYMargin)];
+    [_statusField setEditable:NO];
+    [_statusField setBordered:NO];
+    [_statusField setDrawsBackground:NO];
+    [_statusField setFont:[NSFont systemFontOfSize:[NSFont smallSystemFontSize]]];
+    [contentView addSubview:_statusField];
+
+    NSButton * reduceButton = [[NSButton alloc] initWithFrame:NSMakeRect(NSWidth(bounds) - 192.0, 8.0, 180.0, 32.0)];
+    [reduceButton setAutoresizingMask:(NSViewMinXMargin | NSViewMaxYMargin)];
+    [reduceButton setBezelStyle:NSRoundedBezelStyle];
+    [reduceButton setTitle:NSLocalizedString(@"Reduce Memory Use", nil)];
+    [reduceButton setTarget:self];
+    [reduceButton setAction:@selector(reduceMemoryUsage:)];
+    [contentView addSubview:reduceButton];
+    [reduceButton release];
+
+    NSButton * refreshButton = [[NSButton alloc] initWithFrame:NSMakeRect(NSWidth(bounds) - 300.0, 8.0, 108.0, 32.0)];
+    [refreshButton setAutoresizingMask:(NSViewMinXMargin | NSViewMaxYMargin)];
+    [refreshButton setBezelStyle:NSRoundedBezelStyle];
+    [refreshButton setTitle:NSLocalizedString(@"Refresh", nil)];
+    [refreshButton setTarget:self];
+    [refreshButton setAction:@selector(refresh:)];
+    [contentView addSubview:refreshButton];
+    [refreshButton release];
+
+    [panel center];
+
+    // Follow the deck in front.
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(refresh:) name:NSWindowDidBecomeMainNotification object:nil];
+    return self;
+}
+
+//! Stops observing windows and releases the views and report.
+- (void) dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [_tableView release];
+    [_statusField release];
+    [_report release];
+    [_subsystems release];
+    [super dealloc];
+}
+
+//! Shows the window with a fresh report.
+- (IBAction) showWindow:(id)sender
+{
+    [self refresh:sender];
+    [super showWindow:sender];
+}
+
+//! Measures the current deck again.
+- (IBAction) refresh:(id)sender
+{
+    GeniusDocument * document = CurrentDeck();
+    GeniusMemoryReport * report = [document memoryReport];
+    [report retain];
+    [_report release];
+    _report = report;
+
+    NSArray * subsystems = (_report ? [_report subsystems] : [NSArray array]);
+    [subsystems retain];
+    [_subsystems release];
+    _subsystems = subsystems;
+    [_tableView reloadData];
+
+    if (document == nil)
+        [_statusField setStringValue:NSLocalizedString(@"No deck is open.", nil)];
+    else
+    {
+        NSString * format = NSLocalizedString(@"%@:  %llu KB in %u objects", nil);
+        [_statusField setStringValue:[NSString stringWithFormat:format, [document displayName], ([_report totalByteCount] + 1023) / 1024, [_report totalObjectCount]]];
+    }
+}
+
+//! Empties the rebuildable caches of the current deck and shows what is left.
+- (IBAction) reduceMemoryUsage:(id)sender
+{
+    [CurrentDeck() reduceMemoryUsage];
+    [self refresh:sender];
+}
+
+@end
+
+
+//! Table data source.
+@implementation GeniusMemoryController(NSTableDataSource)
+
+//! Number of subsystems.
+- (int)numberOfRowsInTableView:(NSTableView *)aTableView
+{
+    return [_subsystems count];
+}
+
+//! Name, object count, byte count or budget of the subsystem in @a rowIndex.
+- (id)tableView:(NSTableView *)aTableView objectValueForTableColumn:(NSTableColumn *)aTableColumn row:(int)rowIndex
+{
+    NSString * subsystem = [_subsystems objectAtIndex:rowIndex];
+    NSString * identifier = [aTableColumn identifier];
+    if ([identifier isEqualToString:@"subsystem"])
+        return subsystem;
+    if ([identifier isEqualToString:@"objects"])
+        return [NSNumber numberWithUnsignedInt:[_report objectCountForSubsystem:subsystem]];
+    if ([identifier isEqualToString:@"bytes"])
+        return [NSNumber numberWithUnsignedLongLong:[_report byteCountForSubsystem:subsystem]];
+
+    unsigned long long limit = [_report limitForSubsystem:subsystem];
+    return (limit ? (id)[NSNumber numberWithUnsignedLongLong:limit] : (id)@"-");
+}
+
+@end
@@ -0,0 +1,88 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import <Foundation/Foundation.h>
+
+// Subsystems reported by GeniusMemoryReport#addPairs: and GeniusDocument(MemoryAccounting).
+extern NSString * GeniusMemoryPairsSubsystem;           //!< GeniusPair objects and their user dictionaries.
+extern NSString * GeniusMemoryAssociationsSubsystem;    //!< GeniusAssociation objects.
+extern NSString * GeniusMemoryPerformanceSubsystem;     //!< Performance dictionaries of the associations.
+extern NSString * GeniusMemoryItemsSubsystem;           //!< GeniusItem objects, their storage, URLs and answer keys.
+extern NSString * GeniusMemoryTextSubsystem;            //!< Strings held by items and user dictionaries.
+extern NSString * GeniusMemoryObservationSubsystem;     //!< Key value observation info of observed model objects.
+extern NSString * GeniusMemoryUndoSubsystem;            //!< Registered undo invocations.  Estimated, NSUndoManager doesn't expose its stacks.
+extern NSString * GeniusMemoryTypeCacheSubsystem;       //!< Custom type strings cached by the document.
+extern NSString * GeniusMemoryPairIndexSubsystem;       //!< Pair arrays and the pair id table.
+extern NSString * GeniusMemoryDueIndexSubsystem;        //!< GeniusTimingWheel entries.
+extern NSString * GeniusMemoryRowModelSubsystem;        //!< Rows cached by GeniusTableRowModel.
+extern NSString * GeniusMemorySortKeysSubsystem;        //!< Keys cached by GeniusSortEngine.
+extern NSString * GeniusMemorySearchIndexSubsystem;     //!< GeniusFuzzyIndex and GeniusPairColumns.
+extern NSString * GeniusMemoryDistractorsSubsystem;     //!< GeniusDistractorIndex entries.
+extern NSString * GeniusMemoryTextCacheSubsystem;       //!< Text decoded by GeniusTextStore.
+extern NSString * GeniusMemoryMediaSubsystem;           //!< Segments mapped by GeniusMediaStore.
+
+//! Bytes and objects one subsystem holds, and the budget it is held to.
+typedef struct _GeniusMemoryUsage {
+    NSString * subsystem;           //!< Name, one of the subsystem constants above.  Retained.
+    unsigned long long byteCount;   //!< Bytes held.
+    unsigned int objectCount;       //!< Objects or entries held.
+    unsigned long long limit;       //!< Most bytes the subsystem keeps before evicting, 0 if unbounded.
+} GeniusMemoryUsage;
+
+//! Per subsystem memory use of a deck, with the budgets of the caches that evict.
+/*!
+    Sizes come from the allocator (malloc_size) for objects and their out of line buffers.  Hash tables
+    are estimated from their counts, since their bucket arrays can't be reached, so totals are close
+    rather than exact.  Storage shared between objects, such as the item storage of copied pairs or a
+    string used by two items, is counted once:  the report remembers what it has counted.
+
+    Needs nothing but Foundation, so the model can be measured without a document or window; #addPairs:
+    walks a pair array.  GeniusDocument(MemoryAccounting) adds the caches of a document.
+ */
+@interface GeniusMemoryReport : NSObject {
+    GeniusMemoryUsage * _usages;        //!< One per subsystem, in the order first reported.
+    unsigned int _count;                //!< Number of _usages.
+    unsigned int _capacity;             //!< Allocated size of _usages.
+    CFMutableSetRef _countedObjects;    //!< Objects and storage already counted.  Not retained.
+}
+
+- (void) addByteCount:(unsigned long long)byteCount objectCount:(unsigned int)objectCount toSubsystem:(NSString *)subsystem;
+- (void) setLimit:(unsigned long long)limit forSubsystem:(NSString *)subsystem;
+
+- (BOOL) shouldCountPointer:(const void *)pointer;
+- (BOOL) addObject:(id)object toSubsystem:(NSString *)subsystem;
+- (BOOL) addString:(NSString *)string toSubsystem:(NSString *)subsystem;
+- (BOOL) addCollection:(id)collection toSubsystem:(NSString *)subsystem;
+- (BOOL) addDictionary:(NSDictionary *)dictionary toSubsystem:(NSString *)subsystem;
+- (void) addObservationInfoOfObject:(id)object;
+- (void) addPairs:(NSArray *)pairs;
+
+- (NSArray *) subsystems;
+- (const GeniusMemoryUsage *) usageForSubsystem:(NSString *)subsystem;
+- (unsigned long long) byteCountForSubsystem:(NSString *)subsystem;
+- (unsigned int) objectCountForSubsystem:(NSString *)subsystem;
+- (unsigned long long) limitForSubsystem:(NSString *)subsystem;
+- (unsigned long long) totalByteCount;
+- (unsigned int) totalObjectCount;
+- (NSArray *) subsystemsOverLimit;
+
+@end
+
+
+size_t GeniusMemorySizeOfObject(id object);
+size_t GeniusMemorySizeOfString(NSString * string);
+size_t GeniusMemorySizeOfCollection(id collection);
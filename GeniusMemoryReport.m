@@ -0,0 +1,310 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import "GeniusMemoryReport.h"
+#import "GeniusPair.h"
+#include <malloc/malloc.h>  // malloc_size
+
+NSString * GeniusMemoryPairsSubsystem = @"Pairs";
+NSString * GeniusMemoryAssociationsSubsystem = @"Associations";
+NSString * GeniusMemoryPerformanceSubsystem = @"Performance";
+NSString * GeniusMemoryItemsSubsystem = @"Items";
+NSString * GeniusMemoryTextSubsystem = @"Text";
+NSString * GeniusMemoryObservationSubsystem = @"Observation";
+NSString * GeniusMemoryUndoSubsystem = @"Undo (estimated)";
+NSString * GeniusMemoryTypeCacheSubsystem = @"Type cache";
+NSString * GeniusMemoryPairIndexSubsystem = @"Pair index";
+NSString * GeniusMemoryDueIndexSubsystem = @"Due index";
+NSString * GeniusMemoryRowModelSubsystem = @"Row model";
+NSString * GeniusMemorySortKeysSubsystem = @"Sort keys";
+NSString * GeniusMemorySearchIndexSubsystem = @"Search index";
+NSString * GeniusMemoryDistractorsSubsystem = @"Distractors";
+NSString * GeniusMemoryTextCacheSubsystem = @"Text cache";
+NSString * GeniusMemoryMediaSubsystem = @"Media";
+
+//! Estimated bytes a hash table spends per entry besides the key and value pointers:  cached hash and free buckets.
+#define kGeniusMemoryHashEntryOverhead (2 * sizeof(void *))
+
+//! Bytes allocated for @a object, 0 for nil and objects not on the heap such as constant strings.
+size_t GeniusMemorySizeOfObject(id object)
+{
+    return (object ? malloc_size(object) : 0);
+}
+
+//! Bytes allocated for @a string, including a character buffer kept outside the object.
+/*! Never decodes a string whose characters are not loaded yet, such as the lazy strings of a GeniusTextStore. */
+size_t GeniusMemorySizeOfString(NSString * string)
+{
+    if (string == nil)
+        return 0;
+
+    size_t size = malloc_size(string);
+    const void * contents = CFStringGetCharactersPtr((CFStringRef)string);
+    if (contents == NULL)
+        contents = CFStringGetCStringPtr((CFStringRef)string, CFStringGetSystemEncoding());
+    if (contents && (contents < (const void *)string || contents >= (const void *)((const char *)string + size)))
+        size += malloc_size(contents);
+    return size;
+}
+
+//! Estimated bytes of an NSArray, NSSet or NSDictionary, or their CF counterparts, without the elements.
+size_t GeniusMemorySizeOfCollection(id collection)
+{
+    if (collection == nil)
+        return 0;
+
+    size_t size = malloc_size(collection);
+    unsigned int count = [collection count];
+    if ([collection isKindOfClass:[NSArray class]])
+        size += count * sizeof(id);
+    else if ([collection isKindOfClass:[NSDictionary class]])
+        size += count * (2 * sizeof(id) + kGeniusMemoryHashEntryOverhead);
+    else
+        size += count * (sizeof(id) + kGeniusMemoryHashEntryOverhead);
+    return size;
+}
+
+
+@interface GeniusMemoryReport (Private)
+- (GeniusMemoryUsage *) _usageForSubsystem:(NSString *)subsystem create:(BOOL)create;
+@end
+
+@implementation GeniusMemoryReport
+
+//! Creates an empty report.
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _countedObjects = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+    }
+    return self;
+}
+
+//! Releases the subsystem names and frees memory.
+- (void) dealloc
+{
+    unsigned int i;
+    for (i=0; i<_count; i++)
+        [_usages[i].subsystem release];
+    free(_usages);
+    CFRelease(_countedObjects);
+    [super dealloc];
+}
+
+//! Adds @a byteCount bytes and @a objectCount objects to @a subsystem, creating its entry on first use.
+- (void) addByteCount:(unsigned long long)byteCount objectCount:(unsigned int)objectCount toSubsystem:(NSString *)subsystem
+{
+    GeniusMemoryUsage * usage = [self _usageForSubsystem:subsystem create:YES];
+    usage->byteCount += byteCount;
+    usage->objectCount += objectCount;
+}
+
+//! Records the budget of @a subsystem.  0 means unbounded.
+- (void) setLimit:(unsigned long long)limit forSubsystem:(NSString *)subsystem
+{
+    [self _usageForSubsystem:subsystem create:YES]->limit = limit;
+}
+
+//! YES the first time it is asked about @a pointer, NO afterwards and for NULL.
+/*! Lets storage reachable from several objects be counted by whichever reaches it first. */
+- (BOOL) shouldCountPointer:(const void *)pointer
+{
+    if (pointer == NULL || CFSetContainsValue(_countedObjects, pointer))
+        return NO;
+    CFSetAddValue(_countedObjects, pointer);
+    return YES;
+}
+
+//! Counts @a object as one object of @a subsystem.  NO if it was counted before.
+- (BOOL) addObject:(id)object toSubsystem:(NSString *)subsystem
+{
+    if ([self shouldCountPointer:object] == NO)
+        return NO;
+    [self addByteCount:GeniusMemorySizeOfObject(object) objectCount:1 toSubsystem:subsystem];
+    return YES;
+}
+
+//! Counts @a string and its characters as one object of @a subsystem.  NO if it was counted before.
+- (BOOL) addString:(NSString *)string toSubsystem:(NSString *)subsystem
+{
+    if ([self shouldCountPointer:string] == NO)
+        return NO;
+    [self addByteCount:GeniusMemorySizeOfString(string) objectCount:1 toSubsystem:subsystem];
+    return YES;
+}
+
+//! Counts the array, set or dictionary @a collection, but not its elements, as one object of @a subsystem.
+- (BOOL) addCollection:(id)collection toSubsystem:(NSString *)subsystem
+{
+    if ([self shouldCountPointer:collection] == NO)
+        return NO;
+    [self addByteCount:GeniusMemorySizeOfCollection(collection) objectCount:1 toSubsystem:subsystem];
+    return YES;
+}
+
+//! Counts @a dictionary and its values.  String values go to GeniusMemoryTextSubsystem, others to @a subsystem.
+- (BOOL) addDictionary:(NSDictionary *)dictionary toSubsystem:(NSString *)subsystem
+{
+    if ([self addCollection:dictionary toSubsystem:subsystem] == NO)
+        return NO;
+
+    NSEnumerator * valueEnumerator = [dictionary objectEnumerator];
+    id value;
+    while ((value = [valueEnumerator nextObject]))
+    {
+        if ([value isKindOfClass:[NSString class]])
+            [self addString:value toSubsystem:GeniusMemoryTextSubsystem];
+        else
+            [self addObject:value toSubsystem:subsystem];
+    }
+    return YES;
+}
+
+//! Counts the key value observation info of @a object, if anything observes it.
+/*! Only the info object itself is measured; its list of observances is shared and opaque. */
+- (void) addObservationInfoOfObject:(id)object
+{
+    void * observationInfo = [object observationInfo];
+    if (observationInfo)
+        [self addObject:(id)observationInfo toSubsystem:GeniusMemoryObservationSubsystem];
+}
+
+//! Counts the array @a pairs and, through GeniusPair#addToMemoryReport:, everything its pairs hold.
+- (void) addPairs:(NSArray *)pairs
+{
+    [self addCollection:pairs toSubsystem:GeniusMemoryPairIndexSubsystem];
+
+    NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+        [pair addToMemoryReport:self];
+}
+
+//! Names of the reported subsystems, in the order first reported.
+- (NSArray *) subsystems
+{
+    NSMutableArray * subsystems = [NSMutableArray arrayWithCapacity:_count];
+    unsigned int i;
+    for (i=0; i<_count; i++)
+        [subsystems addObject:_usages[i].subsystem];
+    return subsystems;
+}
+
+//! Usage of @a subsystem, or NULL if nothing was reported for it.  Valid until the report changes.
+- (const GeniusMemoryUsage *) usageForSubsystem:(NSString *)subsystem
+{
+    return [self _usageForSubsystem:subsystem create:NO];
+}
+
+//! Bytes held by @a subsystem.
+- (unsigned long long) byteCountForSubsystem:(NSString *)subsystem
+{
+    const GeniusMemoryUsage * usage = [self usageForSubsystem:subsystem];
+    return (usage ? usage->byteCount : 0);
+}
+
+//! Objects held by @a subsystem.
+- (unsigned int) objectCountForSubsystem:(NSString *)subsystem
+{
+    const GeniusMemoryUsage * usage = [self usageForSubsystem:subsystem];
+    return (usage ? usage->objectCount : 0);
+}
+
+//! Budget of @a subsystem, 0 if unbounded.
+- (unsigned long long) limitForSubsystem:(NSString *)subsystem
+{
+    const GeniusMemoryUsage * usage = [self usageForSubsystem:subsystem];
+    return (usage ? usage->limit : 0);
+}
+
+//! Bytes held by all subsystems.
+- (unsigned long long) totalByteCount
+{
+    unsigned long long total = 0;
+    unsigned int i;
+    for (i=0; i<_count; i++)
+        total += _usages[i].byteCount;
+    return total;
+}
+
+//! Objects held by all subsystems.
+- (unsigned int) totalObjectCount
+{
+    unsigned int total = 0;
+    unsigned int i;
+    for (i=0; i<_count; i++)
+        total += _usages[i].objectCount;
+    return total;
+}
+
+//! Names of the subsystems holding more than their budget.
+- (NSArray *) subsystemsOverLimit
+{
+    NSMutableArray * subsystems = [NSMutableArray array];
+    unsigned int i;
+    for (i=0; i<_count; i++)
+        if (_usages[i].limit && _usages[i].byteCount > _usages[i].limit)
+            [subsystems addObject:_usages[i].subsystem];
+    return subsystems;
+}
+
+//! One line per subsystem with objects, bytes and budget, then the totals.
+- (NSString *) description
+{
+    NSMutableString * description = [NSMutableString string];
+    [description appendFormat:@"%@ %11s %13s %13s\n", [@"Subsystem" stringByPaddingToLength:14 withString:@" " startingAtIndex:0], "Objects", "Bytes", "Limit"];
+    unsigned int i;
+    for (i=0; i<_count; i++)
+    {
+        NSString * name = [_usages[i].subsystem stringByPaddingToLength:14 withString:@" " startingAtIndex:0];
+        NSString * limit = (_usages[i].limit ? [NSString stringWithFormat:@"%llu", _usages[i].limit] : @"-");
+        [description appendFormat:@"%@ %11u %13llu %13s\n", name, _usages[i].objectCount, _usages[i].byteCount, [limit UTF8String]];
+    }
+    [description appendFormat:@"%@ %11u %13llu\n", [@"Total" stringByPaddingToLength:14 withString:@" " startingAtIndex:0], [self totalObjectCount], [self totalByteCount]];
+    return description;
+}
+
+@end
+
+
+@implementation GeniusMemoryReport (Private)
+
+//! Entry of @a subsystem.  Appends one if @a create is set, else returns NULL for unknown subsystems.
+- (GeniusMemoryUsage *) _usageForSubsystem:(NSString *)subsystem create:(BOOL)create
+{
+    unsigned int i;
+    for (i=0; i<_count; i++)
+        if (_usages[i].subsystem == subsystem || [_usages[i].subsystem isEqualToString:subsystem])
+            return &_usages[i];
+    if (create == NO)
+        return NULL;
+
+    if (_count == _capacity)
+    {
+        _capacity = MAX(2 * _capacity, 16U);
+        _usages = (GeniusMemoryUsage *)realloc(_usages, _capacity * sizeof(GeniusMemoryUsage));
+    }
+    GeniusMemoryUsage * usage = &_usages[_count++];
+    usage->subsystem = [subsystem copy];
+    usage->byteCount = 0;
+    usage->objectCount = 0;
+    usage->limit = 0;
+    return usage;
+}
+
+@end
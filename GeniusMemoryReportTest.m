@@ -0,0 +1,107 @@
+//
+//  GeniusMemoryReportTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusMemoryReport.h"
+#import "GeniusPair.h"
+#import "GeniusItem.h"
+
+@interface GeniusMemoryReportTest : SenTestCase {
+    GeniusMemoryReport *report;     //!< The object under test.
+    GeniusPair *pair;               //!< A pair with text on both sides.
+}
+
+@end
+
+//! Tests for GeniusMemoryReport.
+@implementation GeniusMemoryReportTest
+
+//! Creates an empty report and a pair to measure.
+- (void) setUp
+{
+    report = [[GeniusMemoryReport alloc] init];
+    pair = [[GeniusPair alloc] init];
+    [[pair itemA] setValue:@"a question long enough to need its own buffer" forKey:@"stringValue"];
+    [[pair itemB] setValue:@"an answer just as long as the question above" forKey:@"stringValue"];
+}
+
+//! Releases the report and pair.
+- (void) tearDown
+{
+    [report release];
+    report = nil;
+    [pair release];
+    pair = nil;
+}
+
+//! A pair reports itself, its associations and its items, each in its own subsystem.
+- (void) testAddPairs
+{
+    [report addPairs:[NSArray arrayWithObject:pair]];
+    STAssertTrue([report objectCountForSubsystem:GeniusMemoryPairsSubsystem] >= 1U, @"the pair and its user dictionary");
+    STAssertEquals([report objectCountForSubsystem:GeniusMemoryAssociationsSubsystem], 2U, nil);
+    STAssertTrue([report objectCountForSubsystem:GeniusMemoryItemsSubsystem] >= 2U, nil);
+    STAssertTrue([report byteCountForSubsystem:GeniusMemoryTextSubsystem] > 0, nil);
+
+    unsigned long long total = 0;
+    unsigned int objects = 0;
+    NSEnumerator * subsystemEnumerator = [[report subsystems] objectEnumerator];
+    NSString * subsystem;
+    while ((subsystem = [subsystemEnumerator nextObject]))
+    {
+        total += [report byteCountForSubsystem:subsystem];
+        objects += [report objectCountForSubsystem:subsystem];
+    }
+    STAssertEquals([report totalByteCount], total, nil);
+    STAssertEquals([report totalObjectCount], objects, nil);
+}
+
+//! Storage a copy shares with its original is counted once, and nothing is counted twice.
+- (void) testSharedStorageCountedOnce
+{
+    NSArray * pairs = [NSArray arrayWithObject:pair];
+    [report addPairs:pairs];
+    unsigned long long textBytes = [report byteCountForSubsystem:GeniusMemoryTextSubsystem];
+    unsigned long long totalBytes = [report totalByteCount];
+    unsigned int totalObjects = [report totalObjectCount];
+
+    [report addPairs:pairs];
+    STAssertEquals([report totalByteCount], totalBytes, @"nothing new to count");
+    STAssertEquals([report totalObjectCount], totalObjects, nil);
+
+    GeniusMemoryReport * copyReport = [[GeniusMemoryReport alloc] init];
+    GeniusPair * copy = [pair copy];
+    [copyReport addPairs:[NSArray arrayWithObjects:pair, copy, nil]];
+    STAssertEquals([copyReport objectCountForSubsystem:GeniusMemoryAssociationsSubsystem], 4U, nil);
+    STAssertEquals([copyReport byteCountForSubsystem:GeniusMemoryTextSubsystem], textBytes, @"the copy shares its text");
+    [copy release];
+    [copyReport release];
+}
+
+//! Subsystems over their limit are listed; unbounded ones never are.
+- (void) testLimits
+{
+    [report addByteCount:1000 objectCount:10 toSubsystem:GeniusMemorySortKeysSubsystem];
+    [report addByteCount:5000 objectCount:1 toSubsystem:GeniusMemoryMediaSubsystem];
+    [report addByteCount:9000 objectCount:3 toSubsystem:GeniusMemoryUndoSubsystem];
+    [report setLimit:2000 forSubsystem:GeniusMemorySortKeysSubsystem];
+    [report setLimit:4000 forSubsystem:GeniusMemoryMediaSubsystem];
+
+    STAssertEquals([report limitForSubsystem:GeniusMemoryMediaSubsystem], 4000ULL, nil);
+    STAssertEquals([report limitForSubsystem:GeniusMemoryUndoSubsystem], 0ULL, nil);
+    STAssertEqualObjects([report subsystemsOverLimit], [NSArray arrayWithObject:GeniusMemoryMediaSubsystem], nil);
+    STAssertEquals([report totalByteCount], 15000ULL, nil);
+    STAssertEquals([report totalObjectCount], 14U, nil);
+
+    NSArray * expected = [NSArray arrayWithObjects:GeniusMemorySortKeysSubsystem, GeniusMemoryMediaSubsystem, GeniusMemoryUndoSubsystem, nil];
+    STAssertEqualObjects([report subsystems], expected, @"in the order first reported");
+    STAssertTrue([[report description] rangeOfString:GeniusMemoryMediaSubsystem].location != NSNotFound, nil);
+    STAssertTrue([report usageForSubsystem:GeniusMemoryTextSubsystem] == NULL, nil);
+}
+
+@end
@@ -20,12 +20,16 @@
 
 @class GeniusItem;
 @class GeniusAssociation;
+@class GeniusMemoryReport;
 
 extern const int kGeniusPairDisabledImportance;
 extern const int kGeniusPairMinimumImportance;
 extern const int kGeniusPairNormalImportance;
 extern const int kGeniusPairMaximumImportance;
 
+//! Persistent 63 bit identifier of a GeniusPair, unique within a document.  Zero is never used.
+typedef unsigned long long GeniusPairID;
+
 //! Relates two GeniusAssociation instances and some meta info.
 /*!
 A GeniusPair is conceptually like a two sided index card.  Through its two instances
@@ -40,15 +44,22 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
     //! Stores user entered properties related to this GeniusPair.
     /*! Variable storage for info such as group, importance, and type */
     NSMutableDictionary * _userDict;
+    BOOL _sharesUserDict;               //!< Set when a copy uses _userDict too, so it must be copied before a change.
+
+    GeniusPairID _pairID;               //!< Stable identity, saved with the document.
 }
 
 + (NSArray *) associationsForPairs:(NSArray *)pairs useAB:(BOOL)useAB useBA:(BOOL)useBA;
 
 - (id) initWithItemA:(GeniusItem *)itemA itemB:(GeniusItem *)itemB userDict:(NSMutableDictionary *)userDict;
+- (id) initWithItemA:(GeniusItem *)itemA itemB:(GeniusItem *)itemB userDict:(NSMutableDictionary *)userDict pairID:(GeniusPairID)pairID;
 
 - (void) addObserver: (id) observer;
 - (void) removeObserver: (id) observer;
 
+- (GeniusPairID) pairID;
+- (void) assignNewPairID;
+
 - (GeniusItem *) itemA;
 - (GeniusItem *) itemB;
 
@@ -70,6 +81,8 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
 - (NSString *) notesString;
 - (void) setNotesString:(NSString *)notesString;
 
+- (void) addToMemoryReport:(GeniusMemoryReport *)report;
+
 @end
 
 
@@ -19,6 +19,9 @@
 #import "GeniusPair.h"
 #import "GeniusAssociation.h"
 #import "GeniusItem.h"
+#import "GeniusTabularCodec.h"
+#import "GeniusTrace.h"
+#import "GeniusMemoryReport.h"
 
 NSString * GeniusPairImportanceNumberKey = @"importanceNumber";
 NSString * GeniusPairCustomTypeStringKey = @"customTypeString";
@@ -34,6 +37,63 @@ const int kGeniusPairNormalImportance = 5;
 //! The GeniusItem is maximally relevant.
 const int kGeniusPairMaximumImportance = 10;
 
+//! Keeps pair identifiers within 63 bits so GeniusAssociation#associationID can add the direction.
+static const GeniusPairID kGeniusPairIDMask = 0x7FFFFFFFFFFFFFFFULL;
+
+//! Returns a new pair identifier.
+/*!
+    Scrambles a per launch random base plus a counter with the SplitMix64 finalizer, so identifiers are
+    spread over the whole range and unlikely to collide with those of other decks.  GeniusDocument
+    resolves the rare duplicate.
+ */
+static GeniusPairID GeniusNewPairID(void)
+{
+    static GeniusPairID base = 0, counter = 0;
+    if (base == 0)
+    {
+        CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
+        CFUUIDBytes bytes = CFUUIDGetUUIDBytes(uuid);
+        CFRelease(uuid);
+        memcpy(&base, &bytes, sizeof(base));
+    }
+
+    GeniusPairID pairID;
+    do {
+        GeniusPairID z = base + (++counter) * 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        pairID = (z ^ (z >> 31)) & kGeniusPairIDMask;
+    } while (pairID == 0);
+    return pairID;
+}
+
+//! Folds the UTF-8 bytes of @a string into the 64 bit FNV-1a @a hash.
+static unsigned long long FNV1aHashString(unsigned long long hash, NSString * string)
+{
+    const unsigned char * bytes = (const unsigned char *)[(string ? string : @"") UTF8String];
+    while (*bytes)
+    {
+        hash ^= *bytes++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//! Identifier for pairs from documents saved before pairs had one.
+/*!
+    Hashes the texts of both items, so reopening an old deck without saving gives the same identifiers,
+    and GeniusReviewLog records written against these hashes keep matching.
+ */
+static GeniusPairID GeniusLegacyPairID(GeniusItem * itemA, GeniusItem * itemB)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = FNV1aHashString(hash, [itemA stringValue]);
+    hash = (hash ^ 0x1F) * 1099511628211ULL;      // unit separator between the two texts
+    hash = FNV1aHashString(hash, [itemB stringValue]);
+    hash &= kGeniusPairIDMask;
+    return (hash ? hash : 1);
+}
+
 //! Relates two GeniusAssociation instances and some meta info.
 /*!
 A GeniusPair is conceptually like a two sided index card.  Through its two instances
@@ -41,6 +101,11 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
  the card and one for the 'back'.  In addition a GeniusPair maintains information about
  the users classification of the card, such as importance, group, type, and notes.
  */
+@interface GeniusPair (Private)
+- (NSMutableDictionary *) _writableUserDict;
+@end
+
+
 @implementation GeniusPair
 
 //! Set up #importance as dependent properties.
@@ -72,6 +137,13 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
     return allPairs;
 }
 
+//! Counts pair allocations while tracing.
++ (id) allocWithZone:(NSZone *)zone
+{
+    GeniusTraceCount(GeniusTraceCounterPairAllocations, 1);
+    return [super allocWithZone:zone];
+}
+
 //! Initializes new GeniusPair and allocates storage.
 /*!
     This #init method allocates two GeniusItem objects and connects them together.
@@ -113,6 +185,10 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
     _associationAB = [[GeniusAssociation alloc] _initWithCueItem:itemA answerItem:itemB parentPair:self performanceDict:performanceDictAB];
     _associationBA = [[GeniusAssociation alloc] _initWithCueItem:itemB answerItem:itemA parentPair:self performanceDict:performanceDictBA];
     _userDict = [[coder decodeObjectForKey:@"userDict"] retain];
+    if ([coder containsValueForKey:@"pairID"])
+        _pairID = (GeniusPairID)[coder decodeInt64ForKey:@"pairID"] & kGeniusPairIDMask;
+    if (_pairID == 0)
+        _pairID = GeniusLegacyPairID(itemA, itemB);
 
     return self;
 }
@@ -130,7 +206,9 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
     [coder encodeObject:[self itemB] forKey:@"itemB"];
     [coder encodeObject:[_associationAB performanceDictionary] forKey:@"performanceDictAB"];
     [coder encodeObject:[_associationBA performanceDictionary] forKey:@"performanceDictBA"];
-    [coder encodeObject:_userDict forKey:@"userDict"];
+    // A shared dictionary would be unarchived as one object for both pairs, no longer known to be shared.
+    [coder encodeObject:(_sharesUserDict ? [[_userDict mutableCopy] autorelease] : _userDict) forKey:@"userDict"];
+    [coder encodeInt64:(long long)_pairID forKey:@"pairID"];
 }
 
 //! Convenience method used by <tt>copyWithZone:</tt>
@@ -140,11 +218,18 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
     self is set up as an observer of the two GeniusAssociation objects as well as @a itemA and @a itemB.
 */
 - (id) initWithItemA:(GeniusItem *)itemA itemB:(GeniusItem *)itemB userDict:(NSMutableDictionary *)userDict
+{
+    return [self initWithItemA:itemA itemB:itemB userDict:userDict pairID:GeniusNewPairID()];
+}
+
+//! Same as initWithItemA:itemB:userDict: but keeps an existing @a pairID, for recreating a known card.
+- (id) initWithItemA:(GeniusItem *)itemA itemB:(GeniusItem *)itemB userDict:(NSMutableDictionary *)userDict pairID:(GeniusPairID)pairID
 {
     self = [super init];
     _associationAB = [[GeniusAssociation alloc] _initWithCueItem:itemA answerItem:itemB parentPair:self performanceDict:nil];
     _associationBA = [[GeniusAssociation alloc] _initWithCueItem:itemB answerItem:itemA parentPair:self performanceDict:nil];
     _userDict = [userDict retain];
+    _pairID = pairID & kGeniusPairIDMask;
     return self;
 }
 
@@ -152,14 +237,18 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
 /*!
     The copy created here is not perfect.  The related GeniusItem objects are copied, but the GeniusAssociation objects
     are only partially duplicated.  Specifically the performance information such as score and due date are not copied.
-    As such the returned GeniusPair copy has none of the history information related to the original
+    As such the returned GeniusPair copy has none of the history information related to the original.
+    The copy is a new card and gets a new #pairID.  The items and the group, type, notes and importance are
+    shared with the receiver until either side changes them, so copying costs the same for any length of text.
 */
 - (id)copyWithZone:(NSZone *)zone
 {
     GeniusItem * newItemA = [[[self itemA] copy] autorelease];
     GeniusItem * newItemB = [[[self itemB] copy] autorelease];
-    NSMutableDictionary * newUserDict = [[_userDict mutableCopy] autorelease];
-    return [[[self class] allocWithZone:zone] initWithItemA:newItemA itemB:newItemB userDict:newUserDict];
+    GeniusPair * newPair = [[[self class] allocWithZone:zone] initWithItemA:newItemA itemB:newItemB userDict:_userDict];
+    _sharesUserDict = YES;
+    newPair->_sharesUserDict = YES;
+    return newPair;
 }
 
 //! registers an observer for the relevent fields of this object
@@ -194,6 +283,18 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
     return [NSString stringWithFormat:@"(%@, %@)", [[self itemA] description], [[self itemB] description]];
 }
 
+//! _pairID getter.
+- (GeniusPairID) pairID
+{
+    return _pairID;
+}
+
+//! Gives the receiver a fresh #pairID.  Used by GeniusDocument when two of its pairs share one.
+- (void) assignNewPairID
+{
+    _pairID = GeniusNewPairID();
+}
+
 //! Convenience method for accessing the GeniusItem representing the 'front' of the card.
 - (GeniusItem *) itemA
 {
@@ -231,7 +332,7 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
 - (void) setImportance:(int)importance
 {
     NSNumber * importanceNumber = [NSNumber numberWithInt:importance];
-    [_userDict setObject:importanceNumber forKey:GeniusPairImportanceNumberKey];
+    [[self _writableUserDict] setObject:importanceNumber forKey:GeniusPairImportanceNumberKey];
 }
 
 
@@ -246,9 +347,9 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
 - (void) setCustomGroupString:(NSString *)customGroup
 {
     if (customGroup)
-        [_userDict setObject:customGroup forKey:GeniusPairCustomGroupStringKey];
+        [[self _writableUserDict] setObject:customGroup forKey:GeniusPairCustomGroupStringKey];
     else
-        [_userDict removeObjectForKey:GeniusPairCustomGroupStringKey];
+        [[self _writableUserDict] removeObjectForKey:GeniusPairCustomGroupStringKey];
 }
 
 //! customTypeString getter
@@ -261,9 +362,9 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
 - (void) setCustomTypeString:(NSString *)customType
 {
     if (customType)
-        [_userDict setObject:customType forKey:GeniusPairCustomTypeStringKey];
+        [[self _writableUserDict] setObject:customType forKey:GeniusPairCustomTypeStringKey];
     else
-        [_userDict removeObjectForKey:GeniusPairCustomTypeStringKey];
+        [[self _writableUserDict] removeObjectForKey:GeniusPairCustomTypeStringKey];
 }
 
 //! notesString getter
@@ -276,9 +377,38 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
 - (void) setNotesString:(NSString *)notesString
 {
     if (notesString)
-        [_userDict setObject:notesString forKey:GeniusPairNotesStringKey];
+        [[self _writableUserDict] setObject:notesString forKey:GeniusPairNotesStringKey];
     else
-        [_userDict removeObjectForKey:GeniusPairNotesStringKey];
+        [[self _writableUserDict] removeObjectForKey:GeniusPairNotesStringKey];
+}
+
+//! Adds the pair, its user dictionary and both associations to @a report.  A dictionary shared with copies counts once.
+- (void) addToMemoryReport:(GeniusMemoryReport *)report
+{
+    if ([report addObject:self toSubsystem:GeniusMemoryPairsSubsystem] == NO)
+        return;
+    [report addObservationInfoOfObject:self];
+    [report addDictionary:_userDict toSubsystem:GeniusMemoryPairsSubsystem];
+    [_associationAB addToMemoryReport:report];
+    [_associationBA addToMemoryReport:report];
+}
+
+@end
+
+
+@implementation GeniusPair (Private)
+
+//! Returns _userDict for changing, first taking a copy of its own if the receiver shares it with a copy.
+- (NSMutableDictionary *) _writableUserDict
+{
+    if (_sharesUserDict)
+    {
+        NSMutableDictionary * userDict = [_userDict mutableCopy];
+        [_userDict release];
+        _userDict = userDict;
+        _sharesUserDict = NO;
+    }
+    return _userDict;
 }
 
 @end
@@ -313,16 +443,11 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
 
 //! Serialize an array of GeniusPair objects as delimited text
 /*!
-    Each entry is written out as a line of text.  see tabularTextByOrder:
+    Each entry is written out as a line of text.  see GeniusTabularEncoder
 */
 + (NSString *) tabularTextFromPairs:(NSArray *)pairs order:(NSArray *)keyPaths
 {
-    NSMutableString * outputString = [NSMutableString string];    
-    NSEnumerator * pairEnumerator = [pairs objectEnumerator];
-    GeniusPair * pair;
-    while ((pair = [pairEnumerator nextObject]))
-        [outputString appendFormat:@"%@\n", [pair tabularTextByOrder:keyPaths]];
-    return (NSString *)outputString;
+    return [GeniusTabularEncoder stringFromPairs:pairs keyPaths:keyPaths];
 }
 
 //! Serialize as tab delimited string
@@ -356,49 +481,14 @@ A GeniusPair is conceptually like a two sided index card.  Through its two insta
 }
 
 
-//! Convenience method to subdivide @a string into lines.
-+ (NSArray *) _linesFromString:(NSString *)string
-{
-    NSMutableArray * lines = [NSMutableArray array];
-    unsigned int startIndex, lineEndIndex, contentsEndIndex = 0;
-    unsigned int length = [string length];
-    NSRange range = NSMakeRange(0, 0);
-    while (contentsEndIndex < length)
-    {
-        [string getLineStart:&startIndex end:&lineEndIndex contentsEnd:&contentsEndIndex forRange:range];
-        unsigned int rangeLength = contentsEndIndex - startIndex;
-        if (rangeLength > 0)    // don't include empty lines
-        {
-            NSString * line = [string substringWithRange:NSMakeRange(startIndex, rangeLength)];
-            [lines addObject:line];
-        }
-        range.location = lineEndIndex;
-    }
-    return lines;
-}
-
 //! Generates an array of GeniusPair instances from a delimited string.
 /*!
-    The provided @a string is separated into lines based.  Each line is used to create a new GeniusPair
-    instance that is initialized by the delimited line.
-    @todo Maybe this code belongs in GeniusDocument(FileFormat)
+    Each line of @a string is used to create a new GeniusPair instance that is initialized by the
+    delimited line.  Empty lines are skipped.  see GeniusTabularDecoder
  */
 + (NSMutableArray *) pairsFromTabularText:(NSString *)string order:(NSArray *)keyPaths
 {
-    //Can't use lines = [string componentsSeparatedByString:@"\n"];
-    // because it doesn't handle carriage returns.
-    NSArray * lines = [self _linesFromString:string];
-
-    NSMutableArray * pairs = [NSMutableArray array];
-    NSEnumerator * lineEnumerator = [lines objectEnumerator];
-    NSString * line;
-    while ((line = [lineEnumerator nextObject]))
-    {
-        GeniusPair * pair = [[GeniusPair alloc] initWithTabularText:line order:keyPaths];
-        [pairs addObject:pair];
-        [pair release];
-    }
-    return pairs;
+    return [GeniusTabularDecoder pairsFromString:string keyPaths:keyPaths];
 }
 
 //! Initializes a GeniusPair from a tab delimited string.
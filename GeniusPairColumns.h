@@ -0,0 +1,57 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusAssociation.h"
+
+@class GeniusPair;
+
+//! Packed copy of the importance, scores and due times of a list of GeniusPair items.
+/*!
+    The pair level counterpart of GeniusAssociationColumns, kept by GeniusArrayController for structured
+    filters.  Row @c i describes the @c i th pair of #pairs.  The columns are rebuilt only when the list of
+    pairs changes; an edited pair just has its row reloaded through #invalidateObject:.
+ */
+@interface GeniusPairColumns : NSObject {
+    NSArray * _pairs;                   //!< The pairs the columns were read from, in row order.
+    unsigned int _count;                //!< Number of rows.
+    unsigned int _capacity;             //!< Allocated rows of each column.
+    int * _importances;                 //!< GeniusPair#importance values, -1 when disabled.
+    int * _scoresAB;                    //!< GeniusAssociation#score of GeniusPair#associationAB, -1 when never quizzed.
+    int * _scoresBA;                    //!< GeniusAssociation#score of GeniusPair#associationBA.
+    GeniusTime * _dueTimesAB;           //!< GeniusAssociation#dueTime of GeniusPair#associationAB, kGeniusTimeNone when not scheduled.
+    GeniusTime * _dueTimesBA;           //!< GeniusAssociation#dueTime of GeniusPair#associationBA.
+    CFMutableDictionaryRef _rows;       //!< GeniusPair -> row + 1.
+}
+
+- (void) setPairs:(NSArray *)pairs;
+- (NSArray *) pairs;
+- (unsigned int) count;
+- (unsigned long long) byteCount;
+- (unsigned int) rowOfPair:(GeniusPair *)pair;
+
+- (void) invalidateObject:(id)object;
+
+- (const int *) importances;
+- (const int *) scoresAB;
+- (const int *) scoresBA;
+- (const GeniusTime *) dueTimesAB;
+- (const GeniusTime *) dueTimesBA;
+
+@end
@@ -0,0 +1,165 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusPairColumns.h"
+#import "GeniusPair.h"
+#import "GeniusMemoryReport.h"
+
+@interface GeniusPairColumns (Private)
+- (void) _reloadRow:(unsigned int)row;
+@end
+
+@implementation GeniusPairColumns
+
+//! Frees the columns and deallocates memory.
+- (void) dealloc
+{
+    [_pairs release];
+    free(_importances);
+    free(_scoresAB);
+    free(_scoresBA);
+    free(_dueTimesAB);
+    free(_dueTimesBA);
+    if (_rows)
+        CFRelease(_rows);
+    [super dealloc];
+}
+
+//! Reads the columns from @a pairs, unless they are the pairs already loaded, in the same order.
+- (void) setPairs:(NSArray *)pairs
+{
+    unsigned int row, count = [pairs count];
+    if (_pairs && count == _count)
+    {
+        for (row=0; row<count && [pairs objectAtIndex:row] == [_pairs objectAtIndex:row]; row++)
+            ;
+        if (row == count)
+            return;
+    }
+
+    [_pairs release];
+    _pairs = [pairs copy];
+    _count = count;
+    if (_count > _capacity)
+    {
+        _capacity = _count;
+        _importances = (int *)realloc(_importances, _capacity * sizeof(int));
+        _scoresAB = (int *)realloc(_scoresAB, _capacity * sizeof(int));
+        _scoresBA = (int *)realloc(_scoresBA, _capacity * sizeof(int));
+        _dueTimesAB = (GeniusTime *)realloc(_dueTimesAB, _capacity * sizeof(GeniusTime));
+        _dueTimesBA = (GeniusTime *)realloc(_dueTimesBA, _capacity * sizeof(GeniusTime));
+    }
+
+    if (_rows)
+        CFRelease(_rows);
+    _rows = CFDictionaryCreateMutable(kCFAllocatorDefault, _count, NULL, NULL);
+    for (row=0; row<_count; row++)
+    {
+        CFDictionarySetValue(_rows, [_pairs objectAtIndex:row], (const void *)(uintptr_t)(row + 1));
+        [self _reloadRow:row];
+    }
+}
+
+//! _pairs getter.
+- (NSArray *) pairs
+{
+    return _pairs;
+}
+
+//! Number of rows.
+- (unsigned int) count
+{
+    return _count;
+}
+
+//! Bytes of the columns and the row table.
+- (unsigned long long) byteCount
+{
+    unsigned long long total = GeniusMemorySizeOfObject(self) + GeniusMemorySizeOfCollection((id)_rows);
+    return total + (unsigned long long)_capacity * (3 * sizeof(int) + 2 * sizeof(GeniusTime));
+}
+
+//! Row of @a pair, or NSNotFound.
+- (unsigned int) rowOfPair:(GeniusPair *)pair
+{
+    uintptr_t row = (_rows ? (uintptr_t)CFDictionaryGetValue(_rows, pair) : 0);
+    return (row ? row - 1 : NSNotFound);
+}
+
+//! Reloads the row of @a object, a GeniusPair or one of its associations, after an edit.  Other objects are ignored.
+- (void) invalidateObject:(id)object
+{
+    if ([object isKindOfClass:[GeniusAssociation class]])
+        object = [object parentPair];
+    if ([object isKindOfClass:[GeniusPair class]] == NO)
+        return;
+
+    unsigned int row = [self rowOfPair:object];
+    if (row != NSNotFound)
+        [self _reloadRow:row];
+}
+
+//! Importance column.
+- (const int *) importances
+{
+    return _importances;
+}
+
+//! Score column of the A to B associations.
+- (const int *) scoresAB
+{
+    return _scoresAB;
+}
+
+//! Score column of the B to A associations.
+- (const int *) scoresBA
+{
+    return _scoresBA;
+}
+
+//! Due time column of the A to B associations.
+- (const GeniusTime *) dueTimesAB
+{
+    return _dueTimesAB;
+}
+
+//! Due time column of the B to A associations.
+- (const GeniusTime *) dueTimesBA
+{
+    return _dueTimesBA;
+}
+
+@end
+
+
+@implementation GeniusPairColumns (Private)
+
+//! Copies the values of the pair at @a row into the columns.
+- (void) _reloadRow:(unsigned int)row
+{
+    GeniusPair * pair = [_pairs objectAtIndex:row];
+    GeniusAssociation * associationAB = [pair associationAB];
+    GeniusAssociation * associationBA = [pair associationBA];
+    _importances[row] = [pair importance];
+    _scoresAB[row] = [associationAB score];
+    _scoresBA[row] = [associationBA score];
+    _dueTimesAB[row] = [associationAB dueTime];
+    _dueTimesBA[row] = [associationBA dueTime];
+}
+
+@end
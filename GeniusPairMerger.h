@@ -0,0 +1,60 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+@class GeniusPair;
+
+//! Merges imported GeniusPair items into an existing deck instead of appending duplicates.
+/*!
+    Builds hash indexes over the normalized text of the existing pairs once, then matches each incoming
+    pair in constant time: first by question and answer, then by question alone when only one existing
+    pair has that question.  The match of an incoming pair gets those of its non-empty text fields copied
+    over that differ by more than case and white space, but keeps its GeniusAssociation scores and history.
+    Incoming pairs without a match are inserted.  A later incoming pair with the same question and answer
+    as an inserted one is a duplicate and dropped; one sharing only the question is inserted as well.
+
+    #planMergeOfPairs: only computes the outcome so that the counts can be shown before anything
+    changes.  #applyToDocumentPairs does the updates through key value coding, so they are undoable
+    like any other edit, and returns the pairs still to be inserted.
+ */
+@interface GeniusPairMerger : NSObject {
+    NSMutableDictionary * _pairsByText;     //!< Normalized question and answer -> GeniusPair.
+    NSMutableDictionary * _pairsByCue;      //!< Normalized question -> GeniusPair, or NSNull if several pairs share it.
+    NSMutableArray * _insertedPairs;        //!< Incoming pairs without a match.
+    NSMutableSet * _insertedSet;            //!< _insertedPairs for membership tests.
+    NSMutableArray * _updatedPairs;         //!< Existing pairs with changed fields, parallel to _updateSources.
+    CFMutableDictionaryRef _updateIndexes;  //!< Existing pair -> its index in _updatedPairs plus one.
+    NSMutableArray * _updateSources;        //!< Incoming pairs providing the new field values.
+    unsigned int _unchangedCount;           //!< Incoming pairs matching an existing pair exactly.
+}
+
++ (NSString *) normalizedString:(NSString *)string;
++ (NSArray *) mergedKeyPaths;
+
+- (id) initWithPairs:(NSArray *)pairs;
+
+- (void) planMergeOfPairs:(NSArray *)pairs;
+
+- (unsigned int) insertedCount;
+- (unsigned int) updatedCount;
+- (unsigned int) unchangedCount;
+
+- (NSArray *) applyToDocumentPairs;
+
+@end
@@ -0,0 +1,228 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusPairMerger.h"
+#import "GeniusPair.h"
+
+//! Separates question and answer in the keys of _pairsByText.
+static NSString * const kGeniusPairMergerSeparator = @"\x1F";
+
+//! YES if @a source has a value at @a keyPath that differs from @a pair's beyond case and white space.
+static BOOL FieldDiffers(GeniusPair * pair, GeniusPair * source, NSString * keyPath)
+{
+    NSString * value = [source valueForKeyPath:keyPath];
+    if ([value length] == 0)
+        return NO;
+    NSString * existingValue = [pair valueForKeyPath:keyPath];
+    if ([value isEqualToString:existingValue])
+        return NO;
+    return ([[GeniusPairMerger normalizedString:value] isEqualToString:[GeniusPairMerger normalizedString:existingValue]] == NO);
+}
+
+@interface GeniusPairMerger (Private)
+- (void) _indexPair:(GeniusPair *)pair byCue:(BOOL)byCue;
+- (BOOL) _pair:(GeniusPair *)pair differsFrom:(GeniusPair *)source;
+@end
+
+@implementation GeniusPairMerger
+
+//! Case folded @a string with surrounding white space removed and inner runs of white space collapsed.
++ (NSString *) normalizedString:(NSString *)string
+{
+    if (string == nil)
+        return @"";
+
+    NSCharacterSet * whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+    NSMutableString * normalized = [NSMutableString stringWithCapacity:[string length]];
+    NSScanner * scanner = [NSScanner scannerWithString:string];
+    [scanner setCharactersToBeSkipped:whitespace];
+    NSString * word;
+    while ([scanner scanUpToCharactersFromSet:whitespace intoString:&word])
+    {
+        if ([normalized length] > 0)
+            [normalized appendString:@" "];
+        [normalized appendString:word];
+    }
+    CFStringFold((CFMutableStringRef)normalized, kCFCompareCaseInsensitive, NULL);
+    return normalized;
+}
+
+//! Text fields copied from an incoming pair to its match.  Scores are never merged.
++ (NSArray *) mergedKeyPaths
+{
+    static NSArray * mergedKeyPaths = nil;
+    if (mergedKeyPaths == nil)
+        mergedKeyPaths = [[NSArray alloc] initWithObjects:@"itemA.stringValue", @"itemB.stringValue", @"customGroupString", @"customTypeString", @"notesString", nil];
+    return mergedKeyPaths;
+}
+
+//! Designated initializer.  Indexes the existing @a pairs of the deck.
+- (id) initWithPairs:(NSArray *)pairs
+{
+    self = [super init];
+    if (self != nil) {
+        _pairsByText = [[NSMutableDictionary alloc] initWithCapacity:[pairs count]];
+        _pairsByCue = [[NSMutableDictionary alloc] initWithCapacity:[pairs count]];
+        _insertedPairs = [[NSMutableArray alloc] init];
+        _insertedSet = [[NSMutableSet alloc] init];
+        _updatedPairs = [[NSMutableArray alloc] init];
+        _updateIndexes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+        _updateSources = [[NSMutableArray alloc] init];
+
+        NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+        GeniusPair * pair;
+        while ((pair = [pairEnumerator nextObject]))
+            [self _indexPair:pair byCue:YES];
+    }
+    return self;
+}
+
+//! Releases the indexes and frees memory.
+- (void) dealloc
+{
+    [_pairsByText release];
+    [_pairsByCue release];
+    [_insertedPairs release];
+    [_insertedSet release];
+    [_updatedPairs release];
+    CFRelease(_updateIndexes);
+    [_updateSources release];
+    [super dealloc];
+}
+
+//! Matches each of the incoming @a pairs against the deck without changing anything.
+- (void) planMergeOfPairs:(NSArray *)pairs
+{
+    NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+    GeniusPair * incoming;
+    while ((incoming = [pairEnumerator nextObject]))
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        NSString * cue = [GeniusPairMerger normalizedString:[incoming valueForKeyPath:@"itemA.stringValue"]];
+        NSString * answer = [GeniusPairMerger normalizedString:[incoming valueForKeyPath:@"itemB.stringValue"]];
+        NSString * text = [NSString stringWithFormat:@"%@%@%@", cue, kGeniusPairMergerSeparator, answer];
+
+        GeniusPair * match = [_pairsByText objectForKey:text];
+        if (match == nil && [cue length] > 0)
+        {
+            match = [_pairsByCue objectForKey:cue];
+            if ((id)match == [NSNull null])
+                match = nil;
+        }
+
+        if (match == nil)
+        {
+            [_insertedPairs addObject:incoming];
+            [_insertedSet addObject:incoming];
+            [self _indexPair:incoming byCue:NO];     // a later row with only the same question is a new card too
+        }
+        else if ([_insertedSet containsObject:match] || [self _pair:match differsFrom:incoming] == NO)
+            _unchangedCount++;
+        else
+        {
+            // The last incoming row wins if several update the same pair.
+            unsigned int index = (unsigned int)CFDictionaryGetValue(_updateIndexes, match);
+            if (index == 0)
+            {
+                [_updatedPairs addObject:match];
+                [_updateSources addObject:incoming];
+                CFDictionarySetValue(_updateIndexes, match, (const void *)[_updatedPairs count]);
+            }
+            else
+                [_updateSources replaceObjectAtIndex:index-1 withObject:incoming];
+        }
+        [pool release];
+    }
+}
+
+//! Number of incoming pairs that will be added to the deck.
+- (unsigned int) insertedCount
+{
+    return [_insertedPairs count];
+}
+
+//! Number of existing pairs that will get new field values.
+- (unsigned int) updatedCount
+{
+    return [_updatedPairs count];
+}
+
+//! Number of incoming pairs already in the deck as they are.
+- (unsigned int) unchangedCount
+{
+    return _unchangedCount;
+}
+
+//! Copies the planned field changes into the existing pairs and returns the pairs to insert.
+- (NSArray *) applyToDocumentPairs
+{
+    NSArray * keyPaths = [GeniusPairMerger mergedKeyPaths];
+    unsigned int i, count = [_updatedPairs count];
+    for (i=0; i<count; i++)
+    {
+        GeniusPair * pair = [_updatedPairs objectAtIndex:i];
+        GeniusPair * source = [_updateSources objectAtIndex:i];
+        NSEnumerator * keyPathEnumerator = [keyPaths objectEnumerator];
+        NSString * keyPath;
+        while ((keyPath = [keyPathEnumerator nextObject]))
+        {
+            if (FieldDiffers(pair, source, keyPath))
+                [pair setValue:[source valueForKeyPath:keyPath] forKeyPath:keyPath];
+        }
+    }
+    return _insertedPairs;
+}
+
+@end
+
+
+@implementation GeniusPairMerger (Private)
+
+//! Adds @a pair to _pairsByText, and to _pairsByCue if @a byCue.
+/*! Only pairs of the deck are matched by question alone.  An inserted row matches later rows with the same question and answer. */
+- (void) _indexPair:(GeniusPair *)pair byCue:(BOOL)byCue
+{
+    NSString * cue = [GeniusPairMerger normalizedString:[pair valueForKeyPath:@"itemA.stringValue"]];
+    NSString * answer = [GeniusPairMerger normalizedString:[pair valueForKeyPath:@"itemB.stringValue"]];
+    NSString * text = [NSString stringWithFormat:@"%@%@%@", cue, kGeniusPairMergerSeparator, answer];
+
+    if ([_pairsByText objectForKey:text] == nil)
+        [_pairsByText setObject:pair forKey:text];
+
+    if (byCue == NO || [cue length] == 0)
+        return;
+    if ([_pairsByCue objectForKey:cue] == nil)
+        [_pairsByCue setObject:pair forKey:cue];
+    else if ([_pairsByCue objectForKey:cue] != pair)
+        [_pairsByCue setObject:[NSNull null] forKey:cue];
+}
+
+//! YES if any merged field of @a source differs from the same field of @a pair.
+- (BOOL) _pair:(GeniusPair *)pair differsFrom:(GeniusPair *)source
+{
+    NSEnumerator * keyPathEnumerator = [[GeniusPairMerger mergedKeyPaths] objectEnumerator];
+    NSString * keyPath;
+    while ((keyPath = [keyPathEnumerator nextObject]))
+    {
+        if (FieldDiffers(pair, source, keyPath))
+            return YES;
+    }
+    return NO;
+}
+
+@end
@@ -0,0 +1,88 @@
+//
+//  GeniusPairMergerTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusPairMerger.h"
+#import "GeniusPair.h"
+
+@interface GeniusPairMergerTest : SenTestCase {
+}
+
+@end
+
+//! Tests for GeniusPairMerger.
+@implementation GeniusPairMergerTest
+
+//! Returns a new pair with the given question and answer.
+- (GeniusPair *) _pairWithCue:(NSString *)cue answer:(NSString *)answer
+{
+    GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+    [[pair itemA] setValue:cue forKey:@"stringValue"];
+    [[pair itemB] setValue:answer forKey:@"stringValue"];
+    return pair;
+}
+
+//! Case and white space differences don't matter.
+- (void) testNormalizedString
+{
+    STAssertEqualObjects([GeniusPairMerger normalizedString:@"  Hello \t  World\n"], @"hello world", nil);
+    STAssertEqualObjects([GeniusPairMerger normalizedString:nil], @"", nil);
+}
+
+//! Exact, question only, and unmatched rows are told apart; scores of matched pairs are kept.
+- (void) testMerge
+{
+    GeniusPair * dog = [self _pairWithCue:@"dog" answer:@"Hund"];
+    GeniusPair * cat = [self _pairWithCue:@"cat" answer:@"Kater"];
+    GeniusPair * bank1 = [self _pairWithCue:@"bank" answer:@"Bank"];
+    GeniusPair * bank2 = [self _pairWithCue:@"bank" answer:@"Ufer"];
+    [[cat associationAB] setScore:4];
+
+    GeniusPairMerger * merger = [[GeniusPairMerger alloc] initWithPairs:[NSArray arrayWithObjects:dog, cat, bank1, bank2, nil]];
+
+    GeniusPair * newDog = [self _pairWithCue:@"Dog " answer:@"hund"];     // unchanged
+    GeniusPair * newCat = [self _pairWithCue:@"cat" answer:@"Katze"];     // updated answer
+    [newCat setNotesString:@"female"];
+    GeniusPair * newBank = [self _pairWithCue:@"bank" answer:@"Sitzbank"]; // ambiguous question, inserted
+    GeniusPair * newBird = [self _pairWithCue:@"bird" answer:@"Vogel"];   // inserted
+    GeniusPair * newBird2 = [self _pairWithCue:@"bird" answer:@"Vogel"];  // duplicate of an inserted row
+    [merger planMergeOfPairs:[NSArray arrayWithObjects:newDog, newCat, newBank, newBird, newBird2, nil]];
+
+    STAssertEquals([merger insertedCount], 2U, nil);
+    STAssertEquals([merger updatedCount], 1U, nil);
+    STAssertEquals([merger unchangedCount], 2U, nil);
+    STAssertEqualObjects([cat valueForKeyPath:@"itemB.stringValue"], @"Kater", @"planning changes nothing");
+
+    NSArray * insertedPairs = [merger applyToDocumentPairs];
+    STAssertEqualObjects(insertedPairs, ([NSArray arrayWithObjects:newBank, newBird, nil]), nil);
+    STAssertEqualObjects([cat valueForKeyPath:@"itemB.stringValue"], @"Katze", nil);
+    STAssertEqualObjects([cat notesString], @"female", nil);
+    STAssertEquals([[cat associationAB] score], 4, nil);
+    STAssertEqualObjects([dog valueForKeyPath:@"itemA.stringValue"], @"dog", @"unchanged pairs keep their text");
+    [merger release];
+}
+
+//! Two new rows with the same question and different answers both become cards.
+- (void) testSameQuestionWithinBatch
+{
+    GeniusPair * dog = [self _pairWithCue:@"dog" answer:@"Hund"];
+    GeniusPairMerger * merger = [[GeniusPairMerger alloc] initWithPairs:[NSArray arrayWithObject:dog]];
+
+    GeniusPair * shore = [self _pairWithCue:@"bank" answer:@"Ufer"];
+    GeniusPair * bench = [self _pairWithCue:@"bank" answer:@"Bank"];
+    GeniusPair * shoreAgain = [self _pairWithCue:@"Bank" answer:@"ufer"];
+    [merger planMergeOfPairs:[NSArray arrayWithObjects:shore, bench, shoreAgain, nil]];
+
+    STAssertEquals([merger insertedCount], 2U, nil);
+    STAssertEquals([merger updatedCount], 0U, nil);
+    STAssertEquals([merger unchangedCount], 1U, @"only the exact duplicate is dropped");
+    STAssertEqualObjects([merger applyToDocumentPairs], ([NSArray arrayWithObjects:shore, bench, nil]), nil);
+    [merger release];
+}
+
+@end
@@ -10,6 +10,8 @@
 #import <Foundation/Foundation.h>
 #import <SenTestingKit/SenTestingKit.h>
 #import "GeniusPair.h"
+#import "GeniusAssociation.h"
+#import "GeniusItem.h"
 
 @interface GeniusPairTest : SenTestCase {
     GeniusPair *geniusPair; //!< The object under test.
@@ -56,4 +58,57 @@
     STAssertEquals([geniusPair importance], 42, nil);    
 }
 
+//! Pair identifiers survive archiving, copies get a new one, and associations derive theirs from it.
+- (void) testPairID
+{
+    GeniusPairID pairID = [geniusPair pairID];
+    STAssertTrue(pairID != 0, nil);
+
+    NSData *data = [NSKeyedArchiver archivedDataWithRootObject:geniusPair];
+    GeniusPair *newPair = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+    STAssertEquals([newPair pairID], pairID, nil);
+
+    GeniusPair *copiedPair = [[geniusPair copy] autorelease];
+    STAssertTrue([copiedPair pairID] != pairID, nil);
+
+    STAssertEquals([[geniusPair associationAB] associationID], pairID << 1, nil);
+    STAssertEquals([[geniusPair associationBA] associationID], (pairID << 1) | 1, nil);
+}
+
+//! Copies share text and metadata with the original until one side changes them.
+- (void) testCopyOnWrite
+{
+    [[geniusPair itemA] setStringValue:@"question"];
+    [geniusPair setCustomGroupString:@"group"];
+    GeniusAnswerKey * answerKey = [[geniusPair itemA] answerKey];
+
+    GeniusPair *copiedPair = [[geniusPair copy] autorelease];
+    STAssertTrue([[copiedPair itemA] stringValue] == [[geniusPair itemA] stringValue], nil);
+    STAssertTrue([[copiedPair itemA] answerKey] == answerKey, nil);
+    STAssertEqualObjects([copiedPair customGroupString], @"group", nil);
+
+    [[copiedPair itemA] setStringValue:@"changed"];
+    [copiedPair setCustomGroupString:@"other group"];
+    STAssertEqualObjects([[geniusPair itemA] stringValue], @"question", nil);
+    STAssertEqualObjects([geniusPair customGroupString], @"group", nil);
+    STAssertEqualObjects([[copiedPair itemA] stringValue], @"changed", nil);
+    STAssertEqualObjects([copiedPair customGroupString], @"other group", nil);
+
+    // Changing the original after its copy went its own way.
+    [geniusPair setImportance:8];
+    STAssertEquals([copiedPair importance], kGeniusPairNormalImportance, nil);
+}
+
+//! Pairs sharing metadata don't share it any more once archived together and unarchived.
+- (void) testCopiesArchivedTogether
+{
+    [geniusPair setNotesString:@"notes"];
+    GeniusPair *copiedPair = [[geniusPair copy] autorelease];
+
+    NSData *data = [NSKeyedArchiver archivedDataWithRootObject:[NSArray arrayWithObjects:geniusPair, copiedPair, nil]];
+    NSArray *pairs = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+    [[pairs objectAtIndex:1] setNotesString:@"other notes"];
+    STAssertEqualObjects([[pairs objectAtIndex:0] notesString], @"notes", nil);
+}
+
 @end
@@ -7,6 +7,8 @@
 
 // Study menu
 extern NSString * GeniusPreferencesUseSoundEffectsKey;				// bool
+extern NSString * GeniusPreferencesQuizMultipleChoiceKey;			// bool
+extern NSString * GeniusPreferencesQuizChoiceCountKey;				// integer (3-5 wrong answers)
 
 // Preferences panel
 extern NSString * GeniusPreferencesListTextSizeModeKey;				// integer (0-2)
@@ -7,6 +7,8 @@
 
 
 NSString * GeniusPreferencesUseSoundEffectsKey = @"UseSoundEffects";
+NSString * GeniusPreferencesQuizMultipleChoiceKey = @"QuizMultipleChoice";
+NSString * GeniusPreferencesQuizChoiceCountKey = @"QuizChoiceCount";
 
 NSString * GeniusPreferencesListTextSizeModeKey = @"ListTextSizeMode";
 NSString * GeniusPreferencesQuizUseFullScreenKey = @"UseFullScreen";
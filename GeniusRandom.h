@@ -0,0 +1,35 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+//! State of a small seeded pseudo random generator.
+/*!
+    SplitMix64, the same mixing used for pair identifiers:  64 bits of state, a full period, and good enough
+    statistics for shuffling and simulation.  Unlike random() each user owns its state, so threads do not
+    share a generator and a seed reproduces a run exactly.
+ */
+typedef struct _GeniusRandomState {
+    uint64_t state;
+} GeniusRandomState;
+
+void GeniusRandomSeed(GeniusRandomState * random, uint64_t seed);
+uint64_t GeniusRandomNext(GeniusRandomState * random);
+long GeniusRandomLong(GeniusRandomState * random);
+double GeniusRandomUniform(GeniusRandomState * random);
+double GeniusRandomNormal(GeniusRandomState * random);
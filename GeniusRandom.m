@@ -0,0 +1,55 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusRandom.h"
+#include <math.h>   // log, sqrt, cos
+
+//! Starts @a random at @a seed.  Equal seeds give equal sequences.
+void GeniusRandomSeed(GeniusRandomState * random, uint64_t seed)
+{
+    random->state = seed;
+}
+
+//! Next 64 random bits.
+uint64_t GeniusRandomNext(GeniusRandomState * random)
+{
+    uint64_t z = (random->state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//! Random number from 0 to 2^31 - 1, the range of random().
+long GeniusRandomLong(GeniusRandomState * random)
+{
+    return (long)(GeniusRandomNext(random) >> 33);
+}
+
+//! Uniformly distributed number in [0, 1).
+double GeniusRandomUniform(GeniusRandomState * random)
+{
+    return (GeniusRandomNext(random) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//! Standard normally distributed number, by the Box-Muller transform.
+double GeniusRandomNormal(GeniusRandomState * random)
+{
+    double u = 1.0 - GeniusRandomUniform(random);     // (0, 1], keeps log() finite
+    double v = GeniusRandomUniform(random);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
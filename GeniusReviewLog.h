@@ -0,0 +1,87 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusAssociation.h"
+
+//! One answer event, as kept in a GeniusReviewLog.
+typedef struct _GeniusReviewRecord {
+    GeniusAssociationID associationID;  //!< GeniusAssociation#associationID of the reviewed association.
+    GeniusTime time;                    //!< When the answer was given.
+    unsigned int responseMilliseconds;  //!< Time between presenting the cue and the answer.
+    float matchScore;                   //!< Similarity of the typed answer, 0.0 to 1.0, or -1.0 when nothing was typed.
+    int outcome;                        //!< GeniusReviewOutcome.
+    int flags;                          //!< GeniusReviewRecordDetached and GeniusReviewRecordApplied bits.
+} GeniusReviewRecord;
+
+//! GeniusReviewRecord#flags bit of answers given in a combined review while the deck was closed.
+/*!
+    The deck file does not reflect such answers yet.  The deck applies them when it is next opened,
+    see GeniusDocument#applyReviewRecord:, and saving it then makes them part of the file.
+ */
+#define GeniusReviewRecordDetached 1
+
+//! GeniusReviewRecord#flags bit of detached answers a saved deck file holds.  See GeniusReviewLog#markDetachedRecordsAppliedBefore:.
+#define GeniusReviewRecordApplied 2
+
+//! Called by GeniusReviewLog#scanRecordsWithFunction:context: with consecutive runs of records.
+typedef void (*GeniusReviewLogScanFunction)(const GeniusReviewRecord * records, unsigned int count, void * context);
+
+//! Size of one record on disk in bytes.
+#define kGeniusReviewLogRecordSize 32
+
+//! Append-only history of review events stored in a directory of fixed size segment files.
+/*!
+    Records are encoded as fixed size little endian structures, so a segment can be scanned by simply
+    mapping it.  New records collect in a small buffer which is appended to the newest segment when full,
+    on #flush and on dealloc, so memory use while writing does not grow with the history.  A segment
+    holding #_recordsPerSegment records is closed and a new one started.
+
+    The directory may be changed with #setDirectoryPath:, which takes the existing history along and
+    replaces any log already there.
+ */
+@interface GeniusReviewLog : NSObject {
+    NSString * _directoryPath;              //!< Directory holding the segment files.
+    unsigned int _recordsPerSegment;        //!< Records per segment file before starting a new one.
+
+    unsigned int _segmentIndex;             //!< Index of the newest segment.
+    unsigned int _segmentRecordCount;       //!< Records already written to the newest segment.
+    unsigned long long _storedRecordCount;  //!< Records in all segments.
+
+    GeniusReviewRecord * _buffer;           //!< Records not yet written.
+    unsigned int _bufferCount;              //!< Number of records in #_buffer.
+}
+
++ (NSString *) logPathForDocumentPath:(NSString *)documentPath;
+
+- (id) initWithDirectoryPath:(NSString *)path;
+- (id) initWithDirectoryPath:(NSString *)path recordsPerSegment:(unsigned int)recordsPerSegment;
+
+- (NSString *) directoryPath;
+- (BOOL) setDirectoryPath:(NSString *)path;
+
+- (void) appendRecord:(const GeniusReviewRecord *)record;
+- (BOOL) flush;
+
+- (unsigned long long) recordCount;
+- (unsigned long long) scanRecordsWithFunction:(GeniusReviewLogScanFunction)function context:(void *)context;
+- (NSData *) unappliedDetachedRecords;
+- (BOOL) markDetachedRecordsAppliedBefore:(unsigned long long)position;
+
+@end
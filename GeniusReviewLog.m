@@ -0,0 +1,444 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusReviewLog.h"
+#import "GeniusByteOrder.h"
+#include <string.h>    // memcmp, memset
+#include <fcntl.h>     // open
+#include <unistd.h>    // pwrite
+#include <errno.h>
+
+//! Number of records collected in memory before they are appended to disk.
+#define kGeniusReviewLogBufferCapacity 256
+
+//! Default number of records per segment file, 1 MB worth of records.
+#define kGeniusReviewLogRecordsPerSegment 32768
+
+//! Size of the segment header in bytes: magic, version, record size and a reserved word.
+#define kGeniusReviewLogHeaderSize 16
+
+//! Segment file format version.
+#define kGeniusReviewLogVersion 1
+
+static const unsigned char kGeniusReviewLogMagic[4] = { 'G', 'L', 'O', 'G' };
+
+//! Writes the kGeniusReviewLogRecordSize byte disk representation of @a record to @a bytes.
+static void EncodeRecord(const GeniusReviewRecord * record, unsigned char * bytes)
+{
+    union { float f; unsigned int i; } matchScore;
+    matchScore.f = record->matchScore;
+
+    memset(bytes, 0, kGeniusReviewLogRecordSize);
+    PutUInt64(bytes, record->associationID);
+    PutUInt64(bytes + 8, (unsigned long long)record->time);
+    PutUInt32(bytes + 16, record->responseMilliseconds);
+    PutUInt32(bytes + 20, matchScore.i);
+    bytes[24] = (unsigned char)record->outcome;
+    bytes[25] = (unsigned char)record->flags;
+}
+
+//! Reads a record written by EncodeRecord().
+static void DecodeRecord(const unsigned char * bytes, GeniusReviewRecord * record)
+{
+    union { float f; unsigned int i; } matchScore;
+    matchScore.i = GetUInt32(bytes + 20);
+
+    record->associationID = GetUInt64(bytes);
+    record->time = (GeniusTime)GetUInt64(bytes + 8);
+    record->responseMilliseconds = GetUInt32(bytes + 16);
+    record->matchScore = matchScore.f;
+    record->outcome = bytes[24];
+    record->flags = bytes[25];
+}
+
+
+
+@interface GeniusReviewLog (Private)
+- (NSString *) _pathForSegment:(unsigned int)index;
+- (NSArray *) _segmentIndexes;
+- (void) _loadSegmentState;
+@end
+
+@implementation GeniusReviewLog
+
+//! Returns the log directory belonging to the deck at @a documentPath, e.g. @c Foo.geniuslog for @c Foo.genius.
++ (NSString *) logPathForDocumentPath:(NSString *)documentPath
+{
+    return [[documentPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"geniuslog"];
+}
+
+//! Opens the log in @a path with the default segment size.
+- (id) initWithDirectoryPath:(NSString *)path
+{
+    return [self initWithDirectoryPath:path recordsPerSegment:kGeniusReviewLogRecordsPerSegment];
+}
+
+//! Designated initializer.  The directory is created on the first #flush that has records to write.
+- (id) initWithDirectoryPath:(NSString *)path recordsPerSegment:(unsigned int)recordsPerSegment
+{
+    self = [super init];
+    if (self != nil) {
+        _directoryPath = [path copy];
+        _recordsPerSegment = MAX(recordsPerSegment, 1U);
+        _buffer = (GeniusReviewRecord *)malloc(kGeniusReviewLogBufferCapacity * sizeof(GeniusReviewRecord));
+        _bufferCount = 0;
+        [self _loadSegmentState];
+    }
+    return self;
+}
+
+//! Writes pending records, releases the path and deallocates memory.
+- (void) dealloc
+{
+    [self flush];
+    free(_buffer);
+    [_directoryPath release];
+    [super dealloc];
+}
+
+//! _directoryPath getter.
+- (NSString *) directoryPath
+{
+    return _directoryPath;
+}
+
+//! Moves the log to @a path.
+/*!
+    Pending records are flushed first.  If the current directory holds a history it goes along to
+    @a path:  the directory is moved there, or copied if it isn't a temporary directory, so a deck saved
+    under a new name keeps its own history.  A log already at @a path belongs to the file being replaced
+    and is removed first, so two unrelated histories never mix.  Without a history, as when a deck is
+    opened, the log simply continues the one found at @a path.  Returns NO if the history could not be moved.
+*/
+- (BOOL) setDirectoryPath:(NSString *)path
+{
+    if ([path isEqualToString:_directoryPath])
+        return YES;
+
+    [self flush];
+
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    if (_storedRecordCount > 0 && path != nil)
+    {
+        BOOL isTemporary = [_directoryPath hasPrefix:NSTemporaryDirectory()];
+        BOOL isMoved = YES;
+        if ([fileManager fileExistsAtPath:path])
+            isMoved = [fileManager removeFileAtPath:path handler:nil];
+        if (isMoved && isTemporary)
+            isMoved = [fileManager movePath:_directoryPath toPath:path handler:nil];
+        else if (isMoved)
+            isMoved = [fileManager copyPath:_directoryPath toPath:path handler:nil];
+        if (isMoved == NO)
+        {
+            NSLog(@"Could not move review log %@ to %@", _directoryPath, path);
+            return NO;
+        }
+    }
+
+    [_directoryPath release];
+    _directoryPath = [path copy];
+    [self _loadSegmentState];
+    return YES;
+}
+
+//! Adds @a record to the log.  Writes the buffer to disk when it is full.
+- (void) appendRecord:(const GeniusReviewRecord *)record
+{
+    if (_bufferCount == kGeniusReviewLogBufferCapacity && [self flush] == NO)
+    {
+        NSLog(@"Discarding %u review records", _bufferCount);
+        _bufferCount = 0;
+    }
+    _buffer[_bufferCount++] = *record;
+}
+
+//! Appends buffered records to the segment files.  Returns NO if they could not be written.
+- (BOOL) flush
+{
+    if (_bufferCount == 0)
+        return YES;
+    if (_directoryPath == nil)
+        return NO;
+
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    BOOL isDirectory = NO;
+    if ([fileManager fileExistsAtPath:_directoryPath isDirectory:&isDirectory] == NO)
+    {
+        if ([fileManager createDirectoryAtPath:_directoryPath attributes:nil] == NO)
+            return NO;
+    }
+    else if (isDirectory == NO)
+        return NO;
+
+    unsigned int written = 0;
+    BOOL result = YES;
+    while (written < _bufferCount)
+    {
+        if (_segmentRecordCount == _recordsPerSegment)
+        {
+            _segmentIndex++;
+            _segmentRecordCount = 0;
+        }
+
+        NSString * segmentPath = [self _pathForSegment:_segmentIndex];
+        if (_segmentRecordCount == 0)
+        {
+            unsigned char header[kGeniusReviewLogHeaderSize];
+            memset(header, 0, sizeof(header));
+            memcpy(header, kGeniusReviewLogMagic, 4);
+            PutUInt32(header + 4, kGeniusReviewLogVersion);
+            PutUInt32(header + 8, kGeniusReviewLogRecordSize);
+            NSData * headerData = [NSData dataWithBytes:header length:sizeof(header)];
+            if ([fileManager createFileAtPath:segmentPath contents:headerData attributes:nil] == NO)
+            {
+                result = NO;
+                break;
+            }
+        }
+
+        unsigned int count = MIN(_bufferCount - written, _recordsPerSegment - _segmentRecordCount);
+        NSMutableData * data = [NSMutableData dataWithLength:count * kGeniusReviewLogRecordSize];
+        unsigned char * bytes = [data mutableBytes];
+        unsigned int i;
+        for (i=0; i<count; i++)
+            EncodeRecord(&_buffer[written + i], bytes + i * kGeniusReviewLogRecordSize);
+
+        NSFileHandle * fileHandle = [NSFileHandle fileHandleForWritingAtPath:segmentPath];
+        if (fileHandle == nil)
+        {
+            result = NO;
+            break;
+        }
+        NS_DURING
+            // Also drops a partial record left behind by an interrupted write.
+            [fileHandle truncateFileAtOffset:kGeniusReviewLogHeaderSize + (unsigned long long)_segmentRecordCount * kGeniusReviewLogRecordSize];
+            [fileHandle writeData:data];
+        NS_HANDLER
+            NSLog(@"Could not write review log %@: %@", segmentPath, [localException reason]);
+            result = NO;
+        NS_ENDHANDLER
+        [fileHandle closeFile];
+        if (result == NO)
+            break;
+
+        written += count;
+        _segmentRecordCount += count;
+        _storedRecordCount += count;
+    }
+
+    // Keep what could not be written at the front of the buffer.
+    if (written > 0)
+    {
+        memmove(_buffer, _buffer + written, (_bufferCount - written) * sizeof(GeniusReviewRecord));
+        _bufferCount -= written;
+    }
+    return result;
+}
+
+//! Number of records in the log, written or not.
+- (unsigned long long) recordCount
+{
+    return _storedRecordCount + _bufferCount;
+}
+
+//! Calls @a function with all records in the order they were appended.  Returns the number of records.
+/*!
+    Segments are memory mapped and decoded in batches, so the whole history is never in memory at once.
+    Segments with an unknown header are skipped.
+*/
+- (unsigned long long) scanRecordsWithFunction:(GeniusReviewLogScanFunction)function context:(void *)context
+{
+    GeniusReviewRecord batch[kGeniusReviewLogBufferCapacity];
+    unsigned long long total = 0;
+
+    NSEnumerator * indexEnumerator = [[self _segmentIndexes] objectEnumerator];
+    NSNumber * index;
+    while ((index = [indexEnumerator nextObject]))
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        NSData * data = [NSData dataWithContentsOfMappedFile:[self _pathForSegment:[index unsignedIntValue]]];
+        const unsigned char * bytes = [data bytes];
+        unsigned int length = [data length];
+        if (length >= kGeniusReviewLogHeaderSize && memcmp(bytes, kGeniusReviewLogMagic, 4) == 0
+            && GetUInt32(bytes + 8) == kGeniusReviewLogRecordSize)
+        {
+            unsigned int recordCount = (length - kGeniusReviewLogHeaderSize) / kGeniusReviewLogRecordSize;
+            const unsigned char * recordBytes = bytes + kGeniusReviewLogHeaderSize;
+            unsigned int done = 0;
+            while (done < recordCount)
+            {
+                unsigned int count = MIN(recordCount - done, (unsigned int)kGeniusReviewLogBufferCapacity);
+                unsigned int i;
+                for (i=0; i<count; i++)
+                    DecodeRecord(recordBytes + (done + i) * kGeniusReviewLogRecordSize, &batch[i]);
+                function(batch, count, context);
+                done += count;
+            }
+            total += recordCount;
+        }
+        [pool release];
+    }
+
+    if (_bufferCount > 0)
+    {
+        function(_buffer, _bufferCount, context);
+        total += _bufferCount;
+    }
+    return total;
+}
+
+//! GeniusReviewLogScanFunction keeping the detached records not yet marked applied, appending them to the NSMutableData @a context.
+static void CollectDetachedRecords(const GeniusReviewRecord * records, unsigned int count, void * context)
+{
+    unsigned int i;
+    for (i=0; i<count; i++)
+        if ((records[i].flags & (GeniusReviewRecordDetached | GeniusReviewRecordApplied)) == GeniusReviewRecordDetached)
+            [(NSMutableData *)context appendBytes:&records[i] length:sizeof(GeniusReviewRecord)];
+}
+
+//! The GeniusReviewRecordDetached records not yet marked GeniusReviewRecordApplied, oldest first, as an array of GeniusReviewRecord.
+- (NSData *) unappliedDetachedRecords
+{
+    NSMutableData * records = [NSMutableData data];
+    [self scanRecordsWithFunction:CollectDetachedRecords context:records];
+    return records;
+}
+
+//! Marks the detached records among the first @a position records GeniusReviewRecordApplied.
+/*!
+    Called once a saved deck file holds their answers, so they are not applied again.  The flag is
+    rewritten in place; records keep their position.  Returns NO if a segment could not be written.
+ */
+- (BOOL) markDetachedRecordsAppliedBefore:(unsigned long long)position
+{
+    [self flush];
+
+    BOOL result = YES;
+    unsigned long long done = 0;
+    NSEnumerator * indexEnumerator = [[self _segmentIndexes] objectEnumerator];
+    NSNumber * index;
+    while ((index = [indexEnumerator nextObject]) && done < position)
+    {
+        NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+        NSString * segmentPath = [self _pathForSegment:[index unsignedIntValue]];
+        NSData * data = [NSData dataWithContentsOfMappedFile:segmentPath];
+        const unsigned char * bytes = [data bytes];
+        unsigned int length = [data length];
+        if (length >= kGeniusReviewLogHeaderSize && memcmp(bytes, kGeniusReviewLogMagic, 4) == 0
+            && GetUInt32(bytes + 8) == kGeniusReviewLogRecordSize)
+        {
+            unsigned int i, recordCount = (length - kGeniusReviewLogHeaderSize) / kGeniusReviewLogRecordSize;
+            int fd = -1;
+            for (i=0; i<recordCount && done < position; i++, done++)
+            {
+                off_t flagsOffset = kGeniusReviewLogHeaderSize + (off_t)i * kGeniusReviewLogRecordSize + 25;
+                unsigned char flags = bytes[flagsOffset];
+                if ((flags & GeniusReviewRecordDetached) == 0 || (flags & GeniusReviewRecordApplied))
+                    continue;
+                if (fd < 0 && (fd = open([segmentPath fileSystemRepresentation], O_WRONLY)) < 0)
+                    break;
+                flags |= GeniusReviewRecordApplied;
+                if (pwrite(fd, &flags, 1, flagsOffset) != 1)
+                    break;
+            }
+            if (i < recordCount && done < position)
+            {
+                NSLog(@"Could not mark review log %@: %s", segmentPath, strerror(errno));
+                result = NO;
+            }
+            if (fd >= 0)
+                close(fd);
+        }
+        [pool release];
+        if (result == NO)
+            break;
+    }
+
+    // Records that could not be flushed are marked in the buffer.
+    unsigned int i;
+    for (i=0; result && i<_bufferCount && _storedRecordCount + i < position; i++)
+        if (_buffer[i].flags & GeniusReviewRecordDetached)
+            _buffer[i].flags |= GeniusReviewRecordApplied;
+    return result;
+}
+
+@end
+
+
+@implementation GeniusReviewLog (Private)
+
+//! Path of the segment file with @a index.
+- (NSString *) _pathForSegment:(unsigned int)index
+{
+    return [_directoryPath stringByAppendingPathComponent:[NSString stringWithFormat:@"%08x.log", index]];
+}
+
+//! Sorted NSNumber indexes of the segment files present in #_directoryPath.
+- (NSArray *) _segmentIndexes
+{
+    NSMutableArray * indexes = [NSMutableArray array];
+    if (_directoryPath == nil)
+        return indexes;
+
+    NSEnumerator * fileEnumerator = [[[NSFileManager defaultManager] directoryContentsAtPath:_directoryPath] objectEnumerator];
+    NSString * fileName;
+    while ((fileName = [fileEnumerator nextObject]))
+    {
+        if ([[fileName pathExtension] isEqualToString:@"log"] == NO)
+            continue;
+        unsigned int index;
+        NSScanner * scanner = [NSScanner scannerWithString:[fileName stringByDeletingPathExtension]];
+        if ([scanner scanHexInt:&index] && [scanner isAtEnd])
+            [indexes addObject:[NSNumber numberWithUnsignedInt:index]];
+    }
+    [indexes sortUsingSelector:@selector(compare:)];
+    return indexes;
+}
+
+//! Counts the records already on disk and finds the segment new records go to.
+- (void) _loadSegmentState
+{
+    _segmentIndex = 0;
+    _segmentRecordCount = 0;
+    _storedRecordCount = 0;
+
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    NSEnumerator * indexEnumerator = [[self _segmentIndexes] objectEnumerator];
+    NSNumber * index;
+    while ((index = [indexEnumerator nextObject]))
+    {
+        NSString * segmentPath = [self _pathForSegment:[index unsignedIntValue]];
+        unsigned long long size = [[fileManager fileAttributesAtPath:segmentPath traverseLink:YES] fileSize];
+        unsigned int recordCount = 0;
+        if (size > kGeniusReviewLogHeaderSize)
+            recordCount = (unsigned int)((size - kGeniusReviewLogHeaderSize) / kGeniusReviewLogRecordSize);
+
+        _segmentIndex = [index unsignedIntValue];
+        _segmentRecordCount = recordCount;
+        _storedRecordCount += recordCount;
+    }
+
+    // Never append to a segment that is already full, or was written with a larger segment size.
+    if (_segmentRecordCount >= _recordsPerSegment)
+    {
+        _segmentIndex++;
+        _segmentRecordCount = 0;
+    }
+}
+
+@end
@@ -0,0 +1,155 @@
+//
+//  GeniusReviewLogTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusReviewLog.h"
+
+@interface GeniusReviewLogTest : SenTestCase {
+    NSString *path;     //!< Temporary log directory.
+}
+
+@end
+
+//! Collects scanned records into the NSMutableData passed as context.
+static void CollectRecords(const GeniusReviewRecord * records, unsigned int count, void * context)
+{
+    [(NSMutableData *)context appendBytes:records length:count * sizeof(GeniusReviewRecord)];
+}
+
+//! Tests for the GeniusReviewLog segment files.
+@implementation GeniusReviewLogTest
+
+//! Picks a fresh temporary directory for each test.
+- (void) setUp
+{
+    NSString * name = [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"geniuslog"];
+    path = [[NSTemporaryDirectory() stringByAppendingPathComponent:name] retain];
+}
+
+//! Deletes the log directory.
+- (void) tearDown
+{
+    [[NSFileManager defaultManager] removeFileAtPath:path handler:nil];
+    [path release];
+    path = nil;
+}
+
+//! Records survive reopening and spread over several segments.
+- (void) testAppendAndScan
+{
+    GeniusReviewLog * log = [[GeniusReviewLog alloc] initWithDirectoryPath:path recordsPerSegment:4];
+    int i;
+    for (i=0; i<10; i++)
+    {
+        GeniusReviewRecord record;
+        record.associationID = 0x123456789ULL * i;
+        record.time = 1200000000LL + i;
+        record.responseMilliseconds = 100 * i;
+        record.matchScore = i / 10.0f;
+        record.outcome = i % 3;
+        record.flags = (i % 5 == 0 ? GeniusReviewRecordDetached : 0);
+        [log appendRecord:&record];
+    }
+    STAssertEquals([log recordCount], 10ULL, nil);
+    STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path], @"nothing written before flush");
+    STAssertTrue([log flush], nil);
+    [log release];
+
+    STAssertEquals([[[NSFileManager defaultManager] directoryContentsAtPath:path] count], 3U, nil);
+
+    log = [[GeniusReviewLog alloc] initWithDirectoryPath:path recordsPerSegment:4];
+    STAssertEquals([log recordCount], 10ULL, nil);
+
+    NSMutableData * data = [NSMutableData data];
+    STAssertEquals([log scanRecordsWithFunction:CollectRecords context:data], 10ULL, nil);
+    [log release];
+
+    const GeniusReviewRecord * records = [data bytes];
+    STAssertEquals([data length], 10 * sizeof(GeniusReviewRecord), nil);
+    for (i=0; i<10; i++)
+    {
+        STAssertEquals(records[i].associationID, 0x123456789ULL * i, nil);
+        STAssertEquals(records[i].time, 1200000000LL + i, nil);
+        STAssertEquals(records[i].responseMilliseconds, 100U * i, nil);
+        STAssertEquals(records[i].matchScore, i / 10.0f, nil);
+        STAssertEquals(records[i].outcome, i % 3, nil);
+        STAssertEquals(records[i].flags, (i % 5 == 0 ? GeniusReviewRecordDetached : 0), nil);
+    }
+}
+
+//! Moving a log with records over another log replaces it; an empty log continues the one it moves to.
+- (void) testSetDirectoryPathReplacesExistingLog
+{
+    NSString * otherPath = [[path stringByDeletingPathExtension] stringByAppendingString:@"-other.geniuslog"];
+    GeniusReviewRecord record;
+    memset(&record, 0, sizeof(record));
+    int i;
+
+    GeniusReviewLog * other = [[GeniusReviewLog alloc] initWithDirectoryPath:otherPath recordsPerSegment:4];
+    for (i=0; i<3; i++)
+    {
+        record.associationID = 100 + i;
+        [other appendRecord:&record];
+    }
+    [other release];
+
+    GeniusReviewLog * log = [[GeniusReviewLog alloc] initWithDirectoryPath:path recordsPerSegment:4];
+    for (i=0; i<2; i++)
+    {
+        record.associationID = 200 + i;
+        [log appendRecord:&record];
+    }
+    STAssertTrue([log setDirectoryPath:otherPath], nil);
+    STAssertEquals([log recordCount], 2ULL, @"the replaced deck's history is gone");
+
+    NSMutableData * data = [NSMutableData data];
+    [log scanRecordsWithFunction:CollectRecords context:data];
+    const GeniusReviewRecord * records = [data bytes];
+    STAssertEquals(records[0].associationID, 200ULL, nil);
+    STAssertEquals(records[1].associationID, 201ULL, nil);
+    [log release];
+
+    NSString * emptyPath = [[path stringByDeletingPathExtension] stringByAppendingString:@"-empty.geniuslog"];
+    GeniusReviewLog * opened = [[GeniusReviewLog alloc] initWithDirectoryPath:emptyPath recordsPerSegment:4];
+    STAssertTrue([opened setDirectoryPath:otherPath], nil);
+    STAssertEquals([opened recordCount], 2ULL, @"opening continues the log found there");
+    [opened release];
+
+    [[NSFileManager defaultManager] removeFileAtPath:otherPath handler:nil];
+}
+
+//! Detached records stay unapplied until marked, whatever their time, and the marks are kept on disk.
+- (void) testMarkDetachedRecordsApplied
+{
+    GeniusReviewLog * log = [[GeniusReviewLog alloc] initWithDirectoryPath:path recordsPerSegment:2];
+    GeniusReviewRecord record;
+    memset(&record, 0, sizeof(record));
+    int i;
+    for (i=0; i<5; i++)
+    {
+        record.associationID = i;
+        record.time = 1200000000LL;
+        record.flags = (i == 1 ? 0 : GeniusReviewRecordDetached);
+        [log appendRecord:&record];
+    }
+    STAssertEquals([[log unappliedDetachedRecords] length], 4 * sizeof(GeniusReviewRecord), nil);
+
+    STAssertTrue([log markDetachedRecordsAppliedBefore:3], nil);
+    [log release];
+
+    log = [[GeniusReviewLog alloc] initWithDirectoryPath:path recordsPerSegment:2];
+    NSData * data = [log unappliedDetachedRecords];
+    const GeniusReviewRecord * records = [data bytes];
+    STAssertEquals([data length], 2 * sizeof(GeniusReviewRecord), nil);
+    STAssertEquals(records[0].associationID, 3ULL, nil);
+    STAssertEquals(records[1].associationID, 4ULL, nil);
+    STAssertEquals([log recordCount], 5ULL, @"marking keeps every record");
+    [log release];
+}
+
+@end
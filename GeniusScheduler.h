@@ -0,0 +1,81 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusAssociation.h"
+
+@class GeniusAssociationColumns;
+
+//! What happened when a GeniusAssociation was presented in a quiz.
+typedef enum {
+    GeniusReviewOutcomeWrong = 0,
+    GeniusReviewOutcomeRight = 1,
+    GeniusReviewOutcomeSkip = 2
+} GeniusReviewOutcome;
+
+//! Scores above this share the interval of the maximum score when rescheduling in bulk.
+#define kGeniusSchedulerMaximumScore 63
+
+//! Interface of the scheduling algorithms used by GeniusAssociationEnumerator.
+/*!
+    A scheduler decides the new GeniusAssociation#score and GeniusAssociation#dueTime after each answer.
+    Schedulers are score based: the review interval is a function of the score alone, which is what lets
+    #GeniusRescheduleDueTimes move a whole deck from one scheduler to another over packed arrays.
+ */
+@protocol GeniusScheduler <NSObject>
+- (NSString *) identifier;
+- (NSDictionary *) parameters;
+- (GeniusTime) intervalForScore:(int)score;
+- (void) scheduleAssociation:(GeniusAssociation *)association outcome:(GeniusReviewOutcome)outcome time:(GeniusTime)now;
+@end
+
+
+//! Base class for score based schedulers.  Implements the right / wrong / skip bookkeeping of Genius 1.x.
+@interface GeniusScoreScheduler : NSObject <GeniusScheduler> {
+    NSDictionary * _parameters;     //!< Algorithm parameters, saved with the document.
+}
+
++ (id <GeniusScheduler>) defaultScheduler;
++ (id <GeniusScheduler>) schedulerWithIdentifier:(NSString *)identifier parameters:(NSDictionary *)parameters;
+
+- (id) initWithParameters:(NSDictionary *)parameters;
+- (double) doubleParameterForKey:(NSString *)key defaultValue:(double)defaultValue;
+
+@end
+
+
+//! The original Genius scheduler: the interval is @c base to the power of the score, in seconds.
+/*! Parameter @c base defaults to 5. */
+@interface GeniusClassicScheduler : GeniusScoreScheduler
+@end
+
+
+//! SM-2 style intervals: one day, six days, then growing by the ease factor.
+/*!
+    Parameters are @c easeFactor (default 2.5) and @c relearnSeconds (default 60), the delay before an
+    association answered wrongly comes back.  Ease is kept per deck rather than per card since Genius only
+    records a score per association.
+ */
+@interface GeniusSM2Scheduler : GeniusScoreScheduler
+@end
+
+
+void GeniusComputeRescheduleDeltas(id <GeniusScheduler> oldScheduler, id <GeniusScheduler> newScheduler, GeniusTime * deltas);
+void GeniusRescheduleDueTimes(const int * scores, GeniusTime * dueTimes, unsigned int count, const GeniusTime * deltas);
+unsigned int GeniusRescheduleColumns(GeniusAssociationColumns * columns, id <GeniusScheduler> oldScheduler, id <GeniusScheduler> newScheduler);
@@ -0,0 +1,226 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusScheduler.h"
+#import "GeniusAssociationColumns.h"
+#include <math.h>   // pow
+
+//! Longest interval a scheduler may return, about 300 years.  Keeps pow() based intervals from overflowing.
+static const GeniusTime kGeniusSchedulerMaximumInterval = 10000000000LL;
+
+//! Score based scheduling shared by all the bundled algorithms.
+@implementation GeniusScoreScheduler
+
+//! Returns a shared GeniusClassicScheduler, the behavior of earlier Genius versions.
++ (id <GeniusScheduler>) defaultScheduler
+{
+    static id <GeniusScheduler> defaultScheduler = nil;
+    if (defaultScheduler == nil)
+        defaultScheduler = [[GeniusClassicScheduler alloc] initWithParameters:nil];
+    return defaultScheduler;
+}
+
+//! Creates the scheduler registered under @a identifier.  Returns nil for unknown identifiers.
++ (id <GeniusScheduler>) schedulerWithIdentifier:(NSString *)identifier parameters:(NSDictionary *)parameters
+{
+    Class schedulerClass = Nil;
+    if (identifier == nil || [identifier isEqualToString:@"classic"])
+        schedulerClass = [GeniusClassicScheduler class];
+    else if ([identifier isEqualToString:@"sm2"])
+        schedulerClass = [GeniusSM2Scheduler class];
+
+    if (schedulerClass == Nil)
+        return nil;
+    return [[[schedulerClass alloc] initWithParameters:parameters] autorelease];
+}
+
+//! Designated initializer.  @a parameters may be nil, in which case defaults are used.
+- (id) initWithParameters:(NSDictionary *)parameters
+{
+    self = [super init];
+    if (self != nil) {
+        _parameters = [parameters copy];
+    }
+    return self;
+}
+
+//! Initializes a scheduler with default parameters.
+- (id) init
+{
+    return [self initWithParameters:nil];
+}
+
+//! Releases parameters and deallocates memory.
+- (void) dealloc
+{
+    [_parameters release];
+    [super dealloc];
+}
+
+//! Subclasses return the name used to store the choice of scheduler in a document.
+- (NSString *) identifier
+{
+    [self doesNotRecognizeSelector:_cmd];
+    return nil;
+}
+
+//! _parameters getter.  Never nil.
+- (NSDictionary *) parameters
+{
+    return (_parameters ? _parameters : [NSDictionary dictionary]);
+}
+
+//! Convenience method for reading a numeric parameter.
+- (double) doubleParameterForKey:(NSString *)key defaultValue:(double)defaultValue
+{
+    id value = [_parameters objectForKey:key];
+    if (value && [value respondsToSelector:@selector(doubleValue)])
+        return [value doubleValue];
+    return defaultValue;
+}
+
+//! Subclasses return the review interval in seconds for @a score.
+- (GeniusTime) intervalForScore:(int)score
+{
+    [self doesNotRecognizeSelector:_cmd];
+    return 0;
+}
+
+//! Updates score and due time of @a association for the given @a outcome.
+/*!
+    Right bumps the score up by one, wrong sets it back to zero.  Both schedule the association
+    #intervalForScore: seconds after @a now.  Skip clears score and due date.
+    @todo Skipping still nullifies the score as it always has.  Is that what users expect?
+ */
+- (void) scheduleAssociation:(GeniusAssociation *)association outcome:(GeniusReviewOutcome)outcome time:(GeniusTime)now
+{
+    switch (outcome)
+    {
+        case GeniusReviewOutcomeRight:
+            [association setScore:[association score]+1];
+            break;
+        case GeniusReviewOutcomeWrong:
+            [association setScore:0];
+            break;
+        case GeniusReviewOutcomeSkip:
+            [association setScoreNumber:nil];
+            [association setDueDate:nil];
+            return;
+    }
+
+    GeniusTime interval = [self intervalForScore:[association score]];
+    [association setDueTime:now + MIN(interval, kGeniusSchedulerMaximumInterval)];
+}
+
+@end
+
+
+//! pow(base, score) second intervals.
+@implementation GeniusClassicScheduler
+
+//! Identifier stored in documents.
+- (NSString *) identifier
+{
+    return @"classic";
+}
+
+//! @c base to the power of @a score seconds.
+- (GeniusTime) intervalForScore:(int)score
+{
+    double base = [self doubleParameterForKey:@"base" defaultValue:5.0];
+    double seconds = pow(base, MAX(score, 0));
+    if (seconds > (double)kGeniusSchedulerMaximumInterval)
+        return kGeniusSchedulerMaximumInterval;
+    return (GeniusTime)seconds;
+}
+
+@end
+
+
+//! SM-2 style intervals.
+@implementation GeniusSM2Scheduler
+
+//! Identifier stored in documents.
+- (NSString *) identifier
+{
+    return @"sm2";
+}
+
+//! 0 -> relearn delay, 1 -> 1 day, 2 -> 6 days, n -> 6 days * easeFactor^(n-2).
+- (GeniusTime) intervalForScore:(int)score
+{
+    const double day = 86400.0;
+    double easeFactor = MAX([self doubleParameterForKey:@"easeFactor" defaultValue:2.5], 1.3);
+    double seconds;
+    if (score <= 0)
+        seconds = [self doubleParameterForKey:@"relearnSeconds" defaultValue:60.0];
+    else if (score == 1)
+        seconds = day;
+    else
+        seconds = 6.0 * day * pow(easeFactor, score - 2);
+
+    if (seconds > (double)kGeniusSchedulerMaximumInterval)
+        return kGeniusSchedulerMaximumInterval;
+    return (GeniusTime)seconds;
+}
+
+@end
+
+
+//! Fills @a deltas with the due time change for each score when moving from @a oldScheduler to @a newScheduler.
+/*!
+    @a deltas must hold kGeniusSchedulerMaximumScore+2 entries.  Entry 0 is for associations that were never
+    quizzed and is always 0; entry @c s+1 is for score @c s.  The last review is assumed to have happened
+    exactly one old interval before the due time, so the new due time is that moment plus the new interval.
+ */
+void GeniusComputeRescheduleDeltas(id <GeniusScheduler> oldScheduler, id <GeniusScheduler> newScheduler, GeniusTime * deltas)
+{
+    int score;
+    deltas[0] = 0;
+    for (score=0; score<=kGeniusSchedulerMaximumScore; score++)
+        deltas[score+1] = [newScheduler intervalForScore:score] - [oldScheduler intervalForScore:score];
+}
+
+//! Shifts @a dueTimes by the per score @a deltas.  The batch rescheduling kernel.
+/*!
+    Written without branches so that the compiler can vectorize it: scores are clamped with conditional
+    moves, and unscheduled entries are masked out rather than skipped.
+ */
+void GeniusRescheduleDueTimes(const int * scores, GeniusTime * dueTimes, unsigned int count, const GeniusTime * deltas)
+{
+    unsigned int i;
+    for (i=0; i<count; i++)
+    {
+        int index = scores[i] + 1;
+        index = (index < 0) ? 0 : index;
+        index = (index > kGeniusSchedulerMaximumScore+1) ? kGeniusSchedulerMaximumScore+1 : index;
+        GeniusTime dueTime = dueTimes[i];
+        GeniusTime mask = -(GeniusTime)(dueTime != kGeniusTimeNone);
+        dueTimes[i] = dueTime + (deltas[index] & mask);
+    }
+}
+
+//! Reschedules every association in @a columns and writes the changed due times back.
+/*! Returns the number of associations whose due time changed. */
+unsigned int GeniusRescheduleColumns(GeniusAssociationColumns * columns, id <GeniusScheduler> oldScheduler, id <GeniusScheduler> newScheduler)
+{
+    GeniusTime deltas[kGeniusSchedulerMaximumScore+2];
+    GeniusComputeRescheduleDeltas(oldScheduler, newScheduler, deltas);
+    GeniusRescheduleDueTimes([columns scores], [columns dueTimes], [columns count], deltas);
+    return [columns writeDueTimesToAssociations];
+}
@@ -0,0 +1,60 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+#include <CoreServices/CoreServices.h>
+
+//! Compact sort key of one value: an integer, or a collation key for text.
+typedef struct _GeniusSortKey {
+    BOOL isText;                    //!< YES if #values holds a collation key, NO if #integer is used.
+    long long integer;              //!< Number, BOOL or missing value (LLONG_MIN) as an integer.
+    unsigned int length;            //!< Number of collation values.
+    UCCollationValue values[1];     //!< Collation key, allocated to #length entries.
+} GeniusSortKey;
+
+//! Sorts arrays of objects by NSSortDescriptor key paths using precomputed per object keys.
+/*!
+    The first sort by a key path reads the value of every object once through key value coding and
+    turns it into a GeniusSortKey: numbers become integers, strings become case insensitive collation keys
+    of the current locale.  Later sorts reuse those keys, so re-sorting or switching the sort direction
+    touches no model objects at all.  #invalidateObject: drops the keys of one edited object.  With a
+    #cacheLimit, keys of columns not being sorted by are dropped after a sort that leaves more than that.
+
+    Sorting by a single integer key runs a stable LSD radix sort.  Anything else runs a stable merge sort
+    comparing the precomputed keys.  The descriptor's selector is ignored: text always compares like
+    @c localizedCaseInsensitiveCompare:.
+ */
+@interface GeniusSortEngine : NSObject {
+    CollatorRef _collator;                  //!< Case insensitive collator of the current locale.
+    NSMutableDictionary * _columns;         //!< Key path -> CFMutableDictionaryRef of object -> GeniusSortKey.
+    CFMutableDictionaryRef _dependents;     //!< Object owning a sorted value (e.g. a GeniusItem) -> the sorted object.
+    unsigned int _cachedByteCount;          //!< Bytes allocated for the keys in _columns.
+    unsigned int _cacheLimit;               //!< Most bytes of keys kept after a sort, 0 if unbounded.
+}
+
+- (NSArray *) sortedArrayFromArray:(NSArray *)objects usingDescriptors:(NSArray *)sortDescriptors;
+
+- (void) invalidateObject:(id)object;
+- (void) invalidateAllObjects;
+
+- (unsigned int) cachedKeyCount;
+- (unsigned int) cachedByteCount;
+- (unsigned int) cacheLimit;
+- (void) setCacheLimit:(unsigned int)limit;
+
+@end
@@ -0,0 +1,418 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusSortEngine.h"
+#include <limits.h>    // LLONG_MIN
+#include <malloc/malloc.h>  // malloc_size
+
+//! Runs shorter than this are insertion sorted before merging.
+#define kGeniusSortEngineInsertionRun 16
+
+//! Sort state shared by the comparison and sort functions.
+typedef struct _GeniusSortContext {
+    unsigned int keyCount;              //!< Number of sort descriptors.
+    const GeniusSortKey *** keys;       //!< keys[d][i] is the key of object i for descriptor d.
+    const BOOL * ascending;             //!< Direction of each descriptor.
+} GeniusSortContext;
+
+//! CFDictionary value release callback for malloc'd GeniusSortKey values.
+static void ReleaseSortKey(CFAllocatorRef allocator, const void * value)
+{
+    free((void *)value);
+}
+
+//! CFDictionaryApplyFunction callback adding the size of a GeniusSortKey value to the unsigned int at @a context.
+static void AddSortKeySize(const void * object, const void * key, void * context)
+{
+    *(unsigned int *)context += malloc_size(key);
+}
+
+//! Orders two keys: missing values, then numbers, then text.
+static int CompareSortKeys(const GeniusSortKey * key1, const GeniusSortKey * key2)
+{
+    if (key1->isText != key2->isText)
+        return (key1->isText ? 1 : -1);
+    if (key1->isText == NO)
+        return (key1->integer < key2->integer) ? -1 : (key1->integer > key2->integer);
+
+    Boolean equivalent = false;
+    SInt32 order = 0;
+    UCCompareCollationKeys(key1->values, key1->length, key2->values, key2->length, &equivalent, &order);
+    return (int)order;
+}
+
+//! Compares objects @a i and @a j over all descriptors of @a context.
+static int CompareIndexes(const GeniusSortContext * context, unsigned int i, unsigned int j)
+{
+    unsigned int d;
+    for (d=0; d<context->keyCount; d++)
+    {
+        int result = CompareSortKeys(context->keys[d][i], context->keys[d][j]);
+        if (result != 0)
+            return (context->ascending[d] ? result : -result);
+    }
+    return 0;
+}
+
+//! Stable merge sort of @a indexes, using @a buffer of the same size as scratch space.
+static void MergeSortIndexes(const GeniusSortContext * context, unsigned int * indexes, unsigned int * buffer, unsigned int count)
+{
+    unsigned int start, i, j;
+
+    // Insertion sort short runs.
+    for (start=0; start<count; start+=kGeniusSortEngineInsertionRun)
+    {
+        unsigned int end = MIN(start + kGeniusSortEngineInsertionRun, count);
+        for (i=start+1; i<end; i++)
+        {
+            unsigned int index = indexes[i];
+            for (j=i; j>start && CompareIndexes(context, indexes[j-1], index) > 0; j--)
+                indexes[j] = indexes[j-1];
+            indexes[j] = index;
+        }
+    }
+
+    // Merge runs of doubling width, swapping source and destination each pass.
+    unsigned int * source = indexes;
+    unsigned int * destination = buffer;
+    unsigned int width;
+    for (width=kGeniusSortEngineInsertionRun; width<count; width*=2)
+    {
+        for (start=0; start<count; start+=2*width)
+        {
+            unsigned int middle = MIN(start + width, count);
+            unsigned int end = MIN(start + 2*width, count);
+            unsigned int k = start;
+            i = start;
+            j = middle;
+            while (i < middle && j < end)
+                destination[k++] = (CompareIndexes(context, source[j], source[i]) < 0) ? source[j++] : source[i++];
+            while (i < middle)
+                destination[k++] = source[i++];
+            while (j < end)
+                destination[k++] = source[j++];
+        }
+        unsigned int * swap = source;
+        source = destination;
+        destination = swap;
+    }
+    if (source != indexes)
+        memcpy(indexes, source, count * sizeof(unsigned int));
+}
+
+//! Stable LSD radix sort of @a indexes by the integer keys of the single descriptor of @a context.
+/*! Byte positions where all keys agree are skipped, so small ranges such as scores take one pass. */
+static void RadixSortIndexes(const GeniusSortContext * context, unsigned int * indexes, unsigned int * buffer, unsigned int count)
+{
+    unsigned long long * values = (unsigned long long *)malloc(count * sizeof(unsigned long long));
+    unsigned long long * valueBuffer = (unsigned long long *)malloc(count * sizeof(unsigned long long));
+    const GeniusSortKey ** keys = context->keys[0];
+    unsigned int i;
+    for (i=0; i<count; i++)
+    {
+        // Flip the sign bit so unsigned order matches signed order; complement to sort descending.
+        unsigned long long value = (unsigned long long)keys[i]->integer ^ 0x8000000000000000ULL;
+        values[i] = (context->ascending[0] ? value : ~value);
+        indexes[i] = i;
+    }
+
+    unsigned int shift;
+    for (shift=0; shift<64; shift+=8)
+    {
+        unsigned int counts[256];
+        memset(counts, 0, sizeof(counts));
+        for (i=0; i<count; i++)
+            counts[(values[i] >> shift) & 0xFF]++;
+        if (counts[(values[0] >> shift) & 0xFF] == count)
+            continue;
+
+        unsigned int offsets[256], total = 0, b;
+        for (b=0; b<256; b++)
+        {
+            offsets[b] = total;
+            total += counts[b];
+        }
+        for (i=0; i<count; i++)
+        {
+            unsigned int position = offsets[(values[i] >> shift) & 0xFF]++;
+            valueBuffer[position] = values[i];
+            buffer[position] = indexes[i];
+        }
+        memcpy(values, valueBuffer, count * sizeof(unsigned long long));
+        memcpy(indexes, buffer, count * sizeof(unsigned int));
+    }
+
+    free(values);
+    free(valueBuffer);
+}
+
+
+@interface GeniusSortEngine (Private)
+- (CFMutableDictionaryRef) _keysForKeyPath:(NSString *)keyPath;
+- (GeniusSortKey *) _newSortKeyForValue:(id)value;
+- (void) _removeColumnsExcept:(NSArray *)sortDescriptors;
+@end
+
+@implementation GeniusSortEngine
+
+//! Creates an engine collating by the current locale.
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        UCCollateOptions options = kUCCollateStandardOptions | kUCCollateCaseInsensitiveMask;
+        if (UCCreateCollator(NULL, 0, options, &_collator) != noErr)
+            _collator = NULL;
+        _columns = [[NSMutableDictionary alloc] init];
+        _dependents = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    }
+    return self;
+}
+
+//! Frees all keys and the collator.
+- (void) dealloc
+{
+    if (_collator)
+        UCDisposeCollator(&_collator);
+    [_columns release];
+    CFRelease(_dependents);
+    [super dealloc];
+}
+
+//! Returns @a objects sorted by @a sortDescriptors, like NSArray#sortedArrayUsingDescriptors:.
+- (NSArray *) sortedArrayFromArray:(NSArray *)objects usingDescriptors:(NSArray *)sortDescriptors
+{
+    unsigned int count = [objects count];
+    unsigned int keyCount = [sortDescriptors count];
+    if (count < 2 || keyCount == 0)
+        return [NSArray arrayWithArray:objects];
+
+    // Gather the cached keys, extracting the missing ones.
+    id * objectBuffer = (id *)malloc(count * sizeof(id));
+    [objects getObjects:objectBuffer];
+
+    const GeniusSortKey *** keys = (const GeniusSortKey ***)malloc(keyCount * sizeof(GeniusSortKey **));
+    BOOL * ascending = (BOOL *)malloc(keyCount * sizeof(BOOL));
+    BOOL allIntegers = YES;
+    unsigned int d, i;
+    for (d=0; d<keyCount; d++)
+    {
+        NSSortDescriptor * descriptor = [sortDescriptors objectAtIndex:d];
+        NSString * keyPath = [descriptor key];
+        ascending[d] = [descriptor ascending];
+        keys[d] = (const GeniusSortKey **)malloc(count * sizeof(GeniusSortKey *));
+
+        CFMutableDictionaryRef cache = [self _keysForKeyPath:keyPath];
+        NSRange lastDot = [keyPath rangeOfString:@"." options:NSBackwardsSearch];
+        NSString * ownerKeyPath = (lastDot.location == NSNotFound) ? nil : [keyPath substringToIndex:lastDot.location];
+        for (i=0; i<count; i++)
+        {
+            id object = objectBuffer[i];
+            const GeniusSortKey * key = CFDictionaryGetValue(cache, object);
+            if (key == NULL)
+            {
+                key = [self _newSortKeyForValue:[object valueForKeyPath:keyPath]];
+                CFDictionarySetValue(cache, object, key);
+                _cachedByteCount += malloc_size(key);
+
+                // Remember which object an edit of the value's owner should invalidate.
+                id owner = (ownerKeyPath ? [object valueForKeyPath:ownerKeyPath] : nil);
+                if (owner && owner != object)
+                    CFDictionarySetValue(_dependents, owner, object);
+            }
+            keys[d][i] = key;
+            allIntegers = allIntegers && (key->isText == NO);
+        }
+    }
+
+    GeniusSortContext context;
+    context.keyCount = keyCount;
+    context.keys = keys;
+    context.ascending = ascending;
+
+    unsigned int * indexes = (unsigned int *)malloc(count * sizeof(unsigned int));
+    unsigned int * buffer = (unsigned int *)malloc(count * sizeof(unsigned int));
+    if (keyCount == 1 && allIntegers)
+        RadixSortIndexes(&context, indexes, buffer, count);
+    else
+    {
+        for (i=0; i<count; i++)
+            indexes[i] = i;
+        MergeSortIndexes(&context, indexes, buffer, count);
+    }
+
+    id * sortedObjects = (id *)malloc(count * sizeof(id));
+    for (i=0; i<count; i++)
+        sortedObjects[i] = objectBuffer[indexes[i]];
+    NSArray * result = [NSArray arrayWithObjects:sortedObjects count:count];
+
+    free(sortedObjects);
+    free(indexes);
+    free(buffer);
+    for (d=0; d<keyCount; d++)
+        free(keys[d]);
+    free(keys);
+    free(ascending);
+    free(objectBuffer);
+
+    // Deleted objects keep their keys until the cache grows well past the arranged objects.
+    if ([self cachedKeyCount] > keyCount * (2 * count + 1024))
+        [self invalidateAllObjects];
+    else if (_cacheLimit && _cachedByteCount > _cacheLimit)
+        [self _removeColumnsExcept:sortDescriptors];
+
+    return result;
+}
+
+//! Drops the keys of @a object, or of the object owning it, after an edit.
+- (void) invalidateObject:(id)object
+{
+    id dependent = (id)CFDictionaryGetValue(_dependents, object);
+    NSEnumerator * cacheEnumerator = [_columns objectEnumerator];
+    id cache;
+    while ((cache = [cacheEnumerator nextObject]))
+    {
+        const void * key = CFDictionaryGetValue((CFDictionaryRef)cache, object);
+        if (key)
+        {
+            _cachedByteCount -= malloc_size(key);
+            CFDictionaryRemoveValue((CFMutableDictionaryRef)cache, object);
+        }
+        key = (dependent ? CFDictionaryGetValue((CFDictionaryRef)cache, dependent) : NULL);
+        if (key)
+        {
+            _cachedByteCount -= malloc_size(key);
+            CFDictionaryRemoveValue((CFMutableDictionaryRef)cache, dependent);
+        }
+    }
+}
+
+//! Drops all keys.
+- (void) invalidateAllObjects
+{
+    [_columns removeAllObjects];
+    CFDictionaryRemoveAllValues(_dependents);
+    _cachedByteCount = 0;
+}
+
+//! Total number of cached keys over all key paths.
+- (unsigned int) cachedKeyCount
+{
+    unsigned int total = 0;
+    NSEnumerator * cacheEnumerator = [_columns objectEnumerator];
+    id cache;
+    while ((cache = [cacheEnumerator nextObject]))
+        total += CFDictionaryGetCount((CFDictionaryRef)cache);
+    return total;
+}
+
+//! _cachedByteCount getter.
+- (unsigned int) cachedByteCount
+{
+    return _cachedByteCount;
+}
+
+//! _cacheLimit getter.
+- (unsigned int) cacheLimit
+{
+    return _cacheLimit;
+}
+
+//! _cacheLimit setter.  Takes effect after the next sort.
+- (void) setCacheLimit:(unsigned int)limit
+{
+    _cacheLimit = limit;
+}
+
+@end
+
+
+@implementation GeniusSortEngine (Private)
+
+//! Key cache of @a keyPath, created on first use.  Keys retain their objects so addresses are not reused.
+- (CFMutableDictionaryRef) _keysForKeyPath:(NSString *)keyPath
+{
+    CFMutableDictionaryRef cache = (CFMutableDictionaryRef)[_columns objectForKey:keyPath];
+    if (cache == NULL)
+    {
+        CFDictionaryValueCallBacks valueCallBacks = { 0, NULL, ReleaseSortKey, NULL, NULL };
+        cache = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &valueCallBacks);
+        [_columns setObject:(id)cache forKey:keyPath];
+        CFRelease(cache);
+    }
+    return cache;
+}
+
+//! Converts @a value to a malloc'd GeniusSortKey.
+- (GeniusSortKey *) _newSortKeyForValue:(id)value
+{
+    GeniusSortKey * key;
+    if ([value isKindOfClass:[NSString class]] && _collator)
+    {
+        NSString * string = value;
+        unsigned int length = [string length];
+        UniChar * characters = (UniChar *)malloc(MAX(length, 1U) * sizeof(UniChar));
+        [string getCharacters:characters];
+
+        // Collation keys are rarely longer than a few values per character.
+        ItemCount capacity = 4 * length + 8, keyLength = 0;
+        key = (GeniusSortKey *)malloc(sizeof(GeniusSortKey) + capacity * sizeof(UCCollationValue));
+        while (UCGetCollationKey(_collator, characters, length, capacity, &keyLength, key->values) == kUCOutputBufferTooSmall)
+        {
+            capacity *= 2;
+            key = (GeniusSortKey *)realloc(key, sizeof(GeniusSortKey) + capacity * sizeof(UCCollationValue));
+        }
+        free(characters);
+
+        key->isText = YES;
+        key->integer = 0;
+        key->length = keyLength;
+        return key;
+    }
+
+    key = (GeniusSortKey *)malloc(sizeof(GeniusSortKey));
+    key->isText = NO;
+    key->length = 0;
+    if ([value respondsToSelector:@selector(longLongValue)])
+        key->integer = [value longLongValue];
+    else
+        key->integer = LLONG_MIN;       // nil and unsortable values first
+    return key;
+}
+
+//! Drops the keys of every key path but those of @a sortDescriptors, and those too if the rest is still over #_cacheLimit.
+- (void) _removeColumnsExcept:(NSArray *)sortDescriptors
+{
+    NSArray * keyPaths = [sortDescriptors valueForKey:@"key"];
+    NSEnumerator * keyPathEnumerator = [[_columns allKeys] objectEnumerator];
+    NSString * keyPath;
+    while ((keyPath = [keyPathEnumerator nextObject]))
+    {
+        if ([keyPaths containsObject:keyPath])
+            continue;
+        unsigned int byteCount = 0;
+        CFDictionaryApplyFunction((CFDictionaryRef)[_columns objectForKey:keyPath], AddSortKeySize, &byteCount);
+        _cachedByteCount -= byteCount;
+        [_columns removeObjectForKey:keyPath];
+    }
+
+    if (_cachedByteCount > _cacheLimit)
+        [self invalidateAllObjects];
+}
+
+@end
@@ -0,0 +1,170 @@
+//
+//  GeniusSortEngineTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusSortEngine.h"
+#import "GeniusPair.h"
+#import "GeniusItem.h"
+
+@interface GeniusSortEngineTest : SenTestCase {
+    GeniusSortEngine *engine;   //!< The object under test.
+    NSMutableArray *pairs;      //!< Pairs with mixed case text and repeated scores.
+}
+
+@end
+
+//! Tests for GeniusSortEngine.
+@implementation GeniusSortEngineTest
+
+//! Creates 200 pairs with text in mixed case and scores from -1 to 6.
+- (void) setUp
+{
+    engine = [[GeniusSortEngine alloc] init];
+    pairs = [[NSMutableArray alloc] init];
+
+    srandom(31);
+    int i;
+    for (i=0; i<200; i++)
+    {
+        GeniusPair * pair = [[GeniusPair alloc] init];
+        NSString * text = [NSString stringWithFormat:@"%@word %03d", (i % 2) ? @"W" : @"w", (int)(random() % 50)];
+        [[pair itemA] setValue:text forKey:@"stringValue"];
+        [[pair associationAB] setScore:(i % 8) - 1];
+        [[pair associationBA] setScore:i % 3];
+        [pairs addObject:pair];
+        [pair release];
+    }
+}
+
+//! Releases the engine and pairs.
+- (void) tearDown
+{
+    [engine release];
+    engine = nil;
+    [pairs release];
+    pairs = nil;
+}
+
+//! Returns the descriptor GeniusDocument creates for @a keyPath.
+- (NSSortDescriptor *) _descriptor:(NSString *)keyPath ascending:(BOOL)ascending
+{
+    return [[[NSSortDescriptor alloc] initWithKey:keyPath ascending:ascending] autorelease];
+}
+
+//! Text sorts case insensitively, stable for equal keys, in both directions.
+- (void) testTextSortMatchesSortDescriptor
+{
+    NSSortDescriptor * expectedDescriptor = [[[NSSortDescriptor alloc] initWithKey:@"itemA.stringValue" ascending:YES selector:@selector(localizedCaseInsensitiveCompare:)] autorelease];
+    NSArray * expected = [pairs sortedArrayUsingDescriptors:[NSArray arrayWithObject:expectedDescriptor]];
+    NSArray * actual = [engine sortedArrayFromArray:pairs usingDescriptors:[NSArray arrayWithObject:[self _descriptor:@"itemA.stringValue" ascending:YES]]];
+    STAssertEquals([actual count], [pairs count], nil);
+
+    unsigned int i;
+    for (i=1; i<[actual count]; i++)
+    {
+        NSString * previous = [[actual objectAtIndex:i-1] valueForKeyPath:@"itemA.stringValue"];
+        NSString * current = [[actual objectAtIndex:i] valueForKeyPath:@"itemA.stringValue"];
+        NSComparisonResult order = [previous localizedCaseInsensitiveCompare:current];
+        STAssertTrue(order != NSOrderedDescending, @"row %u", i);
+        if (order == NSOrderedSame)
+            STAssertTrue([pairs indexOfObject:[actual objectAtIndex:i-1]] < [pairs indexOfObject:[actual objectAtIndex:i]], @"unstable at row %u", i);
+        STAssertEqualObjects(current, [[expected objectAtIndex:i] valueForKeyPath:@"itemA.stringValue"], @"row %u", i);
+    }
+
+    NSArray * descending = [engine sortedArrayFromArray:pairs usingDescriptors:[NSArray arrayWithObject:[self _descriptor:@"itemA.stringValue" ascending:NO]]];
+    STAssertEqualObjects([[descending objectAtIndex:0] valueForKeyPath:@"itemA.stringValue"], [[actual lastObject] valueForKeyPath:@"itemA.stringValue"], nil);
+}
+
+//! Integer keys take the radix path and agree with NSSortDescriptor, including its stability.
+- (void) testScoreSortMatchesSortDescriptor
+{
+    BOOL ascending;
+    for (ascending=NO; ascending<=YES; ascending++)
+    {
+        NSArray * descriptors = [NSArray arrayWithObject:[self _descriptor:@"associationBA.scoreNumber" ascending:ascending]];
+        NSArray * expected = [pairs sortedArrayUsingDescriptors:descriptors];
+        NSArray * actual = [engine sortedArrayFromArray:pairs usingDescriptors:descriptors];
+        STAssertEqualObjects(actual, expected, @"ascending %d", ascending);
+    }
+
+    // Unscored associations come first when ascending.
+    NSArray * byScore = [engine sortedArrayFromArray:pairs usingDescriptors:[NSArray arrayWithObject:[self _descriptor:@"associationAB.scoreNumber" ascending:YES]]];
+    STAssertNil([[byScore objectAtIndex:0] valueForKeyPath:@"associationAB.scoreNumber"], nil);
+    STAssertEquals([[[byScore lastObject] valueForKeyPath:@"associationAB.scoreNumber"] intValue], 6, nil);
+}
+
+//! Secondary descriptors break ties of the first.
+- (void) testMultipleDescriptors
+{
+    NSArray * descriptors = [NSArray arrayWithObjects:[self _descriptor:@"associationBA.scoreNumber" ascending:NO], [self _descriptor:@"associationAB.scoreNumber" ascending:YES], nil];
+    NSArray * actual = [engine sortedArrayFromArray:pairs usingDescriptors:descriptors];
+    unsigned int i;
+    for (i=1; i<[actual count]; i++)
+    {
+        GeniusPair * previous = [actual objectAtIndex:i-1];
+        GeniusPair * current = [actual objectAtIndex:i];
+        int previousBA = [[previous associationBA] score], currentBA = [[current associationBA] score];
+        STAssertTrue(previousBA >= currentBA, @"row %u", i);
+        if (previousBA == currentBA)
+            STAssertTrue([[previous associationAB] score] <= [[current associationAB] score], @"row %u", i);
+    }
+}
+
+//! Editing an item only re-sorts correctly after the owning pair's keys are invalidated.
+- (void) testInvalidateObject
+{
+    NSArray * descriptors = [NSArray arrayWithObject:[self _descriptor:@"itemA.stringValue" ascending:YES]];
+    NSArray * sorted = [engine sortedArrayFromArray:pairs usingDescriptors:descriptors];
+    STAssertEquals([engine cachedKeyCount], [pairs count], nil);
+
+    GeniusPair * pair = [sorted objectAtIndex:0];
+    GeniusItem * item = [pair itemA];
+    [item setValue:@"zzz" forKey:@"stringValue"];
+
+    sorted = [engine sortedArrayFromArray:pairs usingDescriptors:descriptors];
+    STAssertEquals([sorted objectAtIndex:0], pair, @"keys are cached until invalidated");
+
+    [engine invalidateObject:item];
+    STAssertEquals([engine cachedKeyCount], [pairs count] - 1, nil);
+    sorted = [engine sortedArrayFromArray:pairs usingDescriptors:descriptors];
+    STAssertEquals([sorted lastObject], pair, nil);
+
+    [engine invalidateAllObjects];
+    STAssertEquals([engine cachedKeyCount], 0U, nil);
+}
+
+//! Over its cache limit the engine keeps only the keys of the columns just sorted by.
+- (void) testCacheLimit
+{
+    NSArray * byText = [NSArray arrayWithObject:[self _descriptor:@"itemA.stringValue" ascending:YES]];
+    NSArray * byScore = [NSArray arrayWithObject:[self _descriptor:@"associationAB.scoreNumber" ascending:YES]];
+    [engine sortedArrayFromArray:pairs usingDescriptors:byText];
+    unsigned int textBytes = [engine cachedByteCount];
+    STAssertTrue(textBytes > 0, nil);
+    [engine sortedArrayFromArray:pairs usingDescriptors:byScore];
+    unsigned int totalBytes = [engine cachedByteCount];
+    STAssertTrue(totalBytes > textBytes, nil);
+
+    [engine invalidateObject:[[pairs objectAtIndex:0] itemA]];
+    STAssertTrue([engine cachedByteCount] < totalBytes, nil);
+    [engine sortedArrayFromArray:pairs usingDescriptors:byText];
+    [engine sortedArrayFromArray:pairs usingDescriptors:byScore];
+    STAssertEquals([engine cachedByteCount], totalBytes, @"byte count follows invalidation");
+
+    [engine setCacheLimit:totalBytes - 1];
+    [engine sortedArrayFromArray:pairs usingDescriptors:byScore];
+    STAssertEquals([engine cachedKeyCount], [pairs count], @"text keys dropped");
+    STAssertEquals([engine cachedByteCount], totalBytes - textBytes, nil);
+
+    [engine setCacheLimit:1];
+    [engine sortedArrayFromArray:pairs usingDescriptors:byScore];
+    STAssertEquals([engine cachedKeyCount], 0U, @"even the sorted column goes when it alone is over the limit");
+    STAssertEquals([engine cachedByteCount], 0U, nil);
+}
+
+@end
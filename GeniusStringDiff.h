@@ -19,9 +19,12 @@
 
 #import <Cocoa/Cocoa.h>
 
+@class GeniusAnswerKey;
+
 
 @interface GeniusStringDiff : NSObject
 
 + (NSAttributedString *) attributedStringHighlightingDifferencesFromString:(NSString *)origString toString:(NSString *)newString;
++ (NSAttributedString *) attributedStringHighlightingDifferencesFromString:(NSString *)origString toString:(NSString *)newString answerKey:(GeniusAnswerKey *)answerKey;
 
 @end
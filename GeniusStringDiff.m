@@ -18,48 +18,8 @@
 */
 
 #import "GeniusStringDiff.h"
-
-
-@interface NSString (GeniusStringDiff)
-- (BOOL) _isEqualToStringIgnoringPunctuationAndCase:(NSString *)string;
-@end
-
-//! NSString category with helper method for punctuation insensitive comparisons.
-/*! @category NSString(GeniusStringDiff) */
-@implementation NSString(GeniusStringDiff)
-
-//! Compares self against @a string ignoring punctuation and case.
-- (BOOL) _isEqualToStringIgnoringPunctuationAndCase:(NSString *)string
-{
-	if ([self caseInsensitiveCompare:string] == NSOrderedSame)
-		return YES;
-
-	NSMutableString * string1 = [self mutableCopy];
-	NSMutableString * string2 = [string mutableCopy];
-
-	// Remove punctuation
-	NSCharacterSet * punctuationCharacterSet = [NSCharacterSet punctuationCharacterSet];
-	while (1)
-	{
-		NSRange range = [string1 rangeOfCharacterFromSet:punctuationCharacterSet];
-		if (range.location == NSNotFound)
-			break;
-		[string1 deleteCharactersInRange:range];
-	}
-	while (1)
-	{
-		NSRange range = [string2 rangeOfCharacterFromSet:punctuationCharacterSet];
-		if (range.location == NSNotFound)
-			break;
-		[string2 deleteCharactersInRange:range];
-	}
-
-	BOOL outResult = ([string1 caseInsensitiveCompare:string2] == NSOrderedSame);
-	[string1 release];
-	[string2 release];
-	return outResult;
-}
-@end
+#import "GeniusTrace.h"
+#import "GeniusAnswerKey.h"
 
 
 //! Handles creation of an string that highlights the differences between two strings.
@@ -131,14 +91,23 @@ The implementation chops @a string1 and @a string2 into words based on the space
 	return [diffOutput autorelease];
 }
 
+//! creates a string that highlights the differences between @a origString and @a newString.
+/*! Same as #attributedStringHighlightingDifferencesFromString:toString:answerKey: without a precomputed key. */
++ (NSAttributedString *) attributedStringHighlightingDifferencesFromString:(NSString *)origString toString:(NSString *)newString
+{
+	return [self attributedStringHighlightingDifferencesFromString:origString toString:newString answerKey:nil];
+}
+
 //! creates a string that highlights the differences between @a origString and @a newString.
 /*! 
-Relies on the output of the UNIX diff command.  
+Relies on the output of the UNIX diff command.  Words diff reports as changed are compared by their
+GeniusAnswerKey#key, so changes of case and punctuation alone are not highlighted.  @a answerKey is the key
+of @a newString, usually cached by a GeniusItem, and may be nil.
 
 @todo Rewrite this to make it legible.
 @see #_runDiffFromString:toString:
 */
-+ (NSAttributedString *) attributedStringHighlightingDifferencesFromString:(NSString *)origString toString:(NSString *)newString
++ (NSAttributedString *) attributedStringHighlightingDifferencesFromString:(NSString *)origString toString:(NSString *)newString answerKey:(GeniusAnswerKey *)answerKey
 {
 	if ([newString isEqualToString:@""])
 		return [[[NSAttributedString alloc] initWithString:@""] autorelease];
@@ -147,7 +116,9 @@ Relies on the output of the UNIX diff command.
 		return [[[NSAttributedString alloc] initWithString:origString] autorelease];
 
 	// Run diff
+	uint64_t spanStart = GeniusTraceSpanBegin();
 	NSString * diffOutput = [self _runDiffFromString:origString toString:newString];
+	GeniusTraceSpanEnd("diff", spanStart);
 	if (diffOutput == nil)
 		return [[[NSAttributedString alloc] initWithString:origString] autorelease];
 
@@ -176,7 +147,8 @@ Relies on the output of the UNIX diff command.
 			range = [marker rangeOfString:@"/"];
 		if (range.location != NSNotFound)
 		{
-			if ([origWord _isEqualToStringIgnoringPunctuationAndCase:newWord] == NO)
+			NSString * newKey = (answerKey ? [answerKey keyForWord:newWord] : GeniusAnswerKeyString(newWord));
+			if ([GeniusAnswerKeyString(origWord) isEqualToString:newKey] == NO)
 				[highlightIndexSet addIndex:[mergedWords count]];
 			/*else
 				NSLog(@"%@ and %@ are the same", origWord, newWord);*/
@@ -0,0 +1,69 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import <Foundation/Foundation.h>
+
+#import "GeniusDeckSnapshot.h"
+
+//! Carries sync requests from a GeniusSyncClient to a sync server and brings back the response.
+/*!
+    Requests and responses are binary property lists; a transport only moves bytes.  GeniusSyncServer
+    answers in process, GeniusSyncFileTransport through a server state file on a shared volume.
+ */
+@protocol GeniusSyncTransport <NSObject>
+//! Returns the server response to @a request, or nil when the server could not be reached.
+- (NSData *) responseForRequest:(NSData *)request;
+@end
+
+
+//! How two version vectors relate.
+typedef enum {
+    GeniusVersionEqual = 0,         //!< Both have seen the same edits.
+    GeniusVersionBefore = 1,        //!< The first has seen a subset of the edits of the second.
+    GeniusVersionAfter = 2,         //!< The first has seen a superset of the edits of the second.
+    GeniusVersionConcurrent = 3     //!< Each has seen edits the other has not: a conflict.
+} GeniusVersionOrder;
+
+/*!
+    A card travels as a dictionary with its pair id under @c id and up to two parts, each with its own
+    version vector (replica id -> edit count), so that editing a card on one machine and studying it on
+    another is not a conflict:
+
+    - content, @c c with vector @c cv: item text under @c a and @c b, group @c g, type @c t, notes @c n
+      (empty strings left out) and importance @c i.  A deleted card has content <tt>{x = 1}</tt>.
+    - performance, @c p with vector @c pv: scores under @c s and due times under @c d, two numbers each.
+ */
+
+NSString * GeniusSyncReplicaID(void);
+
+GeniusVersionOrder GeniusCompareVersionVectors(NSDictionary * a, NSDictionary * b);
+NSDictionary * GeniusMergeVersionVectors(NSDictionary * a, NSDictionary * b);
+NSDictionary * GeniusIncrementVersionVector(NSDictionary * vector, NSString * replicaID);
+
+NSDictionary * GeniusSyncContentWithRecord(const GeniusPairRecord * record);
+NSDictionary * GeniusSyncPerformanceWithRecord(const GeniusPairRecord * record);
+NSDictionary * GeniusSyncDeletedContent(void);
+long long GeniusSyncContentHashOfRecord(const GeniusPairRecord * record);
+long long GeniusSyncPerformanceHashOfRecord(const GeniusPairRecord * record);
+long long GeniusSyncContentHash(NSDictionary * content);
+long long GeniusSyncPerformanceHash(NSDictionary * performance);
+
+NSDictionary * GeniusSyncMergeContent(NSDictionary * a, NSDictionary * aVector, NSDictionary * b, NSDictionary * bVector);
+NSDictionary * GeniusSyncMergePerformance(NSDictionary * a, NSDictionary * b);
+
+BOOL GeniusSyncCardIsDeleted(NSDictionary * card);
+void GeniusSyncApplyCardToPair(NSDictionary * card, GeniusPair * pair);
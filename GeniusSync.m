@@ -0,0 +1,335 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import "GeniusSync.h"
+#import "GeniusPair.h"
+#import "GeniusItem.h"
+#import "GeniusAssociation.h"
+
+//! Defaults key of the identifier of this machine in version vectors.
+static NSString * const GeniusSyncReplicaIDKey = @"GeniusSyncReplicaID";
+
+//! Folds the UTF-8 bytes of @a string into the 64 bit FNV-1a @a hash.  nil hashes like the empty string.
+static unsigned long long FNV1aHashString(unsigned long long hash, NSString * string)
+{
+    const unsigned char * bytes = (const unsigned char *)[(string ? string : @"") UTF8String];
+    while (*bytes)
+    {
+        hash ^= *bytes++;
+        hash *= 1099511628211ULL;
+    }
+    return (hash ^ 0x1F) * 1099511628211ULL;      // unit separator after each field
+}
+
+//! Folds the 8 bytes of @a value into the 64 bit FNV-1a @a hash, low byte first.
+static unsigned long long FNV1aHashInt64(unsigned long long hash, long long value)
+{
+    int i;
+    for (i=0; i<8; i++)
+    {
+        hash ^= (unsigned char)(value >> (8 * i));
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//! Hash of the content fields of a card.  The same on every machine, so merges can break ties with it.
+static long long ContentHash(NSString * itemA, NSString * itemB, NSString * customGroup, NSString * customType, NSString * notes, int importance, BOOL isDeleted)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    if (isDeleted)
+        return (long long)FNV1aHashString(hash, @"deleted");
+    hash = FNV1aHashString(hash, itemA);
+    hash = FNV1aHashString(hash, itemB);
+    hash = FNV1aHashString(hash, customGroup);
+    hash = FNV1aHashString(hash, customType);
+    hash = FNV1aHashString(hash, notes);
+    return (long long)FNV1aHashInt64(hash, importance);
+}
+
+//! Hash of the scores and due times of both associations of a card.
+static long long PerformanceHash(const int * scores, const GeniusTime * dueTimes)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    int i;
+    for (i=0; i<2; i++)
+    {
+        hash = FNV1aHashInt64(hash, scores[i]);
+        hash = FNV1aHashInt64(hash, dueTimes[i]);
+    }
+    return (long long)hash;
+}
+
+//! Adds @a text to @a content under @a key unless it is empty.
+static void SetText(NSMutableDictionary * content, NSString * key, NSString * text)
+{
+    if ([text length])
+        [content setObject:[NSString stringWithString:text] forKey:key];
+}
+
+//! Reads the scores and due times of a performance dictionary.
+static void GetPerformance(NSDictionary * performance, int * scores, GeniusTime * dueTimes)
+{
+    NSArray * scoreNumbers = [performance objectForKey:@"s"];
+    NSArray * dueNumbers = [performance objectForKey:@"d"];
+    int i;
+    for (i=0; i<2; i++)
+    {
+        scores[i] = ([scoreNumbers count] == 2 ? [[scoreNumbers objectAtIndex:i] intValue] : -1);
+        dueTimes[i] = ([dueNumbers count] == 2 ? [[dueNumbers objectAtIndex:i] longLongValue] : kGeniusTimeNone);
+    }
+}
+
+//! Makes a performance dictionary.
+static NSDictionary * PerformanceWithValues(const int * scores, const GeniusTime * dueTimes)
+{
+    NSArray * scoreNumbers = [NSArray arrayWithObjects:[NSNumber numberWithInt:scores[0]], [NSNumber numberWithInt:scores[1]], nil];
+    NSArray * dueNumbers = [NSArray arrayWithObjects:[NSNumber numberWithLongLong:dueTimes[0]], [NSNumber numberWithLongLong:dueTimes[1]], nil];
+    return [NSDictionary dictionaryWithObjectsAndKeys:scoreNumbers, @"s", dueNumbers, @"d", nil];
+}
+
+//! Sum of the edit counts in @a vector.
+static unsigned long long VectorSum(NSDictionary * vector)
+{
+    unsigned long long sum = 0;
+    NSEnumerator * countEnumerator = [vector objectEnumerator];
+    NSNumber * count;
+    while ((count = [countEnumerator nextObject]))
+        sum += [count unsignedIntValue];
+    return sum;
+}
+
+
+//! Identifier of this machine in version vectors, created on first use and kept in the user defaults.
+NSString * GeniusSyncReplicaID(void)
+{
+    NSUserDefaults * defaults = [NSUserDefaults standardUserDefaults];
+    NSString * replicaID = [defaults stringForKey:GeniusSyncReplicaIDKey];
+    if (replicaID == nil)
+    {
+        replicaID = [[NSProcessInfo processInfo] globallyUniqueString];
+        [defaults setObject:replicaID forKey:GeniusSyncReplicaIDKey];
+    }
+    return replicaID;
+}
+
+//! Compares two version vectors.  Missing replicas count as zero edits.
+GeniusVersionOrder GeniusCompareVersionVectors(NSDictionary * a, NSDictionary * b)
+{
+    BOOL aAhead = NO, bAhead = NO;
+    NSEnumerator * replicaEnumerator = [a keyEnumerator];
+    NSString * replicaID;
+    while ((replicaID = [replicaEnumerator nextObject]))
+    {
+        unsigned int aCount = [[a objectForKey:replicaID] unsignedIntValue];
+        unsigned int bCount = [[b objectForKey:replicaID] unsignedIntValue];
+        if (aCount > bCount)
+            aAhead = YES;
+        else if (aCount < bCount)
+            bAhead = YES;
+    }
+    replicaEnumerator = [b keyEnumerator];
+    while ((replicaID = [replicaEnumerator nextObject]))
+        if ([a objectForKey:replicaID] == nil && [[b objectForKey:replicaID] unsignedIntValue] > 0)
+            bAhead = YES;
+
+    if (aAhead && bAhead)
+        return GeniusVersionConcurrent;
+    if (aAhead)
+        return GeniusVersionAfter;
+    if (bAhead)
+        return GeniusVersionBefore;
+    return GeniusVersionEqual;
+}
+
+//! Returns the entry wise maximum of two version vectors, the vector of a merge of both versions.
+NSDictionary * GeniusMergeVersionVectors(NSDictionary * a, NSDictionary * b)
+{
+    NSMutableDictionary * merged = [NSMutableDictionary dictionaryWithDictionary:a];
+    NSEnumerator * replicaEnumerator = [b keyEnumerator];
+    NSString * replicaID;
+    while ((replicaID = [replicaEnumerator nextObject]))
+    {
+        NSNumber * count = [b objectForKey:replicaID];
+        if ([count unsignedIntValue] > [[merged objectForKey:replicaID] unsignedIntValue])
+            [merged setObject:count forKey:replicaID];
+    }
+    return merged;
+}
+
+//! Returns @a vector with one more edit by @a replicaID.  @a vector may be nil.
+NSDictionary * GeniusIncrementVersionVector(NSDictionary * vector, NSString * replicaID)
+{
+    NSMutableDictionary * incremented = [NSMutableDictionary dictionaryWithDictionary:vector];
+    unsigned int count = [[incremented objectForKey:replicaID] unsignedIntValue];
+    [incremented setObject:[NSNumber numberWithUnsignedInt:count + 1] forKey:replicaID];
+    return incremented;
+}
+
+//! Content part of a card for @a record.
+NSDictionary * GeniusSyncContentWithRecord(const GeniusPairRecord * record)
+{
+    NSMutableDictionary * content = [NSMutableDictionary dictionaryWithCapacity:6];
+    SetText(content, @"a", record->itemA);
+    SetText(content, @"b", record->itemB);
+    SetText(content, @"g", record->customGroup);
+    SetText(content, @"t", record->customType);
+    SetText(content, @"n", record->notes);
+    [content setObject:[NSNumber numberWithInt:record->importance] forKey:@"i"];
+    return content;
+}
+
+//! Performance part of a card for @a record.
+NSDictionary * GeniusSyncPerformanceWithRecord(const GeniusPairRecord * record)
+{
+    return PerformanceWithValues(record->scores, record->dueTimes);
+}
+
+//! Content part of a deleted card.
+NSDictionary * GeniusSyncDeletedContent(void)
+{
+    return [NSDictionary dictionaryWithObject:[NSNumber numberWithBool:YES] forKey:@"x"];
+}
+
+//! Same as GeniusSyncContentHash(GeniusSyncContentWithRecord(record)), without building the dictionary.
+long long GeniusSyncContentHashOfRecord(const GeniusPairRecord * record)
+{
+    return ContentHash(record->itemA, record->itemB, record->customGroup, record->customType, record->notes, record->importance, NO);
+}
+
+//! Same as GeniusSyncPerformanceHash(GeniusSyncPerformanceWithRecord(record)), without building the dictionary.
+long long GeniusSyncPerformanceHashOfRecord(const GeniusPairRecord * record)
+{
+    return PerformanceHash(record->scores, record->dueTimes);
+}
+
+//! Hash of a content part.
+long long GeniusSyncContentHash(NSDictionary * content)
+{
+    return ContentHash([content objectForKey:@"a"], [content objectForKey:@"b"], [content objectForKey:@"g"], [content objectForKey:@"t"],
+                       [content objectForKey:@"n"], [[content objectForKey:@"i"] intValue], [[content objectForKey:@"x"] boolValue]);
+}
+
+//! Hash of a performance part.
+long long GeniusSyncPerformanceHash(NSDictionary * performance)
+{
+    int scores[2];
+    GeniusTime dueTimes[2];
+    GetPerformance(performance, scores, dueTimes);
+    return PerformanceHash(scores, dueTimes);
+}
+
+//! Resolves two concurrent edits of the content of a card.  The result does not depend on argument order.
+/*!
+    An edit beats a deletion, so nothing typed on one machine is lost to a delete on another.  Otherwise the
+    version with more edits behind it wins, and between equally edited versions the larger content hash.
+ */
+NSDictionary * GeniusSyncMergeContent(NSDictionary * a, NSDictionary * aVector, NSDictionary * b, NSDictionary * bVector)
+{
+    BOOL aDeleted = [[a objectForKey:@"x"] boolValue];
+    BOOL bDeleted = [[b objectForKey:@"x"] boolValue];
+    if (aDeleted != bDeleted)
+        return (aDeleted ? b : a);
+
+    unsigned long long aSum = VectorSum(aVector);
+    unsigned long long bSum = VectorSum(bVector);
+    if (aSum != bSum)
+        return (aSum > bSum ? a : b);
+    return ((unsigned long long)GeniusSyncContentHash(a) >= (unsigned long long)GeniusSyncContentHash(b) ? a : b);
+}
+
+//! Resolves two concurrent changes of the performance of a card, one direction at a time.
+/*!
+    Keeps the later due time, which belongs to the machine where the association was studied further
+    ahead, and for equal due times the higher score.  The result does not depend on argument order.
+ */
+NSDictionary * GeniusSyncMergePerformance(NSDictionary * a, NSDictionary * b)
+{
+    int aScores[2], bScores[2], scores[2];
+    GeniusTime aDueTimes[2], bDueTimes[2], dueTimes[2];
+    GetPerformance(a, aScores, aDueTimes);
+    GetPerformance(b, bScores, bDueTimes);
+
+    int i;
+    for (i=0; i<2; i++)
+    {
+        BOOL takeA = (aDueTimes[i] != bDueTimes[i]) ? (aDueTimes[i] > bDueTimes[i]) : (aScores[i] >= bScores[i]);
+        scores[i] = (takeA ? aScores[i] : bScores[i]);
+        dueTimes[i] = (takeA ? aDueTimes[i] : bDueTimes[i]);
+    }
+    return PerformanceWithValues(scores, dueTimes);
+}
+
+//! Returns YES when the content part of @a card marks it deleted.
+BOOL GeniusSyncCardIsDeleted(NSDictionary * card)
+{
+    return [[[card objectForKey:@"c"] objectForKey:@"x"] boolValue];
+}
+
+//! Changes @a pair to match the parts present in @a card.  Values already equal are not set, keeping the undo stack short.
+void GeniusSyncApplyCardToPair(NSDictionary * card, GeniusPair * pair)
+{
+    NSDictionary * content = [card objectForKey:@"c"];
+    if (content && [[content objectForKey:@"x"] boolValue] == NO)
+    {
+        NSString * text = [content objectForKey:@"a"];
+        if ([[[pair itemA] stringValue] isEqualToString:(text ? text : @"")] == NO)
+            [[pair itemA] setValue:(text ? text : @"") forKey:@"stringValue"];
+        text = [content objectForKey:@"b"];
+        if ([[[pair itemB] stringValue] isEqualToString:(text ? text : @"")] == NO)
+            [[pair itemB] setValue:(text ? text : @"") forKey:@"stringValue"];
+        text = [content objectForKey:@"g"];
+        if ([[pair customGroupString] length] != [text length] || (text && [[pair customGroupString] isEqualToString:text] == NO))
+            [pair setValue:text forKey:@"customGroupString"];
+        text = [content objectForKey:@"t"];
+        if ([[pair customTypeString] length] != [text length] || (text && [[pair customTypeString] isEqualToString:text] == NO))
+            [pair setValue:text forKey:@"customTypeString"];
+        text = [content objectForKey:@"n"];
+        if ([[pair notesString] length] != [text length] || (text && [[pair notesString] isEqualToString:text] == NO))
+            [pair setValue:text forKey:@"notesString"];
+        int importance = [[content objectForKey:@"i"] intValue];
+        if ([pair importance] != importance)
+            [pair setImportance:importance];
+    }
+
+    NSDictionary * performance = [card objectForKey:@"p"];
+    if (performance)
+    {
+        int scores[2];
+        GeniusTime dueTimes[2];
+        GetPerformance(performance, scores, dueTimes);
+        GeniusAssociation * associations[2] = { [pair associationAB], [pair associationBA] };
+        int i;
+        for (i=0; i<2; i++)
+        {
+            if ([associations[i] score] != scores[i])
+            {
+                if (scores[i] < 0)
+                    [associations[i] setScoreNumber:nil];
+                else
+                    [associations[i] setScore:scores[i]];
+            }
+            if ([associations[i] dueTime] != dueTimes[i])
+            {
+                if (dueTimes[i] == kGeniusTimeNone)
+                    [associations[i] setDueDate:nil];
+                else
+                    [associations[i] setDueTime:dueTimes[i]];
+            }
+        }
+    }
+}
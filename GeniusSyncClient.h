@@ -0,0 +1,54 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import <Foundation/Foundation.h>
+
+#import "GeniusSync.h"
+
+//! One machine's side of syncing a deck with a GeniusSyncServer.
+/*!
+    For each card the client remembers the version vectors and the content and performance hashes it
+    last synced.  A sync hashes every record of a GeniusDeckSnapshot; a part whose hash changed was
+    edited here, so its vector gets one more edit by this replica and the part is pushed.  Cards that
+    left the deck are pushed as deleted.  Unchanged cards cost a hash and nothing on the wire.
+
+    The cards in the response are what the caller has to apply to the deck, see
+    GeniusSyncApplyCardToPair().  The state is kept in a file next to the deck, see
+    #statePathForDocumentPath:, and only changes when a sync succeeds.
+ */
+@interface GeniusSyncClient : NSObject {
+    NSString * _replicaID;              //!< This machine in version vectors.
+    NSString * _statePath;              //!< File holding the sync state, nil to keep it in memory only.
+    unsigned long long _sequence;       //!< Server sequence number as of the last sync.
+    NSMutableDictionary * _cards;       //!< Pair id as NSNumber -> dictionary of vectors @c cv, @c pv and hashes @c ch, @c ph as last synced.
+    unsigned int _bytesSent;            //!< Request size of the last sync.
+    unsigned int _bytesReceived;        //!< Response size of the last sync.
+    unsigned int _sentCount;            //!< Cards pushed by the last sync.
+}
+
++ (NSString *) statePathForDocumentPath:(NSString *)path;
+
+- (id) initWithReplicaID:(NSString *)replicaID statePath:(NSString *)statePath;
+
+- (NSArray *) syncSnapshot:(GeniusDeckSnapshot *)snapshot transport:(id <GeniusSyncTransport>)transport;
+
+- (unsigned long long) sequence;
+- (unsigned int) bytesSent;
+- (unsigned int) bytesReceived;
+- (unsigned int) sentCount;
+
+@end
@@ -0,0 +1,248 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import "GeniusSyncClient.h"
+
+@interface GeniusSyncClient (Private)
+- (NSArray *) _syncSnapshot:(GeniusDeckSnapshot *)snapshot transport:(id <GeniusSyncTransport>)transport;
+- (void) _readState;
+- (void) _writeState;
+@end
+
+
+@implementation GeniusSyncClient
+
+//! Returns the sync state file belonging to the deck at @a path, e.g. @c Foo.geniussync for @c Foo.genius.
++ (NSString *) statePathForDocumentPath:(NSString *)path
+{
+    return [[path stringByDeletingPathExtension] stringByAppendingPathExtension:@"geniussync"];
+}
+
+//! Designated initializer.  Reads the state at @a statePath unless it was written by another replica.
+- (id) initWithReplicaID:(NSString *)replicaID statePath:(NSString *)statePath
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _replicaID = [replicaID copy];
+        _statePath = [statePath copy];
+        _cards = [[NSMutableDictionary alloc] init];
+        [self _readState];
+    }
+    return self;
+}
+
+//! Releases the state and deallocates memory.
+- (void) dealloc
+{
+    [_replicaID release];
+    [_statePath release];
+    [_cards release];
+    [super dealloc];
+}
+
+//! Pushes the cards changed in @a snapshot through @a transport and returns the cards to apply to the deck.
+/*!
+    Returns nil when the server could not be reached, leaving the state as it was.
+*/
+- (NSArray *) syncSnapshot:(GeniusDeckSnapshot *)snapshot transport:(id <GeniusSyncTransport>)transport
+{
+    _bytesSent = _bytesReceived = _sentCount = 0;
+    return [self _syncSnapshot:snapshot transport:transport];
+}
+
+//! _sequence getter.
+- (unsigned long long) sequence
+{
+    return _sequence;
+}
+
+//! _bytesSent getter.
+- (unsigned int) bytesSent
+{
+    return _bytesSent;
+}
+
+//! _bytesReceived getter.
+- (unsigned int) bytesReceived
+{
+    return _bytesReceived;
+}
+
+//! _sentCount getter.
+- (unsigned int) sentCount
+{
+    return _sentCount;
+}
+
+@end
+
+
+@implementation GeniusSyncClient (Private)
+
+//! One request and response.  Starts over with a full sync when the server lost what the client saw.
+- (NSArray *) _syncSnapshot:(GeniusDeckSnapshot *)snapshot transport:(id <GeniusSyncTransport>)transport
+{
+    unsigned int count = [snapshot count];
+    NSMutableArray * outgoing = [NSMutableArray array];
+    NSMutableDictionary * pushedStates = [NSMutableDictionary dictionary];
+    NSMutableSet * livePairIDs = [NSMutableSet setWithCapacity:count];
+
+    unsigned int i;
+    for (i=0; i<count; i++)
+    {
+        const GeniusPairRecord * record = [snapshot recordAtIndex:i];
+        NSNumber * key = [NSNumber numberWithUnsignedLongLong:record->pairID];
+        [livePairIDs addObject:key];
+
+        NSDictionary * state = [_cards objectForKey:key];
+        long long contentHash = GeniusSyncContentHashOfRecord(record);
+        long long performanceHash = GeniusSyncPerformanceHashOfRecord(record);
+        BOOL contentChanged = (state == nil || contentHash != [[state objectForKey:@"ch"] longLongValue]);
+        BOOL performanceChanged = (state == nil || performanceHash != [[state objectForKey:@"ph"] longLongValue]);
+        if (contentChanged == NO && performanceChanged == NO)
+            continue;
+
+        NSMutableDictionary * card = [NSMutableDictionary dictionaryWithObject:key forKey:@"id"];
+        NSMutableDictionary * pushedState = [NSMutableDictionary dictionaryWithDictionary:state];
+        if (contentChanged)
+        {
+            NSDictionary * vector = GeniusIncrementVersionVector([state objectForKey:@"cv"], _replicaID);
+            [card setObject:GeniusSyncContentWithRecord(record) forKey:@"c"];
+            [card setObject:vector forKey:@"cv"];
+            [pushedState setObject:vector forKey:@"cv"];
+            [pushedState setObject:[NSNumber numberWithLongLong:contentHash] forKey:@"ch"];
+        }
+        if (performanceChanged)
+        {
+            NSDictionary * vector = GeniusIncrementVersionVector([state objectForKey:@"pv"], _replicaID);
+            [card setObject:GeniusSyncPerformanceWithRecord(record) forKey:@"p"];
+            [card setObject:vector forKey:@"pv"];
+            [pushedState setObject:vector forKey:@"pv"];
+            [pushedState setObject:[NSNumber numberWithLongLong:performanceHash] forKey:@"ph"];
+        }
+        [outgoing addObject:card];
+        [pushedStates setObject:pushedState forKey:key];
+    }
+
+    // Cards synced before but gone from the deck were deleted here.
+    long long deletedHash = GeniusSyncContentHash(GeniusSyncDeletedContent());
+    NSEnumerator * keyEnumerator = [_cards keyEnumerator];
+    NSNumber * key;
+    while ((key = [keyEnumerator nextObject]))
+    {
+        NSDictionary * state = [_cards objectForKey:key];
+        if ([livePairIDs containsObject:key] || [[state objectForKey:@"ch"] longLongValue] == deletedHash)
+            continue;
+
+        NSDictionary * vector = GeniusIncrementVersionVector([state objectForKey:@"cv"], _replicaID);
+        [outgoing addObject:[NSDictionary dictionaryWithObjectsAndKeys:key, @"id", GeniusSyncDeletedContent(), @"c", vector, @"cv", nil]];
+        NSMutableDictionary * pushedState = [NSMutableDictionary dictionaryWithDictionary:state];
+        [pushedState setObject:vector forKey:@"cv"];
+        [pushedState setObject:[NSNumber numberWithLongLong:deletedHash] forKey:@"ch"];
+        [pushedStates setObject:pushedState forKey:key];
+    }
+
+    NSDictionary * request = [NSDictionary dictionaryWithObjectsAndKeys:
+        _replicaID, @"replica", [NSNumber numberWithUnsignedLongLong:_sequence], @"since", outgoing, @"cards", nil];
+    NSData * requestData = [NSPropertyListSerialization dataFromPropertyList:request format:NSPropertyListBinaryFormat_v1_0 errorDescription:NULL];
+    NSData * responseData = [transport responseForRequest:requestData];
+    if (responseData == nil)
+        return nil;
+    _bytesSent += [requestData length];
+    _bytesReceived += [responseData length];
+    _sentCount += [outgoing count];
+
+    NSDictionary * response = [NSPropertyListSerialization propertyListFromData:responseData mutabilityOption:NSPropertyListImmutable format:NULL errorDescription:NULL];
+    if ([response isKindOfClass:[NSDictionary class]] == NO)
+        return nil;
+
+    unsigned long long sequence = [[response objectForKey:@"sequence"] unsignedLongLongValue];
+    if (sequence < _sequence)
+    {
+        [_cards removeAllObjects];
+        _sequence = 0;
+        return [self _syncSnapshot:snapshot transport:transport];
+    }
+
+    [_cards addEntriesFromDictionary:pushedStates];
+    NSArray * cards = [response objectForKey:@"cards"];
+    NSEnumerator * cardEnumerator = [cards objectEnumerator];
+    NSDictionary * card;
+    while ((card = [cardEnumerator nextObject]))
+    {
+        key = [card objectForKey:@"id"];
+        NSMutableDictionary * state = [NSMutableDictionary dictionaryWithDictionary:[_cards objectForKey:key]];
+        NSDictionary * content = [card objectForKey:@"c"];
+        if (content)
+        {
+            [state setObject:[card objectForKey:@"cv"] forKey:@"cv"];
+            [state setObject:[NSNumber numberWithLongLong:GeniusSyncContentHash(content)] forKey:@"ch"];
+        }
+        NSDictionary * performance = [card objectForKey:@"p"];
+        if (performance)
+        {
+            [state setObject:[card objectForKey:@"pv"] forKey:@"pv"];
+            [state setObject:[NSNumber numberWithLongLong:GeniusSyncPerformanceHash(performance)] forKey:@"ph"];
+        }
+        [_cards setObject:state forKey:key];
+    }
+    _sequence = sequence;
+    [self _writeState];
+    return cards;
+}
+
+//! Loads _sequence and _cards from _statePath.  State written by another replica, such as a copied file, is ignored.
+- (void) _readState
+{
+    NSData * data = (_statePath ? [NSData dataWithContentsOfFile:_statePath] : nil);
+    if (data == nil)
+        return;
+    NSDictionary * state = [NSPropertyListSerialization propertyListFromData:data mutabilityOption:NSPropertyListImmutable format:NULL errorDescription:NULL];
+    if ([state isKindOfClass:[NSDictionary class]] == NO || [[state objectForKey:@"replica"] isEqual:_replicaID] == NO)
+        return;
+
+    _sequence = [[state objectForKey:@"sequence"] unsignedLongLongValue];
+    NSEnumerator * entryEnumerator = [[state objectForKey:@"cards"] objectEnumerator];
+    NSDictionary * entry;
+    while ((entry = [entryEnumerator nextObject]))
+        [_cards setObject:entry forKey:[entry objectForKey:@"id"]];
+}
+
+//! Saves _sequence and _cards to _statePath.
+- (void) _writeState
+{
+    if (_statePath == nil)
+        return;
+
+    NSMutableArray * entries = [NSMutableArray arrayWithCapacity:[_cards count]];
+    NSEnumerator * keyEnumerator = [_cards keyEnumerator];
+    NSNumber * key;
+    while ((key = [keyEnumerator nextObject]))
+    {
+        NSMutableDictionary * entry = [NSMutableDictionary dictionaryWithDictionary:[_cards objectForKey:key]];
+        [entry setObject:key forKey:@"id"];
+        [entries addObject:entry];
+    }
+    NSDictionary * state = [NSDictionary dictionaryWithObjectsAndKeys:
+        _replicaID, @"replica", [NSNumber numberWithUnsignedLongLong:_sequence], @"sequence", entries, @"cards", nil];
+    NSData * data = [NSPropertyListSerialization dataFromPropertyList:state format:NSPropertyListBinaryFormat_v1_0 errorDescription:NULL];
+    if ([data writeToFile:_statePath atomically:YES] == NO)
+        NSLog(@"Could not write sync state to %@", _statePath);
+}
+
+@end
@@ -0,0 +1,62 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import <Foundation/Foundation.h>
+
+#import "GeniusSync.h"
+
+//! The sync server: holds the merged state of one deck and answers GeniusSyncClient requests.
+/*!
+    Every accepted change of a card part gets the next number of a server wide sequence.  A request
+    carries the parts a client changed since its last sync and the sequence number it saw then; the
+    response carries the sequence number now and every part changed after the client's number, except
+    those taken unchanged from the request.  Both directions therefore move only changed cards.
+
+    Parts are merged with their version vectors: a newer version replaces an older one, and concurrent
+    versions are resolved with GeniusSyncMergeContent() and GeniusSyncMergePerformance(), which pick the
+    same result whichever machine syncs first.
+
+    The server answers requests in process, which is what the tests use.  Given a path it loads its state
+    from that file and writes it back after each request that changed something, see GeniusSyncFileTransport.
+ */
+@interface GeniusSyncServer : NSObject <GeniusSyncTransport> {
+    NSString * _path;                   //!< File holding the server state, nil to keep it in memory only.
+    unsigned long long _sequence;       //!< Number of the latest accepted change.
+    NSMutableDictionary * _cards;       //!< Pair id as NSNumber -> NSMutableDictionary with the card and its change numbers @c cs and @c ps.
+}
+
+- (id) initWithPath:(NSString *)path;
+
+- (unsigned int) count;
+- (unsigned long long) sequence;
+- (NSDictionary *) cardWithPairID:(GeniusPairID)pairID;
+
+@end
+
+
+//! Stand-in for a network server: a GeniusSyncServer state file on a volume every machine can reach.
+/*!
+    Each request locks the file with an NSDistributedLock, runs a GeniusSyncServer on it and unlocks it,
+    so machines syncing at the same moment take turns.
+ */
+@interface GeniusSyncFileTransport : NSObject <GeniusSyncTransport> {
+    NSString * _path;                   //!< The server state file.
+}
+
+- (id) initWithPath:(NSString *)path;
+
+@end
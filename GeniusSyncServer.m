@@ -0,0 +1,293 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+#import "GeniusSyncServer.h"
+
+//! What GeniusSyncServer did with one part of a pushed card.
+typedef enum {
+    GeniusSyncPartIgnored = 0,      //!< Absent, or older than the server's version.
+    GeniusSyncPartKnown,            //!< Same version as the server's.
+    GeniusSyncPartAccepted,         //!< Newer than the server's version, stored as it came.
+    GeniusSyncPartMerged            //!< Concurrent with the server's version, merged.
+} GeniusSyncPartResult;
+
+//! Seconds to wait for the lock of a shared state file.
+static const NSTimeInterval kGeniusSyncLockTimeout = 10.0;
+
+//! Age after which the lock of a shared state file is taken to be left over by a machine that crashed.
+static const NSTimeInterval kGeniusSyncStaleLockAge = 120.0;
+
+
+@interface GeniusSyncServer (Private)
+- (GeniusSyncPartResult) _mergePart:(NSString *)valueKey vector:(NSString *)vectorKey sequence:(NSString *)sequenceKey ofCard:(NSDictionary *)card intoEntry:(NSMutableDictionary *)entry;
+- (BOOL) _writeToFile;
+@end
+
+
+@implementation GeniusSyncServer
+
+//! Loads the state saved at @a path, or starts empty when there is no file.  Returns nil when the file is unreadable.
+- (id) initWithPath:(NSString *)path
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _path = [path copy];
+        _cards = [[NSMutableDictionary alloc] init];
+
+        NSData * data = (path ? [NSData dataWithContentsOfFile:path] : nil);
+        if (data)
+        {
+            NSDictionary * state = [NSPropertyListSerialization propertyListFromData:data mutabilityOption:NSPropertyListImmutable format:NULL errorDescription:NULL];
+            if ([state isKindOfClass:[NSDictionary class]] == NO)
+            {
+                [self release];
+                return nil;
+            }
+            _sequence = [[state objectForKey:@"sequence"] unsignedLongLongValue];
+            NSEnumerator * entryEnumerator = [[state objectForKey:@"cards"] objectEnumerator];
+            NSDictionary * entry;
+            while ((entry = [entryEnumerator nextObject]))
+                [_cards setObject:[NSMutableDictionary dictionaryWithDictionary:entry] forKey:[entry objectForKey:@"id"]];
+        }
+        else if (path && [[NSFileManager defaultManager] fileExistsAtPath:path])
+        {
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+//! Initializes an empty server kept in memory.
+- (id) init
+{
+    return [self initWithPath:nil];
+}
+
+//! Releases the cards and deallocates memory.
+- (void) dealloc
+{
+    [_path release];
+    [_cards release];
+    [super dealloc];
+}
+
+//! Number of cards the server knows, including deleted ones.
+- (unsigned int) count
+{
+    return [_cards count];
+}
+
+//! _sequence getter.
+- (unsigned long long) sequence
+{
+    return _sequence;
+}
+
+//! The merged card with @a pairID, or nil.
+- (NSDictionary *) cardWithPairID:(GeniusPairID)pairID
+{
+    return [_cards objectForKey:[NSNumber numberWithUnsignedLongLong:pairID]];
+}
+
+//! Merges the cards pushed with @a requestData and answers with the cards the client has not seen.
+- (NSData *) responseForRequest:(NSData *)requestData
+{
+    NSDictionary * request = [NSPropertyListSerialization propertyListFromData:requestData mutabilityOption:NSPropertyListImmutable format:NULL errorDescription:NULL];
+    if ([request isKindOfClass:[NSDictionary class]] == NO)
+        return nil;
+
+    // A client ahead of the server saw state that has since been lost.  The response tells it to start over.
+    unsigned long long since = [[request objectForKey:@"since"] unsignedLongLongValue];
+    if (since > _sequence)
+        since = 0;
+
+    NSMutableSet * knownContent = [NSMutableSet set];
+    NSMutableSet * knownPerformance = [NSMutableSet set];
+    BOOL didChange = NO;
+    NSEnumerator * cardEnumerator = [[request objectForKey:@"cards"] objectEnumerator];
+    NSDictionary * card;
+    while ((card = [cardEnumerator nextObject]))
+    {
+        NSNumber * key = [card objectForKey:@"id"];
+        if (key == nil)
+            continue;
+        NSMutableDictionary * entry = [_cards objectForKey:key];
+        if (entry == nil)
+        {
+            entry = [NSMutableDictionary dictionaryWithObject:key forKey:@"id"];
+            [_cards setObject:entry forKey:key];
+        }
+
+        BOOL wasDeleted = [[[entry objectForKey:@"c"] objectForKey:@"x"] boolValue];
+        GeniusSyncPartResult result = [self _mergePart:@"c" vector:@"cv" sequence:@"cs" ofCard:card intoEntry:entry];
+        if (result == GeniusSyncPartKnown || result == GeniusSyncPartAccepted)
+            [knownContent addObject:key];
+        didChange |= (result >= GeniusSyncPartAccepted);
+
+        // Machines that deleted a card brought back by an edit need its performance again too:  those that
+        // synced the deletion before the edit arrived, and the one whose deletion the edit just overrode.
+        BOOL pushedDeletion = [[[card objectForKey:@"c"] objectForKey:@"x"] boolValue];
+        if ((wasDeleted || pushedDeletion) && result >= GeniusSyncPartAccepted && [[[entry objectForKey:@"c"] objectForKey:@"x"] boolValue] == NO && [entry objectForKey:@"p"])
+            [entry setObject:[NSNumber numberWithUnsignedLongLong:++_sequence] forKey:@"ps"];
+
+        result = [self _mergePart:@"p" vector:@"pv" sequence:@"ps" ofCard:card intoEntry:entry];
+        if (result == GeniusSyncPartKnown || result == GeniusSyncPartAccepted)
+            [knownPerformance addObject:key];
+        didChange |= (result >= GeniusSyncPartAccepted);
+
+        if ([entry objectForKey:@"c"] == nil && [entry objectForKey:@"p"] == nil)
+            [_cards removeObjectForKey:key];
+    }
+
+    NSMutableArray * cards = [NSMutableArray array];
+    NSEnumerator * entryEnumerator = [_cards objectEnumerator];
+    NSDictionary * entry;
+    while ((entry = [entryEnumerator nextObject]))
+    {
+        NSNumber * key = [entry objectForKey:@"id"];
+        BOOL sendContent = [[entry objectForKey:@"cs"] unsignedLongLongValue] > since && [knownContent containsObject:key] == NO;
+        BOOL sendPerformance = [[entry objectForKey:@"ps"] unsignedLongLongValue] > since && [knownPerformance containsObject:key] == NO;
+        if (sendContent == NO && sendPerformance == NO)
+            continue;
+
+        NSMutableDictionary * outgoing = [NSMutableDictionary dictionaryWithObject:key forKey:@"id"];
+        if (sendContent)
+        {
+            [outgoing setObject:[entry objectForKey:@"c"] forKey:@"c"];
+            [outgoing setObject:[entry objectForKey:@"cv"] forKey:@"cv"];
+        }
+        if (sendPerformance)
+        {
+            [outgoing setObject:[entry objectForKey:@"p"] forKey:@"p"];
+            [outgoing setObject:[entry objectForKey:@"pv"] forKey:@"pv"];
+        }
+        [cards addObject:outgoing];
+    }
+
+    if (didChange && _path && [self _writeToFile] == NO)
+        return nil;
+
+    NSDictionary * response = [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedLongLong:_sequence], @"sequence", cards, @"cards", nil];
+    return [NSPropertyListSerialization dataFromPropertyList:response format:NSPropertyListBinaryFormat_v1_0 errorDescription:NULL];
+}
+
+@end
+
+
+@implementation GeniusSyncServer (Private)
+
+//! Merges the part of @a card under @a valueKey into @a entry, numbering the change when the entry changes.
+- (GeniusSyncPartResult) _mergePart:(NSString *)valueKey vector:(NSString *)vectorKey sequence:(NSString *)sequenceKey ofCard:(NSDictionary *)card intoEntry:(NSMutableDictionary *)entry
+{
+    NSDictionary * value = [card objectForKey:valueKey];
+    NSDictionary * vector = [card objectForKey:vectorKey];
+    if (value == nil || vector == nil)
+        return GeniusSyncPartIgnored;
+
+    GeniusSyncPartResult result = GeniusSyncPartAccepted;
+    NSDictionary * currentValue = [entry objectForKey:valueKey];
+    if (currentValue)
+    {
+        NSDictionary * currentVector = [entry objectForKey:vectorKey];
+        switch (GeniusCompareVersionVectors(vector, currentVector))
+        {
+            case GeniusVersionEqual:
+                return GeniusSyncPartKnown;
+            case GeniusVersionBefore:
+                return GeniusSyncPartIgnored;
+            case GeniusVersionAfter:
+                break;
+            case GeniusVersionConcurrent:
+                if ([valueKey isEqualToString:@"c"])
+                    value = GeniusSyncMergeContent(value, vector, currentValue, currentVector);
+                else
+                    value = GeniusSyncMergePerformance(value, currentValue);
+                vector = GeniusMergeVersionVectors(vector, currentVector);
+                result = GeniusSyncPartMerged;
+                break;
+        }
+    }
+
+    [entry setObject:value forKey:valueKey];
+    [entry setObject:vector forKey:vectorKey];
+    [entry setObject:[NSNumber numberWithUnsignedLongLong:++_sequence] forKey:sequenceKey];
+    return result;
+}
+
+//! Saves the state to _path atomically.
+- (BOOL) _writeToFile
+{
+    NSDictionary * state = [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedLongLong:_sequence], @"sequence", [_cards allValues], @"cards", nil];
+    NSData * data = [NSPropertyListSerialization dataFromPropertyList:state format:NSPropertyListBinaryFormat_v1_0 errorDescription:NULL];
+    return [data writeToFile:_path atomically:YES];
+}
+
+@end
+
+
+@implementation GeniusSyncFileTransport
+
+//! Designated initializer.  @a path need not exist yet; the first sync creates it.
+- (id) initWithPath:(NSString *)path
+{
+    self = [super init];
+    if (self != nil) {
+        _path = [path copy];
+    }
+    return self;
+}
+
+//! Releases the path and deallocates memory.
+- (void) dealloc
+{
+    [_path release];
+    [super dealloc];
+}
+
+//! Runs a GeniusSyncServer on the state file while holding its lock.  Returns nil when the lock or file is unavailable.
+- (NSData *) responseForRequest:(NSData *)request
+{
+    NSDistributedLock * lock = [NSDistributedLock lockWithPath:[_path stringByAppendingPathExtension:@"lock"]];
+    if (lock == nil)
+        return nil;
+
+    NSDate * deadline = [NSDate dateWithTimeIntervalSinceNow:kGeniusSyncLockTimeout];
+    while ([lock tryLock] == NO)
+    {
+        if ([deadline timeIntervalSinceNow] < 0.0)
+        {
+            NSDate * lockDate = [lock lockDate];
+            if (lockDate == nil || [lockDate timeIntervalSinceNow] > -kGeniusSyncStaleLockAge)
+                return nil;
+            [lock breakLock];
+            deadline = [NSDate dateWithTimeIntervalSinceNow:kGeniusSyncLockTimeout];
+        }
+        [NSThread sleepUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    }
+
+    GeniusSyncServer * server = [[GeniusSyncServer alloc] initWithPath:_path];
+    NSData * response = [server responseForRequest:request];
+    [server release];
+    [lock unlock];
+    return response;
+}
+
+@end
@@ -0,0 +1,255 @@
+//
+//  GeniusSyncTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusSyncClient.h"
+#import "GeniusSyncServer.h"
+#import "GeniusDeckSnapshot.h"
+#import "GeniusItem.h"
+
+@interface GeniusSyncTest : SenTestCase {
+    GeniusSyncServer *server;       //!< In memory server both machines sync with.
+    GeniusSyncClient *clientA;      //!< Sync state of the first machine.
+    GeniusSyncClient *clientB;      //!< Sync state of the second machine.
+    NSMutableArray *pairsA;         //!< The deck on the first machine.
+    NSMutableArray *pairsB;         //!< The deck on the second machine.
+}
+
+@end
+
+//! Tests for GeniusSyncClient and GeniusSyncServer with two machines syncing one deck.
+@implementation GeniusSyncTest
+
+//! Returns a new pair with @a question and @a answer.
++ (GeniusPair *) _pairWithQuestion:(NSString *)question answer:(NSString *)answer
+{
+    GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+    [[pair itemA] setValue:question forKey:@"stringValue"];
+    [[pair itemB] setValue:answer forKey:@"stringValue"];
+    return pair;
+}
+
+//! Returns the pair in @a pairs with @a pairID, or nil.
++ (GeniusPair *) _pairWithID:(GeniusPairID)pairID inPairs:(NSArray *)pairs
+{
+    NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+        if ([pair pairID] == pairID)
+            return pair;
+    return nil;
+}
+
+//! Syncs @a pairs through @a client and applies the response the way GeniusDocument does.
+- (void) _syncClient:(GeniusSyncClient *)client pairs:(NSMutableArray *)pairs
+{
+    GeniusDeckStore * store = [[[GeniusDeckStore alloc] initWithPairs:pairs] autorelease];
+    NSArray * cards = [client syncSnapshot:[store snapshot] transport:server];
+    STAssertNotNil(cards, nil);
+
+    NSEnumerator * cardEnumerator = [cards objectEnumerator];
+    NSDictionary * card;
+    while ((card = [cardEnumerator nextObject]))
+    {
+        GeniusPairID pairID = [[card objectForKey:@"id"] unsignedLongLongValue];
+        GeniusPair * pair = [GeniusSyncTest _pairWithID:pairID inPairs:pairs];
+        if (GeniusSyncCardIsDeleted(card))
+        {
+            if (pair)
+                [pairs removeObject:pair];
+        }
+        else if (pair)
+            GeniusSyncApplyCardToPair(card, pair);
+        else if ([card objectForKey:@"c"])
+        {
+            pair = [[[GeniusPair alloc] initWithItemA:[[[GeniusItem alloc] init] autorelease] itemB:[[[GeniusItem alloc] init] autorelease]
+                                             userDict:[NSMutableDictionary dictionary] pairID:pairID] autorelease];
+            GeniusSyncApplyCardToPair(card, pair);
+            [pairs addObject:pair];
+        }
+    }
+}
+
+//! Starts each test with three cards on the first machine, synced to the second.
+- (void) setUp
+{
+    server = [[GeniusSyncServer alloc] initWithPath:nil];
+    clientA = [[GeniusSyncClient alloc] initWithReplicaID:@"A" statePath:nil];
+    clientB = [[GeniusSyncClient alloc] initWithReplicaID:@"B" statePath:nil];
+    pairsA = [[NSMutableArray alloc] init];
+    pairsB = [[NSMutableArray alloc] init];
+
+    [pairsA addObject:[GeniusSyncTest _pairWithQuestion:@"dog" answer:@"Hund"]];
+    [pairsA addObject:[GeniusSyncTest _pairWithQuestion:@"cat" answer:@"Katze"]];
+    [pairsA addObject:[GeniusSyncTest _pairWithQuestion:@"bird" answer:@"Vogel"]];
+    [self _syncClient:clientA pairs:pairsA];
+    [self _syncClient:clientB pairs:pairsB];
+}
+
+//! Releases both machines and the server.
+- (void) tearDown
+{
+    [server release];
+    server = nil;
+    [clientA release];
+    clientA = nil;
+    [clientB release];
+    clientB = nil;
+    [pairsA release];
+    pairsA = nil;
+    [pairsB release];
+    pairsB = nil;
+}
+
+//! Version vectors order edits by what each replica has seen.
+- (void) testVersionVectors
+{
+    NSDictionary * a1 = GeniusIncrementVersionVector(nil, @"A");
+    NSDictionary * a2 = GeniusIncrementVersionVector(a1, @"A");
+    NSDictionary * a1b1 = GeniusIncrementVersionVector(a1, @"B");
+
+    STAssertEquals(GeniusCompareVersionVectors(a1, a1), GeniusVersionEqual, nil);
+    STAssertEquals(GeniusCompareVersionVectors(a1, a2), GeniusVersionBefore, nil);
+    STAssertEquals(GeniusCompareVersionVectors(a1b1, a1), GeniusVersionAfter, nil);
+    STAssertEquals(GeniusCompareVersionVectors(a2, a1b1), GeniusVersionConcurrent, nil);
+
+    NSDictionary * merged = GeniusMergeVersionVectors(a2, a1b1);
+    STAssertEquals(GeniusCompareVersionVectors(merged, a2), GeniusVersionAfter, nil);
+    STAssertEquals(GeniusCompareVersionVectors(merged, a1b1), GeniusVersionAfter, nil);
+}
+
+//! The second machine gets the whole deck, after which unchanged cards cost nothing.
+- (void) testInitialSyncAndDelta
+{
+    STAssertEquals([pairsB count], 3U, nil);
+    GeniusPair * pair = [GeniusSyncTest _pairWithID:[[pairsA objectAtIndex:1] pairID] inPairs:pairsB];
+    STAssertEqualObjects([[pair itemB] stringValue], @"Katze", nil);
+
+    [self _syncClient:clientB pairs:pairsB];
+    STAssertEquals([clientB sentCount], 0U, nil);
+
+    [[[pairsA objectAtIndex:2] associationAB] setScore:1];
+    [self _syncClient:clientA pairs:pairsA];
+    STAssertEquals([clientA sentCount], 1U, nil);
+    [self _syncClient:clientB pairs:pairsB];
+    STAssertEquals([clientB sentCount], 0U, nil);
+    pair = [GeniusSyncTest _pairWithID:[[pairsA objectAtIndex:2] pairID] inPairs:pairsB];
+    STAssertEquals([[pair associationAB] score], 1, nil);
+}
+
+//! Editing a card on one machine and studying it on the other keeps both changes.
+- (void) testEditAndStudyDoNotConflict
+{
+    GeniusPair * pairA = [pairsA objectAtIndex:0];
+    GeniusPair * pairB = [GeniusSyncTest _pairWithID:[pairA pairID] inPairs:pairsB];
+    [[pairA itemB] setValue:@"der Hund" forKey:@"stringValue"];
+    [[pairB associationAB] setScore:3];
+    [[pairB associationAB] setDueTime:1200000000LL];
+
+    [self _syncClient:clientA pairs:pairsA];
+    [self _syncClient:clientB pairs:pairsB];
+    [self _syncClient:clientA pairs:pairsA];
+
+    STAssertEqualObjects([[pairB itemB] stringValue], @"der Hund", nil);
+    STAssertEquals([[pairA associationAB] score], 3, nil);
+    STAssertEquals([[pairA associationAB] dueTime], 1200000000LL, nil);
+}
+
+//! Conflicting edits end the same on both machines whichever syncs first, and the later due date wins.
+- (void) testConcurrentChangesMergeDeterministically
+{
+    GeniusPair * pairA = [pairsA objectAtIndex:1];
+    GeniusPair * pairB = [GeniusSyncTest _pairWithID:[pairA pairID] inPairs:pairsB];
+    [[pairA itemB] setValue:@"die Katze" forKey:@"stringValue"];
+    [[pairB itemB] setValue:@"Kater" forKey:@"stringValue"];
+    [[pairA associationAB] setScore:2];
+    [[pairA associationAB] setDueTime:1200000500LL];
+    [[pairB associationAB] setScore:0];
+    [[pairB associationAB] setDueTime:1200000100LL];
+
+    NSDictionary * contentA = GeniusSyncContentWithRecord([[[[[GeniusDeckStore alloc] initWithPairs:[NSArray arrayWithObject:pairA]] autorelease] snapshot] recordAtIndex:0]);
+    NSDictionary * contentB = GeniusSyncContentWithRecord([[[[[GeniusDeckStore alloc] initWithPairs:[NSArray arrayWithObject:pairB]] autorelease] snapshot] recordAtIndex:0]);
+    NSDictionary * vectorA = GeniusIncrementVersionVector(GeniusIncrementVersionVector(nil, @"A"), @"A");
+    NSDictionary * vectorB = GeniusIncrementVersionVector(GeniusIncrementVersionVector(nil, @"A"), @"B");
+    STAssertEqualObjects(GeniusSyncMergeContent(contentA, vectorA, contentB, vectorB), GeniusSyncMergeContent(contentB, vectorB, contentA, vectorA), nil);
+
+    [self _syncClient:clientB pairs:pairsB];
+    [self _syncClient:clientA pairs:pairsA];
+    [self _syncClient:clientB pairs:pairsB];
+
+    STAssertEqualObjects([[pairA itemB] stringValue], [[pairB itemB] stringValue], nil);
+    STAssertEqualObjects([[pairA itemB] stringValue], [GeniusSyncMergeContent(contentA, vectorA, contentB, vectorB) objectForKey:@"b"], nil);
+    STAssertEquals([[pairA associationAB] dueTime], 1200000500LL, nil);
+    STAssertEquals([[pairB associationAB] dueTime], 1200000500LL, nil);
+    STAssertEquals([[pairB associationAB] score], 2, nil);
+}
+
+//! Deleting a card removes it everywhere, unless another machine edited it meanwhile.
+/*! The edit wins whether it reaches the server before or after the deletion, and the card keeps its scores. */
+- (void) testDeletion
+{
+    GeniusPair * deleted = [pairsA objectAtIndex:0];
+    GeniusPair * studied = [pairsA objectAtIndex:1];
+    GeniusPair * kept = [pairsA objectAtIndex:2];
+    [[studied associationAB] setScore:3];
+    [[studied associationAB] setDueTime:1200000000LL];
+    [self _syncClient:clientA pairs:pairsA];
+    [self _syncClient:clientB pairs:pairsB];
+
+    // The edit of studied reaches the server first, the edit of kept after the deletion.
+    [[GeniusSyncTest _pairWithID:[studied pairID] inPairs:pairsB] setNotesString:@"purrs"];
+    [self _syncClient:clientB pairs:pairsB];
+    [[GeniusSyncTest _pairWithID:[kept pairID] inPairs:pairsB] setNotesString:@"flies"];
+    [pairsA removeObject:deleted];
+    [pairsA removeObject:studied];
+    [pairsA removeObject:kept];
+
+    [self _syncClient:clientA pairs:pairsA];
+    [self _syncClient:clientB pairs:pairsB];
+    [self _syncClient:clientA pairs:pairsA];
+    [self _syncClient:clientB pairs:pairsB];
+
+    STAssertNil([GeniusSyncTest _pairWithID:[deleted pairID] inPairs:pairsB], nil);
+    STAssertEquals([pairsA count], 2U, nil);
+    STAssertEquals([pairsB count], 2U, nil);
+    STAssertEqualObjects([[GeniusSyncTest _pairWithID:[kept pairID] inPairs:pairsA] notesString], @"flies", nil);
+
+    GeniusPair * revived = [GeniusSyncTest _pairWithID:[studied pairID] inPairs:pairsA];
+    STAssertEqualObjects([revived notesString], @"purrs", nil);
+    STAssertEquals([[revived associationAB] score], 3, @"performance comes back with the overriding edit");
+    STAssertEquals([[revived associationAB] dueTime], 1200000000LL, nil);
+    GeniusPair * pairB = [GeniusSyncTest _pairWithID:[studied pairID] inPairs:pairsB];
+    STAssertEquals([[pairB associationAB] score], 3, @"not wiped by the revived copy");
+    STAssertEquals([[pairB associationAB] dueTime], 1200000000LL, nil);
+}
+
+//! A client whose server lost its state pushes the whole deck again.
+- (void) testServerReset
+{
+    [server release];
+    server = [[GeniusSyncServer alloc] initWithPath:nil];
+    [self _syncClient:clientA pairs:pairsA];
+    STAssertEquals([server count], 3U, nil);
+}
+
+//! The file transport keeps the server state between requests.
+- (void) testFileTransport
+{
+    NSString * path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]];
+    GeniusSyncFileTransport * transport = [[[GeniusSyncFileTransport alloc] initWithPath:path] autorelease];
+    GeniusDeckStore * store = [[[GeniusDeckStore alloc] initWithPairs:pairsA] autorelease];
+    GeniusSyncClient * client = [[[GeniusSyncClient alloc] initWithReplicaID:@"C" statePath:nil] autorelease];
+    STAssertNotNil([client syncSnapshot:[store snapshot] transport:transport], nil);
+
+    GeniusSyncServer * fileServer = [[[GeniusSyncServer alloc] initWithPath:path] autorelease];
+    STAssertEquals([fileServer count], 3U, nil);
+    STAssertEqualObjects([[[fileServer cardWithPairID:[[pairsA objectAtIndex:0] pairID]] objectForKey:@"c"] objectForKey:@"a"], @"dog", nil);
+    [[NSFileManager defaultManager] removeFileAtPath:path handler:nil];
+}
+
+@end
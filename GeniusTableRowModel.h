@@ -0,0 +1,74 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+//! Status glyph shown in the score columns.
+typedef enum {
+    GeniusStatusTierNew = 0,        //!< Never quizzed, red.
+    GeniusStatusTierLearning,       //!< Score below 5, yellow.
+    GeniusStatusTierLearned,        //!< Score 5 and up, green.
+    GeniusStatusTierCount
+} GeniusStatusTier;
+
+GeniusStatusTier GeniusStatusTierForScoreNumber(NSNumber * scoreNumber);
+
+//! Row cache sitting between GSTableView and the arranged GeniusPair items.
+/*!
+    Each table column registers the key paths it used to bind to @c arrangedObjects, one per binding name
+    such as @c value or @c textColor, with an optional NSValueTransformer.  Values are only computed for
+    rows the table actually asks for, then kept until the row scrolls out of #setVisibleRange: or the
+    model changes.  The cache never holds much more than a screenful of rows, however large the deck.
+
+    The model does not observe anything itself; its owner calls #setArrangedObjects: and
+    #invalidateAllRows when the controller or the pairs change.  It only uses Foundation so that it
+    can be exercised without a window.
+ */
+@interface GeniusTableRowModel : NSObject {
+    NSArray * _arrangedObjects;             //!< The arranged GeniusPair items, not copied.
+    CFMutableDictionaryRef _columnSlots;    //!< Column identifier -> CFMutableDictionary of binding name -> slot + 1.
+    NSMutableArray * _slotKeyPaths;         //!< Key path relative to a pair for each slot.
+    NSMutableArray * _slotTransformers;     //!< NSValueTransformer or NSNull for each slot.
+    CFMutableDictionaryRef _rows;           //!< Row number + 1 -> NSArray of slot values.
+    NSRange _visibleRange;                  //!< Rows the table currently shows.
+    unsigned int _materializedRowCount;     //!< Rows computed since creation, for measurements.
+}
+
+- (id) initWithArrangedObjects:(NSArray *)arrangedObjects;
+
+- (void) setKeyPath:(NSString *)keyPath transformerName:(NSString *)transformerName forBinding:(NSString *)binding column:(NSString *)identifier;
+- (NSString *) keyPathForBinding:(NSString *)binding column:(NSString *)identifier;
+
+- (NSArray *) arrangedObjects;
+- (void) setArrangedObjects:(NSArray *)arrangedObjects;
+- (unsigned int) count;
+- (id) objectAtRow:(unsigned int)row;
+
+- (id) valueForBinding:(NSString *)binding column:(NSString *)identifier row:(unsigned int)row;
+- (void) setValue:(id)value forBinding:(NSString *)binding column:(NSString *)identifier row:(unsigned int)row;
+- (GeniusStatusTier) statusTierForColumn:(NSString *)identifier row:(unsigned int)row;
+
+- (NSRange) visibleRange;
+- (void) setVisibleRange:(NSRange)range;
+- (void) invalidateAllRows;
+
+- (unsigned int) cachedRowCount;
+- (unsigned long long) cachedByteCount;
+- (unsigned int) materializedRowCount;
+
+@end
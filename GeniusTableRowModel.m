@@ -0,0 +1,289 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusTableRowModel.h"
+#import "GeniusMemoryReport.h"
+
+//! Rows kept beyond the visible range in each direction, so small scrolls hit the cache.
+#define kGeniusTableRowModelMargin 16
+
+//! Upper bound on cached rows when no visible range is known.
+#define kGeniusTableRowModelMaximumRows 512
+
+//! Maps a score to the status glyph tier.  A nil @a scoreNumber means never quizzed.
+GeniusStatusTier GeniusStatusTierForScoreNumber(NSNumber * scoreNumber)
+{
+    if (scoreNumber == nil || [scoreNumber intValue] == -1)
+        return GeniusStatusTierNew;
+    if ([scoreNumber intValue] < 5)
+        return GeniusStatusTierLearning;
+    return GeniusStatusTierLearned;
+}
+
+//! CFDictionaryApplyFunction callback adding the size of a row's value array to the unsigned long long at @a context.
+static void AddRowSize(const void * row, const void * values, void * context)
+{
+    *(unsigned long long *)context += GeniusMemorySizeOfCollection((id)values);
+}
+
+
+@interface GeniusTableRowModel (Private)
+- (unsigned int) _slotForBinding:(NSString *)binding column:(NSString *)identifier;
+- (NSArray *) _slotValuesForRow:(unsigned int)row;
+- (void) _evictRowsOutsideRange:(NSRange)range;
+@end
+
+@implementation GeniusTableRowModel
+
+//! Designated initializer.  @a arrangedObjects may be nil.
+- (id) initWithArrangedObjects:(NSArray *)arrangedObjects
+{
+    self = [super init];
+    if (self != nil) {
+        _arrangedObjects = [arrangedObjects retain];
+        _columnSlots = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        _slotKeyPaths = [[NSMutableArray alloc] init];
+        _slotTransformers = [[NSMutableArray alloc] init];
+        _rows = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+        _visibleRange = NSMakeRange(0, 0);
+        _materializedRowCount = 0;
+    }
+    return self;
+}
+
+//! Initializes an empty row model.
+- (id) init
+{
+    return [self initWithArrangedObjects:nil];
+}
+
+//! Releases the arranged objects, slot tables and cached rows.
+- (void) dealloc
+{
+    [_arrangedObjects release];
+    CFRelease(_columnSlots);
+    [_slotKeyPaths release];
+    [_slotTransformers release];
+    CFRelease(_rows);
+    [super dealloc];
+}
+
+//! Registers the value shown by @a binding of column @a identifier as @a keyPath of the row's pair.
+/*! @a transformerName names a registered NSValueTransformer applied to the value, or is nil. */
+- (void) setKeyPath:(NSString *)keyPath transformerName:(NSString *)transformerName forBinding:(NSString *)binding column:(NSString *)identifier
+{
+    id transformer = nil;
+    if (transformerName)
+        transformer = [NSValueTransformer valueTransformerForName:transformerName];
+    if (transformer == nil)
+        transformer = [NSNull null];
+
+    unsigned int slot = [self _slotForBinding:binding column:identifier];
+    if (slot == NSNotFound)
+    {
+        CFMutableDictionaryRef bindingSlots = (CFMutableDictionaryRef)CFDictionaryGetValue(_columnSlots, identifier);
+        if (bindingSlots == NULL)
+        {
+            bindingSlots = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+            CFDictionarySetValue(_columnSlots, identifier, bindingSlots);
+            CFRelease(bindingSlots);
+        }
+        CFDictionarySetValue(bindingSlots, binding, (const void *)(uintptr_t)([_slotKeyPaths count] + 1));
+        [_slotKeyPaths addObject:keyPath];
+        [_slotTransformers addObject:transformer];
+    }
+    else
+    {
+        [_slotKeyPaths replaceObjectAtIndex:slot withObject:keyPath];
+        [_slotTransformers replaceObjectAtIndex:slot withObject:transformer];
+    }
+    [self invalidateAllRows];
+}
+
+//! Key path registered for @a binding of column @a identifier, or nil.
+- (NSString *) keyPathForBinding:(NSString *)binding column:(NSString *)identifier
+{
+    unsigned int slot = [self _slotForBinding:binding column:identifier];
+    if (slot == NSNotFound)
+        return nil;
+    return [_slotKeyPaths objectAtIndex:slot];
+}
+
+//! _arrangedObjects getter.
+- (NSArray *) arrangedObjects
+{
+    return _arrangedObjects;
+}
+
+//! Replaces the arranged objects and drops all cached rows.
+- (void) setArrangedObjects:(NSArray *)arrangedObjects
+{
+    [arrangedObjects retain];
+    [_arrangedObjects release];
+    _arrangedObjects = arrangedObjects;
+    [self invalidateAllRows];
+}
+
+//! Number of rows.
+- (unsigned int) count
+{
+    return [_arrangedObjects count];
+}
+
+//! The pair shown in @a row.
+- (id) objectAtRow:(unsigned int)row
+{
+    return [_arrangedObjects objectAtIndex:row];
+}
+
+//! Value of @a binding in column @a identifier for @a row, materializing the row if needed.
+/*! Returns nil for unregistered bindings and for nil model values. */
+- (id) valueForBinding:(NSString *)binding column:(NSString *)identifier row:(unsigned int)row
+{
+    unsigned int slot = [self _slotForBinding:binding column:identifier];
+    if (slot == NSNotFound || row >= [_arrangedObjects count])
+        return nil;
+
+    id value = [[self _slotValuesForRow:row] objectAtIndex:slot];
+    return (value == [NSNull null]) ? nil : value;
+}
+
+//! Writes an edited @a value of @a binding in column @a identifier back to the pair of @a row.
+/*!
+    The value goes through the reverse of the slot's transformer when it has one, as the binding did,
+    so a checkbox bound through @c NSNegateBoolean stores what the user clicked.  Drops the cached row.
+ */
+- (void) setValue:(id)value forBinding:(NSString *)binding column:(NSString *)identifier row:(unsigned int)row
+{
+    unsigned int slot = [self _slotForBinding:binding column:identifier];
+    if (slot == NSNotFound || row >= [_arrangedObjects count])
+        return;
+
+    id transformer = [_slotTransformers objectAtIndex:slot];
+    if (transformer != [NSNull null] && [[transformer class] allowsReverseTransformation])
+        value = [transformer reverseTransformedValue:value];
+    [[_arrangedObjects objectAtIndex:row] setValue:value forKeyPath:[_slotKeyPaths objectAtIndex:slot]];
+    CFDictionaryRemoveValue(_rows, (const void *)(uintptr_t)(row + 1));
+}
+
+//! Status glyph tier of the score shown in column @a identifier for @a row.
+- (GeniusStatusTier) statusTierForColumn:(NSString *)identifier row:(unsigned int)row
+{
+    return GeniusStatusTierForScoreNumber([self valueForBinding:@"value" column:identifier row:row]);
+}
+
+//! _visibleRange getter.
+- (NSRange) visibleRange
+{
+    return _visibleRange;
+}
+
+//! Records the rows on screen and evicts cached rows well outside them.
+- (void) setVisibleRange:(NSRange)range
+{
+    _visibleRange = range;
+
+    unsigned int location = (range.location > kGeniusTableRowModelMargin) ? range.location - kGeniusTableRowModelMargin : 0;
+    [self _evictRowsOutsideRange:NSMakeRange(location, NSMaxRange(range) + kGeniusTableRowModelMargin - location)];
+}
+
+//! Drops all cached rows, e.g. after a pair was edited.  Cheap since only visible rows are cached.
+- (void) invalidateAllRows
+{
+    CFDictionaryRemoveAllValues(_rows);
+}
+
+//! Number of rows currently cached.
+- (unsigned int) cachedRowCount
+{
+    return CFDictionaryGetCount(_rows);
+}
+
+//! Estimated bytes of the cached rows:  the row table and the value arrays, not the values, which are mostly model strings.
+- (unsigned long long) cachedByteCount
+{
+    unsigned long long total = GeniusMemorySizeOfCollection((id)_rows);
+    CFDictionaryApplyFunction(_rows, AddRowSize, &total);
+    return total;
+}
+
+//! _materializedRowCount getter.
+- (unsigned int) materializedRowCount
+{
+    return _materializedRowCount;
+}
+
+@end
+
+
+@implementation GeniusTableRowModel (Private)
+
+//! Slot registered for @a binding of column @a identifier, or NSNotFound.  Two hash lookups, nothing allocated.
+- (unsigned int) _slotForBinding:(NSString *)binding column:(NSString *)identifier
+{
+    CFDictionaryRef bindingSlots = (identifier ? CFDictionaryGetValue(_columnSlots, identifier) : NULL);
+    uintptr_t slot = (bindingSlots && binding ? (uintptr_t)CFDictionaryGetValue(bindingSlots, binding) : 0);
+    return (slot ? slot - 1 : NSNotFound);
+}
+
+//! Returns the cached values of @a row, computing every slot the first time the row is asked for.
+- (NSArray *) _slotValuesForRow:(unsigned int)row
+{
+    const void * key = (const void *)(uintptr_t)(row + 1);    // keep 0 out of the key space
+    NSArray * values = (NSArray *)CFDictionaryGetValue(_rows, key);
+    if (values)
+        return values;
+
+    if (CFDictionaryGetCount(_rows) >= kGeniusTableRowModelMaximumRows)
+        [self _evictRowsOutsideRange:_visibleRange];
+
+    id object = [_arrangedObjects objectAtIndex:row];
+    unsigned int slotCount = [_slotKeyPaths count];
+    NSMutableArray * slotValues = [NSMutableArray arrayWithCapacity:slotCount];
+    unsigned int slot;
+    for (slot=0; slot<slotCount; slot++)
+    {
+        id value = [object valueForKeyPath:[_slotKeyPaths objectAtIndex:slot]];
+        id transformer = [_slotTransformers objectAtIndex:slot];
+        if (transformer != [NSNull null])
+            value = [transformer transformedValue:value];
+        [slotValues addObject:(value ? value : [NSNull null])];
+    }
+
+    CFDictionarySetValue(_rows, key, slotValues);
+    _materializedRowCount++;
+    return slotValues;
+}
+
+//! Removes cached rows outside @a range.
+- (void) _evictRowsOutsideRange:(NSRange)range
+{
+    CFIndex count = CFDictionaryGetCount(_rows);
+    if (count == 0)
+        return;
+
+    const void ** keys = (const void **)malloc(count * sizeof(void *));
+    CFDictionaryGetKeysAndValues(_rows, keys, NULL);
+    CFIndex i;
+    for (i=0; i<count; i++)
+        if (NSLocationInRange((unsigned int)(uintptr_t)keys[i] - 1, range) == NO)
+            CFDictionaryRemoveValue(_rows, keys[i]);
+    free(keys);
+}
+
+@end
@@ -0,0 +1,117 @@
+//
+//  GeniusTableRowModelTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusTableRowModel.h"
+#import "GeniusPair.h"
+#import "GeniusItem.h"
+#import "GeniusAssociation.h"
+
+@interface GeniusTableRowModelTest : SenTestCase {
+    GeniusTableRowModel *rowModel;  //!< The object under test.
+    NSMutableArray *pairs;          //!< Arranged objects of #rowModel.
+}
+
+@end
+
+//! Tests for the GeniusTableRowModel row cache.
+@implementation GeniusTableRowModelTest
+
+//! Creates a row model over 100 pairs with text and score columns.
+- (void) setUp
+{
+    pairs = [[NSMutableArray alloc] init];
+    int i;
+    for (i=0; i<100; i++)
+    {
+        GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+        [[pair itemA] setValue:[NSString stringWithFormat:@"cue %d", i] forKey:@"stringValue"];
+        [[pair associationAB] setScore:(i % 8) - 1];
+        [pairs addObject:pair];
+    }
+
+    rowModel = [[GeniusTableRowModel alloc] initWithArrangedObjects:pairs];
+    [rowModel setKeyPath:@"itemA.stringValue" transformerName:nil forBinding:@"value" column:@"columnA"];
+    [rowModel setKeyPath:@"associationAB.scoreNumber" transformerName:nil forBinding:@"value" column:@"scoreAB"];
+    [rowModel setKeyPath:@"importance" transformerName:NSIsNilTransformerName forBinding:@"fontBold" column:@"columnA"];
+    [rowModel setKeyPath:@"disabled" transformerName:NSNegateBooleanTransformerName forBinding:@"value" column:@"enabled"];
+}
+
+//! Releases the row model and pairs.
+- (void) tearDown
+{
+    [rowModel release];
+    rowModel = nil;
+    [pairs release];
+    pairs = nil;
+}
+
+//! Values come from the pair of the row and are transformed when asked.
+- (void) testValues
+{
+    STAssertEquals([rowModel count], 100U, nil);
+    STAssertEqualObjects([rowModel valueForBinding:@"value" column:@"columnA" row:7], @"cue 7", nil);
+    STAssertEqualObjects([rowModel keyPathForBinding:@"value" column:@"scoreAB"], @"associationAB.scoreNumber", nil);
+    STAssertNil([rowModel valueForBinding:@"textColor" column:@"columnA" row:7], nil);
+    STAssertEqualObjects([rowModel valueForBinding:@"fontBold" column:@"columnA" row:7], [NSNumber numberWithBool:NO], nil);
+
+    STAssertEquals([rowModel statusTierForColumn:@"scoreAB" row:0], GeniusStatusTierNew, nil);
+    STAssertEquals([rowModel statusTierForColumn:@"scoreAB" row:3], GeniusStatusTierLearning, nil);
+    STAssertEquals([rowModel statusTierForColumn:@"scoreAB" row:7], GeniusStatusTierLearned, nil);
+}
+
+//! Toggling the checkbox of a column bound through NSNegateBoolean stores the negated state.
+- (void) testSetValueReverseTransforms
+{
+    GeniusPair * pair = [pairs objectAtIndex:4];
+    STAssertEqualObjects([rowModel valueForBinding:@"value" column:@"enabled" row:4], [NSNumber numberWithBool:YES], nil);
+
+    [rowModel setValue:[NSNumber numberWithBool:NO] forBinding:@"value" column:@"enabled" row:4];
+    STAssertTrue([pair disabled], @"unchecking the enabled box disables the pair");
+    STAssertEqualObjects([rowModel valueForBinding:@"value" column:@"enabled" row:4], [NSNumber numberWithBool:NO], @"the row is recomputed");
+
+    [rowModel setValue:[NSNumber numberWithBool:YES] forBinding:@"value" column:@"enabled" row:4];
+    STAssertFalse([pair disabled], nil);
+
+    [rowModel setValue:@"edited" forBinding:@"value" column:@"columnA" row:4];
+    STAssertEqualObjects([[pair itemA] stringValue], @"edited", @"untransformed columns are written as is");
+}
+
+//! Rows are computed once, then served from the cache until invalidated.
+- (void) testCaching
+{
+    [rowModel valueForBinding:@"value" column:@"columnA" row:5];
+    [rowModel valueForBinding:@"value" column:@"scoreAB" row:5];
+    STAssertEquals([rowModel materializedRowCount], 1U, nil);
+
+    [[[pairs objectAtIndex:5] itemA] setValue:@"changed" forKey:@"stringValue"];
+    STAssertEqualObjects([rowModel valueForBinding:@"value" column:@"columnA" row:5], @"cue 5", @"stale until invalidated");
+
+    [rowModel invalidateAllRows];
+    STAssertEqualObjects([rowModel valueForBinding:@"value" column:@"columnA" row:5], @"changed", nil);
+    STAssertEquals([rowModel materializedRowCount], 2U, nil);
+}
+
+//! Scrolling keeps only the rows near the visible range.
+- (void) testVisibleRangeEviction
+{
+    int row;
+    for (row=0; row<40; row++)
+        [rowModel valueForBinding:@"value" column:@"columnA" row:row];
+    STAssertEquals([rowModel cachedRowCount], 40U, nil);
+
+    [rowModel setVisibleRange:NSMakeRange(60, 20)];
+    STAssertEquals([rowModel cachedRowCount], 0U, nil);
+
+    for (row=60; row<80; row++)
+        [rowModel valueForBinding:@"value" column:@"columnA" row:row];
+    [rowModel setVisibleRange:NSMakeRange(70, 20)];
+    STAssertEquals([rowModel cachedRowCount], 20U, @"rows 60-79 are within the margin");
+}
+
+@end
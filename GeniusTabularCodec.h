@@ -0,0 +1,70 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+@class GeniusPair;
+
+//! Writes GeniusPair items as tab delimited text, one line per pair.
+/*!
+    Values are escaped as GeniusPair#tabularTextByOrder: does: tabs become @c \t, line breaks @c \n.
+    Rows are appended straight into the output string without building a string per row, and large
+    batches drain an autorelease pool every few thousand rows so memory stays flat.
+ */
+@interface GeniusTabularEncoder : NSObject {
+    NSArray * _keyPaths;        //!< Column order.
+}
+
++ (NSString *) stringFromPairs:(NSArray *)pairs keyPaths:(NSArray *)keyPaths;
+
+- (id) initWithKeyPaths:(NSArray *)keyPaths;
+
+- (void) appendPair:(GeniusPair *)pair toString:(NSMutableString *)string;
+- (void) appendPairs:(NSArray *)pairs toString:(NSMutableString *)string;
+
+@end
+
+
+//! Incrementally reads tab delimited text into new GeniusPair items.
+/*!
+    Each call to #decodePairsWithLimit: parses at most the given number of lines, so a caller can spread
+    a large paste over several run loop passes.  Any of CR, LF, CRLF and the Unicode line separators end
+    a line; blank lines are skipped.  Decoded pairs accumulate in #pairs.
+ */
+@interface GeniusTabularDecoder : NSObject {
+    NSString * _string;                 //!< Text being decoded.
+    CFStringInlineBuffer _characters;   //!< Buffered character access to _string.
+    unsigned int _length;               //!< Length of _string.
+    unsigned int _location;             //!< Start of the next line in _string.
+    NSArray * _keyPaths;                //!< Column order.
+    unichar * _field;                   //!< Characters of the field being decoded.
+    unsigned int _fieldCapacity;        //!< Allocated size of _field.
+    NSMutableArray * _pairs;            //!< Pairs decoded so far.
+}
+
++ (NSMutableArray *) pairsFromString:(NSString *)string keyPaths:(NSArray *)keyPaths;
+
+- (id) initWithString:(NSString *)string keyPaths:(NSArray *)keyPaths;
+
+- (unsigned int) decodePairsWithLimit:(unsigned int)limit;
+- (BOOL) isAtEnd;
+- (float) progress;
+
+- (NSMutableArray *) pairs;
+
+@end
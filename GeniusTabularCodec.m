@@ -0,0 +1,267 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusTabularCodec.h"
+#import "GeniusPair.h"
+
+//! Rows encoded or decoded between autorelease pool drains.
+#define kGeniusTabularBatchSize 2048
+
+//! YES if @a c ends a line.
+static BOOL IsLineBreak(unichar c)
+{
+    return (c == '\n' || c == '\r' || c == 0x0085 || c == 0x2028 || c == 0x2029);
+}
+
+
+@implementation GeniusTabularEncoder
+
+//! Convenience method encoding all of @a pairs.
++ (NSString *) stringFromPairs:(NSArray *)pairs keyPaths:(NSArray *)keyPaths
+{
+    GeniusTabularEncoder * encoder = [[self alloc] initWithKeyPaths:keyPaths];
+    NSMutableString * string = [NSMutableString string];
+    [encoder appendPairs:pairs toString:string];
+    [encoder release];
+    return string;
+}
+
+//! Designated initializer.  @a keyPaths gives the value written to each column.
+- (id) initWithKeyPaths:(NSArray *)keyPaths
+{
+    self = [super init];
+    if (self != nil) {
+        _keyPaths = [keyPaths copy];
+    }
+    return self;
+}
+
+//! Releases the key paths and frees memory.
+- (void) dealloc
+{
+    [_keyPaths release];
+    [super dealloc];
+}
+
+//! Appends @a value's description to @a string, escaping tabs and line breaks.
+- (void) _appendEscapedValue:(id)value toString:(NSMutableString *)string
+{
+    static NSCharacterSet * specialCharacters = nil;
+    if (specialCharacters == nil)
+        specialCharacters = [[NSCharacterSet characterSetWithCharactersInString:@"\t\n\r"] retain];
+
+    NSString * text = [value description];
+    NSRange special = [text rangeOfCharacterFromSet:specialCharacters];
+    if (special.location == NSNotFound)
+    {
+        [string appendString:text];
+        return;
+    }
+
+    unsigned int length = [text length];
+    unsigned int start = 0;
+    while (special.location != NSNotFound)
+    {
+        [string appendString:[text substringWithRange:NSMakeRange(start, special.location - start)]];
+        [string appendString:([text characterAtIndex:special.location] == '\t') ? @"\\t" : @"\\n"];
+        start = NSMaxRange(special);
+        special = [text rangeOfCharacterFromSet:specialCharacters options:NSLiteralSearch range:NSMakeRange(start, length - start)];
+    }
+    [string appendString:[text substringFromIndex:start]];
+}
+
+//! Appends one line for @a pair, including the line feed.
+- (void) appendPair:(GeniusPair *)pair toString:(NSMutableString *)string
+{
+    unsigned int i, count = [_keyPaths count];
+    for (i=0; i<count; i++)
+    {
+        id value = [pair valueForKeyPath:[_keyPaths objectAtIndex:i]];
+        if (value)
+            [self _appendEscapedValue:value toString:string];
+        if (i<count-1)
+            [string appendString:@"\t"];
+    }
+    [string appendString:@"\n"];
+}
+
+//! Appends one line per pair of @a pairs.
+- (void) appendPairs:(NSArray *)pairs toString:(NSMutableString *)string
+{
+    unsigned int i, count = [pairs count];
+    NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+    for (i=0; i<count; i++)
+    {
+        [self appendPair:[pairs objectAtIndex:i] toString:string];
+        if ((i+1) % kGeniusTabularBatchSize == 0)
+        {
+            [pool release];
+            pool = [[NSAutoreleasePool alloc] init];
+        }
+    }
+    [pool release];
+}
+
+@end
+
+
+@interface GeniusTabularDecoder (Private)
+- (BOOL) _decodeLine;
+@end
+
+@implementation GeniusTabularDecoder
+
+//! Convenience method decoding all of @a string at once.
++ (NSMutableArray *) pairsFromString:(NSString *)string keyPaths:(NSArray *)keyPaths
+{
+    GeniusTabularDecoder * decoder = [[self alloc] initWithString:string keyPaths:keyPaths];
+    while ([decoder isAtEnd] == NO)
+        [decoder decodePairsWithLimit:kGeniusTabularBatchSize];
+    NSMutableArray * pairs = [[[decoder pairs] retain] autorelease];
+    [decoder release];
+    return pairs;
+}
+
+//! Designated initializer.  @a keyPaths gives the key path set from each column; extra columns are ignored.
+- (id) initWithString:(NSString *)string keyPaths:(NSArray *)keyPaths
+{
+    self = [super init];
+    if (self != nil) {
+        _string = [string copy];
+        _length = [_string length];
+        CFStringInitInlineBuffer((CFStringRef)_string, &_characters, CFRangeMake(0, _length));
+        _keyPaths = [keyPaths copy];
+        _fieldCapacity = 256;
+        _field = (unichar *)malloc(_fieldCapacity * sizeof(unichar));
+        _pairs = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+//! Releases the text and decoded pairs and frees memory.
+- (void) dealloc
+{
+    [_string release];
+    [_keyPaths release];
+    free(_field);
+    [_pairs release];
+    [super dealloc];
+}
+
+//! Decodes up to @a limit more lines.  Returns the number of pairs added to #pairs.
+- (unsigned int) decodePairsWithLimit:(unsigned int)limit
+{
+    unsigned int decoded = 0;
+    NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+    while (decoded < limit && [self isAtEnd] == NO)
+    {
+        if ([self _decodeLine])
+            decoded++;
+    }
+    [pool release];
+    return decoded;
+}
+
+//! YES once the whole string was decoded.
+- (BOOL) isAtEnd
+{
+    return (_location >= _length);
+}
+
+//! Fraction of the string decoded so far, from 0 to 1.
+- (float) progress
+{
+    return (_length ? (float)_location / _length : 1.0f);
+}
+
+//! Pairs decoded so far.
+- (NSMutableArray *) pairs
+{
+    return _pairs;
+}
+
+@end
+
+
+@implementation GeniusTabularDecoder (Private)
+
+//! Appends @a c to the field being decoded.
+static inline void AppendFieldCharacter(GeniusTabularDecoder * self, unichar c, unsigned int * fieldLength)
+{
+    if (*fieldLength == self->_fieldCapacity)
+    {
+        self->_fieldCapacity *= 2;
+        self->_field = (unichar *)realloc(self->_field, self->_fieldCapacity * sizeof(unichar));
+    }
+    self->_field[(*fieldLength)++] = c;
+}
+
+//! Decodes the line at _location, un-escaping each field.  Returns NO for blank lines.
+- (BOOL) _decodeLine
+{
+    NSMutableArray * fields = [NSMutableArray array];
+    unsigned int fieldLength = 0;
+    BOOL isBlank = YES;
+
+    while (_location < _length)
+    {
+        unichar c = CFStringGetCharacterFromInlineBuffer(&_characters, _location++);
+        if (IsLineBreak(c))
+        {
+            // Swallow the LF of a CRLF pair.
+            if (c == '\r' && _location < _length && CFStringGetCharacterFromInlineBuffer(&_characters, _location) == '\n')
+                _location++;
+            break;
+        }
+
+        if (c == '\t')
+        {
+            [fields addObject:[NSString stringWithCharacters:_field length:fieldLength]];
+            fieldLength = 0;
+            continue;
+        }
+
+        if (c != ' ')
+            isBlank = NO;
+
+        if (c == '\\' && _location < _length)
+        {
+            unichar next = CFStringGetCharacterFromInlineBuffer(&_characters, _location);
+            if (next == 't' || next == 'n')
+            {
+                c = (next == 't') ? '\t' : '\n';
+                _location++;
+            }
+        }
+        AppendFieldCharacter(self, c, &fieldLength);
+    }
+
+    if (isBlank && [fields count] == 0)
+        return NO;
+    [fields addObject:[NSString stringWithCharacters:_field length:fieldLength]];
+
+    GeniusPair * pair = [[GeniusPair alloc] init];
+    unsigned int f, count = MIN([fields count], [_keyPaths count]);
+    for (f=0; f<count; f++)
+        [pair setValue:[NSMutableString stringWithString:[fields objectAtIndex:f]] forKeyPath:[_keyPaths objectAtIndex:f]];
+    [_pairs addObject:pair];
+    [pair release];
+    return YES;
+}
+
+@end
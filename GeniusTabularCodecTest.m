@@ -0,0 +1,96 @@
+//
+//  GeniusTabularCodecTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusTabularCodec.h"
+#import "GeniusPair.h"
+
+@interface GeniusTabularCodecTest : SenTestCase {
+    NSArray *keyPaths;      //!< Column order used by all tests.
+}
+
+@end
+
+//! Tests for GeniusTabularEncoder and GeniusTabularDecoder.
+@implementation GeniusTabularCodecTest
+
+//! Uses question, answer and notes columns.
+- (void) setUp
+{
+    keyPaths = [[NSArray alloc] initWithObjects:@"itemA.stringValue", @"itemB.stringValue", @"notesString", nil];
+}
+
+//! Releases the key paths.
+- (void) tearDown
+{
+    [keyPaths release];
+    keyPaths = nil;
+}
+
+//! Tabs and line breaks survive a round trip through their escapes.
+- (void) testRoundTrip
+{
+    GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+    [[pair itemA] setValue:@"one\ttwo" forKey:@"stringValue"];
+    [[pair itemB] setValue:@"three\nfour" forKey:@"stringValue"];
+    [pair setNotesString:@"back\\slash"];
+
+    NSString * text = [GeniusTabularEncoder stringFromPairs:[NSArray arrayWithObjects:pair, pair, nil] keyPaths:keyPaths];
+    STAssertEqualObjects(text, @"one\\ttwo\tthree\\nfour\tback\\slash\none\\ttwo\tthree\\nfour\tback\\slash\n", nil);
+    STAssertEqualObjects(text, [GeniusPair tabularTextFromPairs:[NSArray arrayWithObjects:pair, pair, nil] order:keyPaths], nil);
+
+    NSArray * pairs = [GeniusTabularDecoder pairsFromString:text keyPaths:keyPaths];
+    STAssertEquals([pairs count], 2U, nil);
+    GeniusPair * decoded = [pairs objectAtIndex:1];
+    STAssertEqualObjects([decoded valueForKeyPath:@"itemA.stringValue"], @"one\ttwo", nil);
+    STAssertEqualObjects([decoded valueForKeyPath:@"itemB.stringValue"], @"three\nfour", nil);
+    STAssertEqualObjects([decoded notesString], @"back\\slash", nil);
+}
+
+//! CR, CRLF and LF all end lines; blank lines and missing columns are tolerated.
+- (void) testLineEndings
+{
+    NSString * text = @"a\tb\r\nc\td\r\n\r\ne\rf\tg\th\textra\n  \n";
+    NSArray * pairs = [GeniusTabularDecoder pairsFromString:text keyPaths:keyPaths];
+    STAssertEquals([pairs count], 4U, nil);
+    STAssertEqualObjects([[pairs objectAtIndex:1] valueForKeyPath:@"itemB.stringValue"], @"d", nil);
+    STAssertEqualObjects([[pairs objectAtIndex:2] valueForKeyPath:@"itemA.stringValue"], @"e", nil);
+    STAssertNil([[pairs objectAtIndex:2] valueForKeyPath:@"itemB.stringValue"], nil);
+    STAssertEqualObjects([[pairs objectAtIndex:3] notesString], @"h", nil);
+}
+
+//! Decoding in slices yields every pair exactly once.
+- (void) testIncrementalDecoding
+{
+    NSMutableString * text = [NSMutableString string];
+    int i;
+    for (i=0; i<500; i++)
+        [text appendFormat:@"question %d with some longer text\\t\tanswer %d\r\n", i, i];
+
+    GeniusTabularDecoder * decoder = [[GeniusTabularDecoder alloc] initWithString:text keyPaths:keyPaths];
+    unsigned int total = 0, slices = 0;
+    while ([decoder isAtEnd] == NO)
+    {
+        total += [decoder decodePairsWithLimit:7];
+        slices++;
+    }
+    STAssertEquals(total, 500U, nil);
+    STAssertEquals(slices, 72U, nil);
+    STAssertEqualsWithAccuracy([decoder progress], 1.0f, 0.0001f, nil);
+
+    NSArray * pairs = [decoder pairs];
+    for (i=0; i<500; i++)
+    {
+        GeniusPair * pair = [pairs objectAtIndex:i];
+        STAssertEqualObjects([pair valueForKeyPath:@"itemA.stringValue"], ([NSString stringWithFormat:@"question %d with some longer text\t", i]), nil);
+        STAssertEqualObjects([pair valueForKeyPath:@"itemB.stringValue"], ([NSString stringWithFormat:@"answer %d", i]), nil);
+    }
+    [decoder release];
+}
+
+@end
@@ -0,0 +1,109 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+//! Item text longer than this many characters is saved in the text section of a deck.  Notes always are.
+#define kGeniusTextOutOfLineLength 512
+
+//! Default bound on the decoded text a GeniusTextStore keeps, in bytes.
+#define kGeniusTextDefaultCacheLimit (512 * 1024)
+
+//! Where one text is stored in a section.
+/*! The bytes are zlib compressed UTF-8 when #length is less than #byteLength, plain UTF-8 otherwise. */
+typedef struct _GeniusTextRecord {
+    unsigned int offset;        //!< Position of the bytes, counted from the end of the record table.
+    unsigned int length;        //!< Stored size in bytes.
+    unsigned int byteLength;    //!< Size of the UTF-8 text in bytes.
+    unsigned int textLength;    //!< Length of the text in UTF-16 units.
+} GeniusTextRecord;
+
+//! Read only access to the text section of a deck file:  notes and long item text, loaded on demand.
+/*!
+    A section is a 16 byte header (magic and record count), a table of little endian GeniusTextRecord
+    entries, and the text bytes.  Texts are handed out as NSString objects (#lazyStringAtIndex:) that hold
+    nothing but the store and a record number; their characters are decoded when first asked for and kept
+    in a least recently used cache of at most #cacheLimit bytes.  So resident memory is bounded by the cache,
+    however long the notes of the deck are.
+
+    The store starts with the section as decoded from the archive.  Once the deck has a file,
+    #mapSectionFromFile: swaps it for the same bytes mapped from that file, so only the pages of texts that
+    are read get loaded.  Saving renames a new file into place; the old mapping stays valid until the store
+    goes away.  Texts may be read from any thread.
+
+    GeniusTextSectionWriter builds sections.
+ */
+@interface GeniusTextStore : NSObject {
+    NSData * _section;                  //!< Holds the section bytes:  a copy, or the mapped deck file.
+    const unsigned char * _payload;     //!< Text bytes, inside _section after the record table.
+    GeniusTextRecord * _records;        //!< Decoded record table.
+    unsigned int _count;                //!< Number of records.
+    BOOL _isMapped;                     //!< Set once #mapSectionFromFile: succeeded.
+
+    NSLock * _lock;                     //!< Guards the cache.
+    NSString ** _strings;               //!< Record -> decoded text while cached, else nil.
+    unsigned int * _newer;              //!< Record -> next more recently used cached record.
+    unsigned int * _older;              //!< Record -> next less recently used cached record.
+    unsigned int _newest;               //!< Most recently used cached record.
+    unsigned int _oldest;               //!< Least recently used cached record, evicted first.
+    unsigned int _cacheLimit;           //!< Most bytes of decoded text kept.
+    unsigned int _cachedByteCount;      //!< Bytes of decoded text kept, two per UTF-16 unit.
+    unsigned int _loadCount;            //!< Texts decoded since the store was created.
+}
+
+- (id) initWithSectionData:(NSData *)data;
+- (BOOL) mapSectionFromFile:(NSString *)path;
+- (BOOL) isMapped;
+
+- (unsigned int) count;
+- (NSString *) stringAtIndex:(unsigned int)index;
+- (NSString *) lazyStringAtIndex:(unsigned int)index;
+
+- (unsigned int) cacheLimit;
+- (void) setCacheLimit:(unsigned int)limit;
+- (unsigned int) cachedByteCount;
+- (unsigned int) cachedStringCount;
+- (unsigned int) loadCount;
+
+@end
+
+
+//! Collects texts into a section for GeniusTextStore and stands in for them while a deck is archived.
+/*!
+    Strings registered with #addString: are replaced by a record number when the writer is the delegate of
+    an NSKeyedArchiver, matched by identity.  Unarchiving with the GeniusTextStore of the section as the
+    delegate of the NSKeyedUnarchiver turns record numbers back into lazy strings.  Texts that already come
+    from a GeniusTextStore are copied over without decoding them.
+ */
+@interface GeniusTextSectionWriter : NSObject {
+    NSMutableData * _table;             //!< Encoded record table.
+    NSMutableData * _payload;           //!< Text bytes.
+    unsigned int _count;                //!< Number of records.
+    BOOL _compresses;                   //!< Whether texts are zlib compressed where that makes them smaller.
+    CFMutableDictionaryRef _indexes;    //!< Registered string -> record number + 1, by identity.  Retains strings.
+    NSMutableArray * _references;       //!< Stand-ins handed to the archiver, kept until the writer goes away.
+}
+
+- (BOOL) compresses;
+- (void) setCompresses:(BOOL)compresses;
+
+- (unsigned int) addString:(NSString *)string;
+- (unsigned int) count;
+- (NSData *) sectionData;
+
+@end
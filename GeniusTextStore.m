@@ -0,0 +1,623 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusTextStore.h"
+#import "GeniusByteOrder.h"
+#include <zlib.h>       // compress2, uncompress
+#include <string.h>     // memchr, memcmp
+
+//! First bytes of every text section.
+static const char kGeniusTextSectionMagic[8] = { 'G', 'e', 'n', 'i', 'u', 's', 'T', '1' };
+
+//! Size of the section header:  magic, record count and payload length.
+#define kGeniusTextHeaderSize 16
+
+//! Size of one record in the table.
+#define kGeniusTextRecordSize 16
+
+//! Texts shorter than this many UTF-8 bytes are not worth compressing.
+#define kGeniusTextMinimumCompressedLength 64
+
+//! Marks the ends of the cache list.
+#define kGeniusTextNoRecord 0xFFFFFFFFU
+
+
+//! A text of a GeniusTextStore.  Holds no characters; each access goes through the cache of the store.
+@interface GeniusStoredString : NSString {
+    GeniusTextStore * _store;       //!< Retained.
+    unsigned int _index;            //!< Record number in _store.
+    unsigned int _length;           //!< Length in UTF-16 units, known without decoding.
+}
+- (id) initWithStore:(GeniusTextStore *)store index:(unsigned int)index length:(unsigned int)length;
+- (GeniusTextStore *) store;
+- (unsigned int) index;
+@end
+
+
+//! What a GeniusTextSectionWriter puts in an archive in place of a text:  its record number.
+@interface GeniusTextReference : NSObject <NSCoding> {
+    unsigned int _index;            //!< Record number in the section.
+}
+- (id) initWithIndex:(unsigned int)index;
+@end
+
+
+@interface GeniusTextSectionWriter (Private)
+- (BOOL) _containsString:(NSString *)string;
+@end
+
+
+@interface GeniusTextStore (Private)
+- (const GeniusTextRecord *) _recordAtIndex:(unsigned int)index;
+- (void) _appendBytesOfRecord:(unsigned int)index toData:(NSMutableData *)data;
+- (NSString *) _decodeRecord:(unsigned int)index;
+- (void) _unlinkRecord:(unsigned int)index;
+- (void) _linkNewestRecord:(unsigned int)index;
+- (void) _evict;
+@end
+
+@implementation GeniusTextStore
+
+//! Designated initializer.  Returns nil if @a data is not a well formed section.
+- (id) initWithSectionData:(NSData *)data
+{
+    self = [super init];
+    if (self != nil)
+    {
+        const unsigned char * bytes = [data bytes];
+        unsigned int length = [data length];
+        if (length < kGeniusTextHeaderSize || memcmp(bytes, kGeniusTextSectionMagic, sizeof(kGeniusTextSectionMagic)) != 0)
+        {
+            [self release];
+            return nil;
+        }
+
+        _count = GetUInt32(bytes + 8);
+        unsigned int payloadLength = GetUInt32(bytes + 12);
+        unsigned long long tableEnd = kGeniusTextHeaderSize + (unsigned long long)_count * kGeniusTextRecordSize;
+        if (tableEnd + payloadLength != length)
+        {
+            [self release];
+            return nil;
+        }
+
+        _records = malloc(MAX(_count, 1U) * sizeof(GeniusTextRecord));
+        unsigned int i;
+        for (i=0; i<_count; i++)
+        {
+            const unsigned char * record = bytes + kGeniusTextHeaderSize + i * kGeniusTextRecordSize;
+            _records[i].offset = GetUInt32(record);
+            _records[i].length = GetUInt32(record + 4);
+            _records[i].byteLength = GetUInt32(record + 8);
+            _records[i].textLength = GetUInt32(record + 12);
+            if ((unsigned long long)_records[i].offset + _records[i].length > payloadLength
+                    || _records[i].length > _records[i].byteLength || _records[i].textLength > _records[i].byteLength)
+            {
+                [self release];
+                return nil;
+            }
+        }
+
+        _section = [data copy];
+        _payload = (const unsigned char *)[_section bytes] + tableEnd;
+
+        _lock = [[NSLock alloc] init];
+        _strings = calloc(MAX(_count, 1U), sizeof(NSString *));
+        _newer = malloc(MAX(_count, 1U) * sizeof(unsigned int));
+        _older = malloc(MAX(_count, 1U) * sizeof(unsigned int));
+        _newest = _oldest = kGeniusTextNoRecord;
+        _cacheLimit = kGeniusTextDefaultCacheLimit;
+    }
+    return self;
+}
+
+//! Releases the section and cached texts and frees memory.
+- (void) dealloc
+{
+    unsigned int i;
+    for (i=0; _strings && i<_count; i++)
+        [_strings[i] release];
+    free(_strings);
+    free(_newer);
+    free(_older);
+    free(_records);
+    [_section release];
+    [_lock release];
+    [super dealloc];
+}
+
+//! Reads the section from the mapped file at @a path instead of memory, if the file holds it.
+/*!
+    Looks for the header and record table of the section in the file, which in a binary deck file holds the
+    section bytes unchanged.  XML deck files encode them, so their section stays in memory.  The text bytes
+    themselves are not compared, so the pages they occupy are not read.
+ */
+- (BOOL) mapSectionFromFile:(NSString *)path
+{
+    if (_isMapped || path == nil)
+        return _isMapped;
+
+    NSData * mapping = [NSData dataWithContentsOfMappedFile:path];
+    const unsigned char * bytes = [mapping bytes];
+    unsigned int length = [mapping length];
+    unsigned int sectionLength = [_section length];
+    unsigned int tableEnd = _payload - (const unsigned char *)[_section bytes];
+    if (mapping == nil || length < sectionLength)
+        return NO;
+
+    const unsigned char * end = bytes + length - sectionLength + 1;
+    const unsigned char * candidate = bytes;
+    while (candidate < end && (candidate = memchr(candidate, kGeniusTextSectionMagic[0], end - candidate)) != NULL)
+    {
+        if (memcmp(candidate, [_section bytes], tableEnd) == 0)
+        {
+            [_lock lock];
+            [_section release];
+            _section = [mapping retain];
+            _payload = candidate + tableEnd;
+            _isMapped = YES;
+            [_lock unlock];
+            return YES;
+        }
+        candidate++;
+    }
+    return NO;
+}
+
+//! _isMapped getter.
+- (BOOL) isMapped
+{
+    return _isMapped;
+}
+
+//! Number of texts in the section.
+- (unsigned int) count
+{
+    return _count;
+}
+
+//! Text number @a index, decoded or taken from the cache.  nil if @a index is out of range or the text is damaged.
+- (NSString *) stringAtIndex:(unsigned int)index
+{
+    if (index >= _count)
+        return nil;
+
+    [_lock lock];
+    NSString * string = _strings[index];
+    if (string)
+    {
+        [self _unlinkRecord:index];
+        [self _linkNewestRecord:index];
+    }
+    else if ((string = [self _decodeRecord:index]) != nil)
+    {
+        _strings[index] = string;
+        _cachedByteCount += [string length] * sizeof(unichar);
+        _loadCount++;
+        [self _linkNewestRecord:index];
+        [self _evict];
+    }
+    [[string retain] autorelease];
+    [_lock unlock];
+    return string;
+}
+
+//! A string standing for text number @a index that decodes it only when its characters are needed.
+/*! Copies of the string are the string itself, so passing it around never loads it. */
+- (NSString *) lazyStringAtIndex:(unsigned int)index
+{
+    if (index >= _count)
+        return nil;
+    return [[[GeniusStoredString alloc] initWithStore:self index:index length:_records[index].textLength] autorelease];
+}
+
+//! _cacheLimit getter.
+- (unsigned int) cacheLimit
+{
+    return _cacheLimit;
+}
+
+//! _cacheLimit setter.  Evicts texts right away if the cache holds more.
+- (void) setCacheLimit:(unsigned int)limit
+{
+    [_lock lock];
+    _cacheLimit = limit;
+    [self _evict];
+    [_lock unlock];
+}
+
+//! _cachedByteCount getter.
+- (unsigned int) cachedByteCount
+{
+    return _cachedByteCount;
+}
+
+//! Number of texts in the cache.  Walks the cache list.
+- (unsigned int) cachedStringCount
+{
+    unsigned int count = 0;
+    [_lock lock];
+    unsigned int index;
+    for (index=_newest; index!=kGeniusTextNoRecord; index=_older[index])
+        count++;
+    [_lock unlock];
+    return count;
+}
+
+//! _loadCount getter.
+- (unsigned int) loadCount
+{
+    return _loadCount;
+}
+
+@end
+
+
+@implementation GeniusTextStore (Private)
+
+//! Entry @a index of the record table.
+- (const GeniusTextRecord *) _recordAtIndex:(unsigned int)index
+{
+    return _records + index;
+}
+
+//! Appends the stored bytes of record @a index to @a data, as they are.
+/*! Locked, since #mapSectionFromFile: may move the bytes meanwhile. */
+- (void) _appendBytesOfRecord:(unsigned int)index toData:(NSMutableData *)data
+{
+    [_lock lock];
+    [data appendBytes:_payload + _records[index].offset length:_records[index].length];
+    [_lock unlock];
+}
+
+//! Returns a new string with text number @a index, or nil if it can't be decoded.
+- (NSString *) _decodeRecord:(unsigned int)index
+{
+    const GeniusTextRecord * record = _records + index;
+    const unsigned char * bytes = _payload + record->offset;
+    NSString * string = nil;
+    if (record->length < record->byteLength)
+    {
+        unsigned char * buffer = malloc(MAX(record->byteLength, 1U));
+        uLongf byteLength = record->byteLength;
+        if (uncompress(buffer, &byteLength, bytes, record->length) == Z_OK && byteLength == record->byteLength)
+            string = [[NSString alloc] initWithBytes:buffer length:byteLength encoding:NSUTF8StringEncoding];
+        free(buffer);
+    }
+    else
+        string = [[NSString alloc] initWithBytes:bytes length:record->length encoding:NSUTF8StringEncoding];
+
+    if (string && [string length] != record->textLength)
+    {
+        [string release];
+        string = nil;
+    }
+    if (string == nil)
+        NSLog(@"Text %u of the deck is damaged", index);
+    return string;
+}
+
+//! Takes cached record @a index out of the cache list.
+- (void) _unlinkRecord:(unsigned int)index
+{
+    unsigned int newer = _newer[index], older = _older[index];
+    if (newer != kGeniusTextNoRecord)
+        _older[newer] = older;
+    else
+        _newest = older;
+    if (older != kGeniusTextNoRecord)
+        _newer[older] = newer;
+    else
+        _oldest = newer;
+}
+
+//! Puts record @a index at the most recently used end of the cache list.
+- (void) _linkNewestRecord:(unsigned int)index
+{
+    _newer[index] = kGeniusTextNoRecord;
+    _older[index] = _newest;
+    if (_newest != kGeniusTextNoRecord)
+        _newer[_newest] = index;
+    else
+        _oldest = index;
+    _newest = index;
+}
+
+//! Drops least recently used texts until the cache is within its limit.  Keeps the newest text regardless.
+- (void) _evict
+{
+    while (_cachedByteCount > _cacheLimit && _oldest != _newest)
+    {
+        unsigned int index = _oldest;
+        [self _unlinkRecord:index];
+        _cachedByteCount -= [_strings[index] length] * sizeof(unichar);
+        [_strings[index] release];
+        _strings[index] = nil;
+    }
+}
+
+@end
+
+
+@implementation GeniusStoredString
+
+//! Designated initializer.
+- (id) initWithStore:(GeniusTextStore *)store index:(unsigned int)index length:(unsigned int)length
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _store = [store retain];
+        _index = index;
+        _length = length;
+    }
+    return self;
+}
+
+//! Releases the store and deallocates memory.
+- (void) dealloc
+{
+    [_store release];
+    [super dealloc];
+}
+
+//! _store getter.
+- (GeniusTextStore *) store
+{
+    return _store;
+}
+
+//! _index getter.
+- (unsigned int) index
+{
+    return _index;
+}
+
+//! Known without decoding the text.
+- (unsigned int) length
+{
+    return _length;
+}
+
+//! Decodes the text through the cache of the store.  Damaged texts read as zeros.
+- (void) getCharacters:(unichar *)buffer range:(NSRange)range
+{
+    if (NSMaxRange(range) > _length)
+        [NSException raise:NSRangeException format:@"%@ out of bounds of text of length %u", NSStringFromRange(range), _length];
+
+    NSString * string = [_store stringAtIndex:_index];
+    if (string)
+        [string getCharacters:buffer range:range];
+    else
+        memset(buffer, 0, range.length * sizeof(unichar));
+}
+
+//! Same as getCharacters:range: for one character.
+- (unichar) characterAtIndex:(unsigned int)index
+{
+    unichar character;
+    [self getCharacters:&character range:NSMakeRange(index, 1)];
+    return character;
+}
+
+//! Immutable, so copies share the store instead of decoding the text.
+- (id) copyWithZone:(NSZone *)zone
+{
+    return [self retain];
+}
+
+//! Archived as a plain string, except by the GeniusTextSectionWriter of a deck file that holds it.
+- (id) replacementObjectForKeyedArchiver:(NSKeyedArchiver *)archiver
+{
+    id writer = [archiver delegate];
+    if ([writer isKindOfClass:[GeniusTextSectionWriter class]] && [writer _containsString:self])
+        return self;
+    return [NSString stringWithString:self];
+}
+
+//! Archived as a plain string.
+- (id) replacementObjectForCoder:(NSCoder *)coder
+{
+    return [NSString stringWithString:self];
+}
+
+@end
+
+
+@implementation GeniusTextReference
+
+//! Designated initializer.
+- (id) initWithIndex:(unsigned int)index
+{
+    self = [super init];
+    if (self != nil)
+        _index = index;
+    return self;
+}
+
+//! Replaces itself with the lazy string of the GeniusTextStore that is the delegate of @a coder, or nil without one.
+- (id) initWithCoder:(NSCoder *)coder
+{
+    NSAssert([coder allowsKeyedCoding], @"allowsKeyedCoding");
+
+    unsigned int index = (unsigned int)[coder decodeInt64ForKey:@"index"];
+    id store = ([coder isKindOfClass:[NSKeyedUnarchiver class]] ? [(NSKeyedUnarchiver *)coder delegate] : nil);
+    NSString * string = ([store isKindOfClass:[GeniusTextStore class]] ? [store lazyStringAtIndex:index] : nil);
+    [self release];
+    return [string retain];
+}
+
+//! Packs up the record number.
+- (void) encodeWithCoder:(NSCoder *)coder
+{
+    NSAssert([coder allowsKeyedCoding], @"allowsKeyedCoding");
+    [coder encodeInt64:_index forKey:@"index"];
+}
+
+@end
+
+
+//! Identity dictionary callbacks:  keys are retained but compared by pointer.
+static const CFDictionaryKeyCallBacks kGeniusIdentityKeyCallBacks = { 0, NULL, NULL, NULL, NULL, NULL };
+
+@implementation GeniusTextSectionWriter
+
+//! Creates an empty writer that compresses texts.
+- (id) init
+{
+    self = [super init];
+    if (self != nil)
+    {
+        _table = [[NSMutableData alloc] init];
+        _payload = [[NSMutableData alloc] init];
+        _compresses = YES;
+        _indexes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kGeniusIdentityKeyCallBacks, NULL);
+        _references = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+//! Releases the registered strings and deallocates memory.
+- (void) dealloc
+{
+    CFIndex i, count = CFDictionaryGetCount(_indexes);
+    const void ** keys = malloc(MAX(count, 1) * sizeof(void *));
+    CFDictionaryGetKeysAndValues(_indexes, keys, NULL);
+    for (i=0; i<count; i++)
+        [(id)keys[i] release];
+    free(keys);
+    CFRelease(_indexes);
+    [_table release];
+    [_payload release];
+    [_references release];
+    [super dealloc];
+}
+
+//! _compresses getter.
+- (BOOL) compresses
+{
+    return _compresses;
+}
+
+//! _compresses setter.  Only affects texts added later.
+- (void) setCompresses:(BOOL)compresses
+{
+    _compresses = compresses;
+}
+
+//! Adds @a string to the section unless it is there already, and returns its record number.
+- (unsigned int) addString:(NSString *)string
+{
+    unsigned int index = (unsigned int)(uintptr_t)CFDictionaryGetValue(_indexes, string);
+    if (index)
+        return index - 1;
+
+    GeniusTextRecord record;
+    record.offset = [_payload length];
+    if ([string isKindOfClass:[GeniusStoredString class]])
+    {
+        GeniusTextStore * store = [(GeniusStoredString *)string store];
+        unsigned int storedIndex = [(GeniusStoredString *)string index];
+        const GeniusTextRecord * storedRecord = [store _recordAtIndex:storedIndex];
+        record.length = storedRecord->length;
+        record.byteLength = storedRecord->byteLength;
+        record.textLength = storedRecord->textLength;
+        [store _appendBytesOfRecord:storedIndex toData:_payload];
+    }
+    else
+    {
+        NSData * data = [string dataUsingEncoding:NSUTF8StringEncoding];
+        record.byteLength = record.length = [data length];
+        record.textLength = [string length];
+
+        BOOL isCompressed = NO;
+        if (_compresses && record.byteLength >= kGeniusTextMinimumCompressedLength)
+        {
+            // Only worth keeping if smaller, so a buffer one byte short of the text is enough.
+            uLongf length = record.byteLength - 1;
+            [_payload setLength:record.offset + length];
+            unsigned char * buffer = (unsigned char *)[_payload mutableBytes] + record.offset;
+            if (compress2(buffer, &length, [data bytes], record.byteLength, Z_BEST_COMPRESSION) == Z_OK)
+            {
+                record.length = length;
+                isCompressed = YES;
+            }
+            [_payload setLength:record.offset + (isCompressed ? record.length : 0)];
+        }
+        if (isCompressed == NO)
+            [_payload appendData:data];
+    }
+
+    unsigned char bytes[kGeniusTextRecordSize];
+    PutUInt32(bytes, record.offset);
+    PutUInt32(bytes + 4, record.length);
+    PutUInt32(bytes + 8, record.byteLength);
+    PutUInt32(bytes + 12, record.textLength);
+    [_table appendBytes:bytes length:sizeof(bytes)];
+
+    index = _count++;
+    CFDictionarySetValue(_indexes, [string retain], (const void *)(uintptr_t)(index + 1));
+    return index;
+}
+
+//! Number of texts added.
+- (unsigned int) count
+{
+    return _count;
+}
+
+//! The section holding every text added so far, for GeniusTextStore#initWithSectionData:.
+- (NSData *) sectionData
+{
+    unsigned char header[kGeniusTextHeaderSize];
+    memcpy(header, kGeniusTextSectionMagic, sizeof(kGeniusTextSectionMagic));
+    PutUInt32(header + 8, _count);
+    PutUInt32(header + 12, [_payload length]);
+
+    NSMutableData * data = [NSMutableData dataWithCapacity:sizeof(header) + [_table length] + [_payload length]];
+    [data appendBytes:header length:sizeof(header)];
+    [data appendData:_table];
+    [data appendData:_payload];
+    return data;
+}
+
+//! NSKeyedArchiver delegate method.  Replaces strings added to the writer with their record number.
+- (id) archiver:(NSKeyedArchiver *)archiver willEncodeObject:(id)object
+{
+    unsigned int index = (unsigned int)(uintptr_t)CFDictionaryGetValue(_indexes, object);
+    if (index == 0)
+        return object;
+
+    GeniusTextReference * reference = [[GeniusTextReference alloc] initWithIndex:index - 1];
+    [_references addObject:reference];
+    [reference release];
+    return reference;
+}
+
+@end
+
+
+@implementation GeniusTextSectionWriter (Private)
+
+//! YES if @a string itself was added.
+- (BOOL) _containsString:(NSString *)string
+{
+    return CFDictionaryContainsKey(_indexes, string);
+}
+
+@end
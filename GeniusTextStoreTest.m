@@ -0,0 +1,165 @@
+//
+//  GeniusTextStoreTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusTextStore.h"
+
+@interface GeniusTextStoreTest : SenTestCase {
+    NSMutableArray *strings;        //!< Texts written to #store, by record number.
+    GeniusTextStore *store;         //!< The object under test.
+}
+
+@end
+
+//! Tests for GeniusTextStore and GeniusTextSectionWriter.
+@implementation GeniusTextStoreTest
+
+//! Returns a text of roughly @a length characters that compresses well.
+- (NSString *) _textWithLength:(unsigned int)length seed:(int)seed
+{
+    NSMutableString * text = [NSMutableString string];
+    while ([text length] < length)
+        [text appendFormat:@"Line %d of a long note about card %d.\n", [text length], seed];
+    return text;
+}
+
+//! Writes a few short, long and non ASCII texts and opens a store on them.
+- (void) setUp
+{
+    strings = [[NSMutableArray alloc] init];
+    [strings addObject:@"short"];
+    [strings addObject:[NSString stringWithFormat:@"%Ccole, na%Cve, %C", (unichar)0x00C9, (unichar)0x00EF, (unichar)0x65E5]];
+    int i;
+    for (i=0; i<8; i++)
+        [strings addObject:[self _textWithLength:2000 seed:i]];
+
+    GeniusTextSectionWriter * writer = [[[GeniusTextSectionWriter alloc] init] autorelease];
+    NSEnumerator * stringEnumerator = [strings objectEnumerator];
+    NSString * string;
+    while ((string = [stringEnumerator nextObject]))
+        [writer addString:string];
+    store = [[GeniusTextStore alloc] initWithSectionData:[writer sectionData]];
+}
+
+//! Releases the store.
+- (void) tearDown
+{
+    [store release];
+    store = nil;
+    [strings release];
+    strings = nil;
+}
+
+//! Every text reads back as written, and long texts are stored compressed.
+- (void) testRoundTrip
+{
+    STAssertNotNil(store, nil);
+    STAssertEquals([store count], [strings count], nil);
+    unsigned int i;
+    for (i=0; i<[strings count]; i++)
+        STAssertEqualObjects([store stringAtIndex:i], [strings objectAtIndex:i], @"text %u", i);
+    STAssertNil([store stringAtIndex:[strings count]], nil);
+
+    GeniusTextSectionWriter * writer = [[[GeniusTextSectionWriter alloc] init] autorelease];
+    [writer addString:[strings lastObject]];
+    unsigned int compressedLength = [[writer sectionData] length];
+    [writer setCompresses:NO];
+    [writer addString:[[[strings lastObject] mutableCopy] autorelease]];
+    STAssertTrue(compressedLength * 4 < [[writer sectionData] length] - compressedLength, nil);
+
+    STAssertEquals([writer addString:[strings lastObject]], 0U, @"strings are added once");
+    STAssertNil([[[GeniusTextStore alloc] initWithSectionData:[NSData dataWithBytes:"junk" length:4]] autorelease], nil);
+}
+
+//! Lazy strings behave like the text without loading it until their characters are read.
+- (void) testLazyString
+{
+    NSString * lazy = [store lazyStringAtIndex:2];
+    STAssertEquals([lazy length], [[strings objectAtIndex:2] length], nil);
+    STAssertTrue([lazy copy] == lazy, nil);
+    [lazy release];
+    STAssertEquals([store loadCount], 0U, nil);
+
+    STAssertEqualObjects(lazy, [strings objectAtIndex:2], nil);
+    STAssertEquals([lazy hash], [[strings objectAtIndex:2] hash], nil);
+    STAssertEqualObjects([lazy substringFromIndex:[lazy length] - 5], [[strings objectAtIndex:2] substringFromIndex:[lazy length] - 5], nil);
+    STAssertEquals([store loadCount], 1U, nil);
+
+    NSData * archived = [NSKeyedArchiver archivedDataWithRootObject:lazy];
+    STAssertEqualObjects([NSKeyedUnarchiver unarchiveObjectWithData:archived], [strings objectAtIndex:2], nil);
+}
+
+//! The cache keeps recently used texts and stays within its limit.
+- (void) testCacheLimit
+{
+    [store setCacheLimit:3 * 2000 * sizeof(unichar)];
+    unsigned int i;
+    for (i=2; i<[strings count]; i++)
+        [store stringAtIndex:i];
+    STAssertTrue([store cachedByteCount] <= [store cacheLimit], nil);
+    STAssertEquals([store loadCount], 8U, nil);
+
+    [store stringAtIndex:[strings count] - 1];
+    STAssertEquals([store loadCount], 8U, @"recently used texts stay cached");
+    [store stringAtIndex:2];
+    STAssertEquals([store loadCount], 9U, @"old texts were evicted");
+
+    [store setCacheLimit:0];
+    STAssertEquals([store cachedByteCount], [[strings objectAtIndex:2] length] * sizeof(unichar), @"the newest text is kept");
+}
+
+//! Archiving with the writer as delegate and unarchiving with the store brings back lazy strings.
+- (void) testArchiving
+{
+    GeniusTextSectionWriter * writer = [[[GeniusTextSectionWriter alloc] init] autorelease];
+    NSString * notes = [strings objectAtIndex:3];
+    [writer addString:notes];
+
+    NSMutableData * data = [NSMutableData data];
+    NSKeyedArchiver * archiver = [[[NSKeyedArchiver alloc] initForWritingWithMutableData:data] autorelease];
+    [archiver setDelegate:writer];
+    [archiver encodeObject:[NSArray arrayWithObjects:@"inline", notes, nil] forKey:@"root"];
+    [archiver finishEncoding];
+    STAssertTrue([data length] < [notes length] / 2, @"the text is not in the archive");
+
+    GeniusTextStore * sectionStore = [[[GeniusTextStore alloc] initWithSectionData:[writer sectionData]] autorelease];
+    NSKeyedUnarchiver * unarchiver = [[[NSKeyedUnarchiver alloc] initForReadingWithData:data] autorelease];
+    [unarchiver setDelegate:sectionStore];
+    NSArray * array = [unarchiver decodeObjectForKey:@"root"];
+    [unarchiver finishDecoding];
+    STAssertEqualObjects(array, ([NSArray arrayWithObjects:@"inline", notes, nil]), nil);
+    STAssertEquals([sectionStore loadCount], 1U, nil);
+}
+
+//! A file holding the section unchanged is mapped in place of the copy in memory.
+- (void) testMapping
+{
+    GeniusTextSectionWriter * writer = [[[GeniusTextSectionWriter alloc] init] autorelease];
+    NSEnumerator * stringEnumerator = [strings objectEnumerator];
+    NSString * string;
+    while ((string = [stringEnumerator nextObject]))
+        [writer addString:string];
+
+    NSMutableData * file = [NSMutableData dataWithBytes:"GeniusT0 leading bytes" length:22];
+    [file appendData:[writer sectionData]];
+    [file appendBytes:"trailing bytes" length:14];
+    NSString * path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]];
+    STAssertTrue([file writeToFile:path atomically:NO], nil);
+
+    STAssertFalse([store isMapped], nil);
+    STAssertTrue([store mapSectionFromFile:path], nil);
+    STAssertTrue([store isMapped], nil);
+    STAssertEqualObjects([store stringAtIndex:5], [strings objectAtIndex:5], nil);
+    [[NSFileManager defaultManager] removeFileAtPath:path handler:nil];
+    STAssertEqualObjects([store stringAtIndex:6], [strings objectAtIndex:6], @"the mapping outlives the file");
+
+    GeniusTextStore * otherStore = [[[GeniusTextStore alloc] initWithSectionData:[writer sectionData]] autorelease];
+    STAssertFalse([otherStore mapSectionFromFile:path], nil);
+}
+
+@end
@@ -0,0 +1,70 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "GeniusAssociation.h"
+
+//! Number of levels in the GeniusTimingWheel hierarchy (minutes, hours, days, 64 day blocks).
+#define kGeniusTimingWheelLevelCount 4
+
+//! Length of one day in GeniusTime units.
+extern const GeniusTime kGeniusTimeDay;
+
+typedef struct _GeniusTimingWheelEntry GeniusTimingWheelEntry;
+
+//! Doubly linked list of GeniusTimingWheelEntry items with a count.
+typedef struct _GeniusTimingWheelList {
+    GeniusTimingWheelEntry * head;
+    unsigned int count;
+} GeniusTimingWheelList;
+
+//! Hierarchical timing wheel indexing GeniusAssociation items by GeniusAssociation#dueTime.
+/*!
+    Associations are hashed into minute, hour, day and 64 day slots relative to the wheel's current time.
+    Asking how many associations are due now, or how many fall due on each of the next days, only walks
+    slot counters instead of the whole deck.  Associations are not retained.
+ */
+@interface GeniusTimingWheel : NSObject {
+    GeniusTime _currentTime;                        //!< Time the slots are relative to.
+    CFMutableDictionaryRef _entries;                //!< GeniusAssociation -> GeniusTimingWheelEntry.
+    GeniusTimingWheelList _slots[kGeniusTimingWheelLevelCount][64];   //!< Future associations by level and slot.
+    GeniusTimingWheelList _due;                     //!< Associations due at or before #_currentTime.
+    GeniusTimingWheelList _overflow;                //!< Associations beyond the top level.
+    GeniusTimingWheelList _unscheduled;             //!< Associations without a due date.
+}
+
+- (id) initWithTime:(GeniusTime)now;
+
+- (GeniusTime) currentTime;
+- (void) advanceToTime:(GeniusTime)now;
+
+- (void) addAssociation:(GeniusAssociation *)association;
+- (void) removeAssociation:(GeniusAssociation *)association;
+- (void) updateAssociation:(GeniusAssociation *)association;
+- (void) removeAllAssociations;
+
+- (unsigned int) count;
+- (unsigned long long) byteCount;
+- (unsigned int) dueCount;
+- (unsigned int) unscheduledCount;
+- (NSArray *) dueAssociations;
+
+- (void) getDueCounts:(unsigned int *)counts forDays:(unsigned int)dayCount;
+
+@end
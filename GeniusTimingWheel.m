@@ -0,0 +1,411 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusTimingWheel.h"
+#import "GeniusMemoryReport.h"
+
+const GeniusTime kGeniusTimeDay = 86400;
+
+//! Seconds covered by one slot on each level.
+static const GeniusTime kSlotLength[kGeniusTimingWheelLevelCount] = { 60, 3600, 86400, 86400 * 64 };
+//! Number of slots used on each level.
+static const int kSlotCount[kGeniusTimingWheelLevelCount] = { 60, 24, 64, 64 };
+//! Seconds covered by a whole level.  The next level's slot length.
+static const GeniusTime kLevelLength[kGeniusTimingWheelLevelCount] = { 3600, 86400, 86400 * 64, 86400 * 64 * 64 };
+
+//! One indexed association.
+struct _GeniusTimingWheelEntry {
+    GeniusAssociation * association;   //!< Not retained.
+    GeniusTime dueTime;                //!< Due time when the entry was placed.
+    GeniusTimingWheelList * list;      //!< List currently holding the entry.
+    GeniusTimingWheelEntry * previous;
+    GeniusTimingWheelEntry * next;
+};
+
+//! Floor division so that times before 1970 land in the right slot.
+static GeniusTime FloorDivide(GeniusTime value, GeniusTime divisor)
+{
+    GeniusTime quotient = value / divisor;
+    if ((value % divisor) != 0 && value < 0)
+        quotient--;
+    return quotient;
+}
+
+//! Slot of @a index on a level with @a slotCount slots.
+static int SlotIndex(GeniusTime index, int slotCount)
+{
+    int slot = (int)(index % slotCount);
+    return (slot < 0) ? slot + slotCount : slot;
+}
+
+static void ListAppend(GeniusTimingWheelList * list, GeniusTimingWheelEntry * entry)
+{
+    entry->list = list;
+    entry->previous = NULL;
+    entry->next = list->head;
+    if (list->head)
+        list->head->previous = entry;
+    list->head = entry;
+    list->count++;
+}
+
+static void ListRemove(GeniusTimingWheelEntry * entry)
+{
+    GeniusTimingWheelList * list = entry->list;
+    if (entry->previous)
+        entry->previous->next = entry->next;
+    else
+        list->head = entry->next;
+    if (entry->next)
+        entry->next->previous = entry->previous;
+    list->count--;
+    entry->list = NULL;
+    entry->previous = entry->next = NULL;
+}
+
+//! Empties @a source, handing its former entries to the caller through @a outHead.
+static void ListDetach(GeniusTimingWheelList * source, GeniusTimingWheelEntry ** outHead)
+{
+    *outHead = source->head;
+    source->head = NULL;
+    source->count = 0;
+}
+
+
+@interface GeniusTimingWheel (Private)
+- (void) _placeEntry:(GeniusTimingWheelEntry *)entry;
+- (void) _placeEntries:(GeniusTimingWheelEntry *)head;
+@end
+
+//! Hierarchical timing wheel over GeniusAssociation#dueTime.
+/*!
+    Level @c L holds associations due within the same level period as #_currentTime (the same hour for minutes,
+    the same day for hours, and so on) but not within the period of the level below.  When time advances across a
+    period boundary only the slots that became current are redistributed.
+ */
+@implementation GeniusTimingWheel
+
+//! Convenience initializer for a wheel starting at GeniusTimeNow().
+- (id) init
+{
+    return [self initWithTime:GeniusTimeNow()];
+}
+
+//! Designated initializer.  Creates an empty wheel whose slots are relative to @a now.
+- (id) initWithTime:(GeniusTime)now
+{
+    self = [super init];
+    if (self != nil) {
+        _currentTime = now;
+        _entries = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+        memset(_slots, 0, sizeof(_slots));
+        memset(&_due, 0, sizeof(_due));
+        memset(&_overflow, 0, sizeof(_overflow));
+        memset(&_unscheduled, 0, sizeof(_unscheduled));
+    }
+    return self;
+}
+
+//! Frees all entries and deallocates memory.
+- (void) dealloc
+{
+    [self removeAllAssociations];
+    CFRelease(_entries);
+    [super dealloc];
+}
+
+//! _currentTime getter.
+- (GeniusTime) currentTime
+{
+    return _currentTime;
+}
+
+//! Moves the wheel forward to @a now, collecting newly due associations.
+/*!
+    Moving backwards, which only happens when the system clock is changed, re-places every entry.
+ */
+- (void) advanceToTime:(GeniusTime)now
+{
+    GeniusTime oldTime = _currentTime;
+    if (now == oldTime)
+        return;
+
+    GeniusTimingWheelEntry * pending = NULL;
+    GeniusTimingWheelEntry * head;
+    GeniusTimingWheelEntry * entry;
+    int level, slot;
+
+    if (now < oldTime)
+    {
+        _currentTime = now;
+        for (level=0; level<kGeniusTimingWheelLevelCount; level++)
+            for (slot=0; slot<kSlotCount[level]; slot++)
+            {
+                ListDetach(&_slots[level][slot], &head);
+                [self _placeEntries:head];
+            }
+        ListDetach(&_overflow, &head);
+        [self _placeEntries:head];
+        ListDetach(&_due, &head);
+        [self _placeEntries:head];
+        return;
+    }
+
+    _currentTime = now;
+
+    // Find the highest level whose period changed.  Everything on that level and below lies in the past.
+    int changedLevel = -1;
+    for (level=0; level<kGeniusTimingWheelLevelCount; level++)
+        if (FloorDivide(oldTime, kLevelLength[level]) != FloorDivide(now, kLevelLength[level]))
+            changedLevel = level;
+
+    for (level=0; level<=changedLevel; level++)
+        for (slot=0; slot<kSlotCount[level]; slot++)
+            while ((entry = _slots[level][slot].head))
+            {
+                ListRemove(entry);
+                ListAppend(&_due, entry);
+            }
+
+    // On the first unchanged level, slots between the old and new time are due and the current slot is redistributed.
+    level = changedLevel + 1;
+    if (level < kGeniusTimingWheelLevelCount)
+    {
+        GeniusTime oldIndex = FloorDivide(oldTime, kSlotLength[level]);
+        GeniusTime newIndex = FloorDivide(now, kSlotLength[level]);
+        GeniusTime index;
+        for (index=oldIndex; index<newIndex; index++)
+        {
+            slot = SlotIndex(index, kSlotCount[level]);
+            while ((entry = _slots[level][slot].head))
+            {
+                ListRemove(entry);
+                ListAppend(&_due, entry);
+            }
+        }
+        slot = SlotIndex(newIndex, kSlotCount[level]);
+        ListDetach(&_slots[level][slot], &pending);
+        [self _placeEntries:pending];
+    }
+    else
+    {
+        ListDetach(&_overflow, &pending);
+        [self _placeEntries:pending];
+    }
+}
+
+//! Adds @a association using its current GeniusAssociation#dueTime.  Adding twice updates the entry.
+- (void) addAssociation:(GeniusAssociation *)association
+{
+    GeniusTimingWheelEntry * entry = (GeniusTimingWheelEntry *)CFDictionaryGetValue(_entries, association);
+    if (entry)
+    {
+        [self updateAssociation:association];
+        return;
+    }
+
+    entry = calloc(1, sizeof(GeniusTimingWheelEntry));
+    entry->association = association;
+    entry->dueTime = [association dueTime];
+    CFDictionarySetValue(_entries, association, entry);
+    [self _placeEntry:entry];
+}
+
+//! Removes @a association from the wheel.  Unknown associations are ignored.
+- (void) removeAssociation:(GeniusAssociation *)association
+{
+    GeniusTimingWheelEntry * entry = (GeniusTimingWheelEntry *)CFDictionaryGetValue(_entries, association);
+    if (entry == NULL)
+        return;
+    ListRemove(entry);
+    CFDictionaryRemoveValue(_entries, association);
+    free(entry);
+}
+
+//! Re-places @a association after its GeniusAssociation#dueTime changed.
+- (void) updateAssociation:(GeniusAssociation *)association
+{
+    GeniusTimingWheelEntry * entry = (GeniusTimingWheelEntry *)CFDictionaryGetValue(_entries, association);
+    if (entry == NULL)
+        return;
+    GeniusTime dueTime = [association dueTime];
+    if (dueTime == entry->dueTime && entry->list != NULL)
+        return;
+    ListRemove(entry);
+    entry->dueTime = dueTime;
+    [self _placeEntry:entry];
+}
+
+//! Empties the wheel.
+- (void) removeAllAssociations
+{
+    CFIndex i, count = CFDictionaryGetCount(_entries);
+    if (count == 0)
+        return;
+
+    const void ** values = malloc(sizeof(void *) * count);
+    CFDictionaryGetKeysAndValues(_entries, NULL, values);
+    for (i=0; i<count; i++)
+        free((void *)values[i]);
+    free(values);
+    CFDictionaryRemoveAllValues(_entries);
+
+    memset(_slots, 0, sizeof(_slots));
+    memset(&_due, 0, sizeof(_due));
+    memset(&_overflow, 0, sizeof(_overflow));
+    memset(&_unscheduled, 0, sizeof(_unscheduled));
+}
+
+//! Number of indexed associations.
+- (unsigned int) count
+{
+    return (unsigned int)CFDictionaryGetCount(_entries);
+}
+
+//! Bytes of the wheel, its entries and the entry table.
+- (unsigned long long) byteCount
+{
+    unsigned long long total = GeniusMemorySizeOfObject(self) + GeniusMemorySizeOfCollection((id)_entries);
+    return total + (unsigned long long)[self count] * sizeof(GeniusTimingWheelEntry);
+}
+
+//! Number of associations due at or before #currentTime.
+- (unsigned int) dueCount
+{
+    return _due.count;
+}
+
+//! Number of associations without a due date.
+- (unsigned int) unscheduledCount
+{
+    return _unscheduled.count;
+}
+
+//! Returns the associations due at or before #currentTime.  Call #advanceToTime: first.
+- (NSArray *) dueAssociations
+{
+    NSMutableArray * associations = [NSMutableArray arrayWithCapacity:_due.count];
+    GeniusTimingWheelEntry * entry;
+    for (entry = _due.head; entry; entry = entry->next)
+        [associations addObject:entry->association];
+    return associations;
+}
+
+//! Fills @a counts with the number of associations falling due on each of the next @a dayCount days.
+/*!
+    Days are calendar days in the GeniusTime base, starting with the day of #currentTime.  @a counts[0] includes
+    overdue associations.  Days inside the current 64 day block are read from slot counters; days beyond it walk
+    only the entries of the top level slots they touch.
+ */
+- (void) getDueCounts:(unsigned int *)counts forDays:(unsigned int)dayCount
+{
+    if (dayCount == 0)
+        return;
+    memset(counts, 0, sizeof(unsigned int) * dayCount);
+
+    GeniusTime today = FloorDivide(_currentTime, kGeniusTimeDay);
+    GeniusTime lastDay = today + dayCount - 1;
+    int slot;
+
+    // Due now, this hour and today.
+    counts[0] += _due.count;
+    for (slot=0; slot<kSlotCount[0]; slot++)
+        counts[0] += _slots[0][slot].count;
+    for (slot=0; slot<kSlotCount[1]; slot++)
+        counts[0] += _slots[1][slot].count;
+
+    // Day slots of the current block map one to one onto days.
+    GeniusTime blockStart = FloorDivide(today, 64) * 64;
+    for (slot=0; slot<kSlotCount[2]; slot++)
+    {
+        GeniusTime day = blockStart + slot;
+        if (day > today && day <= lastDay)
+            counts[day - today] += _slots[2][slot].count;
+    }
+
+    // Later blocks need their entries bucketed individually.
+    if (lastDay >= blockStart + 64)
+    {
+        GeniusTime block;
+        GeniusTime lastBlock = FloorDivide(lastDay, 64);
+        GeniusTime superBlock = FloorDivide(today, 64 * 64);
+        for (block = FloorDivide(today, 64) + 1; block <= lastBlock; block++)
+        {
+            GeniusTimingWheelList * list = &_overflow;
+            if (FloorDivide(block, 64) == superBlock)
+                list = &_slots[3][SlotIndex(block, 64)];
+
+            GeniusTimingWheelEntry * entry;
+            for (entry = list->head; entry; entry = entry->next)
+            {
+                GeniusTime day = FloorDivide(entry->dueTime, kGeniusTimeDay);
+                if (FloorDivide(day, 64) == block && day <= lastDay)
+                    counts[day - today]++;
+            }
+        }
+    }
+}
+
+@end
+
+
+//! Unexposed methods.
+@implementation GeniusTimingWheel (Private)
+
+//! Puts @a entry in the list matching its due time relative to #_currentTime.
+- (void) _placeEntry:(GeniusTimingWheelEntry *)entry
+{
+    GeniusTime dueTime = entry->dueTime;
+    if (dueTime == kGeniusTimeNone)
+    {
+        ListAppend(&_unscheduled, entry);
+        return;
+    }
+    if (dueTime <= _currentTime)
+    {
+        ListAppend(&_due, entry);
+        return;
+    }
+
+    int level;
+    for (level=0; level<kGeniusTimingWheelLevelCount; level++)
+    {
+        if (FloorDivide(dueTime, kLevelLength[level]) == FloorDivide(_currentTime, kLevelLength[level]))
+        {
+            int slot = SlotIndex(FloorDivide(dueTime, kSlotLength[level]), kSlotCount[level]);
+            ListAppend(&_slots[level][slot], entry);
+            return;
+        }
+    }
+    ListAppend(&_overflow, entry);
+}
+
+//! Places every entry of a detached list starting at @a head.
+- (void) _placeEntries:(GeniusTimingWheelEntry *)head
+{
+    while (head)
+    {
+        GeniusTimingWheelEntry * next = head->next;
+        head->previous = head->next = NULL;
+        head->list = NULL;
+        [self _placeEntry:head];
+        head = next;
+    }
+}
+
+@end
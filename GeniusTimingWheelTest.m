@@ -0,0 +1,125 @@
+//
+//  GeniusTimingWheelTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import "GeniusTimingWheel.h"
+#import "GeniusPair.h"
+
+@interface GeniusTimingWheelTest : SenTestCase {
+    GeniusTimingWheel *wheel;   //!< The object under test.
+    NSMutableArray *pairs;      //!< Pairs owning the indexed associations.
+    GeniusTime start;           //!< Wheel start time, a few seconds into a day.
+}
+
+@end
+
+//! Tests for the GeniusTimingWheel due time index.
+@implementation GeniusTimingWheelTest
+
+//! Creates an empty wheel at a fixed time for each test.
+- (void) setUp
+{
+    start = 14000 * kGeniusTimeDay + 5;
+    wheel = [[GeniusTimingWheel alloc] initWithTime:start];
+    pairs = [[NSMutableArray alloc] init];
+}
+
+//! Releases the wheel and pairs.
+- (void) tearDown
+{
+    [wheel release];
+    wheel = nil;
+    [pairs release];
+    pairs = nil;
+}
+
+//! Returns a new association due at @a dueTime, owned by #pairs.
+- (GeniusAssociation *) _associationDueAt:(GeniusTime)dueTime
+{
+    GeniusPair * pair = [[[GeniusPair alloc] init] autorelease];
+    [pairs addObject:pair];
+    GeniusAssociation * association = [pair associationAB];
+    [association setDueTime:dueTime];
+    return association;
+}
+
+//! Associations become due as the wheel advances past their due time.
+- (void) testAdvanceCollectsDueAssociations
+{
+    GeniusAssociation * soon = [self _associationDueAt:start + 30];
+    GeniusAssociation * later = [self _associationDueAt:start + 3 * kGeniusTimeDay];
+    [wheel addAssociation:soon];
+    [wheel addAssociation:later];
+    [wheel addAssociation:[[pairs objectAtIndex:0] associationBA]];
+
+    STAssertEquals([wheel count], 3U, nil);
+    STAssertEquals([wheel unscheduledCount], 1U, nil);
+    STAssertEquals([wheel dueCount], 0U, nil);
+
+    [wheel advanceToTime:start + 30];
+    STAssertEquals([wheel dueCount], 1U, nil);
+    STAssertEqualObjects([wheel dueAssociations], [NSArray arrayWithObject:soon], nil);
+
+    [wheel advanceToTime:start + 3 * kGeniusTimeDay - 1];
+    STAssertEquals([wheel dueCount], 1U, nil);
+
+    [wheel advanceToTime:start + 3 * kGeniusTimeDay];
+    STAssertEquals([wheel dueCount], 2U, nil);
+}
+
+//! Changing a due date moves the association within the wheel.
+- (void) testUpdateAndRemove
+{
+    GeniusAssociation * association = [self _associationDueAt:start + kGeniusTimeDay];
+    [wheel addAssociation:association];
+
+    [association setDueTime:start - 1];
+    [wheel updateAssociation:association];
+    STAssertEquals([wheel dueCount], 1U, nil);
+
+    [wheel removeAssociation:association];
+    STAssertEquals([wheel count], 0U, nil);
+    STAssertEquals([wheel dueCount], 0U, nil);
+}
+
+//! Forecast counts agree with a brute force count, including days beyond the current 64 day block.
+- (void) testForecast
+{
+    unsigned int expected[100];
+    unsigned int actual[100];
+    memset(expected, 0, sizeof(expected));
+
+    srandom(42);
+    int i;
+    for (i=0; i<500; i++)
+    {
+        GeniusTime dueTime = start - 100 + (random() % (120 * kGeniusTimeDay));
+        [wheel addAssociation:[self _associationDueAt:dueTime]];
+    }
+
+    GeniusTime now = start + 2 * kGeniusTimeDay + 7200;
+    [wheel advanceToTime:now];
+
+    GeniusTime today = now / kGeniusTimeDay;
+    NSEnumerator * pairEnumerator = [pairs objectEnumerator];
+    GeniusPair * pair;
+    while ((pair = [pairEnumerator nextObject]))
+    {
+        GeniusTime day = [[pair associationAB] dueTime] / kGeniusTimeDay - today;
+        if (day <= 0)
+            expected[0]++;
+        else if (day < 100)
+            expected[day]++;
+    }
+
+    [wheel getDueCounts:actual forDays:100];
+    for (i=0; i<100; i++)
+        STAssertEquals(actual[i], expected[i], @"day %d", i);
+}
+
+@end
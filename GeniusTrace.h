@@ -0,0 +1,64 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import <Foundation/Foundation.h>
+#include <mach/mach_time.h>     // mach_absolute_time
+
+//! Counters kept by the tracing layer.  Names in the exported trace come from #GeniusTraceCounterName.
+typedef enum {
+    GeniusTraceCounterKVONotifications = 0,     //!< Change notifications handled by GeniusDocument.
+    GeniusTraceCounterUndoRegistrations,        //!< Undo actions registered for edits.
+    GeniusTraceCounterPairAllocations,          //!< GeniusPair instances created.
+    GeniusTraceCounterItemAllocations,          //!< GeniusItem instances created.
+    kGeniusTraceCounterCount
+} GeniusTraceCounter;
+
+//! Number of spans each thread keeps.  Older spans are overwritten.
+#define kGeniusTraceBufferSize 4096
+
+//! Non-zero while tracing is on.  Read by the macros below; change it with #GeniusTraceSetEnabled.
+/*!
+    Genius traces spans, such as loading a deck or grading an answer, and counters, such as KVO
+    notifications.  Each thread writes its spans into its own ring buffer without locks or atomic
+    operations, so tracing can stay on under real load; counters are shared and updated atomically.
+    #GeniusTraceJSONData exports everything in the Chrome trace event format (chrome://tracing).
+    With tracing off a span or count costs a single load and branch.
+ */
+extern volatile int GeniusTraceEnabled;
+
+//! Starts a span.  Returns 0, and costs one load and branch, while tracing is off.
+#define GeniusTraceSpanBegin() (GeniusTraceEnabled ? mach_absolute_time() : 0ULL)
+
+//! Ends the span started at @a start.  @a name must be a string literal.
+#define GeniusTraceSpanEnd(name, start) do { if (start) GeniusTraceRecordSpan((name), (start), mach_absolute_time()); } while (0)
+
+//! Adds @a delta to @a counter while tracing is on.
+#define GeniusTraceCount(counter, delta) do { if (GeniusTraceEnabled) GeniusTraceAddToCounter((counter), (delta)); } while (0)
+
+void GeniusTraceSetEnabled(BOOL enabled);
+void GeniusTraceReset(void);
+
+void GeniusTraceRecordSpan(const char * name, uint64_t start, uint64_t end);
+void GeniusTraceAddToCounter(GeniusTraceCounter counter, int delta);
+
+int GeniusTraceCounterValue(GeniusTraceCounter counter);
+const char * GeniusTraceCounterName(GeniusTraceCounter counter);
+unsigned int GeniusTraceSpanCount(const char * name);
+
+NSData * GeniusTraceJSONData(void);
+BOOL GeniusTraceWriteToFile(NSString * path);
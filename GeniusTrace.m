@@ -0,0 +1,247 @@
+/*
+	Genius
+	Copyright (C) 2003-2006 John R Chang
+	Copyright (C) 2007-2008 Chris Miner
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	http://www.gnu.org/licenses/gpl.txt
+*/
+
+#import "GeniusTrace.h"
+#include <libkern/OSAtomic.h>   // OSAtomicAdd32Barrier, OSMemoryBarrier
+#include <pthread.h>
+#include <unistd.h>             // getpid
+
+//! One finished span, in mach_absolute_time units.
+typedef struct _GeniusTraceSpan {
+    const char * name;
+    uint64_t start;
+    uint64_t end;
+} GeniusTraceSpan;
+
+//! Ring buffer of the spans of one thread.  Only the owning thread writes to it.
+typedef struct _GeniusTraceBuffer {
+    struct _GeniusTraceBuffer * next;       //!< Next in the list of every buffer.
+    struct _GeniusTraceBuffer * nextFree;   //!< Next buffer left behind by an exited thread.
+    unsigned int threadNumber;              //!< Thread id in the exported trace.
+    int isMainThread;                       //!< Set if the main thread owns the buffer.
+    volatile uint32_t head;                 //!< Number of spans written.  The next one goes to head % kGeniusTraceBufferSize.
+    GeniusTraceSpan spans[kGeniusTraceBufferSize];
+} GeniusTraceBuffer;
+
+volatile int GeniusTraceEnabled = 0;
+
+static volatile int32_t counters[kGeniusTraceCounterCount];
+static const char * counterNames[kGeniusTraceCounterCount] = {
+    "kvo-notifications", "undo-registrations", "pair-allocations", "item-allocations"
+};
+
+static pthread_once_t bufferKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t bufferKey;
+static pthread_mutex_t bufferLock = PTHREAD_MUTEX_INITIALIZER;     //!< Guards the buffer lists, not the spans.
+static GeniusTraceBuffer * buffers = NULL;          //!< Every buffer ever created.
+static GeniusTraceBuffer * freeBuffers = NULL;      //!< Buffers of exited threads, reused by new threads.
+static unsigned int threadCount = 0;
+static uint64_t traceStart = 0;                     //!< Time zero of the exported trace.
+
+//! Thread exit callback.  Keeps the spans but lets the next new thread write to the buffer.
+static void ReleaseBuffer(void * value)
+{
+    GeniusTraceBuffer * buffer = (GeniusTraceBuffer *)value;
+    pthread_mutex_lock(&bufferLock);
+    buffer->nextFree = freeBuffers;
+    freeBuffers = buffer;
+    pthread_mutex_unlock(&bufferLock);
+}
+
+static void CreateBufferKey(void)
+{
+    pthread_key_create(&bufferKey, ReleaseBuffer);
+}
+
+//! Returns the buffer of the calling thread, creating it on the thread's first span.
+static GeniusTraceBuffer * CurrentBuffer(void)
+{
+    pthread_once(&bufferKeyOnce, CreateBufferKey);
+    GeniusTraceBuffer * buffer = (GeniusTraceBuffer *)pthread_getspecific(bufferKey);
+    if (buffer)
+        return buffer;
+
+    pthread_mutex_lock(&bufferLock);
+    if (freeBuffers)
+    {
+        buffer = freeBuffers;
+        freeBuffers = buffer->nextFree;
+    }
+    else
+    {
+        buffer = (GeniusTraceBuffer *)calloc(1, sizeof(GeniusTraceBuffer));
+        buffer->threadNumber = threadCount++;
+        buffer->next = buffers;
+        buffers = buffer;
+    }
+    buffer->isMainThread = pthread_main_np();
+    pthread_mutex_unlock(&bufferLock);
+
+    pthread_setspecific(bufferKey, buffer);
+    return buffer;
+}
+
+//! Copies the spans of @a buffer that are still intact into @a spans.  Returns their number.
+/*!
+    The owning thread may keep writing while we copy.  Spans it could have overwritten in the meantime,
+    the oldest ones, are dropped rather than returned half written.  Once the ring has wrapped, the
+    oldest slot copied is also the one the writer fills next, so it is dropped as well.
+ */
+static uint32_t CopySpans(GeniusTraceBuffer * buffer, GeniusTraceSpan * spans)
+{
+    uint32_t head = buffer->head;
+    OSMemoryBarrier();
+    uint32_t count = MIN(head, (uint32_t)kGeniusTraceBufferSize);
+    uint32_t i;
+    for (i=0; i<count; i++)
+        spans[i] = buffer->spans[(head - count + i) % kGeniusTraceBufferSize];
+    OSMemoryBarrier();
+
+    uint32_t overwritten = buffer->head - head;
+    if (count == kGeniusTraceBufferSize)
+        overwritten++;                  // slot head % kGeniusTraceBufferSize may be half written
+    overwritten = MIN(overwritten, count);
+    memmove(spans, spans + overwritten, (count - overwritten) * sizeof(GeniusTraceSpan));
+    return count - overwritten;
+}
+
+//! Turns tracing on or off.  The first time it is turned on starts the trace clock.
+void GeniusTraceSetEnabled(BOOL enabled)
+{
+    if (enabled && traceStart == 0)
+        traceStart = mach_absolute_time();
+    GeniusTraceEnabled = enabled;
+}
+
+//! Forgets every span and zeroes the counters.  Call while no other thread is tracing.
+void GeniusTraceReset(void)
+{
+    pthread_mutex_lock(&bufferLock);
+    GeniusTraceBuffer * buffer;
+    for (buffer = buffers; buffer; buffer = buffer->next)
+        buffer->head = 0;
+    pthread_mutex_unlock(&bufferLock);
+
+    int i;
+    for (i=0; i<kGeniusTraceCounterCount; i++)
+        counters[i] = 0;
+    traceStart = mach_absolute_time();
+}
+
+//! Appends a span to the calling thread's buffer.  Use GeniusTraceSpanBegin() and GeniusTraceSpanEnd() instead.
+void GeniusTraceRecordSpan(const char * name, uint64_t start, uint64_t end)
+{
+    GeniusTraceBuffer * buffer = CurrentBuffer();
+    uint32_t head = buffer->head;
+    GeniusTraceSpan * span = &buffer->spans[head % kGeniusTraceBufferSize];
+    span->name = name;
+    span->start = start;
+    span->end = end;
+    OSMemoryBarrier();      // publish the span before the head that covers it
+    buffer->head = head + 1;
+}
+
+//! Adds @a delta to @a counter.  Use GeniusTraceCount() instead.
+void GeniusTraceAddToCounter(GeniusTraceCounter counter, int delta)
+{
+    OSAtomicAdd32Barrier(delta, (int32_t *)&counters[counter]);
+}
+
+//! Current value of @a counter.
+int GeniusTraceCounterValue(GeniusTraceCounter counter)
+{
+    return counters[counter];
+}
+
+//! Name of @a counter in the exported trace.
+const char * GeniusTraceCounterName(GeniusTraceCounter counter)
+{
+    return counterNames[counter];
+}
+
+//! Number of recorded spans called @a name, over all threads.
+unsigned int GeniusTraceSpanCount(const char * name)
+{
+    GeniusTraceSpan * spans = (GeniusTraceSpan *)malloc(kGeniusTraceBufferSize * sizeof(GeniusTraceSpan));
+    unsigned int total = 0;
+
+    pthread_mutex_lock(&bufferLock);
+    GeniusTraceBuffer * buffer;
+    for (buffer = buffers; buffer; buffer = buffer->next)
+    {
+        uint32_t i, count = CopySpans(buffer, spans);
+        for (i=0; i<count; i++)
+            if (strcmp(spans[i].name, name) == 0)
+                total++;
+    }
+    pthread_mutex_unlock(&bufferLock);
+
+    free(spans);
+    return total;
+}
+
+//! The trace in Chrome trace event format:  a complete event per span, then thread names and counter values.
+NSData * GeniusTraceJSONData(void)
+{
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double microsecondsPerTick = (double)timebase.numer / timebase.denom / 1000.0;
+    int pid = getpid();
+
+    NSMutableString * json = [NSMutableString stringWithString:@"{\"displayTimeUnit\":\"ms\",\"traceEvents\":["];
+    NSString * separator = @"";
+    GeniusTraceSpan * spans = (GeniusTraceSpan *)malloc(kGeniusTraceBufferSize * sizeof(GeniusTraceSpan));
+
+    pthread_mutex_lock(&bufferLock);
+    GeniusTraceBuffer * buffer;
+    for (buffer = buffers; buffer; buffer = buffer->next)
+    {
+        [json appendFormat:@"%@\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+            separator, pid, buffer->threadNumber, (buffer->isMainThread ? "main" : "worker"), buffer->threadNumber];
+        separator = @",";
+
+        uint32_t i, count = CopySpans(buffer, spans);
+        for (i=0; i<count; i++)
+        {
+            if (spans[i].start < traceStart)
+                continue;
+            [json appendFormat:@",\n{\"name\":\"%s\",\"cat\":\"genius\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                spans[i].name, (spans[i].start - traceStart) * microsecondsPerTick, (spans[i].end - spans[i].start) * microsecondsPerTick,
+                pid, buffer->threadNumber];
+        }
+    }
+    pthread_mutex_unlock(&bufferLock);
+    free(spans);
+
+    double now = (mach_absolute_time() - traceStart) * microsecondsPerTick;
+    int i;
+    for (i=0; i<kGeniusTraceCounterCount; i++)
+    {
+        [json appendFormat:@"%@\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":0,\"args\":{\"value\":%d}}",
+            separator, counterNames[i], now, pid, counters[i]];
+        separator = @",";
+    }
+    [json appendString:@"\n]}\n"];
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+//! Writes #GeniusTraceJSONData to @a path.
+BOOL GeniusTraceWriteToFile(NSString * path)
+{
+    return [GeniusTraceJSONData() writeToFile:path atomically:YES];
+}
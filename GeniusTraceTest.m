@@ -0,0 +1,106 @@
+//
+//  GeniusTraceTest.m
+//  Genius
+//
+//  Copyright 2008 Chris Miner. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SenTestingKit/SenTestingKit.h>
+#import <pthread.h>
+#import "GeniusTrace.h"
+
+@interface GeniusTraceTest : SenTestCase {
+}
+
+@end
+
+//! Records 1000 spans on a thread of its own.
+static void * RecordSpans(void * context)
+{
+    int i;
+    for (i=0; i<1000; i++)
+    {
+        uint64_t spanStart = GeniusTraceSpanBegin();
+        GeniusTraceSpanEnd("test-worker", spanStart);
+    }
+    return NULL;
+}
+
+//! Tests for the GeniusTrace spans, counters and export.
+@implementation GeniusTraceTest
+
+//! Starts each test with tracing on and nothing recorded.
+- (void) setUp
+{
+    GeniusTraceSetEnabled(NO);
+    GeniusTraceReset();
+    GeniusTraceSetEnabled(YES);
+}
+
+//! Leaves tracing off for other tests.
+- (void) tearDown
+{
+    GeniusTraceSetEnabled(NO);
+    GeniusTraceReset();
+}
+
+//! Spans and counts are only recorded while tracing is on.
+- (void) testEnable
+{
+    uint64_t spanStart = GeniusTraceSpanBegin();
+    GeniusTraceSpanEnd("test-span", spanStart);
+    GeniusTraceCount(GeniusTraceCounterUndoRegistrations, 2);
+
+    GeniusTraceSetEnabled(NO);
+    spanStart = GeniusTraceSpanBegin();
+    STAssertEquals(spanStart, 0ULL, nil);
+    GeniusTraceSpanEnd("test-span", spanStart);
+    GeniusTraceCount(GeniusTraceCounterUndoRegistrations, 2);
+
+    STAssertEquals(GeniusTraceSpanCount("test-span"), 1U, nil);
+    STAssertEquals(GeniusTraceCounterValue(GeniusTraceCounterUndoRegistrations), 2, nil);
+}
+
+//! A full buffer keeps the newest spans, less the oldest slot, which the next span overwrites.
+- (void) testRingBufferWraps
+{
+    int i;
+    for (i=0; i<kGeniusTraceBufferSize + 100; i++)
+    {
+        uint64_t spanStart = GeniusTraceSpanBegin();
+        GeniusTraceSpanEnd((i < 100 ? "test-old" : "test-new"), spanStart);
+    }
+    STAssertEquals(GeniusTraceSpanCount("test-old"), 0U, nil);
+    STAssertEquals(GeniusTraceSpanCount("test-new"), (unsigned int)kGeniusTraceBufferSize - 1, nil);
+}
+
+//! Threads record into buffers of their own.
+- (void) testThreads
+{
+    pthread_t threads[4];
+    int i;
+    for (i=0; i<4; i++)
+        pthread_create(&threads[i], NULL, RecordSpans, NULL);
+    for (i=0; i<4; i++)
+        pthread_join(threads[i], NULL);
+
+    STAssertEquals(GeniusTraceSpanCount("test-worker"), 4000U, nil);
+}
+
+//! The export holds complete events, thread names and counters.
+- (void) testJSONExport
+{
+    uint64_t spanStart = GeniusTraceSpanBegin();
+    GeniusTraceSpanEnd("test-export", spanStart);
+    GeniusTraceCount(GeniusTraceCounterKVONotifications, 3);
+
+    NSString * json = [[[NSString alloc] initWithData:GeniusTraceJSONData() encoding:NSUTF8StringEncoding] autorelease];
+    STAssertTrue([json hasPrefix:@"{\"displayTimeUnit\":\"ms\",\"traceEvents\":["], json);
+    STAssertTrue([json rangeOfString:@"\"name\":\"test-export\",\"cat\":\"genius\",\"ph\":\"X\""].location != NSNotFound, json);
+    STAssertTrue([json rangeOfString:@"\"name\":\"thread_name\""].location != NSNotFound, json);
+    STAssertTrue([json rangeOfString:@"\"name\":\"kvo-notifications\",\"ph\":\"C\""].location != NSNotFound, json);
+    STAssertTrue([json rangeOfString:@"\"args\":{\"value\":3}"].location != NSNotFound, json);
+}
+
+@end
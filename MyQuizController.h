@@ -22,6 +22,7 @@
 @class GeniusPair;
 @class GeniusAssociationEnumerator;
 @class GeniusAssociation;
+@class GeniusDistractorIndex;
 
 //! Standard NSWindowController subclass for managing a user quiz.
 @interface MyQuizController : NSWindowController
@@ -43,6 +44,7 @@
     NSSound * _newSound;                //!< Played as new items are presented
     NSSound * _rightSound;              //!< Played as correct answers are entered.
     NSSound * _wrongSound;              //!< Played for incorrect answers.
+    NSSound * _cueSound;                //!< Recording attached to the current cue item, if any.
 	NSWindow * _screenWindow;           //!< Semitransparent black backdrop window.
 
     GeniusItem * _visibleCueItem;       //!< Currently displayed cueItem from _currentAssociation
@@ -50,13 +52,22 @@
     NSFont * _cueItemFont;              //!< Currently used font for displaying cueItem.
     NSFont * _answerItemFont;           //!< Currently used font for displaying answerItem.
     NSColor * _answerTextColor;         //!< Currently used color for displaying answerItem.
+    NSImageView * _cueImageView;        //!< Picture of the cue item, shown in place of #cueTextView.  Created on first use.
+    NSImageView * _answerImageView;     //!< Picture of the answer item, shown in place of #answerTextView.  Created on first use.
+
+    GeniusDistractorIndex * _distractorIndex;   //!< Source of wrong answers in multiple choice quizzes, or nil to type answers.
+    NSMatrix * _choiceMatrix;                   //!< Buttons of the offered answers, shown in place of the quizMode controls.
+    NSMutableArray * _hiddenQuizViews;          //!< quizMode controls hidden while _choiceMatrix is shown.
+    GeniusItem * _chosenItem;                   //!< Answer picked from _choiceMatrix, nil when the answer was typed.
 }
 
 - (void) runQuiz:(GeniusAssociationEnumerator *)enumerator;
+- (void) setDistractorIndex:(GeniusDistractorIndex *)distractorIndex;
 
 - (GeniusItem *) visibleAnswerItem;
 
 - (IBAction)handleEntry:(id)sender;
+- (IBAction)chooseAnswer:(id)sender;
 - (IBAction)getRightYes:(id)sender;
 - (IBAction)getRightNo:(id)sender;
 - (IBAction)getRightSkip:(id)sender;
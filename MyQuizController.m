@@ -18,12 +18,14 @@
 
 #import "MyQuizController.h"
 #import "GeniusWelcomePanel.h"
-#import "NSString+Similiarity.h"
 #import "GeniusStringDiff.h"
+#import "GeniusAnswerKey.h"
 #import "GeniusPreferencesController.h"
 #import "GeniusAssociationEnumerator.h"
 #import "GeniusPair.h"
 #import "GeniusAssociation.h"
+#import "GeniusMediaStore.h"
+#import "GeniusDistractorIndex.h"
 
 
 @implementation MyQuizController
@@ -41,6 +43,7 @@
         _cueItemFont = nil;
         _answerItemFont = nil;
         _answerTextColor = nil;
+        _hiddenQuizViews = [[NSMutableArray alloc] init];
     }
     return self;
 }
@@ -52,19 +55,51 @@
     [_newSound release];
     [_rightSound release];
     [_wrongSound release];
+    [_cueSound stop];
+    [_cueSound release];
 
     [_cueItemFont release];
     [_answerItemFont release];
 
     [_enumerator release];
     [_screenWindow release];
+    [_distractorIndex release];
+    [_choiceMatrix release];
+    [_hiddenQuizViews release];
+    [_cueImageView release];
+    [_answerImageView release];
     
     [super dealloc];
 }
 
 
+//! Shows the picture attached to @a item in place of @a textField, or the text again when there is none.
+/*!
+    @a imageView is created over @a textField the first time a picture is shown.  The text of the item
+    becomes the tool tip of the picture.
+ */
+- (void) _showImageOfItem:(GeniusItem *)item inImageView:(NSImageView **)imageView replacing:(NSTextField *)textField
+{
+    NSData * imageData = [item imageData];
+    NSImage * image = (imageData ? [[[NSImage alloc] initWithData:imageData] autorelease] : nil);
+    if (image && *imageView == nil)
+    {
+        *imageView = [[NSImageView alloc] initWithFrame:[textField frame]];
+        [*imageView setImageScaling:NSScaleProportionally];
+        [*imageView setImageFrameStyle:NSImageFrameNone];
+        [*imageView setEditable:NO];
+        [*imageView setAutoresizingMask:[textField autoresizingMask]];
+        [[textField superview] addSubview:*imageView positioned:NSWindowAbove relativeTo:textField];
+    }
+    [*imageView setImage:image];
+    [*imageView setToolTip:(image ? [item stringValue] : nil)];
+    [*imageView setHidden:(image == nil)];
+    [textField setHidden:(image != nil)];
+}
+
 //! _visibleCueItem setter.
 /*!
+    Items with a picture show it instead of their text.
     Single line items are large size and centered-justified.
     Multiple line items are small size and left-justified.
     Nil items are grey color; non-nil items are black color.
@@ -87,10 +122,12 @@
 
     NSTextAlignment alignment = (useLargeSize ? NSCenterTextAlignment : NSLeftTextAlignment);
     [cueTextView setAlignment:alignment];
+    [self _showImageOfItem:item inImageView:&_cueImageView replacing:cueTextView];
 }
 
 //! _visibleAnswerItem setter.
 /*!
+    Items with a picture show it instead of their text.
     Single line items are large size (18 pt) and centered-justified.
     Multiple line items are small size (13 pt) and left-justified.
     Nil items are grey color; non-nil items are black color.
@@ -116,6 +153,7 @@
 
     NSTextAlignment alignment = (useLargeSize ? NSCenterTextAlignment : NSLeftTextAlignment);
     [answerTextView setAlignment:alignment];
+    [self _showImageOfItem:item inImageView:&_answerImageView replacing:answerTextView];
 }
 
 //! _screenWindow getter.
@@ -151,6 +189,91 @@
     return _enumerator;
 }
 
+//! _distractorIndex setter.  With an index, reviewed associations are quizzed as multiple choice questions.
+- (void) setDistractorIndex:(GeniusDistractorIndex *)distractorIndex
+{
+    [distractorIndex retain];
+    [_distractorIndex release];
+    _distractorIndex = distractorIndex;
+}
+
+//! Replaces the quizMode controls with buttons offering the answer of #_currentAssociation among look alikes.
+/*!
+    Returns NO, leaving the answer to be typed, when the deck has fewer than three wrong answers to offer.
+    GeniusPreferencesQuizChoiceCountKey gives the number of wrong answers, from three to five.
+ */
+- (BOOL) _showChoices
+{
+    if (_distractorIndex == nil)
+        return NO;
+
+    int distractorCount = [[NSUserDefaults standardUserDefaults] integerForKey:GeniusPreferencesQuizChoiceCountKey];
+    distractorCount = MAX(3, MIN(distractorCount, 5));
+    NSArray * distractors = [_distractorIndex distractorsForAssociation:_currentAssociation count:distractorCount];
+    if ([distractors count] < 3)
+        return NO;
+
+    NSMutableArray * choices = [NSMutableArray arrayWithArray:distractors];
+    [choices insertObject:[_currentAssociation answerItem] atIndex:random() % ([choices count] + 1)];
+    int row, rowCount = [choices count];
+
+    NSTabViewItem * tabItem = [evaluationTabView tabViewItemAtIndex:[evaluationTabView indexOfTabViewItemWithIdentifier:@"quizMode"]];
+    NSView * tabView = [tabItem view];
+    NSEnumerator * viewEnumerator = [[tabView subviews] objectEnumerator];
+    NSView * view;
+    while ((view = [viewEnumerator nextObject]))
+        if ([view isHidden] == NO)
+        {
+            [view setHidden:YES];
+            [_hiddenQuizViews addObject:view];
+        }
+
+    NSButtonCell * prototype = [[NSButtonCell alloc] initTextCell:@""];
+    [prototype setBezelStyle:NSRegularSquareBezelStyle];
+    [prototype setLineBreakMode:NSLineBreakByTruncatingTail];
+    NSRect frame = NSInsetRect([tabView bounds], 8.0, 4.0);
+    _choiceMatrix = [[NSMatrix alloc] initWithFrame:frame mode:NSHighlightModeMatrix prototype:prototype numberOfRows:rowCount numberOfColumns:1];
+    [prototype release];
+    [_choiceMatrix setIntercellSpacing:NSMakeSize(0.0, 4.0)];
+    [_choiceMatrix setCellSize:NSMakeSize(NSWidth(frame), (NSHeight(frame) - 4.0 * (rowCount - 1)) / rowCount)];
+    [_choiceMatrix setAutosizesCells:YES];
+    [_choiceMatrix setAutoresizingMask:(NSViewWidthSizable | NSViewHeightSizable)];
+    [_choiceMatrix setTarget:self];
+    [_choiceMatrix setAction:@selector(chooseAnswer:)];
+
+    for (row=0; row<rowCount; row++)
+    {
+        GeniusItem * item = [choices objectAtIndex:row];
+        NSString * text = [[[item stringValue] componentsSeparatedByString:@"\n"] componentsJoinedByString:@" "];
+        NSButtonCell * cell = [_choiceMatrix cellAtRow:row column:0];
+        [cell setTitle:[NSString stringWithFormat:@"%d.  %@", row + 1, text]];
+        [cell setRepresentedObject:item];
+    }
+
+    [tabView addSubview:_choiceMatrix];
+    [entryField setHidden:YES];
+    [[self window] makeFirstResponder:[self window]];   // digits pick a choice, see #keyDown:
+    return YES;
+}
+
+//! Takes down #_choiceMatrix, if shown, and brings back the controls it replaced.
+- (void) _removeChoices
+{
+    if (_choiceMatrix == nil)
+        return;
+
+    [_choiceMatrix removeFromSuperview];
+    [_choiceMatrix autorelease];    // may be sending chooseAnswer:
+    _choiceMatrix = nil;
+
+    NSEnumerator * viewEnumerator = [_hiddenQuizViews objectEnumerator];
+    NSView * view;
+    while ((view = [viewEnumerator nextObject]))
+        [view setHidden:NO];
+    [_hiddenQuizViews removeAllObjects];
+    [entryField setHidden:NO];
+}
+
 //! Puts up optional screening window and takes down other app windows.
 /*! After this is run all app windows are hidden and an optional screening window is faded into place. */
 - (void) quizSetup 
@@ -212,11 +335,51 @@
     [NSApp stopModal];
 }
 
+//! Plays the recording attached to @a cueItem, stopping the one of the previous cue.
+- (void) _playCueSound:(GeniusItem *)cueItem
+{
+    [_cueSound stop];
+    [_cueSound release];
+    _cueSound = nil;
+
+    NSData * soundData = [cueItem soundData];
+    if (soundData)
+    {
+        _cueSound = [[NSSound alloc] initWithData:soundData];
+        [_cueSound play];
+    }
+}
+
+//! Starts reading the media of the next few associations so they are in memory when presented.
+- (void) _prefetchUpcomingMedia
+{
+    NSMutableArray * urls = [NSMutableArray array];
+    NSEnumerator * associationEnumerator = [[[self enumerator] upcomingAssociations:3] objectEnumerator];
+    GeniusAssociation * association;
+    while ((association = [associationEnumerator nextObject]))
+    {
+        NSArray * items = [NSArray arrayWithObjects:[association cueItem], [association answerItem], nil];
+        NSEnumerator * itemEnumerator = [items objectEnumerator];
+        GeniusItem * item;
+        while ((item = [itemEnumerator nextObject]))
+        {
+            if ([item imageURL])
+                [urls addObject:[item imageURL]];
+            if ([item soundURL])
+                [urls addObject:[item soundURL]];
+        }
+    }
+    [GeniusMediaStore prefetchURLs:urls];
+}
+
 //! presents a single Genius Item from deck for quiz or review.  Skips items with no answer.
 - (void) runQuizOnce
 {
     [progressIndicator setDoubleValue:([progressIndicator maxValue] - [[self enumerator] remainingCount])];
 
+    [self _removeChoices];
+    _chosenItem = nil;
+
     // skip associations without answer values.
     do {
         _currentAssociation = [[self enumerator] nextAssociation];
@@ -234,6 +397,9 @@
         
         [cueTextView setNeedsDisplay:YES];
         [answerTextView setNeedsDisplay:YES];
+
+        [self _playCueSound:cueItem];
+        [self _prefetchUpcomingMedia];
         
         // Prepare window for reviewing
         if ([_currentAssociation isFirstTime])
@@ -258,6 +424,7 @@
             [entryField setEnabled:YES];
             [entryField selectText:self];
             [evaluationTabView selectTabViewItemWithIdentifier:@"quizMode"];
+            [self _showChoices];
         }
     }
     // No associations left, so time to clean up.
@@ -296,7 +463,19 @@
     return _visibleAnswerItem;
 }
 
-//! The user entered text in #entryField or hit the okay button during review.
+//! The user picked one of the answers of #_choiceMatrix.  Graded like typing it.
+- (IBAction)chooseAnswer:(id)sender
+{
+    _chosenItem = [[sender selectedCell] representedObject];
+    if (_chosenItem == nil)
+        return;
+
+    [entryField setStringValue:[_chosenItem stringValue]];
+    [self _removeChoices];
+    [self handleEntry:sender];
+}
+
+//! The user entered text in #entryField, picked a choice or hit the okay button during review.
 - (IBAction)handleEntry:(id)sender
 {
     // First end editing in-progress (from -[NSWindow endEditingFor:] documentation)
@@ -322,19 +501,23 @@
         [evaluationTabView selectTabViewItemWithIdentifier:@"checkMode"];
         NSString * inputString = [entryField stringValue];
         NSString * targetString = [answerItem stringValue];
+        GeniusAnswerKey * targetKey = [answerItem answerKey];
         
+        // The target's key is cached by the item, so only the typed answer gets normalized here.
         float correctness = 0.0;
         int matchingMode = [[NSUserDefaults standardUserDefaults] integerForKey:GeniusPreferencesQuizMatchingModeKey];
-        switch (matchingMode)
+        if (_chosenItem)
+            correctness = (float)[[_chosenItem answerKey] isEqualToAnswerKey:targetKey];
+        else switch (matchingMode)
         {
             case GeniusPreferencesQuizExactMatchingMode:
                 correctness = (float)[targetString isEqualToString:inputString];
                 break;
             case GeniusPreferencesQuizCaseInsensitiveMatchingMode:
-                correctness = (float)([targetString localizedCaseInsensitiveCompare:inputString] == NSOrderedSame);
+                correctness = (float)[[targetKey foldedString] isEqualToString:[[GeniusAnswerKey answerKeyWithString:inputString] foldedString]];
                 break;
             case GeniusPreferencesQuizSimilarMatchingMode:
-                correctness = [targetString isSimilarToString:inputString];
+                correctness = [targetKey similarityToAnswerKey:[GeniusAnswerKey answerKeyWithString:inputString]];
                 break;
             default:
                 NSAssert(NO, @"matchingMode");
@@ -343,6 +526,7 @@
 #if DEBUG
         NSLog(@"correctness = %f", correctness);
 #endif
+        [[self enumerator] setMatchScore:correctness];
         if (correctness == 1.0)
         {
             if ([[NSUserDefaults standardUserDefaults] boolForKey:GeniusPreferencesUseSoundEffectsKey])
@@ -355,7 +539,7 @@
             if ([[NSUserDefaults standardUserDefaults] boolForKey:GeniusPreferencesQuizUseVisualErrorsKey])
             {
                 // Get annotated diff string
-                NSAttributedString * attrString = [GeniusStringDiff attributedStringHighlightingDifferencesFromString:inputString toString:targetString];
+                NSAttributedString * attrString = [GeniusStringDiff attributedStringHighlightingDifferencesFromString:inputString toString:targetString answerKey:targetKey];
                 
                 NSMutableAttributedString * mutAttrString = [attrString mutableCopy];
                 NSMutableParagraphStyle * parStyle = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
@@ -433,7 +617,13 @@
 - (void) keyDown: (NSEvent *) theEvent
 {
     NSString * characters = [theEvent characters];
-    if ([characters isEqualToString:@"y"])
+    int choice = ([characters length] == 1 ? [characters intValue] : 0);
+    if (_choiceMatrix && choice >= 1 && choice <= [_choiceMatrix numberOfRows])
+    {
+        [_choiceMatrix selectCellAtRow:choice-1 column:0];
+        [self chooseAnswer:_choiceMatrix];
+    }
+    else if ([characters isEqualToString:@"y"])
         [self getRightYes:self];
     else if ([characters isEqualToString:@"n"])
         [self getRightNo:self];